@@ -60,6 +60,18 @@ class Bitmap {
          */
         size_t bitfield_size_;
 
+        /**
+         * Summary level of the bitfield. Bit i is set iff the 64-bit word i of the
+         * bitfield has no unset bit. Used to skip full words during the search
+         * for an unset bit.
+         */
+        uint64_t* summary_;
+
+        /**
+         * number of 64-Bit-Words the summary consists of
+         */
+        size_t summary_size_;
+
         /**
          * number of unset bits in the bitmap
          */
@@ -281,6 +293,23 @@ class Bitmap {
         inline size_t page(size_t pos);
 
     private:
+        /**
+         * Recalculates the summary of all words of the bitfield.
+         */
+        void RebuildSummary();
+
+        /**
+         * Finds the first word of the bitfield at or after the given word that has an unset bit.
+         *
+         * @return index of the word or bitfield_size_ if all remaining words are full
+         */
+        size_t FindNonFullWord(size_t word);
+
+        /**
+         * Finds the first unset bit in [start_position, end_position) without wrapping.
+         */
+        Option<size_t> FindUnsetInRange(size_t start_position, size_t end_position);
+
         /**
          * Write the metadata only.
          *
@@ -339,6 +368,9 @@ bool Bitmap::set(size_t position) {
             dirtyBitmap_->set(position / (page_size_ * 8));
         }
         bit_set(bitfield_ + (position / 64), position % 64);
+        if (bitfield_[position / 64] == kItemFullMask) {
+            bit_set(summary_ + (position / (64 * 64)), (position / 64) % 64);
+        }
     }
     return true;
 }
@@ -355,6 +387,7 @@ bool Bitmap::clear(size_t position) {
             dirtyBitmap_->set(position / (page_size_ * 8));
         }
         bit_clear(bitfield_ + (position / 64), position % 64);
+        bit_clear(summary_ + (position / (64 * 64)), (position / 64) % 64);
     }
     return true;
 }
@@ -23,6 +23,9 @@
 
 #include <base/base.h>
 
+#include <string>
+#include <vector>
+
 namespace dedupv1 {
 namespace base {
 
@@ -43,8 +46,14 @@ class Compression {
             COMPRESSION_ZLIB_9,//!< COMPRESSION_ZLIB_9
             COMPRESSION_BZ2,    //!< COMPRESSION_BZ2
             COMPRESSION_LZ4,
-            COMPRESSION_SNAPPY //!< Snappy Compression
+            COMPRESSION_SNAPPY, //!< Snappy Compression
+            COMPRESSION_ZSTD //!< Zstandard Compression
         };
+
+        /**
+         * Default compression level of the zstd compression
+         */
+        static const int kDefaultZstdLevel = 3;
     private:
         DISALLOW_COPY_AND_ASSIGN(Compression);
 
@@ -102,6 +111,48 @@ class Compression {
          * @return a new compression instance or NULL if case of an error
          */
         static Compression* NewCompression(enum CompressionType type);
+
+        /**
+         * Factory method to construct a new zstd compression object.
+         *
+         * If a dictionary is given, the data is compressed with the dictionary. The dictionary
+         * is also registered (see RegisterZstdDictionary) so that all zstd compression
+         * objects are able to decompress the data.
+         *
+         * @param level zstd compression level
+         * @param dictionary zstd dictionary or an empty string
+         * @return a new compression instance or NULL if case of an error
+         */
+        static Compression* NewZstdCompression(int level, const std::string& dictionary);
+
+        /**
+         * Registers a zstd dictionary for decompression. Data that has been compressed with
+         * a dictionary can only be decompressed after the dictionary has been registered.
+         * The registration is process-wide and a dictionary stays registered.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        static bool RegisterZstdDictionary(const std::string& dictionary);
+
+        /**
+         * Trains a zstd dictionary from the given samples.
+         *
+         * @param samples concatenated sample data
+         * @param sample_sizes sizes of the samples in the sample data
+         * @param dictionary_size maximal size of the dictionary
+         * @param dictionary out parameter for the dictionary
+         * @return true iff ok, otherwise an error has occurred
+         */
+        static bool TrainZstdDictionary(const std::string& samples,
+                const std::vector<size_t>& sample_sizes,
+                size_t dictionary_size,
+                std::string* dictionary);
+
+        /**
+         * Returns the id of a zstd dictionary or 0 if the dictionary is not a valid
+         * zstd dictionary.
+         */
+        static uint32_t GetZstdDictionaryId(const std::string& dictionary);
 };
 
 }
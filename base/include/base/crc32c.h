@@ -0,0 +1,120 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+/**
+ * @file crc32c.h
+ * CRC-32C (Castagnoli) checksum
+ */
+#ifndef __DEDUPV1_CRC32C_H__ // NOLINT
+#define __DEDUPV1_CRC32C_H__ // NOLINT
+
+#include <base/base.h>
+
+namespace dedupv1 {
+namespace base {
+
+/**
+ * Implementation of the CRC-32C checksum (Castagnoli polynomial).
+ *
+ * The CRC-32C is computed by the SSE 4.2 crc32 instruction on x86-64 and by the CRC32
+ * extension on ARMv8 if the processor supports it. The implementation is selected
+ * at runtime, otherwise a table-driven software implementation is used. All
+ * implementations produce the same values, so data checksummed on one machine
+ * can be verified on another.
+ *
+ * @sa http://tools.ietf.org/html/rfc3720#appendix-B.4
+ */
+class CRC32C {
+    public:
+        /**
+         * Constructor.
+         */
+        inline CRC32C();
+
+        /**
+         * Updates the checksum with the given data.
+         * It is equivalent for the final value if a data block is updated with a
+         * single call or split up into multiple update calls.
+         *
+         * @param data
+         * @param data_size
+         */
+        inline void Update(const void* data, size_t data_size);
+
+        /**
+         * Returns the raw CRC-32C value.
+         */
+        inline uint32_t GetRawValue() const;
+
+        /**
+         * Resets the checksum to calculate a new one.
+         */
+        inline void Reset();
+
+        /**
+         * Extends the CRC-32C value of some data by the given data.
+         * Extend(0, data, size) is the CRC-32C value of the data.
+         */
+        static uint32_t Extend(uint32_t crc_value, const void* data, size_t data_size);
+
+        /**
+         * Extends the CRC-32C value using the software implementation.
+         * Only used to verify the hardware implementations.
+         */
+        static uint32_t ExtendSoftware(uint32_t crc_value, const void* data, size_t data_size);
+
+        /**
+         * returns true iff the CRC-32C value is computed by processor instructions.
+         */
+        static bool IsHardwareAccelerated();
+
+        DISALLOW_COPY_AND_ASSIGN(CRC32C);
+    private:
+        uint32_t crc_value_;
+};
+
+/**
+ * Short function that calculates the CRC-32C value of the given data.
+ */
+inline uint32_t crc32c_raw(const void* value, size_t value_size);
+
+CRC32C::CRC32C() {
+    crc_value_ = 0;
+}
+
+void CRC32C::Update(const void* data, size_t data_size) {
+    crc_value_ = Extend(crc_value_, data, data_size);
+}
+
+uint32_t CRC32C::GetRawValue() const {
+    return crc_value_;
+}
+
+void CRC32C::Reset() {
+    crc_value_ = 0;
+}
+
+uint32_t crc32c_raw(const void* value, size_t value_size) {
+    return CRC32C::Extend(0, value, value_size);
+}
+
+}
+}
+
+#endif  // __DEDUPV1_CRC32C_H__ NOLINT
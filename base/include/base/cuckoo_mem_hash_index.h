@@ -0,0 +1,414 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef CUCKOO_MEM_HASH_INDEX_H__
+#define CUCKOO_MEM_HASH_INDEX_H__
+
+#include <string>
+#include <vector>
+
+#include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
+#include <tbb/spin_rw_mutex.h>
+
+#include <base/base.h>
+#include <base/index.h>
+#include <base/profile.h>
+
+namespace dedupv1 {
+namespace base {
+
+class CuckooMemHashIndex;
+
+/**
+ * Iterator over all entries of a cuckoo hash index.
+ * As with the other in-memory indexes, the iterator fails if the
+ * index is modified after the iterator has been created.
+ */
+class CuckooMemHashIndexIterator : public IndexIterator {
+        DISALLOW_COPY_AND_ASSIGN(CuckooMemHashIndexIterator);
+
+        /**
+         * Index to iterate over
+         */
+        CuckooMemHashIndex* index_;
+
+        /**
+         * Next bucket to check
+         */
+        uint64_t bucket_;
+
+        /**
+         * Next slot within the bucket to check
+         */
+        uint32_t slot_;
+
+        /**
+         * version counter at the time of creation.
+         * Used to detect concurrent changed.
+         */
+        uint64_t version_counter_;
+    public:
+        explicit CuckooMemHashIndexIterator(CuckooMemHashIndex* index);
+
+        virtual ~CuckooMemHashIndexIterator();
+
+        virtual enum lookup_result Next(void* key, size_t* key_size, google::protobuf::Message* message);
+};
+
+/**
+ * Native in-memory hash index based on bucketized cuckoo hashing.
+ *
+ * Each key has two candidate buckets with kSlotsPerBucket fixed-size
+ * slots each. A slot stores the hash, the key (up to max-key-size bytes)
+ * and a pointer into a slab allocator that holds the value. The slab uses
+ * power-of-two size classes so that values are not malloc'ed one by one.
+ *
+ * Writers are serialized by a single writer lock. When both candidate buckets are
+ * full, the writer moves entries along a cuckoo path to their alternate
+ * bucket and, if no path is found, doubles the table.
+ *
+ * Readers never take the writer lock. They use per-stripe version counters
+ * (a seqlock) that writers increment before and after each modification of a bucket
+ * and retry if a bucket was changed during the lookup. Only a table resize or Clear
+ * blocks readers.
+ */
+class CuckooMemHashIndex : public MemoryIndex {
+        DISALLOW_COPY_AND_ASSIGN(CuckooMemHashIndex);
+        friend class CuckooMemHashIndexIterator;
+
+        enum cuckoo_mem_hash_index_state {
+            CUCKOO_MEM_HASH_INDEX_STATE_CREATED,
+            CUCKOO_MEM_HASH_INDEX_STATE_STARTED
+        };
+
+        /**
+         * Header of a slot. The key bytes follow directly after the header.
+         * A slot is empty iff the key size is zero.
+         */
+        struct slot_header {
+            uint64_t hash;
+            byte* value;
+            uint32_t value_size;
+            uint8_t key_size;
+            uint8_t reserved[3];
+        };
+
+        /**
+         * Position of a slot in the table
+         */
+        struct slot_position {
+            uint64_t bucket;
+            uint32_t slot;
+        };
+
+        /**
+         * Number of slots per bucket
+         */
+        static const uint32_t kSlotsPerBucket = 4;
+
+        /**
+         * Number of version counters. Buckets are mapped to the version counters
+         * by the lower bits of the bucket id.
+         */
+        static const uint32_t kVersionStripeCount = 4096;
+
+        /**
+         * Maximal length of a cuckoo path before the table is grown.
+         */
+        static const uint32_t kMaxCuckooPathLength = 128;
+
+        /**
+         * Size of the smallest slab size class
+         */
+        static const uint32_t kMinValueChunkSize = 16;
+
+        /**
+         * Size of a slab page. Larger values get pages of their size class.
+         */
+        static const uint32_t kSlabPageSize = 1024 * 1024;
+
+        /**
+         * Default number of buckets
+         */
+        static const uint64_t kDefaultBucketCount = 1024;
+
+        /**
+         * Default maximal key size
+         */
+        static const uint32_t kDefaultMaxKeySize = 32;
+
+        /**
+         * Default maximal value size
+         */
+        static const uint32_t kDefaultMaxValueSize = 64 * 1024;
+
+        /**
+         * State of the index
+         */
+        enum cuckoo_mem_hash_index_state state_;
+
+        /**
+         * Configured number of buckets. Rounded up to a power of two.
+         */
+        uint64_t bucket_count_;
+
+        /**
+         * bucket_count_ - 1
+         */
+        uint64_t bucket_mask_;
+
+        /**
+         * Maximal key size
+         */
+        uint32_t max_key_size_;
+
+        /**
+         * Maximal value size
+         */
+        uint32_t max_value_size_;
+
+        /**
+         * Size of a slot in bytes (header plus key, aligned to 8 bytes)
+         */
+        uint32_t slot_size_;
+
+        /**
+         * Table memory with bucket_count_ * kSlotsPerBucket slots
+         */
+        byte* table_;
+
+        /**
+         * Per-stripe version counters. Odd while a writer modifies a bucket of the stripe.
+         */
+        tbb::atomic<uint32_t>* stripe_versions_;
+
+        /**
+         * Serializes all writers
+         */
+        tbb::spin_mutex writer_lock_;
+
+        /**
+         * Held shared by readers and exclusive while the table is grown or cleared.
+         */
+        tbb::spin_rw_mutex table_lock_;
+
+        /**
+         * Free value chunks per size class
+         */
+        std::vector<std::vector<byte*> > free_value_chunks_;
+
+        /**
+         * All allocated slab pages
+         */
+        std::vector<byte*> slab_pages_;
+
+        /**
+         * Memory allocated for slab pages in bytes
+         */
+        uint64_t slab_memory_size_;
+
+        /**
+         * State of the random generator used for the cuckoo path search
+         */
+        uint64_t random_state_;
+
+        tbb::atomic<uint64_t> item_count_;
+
+        tbb::atomic<uint64_t> version_counter_;
+
+        tbb::atomic<int> iterator_counter_;
+
+        /**
+         * iff true, a checksum is stored for all messages in this index.
+         * No checksum is stored for raw access
+         */
+        bool checksum_;
+
+        /**
+         * Profiling information
+         */
+        dedupv1::base::Profile update_time_;
+
+        dedupv1::base::Profile lookup_time_;
+
+        tbb::atomic<uint64_t> cuckoo_move_count_;
+
+        tbb::atomic<uint64_t> grow_count_;
+
+        tbb::atomic<uint64_t> read_retry_count_;
+
+        inline slot_header* GetSlot(uint64_t bucket, uint32_t slot);
+
+        inline byte* GetSlotKey(slot_header* header);
+
+        inline tbb::atomic<uint32_t>* GetStripeVersion(uint64_t bucket);
+
+        inline uint64_t GetAlternativeBucket(uint64_t bucket, uint64_t hash);
+
+        void BeginBucketUpdate(uint64_t bucket1, uint64_t bucket2);
+
+        void EndBucketUpdate(uint64_t bucket1, uint64_t bucket2);
+
+        static uint64_t Hash(const void* key, size_t key_size);
+
+        /**
+         * Searches the key in the given bucket.
+         * Without the writer lock, the result has to be validated against the stripe versions.
+         *
+         * @return the slot or NULL if the key is not stored in the bucket
+         */
+        slot_header* FindInBucket(uint64_t bucket, uint64_t hash, const void* key, size_t key_size);
+
+        /**
+         * Searches the key in both candidate buckets. The caller has to hold the writer lock.
+         */
+        slot_header* FindSlot(uint64_t hash, const void* key, size_t key_size, uint64_t* bucket);
+
+        /**
+         * Optimistic lookup without the writer lock.
+         * The value is either copied into the given buffer (value, value_size with
+         * the semantics of RawLookup) or, if value_string is set, into the string.
+         */
+        enum lookup_result OptimisticLookup(const void* key, size_t key_size,
+                void* value, size_t* value_size, bytestring* value_string);
+
+        /**
+         * Finds an empty slot in the given bucket
+         */
+        bool FindEmptySlot(uint64_t bucket, slot_position* position);
+
+        /**
+         * Moves the entry in slot from to the empty slot to.
+         */
+        void MoveSlot(const slot_position& from, const slot_position& to);
+
+        /**
+         * Frees an empty slot for a new entry with the given hash by moving entries
+         * along a cuckoo path. The caller has to hold the writer lock.
+         *
+         * @return true iff a slot has been freed. false if no cuckoo path has been found.
+         */
+        bool MakeRoom(uint64_t hash, slot_position* position);
+
+        /**
+         * Doubles the number of buckets. The caller has to hold the writer lock.
+         */
+        bool Grow();
+
+        /**
+         * Inserts or updates the entry. The caller has to hold the writer lock.
+         */
+        enum put_result InternalPut(const void* key, size_t key_size,
+                const void* value, size_t value_size, bool keep_existing);
+
+        /**
+         * Replaces the value of an existing entry. The caller has to hold the writer lock.
+         */
+        void UpdateValue(uint64_t bucket, slot_header* header, const void* value, size_t value_size);
+
+        int GetSizeClass(size_t value_size);
+
+        byte* AllocateValue(size_t value_size);
+
+        void FreeValue(byte* value, size_t value_size);
+
+        void FreeSlabs();
+
+        uint64_t NextRandom();
+    public:
+        CuckooMemHashIndex();
+
+        virtual ~CuckooMemHashIndex();
+
+        static Index* CreateIndex();
+
+        static void RegisterIndex();
+
+        /**
+         *
+         * Available options:
+         * - bucket-count: StorageUnit (initial number of buckets, the table grows if necessary)
+         * - max-key-size: StorageUnit (<= 255)
+         * - max-value-size: StorageUnit
+         * - checksum: Boolean
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool SetOption(const std::string& option_name, const std::string& option);
+
+        /**
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool Start(const dedupv1::StartContext& start_context);
+
+        virtual IndexIterator* CreateIterator();
+
+        virtual enum lookup_result Lookup(const void* key, size_t key_size,
+                google::protobuf::Message* message);
+
+        virtual enum put_result Put(const void* key, size_t key_size,
+                const google::protobuf::Message& message);
+
+        virtual enum put_result PutIfAbsent(
+                const void* key, size_t key_size,
+                const google::protobuf::Message& message);
+
+        virtual enum delete_result Delete(const void* key, size_t key_size);
+
+        virtual uint64_t GetItemCount();
+
+        /**
+         * Returns the memory used by the bucket table, the version counters and all
+         * allocated slab pages.
+         */
+        virtual uint64_t GetMemorySize();
+
+        virtual bool Clear();
+
+        virtual std::string PrintProfile();
+
+        virtual std::string PrintTrace();
+
+        virtual enum put_result RawPutIfAbsent(
+                const void* key, size_t key_size,
+                const void* value, size_t value_size);
+
+        virtual enum put_result RawPut(
+                const void* key, size_t key_size,
+                const void* value, size_t value_size);
+
+        virtual enum lookup_result RawLookup(const void* key, size_t key_size,
+                void* value, size_t* value_size);
+
+        virtual enum put_result CompareAndSwap(const void* key, size_t key_size,
+                const google::protobuf::Message& message,
+                const google::protobuf::Message& compare_message,
+                google::protobuf::Message* result_message);
+
+        inline uint64_t bucket_count() const {
+            return bucket_count_;
+        }
+};
+
+}
+}
+
+#endif  // CUCKOO_MEM_HASH_INDEX_H__
@@ -36,6 +36,7 @@
 #include <base/profile.h>
 #include <base/locks.h>
 #include <base/fileutil.h>
+#include <base/io_scheduler.h>
 
 #include <gtest/gtest_prod.h>
 
@@ -45,7 +46,7 @@ namespace dedupv1 {
 namespace base {
 
 class DiskHashIndex;
-class TCMemHashIndex;
+class DiskHashIndexBulkLoader;
 
 namespace internal {
 
@@ -339,6 +340,19 @@ class DiskHashPage {
         enum put_result Update(const void* key, size_t key_size,
                 const google::protobuf::Message& message, bool keep = false);
 
+        /**
+         * Updates the given key in the page with an already serialized value.
+         * Used by the bulk loader that handles the values in serialized form.
+         *
+         * @param key
+         * @param key_size
+         * @param value serialized message
+         * @param value_size
+         * @return
+         */
+        enum put_result RawUpdate(const void* key, size_t key_size,
+                const void* value, size_t value_size);
+
         /**
          * Merges a cache with a cache page with the intent for writting it back
          */
@@ -544,6 +558,7 @@ class DiskHashIndex : public PersistentIndex {
     friend class internal::DiskHashPage;
     friend class internal::DiskHashIndexTransactionSystem;
     friend class internal::DiskHashIndexTransaction;
+    friend class DiskHashIndexBulkLoader;
     friend class DiskHashIndexTest;
     FRIEND_TEST(DiskHashIndexTest, GetFileSequential);
     FRIEND_TEST(DiskHashIndexTest, RecoverItemCount);
@@ -782,6 +797,17 @@ class DiskHashIndex : public PersistentIndex {
      */
     bool crc_;
 
+    /**
+     * Checksum type of the pages. The configured type is only used for newly created
+     * indexes, existing indexes use the type stored in the info file.
+     */
+    DiskHashChecksumType checksum_type_;
+
+    /**
+     * Calculates the checksum of the page data with the checksum type of the index.
+     */
+    uint32_t CalculatePageChecksum(const void* data, size_t data_size) const;
+
     /**
      * Subsystem to allow transactions.
      * If the system crashes in the middle of a write, the system might get in an incorrect state.
@@ -806,7 +832,14 @@ class DiskHashIndex : public PersistentIndex {
      *
      * The client of the write back cache is responsible for the cache eviction policy.
      */
-    dedupv1::base::TCMemHashIndex* write_back_cache_;
+    dedupv1::base::MemoryIndex* write_back_cache_;
+
+    /**
+     * Optional per-file I/O scheduler.
+     * If set, all page reads and writes are submitted through the per-file submission
+     * queues of the scheduler. NULL if not configured.
+     */
+    IOScheduler* io_scheduler_;
 
     /**
      * maximal number of pages cached by the write back cache
@@ -1102,11 +1135,15 @@ class DiskHashIndex : public PersistentIndex {
      * - max-key-size: size_t
      * - max-value-size: size_t
      * - checksum: Boolean
+     * - checksum-type: String (crc32, crc32c)
      * - estimated-max-fill-ratio: Double, >0 & <1 (has to be checked)
      * - overflow-area: String
      * - overflow-area.: String
-     * - write-cache: String
+     * - write-cache: Boolean
+     * - write-cache.type: String (in-memory index type of the cache, default tc-mem-hash)
      * - write-cache.: String
+     * - io-scheduler: Boolean, one I/O submission thread per file (see IOScheduler)
+     * - io-scheduler.: String
      * - transactions.: String
      *
      * @param option_name
@@ -1292,6 +1329,15 @@ class DiskHashIndex : public PersistentIndex {
      */
     virtual IndexIterator* CreateIterator();
 
+    /**
+     * Creates a new bulk loader for the index.
+     * The client is responsible to delete the loader.
+     *
+     * @param max_memory memory used by the loader before sorted runs are spilled to disk
+     * @return a new bulk loader or NULL if an error occurred.
+     */
+    DiskHashIndexBulkLoader* CreateBulkLoader(uint64_t max_memory);
+
     /**
      * Returns the index of the page bucket into which the key data would be stored.
      * This is not a kind of test that the key is stored there, but if the key
@@ -0,0 +1,236 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef DISK_HASH_INDEX_BULK_LOADER_H__
+#define DISK_HASH_INDEX_BULK_LOADER_H__
+
+#include <vector>
+#include <string>
+
+#include <base/base.h>
+#include <base/index.h>
+#include <base/fileutil.h>
+
+#include <google/protobuf/message.h>
+
+namespace dedupv1 {
+namespace base {
+
+class DiskHashIndex;
+
+/**
+ * Loads a large number of key/value pairs into a disk-based hash index.
+ *
+ * Instead of a random read/modify/write cycle for each entry as done by Put, the
+ * entries are collected and partitioned by bucket. If the configured memory is
+ * exhausted, the current run is sorted by bucket and spilled to a temporary run file next
+ * to the first index file. In Finish, all runs are merged in bucket order and each
+ * affected page is read and written exactly once in file order.
+ *
+ * The transaction system is bypassed. Before the first page is written, all transaction areas
+ * are cleared so that no old transaction is replayed over a bulk loaded page. At the end, all
+ * index files are synced once and the item count is persisted by a single transaction.
+ *
+ * An entry that is put multiple times has the value of the last put.
+ *
+ * The index must not be used by other threads while a bulk load is running. A crash
+ * during a bulk load leaves the index with a subset of the loaded entries, so the
+ * bulk load should be repeated.
+ */
+class DiskHashIndexBulkLoader {
+        DISALLOW_COPY_AND_ASSIGN(DiskHashIndexBulkLoader);
+
+        /**
+         * Size of the buffers used to write and read the run files
+         */
+        static const size_t kRunBufferSize = 1024 * 1024;
+
+        /**
+         * Size of the header of an entry in the memory and the run files:
+         * bucket id (8 byte), key size (4 byte), value size (4 byte).
+         */
+        static const size_t kEntryHeaderSize = 16;
+
+        /**
+         * Reference to an entry in the data buffer
+         */
+        class EntryRef {
+            public:
+                uint64_t bucket_id;
+                size_t offset;
+
+                bool operator<(const EntryRef& e) const {
+                    return bucket_id < e.bucket_id;
+                }
+        };
+
+        /**
+         * Sequential reader of a sorted run, either a run file or the in-memory run.
+         */
+        class RunReader {
+                DISALLOW_COPY_AND_ASSIGN(RunReader);
+                File* file_;
+                uint64_t file_size_;
+                uint64_t file_offset_;
+                bytestring buffer_;
+                size_t buffer_pos_;
+
+                const bytestring* memory_data_;
+                const std::vector<EntryRef>* memory_entries_;
+                size_t memory_pos_;
+
+                const byte* current_;
+                bool end_;
+
+                bool Fill(size_t size);
+            public:
+                /**
+                 * Reader of a run file
+                 */
+                RunReader(File* file, uint64_t file_size);
+
+                /**
+                 * Reader of the in-memory run
+                 */
+                RunReader(const bytestring* data, const std::vector<EntryRef>* entries);
+
+                /**
+                 * Moves to the next entry.
+                 */
+                bool Next();
+
+                inline bool end() const {
+                    return end_;
+                }
+
+                uint64_t bucket_id() const;
+                const void* key() const;
+                size_t key_size() const;
+                const void* value() const;
+                size_t value_size() const;
+        };
+
+        DiskHashIndex* index_;
+
+        /**
+         * maximal memory used for the in-memory run
+         */
+        uint64_t max_memory_;
+
+        /**
+         * Entry data of the in-memory run: header, key, and value per entry
+         */
+        bytestring data_;
+
+        /**
+         * Entries of the in-memory run
+         */
+        std::vector<EntryRef> entries_;
+
+        std::vector<std::string> run_filenames_;
+
+        std::vector<File*> run_files_;
+
+        std::vector<uint64_t> run_file_sizes_;
+
+        /**
+         * Number of entries put into the loader
+         */
+        uint64_t entry_count_;
+
+        /**
+         * Number of pages written by Finish
+         */
+        uint64_t page_count_;
+
+        bool finished_;
+
+        /**
+         * Sorts the in-memory run and writes it to a new run file
+         */
+        bool SpillRun();
+
+        /**
+         * Applies all entries of the given bucket from all runs to the page and writes the page.
+         */
+        bool LoadBucket(uint64_t bucket_id, std::vector<RunReader*>* readers, byte* page_buffer);
+
+        /**
+         * Persists the item count by a transaction that rewrites the given page unchanged.
+         */
+        bool PersistItemCount(uint64_t bucket_id, byte* page_buffer);
+
+        bool RemoveRunFiles();
+    public:
+        /**
+         * Default memory used for the in-memory run
+         */
+        static const uint64_t kDefaultMaxMemory = 64 * 1024 * 1024;
+
+        /**
+         * Constructor.
+         * @param index started disk-based hash index
+         * @param max_memory memory used for the in-memory run before it is spilled to disk
+         */
+        DiskHashIndexBulkLoader(DiskHashIndex* index, uint64_t max_memory);
+
+        /**
+         * Destructor. Removes the run files if Finish has not been called.
+         */
+        ~DiskHashIndexBulkLoader();
+
+        /**
+         * Adds an entry to the bulk load.
+         * The entry is not visible in the index before Finish returned.
+         */
+        enum put_result Put(const void* key, size_t key_size,
+                const google::protobuf::Message& message);
+
+        /**
+         * Adds an entry with an already serialized value to the bulk load.
+         */
+        enum put_result RawPut(const void* key, size_t key_size,
+                const void* value, size_t value_size);
+
+        /**
+         * Writes all entries to the index.
+         * The loader cannot be used after Finish.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Finish();
+
+        inline uint64_t entry_count() const {
+            return entry_count_;
+        }
+
+        inline uint64_t run_count() const {
+            return run_files_.size();
+        }
+
+        inline uint64_t page_count() const {
+            return page_count_;
+        }
+};
+
+}
+}
+
+#endif  // DISK_HASH_INDEX_BULK_LOADER_H__
@@ -219,6 +219,16 @@ class DiskHashIndexTransactionSystem {
          */
         bool Start(const dedupv1::StartContext& start_context, bool allow_restore);
 
+        /**
+         * Removes the data of all transaction areas so that no transaction is restored
+         * after a restart. Used when pages are written without transactions, e.g. by the
+         * bulk loader, because an old transaction of a bucket would otherwise be applied over the
+         * newer page data.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool ClearTransactionAreas();
+
         /**
          * Returns the pointer the the base index
          * @return
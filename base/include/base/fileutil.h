@@ -30,6 +30,7 @@
 
 #include <stdio.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <string>
 #include <vector>
 #include <unistd.h>
@@ -239,6 +240,31 @@ class File {
          */
         ssize_t Write(const void* data, size_t size);
 
+        /**
+         * Reads data at the given offset into multiple buffers (scatter read).
+         * The buffers are filled in order as if they were a single contiguous buffer.
+         *
+         * The call is interrupted safe in the sense that it is retried, when EINTR is returned.
+         *
+         * @param offset
+         * @param iov
+         * @param iovcnt
+         * @return number of bytes read or kIOError
+         */
+        ssize_t ReadV(off_t offset, const struct iovec* iov, int iovcnt);
+
+        /**
+         * Writes data from multiple buffers at the given offset (gather write).
+         *
+         * The call is interrupted safe in the sense that it is retried, when EINTR is returned.
+         *
+         * @param offset
+         * @param iov
+         * @param iovcnt
+         * @return number of bytes written or kIOError
+         */
+        ssize_t WriteV(off_t offset, const struct iovec* iov, int iovcnt);
+
         /**
          *
          * The call is interrupted safe in the sense that it is retried, when EINTR is returned.
@@ -288,6 +314,13 @@ class File {
          */
         bool Sync();
 
+        /**
+         * Syncs the data of a file, but only the metadata that is
+         * necessary to read the data back (fdatasync).
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool DataSync();
+
         /**
          * returns the path.
          * @return
@@ -36,6 +36,7 @@
 #include <base/index.h>
 #include <base/profile.h>
 #include <base/fileutil.h>
+#include <base/io_scheduler.h>
 
 namespace dedupv1 {
 namespace base {
@@ -136,6 +137,12 @@ class FixedIndex : public IDBasedIndex {
         dedupv1::base::Profile profiling;
         dedupv1::base::Profile disk_time;
 
+        /**
+         * Optional scheduler that merges the bucket requests of concurrent
+         * threads per file. NULL if the buckets are read and written directly.
+         */
+        IOScheduler* io_scheduler;
+
         /**
          * version counter. The version counter is changed each time
          * the index is changed
@@ -154,6 +161,14 @@ class FixedIndex : public IDBasedIndex {
                 int64_t global_id,
                 const google::protobuf::Message& message);
 
+        /**
+         * Writes the serialized bucket data at the given offset, either
+         * directly or via the io scheduler if configured.
+         *
+         * @return number of written bytes or -1 on error
+         */
+        ssize_t WriteBucketData(dedupv1::base::File* file, off_t offset, const google::protobuf::Message& data);
+
         /**
          * Reads a bucket
          */
@@ -202,6 +217,8 @@ class FixedIndex : public IDBasedIndex {
          * - filename: String with file where the transaction data is stored (multi)
          * - width: StorageUnit
          * - size: StorageUnit
+         * - io-scheduler: Boolean, one I/O submission thread per file (see IOScheduler)
+         * - io-scheduler.*: String
          */
         bool SetOption(const std::string& option_name, const std::string& option);
 
@@ -0,0 +1,331 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+/**
+ * @file io_scheduler.h
+ * Per-file I/O submission queues with request coalescing
+ */
+
+#ifndef IO_SCHEDULER_H__
+#define IO_SCHEDULER_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <tbb/atomic.h>
+#include <tbb/tick_count.h>
+
+#include <base/base.h>
+#include <base/locks.h>
+#include <base/thread.h>
+#include <base/fileutil.h>
+#include <base/profile.h>
+#include <base/sliding_average.h>
+
+namespace dedupv1 {
+namespace base {
+
+/**
+ * The I/O scheduler serializes all synchronous reads and writes to a file
+ * through a dedicated submission thread per file. Files on the same device
+ * have separate queues, so requests to different files are neither ordered nor merged.
+ *
+ * Without the scheduler, every thread of the thread pool can issue a pread/pwrite
+ * to any file at any point in time. There is no way to control the queue depth
+ * per file and adjacent requests are never merged.
+ *
+ * With the scheduler, clients enqueue requests into the queue of the file and wait
+ * until the submission thread has processed them. The submission thread
+ * processes the pending requests in ascending offset order (one-way elevator) and merges
+ * requests of the same type with adjacent file regions into a single vectored I/O call.
+ * The number of pending requests per file is bounded by the queue depth. Clients block
+ * if the queue of a file is full.
+ *
+ * The scheduler is optional for all components. If a component has no scheduler configured,
+ * the files are accessed directly.
+ *
+ * All files have to be registered before the scheduler is started.
+ *
+ * Available options:
+ * - queue-depth: uint32_t, maximal number of pending requests per file
+ * - max-merge-size: StorageUnit, maximal size of a merged request
+ *
+ * Thread safety: Read and Write can be called concurrently from multiple threads.
+ */
+class IOScheduler {
+        DISALLOW_COPY_AND_ASSIGN(IOScheduler);
+    public:
+        /**
+         * Default maximal number of pending requests per file
+         */
+        static const uint32_t kDefaultQueueDepth = 32;
+
+        /**
+         * Default maximal size of a merged request
+         */
+        static const size_t kDefaultMaxMergeSize = 1024 * 1024;
+
+        /**
+         * Maximal number of requests merged into a single I/O call.
+         * The value is below the IOV_MAX of all supported platforms.
+         */
+        static const int kMaxMergeCount = 256;
+
+    private:
+        /**
+         * States of the scheduler
+         */
+        enum io_scheduler_state {
+            CREATED,
+            STARTED,
+            STOPPED
+        };
+
+        /**
+         * Type of an I/O request
+         */
+        enum request_type {
+            REQUEST_READ,
+            REQUEST_WRITE
+        };
+
+        /**
+         * A single client request.
+         * The request is owned by the submitting client thread.
+         */
+        struct Request {
+            enum request_type type_;
+            off_t offset_;
+            byte* data_;
+            size_t size_;
+
+            /**
+             * number of bytes processed or File::kIOError
+             */
+            ssize_t result_;
+
+            /**
+             * set by the submission thread after the request has been processed.
+             */
+            bool done_;
+
+            tbb::tick_count submit_time_;
+        };
+
+        /**
+         * Submission queue and statistics of a single file.
+         */
+        class FileQueue {
+            public:
+                explicit FileQueue(File* file);
+
+                ~FileQueue();
+
+                File* file_;
+
+                /**
+                 * protects the pending requests and the done state of all requests
+                 */
+                MutexLock lock_;
+
+                /**
+                 * signaled when a new request is queued
+                 */
+                Condition work_condition_;
+
+                /**
+                 * signaled when requests are processed
+                 */
+                Condition done_condition_;
+
+                /**
+                 * signaled when there is free space in the queue
+                 */
+                Condition space_condition_;
+
+                /**
+                 * pending requests sorted by offset.
+                 * protected by lock_
+                 */
+                std::multimap<off_t, Request*> pending_;
+
+                /**
+                 * offset at which the last submitted I/O ended. Used
+                 * for the elevator ordering.
+                 */
+                off_t head_position_;
+
+                Thread<bool>* thread_;
+
+                tbb::atomic<uint64_t> read_count_;
+                tbb::atomic<uint64_t> write_count_;
+
+                /**
+                 * number of I/O calls issued by the submission thread
+                 */
+                tbb::atomic<uint64_t> submit_count_;
+
+                /**
+                 * number of requests that have been merged into the I/O of another request
+                 */
+                tbb::atomic<uint64_t> merged_count_;
+
+                /**
+                 * number of times a client had to wait because the queue was full
+                 */
+                tbb::atomic<uint64_t> queue_full_count_;
+
+                tbb::atomic<uint64_t> io_error_count_;
+
+                tbb::atomic<uint32_t> max_queue_length_;
+
+                /**
+                 * average latency of a request from the submission to the completion in ms
+                 */
+                SimpleSlidingAverage average_latency_;
+
+                /**
+                 * average number of queued requests seen at submission time
+                 */
+                SimpleSlidingAverage average_queue_length_;
+
+                Profile io_time_;
+            private:
+                DISALLOW_COPY_AND_ASSIGN(FileQueue);
+        };
+
+        volatile enum io_scheduler_state state_;
+
+        /**
+         * Maximal number of pending requests per file
+         */
+        uint32_t queue_depth_;
+
+        /**
+         * Maximal size of a merged request
+         */
+        size_t max_merge_size_;
+
+        std::vector<FileQueue*> queues_;
+
+        /**
+         * Map from a file to its queue.
+         * The map is only modified before the start.
+         */
+        std::map<const File*, FileQueue*> queue_map_;
+
+        /**
+         * Runner of the submission threads
+         */
+        bool Loop(FileQueue* queue);
+
+        /**
+         * Removes the next batch of mergeable requests from the
+         * pending requests of the file. The queue lock must be held.
+         */
+        void NextBatch(FileQueue* queue, std::vector<Request*>* batch);
+
+        /**
+         * Executes a batch of adjacent requests with a single I/O call.
+         * No lock should be held.
+         */
+        ssize_t ExecuteBatch(FileQueue* queue, const std::vector<Request*>& batch);
+
+        ssize_t Submit(File* file, enum request_type type, off_t offset, byte* data, size_t size);
+    public:
+        /**
+         * Constructor
+         */
+        IOScheduler();
+
+        /**
+         * Destructor.
+         * Stops the submission threads if necessary.
+         */
+        ~IOScheduler();
+
+        /**
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool SetOption(const std::string& option_name, const std::string& option);
+
+        /**
+         * Registers a file with an own submission queue and submission thread.
+         * Must be called before the start.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool RegisterFile(File* file);
+
+        /**
+         * Starts the submission threads.
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Start();
+
+        /**
+         * Stops the submission threads. All pending requests are processed before.
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Stop();
+
+        /**
+         * Reads data from the given registered file. The call blocks until the
+         * request has been processed by the submission thread.
+         *
+         * @return number of bytes read or File::kIOError
+         */
+        ssize_t Read(File* file, off_t offset, void* data, size_t size);
+
+        /**
+         * Writes data to the given registered file. The call blocks until the
+         * request has been processed by the submission thread.
+         *
+         * @return number of bytes written or File::kIOError
+         */
+        ssize_t Write(File* file, off_t offset, const void* data, size_t size);
+
+        /**
+         * returns true iff the given file is handled by the scheduler.
+         */
+        bool IsRegistered(const File* file) const;
+
+        inline bool IsStarted() const;
+
+        inline uint32_t queue_depth() const;
+
+        std::string PrintStatistics();
+
+        std::string PrintProfile();
+};
+
+bool IOScheduler::IsStarted() const {
+    return state_ == STARTED;
+}
+
+uint32_t IOScheduler::queue_depth() const {
+    return queue_depth_;
+}
+
+}
+}
+
+#endif  // IO_SCHEDULER_H__
@@ -34,6 +34,7 @@
 #include <base/hash_index.h>
 #include <base/tc_hash_index.h>
 #include <base/tc_hash_mem_index.h>
+#include <base/cuckoo_mem_hash_index.h>
 #include <base/tc_btree_index.h>
 #include <base/tc_fixed_index.h>
 #include <base/fixed_index.h>
@@ -82,6 +83,7 @@ void RegisterDefaults() {
     dedupv1::base::TCHashIndex::RegisterIndex();
     dedupv1::base::TCBTreeIndex::RegisterIndex();
     dedupv1::base::TCMemHashIndex::RegisterIndex();
+    dedupv1::base::CuckooMemHashIndex::RegisterIndex();
     dedupv1::base::TCFixedIndex::RegisterIndex();
     dedupv1::base::FixedIndex::RegisterIndex();
     dedupv1::base::SqliteIndex::RegisterIndex();
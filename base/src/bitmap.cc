@@ -45,6 +45,11 @@ Bitmap::Bitmap(size_t size) {
     page_size_ = 0;
     dirtyBitmap_ = NULL;
     bitfield_ = new uint64_t[bitfield_size_];
+    summary_size_ = bitfield_size_ / 64;
+    if ((bitfield_size_ % 64) > 0) {
+        summary_size_++;
+    }
+    summary_ = new uint64_t[summary_size_];
     ClearAll();
     dirty_ = true;
 }
@@ -52,6 +57,8 @@ Bitmap::Bitmap(size_t size) {
 Bitmap::~Bitmap() {
     if (bitfield_)
         delete[] bitfield_;
+    if (summary_)
+        delete[] summary_;
     if (key_)
         delete[] key_;
     if (dirtyBitmap_) {
@@ -112,6 +119,8 @@ bool Bitmap::Load(bool crashed) {
         }
     }
 
+    RebuildSummary();
+
     if (crashed) {
         clean_bits_ = bitfield_size_ * 64;
         for (size_t i = 0; i < bitfield_size_; i++) {
@@ -222,6 +231,7 @@ void Bitmap::ClearAll() {
             bit_set(bitfield_ + bitfield_size_ - 1, i);
         }
     }
+    RebuildSummary();
     clean_bits_ = size_;
     dirty_ = true;
     if (persistent_index_) {
@@ -233,6 +243,7 @@ void Bitmap::ClearAll() {
 bool Bitmap::SetAll() {
     memset(bitfield_, 0xFF, bitfield_size_ * sizeof(uint64_t));
     // I set all unreachabe bit, so I have not to tread this special during search
+    RebuildSummary();
     clean_bits_ = 0;
     dirty_ = true;
     if (persistent_index_) {
@@ -251,6 +262,7 @@ bool Bitmap::Negate() {
             bit_set(bitfield_ + bitfield_size_ - 1, i);
         }
     }
+    RebuildSummary();
     if (persistent_index_) {
         dirtyBitmap_->SetAll();
     }
@@ -290,77 +302,78 @@ bool Bitmap::setPersistence(PersistentIndex* persistent_index, const void* key_p
     return true;
 }
 
-Option<size_t> Bitmap::find_next_unset(size_t start_position, size_t end_position) {
-    CHECK(start_position < size_, "Startposition has to be smaller then size");
-    CHECK(end_position <= size_, "Endposition has to be smaller or equal to size");
+void Bitmap::RebuildSummary() {
+    memset(summary_, 0, summary_size_ * sizeof(uint64_t));
+    for (size_t i = 0; i < bitfield_size_; i++) {
+        if (bitfield_[i] == kItemFullMask) {
+            bit_set(summary_ + (i / 64), i % 64);
+        }
+    }
+    // as in the bitfield, the summary bits of not existing words are set, so that they are never found
+    if ((bitfield_size_ % 64) > 0) {
+        for (size_t i = bitfield_size_ % 64; i < 64; i++) {
+            bit_set(summary_ + summary_size_ - 1, i);
+        }
+    }
+}
 
-    // At many cases here we do not have to deal the last entry of bitfield in a special way, as invalid positions are set to one
-    // We could improve the speed by changing the layout:
-    // If we allow only to search for 1 values we could invert the whole Bitmap, so we would compare to 0 and would not have to negate the entries.
+size_t Bitmap::FindNonFullWord(size_t word) {
+    size_t summary_pos = word / 64;
+    if (summary_pos >= summary_size_) {
+        return bitfield_size_;
+    }
+    uint64_t or_mask = (uint64_t(1) << (word % 64)) - 1;
+    uint64_t test_line = ~(summary_[summary_pos] | or_mask);
+    while (test_line == 0) {
+        summary_pos++;
+        if (summary_pos >= summary_size_) {
+            return bitfield_size_;
+        }
+        test_line = ~(summary_[summary_pos]);
+    }
+    return (summary_pos * 64) + (__builtin_ffsll(test_line) - 1);
+}
 
-    // We could also change the value directly here, so it is less expensible then a following set
+Option<size_t> Bitmap::FindUnsetInRange(size_t start_position, size_t end_position) {
+    if (start_position >= end_position) {
+        return false;
+    }
+    size_t word = start_position / 64;
+    uint64_t or_mask = (uint64_t(1) << (start_position % 64)) - 1;
+    uint64_t test_line = ~(bitfield_[word] | or_mask);
+    if (test_line == 0) {
+        // the summary allows to skip 64 full words with a single test
+        word = FindNonFullWord(word + 1);
+        if (word >= bitfield_size_) {
+            return false;
+        }
+        test_line = ~(bitfield_[word]);
+    }
+    size_t pos = (word * 64) + (__builtin_ffsll(test_line) - 1);
+    if (likely(pos < end_position)) {
+        return make_option(pos);
+    }
+    return false;
+}
 
-    // This method is implemented to be fast, therefore the code is quite long.
+Option<size_t> Bitmap::find_next_unset(size_t start_position, size_t end_position) {
+    CHECK(start_position < size_, "Startposition has to be smaller then size");
+    CHECK(end_position <= size_, "Endposition has to be smaller or equal to size");
 
+    // Unreachable bits are set in the bitfield and in the summary. Therefore the last
+    // word does not need a special treatment.
     size_t end = end_position;
     if (end_position <= start_position)
         end = size_;
-    size_t page_pos = start_position / 64;
-    size_t pos_in_page = start_position % 64;
-    size_t iterator = page_pos * 64;
-
-    // Search in first 64-Bit entry
-    if (pos_in_page != 0) {
-        uint64_t or_mask = (uint64_t(1) << pos_in_page) - 1;
-        uint64_t test_line = ~(bitfield_[page_pos] | or_mask);
-        if (test_line != 0) {
-            int pos = __builtin_ffsll(test_line) - 1;
-            iterator += pos;
-            if (likely(iterator < end)) {
-                return make_option(iterator);
-            }
-            return false;
-        }
-        iterator += 64;
-        pos_in_page = 0;
-        page_pos++;
-    }
 
-    // Now search between end of first page to end
-    while (iterator < end) {
-        if (bitfield_[page_pos] == kItemFullMask) {
-            page_pos++;
-            iterator += 64;
-        } else {
-            int pos = __builtin_ffsll(~(bitfield_[page_pos])) - 1;
-            iterator += pos;
-            if (likely(iterator < end)) {
-                return make_option(iterator);
-            }
-            return false;
-        }
+    Option<size_t> pos = FindUnsetInRange(start_position, end);
+    if (pos.valid()) {
+        return pos;
     }
 
     // Now search from the beginning to end_position
     if ((end > end_position) && (end_position > 0)) {
-        // now we have to rap the search
-        iterator = 0;
-        page_pos = 0;
-        end = end_position;
-
-        while (iterator < end) {
-            if (bitfield_[page_pos] == kItemFullMask) {
-                page_pos++;
-                iterator += 64;
-            } else {
-                int pos = __builtin_ffsll(~(bitfield_[page_pos])) - 1;
-                iterator += pos;
-                if (likely(iterator < end)) {
-                    return make_option(iterator);
-                }
-                return false;
-            }
-        }
+        return FindUnsetInRange(0, end_position);
     }
 
     // No unset element found
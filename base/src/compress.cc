@@ -26,6 +26,14 @@
 #include "bzlib.h"
 #include "snappy.h"
 #include "lz4.h"
+#include "zstd.h"
+#include "zdict.h"
+
+#include <map>
+#include <vector>
+
+#include <tbb/spin_mutex.h>
+#include <tbb/spin_rw_mutex.h>
 
 #include <base/compress.h>
 #include <base/logging.h>
@@ -34,6 +42,9 @@
 LOGGER("Compression");
 
 using dedupv1::base::sha1;
+using std::map;
+using std::string;
+using std::vector;
 
 namespace dedupv1 {
 namespace base {
@@ -305,6 +316,235 @@ public:
     DISALLOW_COPY_AND_ASSIGN(SnappyCompression);
 };
 
+namespace {
+
+/**
+ * registered zstd dictionaries for the decompression.
+ * The dictionaries are never removed.
+ */
+map<uint32_t, ZSTD_DDict*> zstd_dictionaries;
+
+/**
+ * protects the registered zstd dictionaries
+ */
+tbb::spin_rw_mutex zstd_dictionaries_lock;
+
+ZSTD_DDict* GetZstdDictionary(uint32_t dictionary_id) {
+    tbb::spin_rw_mutex::scoped_lock scoped_lock(zstd_dictionaries_lock, false);
+    map<uint32_t, ZSTD_DDict*>::iterator i = zstd_dictionaries.find(dictionary_id);
+    if (i == zstd_dictionaries.end()) {
+        return NULL;
+    }
+    return i->second;
+}
+
+/**
+ * Maximal number of idle zstd contexts of each kind that are kept for reuse.
+ * Creating a context allocates several hundred KB, so the contexts are not created per chunk.
+ */
+const size_t kMaxZstdContextPoolSize = 64;
+
+/**
+ * idle zstd compression contexts. A context is used by a single thread at a time.
+ */
+vector<ZSTD_CCtx*> zstd_cctx_pool;
+
+/**
+ * protects the idle zstd compression contexts
+ */
+tbb::spin_mutex zstd_cctx_pool_lock;
+
+/**
+ * idle zstd decompression contexts. A context is used by a single thread at a time.
+ */
+vector<ZSTD_DCtx*> zstd_dctx_pool;
+
+/**
+ * protects the idle zstd decompression contexts
+ */
+tbb::spin_mutex zstd_dctx_pool_lock;
+
+ZSTD_CCtx* AcquireZstdCCtx() {
+    tbb::spin_mutex::scoped_lock scoped_lock(zstd_cctx_pool_lock);
+    if (!zstd_cctx_pool.empty()) {
+        ZSTD_CCtx* context = zstd_cctx_pool.back();
+        zstd_cctx_pool.pop_back();
+        return context;
+    }
+    scoped_lock.release();
+    return ZSTD_createCCtx();
+}
+
+void ReleaseZstdCCtx(ZSTD_CCtx* context) {
+    tbb::spin_mutex::scoped_lock scoped_lock(zstd_cctx_pool_lock);
+    if (zstd_cctx_pool.size() < kMaxZstdContextPoolSize) {
+        zstd_cctx_pool.push_back(context);
+        return;
+    }
+    scoped_lock.release();
+    ZSTD_freeCCtx(context);
+}
+
+ZSTD_DCtx* AcquireZstdDCtx() {
+    tbb::spin_mutex::scoped_lock scoped_lock(zstd_dctx_pool_lock);
+    if (!zstd_dctx_pool.empty()) {
+        ZSTD_DCtx* context = zstd_dctx_pool.back();
+        zstd_dctx_pool.pop_back();
+        return context;
+    }
+    scoped_lock.release();
+    return ZSTD_createDCtx();
+}
+
+void ReleaseZstdDCtx(ZSTD_DCtx* context) {
+    tbb::spin_mutex::scoped_lock scoped_lock(zstd_dctx_pool_lock);
+    if (zstd_dctx_pool.size() < kMaxZstdContextPoolSize) {
+        zstd_dctx_pool.push_back(context);
+        return;
+    }
+    scoped_lock.release();
+    ZSTD_freeDCtx(context);
+}
+
+}
+
+/**
+ * Wrapper class around the zstd compression library.
+ * See http://facebook.github.io/zstd/ for details.
+ *
+ * The dictionary of a compressed frame is identified by the dictionary id
+ * stored in the frame header, so a zstd compression object is able to
+ * decompress data compressed with any registered dictionary.
+ */
+class ZstdCompression : public Compression {
+    int level_;
+
+    /**
+     * digested dictionary for the compression or NULL
+     */
+    ZSTD_CDict* dictionary_;
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param type
+     * @param level
+     * @param dictionary digested dictionary or NULL. The compression takes the ownership.
+     * @return
+     */
+    ZstdCompression(enum CompressionType type, int level, ZSTD_CDict* dictionary) : Compression(type),
+        level_(level),
+        dictionary_(dictionary) {
+    }
+
+    virtual ~ZstdCompression() {
+        if (dictionary_) {
+            ZSTD_freeCDict(dictionary_);
+            dictionary_ = NULL;
+        }
+    }
+
+    virtual ssize_t Compress(void* dest, size_t dest_size, const void* src, size_t src_size) {
+        DCHECK_RETURN(dest, -1, "Destination not set");
+        DCHECK_RETURN(src, -1, "Src not set");
+
+        // a context is used by a single call at a time, this keeps the compression thread-safe
+        ZSTD_CCtx* context = AcquireZstdCCtx();
+        CHECK_RETURN(context, -1, "Failed to create zstd context");
+        size_t r = 0;
+        if (dictionary_) {
+            r = ZSTD_compress_usingCDict(context, dest, dest_size, src, src_size, dictionary_);
+        } else {
+            r = ZSTD_compressCCtx(context, dest, dest_size, src, src_size, level_);
+        }
+        ReleaseZstdCCtx(context);
+        CHECK_RETURN(!ZSTD_isError(r), -1, "Compression failed: " << ZSTD_getErrorName(r) <<
+            ", src size " << src_size <<
+            ", dest size " << dest_size);
+        return r;
+    }
+
+    virtual ssize_t Decompress(void* dest, size_t dest_size, const void* src, size_t src_size) {
+        DCHECK_RETURN(dest, -1, "Destination not set");
+        DCHECK_RETURN(src, -1, "Src not set");
+
+        ZSTD_DDict* dictionary = NULL;
+        uint32_t dictionary_id = ZSTD_getDictID_fromFrame(src, src_size);
+        if (dictionary_id != 0) {
+            dictionary = GetZstdDictionary(dictionary_id);
+            CHECK_RETURN(dictionary, -1, "Zstd dictionary not registered: dictionary id " << dictionary_id);
+        }
+
+        ZSTD_DCtx* context = AcquireZstdDCtx();
+        CHECK_RETURN(context, -1, "Failed to create zstd context");
+        size_t r = 0;
+        if (dictionary) {
+            r = ZSTD_decompress_usingDDict(context, dest, dest_size, src, src_size, dictionary);
+        } else {
+            r = ZSTD_decompressDCtx(context, dest, dest_size, src, src_size);
+        }
+        ReleaseZstdDCtx(context);
+        CHECK_RETURN(!ZSTD_isError(r), -1, "Decompression failed: " << ZSTD_getErrorName(r) <<
+            ", src size " << src_size <<
+            ", dest size " << dest_size);
+        return r;
+    }
+
+    DISALLOW_COPY_AND_ASSIGN(ZstdCompression);
+};
+
+Compression* Compression::NewZstdCompression(int level, const string& dictionary) {
+    CHECK_RETURN(level >= 1 && level <= ZSTD_maxCLevel(), NULL, "Illegal zstd compression level: " << level);
+
+    ZSTD_CDict* cdict = NULL;
+    if (!dictionary.empty()) {
+        CHECK_RETURN(RegisterZstdDictionary(dictionary), NULL, "Failed to register zstd dictionary");
+        cdict = ZSTD_createCDict(dictionary.data(), dictionary.size(), level);
+        CHECK_RETURN(cdict, NULL, "Failed to create zstd dictionary");
+    }
+    return new ZstdCompression(COMPRESSION_ZSTD, level, cdict);
+}
+
+bool Compression::RegisterZstdDictionary(const string& dictionary) {
+    uint32_t dictionary_id = GetZstdDictionaryId(dictionary);
+    CHECK(dictionary_id != 0, "Illegal zstd dictionary: size " << dictionary.size());
+
+    tbb::spin_rw_mutex::scoped_lock scoped_lock(zstd_dictionaries_lock, true);
+    if (zstd_dictionaries.find(dictionary_id) != zstd_dictionaries.end()) {
+        return true;
+    }
+    ZSTD_DDict* ddict = ZSTD_createDDict(dictionary.data(), dictionary.size());
+    CHECK(ddict, "Failed to create zstd dictionary: dictionary id " << dictionary_id);
+    zstd_dictionaries[dictionary_id] = ddict;
+    return true;
+}
+
+bool Compression::TrainZstdDictionary(const string& samples,
+                                      const vector<size_t>& sample_sizes,
+                                      size_t dictionary_size,
+                                      string* dictionary) {
+    CHECK(dictionary, "Dictionary not set");
+    CHECK(!sample_sizes.empty(), "No samples");
+    CHECK(dictionary_size > 0, "Illegal dictionary size");
+
+    vector<byte> buffer(dictionary_size);
+    size_t r = ZDICT_trainFromBuffer(&buffer[0], buffer.size(),
+        samples.data(), &sample_sizes[0], sample_sizes.size());
+    CHECK(!ZDICT_isError(r), "Failed to train zstd dictionary: " << ZDICT_getErrorName(r) <<
+        ", samples " << sample_sizes.size() <<
+        ", sample size " << samples.size());
+    dictionary->assign(reinterpret_cast<const char*>(&buffer[0]), r);
+    return true;
+}
+
+uint32_t Compression::GetZstdDictionaryId(const string& dictionary) {
+    if (dictionary.empty()) {
+        return 0;
+    }
+    return ZDICT_getDictID(dictionary.data(), dictionary.size());
+}
+
 Compression* Compression::NewCompression(enum CompressionType type) {
     if (type == Compression::COMPRESSION_ZLIB_1) {
         return new ZlibCompression(type, 1);
@@ -318,6 +558,8 @@ Compression* Compression::NewCompression(enum CompressionType type) {
         return new LZ4Compression(COMPRESSION_LZ4);
     } else if (type == Compression::COMPRESSION_SNAPPY) {
         return new SnappyCompression(type);
+    } else if (type == Compression::COMPRESSION_ZSTD) {
+        return new ZstdCompression(type, kDefaultZstdLevel, NULL);
     }
     return NULL;
 }
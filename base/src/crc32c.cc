@@ -0,0 +1,206 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <base/crc32c.h>
+
+#include <string.h>
+#include <endian.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#elif defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#include <arm_acle.h>
+#endif
+
+namespace dedupv1 {
+namespace base {
+
+namespace {
+
+/**
+ * Reflected Castagnoli polynomial
+ */
+const uint32_t kCRC32CPolynomial = 0x82F63B78;
+
+/**
+ * Tables of the slicing-by-8 software implementation.
+ */
+class CRC32CTables {
+    public:
+        uint32_t table[8][256];
+
+        CRC32CTables() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int j = 0; j < 8; j++) {
+                    c = (c & 1) ? (c >> 1) ^ kCRC32CPolynomial : (c >> 1);
+                }
+                table[0][i] = c;
+            }
+            for (uint32_t i = 0; i < 256; i++) {
+                for (int k = 1; k < 8; k++) {
+                    table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+                }
+            }
+        }
+};
+
+CRC32CTables crc32c_tables;
+
+/**
+ * Extends the inverted crc value.
+ */
+uint32_t ExtendSoftwareInternal(uint32_t c, const byte* p, size_t size) {
+    const uint32_t (*t)[256] = crc32c_tables.table;
+    while (size > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+        c = t[0][(c ^ *p) & 0xFF] ^ (c >> 8);
+        p++;
+        size--;
+    }
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    while (size >= 8) {
+        uint32_t low;
+        uint32_t high;
+        memcpy(&low, p, sizeof(low));
+        memcpy(&high, p + 4, sizeof(high));
+        low ^= c;
+        c = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+            t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        p += 8;
+        size -= 8;
+    }
+#endif
+    while (size > 0) {
+        c = t[0][(c ^ *p) & 0xFF] ^ (c >> 8);
+        p++;
+        size--;
+    }
+    return c;
+}
+
+#if defined(__x86_64__)
+inline uint32_t HardwareStep(uint32_t c, byte v) {
+    __asm__("crc32b %1, %0" : "+r" (c) : "rm" (v));
+    return c;
+}
+
+inline uint64_t HardwareStep(uint64_t c, uint64_t v) {
+    __asm__("crc32q %1, %0" : "+r" (c) : "rm" (v));
+    return c;
+}
+
+bool DetectHardwareSupport() {
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (ecx & bit_SSE4_2) != 0;
+}
+
+uint32_t ExtendHardwareInternal(uint32_t c, const byte* p, size_t size) {
+    while (size > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+        c = HardwareStep(c, *p);
+        p++;
+        size--;
+    }
+    uint64_t c64 = c;
+    while (size >= 8) {
+        c64 = HardwareStep(c64, *reinterpret_cast<const uint64_t*>(p));
+        p += 8;
+        size -= 8;
+    }
+    c = static_cast<uint32_t>(c64);
+    while (size > 0) {
+        c = HardwareStep(c, *p);
+        p++;
+        size--;
+    }
+    return c;
+}
+#elif defined(__aarch64__)
+bool DetectHardwareSupport() {
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+
+__attribute__((target("+crc")))
+uint32_t ExtendHardwareInternal(uint32_t c, const byte* p, size_t size) {
+    while (size > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+        c = __crc32cb(c, *p);
+        p++;
+        size--;
+    }
+    while (size >= 8) {
+        c = __crc32cd(c, *reinterpret_cast<const uint64_t*>(p));
+        p += 8;
+        size -= 8;
+    }
+    while (size > 0) {
+        c = __crc32cb(c, *p);
+        p++;
+        size--;
+    }
+    return c;
+}
+#else
+bool DetectHardwareSupport() {
+    return false;
+}
+
+uint32_t ExtendHardwareInternal(uint32_t c, const byte* p, size_t size) {
+    return ExtendSoftwareInternal(c, p, size);
+}
+#endif
+
+/**
+ * Selects the implementation once when the library is loaded.
+ */
+class CRC32CDispatcher {
+    public:
+        bool hardware_accelerated;
+
+        CRC32CDispatcher() {
+            hardware_accelerated = DetectHardwareSupport();
+        }
+};
+
+CRC32CDispatcher crc32c_dispatcher;
+
+}
+
+uint32_t CRC32C::Extend(uint32_t crc_value, const void* data, size_t data_size) {
+    const byte* p = static_cast<const byte*>(data);
+    if (crc32c_dispatcher.hardware_accelerated) {
+        return ~ExtendHardwareInternal(~crc_value, p, data_size);
+    }
+    return ~ExtendSoftwareInternal(~crc_value, p, data_size);
+}
+
+uint32_t CRC32C::ExtendSoftware(uint32_t crc_value, const void* data, size_t data_size) {
+    return ~ExtendSoftwareInternal(~crc_value, static_cast<const byte*>(data), data_size);
+}
+
+bool CRC32C::IsHardwareAccelerated() {
+    return crc32c_dispatcher.hardware_accelerated;
+}
+
+}
+}
@@ -0,0 +1,782 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <base/cuckoo_mem_hash_index.h>
+
+#include <sstream>
+
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include <base/index.h>
+#include <base/base.h>
+#include <base/hashing_util.h>
+#include <base/strutil.h>
+#include <base/logging.h>
+#include <base/timer.h>
+#include <base/protobuf_util.h>
+
+using std::string;
+using std::stringstream;
+using std::vector;
+using dedupv1::base::strutil::ToStorageUnit;
+using dedupv1::base::strutil::To;
+using dedupv1::base::strutil::ToHexString;
+using dedupv1::base::ProfileTimer;
+using google::protobuf::Message;
+using dedupv1::base::ParseSizedMessage;
+using dedupv1::base::SerializeSizedMessageToString;
+
+LOGGER("CuckooMemHashIndex");
+
+namespace dedupv1 {
+namespace base {
+
+void CuckooMemHashIndex::RegisterIndex() {
+    Index::Factory().Register("cuckoo-mem-hash", &CuckooMemHashIndex::CreateIndex);
+}
+
+Index* CuckooMemHashIndex::CreateIndex() {
+    Index* i = new CuckooMemHashIndex();
+    return i;
+}
+
+CuckooMemHashIndex::CuckooMemHashIndex() : MemoryIndex(HAS_ITERATOR | RETURNS_DELETE_NOT_FOUND | RAW_ACCESS | COMPARE_AND_SWAP | PUT_IF_ABSENT) {
+    state_ = CUCKOO_MEM_HASH_INDEX_STATE_CREATED;
+    bucket_count_ = kDefaultBucketCount;
+    bucket_mask_ = 0;
+    max_key_size_ = kDefaultMaxKeySize;
+    max_value_size_ = kDefaultMaxValueSize;
+    slot_size_ = 0;
+    table_ = NULL;
+    stripe_versions_ = NULL;
+    slab_memory_size_ = 0;
+    random_state_ = 0x9E3779B97F4A7C15ULL;
+    item_count_ = 0;
+    version_counter_ = 0;
+    iterator_counter_ = 0;
+    checksum_ = true;
+    cuckoo_move_count_ = 0;
+    grow_count_ = 0;
+    read_retry_count_ = 0;
+}
+
+CuckooMemHashIndex::~CuckooMemHashIndex() {
+    FreeSlabs();
+    if (table_) {
+        delete[] table_;
+        table_ = NULL;
+    }
+    if (stripe_versions_) {
+        delete[] stripe_versions_;
+        stripe_versions_ = NULL;
+    }
+}
+
+bool CuckooMemHashIndex::SetOption(const string& option_name, const string& option) {
+    if (option_name == "bucket-count") {
+        CHECK(ToStorageUnit(option).valid(), "Illegal option " << option);
+        this->bucket_count_ = ToStorageUnit(option).value();
+        return true;
+    }
+    if (option_name == "max-key-size") {
+        CHECK(ToStorageUnit(option).valid(), "Illegal option " << option);
+        int64_t s = ToStorageUnit(option).value();
+        CHECK(s > 0 && s <= 255, "Illegal max key size " << option);
+        this->max_key_size_ = s;
+        return true;
+    }
+    if (option_name == "max-value-size") {
+        CHECK(ToStorageUnit(option).valid(), "Illegal option " << option);
+        int64_t s = ToStorageUnit(option).value();
+        CHECK(s > 0 && s <= UINT_MAX, "Illegal max value size " << option);
+        this->max_value_size_ = s;
+        return true;
+    }
+    if (option_name == "checksum") {
+        CHECK(To<bool>(option).valid(), "Illegal option " << option);
+        this->checksum_ = To<bool>(option).value();
+        return true;
+    }
+    return Index::SetOption(option_name, option);
+}
+
+bool CuckooMemHashIndex::Start(const StartContext& start_context) {
+    CHECK(this->state_ == CUCKOO_MEM_HASH_INDEX_STATE_CREATED, "Index in invalid state");
+
+    // the bucket count is rounded up to the next power of two
+    uint64_t bucket_count = 16;
+    while (bucket_count < bucket_count_) {
+        bucket_count <<= 1;
+    }
+    bucket_count_ = bucket_count;
+    bucket_mask_ = bucket_count_ - 1;
+    slot_size_ = (sizeof(slot_header) + max_key_size_ + 7) & ~7U;
+
+    size_t table_size = bucket_count_ * kSlotsPerBucket * slot_size_;
+    table_ = new byte[table_size];
+    CHECK(table_, "Failed to allocate bucket table");
+    memset(table_, 0, table_size);
+
+    stripe_versions_ = new tbb::atomic<uint32_t>[kVersionStripeCount];
+    CHECK(stripe_versions_, "Failed to allocate version counters");
+    for (uint32_t i = 0; i < kVersionStripeCount; i++) {
+        stripe_versions_[i] = 0;
+    }
+    free_value_chunks_.resize(GetSizeClass(max_value_size_) + 1);
+
+    DEBUG("Started cuckoo hash index: bucket count " << bucket_count_ <<
+        ", slot size " << slot_size_ <<
+        ", max value size " << max_value_size_);
+
+    this->state_ = CUCKOO_MEM_HASH_INDEX_STATE_STARTED;
+    return true;
+}
+
+inline CuckooMemHashIndex::slot_header* CuckooMemHashIndex::GetSlot(uint64_t bucket, uint32_t slot) {
+    return reinterpret_cast<slot_header*>(table_ + ((bucket * kSlotsPerBucket) + slot) * slot_size_);
+}
+
+inline byte* CuckooMemHashIndex::GetSlotKey(slot_header* header) {
+    return reinterpret_cast<byte*>(header) + sizeof(slot_header);
+}
+
+inline tbb::atomic<uint32_t>* CuckooMemHashIndex::GetStripeVersion(uint64_t bucket) {
+    return &stripe_versions_[bucket & (kVersionStripeCount - 1)];
+}
+
+inline uint64_t CuckooMemHashIndex::GetAlternativeBucket(uint64_t bucket, uint64_t hash) {
+    // the xor with a value derived only from the hash makes the mapping its own inverse
+    uint64_t d = ((hash >> 32) * 0xc6a4a7935bd1e995ULL) >> 16;
+    d &= bucket_mask_;
+    if (d == 0) {
+        d = 1;
+    }
+    return (bucket ^ d) & bucket_mask_;
+}
+
+uint64_t CuckooMemHashIndex::Hash(const void* key, size_t key_size) {
+    uint64_t hash[2];
+    murmur_hash3_x64_128(key, key_size, 0, hash);
+    return hash[0];
+}
+
+uint64_t CuckooMemHashIndex::NextRandom() {
+    // xorshift
+    random_state_ ^= random_state_ << 13;
+    random_state_ ^= random_state_ >> 7;
+    random_state_ ^= random_state_ << 17;
+    return random_state_;
+}
+
+void CuckooMemHashIndex::BeginBucketUpdate(uint64_t bucket1, uint64_t bucket2) {
+    tbb::atomic<uint32_t>* v1 = GetStripeVersion(bucket1);
+    tbb::atomic<uint32_t>* v2 = GetStripeVersion(bucket2);
+    v1->fetch_and_increment();
+    if (v2 != v1) {
+        v2->fetch_and_increment();
+    }
+}
+
+void CuckooMemHashIndex::EndBucketUpdate(uint64_t bucket1, uint64_t bucket2) {
+    tbb::atomic<uint32_t>* v1 = GetStripeVersion(bucket1);
+    tbb::atomic<uint32_t>* v2 = GetStripeVersion(bucket2);
+    v1->fetch_and_increment();
+    if (v2 != v1) {
+        v2->fetch_and_increment();
+    }
+}
+
+CuckooMemHashIndex::slot_header* CuckooMemHashIndex::FindInBucket(uint64_t bucket, uint64_t hash,
+                                                                  const void* key, size_t key_size) {
+    for (uint32_t i = 0; i < kSlotsPerBucket; i++) {
+        slot_header* header = GetSlot(bucket, i);
+        if (header->hash == hash && header->key_size == key_size &&
+            memcmp(GetSlotKey(header), key, key_size) == 0) {
+            return header;
+        }
+    }
+    return NULL;
+}
+
+CuckooMemHashIndex::slot_header* CuckooMemHashIndex::FindSlot(uint64_t hash,
+                                                              const void* key, size_t key_size,
+                                                              uint64_t* bucket) {
+    uint64_t bucket1 = hash & bucket_mask_;
+    slot_header* header = FindInBucket(bucket1, hash, key, key_size);
+    if (header) {
+        *bucket = bucket1;
+        return header;
+    }
+    uint64_t bucket2 = GetAlternativeBucket(bucket1, hash);
+    header = FindInBucket(bucket2, hash, key, key_size);
+    if (header) {
+        *bucket = bucket2;
+    }
+    return header;
+}
+
+bool CuckooMemHashIndex::FindEmptySlot(uint64_t bucket, slot_position* position) {
+    for (uint32_t i = 0; i < kSlotsPerBucket; i++) {
+        if (GetSlot(bucket, i)->key_size == 0) {
+            position->bucket = bucket;
+            position->slot = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CuckooMemHashIndex::MoveSlot(const slot_position& from, const slot_position& to) {
+    slot_header* from_header = GetSlot(from.bucket, from.slot);
+    slot_header* to_header = GetSlot(to.bucket, to.slot);
+
+    BeginBucketUpdate(from.bucket, to.bucket);
+    memcpy(to_header, from_header, slot_size_);
+    from_header->key_size = 0;
+    from_header->value = NULL;
+    from_header->value_size = 0;
+    EndBucketUpdate(from.bucket, to.bucket);
+    cuckoo_move_count_++;
+}
+
+bool CuckooMemHashIndex::MakeRoom(uint64_t hash, slot_position* position) {
+    uint64_t bucket1 = hash & bucket_mask_;
+    uint64_t bucket2 = GetAlternativeBucket(bucket1, hash);
+    if (FindEmptySlot(bucket1, position) || FindEmptySlot(bucket2, position)) {
+        return true;
+    }
+
+    slot_position path[kMaxCuckooPathLength];
+    for (int attempt = 0; attempt < 4; attempt++) {
+        // random walk until a bucket with an empty slot is found
+        uint64_t bucket = (NextRandom() & 1) ? bucket1 : bucket2;
+        uint32_t path_length = 0;
+        slot_position empty_position;
+        bool found = false;
+        while (path_length < kMaxCuckooPathLength) {
+            path[path_length].bucket = bucket;
+            path[path_length].slot = NextRandom() % kSlotsPerBucket;
+            bucket = GetAlternativeBucket(bucket, GetSlot(bucket, path[path_length].slot)->hash);
+            path_length++;
+            if (FindEmptySlot(bucket, &empty_position)) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            continue;
+        }
+
+        // move the entries backwards along the path so that each entry is
+        // always stored in one of its buckets
+        slot_position to = empty_position;
+        bool moved = true;
+        for (int i = path_length - 1; i >= 0; i--) {
+            slot_header* header = GetSlot(path[i].bucket, path[i].slot);
+            if (header->key_size == 0 || GetAlternativeBucket(path[i].bucket, header->hash) != to.bucket) {
+                // the walk visited the slot twice. All entries moved so far are at a valid position.
+                moved = false;
+                break;
+            }
+            MoveSlot(path[i], to);
+            to = path[i];
+        }
+        if (moved) {
+            *position = to;
+            return true;
+        }
+        if (FindEmptySlot(bucket1, position) || FindEmptySlot(bucket2, position)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CuckooMemHashIndex::Grow() {
+    tbb::spin_rw_mutex::scoped_lock table_scoped_lock(table_lock_, true);
+
+    byte* old_table = table_;
+    uint64_t old_bucket_count = bucket_count_;
+    uint64_t new_bucket_count = bucket_count_ * 2;
+
+    for (;;) {
+        size_t table_size = new_bucket_count * kSlotsPerBucket * slot_size_;
+        table_ = new byte[table_size];
+        CHECK(table_, "Failed to allocate bucket table");
+        memset(table_, 0, table_size);
+        bucket_count_ = new_bucket_count;
+        bucket_mask_ = bucket_count_ - 1;
+
+        bool failed = false;
+        for (uint64_t i = 0; i < old_bucket_count * kSlotsPerBucket && !failed; i++) {
+            slot_header* header = reinterpret_cast<slot_header*>(old_table + (i * slot_size_));
+            if (header->key_size == 0) {
+                continue;
+            }
+            slot_position position;
+            if (!MakeRoom(header->hash, &position)) {
+                failed = true;
+                break;
+            }
+            memcpy(GetSlot(position.bucket, position.slot), header, slot_size_);
+        }
+        if (!failed) {
+            break;
+        }
+        delete[] table_;
+        new_bucket_count *= 2;
+    }
+    delete[] old_table;
+    grow_count_++;
+    version_counter_++;
+
+    DEBUG("Grow cuckoo hash index: bucket count " << bucket_count_ << ", item count " << item_count_);
+    return true;
+}
+
+int CuckooMemHashIndex::GetSizeClass(size_t value_size) {
+    int size_class = 0;
+    size_t chunk_size = kMinValueChunkSize;
+    while (chunk_size < value_size) {
+        chunk_size <<= 1;
+        size_class++;
+    }
+    return size_class;
+}
+
+byte* CuckooMemHashIndex::AllocateValue(size_t value_size) {
+    if (value_size == 0) {
+        return NULL;
+    }
+    int size_class = GetSizeClass(value_size);
+    vector<byte*>& free_list(free_value_chunks_[size_class]);
+    if (free_list.empty()) {
+        size_t chunk_size = kMinValueChunkSize << size_class;
+        size_t page_size = chunk_size > kSlabPageSize ? chunk_size : kSlabPageSize;
+        byte* page = new byte[page_size];
+        slab_pages_.push_back(page);
+        slab_memory_size_ += page_size;
+        for (size_t offset = 0; offset + chunk_size <= page_size; offset += chunk_size) {
+            free_list.push_back(page + offset);
+        }
+    }
+    byte* value = free_list.back();
+    free_list.pop_back();
+    return value;
+}
+
+void CuckooMemHashIndex::FreeValue(byte* value, size_t value_size) {
+    if (value == NULL) {
+        return;
+    }
+    // the chunk stays mapped so that a concurrent reader never touches unmapped memory
+    free_value_chunks_[GetSizeClass(value_size)].push_back(value);
+}
+
+void CuckooMemHashIndex::FreeSlabs() {
+    vector<byte*>::iterator i;
+    for (i = slab_pages_.begin(); i != slab_pages_.end(); i++) {
+        delete[] *i;
+    }
+    vector<byte*>().swap(slab_pages_);
+    slab_memory_size_ = 0;
+    for (size_t j = 0; j < free_value_chunks_.size(); j++) {
+        vector<byte*>().swap(free_value_chunks_[j]);
+    }
+}
+
+void CuckooMemHashIndex::UpdateValue(uint64_t bucket, slot_header* header,
+                                     const void* value, size_t value_size) {
+    byte* new_value = AllocateValue(value_size);
+    if (value_size > 0) {
+        memcpy(new_value, value, value_size);
+    }
+    byte* old_value = header->value;
+    uint32_t old_value_size = header->value_size;
+
+    BeginBucketUpdate(bucket, bucket);
+    header->value = new_value;
+    header->value_size = value_size;
+    EndBucketUpdate(bucket, bucket);
+
+    FreeValue(old_value, old_value_size);
+}
+
+enum put_result CuckooMemHashIndex::InternalPut(const void* key, size_t key_size,
+                                                const void* value, size_t value_size, bool keep_existing) {
+    CHECK_RETURN(key_size > 0 && key_size <= max_key_size_, PUT_ERROR, "Illegal key size " << key_size);
+    CHECK_RETURN(value_size <= max_value_size_, PUT_ERROR, "Illegal value size " << value_size <<
+        ", max value size " << max_value_size_);
+
+    uint64_t hash = Hash(key, key_size);
+    uint64_t bucket = 0;
+    slot_header* header = FindSlot(hash, key, key_size, &bucket);
+    if (header) {
+        if (keep_existing) {
+            return PUT_KEEP;
+        }
+        UpdateValue(bucket, header, value, value_size);
+        version_counter_++;
+        return PUT_OK;
+    }
+
+    slot_position position;
+    while (!MakeRoom(hash, &position)) {
+        CHECK_RETURN(Grow(), PUT_ERROR, "Failed to grow cuckoo hash index");
+    }
+
+    byte* new_value = AllocateValue(value_size);
+    if (value_size > 0) {
+        memcpy(new_value, value, value_size);
+    }
+    header = GetSlot(position.bucket, position.slot);
+
+    BeginBucketUpdate(position.bucket, position.bucket);
+    header->hash = hash;
+    header->value = new_value;
+    header->value_size = value_size;
+    memcpy(GetSlotKey(header), key, key_size);
+    header->key_size = key_size;
+    EndBucketUpdate(position.bucket, position.bucket);
+
+    item_count_++;
+    version_counter_++;
+    return PUT_OK;
+}
+
+enum lookup_result CuckooMemHashIndex::OptimisticLookup(const void* key, size_t key_size,
+                                                        void* value, size_t* value_size,
+                                                        bytestring* value_string) {
+    CHECK_RETURN(key_size > 0 && key_size <= max_key_size_, LOOKUP_ERROR, "Illegal key size " << key_size);
+    uint64_t hash = Hash(key, key_size);
+
+    tbb::spin_rw_mutex::scoped_lock table_scoped_lock(table_lock_, false);
+    uint64_t bucket1 = hash & bucket_mask_;
+    uint64_t bucket2 = GetAlternativeBucket(bucket1, hash);
+    tbb::atomic<uint32_t>* v1 = GetStripeVersion(bucket1);
+    tbb::atomic<uint32_t>* v2 = GetStripeVersion(bucket2);
+
+    for (;;) {
+        uint32_t version1 = *v1;
+        uint32_t version2 = *v2;
+        if ((version1 | version2) & 1) {
+            // writer active
+            continue;
+        }
+        slot_header* header = FindInBucket(bucket1, hash, key, key_size);
+        if (header == NULL) {
+            header = FindInBucket(bucket2, hash, key, key_size);
+        }
+        const byte* data = NULL;
+        size_t data_size = 0;
+        if (header) {
+            data = header->value;
+            data_size = header->value_size;
+        }
+        __sync_synchronize();
+        if (version1 != *v1 || version2 != *v2) {
+            read_retry_count_++;
+            continue;
+        }
+        if (header == NULL) {
+            return LOOKUP_NOT_FOUND;
+        }
+
+        // the value chunk might be freed and reused concurrently. The copy is validated below
+        if (value) {
+            DCHECK_RETURN(value_size, LOOKUP_ERROR, "Value size not set");
+            if (data_size > *value_size) {
+                // only report a size that belongs to a consistent snapshot of the slot
+                __sync_synchronize();
+                if (version1 != *v1 || version2 != *v2) {
+                    read_retry_count_++;
+                    continue;
+                }
+                *value_size = data_size;
+                return LOOKUP_ERROR;
+            }
+            if (data_size > 0) {
+                memcpy(value, data, data_size);
+            }
+        } else if (value_string) {
+            value_string->assign(data, data_size);
+        }
+        __sync_synchronize();
+        if (version1 != *v1 || version2 != *v2) {
+            read_retry_count_++;
+            continue;
+        }
+        if (value_size) {
+            *value_size = data_size;
+        }
+        return LOOKUP_FOUND;
+    }
+}
+
+enum lookup_result CuckooMemHashIndex::RawLookup(const void* key, size_t key_size,
+                                                 void* value, size_t* value_size) {
+    DCHECK_RETURN(key, LOOKUP_ERROR, "Key not set");
+    ProfileTimer timer(this->lookup_time_);
+    CHECK_RETURN(this->state_ == CUCKOO_MEM_HASH_INDEX_STATE_STARTED, LOOKUP_ERROR, "Index not started");
+
+    return OptimisticLookup(key, key_size, value, value_size, NULL);
+}
+
+enum lookup_result CuckooMemHashIndex::Lookup(const void* key, size_t key_size,
+                                              Message* message) {
+    DCHECK_RETURN(key, LOOKUP_ERROR, "Key not set");
+    ProfileTimer timer(this->lookup_time_);
+    CHECK_RETURN(this->state_ == CUCKOO_MEM_HASH_INDEX_STATE_STARTED, LOOKUP_ERROR, "Index not started");
+
+    bytestring buffer;
+    enum lookup_result r = OptimisticLookup(key, key_size, NULL, NULL, message ? &buffer : NULL);
+    if (r != LOOKUP_FOUND) {
+        return r;
+    }
+    if (message) {
+        if (!ParseSizedMessage(message, buffer.data(), buffer.size(), checksum_).valid()) {
+            ERROR("Failed to parse message: " << ToHexString(buffer.data(), buffer.size()));
+            return LOOKUP_ERROR;
+        }
+    }
+    return LOOKUP_FOUND;
+}
+
+enum put_result CuckooMemHashIndex::RawPut(const void* key, size_t key_size,
+                                           const void* value, size_t value_size) {
+    DCHECK_RETURN(key, PUT_ERROR, "Key not set");
+    CHECK_RETURN(this->state_ == CUCKOO_MEM_HASH_INDEX_STATE_STARTED, PUT_ERROR, "Index not started");
+
+    ProfileTimer timer(this->update_time_);
+    tbb::spin_mutex::scoped_lock scoped_lock(writer_lock_);
+    return InternalPut(key, key_size, value, value_size, false);
+}
+
+enum put_result CuckooMemHashIndex::RawPutIfAbsent(const void* key, size_t key_size,
+                                                   const void* value, size_t value_size) {
+    DCHECK_RETURN(key, PUT_ERROR, "Key not set");
+    CHECK_RETURN(this->state_ == CUCKOO_MEM_HASH_INDEX_STATE_STARTED, PUT_ERROR, "Index not started");
+
+    ProfileTimer timer(this->update_time_);
+    tbb::spin_mutex::scoped_lock scoped_lock(writer_lock_);
+    return InternalPut(key, key_size, value, value_size, true);
+}
+
+enum put_result CuckooMemHashIndex::Put(const void* key, size_t key_size,
+                                        const Message& message) {
+    ProfileTimer timer(this->update_time_);
+    CHECK_RETURN(this->state_ == CUCKOO_MEM_HASH_INDEX_STATE_STARTED, PUT_ERROR, "Index not started");
+    CHECK_RETURN(key, PUT_ERROR, "Key not set");
+
+    string target;
+    CHECK_RETURN(SerializeSizedMessageToString(message, &target, checksum_),
+        PUT_ERROR,
+        "Failed to serialize message: " << message.ShortDebugString());
+
+    tbb::spin_mutex::scoped_lock scoped_lock(writer_lock_);
+    return InternalPut(key, key_size, target.data(), target.size(), false);
+}
+
+enum put_result CuckooMemHashIndex::PutIfAbsent(const void* key, size_t key_size,
+                                                const Message& message) {
+    ProfileTimer timer(this->update_time_);
+    CHECK_RETURN(this->state_ == CUCKOO_MEM_HASH_INDEX_STATE_STARTED, PUT_ERROR, "Index not started");
+    CHECK_RETURN(key, PUT_ERROR, "Key not set");
+
+    string target;
+    CHECK_RETURN(SerializeSizedMessageToString(message, &target, checksum_),
+        PUT_ERROR,
+        "Failed to serialize message: " << message.ShortDebugString());
+
+    tbb::spin_mutex::scoped_lock scoped_lock(writer_lock_);
+    return InternalPut(key, key_size, target.data(), target.size(), true);
+}
+
+enum put_result CuckooMemHashIndex::CompareAndSwap(const void* key, size_t key_size,
+                                                   const Message& message,
+                                                   const Message& compare_message,
+                                                   Message* result_message) {
+    ProfileTimer timer(this->update_time_);
+    CHECK_RETURN(this->state_ == CUCKOO_MEM_HASH_INDEX_STATE_STARTED, PUT_ERROR, "Index not started");
+    CHECK_RETURN(key, PUT_ERROR, "Key not set");
+    CHECK_RETURN(key_size > 0 && key_size <= max_key_size_, PUT_ERROR, "Illegal key size " << key_size);
+
+    string target;
+    CHECK_RETURN(SerializeSizedMessageToString(message, &target, checksum_),
+        PUT_ERROR,
+        "Failed to serialize message: " << message.ShortDebugString());
+    CHECK_RETURN(target.size() <= max_value_size_, PUT_ERROR, "Illegal value size " << target.size());
+
+    string compare_target;
+    CHECK_RETURN(SerializeSizedMessageToString(compare_message, &compare_target, checksum_),
+        PUT_ERROR,
+        "Failed to serialize compare message: " << compare_message.ShortDebugString());
+
+    tbb::spin_mutex::scoped_lock scoped_lock(writer_lock_);
+    uint64_t bucket = 0;
+    slot_header* header = FindSlot(Hash(key, key_size), key, key_size, &bucket);
+    CHECK_RETURN(header, PUT_ERROR, "Failed to find value in cuckoo hash index");
+
+    if (raw_compare(compare_target.data(), compare_target.size(), header->value, header->value_size) == 0) {
+        UpdateValue(bucket, header, target.data(), target.size());
+        version_counter_++;
+        result_message->CopyFrom(message);
+        return PUT_OK;
+    }
+    CHECK_RETURN(ParseSizedMessage(result_message, header->value, header->value_size, checksum_).valid(),
+        PUT_ERROR, "Failed to parse message: " << ToHexString(header->value, header->value_size));
+    return PUT_KEEP;
+}
+
+enum delete_result CuckooMemHashIndex::Delete(const void* key, size_t key_size) {
+    ProfileTimer timer(this->update_time_);
+    CHECK_RETURN(this->state_ == CUCKOO_MEM_HASH_INDEX_STATE_STARTED, DELETE_ERROR, "Index not started");
+    CHECK_RETURN(key, DELETE_ERROR, "Key not set");
+    CHECK_RETURN(key_size > 0 && key_size <= max_key_size_, DELETE_ERROR, "Illegal key size " << key_size);
+
+    tbb::spin_mutex::scoped_lock scoped_lock(writer_lock_);
+    uint64_t bucket = 0;
+    slot_header* header = FindSlot(Hash(key, key_size), key, key_size, &bucket);
+    if (header == NULL) {
+        return DELETE_NOT_FOUND;
+    }
+    byte* old_value = header->value;
+    uint32_t old_value_size = header->value_size;
+
+    BeginBucketUpdate(bucket, bucket);
+    header->key_size = 0;
+    header->value = NULL;
+    header->value_size = 0;
+    EndBucketUpdate(bucket, bucket);
+
+    FreeValue(old_value, old_value_size);
+    item_count_--;
+    version_counter_++;
+    return DELETE_OK;
+}
+
+bool CuckooMemHashIndex::Clear() {
+    if (this->state_ != CUCKOO_MEM_HASH_INDEX_STATE_STARTED) {
+        return true;
+    }
+    tbb::spin_mutex::scoped_lock scoped_lock(writer_lock_);
+    tbb::spin_rw_mutex::scoped_lock table_scoped_lock(table_lock_, true);
+
+    memset(table_, 0, bucket_count_ * kSlotsPerBucket * slot_size_);
+    FreeSlabs();
+    item_count_ = 0;
+    version_counter_++;
+    return true;
+}
+
+uint64_t CuckooMemHashIndex::GetItemCount() {
+    return item_count_;
+}
+
+uint64_t CuckooMemHashIndex::GetMemorySize() {
+    if (this->state_ != CUCKOO_MEM_HASH_INDEX_STATE_STARTED) {
+        return 0;
+    }
+    tbb::spin_mutex::scoped_lock scoped_lock(writer_lock_);
+    uint64_t memory_size = bucket_count_ * kSlotsPerBucket * slot_size_;
+    memory_size += kVersionStripeCount * sizeof(tbb::atomic<uint32_t>);
+    memory_size += slab_memory_size_;
+    memory_size += slab_pages_.capacity() * sizeof(byte*);
+    for (size_t i = 0; i < free_value_chunks_.size(); i++) {
+        memory_size += free_value_chunks_[i].capacity() * sizeof(byte*);
+    }
+    return memory_size;
+}
+
+string CuckooMemHashIndex::PrintProfile() {
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"update time\": " << this->update_time_.GetSum() << "," << std::endl;
+    sstr << "\"lookup time\": " << this->lookup_time_.GetSum() << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+string CuckooMemHashIndex::PrintTrace() {
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"item count\": " << item_count_ << "," << std::endl;
+    sstr << "\"bucket count\": " << bucket_count_ << "," << std::endl;
+    sstr << "\"cuckoo move count\": " << cuckoo_move_count_ << "," << std::endl;
+    sstr << "\"grow count\": " << grow_count_ << "," << std::endl;
+    sstr << "\"read retry count\": " << read_retry_count_ << "," << std::endl;
+    sstr << "\"memory size\": " << GetMemorySize() << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+IndexIterator* CuckooMemHashIndex::CreateIterator() {
+    CHECK_RETURN(state_ == CUCKOO_MEM_HASH_INDEX_STATE_STARTED, NULL, "Illegal state: " << state_);
+    CHECK_RETURN(iterator_counter_ == 0, NULL, "Already open iterators");
+
+    int c = iterator_counter_.compare_and_swap(1, 0);
+    CHECK_RETURN(c == 0, NULL, "Already open iterators");
+    return new CuckooMemHashIndexIterator(this);
+}
+
+CuckooMemHashIndexIterator::CuckooMemHashIndexIterator(CuckooMemHashIndex* index) {
+    this->index_ = index;
+    this->bucket_ = 0;
+    this->slot_ = 0;
+    this->version_counter_ = index->version_counter_;
+}
+
+CuckooMemHashIndexIterator::~CuckooMemHashIndexIterator() {
+    index_->iterator_counter_--;
+}
+
+enum lookup_result CuckooMemHashIndexIterator::Next(void* key, size_t* key_size, Message* message) {
+    CHECK_RETURN(this->version_counter_ == this->index_->version_counter_, LOOKUP_ERROR, "Concurrent modification error");
+
+    tbb::spin_mutex::scoped_lock scoped_lock(index_->writer_lock_);
+    while (bucket_ < index_->bucket_count_) {
+        while (slot_ < CuckooMemHashIndex::kSlotsPerBucket) {
+            CuckooMemHashIndex::slot_header* header = index_->GetSlot(bucket_, slot_);
+            slot_++;
+            if (header->key_size == 0) {
+                continue;
+            }
+            if (key) {
+                CHECK_RETURN(key_size, LOOKUP_ERROR, "Key size not set");
+                CHECK_RETURN(*key_size >= header->key_size, LOOKUP_ERROR, "Illegal key size " << (*key_size));
+                memcpy(key, index_->GetSlotKey(header), header->key_size);
+                *key_size = header->key_size;
+            }
+            if (message) {
+                CHECK_RETURN(ParseSizedMessage(message, header->value, header->value_size, index_->checksum_).valid(),
+                    LOOKUP_ERROR, "Failed to parse message");
+            }
+            return LOOKUP_FOUND;
+        }
+        slot_ = 0;
+        bucket_++;
+    }
+    return LOOKUP_NOT_FOUND;
+}
+
+}
+}
@@ -38,12 +38,14 @@
 #include <base/bitutil.h>
 #include <base/fileutil.h>
 #include <base/crc32.h>
+#include <base/crc32c.h>
 #include <base/locks.h>
 #include <base/strutil.h>
 #include <base/logging.h>
 #include <base/timer.h>
 #include <base/protobuf_util.h>
 #include <base/disk_hash_index_transaction.h>
+#include <base/disk_hash_index_bulk_loader.h>
 #include <base/disk_hash_cache_page.h>
 #include <base/tc_hash_mem_index.h>
 #include <base/memory.h>
@@ -57,6 +59,7 @@ using dedupv1::base::strutil::ToString;
 using dedupv1::base::strutil::StartsWith;
 using dedupv1::base::CRC;
 using dedupv1::base::crc;
+using dedupv1::base::crc32c_raw;
 using dedupv1::base::ProfileTimer;
 using dedupv1::base::bits;
 using dedupv1::base::File;
@@ -76,7 +79,6 @@ using std::make_pair;
 using std::pair;
 using dedupv1::base::make_bytestring;
 using dedupv1::base::ScopedArray;
-using dedupv1::base::TCMemHashIndex;
 using std::tr1::unordered_map;
 LOGGER("DiskHashIndex");
 
@@ -104,6 +106,7 @@ DiskHashIndex::DiskHashIndex() :
     this->max_key_size_ = 0;
     this->max_value_size_ = 0;
     this->crc_ = true;
+    this->checksum_type_ = DISK_HASH_CHECKSUM_CRC32;
     this->version_counter_ = 0;
     this->state_ = INITED;
 
@@ -113,6 +116,7 @@ DiskHashIndex::DiskHashIndex() :
     this->item_count_ = 0;
     this->estimated_max_fill_ratio_ = kDefaultEstimatedMaxFillRatio;
     this->write_back_cache_ = NULL;
+    this->io_scheduler_ = NULL;
     max_cache_page_count_ = 0;
     max_cache_item_count_ = 0;
     dirty_item_count_ = 0;
@@ -206,6 +210,17 @@ bool DiskHashIndex::SetOption(const string& option_name, const string& option) {
         this->crc_ = To<bool>(option).value();
         return true;
     }
+    if (option_name == "checksum-type") {
+        if (option == "crc32") {
+            this->checksum_type_ = DISK_HASH_CHECKSUM_CRC32;
+        } else if (option == "crc32c") {
+            this->checksum_type_ = DISK_HASH_CHECKSUM_CRC32C;
+        } else {
+            ERROR("Illegal checksum type: " << option);
+            return false;
+        }
+        return true;
+    }
     if (option_name == "estimated-max-fill-ratio") {
         CHECK(To<double>(option).valid(), "Illegal option " << option);
         this->estimated_max_fill_ratio_ = To<double>(option).value();
@@ -235,8 +250,22 @@ bool DiskHashIndex::SetOption(const string& option_name, const string& option) {
         if (To<bool>(option).value()) {
             Index* index = Index::Factory().Create("tc-mem-hash");
             CHECK(index, "Failed to create write back cache index type tc-mem-hash");
-            this->write_back_cache_ = static_cast<TCMemHashIndex*>(index);
+            this->write_back_cache_ = index->AsMemoryIndex();
+        }
+        return true;
+    }
+    if (option_name == "write-cache.type") {
+        // replaces the default tc-mem-hash cache. Has to be set before other write cache options
+        CHECK(this->write_back_cache_ != NULL, "Write back cache not created");
+        Index* index = Index::Factory().Create(option);
+        CHECK(index, "Failed to create write back cache index type " << option);
+        if (index->IsPersistent() || !index->HasCapability(dedupv1::base::RAW_ACCESS)) {
+            delete index;
+            ERROR("Write back cache index type " << option << " is not an in-memory index with raw access");
+            return false;
         }
+        delete this->write_back_cache_;
+        this->write_back_cache_ = index->AsMemoryIndex();
         return true;
     }
     if (option_name == "write-cache.max-item-count") {
@@ -259,6 +288,20 @@ bool DiskHashIndex::SetOption(const string& option_name, const string& option) {
             "Write back cache configuration failed");
         return true;
     }
+    if (option_name == "io-scheduler") {
+        CHECK(this->io_scheduler_ == NULL, "IO scheduler already created");
+        CHECK(To<bool>(option).valid(), "Illegal option " << option);
+        if (To<bool>(option).value()) {
+            this->io_scheduler_ = new IOScheduler();
+        }
+        return true;
+    }
+    if (StartsWith(option_name, "io-scheduler.")) {
+        CHECK(this->io_scheduler_ != NULL, "IO scheduler not created");
+        CHECK(this->io_scheduler_->SetOption(option_name.substr(strlen("io-scheduler.")), option),
+            "IO scheduler configuration failed");
+        return true;
+    }
     // transactions
     if (StartsWith(option_name, "transactions.")) {
         if (this->trans_system_ == NULL) {
@@ -282,6 +325,9 @@ bool DiskHashIndex::DumpData() {
     if (this->overflow_area_) {
         logfile_data.set_overflow_area(true);
     }
+    if (this->checksum_type_ != DISK_HASH_CHECKSUM_CRC32) {
+        logfile_data.set_checksum_type(this->checksum_type_);
+    }
 
     for (size_t i = 0; i < this->filename_.size(); i++) {
         logfile_data.add_filename(this->filename_[i]);
@@ -329,9 +375,26 @@ bool DiskHashIndex::ReadDumpData() {
     if (this->overflow_area_) {
         CHECK(logfile_data.has_overflow_area() && logfile_data.overflow_area(), "Overflow mismatch: stored false, configured true");
     }
+
+    // the pages of an existing index are always verified with the checksum type they have been written with
+    if (this->checksum_type_ != logfile_data.checksum_type()) {
+        INFO("Checksum type of existing index differs from configuration: " <<
+            "stored " << DiskHashChecksumType_Name(logfile_data.checksum_type()) <<
+            ", configured " << DiskHashChecksumType_Name(this->checksum_type_));
+        this->checksum_type_ = logfile_data.checksum_type();
+    }
     return true;
 }
 
+uint32_t DiskHashIndex::CalculatePageChecksum(const void* data, size_t data_size) const {
+    if (checksum_type_ == DISK_HASH_CHECKSUM_CRC32C) {
+        return crc32c_raw(data, data_size);
+    }
+    CRC crc_gen;
+    crc_gen.Update(data, data_size);
+    return crc_gen.GetRawValue();
+}
+
 uint64_t DiskHashIndex::GetEstimatedMaxItemCount() {
     if ((this->max_key_size_ + max_value_size_) == 0) {
         return 0;
@@ -424,6 +487,14 @@ bool DiskHashIndex::Start(const StartContext& start_context) {
         this->file_[i] = tmp_file;
     }
 
+    if (this->io_scheduler_) {
+        for (size_t i = 0; i < this->file_.size(); i++) {
+            CHECK(this->io_scheduler_->RegisterFile(this->file_[i]),
+                "Failed to register file at io scheduler: " << this->filename_[i]);
+        }
+        CHECK(this->io_scheduler_->Start(), "Failed to start io scheduler");
+    }
+
     CHECK(File::MakeParentDirectory(this->info_filename_, start_context.dir_mode().mode()),
         "Failed to check parent directories");
 
@@ -1904,6 +1975,9 @@ string DiskHashIndex::PrintTrace() {
     if (trans_system_) {
         sstr << "\"transaction\": " << trans_system_->PrintTrace() << "," << std::endl;
     }
+    if (io_scheduler_) {
+        sstr << "\"io scheduler\": " << io_scheduler_->PrintStatistics() << "," << std::endl;
+    }
     sstr << "\"estimated max item count\": " << this->GetEstimatedMaxItemCount() << std::endl;
     sstr << "}";
     return sstr.str();
@@ -1936,6 +2010,9 @@ string DiskHashIndex::PrintProfile() {
     if (trans_system_) {
         sstr << "\"transaction\": " << trans_system_->PrintProfile() << "," << std::endl;
     }
+    if (io_scheduler_) {
+        sstr << "\"io scheduler\": " << io_scheduler_->PrintProfile() << "," << std::endl;
+    }
     sstr << "\"lookup time\": " << this->statistics_.lookup_time_.GetSum() << "," << std::endl;
     sstr << "\"update time\": " << this->statistics_.update_time_.GetSum() << "," << std::endl;
     sstr << "\"update time lock wait\": " << this->statistics_.update_time_lock_wait_.GetSum() << "," << std::endl;
@@ -2003,6 +2080,12 @@ DiskHashIndex::~DiskHashIndex() {
     // we do not dump the data during closing as all data that is allowed to change
     // can be recovered from the transactions.
 
+    if (this->io_scheduler_) {
+        // the scheduler must not access the files after they are closed
+        delete io_scheduler_;
+        this->io_scheduler_ = NULL;
+    }
+
     for (size_t i = 0; i < this->file_.size(); i++) {
         if (this->file_[i]) {
             if (!this->file_[i]->Sync()) {
@@ -2045,6 +2128,12 @@ IndexIterator* DiskHashIndex::CreateIterator() {
     return new DiskHashIndexIterator(this);
 }
 
+DiskHashIndexBulkLoader* DiskHashIndex::CreateBulkLoader(uint64_t max_memory) {
+    CHECK_RETURN(this->state_ == STARTED, NULL, "Index not started");
+    CHECK_RETURN(max_memory > 0, NULL, "Illegal bulk loader memory");
+    return new DiskHashIndexBulkLoader(this, max_memory);
+}
+
 uint64_t DiskHashIndex::GetEstimatedMaxCacheItemCount() {
     return this->max_cache_item_count_;
 }
@@ -2276,6 +2365,76 @@ put_result DiskHashPage::Update(const void* key, size_t key_size, const Message&
     return PUT_OK;
 }
 
+put_result DiskHashPage::RawUpdate(const void* key, size_t key_size, const void* value, size_t value_size) {
+    changed_since_last_serialize_ = true;
+    CHECK_RETURN(key, PUT_ERROR, "Key not set");
+    CHECK_RETURN(this->index_, PUT_ERROR, "Index not set");
+    CHECK_RETURN(key_size <= this->index_->max_key_size(), PUT_ERROR, "Key size > Max key size");
+    CHECK_RETURN(value_size <= this->index_->max_value_size(), PUT_ERROR, "Value size > Max value size");
+
+    TRACE("Raw update bucket: bucket " << bucket_id_ <<
+        ", key " << ToHexString(key, key_size) <<
+        ", value size " << value_size);
+
+    DiskHashEntry entry(this->index_->max_key_size(), this->index_->max_value_size());
+
+    for (uint32_t i = 0; i < this->item_count(); i++) {
+        uint32_t offset = i * entry.entry_data_size();
+        CHECK_RETURN(entry.entry_data_size() <= this->data_buffer_size_ - offset,
+            PUT_ERROR,
+            "entry data size " << entry.entry_data_size() <<
+            "available size " << this->data_buffer_size_ - offset);
+        CHECK_RETURN(entry.ParseFrom(this->data_buffer_ + offset, entry.entry_data_size()),
+            PUT_ERROR,
+            "Failed to parse entry data: " <<
+            "offset " << offset <<
+            ", item index " << i <<
+            ", bucket page " << this->DebugString());
+        if (raw_compare(entry.key(), entry.key_size(), key, key_size) == 0) {
+            CHECK_RETURN(entry.AssignRawValue(static_cast<const byte*>(value), value_size), PUT_ERROR,
+                "Failed to assign value data");
+            return PUT_OK;
+        }
+    }
+
+    if (unlikely(this->overflow_)) {
+        CHECK_RETURN(this->index_->overflow_area_, PUT_ERROR, "Overflow area not set");
+        enum lookup_result r = this->index_->overflow_area_->Lookup(key, key_size, NULL);
+        CHECK_RETURN(r != LOOKUP_ERROR, PUT_ERROR, "Error lookup up overflow area");
+        if (r == LOOKUP_FOUND) {
+            return this->index_->overflow_area_->RawPut(key, key_size, value, value_size);
+        }
+    }
+
+    uint32_t next_offset = this->item_count() * entry.entry_data_size();
+    bool isOverflow = (this->item_count() + 1) * entry.entry_data_size() >= this->data_buffer_size();
+    if (likely(!isOverflow)) {
+        byte* entry_buffer = this->data_buffer_ + next_offset;
+        size_t entry_size = this->data_buffer_size_ - next_offset;
+        CHECK_RETURN(entry.AssignBuffer(entry_buffer, entry_size), PUT_ERROR,
+            "Failed to parse entry data: offset " << next_offset << ", entry size " << entry_size << ", buffer size " << this->data_buffer_size_);
+        CHECK_RETURN(entry.AssignKey(key, key_size), PUT_ERROR,
+            "Failed to assign value data: key size " << key_size << ", max key size " << entry.max_key_size());
+        CHECK_RETURN(entry.AssignRawValue(static_cast<const byte*>(value), value_size), PUT_ERROR,
+            "Failed to assign value data: value size " << value_size);
+
+        this->index_->item_count_++;
+        this->item_count_++;
+    } else {
+        CHECK_RETURN(this->index_->overflow_area_, PUT_ERROR, "Bucket full: " <<
+            "bucket id " << this->bucket_id_ <<
+            ", item count " << this->item_count() <<
+            ", overflow area not set");
+        if (!this->overflow_) {
+            this->overflow_ = true;
+            TRACE("Bucket " << this->bucket_id_ << " switches to overflow mode");
+        }
+        CHECK_RETURN(this->index_->overflow_area_->RawPut(key, key_size, value, value_size) != PUT_ERROR, PUT_ERROR,
+            "Failed to put data to overflow area");
+    }
+    return PUT_OK;
+}
+
 DiskHashPage::DiskHashPage(DiskHashIndex* c, uint64_t bucket_id, byte* buffer, size_t buffer_size) {
     this->index_ = c;
     this->bucket_id_ = bucket_id;
@@ -2299,9 +2458,7 @@ bool DiskHashPage::SerializeToBuffer() {
     }
 
     if (index_->crc_) {
-        CRC crc;
-        crc.Update(this->data_buffer_, used_data_size());
-        page_data_.set_crc(crc.GetRawValue());
+        page_data_.set_crc(index_->CalculatePageChecksum(this->data_buffer_, used_data_size()));
     }
 
     Option<size_t> s = SerializeSizedMessage(page_data_, this->buffer_, kPageDataSize, this->index_->crc_);
@@ -2328,7 +2485,12 @@ bool DiskHashPage::Write(File* file) {
 
     // We always write the complete page. Writing less only leads to read/modify write cycles
     ProfileTimer timer(index_->statistics_.write_disk_time_);
-    int result = file->Write(offset, this->buffer_, this->buffer_size_);
+    int result = 0;
+    if (index_->io_scheduler_) {
+        result = index_->io_scheduler_->Write(file, offset, this->buffer_, this->buffer_size_);
+    } else {
+        result = file->Write(offset, this->buffer_, this->buffer_size_);
+    }
     CHECK(result == this->buffer_size_ && result != File::kIOError,
         "Hash write failed: " << DebugString());
     timer.stop();
@@ -2533,10 +2695,8 @@ bool DiskHashPage::ParseBuffer() {
         this->overflow_ = true;
     }
     if (likely(page_data_.has_crc() && index_->crc_)) {
-        CRC crc_gen;
-        crc_gen.Update(this->data_buffer_, used_data_size());
         uint32_t stored = page_data_.crc();
-        uint32_t generated = crc_gen.GetRawValue();
+        uint32_t generated = index_->CalculatePageChecksum(this->data_buffer_, used_data_size());
         CHECK(stored == generated, "CRC check failed: " <<
             "stored " << stored <<
             ", generated " << generated <<
@@ -2556,7 +2716,12 @@ bool DiskHashPage::Read(File* file) {
     // Scope for profile timing
     {
         ProfileTimer timer(this->index_->statistics_.read_disk_time_);
-        ssize_t r = file->Read(offset, this->buffer_, this->index_->page_size_);
+        ssize_t r = 0;
+        if (index_->io_scheduler_) {
+            r = index_->io_scheduler_->Read(file, offset, this->buffer_, this->index_->page_size_);
+        } else {
+            r = file->Read(offset, this->buffer_, this->index_->page_size_);
+        }
         CHECK(r == this->index_->page_size_,
             "Cannot read page data: " <<
             "bucket " << bucket_id_ <<
@@ -0,0 +1,425 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <base/disk_hash_index_bulk_loader.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "dedupv1_base.pb.h"
+
+#include <base/disk_hash_index.h>
+#include <base/disk_hash_index_transaction.h>
+#include <base/locks.h>
+#include <base/logging.h>
+#include <base/strutil.h>
+
+using std::string;
+using std::vector;
+using std::tr1::unordered_map;
+using dedupv1::base::strutil::ToString;
+using dedupv1::base::ScopedReadWriteLock;
+using dedupv1::base::internal::DiskHashPage;
+using dedupv1::base::internal::DiskHashIndexTransaction;
+using google::protobuf::Message;
+
+LOGGER("DiskHashIndexBulkLoader");
+
+namespace dedupv1 {
+namespace base {
+
+namespace {
+
+size_t EntrySize(const byte* entry) {
+    uint32_t key_size = 0;
+    uint32_t value_size = 0;
+    memcpy(&key_size, entry + sizeof(uint64_t), sizeof(key_size));
+    memcpy(&value_size, entry + sizeof(uint64_t) + sizeof(key_size), sizeof(value_size));
+    return sizeof(uint64_t) + sizeof(key_size) + sizeof(value_size) + key_size + value_size;
+}
+
+}
+
+DiskHashIndexBulkLoader::RunReader::RunReader(File* file, uint64_t file_size) {
+    file_ = file;
+    file_size_ = file_size;
+    file_offset_ = 0;
+    buffer_pos_ = 0;
+    memory_data_ = NULL;
+    memory_entries_ = NULL;
+    memory_pos_ = 0;
+    current_ = NULL;
+    end_ = false;
+}
+
+DiskHashIndexBulkLoader::RunReader::RunReader(const bytestring* data, const vector<EntryRef>* entries) {
+    file_ = NULL;
+    file_size_ = 0;
+    file_offset_ = 0;
+    buffer_pos_ = 0;
+    memory_data_ = data;
+    memory_entries_ = entries;
+    memory_pos_ = 0;
+    current_ = NULL;
+    end_ = false;
+}
+
+bool DiskHashIndexBulkLoader::RunReader::Fill(size_t size) {
+    if (buffer_.size() - buffer_pos_ >= size) {
+        return true;
+    }
+    // move the unread data to the front and read the next part of the run file
+    buffer_.erase(0, buffer_pos_);
+    buffer_pos_ = 0;
+
+    size_t read_size = kRunBufferSize;
+    if (read_size > file_size_ - file_offset_) {
+        read_size = file_size_ - file_offset_;
+    }
+    size_t old_size = buffer_.size();
+    buffer_.resize(old_size + read_size);
+    ssize_t r = file_->Read(file_offset_, &buffer_[old_size], read_size);
+    CHECK(r == static_cast<ssize_t>(read_size), "Failed to read run file: " <<
+        "file " << file_->path() <<
+        ", offset " << file_offset_ <<
+        ", size " << read_size);
+    file_offset_ += read_size;
+    CHECK(buffer_.size() >= size, "Run file truncated: " <<
+        "file " << file_->path() <<
+        ", offset " << file_offset_);
+    return true;
+}
+
+bool DiskHashIndexBulkLoader::RunReader::Next() {
+    if (memory_entries_) {
+        if (memory_pos_ >= memory_entries_->size()) {
+            end_ = true;
+            current_ = NULL;
+            return true;
+        }
+        current_ = memory_data_->data() + (*memory_entries_)[memory_pos_].offset;
+        memory_pos_++;
+        return true;
+    }
+
+    if (buffer_pos_ == buffer_.size() && file_offset_ == file_size_) {
+        end_ = true;
+        current_ = NULL;
+        return true;
+    }
+    CHECK(Fill(kEntryHeaderSize), "Failed to read entry header");
+    size_t entry_size = EntrySize(buffer_.data() + buffer_pos_);
+    CHECK(Fill(entry_size), "Failed to read entry");
+    current_ = buffer_.data() + buffer_pos_;
+    buffer_pos_ += entry_size;
+    return true;
+}
+
+uint64_t DiskHashIndexBulkLoader::RunReader::bucket_id() const {
+    uint64_t bucket_id = 0;
+    memcpy(&bucket_id, current_, sizeof(bucket_id));
+    return bucket_id;
+}
+
+size_t DiskHashIndexBulkLoader::RunReader::key_size() const {
+    uint32_t key_size = 0;
+    memcpy(&key_size, current_ + sizeof(uint64_t), sizeof(key_size));
+    return key_size;
+}
+
+size_t DiskHashIndexBulkLoader::RunReader::value_size() const {
+    uint32_t value_size = 0;
+    memcpy(&value_size, current_ + sizeof(uint64_t) + sizeof(uint32_t), sizeof(value_size));
+    return value_size;
+}
+
+const void* DiskHashIndexBulkLoader::RunReader::key() const {
+    return current_ + kEntryHeaderSize;
+}
+
+const void* DiskHashIndexBulkLoader::RunReader::value() const {
+    return current_ + kEntryHeaderSize + key_size();
+}
+
+DiskHashIndexBulkLoader::DiskHashIndexBulkLoader(DiskHashIndex* index, uint64_t max_memory) {
+    index_ = index;
+    max_memory_ = max_memory;
+    entry_count_ = 0;
+    page_count_ = 0;
+    finished_ = false;
+}
+
+DiskHashIndexBulkLoader::~DiskHashIndexBulkLoader() {
+    if (!RemoveRunFiles()) {
+        WARNING("Failed to remove bulk load run files");
+    }
+}
+
+bool DiskHashIndexBulkLoader::RemoveRunFiles() {
+    bool failed = false;
+    for (size_t i = 0; i < run_files_.size(); i++) {
+        delete run_files_[i];
+        run_files_[i] = NULL;
+        if (!File::Remove(run_filenames_[i])) {
+            WARNING("Failed to remove run file: " << run_filenames_[i]);
+            failed = true;
+        }
+    }
+    run_files_.clear();
+    run_filenames_.clear();
+    run_file_sizes_.clear();
+    return !failed;
+}
+
+put_result DiskHashIndexBulkLoader::Put(const void* key, size_t key_size, const Message& message) {
+    string value;
+    CHECK_RETURN(message.SerializeToString(&value), PUT_ERROR,
+        "Failed to serialize message: " << message.ShortDebugString());
+    return RawPut(key, key_size, value.data(), value.size());
+}
+
+put_result DiskHashIndexBulkLoader::RawPut(const void* key, size_t key_size,
+                                           const void* value, size_t value_size) {
+    CHECK_RETURN(index_, PUT_ERROR, "Index not set");
+    CHECK_RETURN(!finished_, PUT_ERROR, "Bulk load already finished");
+    CHECK_RETURN(key, PUT_ERROR, "Key not set");
+    CHECK_RETURN(key_size <= index_->max_key_size(), PUT_ERROR, "Key size > Max key size");
+    CHECK_RETURN(value_size <= index_->max_value_size(), PUT_ERROR, "Value size > Max value size");
+
+    EntryRef entry;
+    entry.bucket_id = index_->GetBucket(key, key_size);
+    entry.offset = data_.size();
+
+    uint32_t key_size32 = key_size;
+    uint32_t value_size32 = value_size;
+    byte header[kEntryHeaderSize];
+    memcpy(header, &entry.bucket_id, sizeof(entry.bucket_id));
+    memcpy(header + sizeof(uint64_t), &key_size32, sizeof(key_size32));
+    memcpy(header + sizeof(uint64_t) + sizeof(uint32_t), &value_size32, sizeof(value_size32));
+
+    data_.append(header, kEntryHeaderSize);
+    data_.append(static_cast<const byte*>(key), key_size);
+    data_.append(static_cast<const byte*>(value), value_size);
+    entries_.push_back(entry);
+    entry_count_++;
+
+    if (data_.size() + entries_.size() * sizeof(EntryRef) >= max_memory_) {
+        CHECK_RETURN(SpillRun(), PUT_ERROR, "Failed to spill bulk load run");
+    }
+    return PUT_OK;
+}
+
+bool DiskHashIndexBulkLoader::SpillRun() {
+    // a stable sort keeps the put order of entries with the same key
+    std::stable_sort(entries_.begin(), entries_.end());
+
+    string filename = index_->filename_[0] + ".bulk-run-" + ToString(run_files_.size());
+    File* file = File::Open(filename, O_RDWR | O_CREAT | O_TRUNC | O_LARGEFILE, S_IRUSR | S_IWUSR);
+    CHECK(file, "Failed to open run file: " << filename);
+    run_filenames_.push_back(filename);
+    run_files_.push_back(file);
+
+    DEBUG("Spill bulk load run: file " << filename << ", entry count " << entries_.size());
+
+    bytestring buffer;
+    buffer.reserve(kRunBufferSize);
+    uint64_t offset = 0;
+    vector<EntryRef>::const_iterator i;
+    for (i = entries_.begin(); i != entries_.end(); ++i) {
+        const byte* entry = data_.data() + i->offset;
+        size_t entry_size = EntrySize(entry);
+        if (buffer.size() + entry_size > kRunBufferSize && !buffer.empty()) {
+            CHECK(file->Write(offset, buffer.data(), buffer.size()) == static_cast<ssize_t>(buffer.size()),
+                "Failed to write run file: " << filename);
+            offset += buffer.size();
+            buffer.clear();
+        }
+        buffer.append(entry, entry_size);
+    }
+    if (!buffer.empty()) {
+        CHECK(file->Write(offset, buffer.data(), buffer.size()) == static_cast<ssize_t>(buffer.size()),
+            "Failed to write run file: " << filename);
+        offset += buffer.size();
+    }
+    run_file_sizes_.push_back(offset);
+
+    data_.clear();
+    entries_.clear();
+    return true;
+}
+
+bool DiskHashIndexBulkLoader::LoadBucket(uint64_t bucket_id, vector<RunReader*>* readers, byte* page_buffer) {
+    uint32_t file_index = 0;
+    uint32_t cache_index = 0;
+    index_->GetFileIndex(bucket_id, &file_index, &cache_index);
+    File* file = index_->file_[file_index];
+    CHECK(file, "File not set");
+
+    memset(page_buffer, 0, index_->page_size_);
+    DiskHashPage page(index_, bucket_id, page_buffer, index_->page_size_);
+
+    ScopedReadWriteLock scoped_lock(index_->page_locks_.Get(cache_index));
+    CHECK(scoped_lock.AcquireWriteLock(), "Lock failed");
+
+    CHECK(page.Read(file), "Hash index page read failed: " << page.DebugString());
+    uint32_t item_count_before = page.item_count();
+
+    // the runs are ordered by their creation. Therefore a later put overwrites an earlier one
+    vector<RunReader*>::iterator i;
+    for (i = readers->begin(); i != readers->end(); ++i) {
+        RunReader* reader = *i;
+        while (!reader->end() && reader->bucket_id() == bucket_id) {
+            CHECK(page.RawUpdate(reader->key(), reader->key_size(), reader->value(), reader->value_size()) != PUT_ERROR,
+                "Failed to update page: " << page.DebugString());
+            CHECK(reader->Next(), "Failed to read next bulk load entry");
+        }
+    }
+    if (page.item_count() > item_count_before) {
+        index_->total_item_count_ += (page.item_count() - item_count_before);
+    }
+    CHECK(page.Write(file), "Hash index page write failed: " << page.DebugString());
+
+    if (index_->write_back_cache_) {
+        // drop an outdated clean copy of the page
+        DiskHashIndex::CacheLine* cache_line = index_->cache_lines_[cache_index];
+        unordered_map<uint64_t, uint32_t>::iterator j = cache_line->cache_page_map_.find(bucket_id);
+        if (j != cache_line->cache_page_map_.end()) {
+            CHECK(index_->EvictCacheItem(cache_line, j->second, false),
+                "Failed to evict cache page: bucket id " << bucket_id);
+        }
+    }
+    CHECK(scoped_lock.ReleaseLock(), "Unlock failed");
+    page_count_++;
+    return true;
+}
+
+bool DiskHashIndexBulkLoader::PersistItemCount(uint64_t bucket_id, byte* page_buffer) {
+    uint32_t file_index = 0;
+    uint32_t cache_index = 0;
+    index_->GetFileIndex(bucket_id, &file_index, &cache_index);
+    File* file = index_->file_[file_index];
+    CHECK(file, "File not set");
+
+    memset(page_buffer, 0, index_->page_size_);
+    DiskHashPage page(index_, bucket_id, page_buffer, index_->page_size_);
+
+    ScopedReadWriteLock scoped_lock(index_->page_locks_.Get(cache_index));
+    CHECK(scoped_lock.AcquireWriteLock(), "Lock failed");
+    CHECK(page.Read(file), "Hash index page read failed: " << page.DebugString());
+
+    // the page is written unchanged. The transaction data contains the current version and item count
+    // from which the item count is recovered after a restart.
+    DiskHashIndexTransaction transaction(index_->trans_system_, page);
+    CHECK(transaction.Start(file_index, page), "Failed to start transaction: " << page.DebugString());
+    CHECK(page.Write(file), "Hash index page write failed: " << page.DebugString());
+    CHECK(transaction.Commit(), "Commit failed: " << page.DebugString());
+    CHECK(scoped_lock.ReleaseLock(), "Unlock failed");
+    return true;
+}
+
+bool DiskHashIndexBulkLoader::Finish() {
+    CHECK(index_, "Index not set");
+    CHECK(!finished_, "Bulk load already finished");
+    CHECK(index_->state_ == DiskHashIndex::STARTED, "Index not started");
+    finished_ = true;
+
+    INFO("Finish bulk load: " <<
+        "entry count " << entry_count_ <<
+        ", run count " << run_files_.size() <<
+        ", in-memory entry count " << entries_.size());
+
+    if (index_->write_back_cache_) {
+        // dirty cache pages would overwrite the bulk loaded pages later
+        CHECK(index_->PersistAllDirty(), "Failed to persist dirty pages");
+        CHECK(index_->GetDirtyItemCount() == 0, "Bulk load not possible with dirty (pinned) items: " <<
+            "dirty item count " << index_->GetDirtyItemCount());
+    }
+    std::stable_sort(entries_.begin(), entries_.end());
+
+    if (index_->trans_system_) {
+        CHECK(index_->trans_system_->ClearTransactionAreas(), "Failed to clear transaction areas");
+    }
+    // invalidates open iterators
+    index_->version_counter_++;
+
+    vector<RunReader*> readers;
+    for (size_t i = 0; i < run_files_.size(); i++) {
+        readers.push_back(new RunReader(run_files_[i], run_file_sizes_[i]));
+    }
+    readers.push_back(new RunReader(&data_, &entries_));
+
+    bytestring page_buffer;
+    page_buffer.resize(index_->page_size_);
+
+    bool failed = false;
+    for (size_t i = 0; i < readers.size() && !failed; i++) {
+        if (!readers[i]->Next()) {
+            failed = true;
+        }
+    }
+    uint64_t last_bucket_id = 0;
+    while (!failed) {
+        // merge the sorted runs in bucket order
+        bool found = false;
+        uint64_t bucket_id = 0;
+        for (size_t i = 0; i < readers.size(); i++) {
+            if (!readers[i]->end() && (!found || readers[i]->bucket_id() < bucket_id)) {
+                bucket_id = readers[i]->bucket_id();
+                found = true;
+            }
+        }
+        if (!found) {
+            break;
+        }
+        if (!LoadBucket(bucket_id, &readers, &page_buffer[0])) {
+            ERROR("Failed to load bucket: bucket id " << bucket_id);
+            failed = true;
+        }
+        last_bucket_id = bucket_id;
+    }
+    for (size_t i = 0; i < readers.size(); i++) {
+        delete readers[i];
+    }
+    readers.clear();
+    CHECK(!failed, "Bulk load failed");
+
+    for (size_t i = 0; i < index_->file_.size(); i++) {
+        CHECK(index_->file_[i]->Sync(), "Failed to sync index file: " << index_->filename_[i]);
+    }
+    if (index_->trans_system_ && page_count_ > 0) {
+        CHECK(PersistItemCount(last_bucket_id, &page_buffer[0]), "Failed to persist item count");
+    }
+
+    data_.clear();
+    entries_.clear();
+    CHECK(RemoveRunFiles(), "Failed to remove run files");
+
+    INFO("Finished bulk load: " <<
+        "entry count " << entry_count_ <<
+        ", page count " << page_count_ <<
+        ", index item count " << index_->GetItemCount());
+    return true;
+}
+
+}
+}
@@ -188,6 +188,28 @@ bool DiskHashIndexTransactionSystem::Start(const StartContext& start_context, bo
     return true;
 }
 
+bool DiskHashIndexTransactionSystem::ClearTransactionAreas() {
+    CHECK(this->transaction_file_.size() > 0, "Transaction system not started");
+
+    DEBUG("Clear transaction areas: transaction area count " << transaction_area_size());
+
+    DiskHashTransactionPageData transaction_page_data;
+    // nothing set
+    for (uint64_t i = 0; i < transaction_area_size(); i++) {
+        MutexLock* area_lock = lock(i);
+        CHECK(area_lock->AcquireLock(), "Failed to acquire lock: transaction area " << i);
+
+        File* file = transaction_file(i);
+        bool written = file && file->WriteSizedMessage(transaction_area_offset(i),
+            transaction_page_data, page_size(), true) >= 0;
+        last_file_index_[i] = -1;
+
+        CHECK(area_lock->ReleaseLock(), "Failed to release lock: transaction area " << i);
+        CHECK(written, "Failed to clear transaction area " << i);
+    }
+    return true;
+}
+
 bool DiskHashIndexTransactionSystem::CorrectItemCount(const DiskHashTransactionPageData& page_data) {
     if ((page_data.has_version() && page_data.version() > index_->version_counter_) ||
         (page_data.has_version() && page_data.version() == index_->version_counter_ && page_data.item_count() > index_->item_count_)) {
@@ -32,6 +32,7 @@
 #include "sys/time.h"
 #include <sys/types.h>
 #include <sys/file.h>
+#include <sys/uio.h>
 #include <dirent.h>
 #include <errno.h>
 #include <unistd.h>
@@ -203,6 +204,40 @@ ssize_t File::Read(void* data, size_t size) {
     return bytes;
 }
 
+ssize_t File::ReadV(off_t offset, const struct iovec* iov, int iovcnt) {
+    ssize_t bytes = 0;
+    while (true) {
+        bytes = preadv(this->fd_, iov, iovcnt, offset);
+        if (bytes >= 0) {
+            break;
+        }
+        // bytes < 0
+        if (errno == EINTR) {
+            continue; // operation has been interrupted, try again
+        }
+        ERROR("Vectored read failed: " << path() << ", offset " << offset << ", iov count " << iovcnt << ": " << strerror(errno));
+        return bytes;
+    }
+    return bytes;
+}
+
+ssize_t File::WriteV(off_t offset, const struct iovec* iov, int iovcnt) {
+    ssize_t bytes = 0;
+    while (true) {
+        bytes = pwritev(this->fd_, iov, iovcnt, offset);
+        if (bytes >= 0) {
+            break;
+        }
+        // bytes < 0
+        if (errno == EINTR) {
+            continue; // operation has been interrupted, try again
+        }
+        ERROR("Vectored write failed: " << path() << ", offset " << offset << ", iov count " << iovcnt << ": " << strerror(errno));
+        return bytes;
+    }
+    return bytes;
+}
+
 ssize_t File::Write(const void* data, size_t size) {
     ssize_t bytes = 0;
     while (true) {
@@ -271,6 +306,11 @@ bool File::Sync() {
     return true;
 }
 
+bool File::DataSync() {
+    CHECK(fdatasync(this->fd_) != -1, path() << ", message " << strerror(errno));
+    return true;
+}
+
 ssize_t File::WriteSizedMessage(off_t offset, const ::google::protobuf::Message& message, size_t max_size,
                                 bool checksum) {
     size_t value_size = message.ByteSize() + 32;
@@ -29,6 +29,7 @@
 #include <base/crc32.h>
 #include <base/bitutil.h>
 #include <base/protobuf_util.h>
+#include <base/memory.h>
 
 #include "dedupv1_base.pb.h"
 
@@ -58,6 +59,8 @@ using dedupv1::base::crc_raw;
 using dedupv1::base::crc;
 using dedupv1::base::ProfileTimer;
 using dedupv1::base::File;
+using dedupv1::base::ScopedArray;
+using dedupv1::base::strutil::StartsWith;
 using google::protobuf::Message;
 
 LOGGER("FixedIndex");
@@ -79,6 +82,7 @@ FixedIndex::FixedIndex() : IDBasedIndex(NO_CAPABILITIES) {
     this->version_counter = 0;
     this->state = FIXED_INDEX_STATE_CREATED;
     bucket_size = 0;
+    io_scheduler = NULL;
 }
 
 bool FixedIndex::SetOption(const string& option_name, const string& option) {
@@ -99,6 +103,20 @@ bool FixedIndex::SetOption(const string& option_name, const string& option) {
         CHECK(this->size > 0, "Illegal size: " << option);
         return true;
     }
+    if (option_name == "io-scheduler") {
+        CHECK(this->io_scheduler == NULL, "IO scheduler already created");
+        CHECK(To<bool>(option).valid(), "Illegal option " << option);
+        if (To<bool>(option).value()) {
+            this->io_scheduler = new IOScheduler();
+        }
+        return true;
+    }
+    if (StartsWith(option_name, "io-scheduler.")) {
+        CHECK(this->io_scheduler != NULL, "IO scheduler not created");
+        CHECK(this->io_scheduler->SetOption(option_name.substr(strlen("io-scheduler.")), option),
+            "IO scheduler configuration failed");
+        return true;
+    }
     return Index::SetOption(option_name, option);
 }
 
@@ -203,6 +221,14 @@ bool FixedIndex::Start(const StartContext& start_context) {
             ", actual size " << file_size.value());
     }
 
+    if (this->io_scheduler) {
+        for (int i = 0; i < this->files.size(); i++) {
+            CHECK(this->io_scheduler->RegisterFile(this->files[i]),
+                "Failed to register file at io scheduler: " << this->files[i]->path());
+        }
+        CHECK(this->io_scheduler->Start(), "Failed to start io scheduler");
+    }
+
     DEBUG("Starting index: width " << this->width <<
         ", bucket size " << this->bucket_size <<
         ", total size " << this->size);
@@ -236,7 +262,14 @@ lookup_result FixedIndex::ReadBucket(File* file, int64_t file_id, int64_t global
     FixedIndexBucketData data;
     {
         ProfileTimer disk_timer(this->disk_time);
-        if (!file->ReadSizedMessage(offset, &data, this->bucket_size, true)) {
+        if (this->io_scheduler) {
+            ScopedArray<byte> buffer(new byte[this->bucket_size]);
+            reads = this->io_scheduler->Read(file, offset, buffer.Get(), this->bucket_size);
+            CHECK_RETURN(reads > 0, LOOKUP_ERROR, "Failed to read bucket: " <<
+                "file " << file->path() << ", offset " << offset);
+            CHECK_RETURN(ParseSizedMessage(&data, buffer.Get(), reads, true).valid(), LOOKUP_ERROR,
+                "Failed to parse bucket: file " << file->path() << ", offset " << offset);
+        } else if (!file->ReadSizedMessage(offset, &data, this->bucket_size, true)) {
             return LOOKUP_ERROR;
         }
     }
@@ -306,6 +339,19 @@ lookup_result FixedIndex::Lookup(const void* key, size_t key_size,
     return r;
 }
 
+ssize_t FixedIndex::WriteBucketData(File* file, off_t offset, const Message& data) {
+    if (this->io_scheduler == NULL) {
+        return file->WriteSizedMessage(offset, data, this->bucket_size, true);
+    }
+    ScopedArray<byte> buffer(new byte[this->bucket_size]);
+    Option<size_t> vs = SerializeSizedMessage(data, buffer.Get(), this->bucket_size, true);
+    CHECK_RETURN(vs.valid(), -1, "Cannot serialize bucket: " << data.ShortDebugString());
+    if (this->io_scheduler->Write(file, offset, buffer.Get(), vs.value()) != (ssize_t) vs.value()) {
+        return -1;
+    }
+    return vs.value();
+}
+
 put_result FixedIndex::WriteBucket(File* file, int64_t file_id, int64_t global_id, const Message& message) {
     size_t offset = GetOffset(file, file_id);
 
@@ -318,7 +364,7 @@ put_result FixedIndex::WriteBucket(File* file, int64_t file_id, int64_t global_i
     TRACE("Write bucket " << file_id << ": offset " << offset << ", data " << data.ShortDebugString());
     {
         ProfileTimer disk_timer(this->disk_time);
-        ssize_t writes = file->WriteSizedMessage(offset, data, this->bucket_size, true);
+        ssize_t writes = WriteBucketData(file, offset, data);
         if (writes == -1) {
             ERROR("Error writing bucket into data file");
             return PUT_ERROR;
@@ -336,7 +382,7 @@ delete_result FixedIndex::DeleteBucket(File* file, int64_t file_id, int64_t glob
     TRACE("Mark bucket " << file_id << " as invalid: offset " << offset << ", data " << data.ShortDebugString());
     {
         ProfileTimer disk_timer(this->disk_time);
-        ssize_t writes = file->WriteSizedMessage(offset, data, this->bucket_size, true);
+        ssize_t writes = WriteBucketData(file, offset, data);
         if (writes == -1) {
             ERROR("Error deleting bucket from data file");
             return DELETE_ERROR;
@@ -398,6 +444,11 @@ delete_result FixedIndex::Delete(const void* key, size_t key_size) {
 
 FixedIndex::~FixedIndex() {
     DEBUG("Closing index");
+    if (this->io_scheduler) {
+        // the scheduler must not access the files after they are closed
+        delete io_scheduler;
+        io_scheduler = NULL;
+    }
     for (size_t i = 0; i < this->files.size(); i++) {
         if (this->files[i]) {
             if (!this->files[i]->Sync()) {
@@ -415,6 +466,9 @@ string FixedIndex::PrintProfile() {
     stringstream sstr;
     sstr << "{";
     sstr << "\"total\": " << this->profiling.GetSum() << "," << std::endl;
+    if (this->io_scheduler) {
+        sstr << "\"io scheduler\": " << this->io_scheduler->PrintProfile() << "," << std::endl;
+    }
     sstr << "\"disk time\": " << this->disk_time.GetSum() << std::endl;
     sstr << "}";
     return sstr.str();
@@ -425,6 +479,9 @@ string FixedIndex::PrintTrace() {
     sstr << "{";
     sstr << "\"limit id\": " << GetLimitId() << "," << std::endl;
     sstr << "\"items\": " << GetItemCount() << "," << std::endl;
+    if (this->io_scheduler) {
+        sstr << "\"io scheduler\": " << this->io_scheduler->PrintStatistics() << "," << std::endl;
+    }
     sstr << "\"size\": " << GetPersistentSize() << std::endl;
     sstr << "}";
     return sstr.str();
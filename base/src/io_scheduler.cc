@@ -0,0 +1,376 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <base/io_scheduler.h>
+#include <base/logging.h>
+#include <base/strutil.h>
+
+#include <sys/uio.h>
+
+#include <sstream>
+
+using std::map;
+using std::multimap;
+using std::string;
+using std::stringstream;
+using std::vector;
+using std::make_pair;
+using dedupv1::base::strutil::To;
+using dedupv1::base::strutil::ToString;
+using dedupv1::base::strutil::ToStorageUnit;
+
+LOGGER("IOScheduler");
+
+namespace dedupv1 {
+namespace base {
+
+IOScheduler::FileQueue::FileQueue(File* file) : average_latency_(256), average_queue_length_(256) {
+    file_ = file;
+    head_position_ = 0;
+    thread_ = NULL;
+    read_count_ = 0;
+    write_count_ = 0;
+    submit_count_ = 0;
+    merged_count_ = 0;
+    queue_full_count_ = 0;
+    io_error_count_ = 0;
+    max_queue_length_ = 0;
+}
+
+IOScheduler::FileQueue::~FileQueue() {
+    if (thread_) {
+        delete thread_;
+        thread_ = NULL;
+    }
+}
+
+IOScheduler::IOScheduler() {
+    state_ = CREATED;
+    queue_depth_ = kDefaultQueueDepth;
+    max_merge_size_ = kDefaultMaxMergeSize;
+}
+
+IOScheduler::~IOScheduler() {
+    if (!Stop()) {
+        WARNING("Failed to stop io scheduler");
+    }
+    for (size_t i = 0; i < queues_.size(); i++) {
+        delete queues_[i];
+        queues_[i] = NULL;
+    }
+    queues_.clear();
+    queue_map_.clear();
+}
+
+bool IOScheduler::SetOption(const string& option_name, const string& option) {
+    CHECK(state_ == CREATED, "Illegal state: " << state_);
+    if (option_name == "queue-depth") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        queue_depth_ = To<uint32_t>(option).value();
+        CHECK(queue_depth_ > 0, "Illegal queue depth: " << option);
+        return true;
+    }
+    if (option_name == "max-merge-size") {
+        CHECK(ToStorageUnit(option).valid(), "Illegal option " << option);
+        max_merge_size_ = ToStorageUnit(option).value();
+        return true;
+    }
+    ERROR("Illegal option: " << option_name);
+    return false;
+}
+
+bool IOScheduler::RegisterFile(File* file) {
+    CHECK(file, "File not set");
+    CHECK(state_ == CREATED, "Illegal state: " << state_);
+    CHECK(queue_map_.find(file) == queue_map_.end(), "File already registered: " << file->path());
+
+    FileQueue* queue = new FileQueue(file);
+    queues_.push_back(queue);
+    queue_map_[file] = queue;
+    return true;
+}
+
+bool IOScheduler::IsRegistered(const File* file) const {
+    return queue_map_.find(file) != queue_map_.end();
+}
+
+bool IOScheduler::Start() {
+    CHECK(state_ == CREATED, "Illegal state: " << state_);
+    DEBUG("Starting io scheduler: files " << queues_.size() <<
+        ", queue depth " << queue_depth_ <<
+        ", max merge size " << max_merge_size_);
+
+    state_ = STARTED;
+    for (size_t i = 0; i < queues_.size(); i++) {
+        FileQueue* queue = queues_[i];
+        queue->thread_ = new Thread<bool>(NewRunnable(this, &IOScheduler::Loop, queue),
+            "io " + ToString(i));
+        CHECK(queue->thread_->Start(), "Failed to start submission thread: " << queue->file_->path());
+    }
+    return true;
+}
+
+bool IOScheduler::Stop() {
+    if (state_ != STARTED) {
+        state_ = STOPPED;
+        return true;
+    }
+    DEBUG("Stopping io scheduler");
+    state_ = STOPPED;
+
+    bool failed = false;
+    for (size_t i = 0; i < queues_.size(); i++) {
+        FileQueue* queue = queues_[i];
+        if (!queue->work_condition_.Broadcast()) {
+            WARNING("Failed to wake up submission thread");
+        }
+        if (queue->thread_ && queue->thread_->IsJoinable()) {
+            bool thread_result = false;
+            if (!queue->thread_->Join(&thread_result)) {
+                ERROR("Failed to join submission thread: " << queue->file_->path());
+                failed = true;
+            } else if (!thread_result) {
+                ERROR("Submission thread exited with error: " << queue->file_->path());
+                failed = true;
+            }
+        }
+    }
+    return !failed;
+}
+
+void IOScheduler::NextBatch(FileQueue* queue, vector<Request*>* batch) {
+    // one-way elevator: continue at the last head position, wrap around
+    // at the end of the file
+    multimap<off_t, Request*>::iterator i = queue->pending_.lower_bound(queue->head_position_);
+    if (i == queue->pending_.end()) {
+        i = queue->pending_.begin();
+    }
+    Request* first = i->second;
+    queue->pending_.erase(i);
+    batch->push_back(first);
+
+    size_t batch_size = first->size_;
+    off_t end_offset = first->offset_ + first->size_;
+    while (batch->size() < static_cast<size_t>(kMaxMergeCount)) {
+        std::pair<multimap<off_t, Request*>::iterator, multimap<off_t, Request*>::iterator> range =
+            queue->pending_.equal_range(end_offset);
+        multimap<off_t, Request*>::iterator j;
+        for (j = range.first; j != range.second; j++) {
+            if (j->second->type_ == first->type_) {
+                break;
+            }
+        }
+        if (j == range.second) {
+            break;
+        }
+        Request* next = j->second;
+        if (batch_size + next->size_ > max_merge_size_) {
+            break;
+        }
+        queue->pending_.erase(j);
+        batch->push_back(next);
+        batch_size += next->size_;
+        end_offset += next->size_;
+        queue->merged_count_++;
+    }
+    queue->head_position_ = end_offset;
+}
+
+ssize_t IOScheduler::ExecuteBatch(FileQueue* queue, const vector<Request*>& batch) {
+    DCHECK_RETURN(batch.size() > 0, File::kIOError, "Batch is empty");
+
+    ProfileTimer timer(queue->io_time_);
+    queue->submit_count_++;
+
+    Request* first = batch[0];
+    if (batch.size() == 1) {
+        if (first->type_ == REQUEST_READ) {
+            return queue->file_->Read(first->offset_, first->data_, first->size_);
+        }
+        return queue->file_->Write(first->offset_, first->data_, first->size_);
+    }
+
+    struct iovec iov[kMaxMergeCount];
+    for (size_t i = 0; i < batch.size(); i++) {
+        iov[i].iov_base = batch[i]->data_;
+        iov[i].iov_len = batch[i]->size_;
+    }
+    TRACE("Submit merged request: file " << queue->file_->path() <<
+        ", offset " << first->offset_ <<
+        ", requests " << batch.size());
+    if (first->type_ == REQUEST_READ) {
+        return queue->file_->ReadV(first->offset_, iov, batch.size());
+    }
+    return queue->file_->WriteV(first->offset_, iov, batch.size());
+}
+
+bool IOScheduler::Loop(FileQueue* queue) {
+    DCHECK(queue, "Queue not set");
+    DEBUG("Starting submission thread: file " << queue->file_->path());
+
+    vector<Request*> batch;
+    batch.reserve(kMaxMergeCount);
+
+    ScopedLock scoped_lock(&queue->lock_);
+    CHECK(scoped_lock.AcquireLock(), "Failed to acquire queue lock");
+    while (true) {
+        while (queue->pending_.empty()) {
+            if (state_ != STARTED) {
+                CHECK(scoped_lock.ReleaseLock(), "Failed to release queue lock");
+                DEBUG("Stopped submission thread: file " << queue->file_->path());
+                return true;
+            }
+            CHECK(queue->work_condition_.ConditionWaitTimeout(&queue->lock_, 1) != TIMED_FALSE,
+                "Failed to wait for new requests");
+        }
+
+        batch.clear();
+        NextBatch(queue, &batch);
+        CHECK(queue->space_condition_.Broadcast(), "Failed to broadcast free queue space");
+        CHECK(scoped_lock.ReleaseLock(), "Failed to release queue lock");
+
+        ssize_t r = ExecuteBatch(queue, batch);
+        if (r < 0) {
+            queue->io_error_count_++;
+        }
+
+        CHECK(scoped_lock.AcquireLock(), "Failed to acquire queue lock");
+        ssize_t remaining = r;
+        for (vector<Request*>::iterator i = batch.begin(); i != batch.end(); i++) {
+            Request* request = *i;
+            if (remaining < 0) {
+                request->result_ = File::kIOError;
+            } else {
+                request->result_ = remaining < static_cast<ssize_t>(request->size_) ? remaining : request->size_;
+                remaining -= request->result_;
+            }
+            request->done_ = true;
+        }
+        CHECK(queue->done_condition_.Broadcast(), "Failed to broadcast finished requests");
+    }
+    return true;
+}
+
+ssize_t IOScheduler::Submit(File* file, enum request_type type, off_t offset, byte* data, size_t size) {
+    DCHECK_RETURN(file, File::kIOError, "File not set");
+
+    map<const File*, FileQueue*>::iterator i = queue_map_.find(file);
+    if (state_ != STARTED || i == queue_map_.end()) {
+        // access the file directly
+        if (type == REQUEST_READ) {
+            return file->Read(offset, data, size);
+        }
+        return file->Write(offset, data, size);
+    }
+    FileQueue* queue = i->second;
+    if (type == REQUEST_READ) {
+        queue->read_count_++;
+    } else {
+        queue->write_count_++;
+    }
+
+    Request request;
+    request.type_ = type;
+    request.offset_ = offset;
+    request.data_ = data;
+    request.size_ = size;
+    request.result_ = File::kIOError;
+    request.done_ = false;
+    request.submit_time_ = tbb::tick_count::now();
+
+    ScopedLock scoped_lock(&queue->lock_);
+    CHECK_RETURN(scoped_lock.AcquireLock(), File::kIOError, "Failed to acquire queue lock");
+    while (queue->pending_.size() >= queue_depth_) {
+        queue->queue_full_count_++;
+        CHECK_RETURN(queue->space_condition_.ConditionWaitTimeout(&queue->lock_, 1) != TIMED_FALSE,
+            File::kIOError, "Failed to wait for free queue space");
+    }
+    queue->pending_.insert(make_pair(offset, &request));
+    uint32_t queue_length = queue->pending_.size();
+    if (queue_length > queue->max_queue_length_) {
+        queue->max_queue_length_ = queue_length;
+    }
+    queue->average_queue_length_.Add(queue_length);
+    CHECK_RETURN(queue->work_condition_.Signal(), File::kIOError, "Failed to signal submission thread");
+
+    while (!request.done_) {
+        CHECK_RETURN(queue->done_condition_.ConditionWaitTimeout(&queue->lock_, 1) != TIMED_FALSE,
+            File::kIOError, "Failed to wait for request");
+    }
+    // the sliding averages are protected by the queue lock
+    queue->average_latency_.Add((tbb::tick_count::now() - request.submit_time_).seconds() * 1000);
+    CHECK_RETURN(scoped_lock.ReleaseLock(), File::kIOError, "Failed to release queue lock");
+    return request.result_;
+}
+
+ssize_t IOScheduler::Read(File* file, off_t offset, void* data, size_t size) {
+    return Submit(file, REQUEST_READ, offset, static_cast<byte*>(data), size);
+}
+
+ssize_t IOScheduler::Write(File* file, off_t offset, const void* data, size_t size) {
+    // the data is only read by the submission thread
+    return Submit(file, REQUEST_WRITE, offset, static_cast<byte*>(const_cast<void*>(data)), size);
+}
+
+string IOScheduler::PrintStatistics() {
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"queue depth\": " << queue_depth_ << "," << std::endl;
+    sstr << "\"files\": {";
+    for (size_t i = 0; i < queues_.size(); i++) {
+        FileQueue* queue = queues_[i];
+        if (i > 0) {
+            sstr << "," << std::endl;
+        }
+        sstr << "\"" << queue->file_->path() << "\": {";
+        sstr << "\"reads\": " << queue->read_count_ << "," << std::endl;
+        sstr << "\"writes\": " << queue->write_count_ << "," << std::endl;
+        sstr << "\"submitted io\": " << queue->submit_count_ << "," << std::endl;
+        sstr << "\"merged requests\": " << queue->merged_count_ << "," << std::endl;
+        sstr << "\"queue full\": " << queue->queue_full_count_ << "," << std::endl;
+        sstr << "\"io errors\": " << queue->io_error_count_ << "," << std::endl;
+        sstr << "\"max queue length\": " << queue->max_queue_length_ << "," << std::endl;
+        sstr << "\"average queue length\": " << queue->average_queue_length_.GetAverage() << std::endl;
+        sstr << "}";
+    }
+    sstr << "}" << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+string IOScheduler::PrintProfile() {
+    stringstream sstr;
+    sstr << "{";
+    for (size_t i = 0; i < queues_.size(); i++) {
+        FileQueue* queue = queues_[i];
+        if (i > 0) {
+            sstr << "," << std::endl;
+        }
+        sstr << "\"" << queue->file_->path() << "\": {";
+        sstr << "\"io time\": " << queue->io_time_.GetSum() << "," << std::endl;
+        sstr << "\"average latency\": " << queue->average_latency_.GetAverage() << std::endl;
+        sstr << "}";
+    }
+    sstr << "}";
+    return sstr.str();
+}
+
+}
+}
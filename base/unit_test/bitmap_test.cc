@@ -712,3 +712,52 @@ TEST_F(BitmapTest, FindNextClean)
         bitmap_ = 0;
     }
 }
+
+TEST_F(BitmapTest, FindNextCleanInLargeFullBitmap)
+{
+    // spans several summary words
+    size_t size = 64 * 64 * 3 + 100;
+    bitmap_ = new Bitmap(size);
+    ASSERT_TRUE(bitmap_);
+    ASSERT_TRUE(bitmap_->SetAll());
+
+    Option<size_t> pos_value = bitmap_->find_next_unset(0, 0);
+    ASSERT_FALSE(pos_value.valid());
+
+    ASSERT_TRUE(bitmap_->clear(64 * 64 * 2 + 7));
+    ASSERT_TRUE(bitmap_->clear(size - 1));
+
+    pos_value = bitmap_->find_next_unset(0, 0);
+    ASSERT_TRUE(pos_value.valid());
+    ASSERT_EQ(64U * 64 * 2 + 7, pos_value.value());
+
+    pos_value = bitmap_->find_next_unset(64 * 64 * 2 + 8, 0);
+    ASSERT_TRUE(pos_value.valid());
+    ASSERT_EQ(size - 1, pos_value.value());
+
+    // wrapping search
+    ASSERT_TRUE(bitmap_->set(size - 1));
+    pos_value = bitmap_->find_next_unset(64 * 64 * 2 + 8, 64 * 64 * 2 + 8);
+    ASSERT_TRUE(pos_value.valid());
+    ASSERT_EQ(64U * 64 * 2 + 7, pos_value.value());
+
+    pos_value = bitmap_->find_next_unset(64 * 64 * 2 + 8, 64 * 64 * 2);
+    ASSERT_FALSE(pos_value.valid());
+
+    // a word that is full again is skipped
+    ASSERT_TRUE(bitmap_->set(64 * 64 * 2 + 7));
+    pos_value = bitmap_->find_next_unset(0, 0);
+    ASSERT_FALSE(pos_value.valid());
+
+    ASSERT_TRUE(bitmap_->Negate());
+    pos_value = bitmap_->find_next_unset(64 * 64, 0);
+    ASSERT_TRUE(pos_value.valid());
+    ASSERT_EQ(64U * 64, pos_value.value());
+    ASSERT_TRUE(bitmap_->Negate());
+    ASSERT_TRUE(bitmap_->clear(5));
+    pos_value = bitmap_->find_next_unset(6, 0);
+    ASSERT_FALSE(pos_value.valid());
+    pos_value = bitmap_->find_next_unset(6, 6);
+    ASSERT_TRUE(pos_value.valid());
+    ASSERT_EQ(5U, pos_value.value());
+}
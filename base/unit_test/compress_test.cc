@@ -22,6 +22,7 @@
 #include <unistd.h>
 
 #include <string>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -107,8 +108,73 @@ TEST_P(CompressTest, Use) {
     ASSERT_TRUE(memcmp(buffer, buffer2, file_size) == 0);
 }
 
+class ZstdDictionaryTest : public testing::Test {
+protected:
+    USE_LOGGING_EXPECTATION();
+
+    string samples;
+    std::vector<size_t> sample_sizes;
+
+    /**
+     * Creates small text-like chunks that share a vocabulary, but are different
+     */
+    virtual void SetUp() {
+        const char* words[] = {"volume ", "block ", "chunk ", "container ", "id=", "size=", "name=\"", "\", "};
+        srand(42);
+        for (int i = 0; i < 1024; i++) {
+            string sample;
+            while (sample.size() < 4096) {
+                char number[16];
+                snprintf(number, sizeof(number), "%d;", rand() % 1000);
+                sample += words[rand() % 8];
+                sample += number;
+            }
+            sample.resize(4096);
+            samples += sample;
+            sample_sizes.push_back(sample.size());
+        }
+    }
+};
+
+TEST_F(ZstdDictionaryTest, TrainAndUse) {
+    string dictionary;
+    ASSERT_TRUE(Compression::TrainZstdDictionary(samples, sample_sizes, 16 * 1024, &dictionary));
+    ASSERT_GT(dictionary.size(), 0U);
+    ASSERT_LE(dictionary.size(), 16U * 1024);
+    ASSERT_NE(0U, Compression::GetZstdDictionaryId(dictionary));
+
+    Compression* plain_comp = Compression::NewZstdCompression(Compression::kDefaultZstdLevel, "");
+    ASSERT_TRUE(plain_comp);
+    Compression* dictionary_comp = Compression::NewZstdCompression(Compression::kDefaultZstdLevel, dictionary);
+    ASSERT_TRUE(dictionary_comp);
+
+    string chunk = samples.substr(4096 * 17, 4096);
+    byte compressed[8192];
+    ssize_t plain_size = plain_comp->Compress(compressed, sizeof(compressed), chunk.data(), chunk.size());
+    ASSERT_GT(plain_size, 0);
+    ssize_t dictionary_size = dictionary_comp->Compress(compressed, sizeof(compressed), chunk.data(), chunk.size());
+    ASSERT_GT(dictionary_size, 0);
+    ASSERT_LT(dictionary_size, plain_size) << "The dictionary should improve the compression of small chunks";
+
+    // the dictionary is found by the id stored in the compressed data
+    byte decompressed[4096];
+    ASSERT_EQ(4096, plain_comp->Decompress(decompressed, sizeof(decompressed), compressed, dictionary_size));
+    ASSERT_TRUE(memcmp(decompressed, chunk.data(), chunk.size()) == 0);
+
+    delete plain_comp;
+    delete dictionary_comp;
+}
+
+TEST_F(ZstdDictionaryTest, IllegalDictionary) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Times(3);
+
+    ASSERT_FALSE(Compression::RegisterZstdDictionary("no dictionary"));
+    ASSERT_TRUE(Compression::NewZstdCompression(Compression::kDefaultZstdLevel, "no dictionary") == NULL);
+}
+
 INSTANTIATE_TEST_CASE_P(CompressionRun,
     CompressTest,
     ::testing::Combine(::testing::Values(Compression::COMPRESSION_ZLIB_1,Compression::COMPRESSION_ZLIB_3,
-            Compression::COMPRESSION_ZLIB_9, Compression::COMPRESSION_BZ2, Compression::COMPRESSION_SNAPPY, Compression::COMPRESSION_LZ4),
+            Compression::COMPRESSION_ZLIB_9, Compression::COMPRESSION_BZ2, Compression::COMPRESSION_SNAPPY, Compression::COMPRESSION_LZ4,
+            Compression::COMPRESSION_ZSTD),
         ::testing::Values("data/dedupv1_test.conf","data/compress_document.doc", "data/1mb-testdata", "data/1mb-zero")));
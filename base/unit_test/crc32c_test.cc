@@ -0,0 +1,86 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <gtest/gtest.h>
+#include <base/crc32c.h>
+#include <test_util/log_assert.h>
+
+#include <string.h>
+#include <stdlib.h>
+
+using dedupv1::base::CRC32C;
+using dedupv1::base::crc32c_raw;
+
+/**
+ * Tests the crc32c calculation
+ */
+class CRC32CTest : public testing::Test {
+protected:
+    USE_LOGGING_EXPECTATION();
+};
+
+TEST_F(CRC32CTest, KnownValues) {
+    ASSERT_EQ(crc32c_raw("", 0), 0U);
+    ASSERT_EQ(crc32c_raw("123456789", 9), 0xE3069283U);
+
+    // test vectors of RFC 3720, B.4
+    byte buffer[32];
+    memset(buffer, 0, 32);
+    ASSERT_EQ(crc32c_raw(buffer, 32), 0x8A9136AAU);
+    memset(buffer, 0xFF, 32);
+    ASSERT_EQ(crc32c_raw(buffer, 32), 0x62A8AB43U);
+    for (int i = 0; i < 32; i++) {
+        buffer[i] = i;
+    }
+    ASSERT_EQ(crc32c_raw(buffer, 32), 0x46DD794EU);
+}
+
+TEST_F(CRC32CTest, PiecewiseUpdate) {
+    byte buffer[2048];
+    for (int i = 0; i < 2048; i++) {
+        buffer[i] = rand();
+    }
+    CRC32C crc;
+    crc.Update(buffer, 2048);
+
+    CRC32C crc2;
+    crc2.Update(buffer, 3);
+    crc2.Update(buffer + 3, 1021);
+    crc2.Update(buffer + 1024, 1024);
+    ASSERT_EQ(crc.GetRawValue(), crc2.GetRawValue());
+
+    crc2.Reset();
+    crc2.Update(buffer, 2048);
+    ASSERT_EQ(crc.GetRawValue(), crc2.GetRawValue());
+}
+
+TEST_F(CRC32CTest, SoftwareEqualsHardware) {
+    byte buffer[4096 + 16];
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = rand();
+    }
+    // all alignments and a few sizes
+    for (size_t offset = 0; offset < 16; offset++) {
+        for (size_t size = 0; size < 4096; size += 123) {
+            ASSERT_EQ(CRC32C::Extend(0, buffer + offset, size), CRC32C::ExtendSoftware(0, buffer + offset, size)) <<
+            "offset " << offset << ", size " << size;
+        }
+    }
+}
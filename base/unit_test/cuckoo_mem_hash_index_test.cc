@@ -0,0 +1,279 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <base/base.h>
+#include <base/index.h>
+#include <base/cuckoo_mem_hash_index.h>
+#include <base/thread.h>
+#include <base/runnable.h>
+#include <base/logging.h>
+
+#include <tbb/tick_count.h>
+
+#include "dedupv1_base.pb.h"
+
+#include "index_test.h"
+#include <test_util/log_assert.h>
+
+using std::string;
+using dedupv1::base::Thread;
+using dedupv1::base::NewRunnable;
+
+LOGGER("CuckooMemHashIndexTest");
+
+namespace dedupv1 {
+namespace base {
+
+class CuckooMemHashIndexTest : public testing::Test {
+protected:
+    USE_LOGGING_EXPECTATION();
+
+    Index* index_;
+
+    virtual void SetUp() {
+        index_ = NULL;
+    }
+
+    virtual void TearDown() {
+        if (index_) {
+            delete index_;
+        }
+    }
+
+    static bool WriteLoop(Index* index, uint64_t key_count, uint64_t round_count) {
+        for (uint64_t round = 0; round < round_count; round++) {
+            for (uint64_t i = 0; i < key_count; i++) {
+                uint64_t value[2];
+                value[0] = i;
+                value[1] = round;
+                CHECK(index->RawPut(&i, sizeof(i), value, sizeof(value)) == PUT_OK, "Put failed");
+            }
+        }
+        return true;
+    }
+
+    static bool ReadLoop(Index* index, uint64_t key_count, uint64_t round_count) {
+        for (uint64_t round = 0; round < round_count; round++) {
+            for (uint64_t i = 0; i < key_count; i++) {
+                uint64_t value[2];
+                size_t value_size = sizeof(value);
+                enum lookup_result lr = index->RawLookup(&i, sizeof(i), value, &value_size);
+                CHECK(lr != LOOKUP_ERROR, "Lookup failed");
+                if (lr == LOOKUP_FOUND) {
+                    CHECK(value_size == sizeof(value), "Illegal value size " << value_size);
+                    CHECK(value[0] == i, "Illegal value: key " << i << ", value " << value[0]);
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Writes and reads n entries and returns the time in ms
+     */
+    static double Benchmark(Index* index, uint64_t n) {
+        tbb::tick_count start = tbb::tick_count::now();
+        for (uint64_t i = 0; i < n; i++) {
+            IntData value;
+            value.set_i(i);
+            CHECK_RETURN(index->Put(&i, sizeof(i), value) == PUT_OK, -1.0, "Put failed");
+        }
+        tbb::tick_count end = tbb::tick_count::now();
+        double write_time = (end - start).seconds() * 1000;
+
+        start = tbb::tick_count::now();
+        for (uint64_t i = 0; i < n; i++) {
+            IntData value;
+            CHECK_RETURN(index->Lookup(&i, sizeof(i), &value) == LOOKUP_FOUND, -1.0, "Lookup failed");
+        }
+        end = tbb::tick_count::now();
+        double read_time = (end - start).seconds() * 1000;
+
+        INFO("Write time " << write_time << "ms, read time " << read_time << "ms, memory size " <<
+            index->AsMemoryIndex()->GetMemorySize());
+        return write_time + read_time;
+    }
+};
+
+INSTANTIATE_TEST_CASE_P(CuckooMemHashIndex,
+    IndexTest,
+    ::testing::Values("cuckoo-mem-hash;bucket-count=16",
+        "cuckoo-mem-hash;bucket-count=16K",
+        "cuckoo-mem-hash;bucket-count=1K;checksum=false"
+        ));
+
+TEST_F(CuckooMemHashIndexTest, Grow) {
+    index_ = IndexTest::CreateIndex("cuckoo-mem-hash;bucket-count=16");
+    ASSERT_TRUE(index_);
+    ASSERT_TRUE(index_->Start(StartContext()));
+
+    for (uint64_t i = 0; i < 16 * 1024; i++) {
+        IntData value;
+        value.set_i(i);
+        ASSERT_EQ(index_->Put(&i, sizeof(i), value), PUT_OK);
+    }
+    ASSERT_EQ(index_->GetItemCount(), 16 * 1024);
+    ASSERT_GT(static_cast<CuckooMemHashIndex*>(index_)->bucket_count(), 16);
+
+    for (uint64_t i = 0; i < 16 * 1024; i++) {
+        IntData value;
+        ASSERT_EQ(index_->Lookup(&i, sizeof(i), &value), LOOKUP_FOUND) << "key " << i;
+        ASSERT_EQ(value.i(), i);
+    }
+    INFO(index_->PrintTrace());
+}
+
+TEST_F(CuckooMemHashIndexTest, MemorySize) {
+    index_ = IndexTest::CreateIndex("cuckoo-mem-hash;bucket-count=1K");
+    ASSERT_TRUE(index_);
+    ASSERT_TRUE(index_->Start(StartContext()));
+    MemoryIndex* memory_index = index_->AsMemoryIndex();
+
+    uint64_t empty_size = memory_index->GetMemorySize();
+    ASSERT_GT(empty_size, 0);
+
+    byte value[512];
+    memset(value, 1, sizeof(value));
+    for (uint64_t i = 0; i < 1024; i++) {
+        ASSERT_EQ(index_->RawPut(&i, sizeof(i), value, sizeof(value)), PUT_OK);
+    }
+    // at least the raw value data has to be accounted for
+    ASSERT_GE(memory_index->GetMemorySize(), empty_size + (1024 * sizeof(value)));
+
+    ASSERT_TRUE(memory_index->Clear());
+    ASSERT_EQ(index_->GetItemCount(), 0);
+    ASSERT_EQ(memory_index->GetMemorySize(), empty_size);
+}
+
+TEST_F(CuckooMemHashIndexTest, DeleteReusesValueMemory) {
+    index_ = IndexTest::CreateIndex("cuckoo-mem-hash;bucket-count=1K");
+    ASSERT_TRUE(index_);
+    ASSERT_TRUE(index_->Start(StartContext()));
+    MemoryIndex* memory_index = index_->AsMemoryIndex();
+
+    byte value[128];
+    memset(value, 1, sizeof(value));
+    for (uint64_t i = 0; i < 1024; i++) {
+        ASSERT_EQ(index_->RawPut(&i, sizeof(i), value, sizeof(value)), PUT_OK);
+    }
+    uint64_t memory_size = memory_index->GetMemorySize();
+    for (uint64_t i = 0; i < 1024; i++) {
+        ASSERT_EQ(index_->Delete(&i, sizeof(i)), DELETE_OK);
+    }
+    for (uint64_t i = 1024; i < 2048; i++) {
+        ASSERT_EQ(index_->RawPut(&i, sizeof(i), value, sizeof(value)), PUT_OK);
+    }
+    ASSERT_EQ(memory_index->GetMemorySize(), memory_size);
+}
+
+TEST_F(CuckooMemHashIndexTest, IllegalSizes) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Times(2);
+
+    index_ = IndexTest::CreateIndex("cuckoo-mem-hash;max-key-size=8;max-value-size=16");
+    ASSERT_TRUE(index_);
+    ASSERT_TRUE(index_->Start(StartContext()));
+
+    uint64_t key = 1;
+    byte value[32];
+    memset(value, 0, sizeof(value));
+    ASSERT_EQ(index_->RawPut(&key, sizeof(key), value, 16), PUT_OK);
+    ASSERT_EQ(index_->RawPut(&key, sizeof(key), value, sizeof(value)), PUT_ERROR);
+
+    byte large_key[16];
+    memset(large_key, 0, sizeof(large_key));
+    ASSERT_EQ(index_->RawPut(large_key, sizeof(large_key), value, 16), PUT_ERROR);
+}
+
+TEST_F(CuckooMemHashIndexTest, RawLookupBufferTooSmall) {
+    index_ = IndexTest::CreateIndex("cuckoo-mem-hash");
+    ASSERT_TRUE(index_);
+    ASSERT_TRUE(index_->Start(StartContext()));
+
+    uint64_t key = 1;
+    byte value[32];
+    memset(value, 7, sizeof(value));
+    ASSERT_EQ(index_->RawPut(&key, sizeof(key), value, sizeof(value)), PUT_OK);
+
+    byte result[16];
+    size_t result_size = sizeof(result);
+    ASSERT_EQ(index_->RawLookup(&key, sizeof(key), result, &result_size), LOOKUP_ERROR);
+    ASSERT_EQ(result_size, sizeof(value));
+
+    byte result2[32];
+    result_size = sizeof(result2);
+    ASSERT_EQ(index_->RawLookup(&key, sizeof(key), result2, &result_size), LOOKUP_FOUND);
+    ASSERT_EQ(result_size, sizeof(value));
+    ASSERT_EQ(memcmp(result2, value, sizeof(value)), 0);
+}
+
+TEST_F(CuckooMemHashIndexTest, ConcurrentReadWrite) {
+    // a small initial table forces cuckoo moves and table growth while the readers are active
+    index_ = IndexTest::CreateIndex("cuckoo-mem-hash;bucket-count=16");
+    ASSERT_TRUE(index_);
+    ASSERT_TRUE(index_->Start(StartContext()));
+
+    uint64_t key_count = 32 * 1024;
+    Thread<bool> writer(NewRunnable(&CuckooMemHashIndexTest::WriteLoop, index_, key_count, (uint64_t) 4), "writer");
+    Thread<bool> reader1(NewRunnable(&CuckooMemHashIndexTest::ReadLoop, index_, key_count, (uint64_t) 8), "reader 1");
+    Thread<bool> reader2(NewRunnable(&CuckooMemHashIndexTest::ReadLoop, index_, key_count, (uint64_t) 8), "reader 2");
+    ASSERT_TRUE(writer.Start());
+    ASSERT_TRUE(reader1.Start());
+    ASSERT_TRUE(reader2.Start());
+
+    bool r1 = false;
+    bool r2 = false;
+    bool r3 = false;
+    ASSERT_TRUE(writer.Join(&r1));
+    ASSERT_TRUE(reader1.Join(&r2));
+    ASSERT_TRUE(reader2.Join(&r3));
+    ASSERT_TRUE(r1 && r2 && r3);
+
+    ASSERT_EQ(index_->GetItemCount(), key_count);
+    INFO(index_->PrintTrace());
+}
+
+TEST_F(CuckooMemHashIndexTest, Performance) {
+    uint64_t n = 256 * 1024;
+
+    INFO("tc-mem-hash");
+    index_ = IndexTest::CreateIndex("tc-mem-hash;bucket-count=256K");
+    ASSERT_TRUE(index_);
+    ASSERT_TRUE(index_->Start(StartContext()));
+    double tc_time = Benchmark(index_, n);
+    ASSERT_GE(tc_time, 0.0);
+    delete index_;
+    index_ = NULL;
+
+    INFO("cuckoo-mem-hash");
+    index_ = IndexTest::CreateIndex("cuckoo-mem-hash;bucket-count=64K");
+    ASSERT_TRUE(index_);
+    ASSERT_TRUE(index_->Start(StartContext()));
+    double cuckoo_time = Benchmark(index_, n);
+    ASSERT_GE(cuckoo_time, 0.0);
+
+    INFO("tc-mem-hash " << tc_time << "ms, cuckoo-mem-hash " << cuckoo_time << "ms");
+}
+
+}
+}
@@ -0,0 +1,205 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <base/index.h>
+#include <base/disk_hash_index.h>
+#include <base/disk_hash_index_bulk_loader.h>
+#include <base/memory.h>
+#include "index_test.h"
+#include <test_util/log_assert.h>
+#include <base/logging.h>
+#include "dedupv1_base.pb.h"
+
+using std::string;
+LOGGER("DiskHashIndexBulkLoaderTest");
+
+namespace dedupv1 {
+namespace base {
+
+class DiskHashIndexBulkLoaderTest : public testing::Test {
+protected:
+    USE_LOGGING_EXPECTATION();
+
+    Index* index;
+    DiskHashIndex* disk_index;
+
+    virtual void SetUp() {
+        index = NULL;
+        disk_index = NULL;
+    }
+
+    virtual void TearDown() {
+        if (index) {
+            delete index;
+        }
+    }
+
+    void Open(const string& config, bool create) {
+        if (index) {
+            delete index;
+        }
+        index = IndexTest::CreateIndex(config);
+        ASSERT_TRUE(index);
+        StartContext start_context;
+        if (!create) {
+            start_context.set_create(StartContext::NON_CREATE);
+        }
+        ASSERT_TRUE(index->Start(start_context));
+        disk_index = dynamic_cast<DiskHashIndex*>(index);
+        ASSERT_TRUE(disk_index);
+    }
+
+    void CheckValues(int count, int offset) {
+        for (int i = 0; i < count; i++) {
+            uint64_t key_value = i;
+            IntData value;
+            ASSERT_EQ(index->Lookup(&key_value, sizeof(key_value), &value), LOOKUP_FOUND) << "Lookup " << i << " failed";
+            ASSERT_EQ(value.i(), i + offset);
+        }
+    }
+};
+
+TEST_F(DiskHashIndexBulkLoaderTest, Load) {
+    string config = "static-disk-hash;max-key-size=8;max-value-size=8;page-size=8K;size=32M;filename=work/hash_test_data1;filename=work/hash_test_data2";
+    Open(config, true);
+
+    ScopedPtr<DiskHashIndexBulkLoader> loader(disk_index->CreateBulkLoader(DiskHashIndexBulkLoader::kDefaultMaxMemory));
+    ASSERT_TRUE(loader.Get());
+    for (int i = 0; i < 4096; i++) {
+        uint64_t key_value = i;
+        IntData value;
+        value.set_i(i);
+        ASSERT_EQ(loader->Put(&key_value, sizeof(key_value), value), PUT_OK);
+    }
+    ASSERT_EQ(0, loader->run_count());
+    ASSERT_TRUE(loader->Finish());
+    ASSERT_LE(loader->page_count(), disk_index->bucket_count());
+
+    ASSERT_EQ(4096, index->GetItemCount());
+    CheckValues(4096, 0);
+
+    // the bulk loader cannot be used after finish
+    uint64_t key_value = 1;
+    IntData value;
+    value.set_i(1);
+    EXPECT_LOGGING(dedupv1::test::ERROR).Once();
+    ASSERT_EQ(loader->Put(&key_value, sizeof(key_value), value), PUT_ERROR);
+}
+
+TEST_F(DiskHashIndexBulkLoaderTest, LoadWithRuns) {
+    string config = "static-disk-hash;max-key-size=8;max-value-size=8;page-size=8K;size=32M;filename=work/hash_test_data1";
+    Open(config, true);
+
+    // existing entries are updated
+    for (int i = 0; i < 128; i++) {
+        uint64_t key_value = i;
+        IntData value;
+        value.set_i(-1);
+        ASSERT_EQ(index->Put(&key_value, sizeof(key_value), value), PUT_OK);
+    }
+
+    // small memory limit so that runs are spilled to disk
+    ScopedPtr<DiskHashIndexBulkLoader> loader(disk_index->CreateBulkLoader(4 * 1024));
+    ASSERT_TRUE(loader.Get());
+    for (int i = 0; i < 4096; i++) {
+        uint64_t key_value = i;
+        IntData value;
+        value.set_i(i);
+        ASSERT_EQ(loader->Put(&key_value, sizeof(key_value), value), PUT_OK);
+    }
+    // later puts of the same key win, even if they are in a different run
+    for (int i = 0; i < 4096; i += 2) {
+        uint64_t key_value = i;
+        IntData value;
+        value.set_i(i + 1);
+        ASSERT_EQ(loader->Put(&key_value, sizeof(key_value), value), PUT_OK);
+    }
+    ASSERT_GT(loader->run_count(), 1);
+    ASSERT_TRUE(loader->Finish());
+    ASSERT_EQ(0, loader->run_count());
+
+    ASSERT_EQ(4096, index->GetItemCount());
+    for (int i = 0; i < 4096; i++) {
+        uint64_t key_value = i;
+        IntData value;
+        ASSERT_EQ(index->Lookup(&key_value, sizeof(key_value), &value), LOOKUP_FOUND);
+        ASSERT_EQ(value.i(), (i % 2 == 0) ? i + 1 : i);
+    }
+}
+
+TEST_F(DiskHashIndexBulkLoaderTest, Restart) {
+    string config = "static-disk-hash;max-key-size=8;max-value-size=8;page-size=8K;size=32M;filename=work/hash_test_data1;transactions.filename=work/hash_test_trans1;transactions.filename=work/hash_test_trans2";
+    Open(config, true);
+
+    // an old transaction of a bucket must not be replayed over the bulk loaded page
+    for (int i = 0; i < 512; i++) {
+        uint64_t key_value = i;
+        IntData value;
+        value.set_i(-1);
+        ASSERT_EQ(index->Put(&key_value, sizeof(key_value), value), PUT_OK);
+    }
+
+    DiskHashIndexBulkLoader* loader = disk_index->CreateBulkLoader(16 * 1024);
+    ASSERT_TRUE(loader);
+    for (int i = 0; i < 2048; i++) {
+        uint64_t key_value = i;
+        IntData value;
+        value.set_i(i + 7);
+        ASSERT_EQ(loader->Put(&key_value, sizeof(key_value), value), PUT_OK);
+    }
+    ASSERT_TRUE(loader->Finish());
+    delete loader;
+
+    Open(config, false);
+    ASSERT_EQ(2048, index->GetItemCount());
+    CheckValues(2048, 7);
+}
+
+TEST_F(DiskHashIndexBulkLoaderTest, WriteBackCache) {
+    string config = "static-disk-hash;max-key-size=8;max-value-size=8;page-size=8K;size=32M;filename=work/hash_test_data1;write-cache=true;write-cache.bucket-count=1K;write-cache.max-page-count=128";
+    Open(config, true);
+
+    for (int i = 0; i < 256; i++) {
+        uint64_t key_value = i;
+        IntData value;
+        value.set_i(-1);
+        ASSERT_EQ(disk_index->PutDirty(&key_value, sizeof(key_value), value, false), PUT_OK);
+    }
+
+    ScopedPtr<DiskHashIndexBulkLoader> loader(disk_index->CreateBulkLoader(DiskHashIndexBulkLoader::kDefaultMaxMemory));
+    ASSERT_TRUE(loader.Get());
+    for (int i = 0; i < 1024; i++) {
+        uint64_t key_value = i;
+        IntData value;
+        value.set_i(i);
+        ASSERT_EQ(loader->Put(&key_value, sizeof(key_value), value), PUT_OK);
+    }
+    ASSERT_TRUE(loader->Finish());
+
+    ASSERT_EQ(0, disk_index->GetDirtyItemCount());
+    CheckValues(1024, 0);
+}
+
+}
+}
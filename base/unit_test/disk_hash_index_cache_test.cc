@@ -74,7 +74,9 @@ INSTANTIATE_TEST_CASE_P(DiskHashIndex,
     DiskHashIndexCacheTest,
     ::testing::Values(
         // Write-back cache
-        string("static-disk-hash;max-key-size=8;max-value-size=8;page-lock-count=1;page-size=4K;size=4M;filename=work/data/hash_test_data;write-cache=true;write-cache.bucket-count=1K;write-cache.max-page-count=4")
+        string("static-disk-hash;max-key-size=8;max-value-size=8;page-lock-count=1;page-size=4K;size=4M;filename=work/data/hash_test_data;write-cache=true;write-cache.bucket-count=1K;write-cache.max-page-count=4"),
+        // Write-back cache with cuckoo hash cache index
+        string("static-disk-hash;max-key-size=8;max-value-size=8;page-lock-count=1;page-size=4K;size=4M;filename=work/data/hash_test_data;write-cache=true;write-cache.type=cuckoo-mem-hash;write-cache.bucket-count=1K;write-cache.max-page-count=4")
         ));
 
 TEST_P(DiskHashIndexCacheTest, EnsurePersistent) {
@@ -75,7 +75,11 @@ INSTANTIATE_TEST_CASE_P(DiskHashIndex,
         // Transactions (custom files)
         "static-disk-hash;max-key-size=8;max-value-size=8;page-size=8K;size=32M;filename=work/data/hash_test_data1;transactions.filename=work/hash_test_trans1;transactions.filename=work/hash_test_trans2",
         // Write-back cache
-        "static-disk-hash;max-key-size=8;max-value-size=8;page-size=8K;size=32M;filename=work/data/hash_test_data;write-cache=true;write-cache.bucket-count=1K;write-cache.max-page-count=128"
+        "static-disk-hash;max-key-size=8;max-value-size=8;page-size=8K;size=32M;filename=work/data/hash_test_data;write-cache=true;write-cache.bucket-count=1K;write-cache.max-page-count=128",
+        // Write-back cache with cuckoo hash cache index
+        "static-disk-hash;max-key-size=8;max-value-size=8;page-size=8K;size=32M;filename=work/data/hash_test_data;write-cache=true;write-cache.type=cuckoo-mem-hash;write-cache.bucket-count=1K;write-cache.max-page-count=128",
+        // CRC-32C page checksums
+        "static-disk-hash;max-key-size=8;max-value-size=8;page-size=8K;size=32M;filename=work/data/hash_test_data1;checksum-type=crc32c"
         ))
 ;
 
@@ -138,6 +142,35 @@ TEST_F(DiskHashIndexTest, RecoverItemCount) {
     ASSERT_EQ(32, index->GetItemCount());
 }
 
+TEST_F(DiskHashIndexTest, ChecksumTypeOfExistingIndex) {
+    string config = "static-disk-hash;max-key-size=8;max-value-size=8;page-size=8K;size=32M;filename=work/hash_test_data1";
+    index = IndexTest::CreateIndex(config);
+    ASSERT_TRUE(index);
+    ASSERT_TRUE(index->Start(StartContext()));
+
+    for (int i = 0; i < 32; i++) {
+        uint64_t key_value = i;
+        IntData value;
+        value.set_i(i);
+        ASSERT_EQ(index->Put(&key_value, sizeof(key_value), value), PUT_OK) << "Put " << i << " failed";
+    }
+    delete index;
+    index = NULL;
+
+    // the pages have been written with crc32 checksums. They have to be verified with crc32
+    // even if crc32c is configured now.
+    index = IndexTest::CreateIndex(config + ";checksum-type=crc32c");
+    ASSERT_TRUE(index);
+    ASSERT_TRUE(index->Start(StartContext()));
+
+    for (int i = 0; i < 32; i++) {
+        uint64_t key_value = i;
+        IntData value;
+        ASSERT_EQ(index->Lookup(&key_value, sizeof(key_value), &value), LOOKUP_FOUND) << "Lookup " << i << " failed";
+        ASSERT_EQ(value.i(), i);
+    }
+}
+
 TEST_F(DiskHashIndexTest, TransactionsWithoutFilename) {
     EXPECT_LOGGING(dedupv1::test::ERROR).Repeatedly();
 
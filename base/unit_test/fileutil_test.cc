@@ -531,6 +531,7 @@ TEST_F(FileUtilTest, ReadWrite)
     ASSERT_EQ(1024, f1->Write(1024, buffer, 1024));
 
     ASSERT_TRUE(f1->Sync());
+    ASSERT_TRUE(f1->DataSync());
     delete f1;
 
     // read
@@ -0,0 +1,192 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <gtest/gtest.h>
+#include <base/io_scheduler.h>
+#include <base/fileutil.h>
+#include <base/thread.h>
+#include <base/runnable.h>
+#include <base/logging.h>
+#include <test_util/log_assert.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <vector>
+
+using std::vector;
+using dedupv1::base::NewRunnable;
+using dedupv1::base::Thread;
+LOGGER("IOSchedulerTest");
+
+namespace dedupv1 {
+namespace base {
+
+class IOSchedulerTest : public testing::Test {
+protected:
+    USE_LOGGING_EXPECTATION();
+
+    static const size_t kBlockSize = 4096;
+    static const int kBlockCount = 64;
+
+    IOScheduler* scheduler;
+    File* file;
+
+    virtual void SetUp() {
+        scheduler = new IOScheduler();
+        ASSERT_TRUE(scheduler);
+
+        file = File::Open("work/io-scheduler-file", O_RDWR | O_CREAT | O_TRUNC | O_LARGEFILE, S_IRUSR | S_IWUSR);
+        ASSERT_TRUE(file);
+    }
+
+    virtual void TearDown() {
+        if (scheduler) {
+            delete scheduler;
+            scheduler = NULL;
+        }
+        if (file) {
+            delete file;
+            file = NULL;
+        }
+    }
+
+public:
+    static void FillBlock(byte* buffer, int block) {
+        memset(buffer, block % 256, kBlockSize);
+    }
+
+    bool WriteBlocks(int start, int step) {
+        byte buffer[kBlockSize];
+        for (int i = start; i < kBlockCount; i += step) {
+            FillBlock(buffer, i);
+            if (scheduler->Write(file, i * kBlockSize, buffer, kBlockSize) != static_cast<ssize_t>(kBlockSize)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool ReadBlocks(int start, int step) {
+        byte buffer[kBlockSize];
+        byte expected[kBlockSize];
+        for (int i = start; i < kBlockCount; i += step) {
+            FillBlock(expected, i);
+            if (scheduler->Read(file, i * kBlockSize, buffer, kBlockSize) != static_cast<ssize_t>(kBlockSize)) {
+                return false;
+            }
+            if (memcmp(buffer, expected, kBlockSize) != 0) {
+                ERROR("Data mismatch: block " << i);
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+TEST_F(IOSchedulerTest, Create) {
+}
+
+TEST_F(IOSchedulerTest, StartWithoutFiles) {
+    ASSERT_TRUE(scheduler->Start());
+    ASSERT_TRUE(scheduler->Stop());
+}
+
+TEST_F(IOSchedulerTest, IllegalOption) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Repeatedly();
+
+    ASSERT_FALSE(scheduler->SetOption("queue-depth", "0"));
+    ASSERT_FALSE(scheduler->SetOption("queue-depth", "abc"));
+    ASSERT_FALSE(scheduler->SetOption("no-option", "1"));
+}
+
+TEST_F(IOSchedulerTest, DoubleRegister) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Once();
+
+    ASSERT_TRUE(scheduler->RegisterFile(file));
+    ASSERT_TRUE(scheduler->IsRegistered(file));
+    ASSERT_FALSE(scheduler->RegisterFile(file));
+}
+
+TEST_F(IOSchedulerTest, NotStarted) {
+    // requests are executed directly if the scheduler is not started
+    ASSERT_TRUE(scheduler->RegisterFile(file));
+    ASSERT_TRUE(WriteBlocks(0, 1));
+    ASSERT_TRUE(ReadBlocks(0, 1));
+}
+
+TEST_F(IOSchedulerTest, ReadWrite) {
+    ASSERT_TRUE(scheduler->RegisterFile(file));
+    ASSERT_TRUE(scheduler->Start());
+
+    ASSERT_TRUE(WriteBlocks(0, 1));
+    ASSERT_TRUE(ReadBlocks(0, 1));
+
+    ASSERT_TRUE(scheduler->Stop());
+
+    // check that the data has been written to the file
+    byte buffer[kBlockSize];
+    byte expected[kBlockSize];
+    FillBlock(expected, 7);
+    ASSERT_EQ(file->Read(7 * kBlockSize, buffer, kBlockSize), static_cast<ssize_t>(kBlockSize));
+    ASSERT_EQ(memcmp(buffer, expected, kBlockSize), 0);
+}
+
+TEST_F(IOSchedulerTest, ConcurrentReadWrite) {
+    ASSERT_TRUE(scheduler->SetOption("queue-depth", "4"));
+    ASSERT_TRUE(scheduler->SetOption("max-merge-size", "16K"));
+    ASSERT_TRUE(scheduler->RegisterFile(file));
+    ASSERT_TRUE(scheduler->Start());
+
+    int thread_count = 8;
+    vector<Thread<bool>*> threads;
+    for (int i = 0; i < thread_count; i++) {
+        threads.push_back(new Thread<bool>(NewRunnable(static_cast<IOSchedulerTest*>(this), &IOSchedulerTest::WriteBlocks, i, thread_count), "write"));
+    }
+    for (int i = 0; i < thread_count; i++) {
+        ASSERT_TRUE(threads[i]->Start());
+    }
+    for (int i = 0; i < thread_count; i++) {
+        bool result = false;
+        ASSERT_TRUE(threads[i]->Join(&result));
+        ASSERT_TRUE(result);
+        delete threads[i];
+    }
+    threads.clear();
+
+    for (int i = 0; i < thread_count; i++) {
+        threads.push_back(new Thread<bool>(NewRunnable(static_cast<IOSchedulerTest*>(this), &IOSchedulerTest::ReadBlocks, i, thread_count), "read"));
+    }
+    for (int i = 0; i < thread_count; i++) {
+        ASSERT_TRUE(threads[i]->Start());
+    }
+    for (int i = 0; i < thread_count; i++) {
+        bool result = false;
+        ASSERT_TRUE(threads[i]->Join(&result));
+        ASSERT_TRUE(result);
+        delete threads[i];
+    }
+    threads.clear();
+
+    DEBUG(scheduler->PrintStatistics());
+    ASSERT_TRUE(scheduler->Stop());
+}
+
+}
+}
@@ -65,6 +65,7 @@ using dedupv1::chunkindex::ChunkIndex;
 using dedupv1::chunkstore::Storage;
 using dedupv1::chunkstore::ContainerStorage;
 using dedupv1::chunkstore::Container;
+using dedupv1::chunkstore::ScopedPoolContainer;
 using dedupv1::chunkstore::ContainerItem;
 using dedupv1::chunkindex::ChunkMapping;
 using dedupv1::gc::GarbageCollector;
@@ -841,7 +842,9 @@ bool Dedupv1Checker::ReadContainerData() {
         // non processed container
 
         // Read the container.
-        Container container(container_id, storage->GetContainerSize(), false);
+        ScopedPoolContainer pool_container(storage->container_pool(), container_id, false);
+        CHECK(pool_container.Get(), "Failed to acquire container " << container_id);
+        Container& container(*pool_container);
         lookup_result read_result = storage->ReadContainer(&container);
         if (read_result == LOOKUP_ERROR) {
             WARNING("Failed to read container " << container_id << ", address " << container_address.ShortDebugString());
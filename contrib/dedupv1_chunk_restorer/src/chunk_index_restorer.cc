@@ -20,6 +20,13 @@
 
 #include "chunk_index_restorer.h"
 
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
 #include <iostream>
 
 #include <core/block_index.h>
@@ -34,11 +41,18 @@
 #include <base/strutil.h>
 #include <base/startup.h>
 #include <base/memory.h>
+#include <base/disk_hash_index.h>
+#include <base/disk_hash_index_bulk_loader.h>
+#include <base/fileutil.h>
+#include <base/runnable.h>
+#include <base/thread.h>
 
 #include <dedupv1.pb.h>
 #include <tbb/tick_count.h>
 
 using std::vector;
+using std::string;
+using std::pair;
 using dedupv1::DedupSystem;
 using dedupv1::StartContext;
 using dedupv1::chunkindex::ChunkIndex;
@@ -46,6 +60,7 @@ using dedupv1::chunkstore::Storage;
 using dedupv1::chunkstore::ContainerStorage;
 using dedupv1::chunkstore::Container;
 using dedupv1::chunkstore::ContainerItem;
+using dedupv1::chunkstore::ContainerSummaryLog;
 using dedupv1::chunkindex::ChunkMapping;
 using dedupv1::base::lookup_result;
 using dedupv1::base::LOOKUP_FOUND;
@@ -62,6 +77,17 @@ using dedupv1::FileMode;
 using tbb::tick_count;
 using dedupv1::blockindex::BlockMapping;
 using dedupv1::blockindex::BlockMappingItem;
+using dedupv1::base::DiskHashIndex;
+using dedupv1::base::DiskHashIndexBulkLoader;
+using dedupv1::base::PUT_ERROR;
+using dedupv1::base::File;
+using dedupv1::base::Thread;
+using dedupv1::base::NewRunnable;
+using dedupv1::base::raw_compare;
+using dedupv1::base::murmur_hash3_x86_32;
+using dedupv1::base::strutil::To;
+using dedupv1::base::strutil::ToString;
+using dedupv1::base::strutil::ToStorageUnit;
 
 LOGGER("ChunkIndexRestorer");
 
@@ -71,6 +97,36 @@ namespace restorer {
 
 ChunkIndexRestorer::ChunkIndexRestorer() : dedup_system_(NULL), started_(false) {
     system_ = NULL;
+    worker_thread_count_ = kDefaultWorkerThreadCount;
+    loader_memory_ = kDefaultLoaderMemory;
+    container_data_restored_ = false;
+    entry_count_ = 0;
+    max_entry_count_ = 0;
+    bucket_count_ = 0;
+}
+
+bool ChunkIndexRestorer::SetOption(const std::string& option_name, const std::string& option) {
+    CHECK(!started_, "Chunk index restorer already started");
+    if (option_name == "worker-threads") {
+        Option<uint32_t> o = To<uint32_t>(option);
+        CHECK(o.valid(), "Illegal option " << option);
+        CHECK(o.value() > 0, "Illegal worker thread count " << option);
+        worker_thread_count_ = o.value();
+        return true;
+    }
+    if (option_name == "loader-memory") {
+        Option<int64_t> o = ToStorageUnit(option);
+        CHECK(o.valid(), "Illegal option " << option);
+        CHECK(o.value() > 0, "Illegal loader memory " << option);
+        loader_memory_ = o.value();
+        return true;
+    }
+    if (option_name == "checkpoint") {
+        checkpoint_filename_ = option;
+        return true;
+    }
+    ERROR("Illegal option: " << option_name);
+    return false;
 }
 
 bool ChunkIndexRestorer::InitializeStorageAndChunkIndex(const std::string& filename) {
@@ -140,7 +196,332 @@ bool ChunkIndexRestorer::RestoreChunkIndexFromContainerStorage() {
     CHECK(ReadContainerData(chunk_index), "Could not read container data");
 
     INFO("Step 2");
+    if (container_data_restored_) {
+        // the usage count restore of the interrupted run might have been started
+        CHECK(ResetUsageCount(chunk_index), "Could not reset usage count");
+    }
     CHECK(RestoreUsageCount(chunk_index), "Could not restore usage count");
+
+    if (!checkpoint_filename_.empty()) {
+        CHECK(File::Remove(checkpoint_filename_), "Failed to remove checkpoint file: " << checkpoint_filename_);
+    }
+    return true;
+}
+
+bool ChunkIndexRestorer::RestoreEntry::operator<(const RestoreEntry& e) const {
+    if (order != e.order) {
+        return order < e.order;
+    }
+    int c = raw_compare(fp, fp_size, e.fp, e.fp_size);
+    if (c != 0) {
+        return c < 0;
+    }
+    // the item of the container with the highest primary id wins as in a serial restore
+    // in container id order. The data address only orders items of the same container.
+    if (container_id != e.container_id) {
+        return container_id < e.container_id;
+    }
+    return data_address < e.data_address;
+}
+
+bool ChunkIndexRestorer::ReadCheckpoint(uint32_t file_count, vector<uint64_t>* next_offsets,
+                                        vector<uint64_t>* next_summary_offsets) {
+    CHECK(next_offsets, "Next offsets not set");
+    CHECK(next_summary_offsets, "Next summary offsets not set");
+    next_offsets->clear();
+    next_offsets->resize(file_count, 0);
+    next_summary_offsets->clear();
+    next_summary_offsets->resize(file_count, 0);
+    container_data_restored_ = false;
+
+    if (checkpoint_filename_.empty()) {
+        return true;
+    }
+    Option<bool> exists = File::Exists(checkpoint_filename_);
+    CHECK(exists.valid(), "Failed to check checkpoint file: " << checkpoint_filename_);
+    if (!exists.value()) {
+        return true;
+    }
+    File* file = File::Open(checkpoint_filename_, O_RDONLY, 0);
+    CHECK(file, "Failed to open checkpoint file: " << checkpoint_filename_);
+    ScopedPtr<File> scoped_file(file);
+
+    ChunkIndexRestorerCheckpointData checkpoint_data;
+    CHECK(file->ReadSizedMessage(0, &checkpoint_data, kCheckpointSize, true),
+        "Failed to read checkpoint file: " << checkpoint_filename_);
+    CHECK(checkpoint_data.next_offset_size() == static_cast<int>(file_count),
+        "Checkpoint doesn't match container storage: " <<
+        "checkpoint " << checkpoint_data.ShortDebugString() <<
+        ", file count " << file_count);
+    // a checkpoint without summary offsets streams the summary logs again. Loading
+    // a summary twice only overwrites the chunk mappings with the same data.
+    CHECK(checkpoint_data.next_summary_offset_size() == 0 ||
+        checkpoint_data.next_summary_offset_size() == static_cast<int>(file_count),
+        "Checkpoint doesn't match container storage: " <<
+        "checkpoint " << checkpoint_data.ShortDebugString() <<
+        ", file count " << file_count);
+    for (uint32_t i = 0; i < file_count; i++) {
+        (*next_offsets)[i] = checkpoint_data.next_offset(i);
+        if (checkpoint_data.next_summary_offset_size() > 0) {
+            (*next_summary_offsets)[i] = checkpoint_data.next_summary_offset(i);
+        }
+    }
+    container_data_restored_ = checkpoint_data.container_data_restored();
+    INFO("Resume chunk index restore: " << checkpoint_data.ShortDebugString());
+    return true;
+}
+
+bool ChunkIndexRestorer::WriteCheckpoint(const vector<uint64_t>& next_offsets,
+                                         const vector<uint64_t>& next_summary_offsets,
+                                         bool container_data_restored) {
+    if (checkpoint_filename_.empty()) {
+        return true;
+    }
+    ChunkIndexRestorerCheckpointData checkpoint_data;
+    for (size_t i = 0; i < next_offsets.size(); i++) {
+        checkpoint_data.add_next_offset(next_offsets[i]);
+    }
+    for (size_t i = 0; i < next_summary_offsets.size(); i++) {
+        checkpoint_data.add_next_summary_offset(next_summary_offsets[i]);
+    }
+    checkpoint_data.set_container_data_restored(container_data_restored);
+
+    // the checkpoint is written to a temporary file and renamed afterwards so that
+    // a crash never leaves a partially written checkpoint.
+    string tmp_filename = checkpoint_filename_ + ".tmp";
+    File* file = File::Open(tmp_filename, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP);
+    CHECK(file, "Failed to open checkpoint file: " << tmp_filename);
+    ScopedPtr<File> scoped_file(file);
+    CHECK(file->WriteSizedMessage(0, checkpoint_data, kCheckpointSize, true) > 0,
+        "Failed to write checkpoint: " << checkpoint_data.ShortDebugString());
+    CHECK(file->Sync(), "Failed to sync checkpoint file: " << tmp_filename);
+    CHECK(rename(tmp_filename.c_str(), checkpoint_filename_.c_str()) == 0,
+        "Failed to rename checkpoint file: " << tmp_filename << ", message " << strerror(errno));
+
+    DEBUG("Wrote checkpoint: " << checkpoint_data.ShortDebugString());
+    return true;
+}
+
+bool ChunkIndexRestorer::ReadContainerFile(ContainerStorage* storage,
+                                           uint32_t file_index,
+                                           const vector<pair<uint64_t, uint64_t> >* containers,
+                                           size_t* position) {
+    CHECK(storage, "Storage not set");
+    CHECK(containers, "Containers not set");
+    CHECK(position, "Position not set");
+
+    File* file = storage->file(file_index).file();
+    CHECK(file, "Container file not set: file index " << file_index);
+
+    ContainerSummaryLog* summary_log = storage->summary_log(file_index);
+    if (summary_log) {
+        uint64_t end_offset = summary_log->end_offset();
+        while (summary_offsets_[file_index] < end_offset && entry_count_ < max_entry_count_) {
+            ContainerSummaryData* summary = new ContainerSummaryData();
+            lookup_result lr = summary_log->ReadNext(&summary_offsets_[file_index], summary);
+            if (lr != LOOKUP_FOUND) {
+                delete summary;
+                CHECK(lr != LOOKUP_ERROR, "Failed to read summary log: " << summary_log->filename());
+                WARNING("Summary log ends before end offset: " << summary_log->filename() <<
+                    ", offset " << summary_offsets_[file_index] <<
+                    ", end offset " << end_offset);
+                summary_offsets_[file_index] = end_offset;
+                break;
+            }
+            Option<bool> current = storage->IsCurrentContainerSummary(*summary);
+            if (!current.valid()) {
+                ERROR("Failed to check summary record: " << summary->ShortDebugString());
+                delete summary;
+                return false;
+            }
+            if (current.value() && summary->address().file_index() == file_index) {
+                summary_containers_[file_index].insert(summary->container_id());
+                container_queue_.push(summary);
+            } else {
+                delete summary;
+            }
+        }
+        if (summary_offsets_[file_index] < end_offset) {
+            // round is full
+            return true;
+        }
+    }
+
+    while (*position < containers->size() && entry_count_ < max_entry_count_) {
+        uint64_t offset = (*containers)[*position].first;
+        uint64_t container_id = (*containers)[*position].second;
+
+        if (summary_containers_[file_index].find(container_id) != summary_containers_[file_index].end()) {
+            // already loaded from the summary log
+            (*position)++;
+            continue;
+        }
+
+        // only the meta data is needed. As the containers are read in offset order, the reads
+        // form a sequential scan over the container file.
+        Container container(container_id, storage->GetContainerSize(), true);
+        if (!container.LoadFromFile(file, offset + ContainerStorage::kSuperBlockSize, true)) {
+            ERROR("Failed to read container: " <<
+                "container id " << container_id <<
+                ", file index " << file_index <<
+                ", file offset " << offset);
+            return false;
+        }
+        if (container.primary_id() != container_id) {
+            WARNING("Inconsistent container meta data: " <<
+                "container id " << container_id <<
+                ", file index " << file_index <<
+                ", file offset " << offset <<
+                ", stored container " << container.DebugString());
+        } else {
+            ContainerSummaryData* summary = new ContainerSummaryData();
+            if (!ContainerSummaryLog::FillSummary(container, summary)) {
+                delete summary;
+                ERROR("Failed to fill container summary: " << container.DebugString());
+                return false;
+            }
+            container_queue_.push(summary);
+        }
+        (*position)++;
+    }
+    return true;
+}
+
+bool ChunkIndexRestorer::ScanSummaryLogs(ContainerStorage* storage) {
+    CHECK(storage, "Storage not set");
+    CHECK(summary_offsets_.size() == storage->GetFileCount(), "Illegal summary offsets");
+
+    summary_containers_.clear();
+    summary_containers_.resize(storage->GetFileCount());
+    uint64_t current_record_count = 0;
+    for (uint32_t f = 0; f < storage->GetFileCount(); f++) {
+        ContainerSummaryLog* summary_log = storage->summary_log(f);
+        if (summary_log == NULL) {
+            continue;
+        }
+        uint64_t offset = 0;
+        ContainerSummaryData summary;
+        while (offset < summary_offsets_[f]) {
+            lookup_result lr = summary_log->ReadNext(&offset, &summary);
+            CHECK(lr != LOOKUP_ERROR, "Failed to read summary log: " << summary_log->filename());
+            if (lr == LOOKUP_NOT_FOUND) {
+                break;
+            }
+            Option<bool> current = storage->IsCurrentContainerSummary(summary);
+            CHECK(current.valid(), "Failed to check summary record: " << summary.ShortDebugString());
+            if (current.value() && summary.address().file_index() == f) {
+                summary_containers_[f].insert(summary.container_id());
+                current_record_count++;
+            }
+        }
+    }
+    if (current_record_count > 0) {
+        INFO("Found " << current_record_count << " already restored container summaries");
+    }
+    return true;
+}
+
+bool ChunkIndexRestorer::ExtractContainerItems(ChunkIndex* chunk_index) {
+    CHECK(chunk_index, "Chunk index not set");
+    DiskHashIndex* disk_hash_index = dynamic_cast<DiskHashIndex*>(chunk_index->persistent_index());
+
+    bool failed = false;
+    ContainerSummaryData* summary = NULL;
+    container_queue_.pop(summary);
+    while (summary) {
+        DEBUG("Restore container " << summary->container_id());
+        for (int i = 0; !failed && i < summary->item_size(); i++) {
+            const ContainerItemData& item(summary->item(i));
+            const byte* fp = reinterpret_cast<const byte*>(item.fp().data());
+            size_t fp_size = item.fp().size();
+            if (fp_size > Fingerprinter::kMaxFingerprintSize) {
+                ERROR("Illegal container item: " << item.ShortDebugString());
+                failed = true;
+                break;
+            }
+
+            RestoreEntry entry;
+            if (disk_hash_index) {
+                entry.order = disk_hash_index->GetBucket(fp, fp_size);
+            } else {
+                uint32_t hash_value = 0;
+                murmur_hash3_x86_32(fp, fp_size, 0, &hash_value);
+                entry.order = hash_value;
+            }
+            entry.container_id = summary->container_id();
+            entry.data_address = item.original_id();
+            entry.fp_size = fp_size;
+            memcpy(entry.fp, fp, fp_size);
+
+            uint64_t order_range = bucket_count_ ? bucket_count_ : (1ULL << 32);
+            Partition* partition = partitions_[entry.order * kPartitionCount / order_range];
+            {
+                tbb::spin_mutex::scoped_lock l(partition->lock);
+                partition->entries.push_back(entry);
+            }
+            entry_count_++;
+        }
+        delete summary;
+        summary = NULL;
+        // after a failure the queue is still drained so that the readers do not block
+        container_queue_.pop(summary);
+    }
+    return !failed;
+}
+
+bool ChunkIndexRestorer::LoadPartitions(ChunkIndex* chunk_index) {
+    CHECK(chunk_index, "Chunk index not set");
+
+    // With a disk-based hash index, the entries are bulk loaded so that every page is written once
+    DiskHashIndexBulkLoader* loader = NULL;
+    DiskHashIndex* disk_hash_index = dynamic_cast<DiskHashIndex*>(chunk_index->persistent_index());
+    if (disk_hash_index) {
+        loader = disk_hash_index->CreateBulkLoader(loader_memory_);
+        CHECK(loader, "Failed to create bulk loader");
+    }
+    ScopedPtr<DiskHashIndexBulkLoader> scoped_loader(loader);
+
+    for (size_t i = 0; i < partitions_.size(); i++) {
+        vector<RestoreEntry>& entries(partitions_[i]->entries);
+        std::sort(entries.begin(), entries.end());
+
+        uint64_t superseded_data_address = Storage::ILLEGAL_STORAGE_ADDRESS;
+        vector<RestoreEntry>::const_iterator j;
+        for (j = entries.begin(); j != entries.end(); ++j) {
+            vector<RestoreEntry>::const_iterator next = j + 1;
+            if (next != entries.end() && raw_compare(j->fp, j->fp_size, next->fp, next->fp_size) == 0) {
+                // an older copy of a rewritten chunk. Only the last one before the winner is
+                // tracked as in the chunk index filter.
+                if (j->data_address != next->data_address) {
+                    superseded_data_address = j->data_address;
+                }
+                continue;
+            }
+            ChunkMapping mapping(j->fp, j->fp_size);
+            mapping.set_data_address(j->data_address);
+            mapping.set_superseded_data_address(superseded_data_address);
+            superseded_data_address = Storage::ILLEGAL_STORAGE_ADDRESS;
+            // Usage-Count is adjusted later.
+            mapping.set_usage_count(0);
+
+            TRACE("Restore container item " << mapping.DebugString());
+            if (loader) {
+                ChunkMappingData data;
+                CHECK(mapping.SerializeTo(&data), "Failed to serialize chunk mapping: " << mapping.DebugString());
+                CHECK(loader->Put(mapping.fingerprint(), mapping.fingerprint_size(), data) != PUT_ERROR,
+                    "Failed to store chunk mapping: " << mapping.DebugString());
+            } else {
+                CHECK(chunk_index->PutPersistentIndex(mapping, true, false, NO_EC),
+                    "Failed to store chunk mapping: " << mapping.DebugString());
+            }
+        }
+        // swap to release the memory
+        vector<RestoreEntry>().swap(entries);
+    }
+    if (loader) {
+        CHECK(loader->Finish(), "Failed to finish bulk load");
+    }
+    entry_count_ = 0;
     return true;
 }
 
@@ -158,87 +539,195 @@ bool ChunkIndexRestorer::ReadContainerData(ChunkIndex* chunk_index) {
 
     INFO("Restoring chunk index data");
 
-    // Have a vector<bool> for all duplicate (i.e. secondary) ids so that we don't read
-    // those containers also. Note that a vector<bool> only consumes 1 bit per field.
-    std::vector<bool> duplicate_ids(storage->meta_data_index()->GetItemCount(), false);
-
-    uint64_t container_entry_count = storage->meta_data_index()->GetItemCount();
-    uint64_t processed_container = 0;
-    double progress = 0.0;
-    tick_count start_time = tick_count::now();
+    // Collect the addresses of all primary containers per container file. Secondary ids
+    // point to the same containers and are only needed for the container tracker.
+    uint32_t file_count = storage->GetFileCount();
+    vector<vector<pair<uint64_t, uint64_t> > > file_containers(file_count);
+    vector<uint64_t> container_ids;
+    uint64_t total_container_count = 0;
 
     uint64_t container_id;
     size_t key_size = sizeof(container_id);
-    lookup_result lr = i->Next(&container_id, &key_size, NULL);
+    ContainerStorageAddressData address_data;
+    lookup_result lr = i->Next(&container_id, &key_size, &address_data);
     while (lr == LOOKUP_FOUND) {
-        DEBUG("Process container id " << container_id);
+        container_ids.push_back(container_id);
+        if (!address_data.has_primary_id() || address_data.primary_id() == container_id) {
+            CHECK(address_data.file_index() < file_count,
+                "Illegal container address: container id " << container_id <<
+                ", address " << address_data.ShortDebugString());
+            file_containers[address_data.file_index()].push_back(
+                std::make_pair(address_data.file_offset(), container_id));
+            total_container_count++;
+        }
+        lr = i->Next(&container_id, &key_size, &address_data);
+    }
+    CHECK(lr != LOOKUP_ERROR, "Failed to get container id");
 
-        if ((processed_container * 100.0 / container_entry_count) >= progress + 1.0) {
-            progress = (processed_container * 100.0 / container_entry_count);
+    vector<uint64_t> next_offsets;
+    CHECK(ReadCheckpoint(file_count, &next_offsets, &summary_offsets_), "Failed to read checkpoint");
 
-            tick_count::interval_t run_time = tick_count::now() - start_time;
-            INFO("Restoring chunk index data: " << static_cast<int>(progress) << "%, running time " << run_time.seconds() << "s");
-        }
+    vector<size_t> positions(file_count, 0);
+    for (uint32_t f = 0; f < file_count; f++) {
+        std::sort(file_containers[f].begin(), file_containers[f].end());
+        positions[f] = std::lower_bound(file_containers[f].begin(), file_containers[f].end(),
+            std::make_pair(next_offsets[f], static_cast<uint64_t>(0))) - file_containers[f].begin();
+    }
 
-        if (duplicate_ids.size() <= container_id) {
-            duplicate_ids.resize(container_id * 2, false);
+    if (!container_data_restored_) {
+        DiskHashIndex* disk_hash_index = dynamic_cast<DiskHashIndex*>(chunk_index->persistent_index());
+        bucket_count_ = disk_hash_index ? disk_hash_index->bucket_count() : 0;
+        max_entry_count_ = loader_memory_ / sizeof(RestoreEntry);
+        if (max_entry_count_ == 0) {
+            max_entry_count_ = 1;
         }
-        if (!duplicate_ids.at(container_id)) {
-            // Read the container.
-            Container container(container_id, storage->GetContainerSize(), true);
-            lookup_result read_result = storage->ReadContainer(&container);
-            CHECK(read_result != LOOKUP_ERROR, "Failed to read container " << container_id);
-            if (read_result == LOOKUP_NOT_FOUND) {
-                WARNING("Inconsistent container meta data: container " << container_id << " not found");
-            } else {
-                DEBUG("Restore container " << container.DebugString());
-
-                // Get the container items.
-                vector<ContainerItem*>& items = container.items();
-                vector<ContainerItem*>::const_iterator item_iterator;
-                for (item_iterator = items.begin(); item_iterator != items.end(); ++item_iterator) {
-                    ContainerItem* item = *item_iterator;
-                    // Create a chunk mapping.
-                    ChunkMapping mapping(item->key(), item->key_size());
-
-                    // Set the correct data address
-                    mapping.set_data_address(item->original_id());
-                    // Usage-Count is adjusted later.
-                    mapping.set_usage_count(0);
-
-                    DEBUG("Restore container item " << mapping.DebugString());
-                    // Insert the chunk mapping into the chunk index.
-                    CHECK(chunk_index->PutPersistentIndex(mapping, true, false, NO_EC),
-                        "Failed to store chunk mapping: " << mapping.DebugString());
+        for (uint32_t p = 0; p < kPartitionCount; p++) {
+            partitions_.push_back(new Partition());
+        }
+        container_queue_.set_capacity(2 * worker_thread_count_);
+        CHECK(ScanSummaryLogs(storage), "Failed to scan summary logs");
+
+        tick_count start_time = tick_count::now();
+        bool finished = false;
+        while (!finished) {
+            entry_count_ = 0;
+
+            vector<Thread<bool>*> workers;
+            for (uint32_t w = 0; w < worker_thread_count_; w++) {
+                Thread<bool>* t = new Thread<bool>(
+                    NewRunnable(this, &ChunkIndexRestorer::ExtractContainerItems, chunk_index),
+                    "restore worker " + ToString(w));
+                workers.push_back(t);
+            }
+            vector<Thread<bool>*> readers;
+            for (uint32_t f = 0; f < file_count; f++) {
+                Thread<bool>* t = new Thread<bool>(
+                    NewRunnable(this, &ChunkIndexRestorer::ReadContainerFile, storage, f,
+                        const_cast<const vector<pair<uint64_t, uint64_t> >*>(&file_containers[f]), &positions[f]),
+                    "restore reader " + ToString(f));
+                readers.push_back(t);
+            }
 
+            bool failed = false;
+            for (size_t t = 0; t < workers.size(); t++) {
+                if (!workers[t]->Start()) {
+                    ERROR("Failed to start worker thread " << t);
+                    failed = true;
                 }
-
-                if (duplicate_ids.size() <= container.primary_id()) {
-                    duplicate_ids.resize(container.primary_id() * 2, false);
+            }
+            for (size_t t = 0; !failed && t < readers.size(); t++) {
+                if (!readers[t]->Start()) {
+                    ERROR("Failed to start reader thread " << t);
+                    failed = true;
                 }
-                duplicate_ids.at(container.primary_id()) = true;
-
-                // Inform the chunk index that it needs to save the containers.
-                chunk_index->container_tracker()->ProcessedContainer(container.primary_id());
-
-                // Update the duplicate ids.
-                std::set<uint64_t>::const_iterator id_iterator;
-                for (id_iterator = container.secondary_ids().begin(); id_iterator != container.secondary_ids().end(); ++id_iterator) {
-                    if (duplicate_ids.size() <= *id_iterator) {
-                        duplicate_ids.resize(*id_iterator * 2, false);
+            }
+            for (size_t t = 0; t < readers.size(); t++) {
+                bool result = false;
+                if (readers[t]->IsJoinable()) {
+                    if (!readers[t]->Join(&result) || !result) {
+                        ERROR("Reader thread failed: file index " << t);
+                        failed = true;
                     }
-                    duplicate_ids.at(*id_iterator) = true;
+                }
+                delete readers[t];
+            }
+            for (size_t t = 0; t < workers.size(); t++) {
+                if (workers[t]->IsStarted()) {
+                    container_queue_.push(NULL);
+                }
+            }
+            for (size_t t = 0; t < workers.size(); t++) {
+                bool result = false;
+                if (workers[t]->IsJoinable()) {
+                    if (!workers[t]->Join(&result) || !result) {
+                        ERROR("Worker thread failed: " << t);
+                        failed = true;
+                    }
+                }
+                delete workers[t];
+            }
+            CHECK(!failed, "Failed to read container data");
+
+            CHECK(LoadPartitions(chunk_index), "Failed to load chunk mappings");
 
-                    // Inform the chunk index that it needs to save the containers.
-                    chunk_index->container_tracker()->ProcessedContainer(*id_iterator);
+            finished = true;
+            uint64_t processed_container = 0;
+            for (uint32_t f = 0; f < file_count; f++) {
+                ContainerSummaryLog* summary_log = storage->summary_log(f);
+                if (summary_log && summary_offsets_[f] < summary_log->end_offset()) {
+                    finished = false;
                 }
+                if (positions[f] < file_containers[f].size()) {
+                    next_offsets[f] = file_containers[f][positions[f]].first;
+                    finished = false;
+                } else if (!file_containers[f].empty()) {
+                    next_offsets[f] = file_containers[f].back().first + 1;
+                }
+                processed_container += positions[f];
             }
+            CHECK(WriteCheckpoint(next_offsets, summary_offsets_, false), "Failed to write checkpoint");
+
+            tick_count::interval_t run_time = tick_count::now() - start_time;
+            INFO("Restoring chunk index data: " <<
+                static_cast<int>(total_container_count ? processed_container * 100.0 / total_container_count : 100.0) <<
+                "%, running time " << run_time.seconds() << "s");
         }
-        processed_container++;
-        lr = i->Next(&container_id, &key_size, NULL);
     }
-    CHECK(lr != LOOKUP_ERROR, "Failed to get container id");
 
+    // Inform the chunk index that it needs to save the containers.
+    for (size_t j = 0; j < container_ids.size(); j++) {
+        chunk_index->container_tracker()->ProcessedContainer(container_ids[j]);
+    }
+
+    CHECK(WriteCheckpoint(next_offsets, summary_offsets_, true), "Failed to write checkpoint");
+    return true;
+}
+
+bool ChunkIndexRestorer::ResetUsageCount(ChunkIndex* chunk_index) {
+    CHECK(chunk_index, "Chunk index not set");
+
+    INFO("Resetting chunk usage count data");
+
+    uint64_t max_batch_size = loader_memory_ / sizeof(ChunkMapping);
+    if (max_batch_size == 0) {
+        max_batch_size = 1;
+    }
+
+    // The index cannot be changed while iterating. Therefore the mappings are reset in batches
+    // and the iteration restarts after each batch. Already reset mappings are skipped.
+    vector<ChunkMapping> mappings;
+    do {
+        mappings.clear();
+
+        IndexIterator* iter = chunk_index->CreatePersistentIterator();
+        CHECK(iter, "Index iterator was NULL");
+        ScopedPtr<IndexIterator> scoped_iter(iter);
+
+        ChunkMappingData chunk_mapping_data;
+        byte fp[Fingerprinter::kMaxFingerprintSize];
+        size_t fp_size = sizeof(fp);
+        lookup_result lr = iter->Next(fp, &fp_size, &chunk_mapping_data);
+        while (lr == LOOKUP_FOUND && mappings.size() < max_batch_size) {
+            if (chunk_mapping_data.usage_count() != 0) {
+                ChunkMapping mapping(fp, fp_size);
+                CHECK(mapping.UnserializeFrom(chunk_mapping_data, true),
+                    "Failed to unserialize chunk mapping: " << chunk_mapping_data.ShortDebugString());
+                mapping.set_usage_count(0);
+                mappings.push_back(mapping);
+            }
+            fp_size = sizeof(fp);
+            lr = iter->Next(fp, &fp_size, &chunk_mapping_data);
+        }
+        CHECK(lr != LOOKUP_ERROR, "Failed to iterate chunk index");
+        scoped_iter.Release();
+        delete iter;
+
+        vector<ChunkMapping>::const_iterator i;
+        for (i = mappings.begin(); i != mappings.end(); ++i) {
+            CHECK(chunk_index->PutPersistentIndex(*i, true, false, NO_EC),
+                "Failed to reset usage count: " << i->DebugString());
+        }
+    } while (mappings.size() == max_batch_size);
     return true;
 }
 
@@ -315,6 +804,10 @@ bool ChunkIndexRestorer::RestoreUsageCount(ChunkIndex* chunk_index) {
 }
 
 ChunkIndexRestorer::~ChunkIndexRestorer() {
+  for (size_t i = 0; i < partitions_.size(); i++) {
+    delete partitions_[i];
+  }
+  partitions_.clear();
   if (system_) {
     delete system_;
   }
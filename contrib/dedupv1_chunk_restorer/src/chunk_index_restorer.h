@@ -23,11 +23,21 @@
 #include <gtest/gtest_prod.h>
 
 #include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <utility>
 
 #include <core/chunk_index.h>
+#include <core/container.h>
 #include <core/container_storage.h>
+#include <core/fingerprinter.h>
 #include "dedupv1d.h"
 
+#include <tbb/atomic.h>
+#include <tbb/concurrent_queue.h>
+#include <tbb/spin_mutex.h>
+
 namespace dedupv1 {
 namespace contrib {
 namespace restorer {
@@ -39,13 +49,85 @@ namespace restorer {
 * It is not necessary to replay the log before restoring the chunk index.
 * This is important because it might not be possible to replay the log without the
 * chunk index.
+*
+* The container data is read in rounds. In each round, one reader thread per container
+* file reads the containers of its file in offset order, worker threads extract the
+* items into bucket-ordered partitions and the partitions are then written to the
+* chunk index in bucket order. If a checkpoint file is configured, the progress is stored
+* after each round so that an interrupted restore can resume.
+*
+* If the container files have summary logs, each reader thread first streams the summary log
+* of its file sequentially and hands the current records to the worker threads. Afterwards only
+* the containers without a current summary record are read from the container file.
 */
 class ChunkIndexRestorer {
         FRIEND_TEST(DedupSystemTest, ChunkIndexRestorerRestore);
+
+        /**
+        * Default number of worker threads that extract the container items.
+        */
+        static const uint32_t kDefaultWorkerThreadCount = 4;
+
+        /**
+        * Default memory used to buffer the chunk mappings of a round.
+        */
+        static const uint64_t kDefaultLoaderMemory = 256 * 1024 * 1024;
+
+        /**
+        * Number of bucket-range partitions of the loader.
+        */
+        static const uint32_t kPartitionCount = 64;
+
+        /**
+        * Maximal size of the checkpoint file.
+        */
+        static const size_t kCheckpointSize = 64 * 1024;
+
+        /**
+        * Chunk mapping extracted from a container that waits to be loaded
+        * into the chunk index.
+        */
+        struct RestoreEntry {
+            /**
+            * Bucket of the fingerprint in the persistent chunk index (or
+            * a hash value if the index is not a disk-based hash index).
+            */
+            uint64_t order;
+
+            /**
+            * Primary id of the container the item has been read from. Used to
+            * break ties between items of the same fingerprint.
+            */
+            uint64_t container_id;
+            uint64_t data_address;
+            uint32_t fp_size;
+            byte fp[dedupv1::Fingerprinter::kMaxFingerprintSize];
+
+            bool operator<(const RestoreEntry& e) const;
+        };
+
+        /**
+        * Entries of a range of buckets.
+        */
+        class Partition {
+            public:
+                tbb::spin_mutex lock;
+                std::vector<RestoreEntry> entries;
+        };
+
     public:
         ChunkIndexRestorer();
         ~ChunkIndexRestorer();
 
+        /**
+        * Configures the restorer.
+        *
+        * Available options:
+        * - worker-threads: uint32_t
+        * - loader-memory: StorageUnit
+        * - checkpoint: String (filename, empty for no checkpointing)
+        */
+        bool SetOption(const std::string& option_name, const std::string& option);
 
         /**
         * Initializes the storage and chunk index from the config file.
@@ -68,11 +150,107 @@ class ChunkIndexRestorer {
 
         bool started_;
 
+        uint32_t worker_thread_count_;
+
+        uint64_t loader_memory_;
+
+        std::string checkpoint_filename_;
+
+        /**
+        * true iff the restorer has been resumed from a checkpoint that
+        * has been written after all container data has been restored.
+        */
+        bool container_data_restored_;
+
+        /**
+        * Container summaries read by the reader threads. A NULL summary signals
+        * a worker thread to stop.
+        */
+        tbb::concurrent_bounded_queue<ContainerSummaryData*> container_queue_;
+
+        /**
+        * Per container file: ids of the containers with a current record in the
+        * already streamed part of the summary log of the file.
+        */
+        std::vector<std::set<uint64_t> > summary_containers_;
+
+        /**
+        * Per container file: offset of the next record to stream from the summary log of the file.
+        */
+        std::vector<uint64_t> summary_offsets_;
+
+        std::vector<Partition*> partitions_;
+
+        /**
+        * Number of entries over all partitions.
+        */
+        tbb::atomic<uint64_t> entry_count_;
+
+        /**
+        * Maximal number of entries per round. Derived from the loader memory.
+        */
+        uint64_t max_entry_count_;
+
+        /**
+        * Bucket count of the persistent chunk index or 0 if the index is not
+        * a disk-based hash index.
+        */
+        uint64_t bucket_count_;
+
         /**
         * Reads data from the containers.
         */
         bool ReadContainerData(dedupv1::chunkindex::ChunkIndex* chunk_index);
 
+        /**
+        * Collects the ids of the containers with a current record in the summary logs
+        * up to the summary offsets. Used when a restore is resumed from a checkpoint.
+        */
+        bool ScanSummaryLogs(dedupv1::chunkstore::ContainerStorage* storage);
+
+        /**
+        * Hands the container summaries of a container file to the worker threads until the round is full.
+        * The summary log of the file is streamed first starting at the summary offset of the file. Afterwards the
+        * containers without a current summary record are read in offset order starting at the given position.
+        * The summary offset and the position are updated to the first record and container not read.
+        *
+        * @param file_index index of the container file
+        * @param containers pairs of file offset and container id sorted by offset
+        */
+        bool ReadContainerFile(dedupv1::chunkstore::ContainerStorage* storage,
+                uint32_t file_index,
+                const std::vector<std::pair<uint64_t, uint64_t> >* containers,
+                size_t* position);
+
+        /**
+        * Extracts the container items of the queued container summaries into the partitions.
+        */
+        bool ExtractContainerItems(dedupv1::chunkindex::ChunkIndex* chunk_index);
+
+        /**
+        * Writes all buffered entries in bucket order to the chunk index and clears the partitions.
+        */
+        bool LoadPartitions(dedupv1::chunkindex::ChunkIndex* chunk_index);
+
+        /**
+        * Reads the checkpoint file. If no checkpoint exists, all container files and summary logs start at offset 0.
+        */
+        bool ReadCheckpoint(uint32_t file_count, std::vector<uint64_t>* next_offsets,
+                std::vector<uint64_t>* next_summary_offsets);
+
+        /**
+        * Writes the checkpoint file.
+        */
+        bool WriteCheckpoint(const std::vector<uint64_t>& next_offsets,
+                const std::vector<uint64_t>& next_summary_offsets,
+                bool container_data_restored);
+
+        /**
+        * Sets the usage count of all chunk mappings to zero. This is necessary
+        * if a restore is resumed after the usage count restore has been interrupted.
+        */
+        bool ResetUsageCount(dedupv1::chunkindex::ChunkIndex* chunk_index);
+
         /**
         * Restores the usage count of all chunk mappings.
         */
@@ -60,6 +60,9 @@ LOGGER("ChunkIndexRestorer");
 
 DEFINE_string(config, DEDUPV1_DEFAULT_CONFIG, "dedupv1 configuration file");
 DEFINE_string(logging, DEDUPV1_ROOT "/etc/dedupv1/console_logging.xml", "Logging configuration file");
+DEFINE_int32(worker_threads, 4, "Number of threads extracting the container items");
+DEFINE_string(loader_memory, "256M", "Memory used to buffer chunk mappings before they are written to the chunk index");
+DEFINE_string(checkpoint, "", "Checkpoint file. If set, an interrupted restore resumes from the last checkpoint");
 
 int main(int argc, char * argv[]) {
     // Verify that the version of the library that we linked against is
@@ -86,6 +89,12 @@ int main(int argc, char * argv[]) {
     dedupv1::DedupSystem::RegisterDefaults();
 
     dedupv1::contrib::restorer::ChunkIndexRestorer restorer;
+    if (!restorer.SetOption("worker-threads", dedupv1::base::strutil::ToString(FLAGS_worker_threads)) ||
+            !restorer.SetOption("loader-memory", FLAGS_loader_memory) ||
+            !restorer.SetOption("checkpoint", FLAGS_checkpoint)) {
+        ERROR("Illegal restorer options");
+        exit(1);
+    }
 
     INFO("Restoring chunk index");
 
@@ -18,6 +18,10 @@
  * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
  */
 
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <limits>
 #include <map>
 #include <vector>
 #include <string>
@@ -36,6 +40,8 @@
 #include <base/memory.h>
 #include <core/storage.h>
 #include <base/strutil.h>
+#include <base/fileutil.h>
+#include <core/container_storage.h>
 #include "dedupv1d.h"
 #include <test_util/log_assert.h>
 
@@ -49,6 +55,7 @@ using dedupv1::base::PersistentIndex;
 using dedupv1::base::IndexIterator;
 using dedupv1::chunkindex::ChunkMapping;
 using dedupv1::base::lookup_result;
+using dedupv1::base::Option;
 using dedupv1::base::LOOKUP_FOUND;
 using dedupv1::base::strutil::ToHexString;
 using dedupv1d::Dedupv1d;
@@ -276,3 +283,172 @@ TEST_F(ChunkIndexRestorerTest, ChunkIndexRestorerEmptyFingerprint) {
     // if the restore finished, without an error we are happy
 
 }
+
+TEST_F(ChunkIndexRestorerTest, ChunkIndexRestorerParallel) {
+    system = new Dedupv1d();
+    ASSERT_TRUE(system->LoadOptions("data/dedupv1_test.conf"));
+    ASSERT_TRUE(system->Start(dedupv1::StartContext()));
+    ASSERT_TRUE(system->Run());
+    FILE* file = fopen("data/random","r");
+    ASSERT_TRUE(file);
+
+    byte buffer[64 * 1024];
+    ASSERT_EQ(65536, fread(buffer, sizeof(byte), 65536, file));
+
+    DedupVolume* volume = system->dedup_system()->GetVolume(0);
+    ASSERT_TRUE(volume);
+
+    ASSERT_TRUE(volume->MakeRequest(REQUEST_WRITE, 0, 64 * 1024, buffer, NO_EC));
+    fclose(file);
+
+    ASSERT_TRUE(system->Shutdown(dedupv1::StopContext()));
+    ASSERT_TRUE(system->Stop());
+    delete system;
+    system = NULL;
+
+    dedupv1::StartContext start_context;
+    start_context.set_create(dedupv1::StartContext::NON_CREATE);
+    system = new Dedupv1d();
+    ASSERT_TRUE(system->LoadOptions("data/dedupv1_test.conf"));
+    ASSERT_TRUE(system->Start(start_context));
+    ASSERT_TRUE(system->dedup_system()->log()->PerformFullReplayBackgroundMode());
+
+    ChunkIndex* chunk_index = system->dedup_system()->chunk_index();
+    ASSERT_TRUE(chunk_index != NULL);
+    ChunkMappingData chunk_mapping_data;
+    size_t key_size = 20;
+    byte key[20];
+
+    IndexIterator* iter = chunk_index->CreatePersistentIterator();
+    ASSERT_TRUE(iter != NULL);
+    map<string, uint64_t> reference_map;
+    while (iter->Next(key, &key_size, &chunk_mapping_data) == LOOKUP_FOUND) {
+        string fp;
+        fp.assign(reinterpret_cast<char*>(key), key_size);
+        reference_map[fp] = chunk_mapping_data.usage_count();
+    }
+    delete iter;
+    ASSERT_GT(reference_map.size(), 0);
+
+    ASSERT_TRUE(system->Shutdown(dedupv1::StopContext::WritebackStopContext()));
+    ASSERT_TRUE(system->Stop());
+    delete system;
+    system = NULL;
+
+    unlink("work/chunk-index");
+
+    // a small loader memory forces multiple rounds and checkpoints
+    ASSERT_TRUE(restorer.SetOption("worker-threads", "3"));
+    ASSERT_TRUE(restorer.SetOption("loader-memory", "4K"));
+    ASSERT_TRUE(restorer.SetOption("checkpoint", "work/chunk-restorer-checkpoint"));
+    ASSERT_TRUE(restorer.InitializeStorageAndChunkIndex("data/dedupv1_test.conf"));
+    ASSERT_TRUE(restorer.RestoreChunkIndexFromContainerStorage());
+    ASSERT_TRUE(restorer.Stop());
+
+    // the checkpoint is removed after a successful restore
+    Option<bool> exists = dedupv1::base::File::Exists("work/chunk-restorer-checkpoint");
+    ASSERT_TRUE(exists.valid());
+    ASSERT_FALSE(exists.value());
+
+    system = new Dedupv1d();
+    ASSERT_TRUE(system->LoadOptions("data/dedupv1_test.conf"));
+    ASSERT_TRUE(system->Start(start_context));
+    chunk_index = system->dedup_system()->chunk_index();
+    ASSERT_TRUE(chunk_index);
+    for (map<string, uint64_t>::iterator i = reference_map.begin(); i != reference_map.end(); i++) {
+        ChunkMapping mapping(reinterpret_cast<const byte*>(i->first.data()), i->first.size());
+        ASSERT_EQ(chunk_index->Lookup(&mapping, false, NO_EC), LOOKUP_FOUND);
+        EXPECT_EQ(i->second, mapping.usage_count());
+    }
+}
+
+TEST_F(ChunkIndexRestorerTest, ChunkIndexRestorerResume) {
+    system = new Dedupv1d();
+    ASSERT_TRUE(system->LoadOptions("data/dedupv1_test.conf"));
+    ASSERT_TRUE(system->Start(dedupv1::StartContext()));
+    ASSERT_TRUE(system->Run());
+    FILE* file = fopen("data/random","r");
+    ASSERT_TRUE(file);
+
+    byte buffer[64 * 1024];
+    ASSERT_EQ(65536, fread(buffer, sizeof(byte), 65536, file));
+
+    DedupVolume* volume = system->dedup_system()->GetVolume(0);
+    ASSERT_TRUE(volume);
+
+    ASSERT_TRUE(volume->MakeRequest(REQUEST_WRITE, 0, 64 * 1024, buffer, NO_EC));
+    fclose(file);
+
+    dedupv1::chunkstore::ContainerStorage* storage =
+        dynamic_cast<dedupv1::chunkstore::ContainerStorage*>(system->dedup_system()->storage());
+    ASSERT_TRUE(storage);
+    uint32_t file_count = storage->GetFileCount();
+
+    ASSERT_TRUE(system->Shutdown(dedupv1::StopContext()));
+    ASSERT_TRUE(system->Stop());
+    delete system;
+    system = NULL;
+
+    unlink("work/chunk-index");
+
+    {
+        dedupv1::contrib::restorer::ChunkIndexRestorer first_restorer;
+        ASSERT_TRUE(first_restorer.InitializeStorageAndChunkIndex("data/dedupv1_test.conf"));
+        ASSERT_TRUE(first_restorer.RestoreChunkIndexFromContainerStorage());
+        ASSERT_TRUE(first_restorer.Stop());
+    }
+
+    dedupv1::StartContext start_context;
+    start_context.set_create(dedupv1::StartContext::NON_CREATE);
+    system = new Dedupv1d();
+    ASSERT_TRUE(system->LoadOptions("data/dedupv1_test.conf"));
+    ASSERT_TRUE(system->Start(start_context));
+    ChunkIndex* chunk_index = system->dedup_system()->chunk_index();
+    ASSERT_TRUE(chunk_index != NULL);
+    ChunkMappingData chunk_mapping_data;
+    size_t key_size = 20;
+    byte key[20];
+
+    IndexIterator* iter = chunk_index->CreatePersistentIterator();
+    ASSERT_TRUE(iter != NULL);
+    map<string, uint64_t> reference_map;
+    while (iter->Next(key, &key_size, &chunk_mapping_data) == LOOKUP_FOUND) {
+        string fp;
+        fp.assign(reinterpret_cast<char*>(key), key_size);
+        reference_map[fp] = chunk_mapping_data.usage_count();
+    }
+    delete iter;
+    ASSERT_GT(reference_map.size(), 0);
+    ASSERT_TRUE(system->Stop());
+    delete system;
+    system = NULL;
+
+    // Simulate a restore that has been interrupted while restoring the usage counts. The
+    // restored usage counts are already set and must not be counted twice.
+    ChunkIndexRestorerCheckpointData checkpoint_data;
+    for (uint32_t i = 0; i < file_count; i++) {
+        checkpoint_data.add_next_offset(std::numeric_limits<uint64_t>::max());
+    }
+    checkpoint_data.set_container_data_restored(true);
+    dedupv1::base::File* checkpoint_file = dedupv1::base::File::Open("work/chunk-restorer-checkpoint",
+        O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    ASSERT_TRUE(checkpoint_file);
+    ASSERT_GT(checkpoint_file->WriteSizedMessage(0, checkpoint_data, 64 * 1024, true), 0);
+    delete checkpoint_file;
+
+    ASSERT_TRUE(restorer.SetOption("checkpoint", "work/chunk-restorer-checkpoint"));
+    ASSERT_TRUE(restorer.InitializeStorageAndChunkIndex("data/dedupv1_test.conf"));
+    ASSERT_TRUE(restorer.RestoreChunkIndexFromContainerStorage());
+    ASSERT_TRUE(restorer.Stop());
+
+    system = new Dedupv1d();
+    ASSERT_TRUE(system->LoadOptions("data/dedupv1_test.conf"));
+    ASSERT_TRUE(system->Start(start_context));
+    chunk_index = system->dedup_system()->chunk_index();
+    ASSERT_TRUE(chunk_index);
+    for (map<string, uint64_t>::iterator i = reference_map.begin(); i != reference_map.end(); i++) {
+        ChunkMapping mapping(reinterpret_cast<const byte*>(i->first.data()), i->first.size());
+        ASSERT_EQ(chunk_index->Lookup(&mapping, false, NO_EC), LOOKUP_FOUND);
+        EXPECT_EQ(i->second, mapping.usage_count());
+    }
+}
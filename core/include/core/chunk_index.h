@@ -36,6 +36,7 @@
 #include <base/error.h>
 #include <core/chunk_locks.h>
 #include <core/chunk_index_in_combat.h>
+#include <core/chunk_index_hot_tier.h>
 #include <core/chunk_index_sampling_strategy.h>
 #include <core/info_store.h>
 #include <core/container.h>
@@ -225,6 +226,12 @@ private:
 
     ChunkIndexInCombats in_combats_;
 
+    /**
+     * Optional in-memory tier with the chunk mappings of frequently used chunks.
+     * Checked before the persistent index.
+     */
+    ChunkIndexHotTier hot_tier_;
+
     /**
      * Info store
      */
@@ -449,6 +456,7 @@ public:
      *   The parallel import improves the performance to the the concurrency, but this feature was only
      *   recently introduced. The default is true. The option is depreciated and might be removed in the future.
      * - in-combats.*: Forwards the option suffix to the in combats object. See there for more information.
+     * - hot-tier.*: Forwards the option suffix to the hot tier. See there for more information.
      * - bg-thread-count: Number of background importing threads. Default: 4.
      * - dirty-chunks-threshold: sets the dirty chunk threashold (storage unit)
      *
@@ -29,6 +29,7 @@
 #include <base/profile.h>
 #include <core/chunk_index.h>
 #include <core/block_mapping.h>
+#include <core/chunk_rewrite_policy.h>
 #include <base/sliding_average.h>
 
 #include <string>
@@ -66,6 +67,7 @@ public:
         tbb::atomic<uint64_t> miss_;
         tbb::atomic<uint64_t> failures_;
         tbb::atomic<uint64_t> anchor_count_;
+        tbb::atomic<uint64_t> rewrites_;
 
         /**
          * Profiling information about the filter.
@@ -88,6 +90,16 @@ public:
      */
     Statistics stats_;
 
+    /**
+     * iff true, fragmented duplicates are rewritten
+     */
+    bool rewrite_enabled_;
+
+    /**
+     * Policy that decides which duplicates are rewritten
+     */
+    ChunkRewritePolicy rewrite_policy_;
+
     /**
      * Releases the lock on the fingerprint of the chunk
      */
@@ -100,6 +112,12 @@ public:
      */
     bool AcquireChunkLock(const dedupv1::chunkindex::ChunkMapping& mapping);
 
+    /**
+     * Checks if the found chunk should be stored again to reduce the
+     * fragmentation of the volume of the session.
+     */
+    bool ShouldRewrite(dedupv1::Session* session, const dedupv1::chunkindex::ChunkMapping& mapping);
+
 public:
     /**
      * Constructor
@@ -121,11 +139,26 @@ public:
      */
     virtual bool Start(DedupSystem* system);
 
+    /**
+     * Configures the chunk index filter.
+     *
+     * Available options:
+     * - rewrite: Boolean, default false. Rewritten chunks are stored a second time. The old
+     *   copy is only reclaimed when the chunk is no longer used (see ChunkRewritePolicy).
+     * - rewrite.*: Options of the chunk rewrite policy
+     *
+     * @return true iff ok, otherwise an error has occurred
+     */
+    virtual bool SetOption(const std::string& option_name, const std::string& option);
+
     /**
      * Checks the chunk index for the chunk mapping.
      * If we find an entry in the chunk index with the same fingerprint,
      * STRONG_MAYBE is returned. Otherwise NOT_EXISTING is returned.
      *
+     * If rewriting is enabled and the rewrite policy decides that the
+     * found chunk should be stored again, NOT_EXISTING is returned, too.
+     *
      * If an auxiliary index is configured, the auxiliary index is checked
      * first.
      *
@@ -0,0 +1,278 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef CHUNK_INDEX_HOT_TIER_H_
+#define CHUNK_INDEX_HOT_TIER_H_
+
+#include <core/dedup.h>
+#include <core/chunk_mapping.h>
+#include <core/statistics.h>
+#include <base/index.h>
+#include <base/profile.h>
+
+#include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
+
+#include <string>
+
+namespace dedupv1 {
+namespace chunkindex {
+
+/**
+ * Small in-memory tier in front of the persistent chunk index that holds the
+ * chunk mappings of the most frequently used fingerprints, e.g. the chunks of
+ * operating system files in VM backups.
+ *
+ * The tier is a set-associative hash table with fixed-size keys and values. Within a set,
+ * the least recently used entry is the eviction candidate. A new fingerprint is only
+ * admitted if it has been seen more often than the eviction candidate (TinyLFU). The access frequencies are
+ * estimated by a count-min sketch with small saturating counters that are halved
+ * periodically so that the tier adapts to a changing working set.
+ *
+ * The tier is a write-through cache: The chunk index has to call Update for every changed
+ * and Remove for every deleted chunk mapping. An admission is rejected if the set has been modified
+ * between the persistent lookup and the admission.
+ */
+class ChunkIndexHotTier : public dedupv1::StatisticProvider {
+    private:
+        DISALLOW_COPY_AND_ASSIGN(ChunkIndexHotTier);
+
+        /**
+         * Maximal size of a fingerprint stored in the tier
+         */
+        static const size_t kMaxKeySize = 32;
+
+        /**
+         * Number of entries per set
+         */
+        static const uint32_t kWays = 8;
+
+        /**
+         * Number of count-min sketch rows
+         */
+        static const uint32_t kSketchDepth = 4;
+
+        /**
+         * Minimal number of counters per sketch row
+         */
+        static const uint64_t kMinSketchWidth = 1024;
+
+        /**
+         * Maximal value of a sketch counter
+         */
+        static const uint8_t kMaxFrequency = 15;
+
+        /**
+         * Number of frequency samples per entry after that the sketch counters are halved
+         */
+        static const uint32_t kSampleFactor = 10;
+
+        /**
+         * Fixed-size entry of the tier.
+         * An entry with key_size_ == 0 is unused.
+         */
+        struct Entry {
+            byte key_[kMaxKeySize];
+            uint8_t key_size_;
+            bool has_block_hint_;
+            uint64_t last_access_;
+            uint64_t data_address_;
+            int64_t usage_count_;
+            uint64_t usage_count_change_log_id_;
+            uint64_t usage_count_failed_write_change_log_id_;
+            uint64_t block_hint_;
+        };
+
+        struct Set {
+            tbb::spin_mutex lock_;
+
+            /**
+             * Incremented whenever an entry of the set is updated or removed.
+             */
+            uint32_t epoch_;
+
+            Entry entries_[kWays];
+        };
+
+        class Statistics {
+            public:
+                Statistics();
+
+                tbb::atomic<uint64_t> hit_count_;
+                tbb::atomic<uint64_t> miss_count_;
+                tbb::atomic<uint64_t> admit_count_;
+                tbb::atomic<uint64_t> reject_count_;
+                tbb::atomic<uint64_t> evict_count_;
+                tbb::atomic<uint64_t> update_count_;
+                tbb::atomic<uint64_t> remove_count_;
+                tbb::atomic<uint64_t> aging_count_;
+
+                dedupv1::base::Profile lookup_time_;
+                dedupv1::base::Profile update_time_;
+        };
+
+        /**
+         * Configured number of entries. 0 disables the tier.
+         */
+        uint64_t size_;
+
+        /**
+         * iff false, every fingerprint is admitted (plain LRU)
+         */
+        bool admission_;
+
+        Set* sets_;
+
+        uint64_t set_count_;
+
+        /**
+         * Count-min sketch with kSketchDepth rows of sketch_width_ counters.
+         */
+        tbb::atomic<uint8_t>* sketch_;
+
+        /**
+         * Number of counters per sketch row. Always a power of two.
+         */
+        uint64_t sketch_width_;
+
+        /**
+         * Number of frequency samples since the last aging
+         */
+        tbb::atomic<uint64_t> sample_count_;
+
+        uint64_t aging_threshold_;
+
+        /**
+         * Logical clock for the LRU ordering within a set
+         */
+        tbb::atomic<uint64_t> access_clock_;
+
+        bool started_;
+
+        Statistics stats_;
+
+        void Hash(const void* fp, size_t fp_size, uint32_t* hash_values);
+
+        Set* GetSet(const uint32_t* hash_values);
+
+        Entry* FindEntry(Set* set, const void* fp, size_t fp_size);
+
+        /**
+         * Records an access of the fingerprint in the sketch
+         */
+        void RecordAccess(const uint32_t* hash_values);
+
+        /**
+         * Estimates the access frequency of a fingerprint.
+         */
+        uint8_t EstimateFrequency(const uint32_t* hash_values);
+
+        /**
+         * Halves all sketch counters
+         */
+        void Age();
+
+        static void CopyToEntry(const ChunkMapping& mapping, Entry* entry);
+    public:
+        /**
+         * Constructor
+         */
+        ChunkIndexHotTier();
+
+        /**
+         * Destructor
+         */
+        virtual ~ChunkIndexHotTier();
+
+        /**
+         * Configures the hot tier.
+         *
+         * Available options:
+         * - size: StorageUnit (number of entries, 0 disables the tier)
+         * - admission: Boolean
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool SetOption(const std::string& option_name, const std::string& option);
+
+        /**
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Start();
+
+        /**
+         * returns true iff the tier is configured and started
+         */
+        inline bool IsEnabled() const;
+
+        /**
+         * Looks up the fingerprint of the given mapping and fills the mapping
+         * on a hit. The access is recorded for the admission policy.
+         *
+         * @param epoch set to the current epoch of the set of the fingerprint. Should
+         * be passed to Admit if the mapping is found in the persistent index
+         */
+        dedupv1::base::lookup_result Lookup(ChunkMapping* mapping, uint32_t* epoch);
+
+        /**
+         * Tries to admit a mapping that has been found in the persistent index.
+         *
+         * @param epoch epoch returned by the previous Lookup
+         * @return true iff ok, otherwise an error has occurred. A rejected admission is
+         * not an error.
+         */
+        bool Admit(const ChunkMapping& mapping, uint32_t epoch);
+
+        /**
+         * Updates the entry of the mapping if it is stored in the tier.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Update(const ChunkMapping& mapping);
+
+        /**
+         * Removes the entry of the fingerprint if it is stored in the tier.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Remove(const void* fp, size_t fp_size);
+
+        /**
+         * Removes all entries
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Clear();
+
+        virtual std::string PrintStatistics();
+
+        virtual std::string PrintTrace();
+
+        virtual std::string PrintProfile();
+};
+
+bool ChunkIndexHotTier::IsEnabled() const {
+    return started_ && size_ > 0;
+}
+
+}
+}
+
+#endif /* CHUNK_INDEX_HOT_TIER_H_ */
@@ -62,6 +62,13 @@ class ChunkMapping {
          */
         uint64_t data_address_;
 
+        /**
+         * Data address of an older copy of the chunk that has been replaced by a rewrite
+         * or Storage::ILLEGAL_STORAGE_ADDRESS. The older copy is still referenced by the
+         * block mappings written before the rewrite.
+         */
+        uint64_t superseded_data_address_;
+
         /**
          * Number of references to the chunk.
          * The value is usually stale as the garbage collector updates the usage counter in a lazy
@@ -206,6 +213,17 @@ class ChunkMapping {
          */
         inline ChunkMapping& set_data_address(uint64_t data_address);
 
+        /**
+         * returns the data address of the older copy replaced by a rewrite or
+         * Storage::ILLEGAL_STORAGE_ADDRESS if there is no older copy.
+         */
+        inline uint64_t superseded_data_address() const;
+
+        /**
+         * sets the data address of the older copy replaced by a rewrite
+         */
+        inline ChunkMapping& set_superseded_data_address(uint64_t data_address);
+
         /**
          * returns the usage counter.
          * May be stale as the usage counter is update lazyly.
@@ -399,6 +417,15 @@ ChunkMapping& ChunkMapping::set_data_address(uint64_t data_address) {
     return *this;
 }
 
+uint64_t ChunkMapping::superseded_data_address() const {
+    return superseded_data_address_;
+}
+
+ChunkMapping& ChunkMapping::set_superseded_data_address(uint64_t data_address) {
+    this->superseded_data_address_ = data_address;
+    return *this;
+}
+
 ChunkMapping& ChunkMapping::set_usage_count(int64_t usage_count) {
     this->usage_count_ = usage_count;
     return *this;
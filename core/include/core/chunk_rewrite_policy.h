@@ -0,0 +1,179 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef CHUNK_REWRITE_POLICY_H__
+#define CHUNK_REWRITE_POLICY_H__
+
+#include <core/dedup.h>
+#include <core/statistics.h>
+
+#include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
+
+#include <deque>
+#include <map>
+#include <string>
+
+namespace dedupv1 {
+namespace filter {
+
+/**
+ * Write-path policy that limits the fragmentation of a volume by rewriting duplicate chunks
+ * (similar to capping and context-based rewriting).
+ *
+ * For each volume, the policy remembers the containers referenced by the last
+ * window-size duplicate chunks. The number of distinct containers in the window
+ * is the fragmentation of the volume: a restore of the recently written data has to read at least
+ * that many containers. If the fragmentation exceeds the container threshold, a duplicate that
+ * is stored in a container with less than min-references other references in the
+ * window is rewritten, i.e. it is stored again in the current container.
+ *
+ * The rewritten data is bounded by max-ratio of the data written to the volume.
+ * The old copy of a rewritten chunk is still referenced by the block mappings written before
+ * the rewrite. Its address is kept as superseded address in the chunk mapping and the
+ * garbage collector deletes it together with the new copy when the usage count of the
+ * chunk drops to zero. A chunk that already has a superseded copy is not rewritten again,
+ * so there are at most two copies of a chunk.
+ */
+class ChunkRewritePolicy : public dedupv1::StatisticProvider {
+    private:
+        DISALLOW_COPY_AND_ASSIGN(ChunkRewritePolicy);
+
+        static const uint32_t kDefaultWindowSize = 1024;
+        static const uint32_t kDefaultContainerThreshold = 64;
+        static const uint32_t kDefaultMinReferences = 4;
+
+        /**
+         * Fragmentation state of a single volume.
+         * All members are protected by the lock.
+         */
+        class VolumeState {
+            public:
+                VolumeState();
+
+                tbb::spin_mutex lock_;
+
+                /**
+                 * container ids of the last duplicate chunks
+                 */
+                std::deque<uint64_t> window_;
+
+                /**
+                 * number of references to a container in the window
+                 */
+                std::map<uint64_t, uint32_t> container_counts_;
+
+                uint64_t written_bytes_;
+                uint64_t duplicate_count_;
+                uint64_t rewrite_count_;
+                uint64_t rewrite_bytes_;
+                uint64_t capped_count_;
+        };
+
+        /**
+         * Number of duplicate chunks that are considered for the fragmentation
+         */
+        uint32_t window_size_;
+
+        /**
+         * Number of distinct containers in the window above that chunks are rewritten
+         */
+        uint32_t container_threshold_;
+
+        /**
+         * A chunk is only rewritten if its container is referenced less often in the window.
+         */
+        uint32_t min_references_;
+
+        /**
+         * Maximal ratio of rewritten data to written data of a volume
+         */
+        double max_ratio_;
+
+        /**
+         * Protects the volume map
+         */
+        tbb::spin_mutex volume_lock_;
+
+        /**
+         * Map from the volume id to the volume state.
+         * Entries are never removed.
+         */
+        std::map<uint32_t, VolumeState*> volumes_;
+
+        bool started_;
+
+        VolumeState* GetVolumeState(uint32_t volume_id);
+
+        void AddToWindow(VolumeState* state, uint64_t container_id);
+    public:
+        /**
+         * Constructor
+         */
+        ChunkRewritePolicy();
+
+        /**
+         * Destructor
+         */
+        virtual ~ChunkRewritePolicy();
+
+        /**
+         * Available options:
+         * - window-size: uint32_t
+         * - container-threshold: uint32_t
+         * - min-references: uint32_t
+         * - max-ratio: double, maximal ratio of rewritten bytes to written bytes of a volume
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool SetOption(const std::string& option_name, const std::string& option);
+
+        /**
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Start();
+
+        /**
+         * Accounts a chunk written to the given volume, regardless if the chunk is a duplicate
+         * or not.
+         */
+        void OnWrite(uint32_t volume_id, size_t chunk_size);
+
+        /**
+         * Decides if a duplicate chunk of the given volume that is stored in the given container
+         * should be rewritten.
+         *
+         * @return true iff the chunk should be stored again
+         */
+        bool ShouldRewrite(uint32_t volume_id, uint64_t container_id, size_t chunk_size);
+
+        /**
+         * returns the number of distinct containers referenced by the last duplicate chunks
+         * of the volume
+         */
+        uint32_t GetFragmentation(uint32_t volume_id);
+
+        virtual std::string PrintStatistics();
+};
+
+}
+}
+
+#endif  // CHUNK_REWRITE_POLICY_H__
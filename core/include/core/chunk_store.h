@@ -132,11 +132,13 @@ public:
      * value before are set.
      *
      * @param chunk_mappings
+     * @param stream_id stream the chunk belongs to, e.g. the volume id, or Storage::NO_STREAM_ID
      * @param ec Error context that can be filled if case of special errors
      * @return true iff ok, otherwise an error has occurred
      */
     virtual bool WriteBlock(
         dedupv1::chunkindex::ChunkMapping* chunk_mappings,
+        uint32_t stream_id,
         dedupv1::base::ErrorContext* ec);
 
     /**
@@ -155,6 +157,18 @@ public:
         uint32_t size,
         dedupv1::base::ErrorContext* ec);
 
+    /**
+     * Reads the data of multiple block mapping items with a single batched storage read.
+     * Requests for the empty data address are filled with zeros.
+     *
+     * @param requests read requests. The request address is the data address of the item.
+     * @param ec Error context that can be filled if case of special errors
+     * @return true iff ok, otherwise an error has occurred
+     */
+    virtual bool ReadBlocks(
+        const std::vector<StorageReadRequest*>& requests,
+        dedupv1::base::ErrorContext* ec);
+
     /**
      * Flushes all open data to disk
      * @return true iff ok, otherwise an error has occurred
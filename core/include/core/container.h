@@ -25,6 +25,7 @@
 #include <core/fingerprinter.h>
 #include <base/compress.h>
 #include <base/fileutil.h>
+#include <base/io_scheduler.h>
 
 #include <gtest/gtest_prod.h>
 
@@ -34,6 +35,8 @@
 #include <set>
 #include <vector>
 
+#include "dedupv1.pb.h"
+
 namespace dedupv1 {
 namespace chunkstore {
 
@@ -51,43 +54,40 @@ class ContainerItem {
          */
         byte key_[dedupv1::Fingerprinter::kMaxFingerprintSize];
 
-        /**
-         * Size of the key.
-         * key_size <= Fingerprinter::kMaxFingerprintSize
-         */
-        size_t key_size_;
-
         /**
          * Offset of the data of the container item in the
          * container data. The offset is calculated from
          * the beginning of the container, not from the
          * beginning of the container data area.
+         *
+         * 32-bit values are enough as a container is always smaller than 4 GB. The smaller
+         * fields reduce the memory footprint of the cached containers.
          */
-        size_t offset_;
+        uint32_t offset_;
 
         /**
          * on-disk size of the item.
          * It is the possibly compressed size of the item data plus the
-         * size of the ContainerItemValueData message.
+         * size of the item header.
          */
-        size_t item_size_;
+        uint32_t item_size_;
 
         /**
          * Uncompressed data size of the container item
          */
-        size_t raw_size_;
+        uint32_t raw_size_;
 
         /**
-         * Flag if the container item is deleted and is allowed
-         * to be deleted from the container eventually.
+         * Size of the key.
+         * key_size <= Fingerprinter::kMaxFingerprintSize
          */
-        bool deleted_;
+        uint8_t key_size_;
 
         /**
-         * container if of the container the item has been added in the first place, e.g.
-         * before any merging.
+         * Flag if the container item is deleted and is allowed
+         * to be deleted from the container eventually.
          */
-        uint64_t original_id_;
+        bool deleted_;
 
         /**
          * Indicates if the container item should have a corresponding
@@ -95,6 +95,18 @@ class ContainerItem {
          */
         bool is_indexed_;
 
+        /**
+         * Layout of the item header (a ContainerFormatVersion value). Stored as a byte to
+         * keep the memory footprint of the cached items small.
+         */
+        uint8_t format_version_;
+
+        /**
+         * container if of the container the item has been added in the first place, e.g.
+         * before any merging.
+         */
+        uint64_t original_id_;
+
     public:
         /**
          * Constructor
@@ -105,7 +117,8 @@ class ContainerItem {
             size_t raw_size,
             size_t item_size,
             uint64_t original_id,
-            bool is_indexed);
+            bool is_indexed,
+            ContainerFormatVersion format_version);
 
         /**
          * returns the key of the container item.
@@ -154,6 +167,11 @@ class ContainerItem {
          */
         inline bool is_indexed() const;
 
+        /**
+         * Layout of the item header in front of the item data.
+         */
+        inline ContainerFormatVersion format_version() const;
+
         /**
          * Tests for equality.
          * @param item container item to compare with
@@ -180,9 +198,19 @@ class ContainerItem {
  * In the data area multiple container items are stored. Each item
  * consists of the following structure:
  * ---------------------------------------------------------------------
- * - Int - ContainerValueDataItem - Data                               -
+ * - Item header - Data                                                -
  * ---------------------------------------------------------------------
  *
+ * The layout of the item header depends on the format version of the container.
+ * Containers of the version CONTAINER_FORMAT_ITEM_MESSAGE prefix each item with a sized
+ * ContainerItemValueData message. Containers of the version CONTAINER_FORMAT_FIXED_ITEM_HEADER
+ * use a fixed binary header of kItemHeaderSize bytes:
+ * ---------------------------------------------------------------------
+ * - On disk size (4 bytes) - Compression (1 byte) - Flags (1 byte) - Reserved (2 bytes) -
+ * ---------------------------------------------------------------------
+ * The fixed header is decoded without a protobuf parse on every item read. New containers
+ * always use the fixed header; older containers keep their format until their items are copied.
+ *
  * Each entry in the meta data section points to an specific (non-overlapping) such
  * region (offset / on_disk_size). The meta data item and the region together form a container
  * item which presents a stored chunk data.
@@ -192,6 +220,8 @@ private:
     DISALLOW_COPY_AND_ASSIGN(Container);
     friend class ContainerTest;
     FRIEND_TEST(ContainerTest, SerializeContainer);
+    FRIEND_TEST(ContainerTest, SerializeContainerWithCRC32C);
+    FRIEND_TEST(ContainerTest, MergeContainerWithItemMessageFormat);
 
     /**
      * Current data position.
@@ -229,10 +259,24 @@ private:
 
     /**
      * List of container items of the container.
-     * The items are maintained in a sorted fashion by fingerprint to allow a fast binary search.
+     * The first sorted_item_count_ items are sorted by fingerprint to allow a fast binary search. New items
+     * are appended in an unsorted tail that is merged into the sorted part when it gets too long and before
+     * the metadata is serialized.
      */
     std::vector<ContainerItem*> items_;
 
+    /**
+     * Flat array with the key prefix (see GetKeyPrefix) of each item in items_ (same index).
+     * The search is done on this contiguous array and only the candidates with
+     * a matching prefix are compared using the full fingerprint.
+     */
+    std::vector<uint64_t> item_key_prefixes_;
+
+    /**
+     * Number of items at the beginning of items_ that are sorted.
+     */
+    size_t sorted_item_count_;
+
     /**
      * Note: We do not use items.size() because IsFull is called very often and items.size() takes some time.
      * The item count currently contains the deleted and the undeleted items.
@@ -260,6 +304,24 @@ private:
      */
     bool metaDataOnly_;
 
+    /**
+     * Size of the mapping of the data buffer if the buffer has been mapped (huge pages).
+     * 0 if the buffer has been allocated on the heap.
+     */
+    size_t data_mapped_size_;
+
+    /**
+     * Container items that are not used anymore. The items are recycled for
+     * new items so that a reused container does not allocate items again.
+     */
+    std::vector<ContainerItem*> free_items_;
+
+    /**
+     * Container items are allocated in blocks of kItemBlockSize items to
+     * avoid a heap allocation per item. The blocks are freed in the destructor.
+     */
+    std::vector<ContainerItem*> item_blocks_;
+
     /**
      * Time the container has been committed or merged.
      * Set to "0" if the container has not been committed before.
@@ -268,13 +330,81 @@ private:
      */
     time_t commit_time_;
 
+    /**
+     * Type of the checksum calculated when the container is stored.
+     */
+    ContainerChecksumType checksum_type_;
+
+    /**
+     * Layout of the item headers in the data area.
+     */
+    ContainerFormatVersion format_version_;
+
     /**
      * Returns a mutable pointer to the data
      * @return
      */
     inline byte* mutable_data();
 
-    static void InsertItemSorted(std::vector<ContainerItem*>* items, ContainerItem* item);
+    /**
+     * Number of items allocated at once
+     */
+    static const size_t kItemBlockSize = 64;
+
+    /**
+     * Maximal number of items in the unsorted tail of the item list.
+     */
+    static const size_t kMaxUnsortedItemCount = 64;
+
+    /**
+     * If the search range is smaller than this, the prefix array is scanned linearly
+     */
+    static const size_t kLinearSearchThreshold = 16;
+
+    /**
+     * Returns a 64-bit prefix of the key that is ordered in the same way as
+     * raw_compare orders the keys: The highest byte encodes the (inverted) key size,
+     * the other bytes are the first bytes of the key.
+     */
+    static inline uint64_t GetKeyPrefix(const void* key, size_t key_size);
+
+    /**
+     * Appends the item to the unsorted tail of the item list.
+     */
+    void AppendItem(ContainerItem* item);
+
+    /**
+     * Sorts the unsorted tail of the item list and merges it into the sorted part.
+     */
+    void SortItems();
+
+    /**
+     * Returns the index of the item with the given fingerprint or -1 if
+     * no such item exists.
+     */
+    int FindItemIndex(const void* fp, size_t fp_size, bool find_deleted) const;
+
+    /**
+     * Returns a new container item. A free item is recycled if possible.
+     */
+    ContainerItem* NewItem(const byte* key,
+            size_t key_size,
+            size_t offset,
+            size_t raw_size,
+            size_t item_size,
+            uint64_t original_id,
+            bool is_indexed,
+            ContainerFormatVersion format_version);
+
+    /**
+     * Ensures that at least count items are in the free item list.
+     */
+    void ReserveItems(size_t count);
+
+    /**
+     * Moves all items to the free item list.
+     */
+    void ReleaseItems();
 public:
     static const uint64_t kLeastValidContainerId = 1;
 
@@ -299,10 +429,23 @@ public:
      */
     static const size_t kMaxSerializedItemMetadataSize = 84;
 
+    /**
+     * Size of the fixed binary item header of the CONTAINER_FORMAT_FIXED_ITEM_HEADER format.
+     */
+    static const size_t kItemHeaderSize = 8;
+
+    /**
+     * Format version of new containers
+     */
+    static const ContainerFormatVersion kDefaultFormatVersion = CONTAINER_FORMAT_FIXED_ITEM_HEADER;
+
     /**
      * Constructor.
+     *
+     * @param huge_pages if true, the data buffer of a (non meta data only) container is mapped
+     * with huge pages if the system supports it.
      */
-    Container(uint64_t id, size_t container_size, bool metadata_only);
+    Container(uint64_t id, size_t container_size, bool metadata_only, bool huge_pages = false);
 
     /**
      * Destructor.
@@ -325,6 +468,18 @@ public:
                 bool is_indexed,
                 dedupv1::base::Compression* comp);
 
+    /**
+     * Compresses all uncompressed items of the container and repacks the item data
+     * so that the freed space is at the end of the container. The item offsets and
+     * item sizes are updated.
+     *
+     * Used to compress a container in the background before it is stored when the
+     * items have been added without a compression.
+     *
+     * @return true iff ok, otherwise an error has occurred
+     */
+    bool CompressItems(dedupv1::base::Compression* comp);
+
     /**
      * @return true iff ok, otherwise an error has occurred
      */
@@ -351,6 +506,19 @@ public:
 
     inline std::time_t commit_time() const;
 
+    inline ContainerChecksumType checksum_type() const;
+
+    /**
+     * Sets the type of the checksum that is calculated when the container is stored.
+     * Loading a container does not change the type as the stored checksum type is used for the verification.
+     */
+    inline void set_checksum_type(ContainerChecksumType checksum_type);
+
+    /**
+     * Layout of the item headers of the container. Loaded containers keep the stored format version.
+     */
+    inline ContainerFormatVersion format_version() const;
+
     /**
      * Unserialized metadata from the beginning section of the container
      * @return 0 means error, otherwise the length of the meta data
@@ -373,9 +541,12 @@ public:
      * @param offset offset inside the file to store the container
      * @param calculate_checksum calculates the checksum of the given container and
      * store the checksum besides the data.
+     * @param io_scheduler optional io scheduler the write is submitted to. If NULL,
+     * the container is written directly to the file.
      * @return true iff ok, otherwise an error has occurred
      */
-    bool StoreToFile(dedupv1::base::File* file, off_t offset, bool calculate_checksum);
+    bool StoreToFile(dedupv1::base::File* file, off_t offset, bool calculate_checksum,
+            dedupv1::base::IOScheduler* io_scheduler = NULL);
 
     /**
      * Loads the container from the given file at the given offset.
@@ -387,9 +558,12 @@ public:
      * @param offset
      * @param verify_checksum iff true, the checksum of the container on disk
      * should be verified.
+     * @param io_scheduler optional io scheduler the read is submitted to. If NULL,
+     * the container is read directly from the file.
      * @return true iff ok, otherwise an error has occurred
      */
-    bool LoadFromFile(dedupv1::base::File* file, off_t offset, bool verify_checksum);
+    bool LoadFromFile(dedupv1::base::File* file, off_t offset, bool verify_checksum,
+            dedupv1::base::IOScheduler* io_scheduler = NULL);
 
     bool CopyFrom(const Container& container, bool copyId = false);
 
@@ -426,6 +600,24 @@ public:
                      uint32_t offset,
                      uint32_t dest_size) const;
 
+    /**
+     * Copies the raw (uncompressed) data of the given container item from a buffer
+     * that only contains the on-disk data of the item. This allows to read an item
+     * without loading the complete container.
+     *
+     * @param item
+     * @param item_buffer on-disk data of the item (item_size bytes starting at the item offset)
+     * @param dest
+     * @param offset offset of the data to copy within the container item
+     * @param dest_size
+     * @return true iff ok, otherwise an error has occurred
+     */
+    static bool CopyRawItemData(const ContainerItem* item,
+                                const byte* item_buffer,
+                                void* dest,
+                                uint32_t offset,
+                                uint32_t dest_size);
+
     /**
      * Searches for an item with the given fingerprint in the container.
      *
@@ -454,6 +646,26 @@ public:
      */
     bool MergeContainer(const Container& container1, const Container& container2);
 
+    /**
+     * Checks if the items of both containers fit into this container.
+     * The size of an item changes if its item header is converted to the format of this container.
+     *
+     * @param container1
+     * @param container2
+     * @return true iff MergeContainer would succeed, false if the merged items do not fit, or
+     * an unset option if an error occurred
+     */
+    dedupv1::base::Option<bool> CanMergeContainer(const Container& container1, const Container& container2) const;
+
+    /**
+     * Returns the size of the item after it has been copied into this container.
+     *
+     * @param parent_container container of the item
+     * @param item
+     * @return size of the copied item or an unset option if an error occurred
+     */
+    dedupv1::base::Option<size_t> GetCopiedItemSize(const Container& parent_container, const ContainerItem& item) const;
+
     /**
      * Checks if the container has the given id as primary or secondary id.
      *
@@ -467,6 +679,11 @@ public:
     inline bool is_stored() const;
 
     inline bool is_metadata_only() const;
+
+    /**
+     * returns true iff the data buffer has been mapped instead of being allocated on the heap
+     */
+    inline bool has_mapped_data() const;
 };
 
 uint32_t Container::item_count() const {
@@ -521,6 +738,10 @@ inline uint64_t ContainerItem::original_id() const {
     return this->original_id_;
 }
 
+ContainerFormatVersion ContainerItem::format_version() const {
+    return static_cast<ContainerFormatVersion>(this->format_version_);
+}
+
 std::vector<ContainerItem*>& Container::items() {
     return this->items_;
 }
@@ -557,6 +778,18 @@ std::time_t Container::commit_time() const {
     return this->commit_time_;
 }
 
+ContainerChecksumType Container::checksum_type() const {
+    return this->checksum_type_;
+}
+
+void Container::set_checksum_type(ContainerChecksumType checksum_type) {
+    this->checksum_type_ = checksum_type;
+}
+
+ContainerFormatVersion Container::format_version() const {
+    return this->format_version_;
+}
+
 bool Container::is_stored() const {
     return this->stored_;
 }
@@ -565,10 +798,23 @@ bool Container::is_metadata_only() const {
     return this->metaDataOnly_;
 }
 
+bool Container::has_mapped_data() const {
+    return this->data_mapped_size_ > 0;
+}
+
 byte* Container::mutable_data() {
     return this->data_;
 }
 
+uint64_t Container::GetKeyPrefix(const void* key, size_t key_size) {
+    const byte* k = static_cast<const byte*>(key);
+    uint64_t prefix = static_cast<uint64_t>(0xFF - key_size) << 56;
+    for (size_t i = 0; i < 7 && i < key_size; i++) {
+        prefix |= static_cast<uint64_t>(k[i]) << (48 - (8 * i));
+    }
+    return prefix;
+}
+
 }
 }
 
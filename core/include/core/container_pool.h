@@ -0,0 +1,217 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef CONTAINER_POOL_H__
+#define CONTAINER_POOL_H__
+
+#include <core/dedup.h>
+#include <core/container.h>
+
+#include <tbb/spin_mutex.h>
+#include <tbb/atomic.h>
+
+#include <vector>
+#include <string>
+
+namespace dedupv1 {
+namespace chunkstore {
+
+/**
+ * Pool of reusable containers.
+ *
+ * Reading a container into a fresh Container object allocates a container size data buffer and
+ * all container items. The pool keeps a bounded number of released containers and hands them out
+ * again (see Container::Reuse), so that the buffers and items are only allocated once.
+ * The data buffers can be backed by huge pages.
+ *
+ * A container from the pool contains the data of its former use. It should only be used
+ * to load a container, not to build a new container.
+ *
+ * The pool is thread-safe.
+ */
+class ContainerPool {
+        DISALLOW_COPY_AND_ASSIGN(ContainerPool);
+    public:
+        /**
+         * Default maximal number of pooled containers per kind (full and meta data only)
+         */
+        static const uint32_t kDefaultSize = 8;
+
+        /**
+         * Statistics about the container pool
+         */
+        class Statistics {
+            public:
+                Statistics();
+
+                /**
+                 * number of acquired containers
+                 */
+                tbb::atomic<uint64_t> acquires_;
+
+                /**
+                 * number of acquired containers that have been taken from the pool
+                 */
+                tbb::atomic<uint64_t> reuses_;
+
+                /**
+                 * number of newly allocated containers
+                 */
+                tbb::atomic<uint64_t> allocations_;
+
+                /**
+                 * number of newly allocated containers with a mapped data buffer
+                 */
+                tbb::atomic<uint64_t> mapped_allocations_;
+
+                /**
+                 * number of released containers
+                 */
+                tbb::atomic<uint64_t> releases_;
+
+                /**
+                 * number of released containers that have been freed because the pool was full
+                 */
+                tbb::atomic<uint64_t> discards_;
+        };
+    private:
+        Statistics stats_;
+
+        /**
+         * container size of all pooled containers
+         */
+        size_t container_size_;
+
+        /**
+         * maximal number of pooled containers per kind
+         */
+        uint32_t size_;
+
+        /**
+         * iff true, the data buffers of new containers are backed by huge pages
+         */
+        bool huge_pages_;
+
+        bool started_;
+
+        /**
+         * free (non meta data only) containers
+         */
+        std::vector<Container*> free_containers_;
+
+        /**
+         * free meta data only containers
+         */
+        std::vector<Container*> free_metadata_containers_;
+
+        /**
+         * protects the free lists
+         */
+        tbb::spin_mutex lock_;
+    public:
+        /**
+         * Constructor
+         */
+        ContainerPool();
+
+        /**
+         * Destructor. Frees all pooled containers.
+         */
+        ~ContainerPool();
+
+        /**
+         * Configures the pool.
+         *
+         * Available options:
+         * - size: uint32_t, maximal number of pooled containers per kind. 0 disables the pooling.
+         * - huge-pages: Boolean
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool SetOption(const std::string& option_name, const std::string& option);
+
+        /**
+         * Starts the pool.
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Start(size_t container_size);
+
+        /**
+         * Returns a container with the given id. The caller has to release the
+         * container via Release.
+         *
+         * @return the container or NULL if an error occurred
+         */
+        Container* Acquire(uint64_t id, bool metadata_only);
+
+        /**
+         * Returns a container to the pool. If the pool is full, the container is freed.
+         * The container may also be a container that has not been acquired from the pool.
+         */
+        void Release(Container* container);
+
+        /**
+         * returns the number of pooled containers
+         */
+        size_t GetFreeCount();
+
+        /**
+         * returns statistics about the pool as JSON string
+         */
+        std::string PrintStatistics();
+
+        inline bool is_started() const {
+            return started_;
+        }
+};
+
+/**
+ * Acquires a container from a container pool and releases it at the end of the scope.
+ */
+class ScopedPoolContainer {
+        DISALLOW_COPY_AND_ASSIGN(ScopedPoolContainer);
+
+        ContainerPool* pool_;
+        Container* container_;
+    public:
+        /**
+         * Constructor. Get() returns NULL if the container could not be acquired.
+         */
+        ScopedPoolContainer(ContainerPool* pool, uint64_t id, bool metadata_only);
+
+        ~ScopedPoolContainer();
+
+        inline Container* Get() {
+            return container_;
+        }
+
+        inline Container* operator->() {
+            return container_;
+        }
+
+        inline Container& operator*() {
+            return *container_;
+        }
+};
+
+}
+}
+
+#endif  // CONTAINER_POOL_H__
@@ -28,14 +28,24 @@
 #include <core/container.h>
 #include <core/container_storage_bg.h>
 #include <core/container_storage_cache.h>
+#include <core/container_storage_item_table.h>
+#include <core/container_storage_address_table.h>
+#include <core/container_pool.h>
+#include <core/container_storage_dictionary.h>
+#include <core/container_storage_adaptive_compression.h>
+#include <core/container_storage_group_sync.h>
 #include <core/container_storage_write_cache.h>
 #include <core/container_storage_alloc.h>
+#include <core/container_storage_tiering.h>
+#include <core/container_summary_log.h>
 #include <base/fileutil.h>
+#include <base/io_scheduler.h>
 #include <base/compress.h>
 #include <base/cache_strategy.h>
 #include <base/locks.h>
 #include <base/index.h>
 #include <base/thread.h>
+#include <base/threadpool.h>
 #include <base/handover_store.h>
 #include <base/profile.h>
 #include <base/barrier.h>
@@ -69,6 +79,7 @@ class ContainerStorageReadCache;
 class ContainerStorageWriteCache;
 
 class ContainerStorageMetadataCache;
+class ContainerMergeRequest;
 
 /**
  * Cache state stores the commit state of container ids.
@@ -179,6 +190,21 @@ public:
 
     static const uint64_t kSuperBlockSize = 4096;
 
+    /**
+     * Default maximal number of containers that are prefetched concurrently
+     */
+    static const uint32_t kDefaultMaxPrefetchCount = 8;
+
+    /**
+     * Default number of partial reads of a container after which the complete container is loaded
+     */
+    static const uint32_t kDefaultPartialReadFullLoadCount = 4;
+
+    /**
+     * Maximal gap between two items that are read with a single partial read
+     */
+    static const uint32_t kPartialReadMaxGap = 64 * 1024;
+
     /**
      * Runtime states of the container storage
      */
@@ -197,7 +223,13 @@ public:
 
         void Init(const std::string& f);
 
-        bool Start(dedupv1::base::File* file, bool is_new);
+        /**
+         * Starts the container file.
+         * @param file opened container file
+         * @param is_new true iff the file has been created
+         * @param group_sync iff true, the container writes are made durable by a group sync
+         */
+        bool Start(dedupv1::base::File* file, bool is_new, bool group_sync);
 
         const std::string filename() const {
             return filename_;
@@ -227,17 +259,56 @@ public:
             file_size_ = fs;
         }
 
+        /**
+         * returns true iff the file belongs to the fast tier
+         */
+        bool fast_tier() const {
+            return fast_tier_;
+        }
+
+        void set_fast_tier(bool fast_tier) {
+            fast_tier_ = fast_tier;
+        }
+
+        /**
+         * returns the checksum type of the containers written to the file
+         */
+        ContainerChecksumType checksum_type() const {
+            return checksum_type_;
+        }
+
+        void set_checksum_type(ContainerChecksumType checksum_type) {
+            checksum_type_ = checksum_type;
+        }
+
         dedupv1::base::MutexLock* lock() {
             return lock_;
         }
+
+        /**
+         * returns the group sync of the file or NULL if the file is opened with O_SYNC
+         */
+        ContainerStorageGroupSync* group_sync() {
+            return group_sync_;
+        }
 private:
         std::string filename_;
         dedupv1::base::File* file_;
 
         dedupv1::base::MutexLock* lock_;
 
+        ContainerStorageGroupSync* group_sync_;
+
         uint64_t file_size_;
 
+        /**
+         * iff true, the file belongs to the fast tier (e.g. SSD), otherwise it
+         * belongs to the capacity tier (e.g. HDD)
+         */
+        bool fast_tier_;
+
+        ContainerChecksumType checksum_type_;
+
         bool new_;
 
         dedupv1::base::UUID uuid_;
@@ -264,6 +335,63 @@ public:
         tbb::atomic<uint32_t> container_lock_free_;
         tbb::atomic<uint32_t> container_lock_busy_;
 
+        /**
+         * Number of batched read requests
+         */
+        tbb::atomic<uint64_t> batch_reads_;
+
+        /**
+         * Number of containers resolved for batched read requests.
+         */
+        tbb::atomic<uint64_t> batch_read_containers_;
+
+        /**
+         * Number of prefetch hints
+         */
+        tbb::atomic<uint64_t> prefetch_requests_;
+
+        /**
+         * Number of containers loaded into the read cache because of a prefetch hint
+         */
+        tbb::atomic<uint64_t> prefetch_loads_;
+
+        /**
+         * Number of prefetch hints that have been ignored because the container was
+         * already in memory or already being prefetched.
+         */
+        tbb::atomic<uint64_t> prefetch_ignored_;
+
+        /**
+         * Number of read-cache misses answered by reading only the needed items
+         */
+        tbb::atomic<uint64_t> partial_reads_;
+
+        /**
+         * Number of bytes read by partial reads (without the meta data)
+         */
+        tbb::atomic<uint64_t> partial_read_bytes_;
+
+        /**
+         * Number of meta data loads for partial reads
+         */
+        tbb::atomic<uint64_t> partial_read_metadata_loads_;
+
+        /**
+         * Number of read-cache misses for which a partial read was possible, but
+         * the complete container has been loaded.
+         */
+        tbb::atomic<uint64_t> partial_read_full_loads_;
+
+        /**
+         * Number of containers that have been compressed on commit
+         */
+        tbb::atomic<uint64_t> background_compressed_container_;
+
+        /**
+         * Number of bytes saved by compressing containers on commit
+         */
+        tbb::atomic<uint64_t> background_compression_saved_bytes_;
+
         dedupv1::base::Profile pre_commit_time_;
         dedupv1::base::Profile total_write_time_;
         dedupv1::base::Profile total_read_time_;
@@ -272,6 +400,7 @@ public:
         dedupv1::base::Profile total_read_container_time_;
         dedupv1::base::Profile is_committed_time_;
         dedupv1::base::Profile container_write_time_;
+        dedupv1::base::Profile background_compression_time_;
         dedupv1::base::Profile total_file_lock_time_;
         dedupv1::base::Profile total_file_load_time_;
 
@@ -280,6 +409,7 @@ public:
         tbb::atomic<uint64_t> readed_container_;
         tbb::atomic<uint64_t> moved_container_;
         tbb::atomic<uint64_t> merged_container_;
+        tbb::atomic<uint64_t> pipelined_merges_;
         tbb::atomic<uint64_t> failed_container_;
         tbb::atomic<uint64_t> deleted_container_;
 
@@ -334,6 +464,46 @@ public:
      */
     ContainerStorageMetadataCache meta_data_cache_;
 
+    /**
+     * iff true, the addresses of the meta data index are also held in the in-memory
+     * address table and all address lookups are answered from the table.
+     */
+    bool address_table_enabled_;
+
+    /**
+     * In-memory copy of the meta data index. Only used if address_table_enabled_ is set.
+     * Updated together with the meta data index while the meta data lock is held.
+     */
+    ContainerStorageAddressTable address_table_;
+
+    /**
+     * iff true, containers are moved between the fast and the capacity tier
+     * of the container files.
+     */
+    bool tiering_enabled_;
+
+    /**
+     * Hot/cold tiering. Only used if tiering_enabled_ is set.
+     */
+    ContainerStorageTiering tiering_;
+
+    /**
+     * iff true, batches of container merges are executed by the merge pipeline
+     * so that the reads, the merging, and the writes of different merges overlap.
+     */
+    bool merge_pipeline_enabled_;
+
+    /**
+     * iff true, a summary record is appended to the summary log of the container file
+     * whenever a container is written.
+     */
+    bool summary_log_enabled_;
+
+    /**
+     * Summary logs of the container files. Empty if summary_log_enabled_ is not set.
+     */
+    std::vector<ContainerSummaryLog*> summary_logs_;
+
     /**
      * Global lock used to secure central shared data structured like the read cache entry (
      * not the read cache containers itself).
@@ -400,6 +570,60 @@ public:
      */
     dedupv1::base::Compression* compression_;
 
+    /**
+     * iff true, the items are added uncompressed to the write containers and the
+     * containers are compressed when they are committed (usually by the background committer)
+     * so that the compression time is not part of the write latency.
+     */
+    bool background_compression_;
+
+    /**
+     * zstd compression level
+     */
+    int compression_level_;
+
+    /**
+     * iff true, the compression level has been configured. The zstd compression
+     * is then recreated with compression_level_ in Start.
+     */
+    bool compression_level_set_;
+
+    /**
+     * iff true, a zstd dictionary is trained on sampled chunks and used for the compression
+     * of new items.
+     */
+    bool compression_dictionary_enabled_;
+
+    /**
+     * Compression dictionary. The dictionary is always started so that a persisted dictionary
+     * is registered for decompression. The training and the compression with the dictionary
+     * are only done if compression_dictionary_enabled_ is set.
+     */
+    ContainerStorageCompressionDictionary compression_dictionary_;
+
+    /**
+     * iff true, the compression of a chunk is skipped if the chunk (or its stream)
+     * is estimated to be incompressible
+     */
+    bool adaptive_compression_enabled_;
+
+    /**
+     * Adaptive compression. Only used if adaptive_compression_enabled_ is set.
+     */
+    ContainerStorageAdaptiveCompression adaptive_compression_;
+
+    /**
+     * iff true, the container files are opened without O_SYNC and the container
+     * writes are made durable by a group fdatasync shared by all concurrent writers of a file.
+     */
+    bool group_commit_;
+
+    /**
+     * returns the compression that should be used to compress new items or NULL
+     * if no compression is used
+     */
+    dedupv1::base::Compression* GetCompression();
+
     /**
      * Thread to commit container in the background.
      * The pointer is only set when the option background_commit is set
@@ -444,6 +668,63 @@ public:
 
     bool calculate_container_checksum_;
 
+    /**
+     * Checksum type of newly created container files. Existing files keep the type
+     * stored in their super block.
+     */
+    ContainerChecksumType checksum_type_;
+
+    /**
+     * Optional scheduler that orders and merges the container reads and writes per
+     * container file. NULL if the containers are accessed directly.
+     */
+    dedupv1::base::IOScheduler* io_scheduler_;
+
+    /**
+     * Thread pool used to load the containers of a batched read in parallel.
+     * NULL if the system has no thread pool
+     */
+    dedupv1::base::Threadpool* tp_;
+
+    /**
+     * Set of container ids that are currently prefetched in the background.
+     */
+    tbb::concurrent_hash_map<uint64_t, bool> prefetch_set_;
+
+    /**
+     * Maximal number of containers that are prefetched concurrently.
+     */
+    uint32_t max_prefetch_count_;
+
+    /**
+     * iff true, a read-cache miss might be answered by reading only the needed items
+     * instead of the complete container. Disabled in Start if container checksums are
+     * calculated as the checksum can only be verified over the complete container.
+     */
+    bool partial_read_;
+
+    /**
+     * A partial read is only done if the data to read (including the meta data if the
+     * item table is not cached) is less than this ratio of the container size.
+     */
+    double partial_read_max_ratio_;
+
+    /**
+     * Number of partial reads of a container after which the complete container is loaded into the read cache
+     * instead as the container is obviously used often.
+     */
+    uint32_t partial_read_full_load_count_;
+
+    /**
+     * Item tables of containers used for partial reads
+     */
+    ContainerStorageItemTableCache item_table_cache_;
+
+    /**
+     * Pool of containers used to load containers from disk
+     */
+    ContainerPool container_pool_;
+
     bool had_been_started_;
 
     /**
@@ -486,6 +767,40 @@ public:
      */
     bool MarkContainerCommitAsFailed(Container* container);
 
+    /**
+     * Looks up the (not redirected) address of the given container id in the address table or,
+     * if the address table is not used, in the meta data index. Both sources return the same address
+     * including the log id.
+     *
+     * @param address_data may be NULL
+     */
+    dedupv1::base::lookup_result LookupAddressData(uint64_t container_id, ContainerStorageAddressData* address_data);
+
+    /**
+     * Appends the summary of the given container to the summary log of the file
+     * the container has been written to. A failure is only reported as warning because
+     * the summary log is optional for all readers.
+     *
+     * @param log_id id of the event that stored the container at the address
+     */
+    void AppendContainerSummary(const Container& container, const ContainerStorageAddressData& address, int64_t log_id);
+
+    /**
+     * Stores the address of the given container id in the meta data index and the address table.
+     * The caller should hold the meta data lock.
+     *
+     * @return true iff ok, otherwise an error has occurred
+     */
+    bool PutAddressData(uint64_t container_id, const ContainerStorageAddressData& address_data);
+
+    /**
+     * Deletes the address of the given container id from the meta data index and the address table.
+     * The caller should hold the meta data lock.
+     *
+     * @return true iff ok, otherwise an error has occurred
+     */
+    bool DeleteAddressData(uint64_t container_id);
+
     dedupv1::base::lookup_result ReadContainerLocked(Container* container,
                                                      const ContainerStorageAddressData& container_address);
 
@@ -502,6 +817,39 @@ public:
      */
     bool WriteContainer(Container* container, const ContainerStorageAddressData& container_address);
 
+    /**
+     * First stage of a container merge: Checks both containers, removes them from the
+     * read cache, adds them to the in-move set and reads them. The container locks are only
+     * held during this stage. The in-move set membership is held until the merge is committed.
+     *
+     * @return true iff ok, otherwise an error has occurred
+     */
+    bool ReadMergeContainers(ContainerMergeRequest* request);
+
+    /**
+     * Second stage of a container merge: Merges the containers, allocates the new
+     * address and prepares the merge event.
+     *
+     * @return true iff ok, otherwise an error has occurred
+     */
+    bool MergeContainers(ContainerMergeRequest* request);
+
+    /**
+     * Third stage of a container merge: Writes the merged container and commits the
+     * merge event.
+     *
+     * @return true iff ok, otherwise an error has occurred
+     */
+    bool WriteMergedContainer(ContainerMergeRequest* request);
+
+    /**
+     * Compresses the items of a container that has been filled without compression
+     * (background compression).
+     *
+     * @return true iff ok, otherwise an error has occurred
+     */
+    bool CompressContainer(Container* container);
+
     /**
      * Writes the given container (directly) to disk. No locks must be hold at the call.
      *
@@ -596,6 +944,41 @@ public:
                                                     uint32_t size,
                                                     bool* found);
 
+    /**
+     * Reads all given requests from the given container.
+     * @return true iff ok. false if an error occurred or if an item has not been found.
+     */
+    bool ReadRequestsInContainer(const Container& container,
+                                 const std::vector<StorageReadRequest*>& requests);
+
+    /**
+     * Reads all given requests from the container with the given address.
+     * The container is resolved once: either from the write cache, the read cache or from disk.
+     *
+     * @return true iff ok. false if an error occurred or if an item has not been found.
+     */
+    bool ReadContainerRequests(uint64_t address,
+                               const std::vector<StorageReadRequest*>* requests);
+
+    /**
+     * Loads the container with the given address into the read cache if it is
+     * neither in the write cache nor in the read cache. Executed by the thread pool
+     * for prefetch hints.
+     *
+     * @return true iff ok, otherwise an error has occurred
+     */
+    bool PrefetchContainer(uint64_t address);
+
+    /**
+     * Reads the given requests by reading only the needed items from disk. The item table of the container
+     * is taken from the item table cache or the meta data of the container is loaded.
+     *
+     * @return true if the requests have been read, false if the complete container should be loaded
+     * instead. An unset option is returned if an error occurred.
+     */
+    dedupv1::base::Option<bool> ReadContainerRequestsPartial(uint64_t address,
+                                                             const std::vector<StorageReadRequest*>& requests);
+
     /**
      * Performs the deletion of items from the given container
      * The method assumes that
@@ -634,6 +1017,7 @@ public:
      * - container-size: StorageUnit
      * - size: StorageUnit
      * - checksum: Boolean
+     * - checksum-type: String (adler32, crc32c)
      * - preallocate: Boolean
      * - read-cache-size
      * - write-container-count
@@ -643,6 +1027,7 @@ public:
      * - filename: String
      * - filename.clear: Boolean
      * - filesize: StorageUnit
+     * - filetier: fast or capacity
      * - meta-data: String
      * - meta-data.*
      * - write-cache.*
@@ -651,6 +1036,27 @@ public:
      * - gc.*: String
      * - alloc: String
      * - alloc.*: String
+     * - io-scheduler: Boolean, one I/O submission thread per container file (see IOScheduler)
+     * - io-scheduler.*: String
+     * - max-prefetch-count: uint32_t
+     * - partial-read: Boolean, ignored if checksum is set
+     * - partial-read.max-ratio: Double
+     * - partial-read.full-load-count: uint32_t
+     * - partial-read.item-table-size: StorageUnit
+     * - container-pool.*
+     * - compression: deflate, bz2, snappy, lz4, zstd, or none
+     * - compression.level: int (zstd only)
+     * - compression.dictionary: Boolean (zstd only). A persisted dictionary is restored for reads even if false.
+     * - compression.dictionary.*
+     * - background-compression: Boolean
+     * - adaptive-compression: Boolean
+     * - adaptive-compression.*
+     * - group-commit: Boolean
+     * - address-table: Boolean
+     * - tiering: Boolean
+     * - tiering.*
+     * - merge-pipeline: Boolean
+     * - summary-log: Boolean
      *
      * @return true iff ok, otherwise an error has occurred
      */
@@ -691,6 +1097,26 @@ public:
             uint64_t* address,
             dedupv1::base::ErrorContext* ec);
 
+        /**
+         * Writes a new chunk of the given stream. The stream id is used by the
+         * adaptive compression to learn the compressibility of the stream.
+         *
+         * @param stream_id stream of the chunk or Storage::NO_STREAM_ID
+         * @param key
+         * @param key_size
+         * @param data
+         * @param data_size
+         * @param address
+         * @param ec error context (can be NULL)
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool WriteNewInStream(uint32_t stream_id,
+            const void* key, size_t key_size,
+            const void* data, size_t data_size,
+            bool is_indexed,
+            uint64_t* address,
+            dedupv1::base::ErrorContext* ec);
+
     /**
      *
      * Note: In contrast to ReadInContainer and other methods, the Read method should report an error, if the
@@ -711,6 +1137,24 @@ public:
                                                  uint32_t size,
                                                  dedupv1::base::ErrorContext* ec);
 
+    /**
+     * Reads all given chunks. The requests are grouped by the container address so
+     * that each container is checked in the write cache, the read cache and, if necessary, loaded
+     * from disk only once. The containers of different groups are read in parallel
+     * using the system thread pool.
+     *
+     * @return true iff ok, otherwise an error has occurred
+     */
+    virtual bool ReadBatch(const std::vector<StorageReadRequest*>& requests,
+                           dedupv1::base::ErrorContext* ec);
+
+    /**
+     * Loads the container with the given address asynchronously into the read cache.
+     * The hint is ignored if the system has no thread pool, if the container is
+     * already in memory or if already too many containers are prefetched.
+     */
+    virtual dedupv1::base::Option<bool> Prefetch(uint64_t address, dedupv1::base::ErrorContext* ec);
+
     /**
      *
      * @param address
@@ -786,10 +1230,13 @@ public:
      * Do not call this method when you hold a container or a meta data lock.
      *
      * @param container
+     * @param hint hint how the read should interact with the read cache. Callers that
+     * read each container only once (e.g. imports, gc) should use READ_CACHE_HINT_NO_POLLUTE.
      * @return
      */
     dedupv1::base::lookup_result ReadContainerWithCache(
-        Container* container);
+        Container* container,
+        read_cache_hint hint = READ_CACHE_HINT_DEFAULT);
 
     uint64_t GetLastGivenContainerId();
 
@@ -873,6 +1320,21 @@ public:
      */
     virtual bool TryMergeContainer(uint64_t container_id_1, uint64_t container_id_2, bool* aborted);
 
+    /**
+     * Merges a batch of container pairs. If the merge pipeline is enabled, the merges
+     * are executed as a three stage pipeline (read, merge, write) on the threadpool so that
+     * the I/O of consecutive merges overlaps. Otherwise TryMergeContainer is called for each pair.
+     *
+     * The pairs must be independent, e.g. no container id is allowed to be used in more
+     * than one pair. The same restrictions as for TryMergeContainer apply.
+     *
+     * @param merge_list list of container id pairs to merge
+     * @param aborted_list is set to the aborted state of each merge
+     * @return true iff ok, otherwise an error has occurred
+     */
+    virtual bool TryMergeContainers(const std::vector<std::pair<uint64_t, uint64_t> >& merge_list,
+            std::vector<bool>* aborted_list);
+
     /**
      * Note: The container has to be committed, however, the can be
      * stored in the read cache.
@@ -887,6 +1349,40 @@ public:
      */
     virtual bool TryDeleteContainer(uint64_t container_id, bool* aborted);
 
+    /**
+     * Moves a committed container to a file of the given tier. The move is aborted
+     * if the container is not committed, is already stored on the given tier, is currently
+     * locked, or if the tier has no free place.
+     *
+     * The container id must be the primary id of the container.
+     *
+     * @param container_id
+     * @param fast_tier iff true, the container is moved to the fast tier, otherwise to the capacity tier
+     * @param aborted out parameter that is set to true if the move has been aborted
+     * @return true iff ok, otherwise an error has occurred
+     */
+    virtual bool TryMoveContainer(uint64_t container_id, bool fast_tier, bool* aborted);
+
+    /**
+     * returns true iff the given address is stored in a file of the fast tier
+     */
+    bool IsFastTierAddress(const ContainerStorageAddressData& address) const;
+
+    /**
+     * returns the summary log of the given container file or NULL if summary logs are
+     * not enabled.
+     */
+    ContainerSummaryLog* summary_log(uint32_t file_index);
+
+    /**
+     * Checks if the given summary record describes the current state of the container,
+     * i.e. the container is still stored at the address of the record and has not been
+     * changed since.
+     *
+     * @return true iff the record is current, false if it is stale. The option is not set if an error occurred.
+     */
+    dedupv1::base::Option<bool> IsCurrentContainerSummary(const ContainerSummaryData& summary);
+
     /**
      * Called in unknown (for the container storage) intervals when the system
      * (more specific: the current IdleDetector) is idle. The container storage
@@ -962,6 +1458,11 @@ public:
      */
     inline ContainerStorageReadCache* GetReadCache();
 
+    /**
+     * Returns the pool of containers that should be used to load containers
+     */
+    inline ContainerPool* container_pool();
+
     /**
      * returns the container gc.
      * @return
@@ -974,6 +1475,11 @@ public:
      */
     inline ContainerStorageAllocator* allocator();
 
+    /**
+     * returns the tiering or NULL if tiering is not enabled
+     */
+    inline ContainerStorageTiering* tiering();
+
     inline bool is_preallocated() const;
 
     inline uint64_t size() const;
@@ -1025,11 +1531,14 @@ public:
     virtual uint64_t GetActiveStorageDataSize();
 
     friend class ContainerStorageBackgroundCommitter;
+    friend class ContainerStoragePrefetchTask;
 
 #ifdef DEDUPV1_CORE_TEST
     void ClearData();
 #endif
     FRIEND_TEST(ContainerStorageTest, MergeWithSameContainerLock);
+    FRIEND_TEST(ContainerStorageTest, PartialRead);
+    FRIEND_TEST(ContainerStorageTest, PartialReadWithChecksum);
 };
 
 const ContainerStorage::ContainerFile& ContainerStorage::file(int i) const {
@@ -1076,10 +1585,21 @@ ContainerStorageReadCache*  ContainerStorage::GetReadCache() {
     return &this->cache_;
 }
 
+ContainerPool* ContainerStorage::container_pool() {
+    return &this->container_pool_;
+}
+
 ContainerStorageAllocator* ContainerStorage::allocator() {
     return this->allocator_;
 }
 
+ContainerStorageTiering* ContainerStorage::tiering() {
+    if (!tiering_enabled_) {
+        return NULL;
+    }
+    return &this->tiering_;
+}
+
 ContainerStorageBackgroundCommitter* ContainerStorage::background_committer() {
     return &this->background_committer_;
 }
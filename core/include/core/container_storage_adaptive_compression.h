@@ -0,0 +1,234 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef CONTAINER_STORAGE_ADAPTIVE_COMPRESSION_H__
+#define CONTAINER_STORAGE_ADAPTIVE_COMPRESSION_H__
+
+#include <tbb/atomic.h>
+#include <tbb/concurrent_hash_map.h>
+
+#include <core/dedup.h>
+
+#include <string>
+
+namespace dedupv1 {
+namespace chunkstore {
+
+/**
+ * Decides per chunk if the container storage should compress a chunk.
+ *
+ * Compressing incompressible data (e.g. encrypted or already compressed data) wastes
+ * CPU time as the compressed result is discarded afterwards. The adaptive compression
+ * estimates the compressibility of a chunk by the byte entropy of a sample of the chunk
+ * before the compression is tried.
+ *
+ * In addition, the outcome of the decisions is observed per stream (e.g. per volume).
+ * If the chunks of a stream consistently do not compress, the compression is switched off
+ * for the stream. From time to time, a few chunks of a disabled stream are probed again to
+ * detect a change of the data.
+ *
+ * The class is thread-safe.
+ */
+class ContainerStorageAdaptiveCompression {
+        DISALLOW_COPY_AND_ASSIGN(ContainerStorageAdaptiveCompression);
+    public:
+        /**
+         * Default entropy (in bits per byte) above which a chunk is considered incompressible
+         */
+        static const double kDefaultEntropyThreshold;
+
+        /**
+         * Default number of sampled bytes per chunk for the entropy estimation
+         */
+        static const size_t kDefaultSampleSize = 2048;
+
+        /**
+         * Default number of decisions after which the compressibility of a stream is evaluated
+         */
+        static const uint32_t kDefaultWindowSize = 64;
+
+        /**
+         * Default number of chunks for which the compression is switched off if a stream does not compress
+         */
+        static const uint32_t kDefaultSkipCount = 1024;
+
+        /**
+         * Default minimal fraction of chunks in a window that have to compress well so
+         * that the compression stays enabled for a stream.
+         */
+        static const double kDefaultMinGainRatio;
+
+        /**
+         * A chunk compresses well if the stored size is at most this fraction of the raw size
+         */
+        static const double kGoodCompressionRatio;
+
+        /**
+         * Statistics about the adaptive compression
+         */
+        class Statistics {
+            public:
+                Statistics();
+
+                /**
+                 * number of decisions
+                 */
+                tbb::atomic<uint64_t> decisions_;
+
+                /**
+                 * number of chunks that should be compressed
+                 */
+                tbb::atomic<uint64_t> compress_decisions_;
+
+                /**
+                 * number of chunks skipped because of a high estimated entropy
+                 */
+                tbb::atomic<uint64_t> entropy_skips_;
+
+                /**
+                 * number of chunks skipped because the compression is switched off for the stream
+                 */
+                tbb::atomic<uint64_t> stream_skips_;
+
+                /**
+                 * number of compressed chunks that compressed well
+                 */
+                tbb::atomic<uint64_t> good_compressions_;
+
+                /**
+                 * number of compressed chunks that did not compress well
+                 */
+                tbb::atomic<uint64_t> bad_compressions_;
+
+                /**
+                 * number of times the compression has been switched off for a stream
+                 */
+                tbb::atomic<uint64_t> stream_disables_;
+        };
+    private:
+        /**
+         * Compression state of a stream
+         */
+        class StreamState {
+            public:
+                StreamState();
+
+                /**
+                 * number of decisions in the current window
+                 */
+                uint32_t window_decisions_;
+
+                /**
+                 * number of chunks in the current window that compressed well
+                 */
+                uint32_t window_gains_;
+
+                /**
+                 * number of chunks that are still skipped before the stream is probed again
+                 */
+                uint32_t skip_count_;
+        };
+
+        Statistics stats_;
+
+        double entropy_threshold_;
+
+        size_t sample_size_;
+
+        uint32_t window_size_;
+
+        uint32_t skip_count_;
+
+        double min_gain_ratio_;
+
+        bool started_;
+
+        /**
+         * compression state per stream
+         */
+        tbb::concurrent_hash_map<uint32_t, StreamState> streams_;
+
+        /**
+         * Records the outcome of a decision of a stream and evaluates the window
+         */
+        void RecordOutcome(uint32_t stream_id, bool gain);
+    public:
+        /**
+         * Constructor
+         */
+        ContainerStorageAdaptiveCompression();
+
+        /**
+         * Configures the adaptive compression.
+         *
+         * Available options:
+         * - entropy-threshold: double, bits per byte
+         * - sample-size: StorageUnit
+         * - window-size: uint32_t
+         * - skip-count: uint32_t
+         * - min-gain-ratio: double
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool SetOption(const std::string& option_name, const std::string& option);
+
+        /**
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Start();
+
+        /**
+         * Returns true iff the given chunk of the given stream should be compressed.
+         *
+         * @param stream_id stream of the chunk or Storage::NO_STREAM_ID
+         */
+        bool ShouldCompress(uint32_t stream_id, const void* data, size_t data_size);
+
+        /**
+         * Reports the result of the compression of a chunk for which ShouldCompress returned true.
+         *
+         * @param stream_id stream of the chunk or Storage::NO_STREAM_ID
+         * @param raw_size size of the chunk
+         * @param stored_size size of the chunk in the container
+         */
+        void ReportCompression(uint32_t stream_id, size_t raw_size, size_t stored_size);
+
+        /**
+         * Estimates the byte entropy (in bits per byte) of the data based on evenly
+         * distributed samples.
+         *
+         * @param sample_size maximal number of sampled bytes
+         */
+        static double EstimateEntropy(const void* data, size_t data_size, size_t sample_size);
+
+        /**
+         * returns statistics about the adaptive compression as JSON string
+         */
+        std::string PrintStatistics();
+
+        inline bool is_started() const {
+            return started_;
+        }
+};
+
+}
+}
+
+#endif  // CONTAINER_STORAGE_ADAPTIVE_COMPRESSION_H__
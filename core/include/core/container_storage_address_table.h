@@ -0,0 +1,175 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef CONTAINER_STORAGE_ADDRESS_TABLE_H__
+#define CONTAINER_STORAGE_ADDRESS_TABLE_H__
+
+#include <core/dedup.h>
+#include <base/index.h>
+
+#include <tbb/spin_rw_mutex.h>
+#include <tbb/atomic.h>
+
+#include <vector>
+#include <string>
+
+#include "dedupv1.pb.h"
+
+namespace dedupv1 {
+namespace chunkstore {
+
+/**
+ * In-memory copy of the container storage meta data index.
+ *
+ * The table is a dense array indexed by the container id. Each entry stores either
+ * the file index and file offset of a primary container or the primary id of a secondary
+ * container together with the log id of the last change in 24 bytes. The table is rebuilt from the meta data index at startup and
+ * every change of the meta data index has to be applied to the table, too. After the start,
+ * the table is authoritative: A container id that is not in the table is also not in the
+ * meta data index.
+ *
+ * The table is thread-safe.
+ */
+class ContainerStorageAddressTable {
+        DISALLOW_COPY_AND_ASSIGN(ContainerStorageAddressTable);
+    public:
+        /**
+         * Statistics about the address table
+         */
+        class Statistics {
+            public:
+                Statistics();
+
+                tbb::atomic<uint64_t> lookup_count_;
+                tbb::atomic<uint64_t> update_count_;
+                tbb::atomic<uint64_t> delete_count_;
+        };
+    private:
+        /**
+         * Type of an address table entry
+         */
+        enum entry_type {
+            ENTRY_EMPTY = 0,
+            ENTRY_PRIMARY = 1,
+            ENTRY_SECONDARY = 2
+        };
+
+        /**
+         * Packed address of a single container id.
+         */
+        struct Entry {
+            /**
+             * file offset of a primary container or primary id of a secondary container
+             */
+            uint64_t value_;
+
+            /**
+             * log id of the last change of the address. 0 if the address has no log id.
+             */
+            uint64_t log_id_;
+
+            /**
+             * index of the container file. Only used for primary containers.
+             */
+            uint32_t file_index_;
+
+            /**
+             * type of the entry
+             */
+            uint32_t type_;
+        };
+
+        /**
+         * Entries by container id. Protected by lock_.
+         */
+        std::vector<Entry> entries_;
+
+        /**
+         * Number of non-empty entries. Protected by lock_.
+         */
+        uint64_t entry_count_;
+
+        tbb::spin_rw_mutex lock_;
+
+        bool started_;
+
+        Statistics stats_;
+    public:
+        /**
+         * Constructor
+         */
+        ContainerStorageAddressTable();
+
+        /**
+         * Loads all addresses of the meta data index into the table.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Start(dedupv1::base::PersistentIndex* meta_data_index);
+
+        /**
+         * Looks up the address of the given container id.
+         * The address is not redirected to the primary id.
+         *
+         * @param address_data the address is stored here if the container id is found. May be NULL.
+         * @return LOOKUP_FOUND if the container id has an address, LOOKUP_NOT_FOUND if not, LOOKUP_ERROR
+         * if an error occurred.
+         */
+        dedupv1::base::lookup_result Lookup(uint64_t container_id, ContainerStorageAddressData* address_data);
+
+        /**
+         * Sets the address of the given container id.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Update(uint64_t container_id, const ContainerStorageAddressData& address_data);
+
+        /**
+         * Removes the address of the given container id. It is not an error if the container id has
+         * no address.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Delete(uint64_t container_id);
+
+        /**
+         * returns the number of container ids with an address
+         */
+        uint64_t GetSize();
+
+        /**
+         * returns the number of bytes used by the table
+         */
+        uint64_t GetMemorySize();
+
+        /**
+         * returns statistics about the address table
+         */
+        std::string PrintStatistics();
+
+        inline bool is_started() const {
+            return started_;
+        }
+};
+
+}
+}
+
+#endif  // CONTAINER_STORAGE_ADDRESS_TABLE_H__
@@ -62,6 +62,26 @@ enum alloc_result {
     ALLOC_OK,
 };
 
+/**
+ * Storage tier of a container file
+ */
+enum storage_tier {
+    /**
+     * any file regardless of its tier
+     */
+    STORAGE_TIER_ANY,
+
+    /**
+     * fast tier, e.g. files on SSD
+     */
+    STORAGE_TIER_FAST,
+
+    /**
+     * capacity tier, e.g. files on HDD
+     */
+    STORAGE_TIER_CAPACITY
+};
+
 /**
  * The container storage allocator strategy
  * controls where to store new container data on disk.
@@ -102,6 +122,9 @@ class ContainerStorageAllocator : public dedupv1::StatisticProvider {
      * we want to get a new address for a merge or delete item operation. The reason for this
      * parameter is that an allocator might not give the last free container place to a newly
      * written container.
+     * @param tier preferred tier of the new address, e.g. the fast tier for new containers, the
+     * capacity tier for merged containers, and the current tier for a container that is rewritten
+     * after an item delete. Allocators that don't support tiering ignore the tier.
      * @param new_address out parameter that should be set to the address of
      * the container. If the call returns true, the address has to be set.
      * The address is ensured to be free for the container. If the container processing
@@ -113,6 +136,7 @@ class ContainerStorageAllocator : public dedupv1::StatisticProvider {
      */
     virtual enum alloc_result OnNewContainer(const Container& container,
             bool is_new_container,
+            enum storage_tier tier,
             ContainerStorageAddressData* new_address) = 0;
 
     /**
@@ -135,6 +159,28 @@ class ContainerStorageAllocator : public dedupv1::StatisticProvider {
      */
     virtual bool OnAbortContainer(const Container& container, const ContainerStorageAddressData& address) = 0;
 
+    /**
+     * Called when a committed container should be moved to a file of the given tier.
+     * The container keeps its old address until the move is committed.
+     *
+     * The default implementation doesn't support tiering and returns ALLOC_ERROR.
+     *
+     * @param container reference to the container that should be moved
+     * @param tier tier of the new address
+     * @param new_address out parameter that is set to the new address of the container
+     * @return
+     */
+    virtual enum alloc_result OnMoveContainer(const Container& container,
+            enum storage_tier tier,
+            ContainerStorageAddressData* new_address);
+
+    /**
+     * returns the fill ratio of the files of the given tier. If the allocator
+     * doesn't support tiering or if there are no files of the tier, an
+     * invalid option is returned.
+     */
+    virtual dedupv1::base::Option<double> GetTierFillRatio(enum storage_tier tier);
+
     /**
      * Configures the allocator. The default implementation logs and
      * error (unknown option) and returns false.
@@ -329,6 +375,7 @@ class MemoryBitmapContainerStorageAllocator : public ContainerStorageAllocator {
                 ContainerFile() {
                     bitmap_ = NULL;
                     last_free_pos_ = 0;
+                    fast_tier_ = false;
                 }
 
                 /**
@@ -343,6 +390,10 @@ class MemoryBitmapContainerStorageAllocator : public ContainerStorageAllocator {
                  */
                 size_t last_free_pos_;
 
+                /**
+                 * true iff the file belongs to the fast tier
+                 */
+                bool fast_tier_;
         };
 
         /**
@@ -402,6 +453,24 @@ class MemoryBitmapContainerStorageAllocator : public ContainerStorageAllocator {
          */
         int next_file_;
 
+        /**
+         * Number of containers that have been allocated on next_file_ in the current run
+         */
+        uint32_t next_file_run_;
+
+        /**
+         * Number of consecutive containers that are allocated on the same file before the
+         * next file is used. Consecutive containers of a file are usually adjacent, so that
+         * containers committed together can be written sequentially.
+         */
+        uint32_t file_run_length_;
+
+        /**
+         * true iff there are files of the fast and of the capacity tier.
+         * New containers are then allocated on the fast tier if possible.
+         */
+        bool tiered_;
+
         dedupv1::log::Log* log_;
 
         /**
@@ -449,6 +518,18 @@ class MemoryBitmapContainerStorageAllocator : public ContainerStorageAllocator {
          */
         int GetNextFile();
 
+        /**
+         * Searches a free address in a file of the given tier starting with the
+         * next file.
+         *
+         * @param is_new_container see OnNewContainer
+         * @param tier tier of the files to search
+         * @param new_address out-value to give back the address
+         * @return ALLOC_FULL if no file of the tier has a free place
+         */
+        enum alloc_result SearchFreeFile(bool is_new_container, enum storage_tier tier,
+                ContainerStorageAddressData* new_address);
+
         /**
          * Mark the Adress of the given Container as used.
          *
@@ -486,6 +567,12 @@ class MemoryBitmapContainerStorageAllocator : public ContainerStorageAllocator {
 
         /**
          * Configures the allocator.
+         *
+         * Available options:
+         * - type: String
+         * - file-run-length: uint32_t
+         * - all other options are forwarded to the bitmap index
+         *
          * @param option_name
          * @param option
          * @return
@@ -506,11 +593,21 @@ class MemoryBitmapContainerStorageAllocator : public ContainerStorageAllocator {
 
         virtual bool CheckIfFull();
 
+        /**
+         * If the container files are tiered, the container is allocated on the given tier.
+         * If all files of the preferred tier are full, the other tier is used.
+         */
         virtual enum alloc_result OnNewContainer(const Container& container, bool is_new_container,
+                enum storage_tier tier,
                 ContainerStorageAddressData* new_address);
 
         virtual bool OnAbortContainer(const Container& container, const ContainerStorageAddressData& new_address);
 
+        virtual enum alloc_result OnMoveContainer(const Container& container, enum storage_tier tier,
+                ContainerStorageAddressData* new_address);
+
+        virtual dedupv1::base::Option<double> GetTierFillRatio(enum storage_tier tier);
+
         /**
          * The new address is already known to the allocator since OnCommit is called.
          * However, the allocator is now free the mark the old addresses as free.
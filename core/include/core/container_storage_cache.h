@@ -23,6 +23,7 @@
 
 #include <core/statistics.h>
 #include <core/dedup.h>
+#include <core/container_storage_cache_policy.h>
 
 #include <base/profile.h>
 #include <base/locks.h>
@@ -45,6 +46,23 @@ namespace chunkstore {
 class ContainerStorage;
 class Container;
 
+/**
+ * Hint of a caller how a container read should interact with the read cache.
+ */
+enum read_cache_hint {
+    /**
+     * A missed container is added to the cache, a hit counts as access
+     */
+    READ_CACHE_HINT_DEFAULT,
+
+    /**
+     * The read should not change the cache content, e.g. for imports or gc reads
+     * that access each container only once. A missed container is not added to the
+     * cache and a hit is not counted as access by the replacement policy.
+     */
+    READ_CACHE_HINT_NO_POLLUTE
+};
+
 /**
  * Reference to an Cache entry that a client of the cache gets while requesting the cache.
  * For details when a cache entry is set, please refer to the GetCache and CheckCache method.
@@ -165,6 +183,11 @@ class ContainerStorageReadCache: public dedupv1::StatisticProvider {
 
                 tbb::atomic<uint64_t> cache_hits_;
                 tbb::atomic<uint64_t> cache_miss_;
+
+                /**
+                 * number of cache checks with the no-pollute hint
+                 */
+                tbb::atomic<uint64_t> cache_no_pollute_checks_;
         };
     private:
         /**
@@ -199,17 +222,22 @@ class ContainerStorageReadCache: public dedupv1::StatisticProvider {
         tbb::concurrent_hash_map<uint64_t, int> reverse_cache_map_;
 
         /**
-         * Last currently used time in millisecond resolution.
+         * Replacement policy that selects the cache line to reuse
          */
-        std::vector<tbb::tick_count> read_cache_used_time_;
+        ContainerStorageReadCachePolicy* policy_;
 
         /**
-         * lock to protected the read_cache_used_time field.
-         * We use a rw spin lock because the critical region is so short.
+         * name of the replacement policy
+         */
+        std::string policy_name_;
+
+        /**
+         * lock to protect the replacement policy.
+         * We use a spin lock because the critical region is so short.
          * Phases where this lock is held should not overlap with release or acquire operations of any
          * other lock.
          */
-        tbb::spin_rw_mutex read_cache_used_time_lock_;
+        tbb::spin_mutex policy_lock_;
 
         /**
          * Locks of the read caches
@@ -244,6 +272,7 @@ class ContainerStorageReadCache: public dedupv1::StatisticProvider {
          *
          * Available options:
          * - size: StorageUnit, >0
+         * - policy: String (lru, arc), replacement policy of the cache lines. Default: lru
          *
          * @param option_name
          * @param option
@@ -323,12 +352,20 @@ class ContainerStorageReadCache: public dedupv1::StatisticProvider {
          * @param cache_entry holds the cache line and the cache lock. Shall be set, May be set when LOOKUP_NOT_FOUND is returned,
          * Is be set when LOOKUP_FOUND is returned. Is never set when LOOKUP_ERROR is returned. If it is set, the client
          * is responsible for releasing. If not set, no cache line is re-freed to hold the container
+         * @param hint READ_CACHE_HINT_NO_POLLUTE implies no_update and the hit is not reported to the replacement policy
          * @return
          */
         dedupv1::base::lookup_result CheckCache(uint64_t container_id, const Container** container,
                 bool no_update,
                 bool write_lock,
-                CacheEntry* entry);
+                CacheEntry* entry,
+                read_cache_hint hint = READ_CACHE_HINT_DEFAULT);
+
+        /**
+         * Checks if the given container is in the cache or is currently loaded into the cache.
+         * No cache line lock is acquired, so the result is only a hint.
+         */
+        bool IsCached(uint64_t container_id);
 
         /**
          * Copies the container to the read cache. The cache entry should point to a cache entry
@@ -0,0 +1,262 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef CONTAINER_STORAGE_CACHE_POLICY_H__
+#define CONTAINER_STORAGE_CACHE_POLICY_H__
+
+#include <core/dedup.h>
+
+#include <vector>
+#include <list>
+#include <map>
+#include <string>
+
+namespace dedupv1 {
+namespace chunkstore {
+
+/**
+ * Replacement policy of the container storage read cache.
+ *
+ * The policy decides which cache line is reused if a container is not found in the
+ * read cache. The policy only tracks cache line numbers and the container ids assigned
+ * to them. It is not thread-safe. The read cache serializes all calls.
+ */
+class ContainerStorageReadCachePolicy {
+        DISALLOW_COPY_AND_ASSIGN(ContainerStorageReadCachePolicy);
+    public:
+        /**
+         * Constructor
+         */
+        ContainerStorageReadCachePolicy();
+
+        /**
+         * Destructor
+         */
+        virtual ~ContainerStorageReadCachePolicy();
+
+        /**
+         * Starts the policy. All cache lines are free after the start.
+         *
+         * @param line_count number of cache lines
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool Start(uint32_t line_count) = 0;
+
+        /**
+         * Called when the container in the given cache line has been accessed.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool Touch(int line) = 0;
+
+        /**
+         * Selects the cache line that should be used for the given container id.
+         * The cache line is assigned to the container id afterwards.
+         *
+         * @return the cache line to reuse or -1 if an error occurred
+         */
+        virtual int Replace(uint64_t container_id) = 0;
+
+        /**
+         * Called when the given cache line has been emptied, e.g. because the container
+         * load failed or the container has been removed from the cache.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool Remove(int line) = 0;
+
+        /**
+         * returns statistics about the policy as JSON string
+         */
+        virtual std::string PrintStatistics() = 0;
+
+        /**
+         * Creates a new policy.
+         *
+         * Available policies:
+         * - lru: least recently used cache line is reused
+         * - arc: adaptive replacement cache. Containers that are accessed only once (e.g. during a
+         *   scan) do not evict containers that have been accessed multiple times.
+         *
+         * @return the new policy or NULL if the name is unknown
+         */
+        static ContainerStorageReadCachePolicy* Create(const std::string& name);
+};
+
+/**
+ * Least-recently-used replacement policy.
+ */
+class LruReadCachePolicy : public ContainerStorageReadCachePolicy {
+        DISALLOW_COPY_AND_ASSIGN(LruReadCachePolicy);
+
+        /**
+         * cache lines ordered by last access. The front is the least recently used line.
+         */
+        std::list<int> lru_list_;
+
+        /**
+         * position of every cache line in the lru list
+         */
+        std::vector<std::list<int>::iterator> lru_position_;
+
+        /**
+         * number of cache lines that have been reused while holding a container
+         */
+        uint64_t evictions_;
+
+        /**
+         * true iff the cache line holds (or is about to hold) a container
+         */
+        std::vector<bool> used_;
+    public:
+        LruReadCachePolicy();
+
+        virtual bool Start(uint32_t line_count);
+        virtual bool Touch(int line);
+        virtual int Replace(uint64_t container_id);
+        virtual bool Remove(int line);
+        virtual std::string PrintStatistics();
+};
+
+/**
+ * Adaptive replacement cache (ARC) policy.
+ *
+ * The resident cache lines are split into a recency list (T1, accessed once) and a
+ * frequency list (T2, accessed at least twice). Ghost lists (B1, B2) remember the container ids
+ * recently evicted from T1 and T2. A hit on a ghost entry shifts the target size of T1.
+ *
+ * A sequential scan only cycles through T1, so containers in T2 survive it.
+ *
+ * @sa N. Megiddo, D. Modha: ARC: A Self-Tuning, Low Overhead Replacement Cache, FAST 2003
+ */
+class ArcReadCachePolicy : public ContainerStorageReadCachePolicy {
+        DISALLOW_COPY_AND_ASSIGN(ArcReadCachePolicy);
+
+        enum line_state {
+            LINE_FREE,
+            LINE_T1,
+            LINE_T2
+        };
+
+        enum ghost_state {
+            GHOST_B1,
+            GHOST_B2
+        };
+
+        /**
+         * Number of cache lines
+         */
+        uint32_t line_count_;
+
+        /**
+         * Target size of T1
+         */
+        uint32_t target_;
+
+        /**
+         * free cache lines
+         */
+        std::list<int> free_list_;
+
+        /**
+         * resident cache lines accessed once. The front is the least recently used line.
+         */
+        std::list<int> t1_;
+
+        /**
+         * resident cache lines accessed at least twice. The front is the least recently used line.
+         */
+        std::list<int> t2_;
+
+        /**
+         * state of every cache line
+         */
+        std::vector<line_state> line_state_;
+
+        /**
+         * position of every cache line in its list
+         */
+        std::vector<std::list<int>::iterator> line_position_;
+
+        /**
+         * container id assigned to every cache line
+         */
+        std::vector<uint64_t> line_container_id_;
+
+        /**
+         * ghost entries evicted from T1. The front is the oldest entry.
+         */
+        std::list<uint64_t> b1_;
+
+        /**
+         * ghost entries evicted from T2. The front is the oldest entry.
+         */
+        std::list<uint64_t> b2_;
+
+        /**
+         * maps from a container id to its ghost entry
+         */
+        std::map<uint64_t, std::pair<ghost_state, std::list<uint64_t>::iterator> > ghost_map_;
+
+        uint64_t b1_hits_;
+        uint64_t b2_hits_;
+        uint64_t evictions_;
+
+        /**
+         * Adds the line at the most recently used end of the given list.
+         */
+        void Insert(int line, line_state state, uint64_t container_id);
+
+        /**
+         * Removes the line from its current list.
+         */
+        void Unlink(int line);
+
+        /**
+         * Adds a ghost entry for the given container id
+         */
+        void AddGhost(uint64_t container_id, ghost_state state);
+
+        /**
+         * Removes the oldest ghost entry of the given ghost list
+         */
+        void RemoveOldestGhost(ghost_state state);
+
+        /**
+         * Frees a cache line. A free line is used first, otherwise
+         * the least recently used line of T1 or T2 is evicted depending on the target size.
+         *
+         * @param b2_hit true iff the container that should be loaded has been found in B2
+         */
+        int FreeLine(bool b2_hit);
+    public:
+        ArcReadCachePolicy();
+
+        virtual bool Start(uint32_t line_count);
+        virtual bool Touch(int line);
+        virtual int Replace(uint64_t container_id);
+        virtual bool Remove(int line);
+        virtual std::string PrintStatistics();
+};
+
+}
+}
+
+#endif  // CONTAINER_STORAGE_CACHE_POLICY_H__
@@ -0,0 +1,222 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef CONTAINER_STORAGE_DICTIONARY_H__
+#define CONTAINER_STORAGE_DICTIONARY_H__
+
+#include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
+
+#include <core/dedup.h>
+#include <core/info_store.h>
+#include <base/compress.h>
+
+#include <vector>
+#include <string>
+
+namespace dedupv1 {
+namespace chunkstore {
+
+/**
+ * Compression dictionary of the container storage.
+ *
+ * Small chunks compress poorly without a dictionary. The dictionary collects
+ * samples from the written chunks, trains a zstd dictionary when enough samples are
+ * available, and stores the dictionary in the info store. After a restart, the dictionary
+ * is restored from the info store so that the compressed items can be decompressed.
+ *
+ * The training is done only once. Items that are compressed before the dictionary is
+ * available are compressed without a dictionary.
+ */
+class ContainerStorageCompressionDictionary {
+        DISALLOW_COPY_AND_ASSIGN(ContainerStorageCompressionDictionary);
+    public:
+        /**
+         * Default maximal size of the dictionary
+         */
+        static const size_t kDefaultDictionarySize = 64 * 1024;
+
+        /**
+         * Default number of sampled chunks used for the training
+         */
+        static const uint32_t kDefaultSampleCount = 1600;
+
+        /**
+         * Maximal number of bytes sampled from a single chunk
+         */
+        static const size_t kMaxSampleSize = 4 * 1024;
+
+        /**
+         * Statistics about the compression dictionary
+         */
+        class Statistics {
+            public:
+                Statistics();
+
+                /**
+                 * number of sampled chunks
+                 */
+                tbb::atomic<uint64_t> samples_;
+
+                /**
+                 * number of dictionary trainings
+                 */
+                tbb::atomic<uint64_t> trainings_;
+
+                /**
+                 * number of failed dictionary trainings
+                 */
+                tbb::atomic<uint64_t> failed_trainings_;
+        };
+    private:
+        Statistics stats_;
+
+        /**
+         * info store to persist the dictionary
+         */
+        dedupv1::InfoStore* info_store_;
+
+        /**
+         * maximal size of the dictionary
+         */
+        size_t dictionary_size_;
+
+        /**
+         * number of sampled chunks used for the training
+         */
+        uint32_t sample_count_;
+
+        /**
+         * zstd compression level
+         */
+        int level_;
+
+        /**
+         * concatenated sample data
+         */
+        std::string samples_;
+
+        /**
+         * sizes of the samples
+         */
+        std::vector<size_t> sample_sizes_;
+
+        /**
+         * protects the samples
+         */
+        tbb::spin_mutex sample_lock_;
+
+        /**
+         * true iff the training has been triggered or a dictionary has been restored
+         */
+        tbb::atomic<bool> training_triggered_;
+
+        /**
+         * compression with the dictionary. NULL until the dictionary is available.
+         */
+        tbb::atomic<dedupv1::base::Compression*> compression_;
+
+        /**
+         * id of the dictionary or 0
+         */
+        uint32_t dictionary_id_;
+
+        bool started_;
+
+        /**
+         * Sets the dictionary and creates the dictionary compression.
+         */
+        bool SetDictionary(const std::string& dictionary);
+    public:
+        /**
+         * Constructor
+         */
+        ContainerStorageCompressionDictionary();
+
+        /**
+         * Destructor
+         */
+        ~ContainerStorageCompressionDictionary();
+
+        /**
+         * Configures the dictionary.
+         *
+         * Available options:
+         * - size: StorageUnit, maximal size of the dictionary
+         * - sample-count: uint32_t, number of sampled chunks used for the training
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool SetOption(const std::string& option_name, const std::string& option);
+
+        /**
+         * Starts the dictionary and restores a persisted dictionary. A restored dictionary is
+         * registered for decompression.
+         *
+         * @param info_store info store to persist the dictionary
+         * @param level zstd compression level
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Start(dedupv1::InfoStore* info_store, int level);
+
+        /**
+         * Samples the given chunk data if the dictionary still collects samples.
+         *
+         * @return true iff the caller should trigger the training (see Train).
+         * This is returned exactly once.
+         */
+        bool AddSample(const void* data, size_t data_size);
+
+        /**
+         * Trains the dictionary on the collected samples and persists it.
+         * Usually called in a background thread.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Train();
+
+        /**
+         * returns the compression with the dictionary or NULL if no dictionary is available yet.
+         */
+        inline dedupv1::base::Compression* compression() {
+            return compression_;
+        }
+
+        /**
+         * returns the id of the dictionary or 0 if no dictionary is available yet
+         */
+        inline uint32_t dictionary_id() const {
+            return dictionary_id_;
+        }
+
+        /**
+         * returns statistics about the dictionary as JSON string
+         */
+        std::string PrintStatistics();
+
+        inline bool is_started() const {
+            return started_;
+        }
+};
+
+}
+}
+
+#endif  // CONTAINER_STORAGE_DICTIONARY_H__
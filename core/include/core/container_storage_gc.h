@@ -62,6 +62,14 @@ class ContainerGCStrategy : public dedupv1::StatisticProvider {
      */
     virtual bool Start(const dedupv1::StartContext& start_context, ContainerStorage* storge);
 
+    /**
+     * Called when the container storage is running, e.g. after the log
+     * has been replayed. Background activities should be started here.
+     *
+     * @return true iff ok, otherwise an error has occurred
+     */
+    virtual bool Run();
+
     /**
      * @return true iff ok, otherwise an error has occurred
      */
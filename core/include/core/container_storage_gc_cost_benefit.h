@@ -0,0 +1,375 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef CONTAINER_STORAGE_GC_COST_BENEFIT_H__
+#define CONTAINER_STORAGE_GC_COST_BENEFIT_H__
+
+#include <map>
+#include <list>
+#include <vector>
+
+#include <core/dedup.h>
+#include <base/index.h>
+#include <base/locks.h>
+#include <base/option.h>
+#include <base/profile.h>
+#include <base/thread.h>
+#include <base/cache_strategy.h>
+#include <core/statistics.h>
+
+#include "dedupv1.pb.h"
+
+#include <core/container_storage_gc.h>
+
+#include <tbb/atomic.h>
+
+namespace dedupv1 {
+namespace chunkstore {
+
+/**
+ * Cost-benefit gc strategy for the container storage.
+ *
+ * In contrast to the greedy strategy, which always merges two containers,
+ * this strategy selects up to max-merge-count sparse containers by
+ * the cost-benefit score known from log-structured file systems:
+ *
+ *   score = (free space * age) / (1 + utilization)
+ *
+ * The selected containers are packed into as few containers as possible.
+ * The packing is executed as a chain of pairwise container merges as
+ * the container storage only supports merging two containers at a time.
+ *
+ * The compaction runs in a background thread. The thread is throttled
+ * so that the estimated copied data per second is below the io budget.
+ * On storage pressure, the compaction is executed directly without
+ * throttling.
+ */
+class CostBenefitContainerGCStrategy : public ContainerGCStrategy {
+    private:
+        /**
+         * State of the gc
+         */
+        enum state {
+            CREATED,
+            STARTED,
+            RUNNING,
+            STOPPED
+        };
+
+        class Statistics {
+            public:
+            Statistics();
+
+            /**
+             * time spend in the gc
+             */
+            dedupv1::base::Profile gc_time_;
+
+            tbb::atomic<uint64_t> pass_count_;
+
+            tbb::atomic<uint64_t> pressure_pass_count_;
+
+            tbb::atomic<uint64_t> merge_count_;
+
+            tbb::atomic<uint64_t> delete_count_;
+
+            tbb::atomic<uint64_t> aborted_count_;
+
+            /**
+             * number of containers freed by the gc
+             */
+            tbb::atomic<uint64_t> reclaimed_count_;
+
+            /**
+             * estimated number of bytes read and written by the gc
+             */
+            tbb::atomic<uint64_t> copied_bytes_;
+        };
+
+        static const uint32_t kDefaultMaxMergeCount = 8;
+
+        static const uint32_t kDefaultInterval = 10;
+
+        static const uint32_t kMaxWaitingTime = 3600;
+
+        /**
+         * Maximal number of compaction passes executed on a single
+         * storage pressure notification.
+         */
+        static const uint32_t kMaxPressurePassCount = 16;
+
+        /**
+         * Statistics
+         */
+        Statistics stats_;
+
+        /**
+         * Reference to the storage
+         */
+        ContainerStorage* storage_;
+
+        uint32_t container_size_;
+
+        uint32_t container_data_size_;
+
+        /**
+         * Index storing all candidates for merging.
+         * Key: container id, value: ContainerCostBenefitGCCandidateData
+         */
+        dedupv1::base::PersistentIndex* merge_candidates_;
+
+        /**
+         * In-memory copy of the merge candidate index.
+         * Protected by lock_.
+         */
+        std::map<uint64_t, ContainerCostBenefitGCCandidateData> candidates_;
+
+        /**
+         * Threshold under that a container is seen as a merge candidate.
+         */
+        uint32_t merge_candidate_data_size_threshold_;
+
+        /**
+         * If a container has more than this number of items, the container
+         * is no merge candidate.
+         */
+        uint32_t merge_candidate_item_count_threshold_;
+
+        /**
+         * Maximal number of containers selected in a single pass
+         */
+        uint32_t max_merge_count_;
+
+        /**
+         * Bytes per second the background thread is allowed to copy.
+         * 0 means that the gc is not throttled.
+         */
+        uint64_t io_budget_;
+
+        /**
+         * Minimal time in seconds between two background passes.
+         */
+        uint32_t interval_;
+
+        /**
+         * We do not touch containers that have been used in recent time.
+         */
+        uint32_t eviction_timeout_;
+
+        /**
+         * true iff the system is started in readonly mode.
+         * No background compaction is done in that case.
+         */
+        bool readonly_;
+
+        /**
+         * set that stored all container that have been touched in the last seconds.
+         * Protected by the lock.
+         */
+        dedupv1::base::TimeEvictionSet<uint64_t> touched_set_;
+
+        /**
+         * Protects the candidates and the touched set
+         */
+        dedupv1::base::MutexLock lock_;
+
+        /**
+         * Serializes the compaction passes of the background thread and
+         * the storage pressure handling.
+         */
+        dedupv1::base::MutexLock pass_lock_;
+
+        dedupv1::base::MutexLock thread_lock_;
+
+        /**
+         * Condition that is fired on state changed.
+         */
+        dedupv1::base::Condition thread_condition_;
+
+        dedupv1::base::Thread<bool> gc_thread_;
+
+        tbb::atomic<enum state> state_;
+
+        dedupv1::base::Option<bool> CheckIfPrimaryContainerId(uint64_t container_id);
+
+        /**
+         * Returns the current primary id of the container with the given id.
+         */
+        std::pair<dedupv1::base::lookup_result, uint64_t> GetPrimaryContainerId(uint64_t container_id);
+
+        /**
+         * Hold the lock when calling this method.
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool PutCandidate(uint64_t container_id, uint32_t item_count, uint32_t active_data_size);
+
+        /**
+         * Hold the lock when calling this method.
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool DeleteCandidate(uint64_t container_id);
+
+        /**
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool ProcessCommit(uint64_t primary_container_id, uint32_t item_count, uint32_t active_data_size);
+
+        /**
+         * Executes a single compaction pass.
+         *
+         * @param copied_bytes estimated number of bytes read and written during the pass
+         * @param reclaimed_count number of containers freed by the pass
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool ProcessMergeCandidates(uint64_t* copied_bytes, uint32_t* reclaimed_count);
+
+        /**
+         * Merges the containers of each group into a single container.
+         * The groups are independent, so the i-th merge of all groups is handed to the
+         * container storage as a single batch, which allows the storage to overlap the merges.
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool MergeGroups(const std::list<std::vector<ContainerCostBenefitGCCandidateData> >& groups,
+                uint64_t* copied_bytes, uint32_t* reclaimed_count);
+
+        bool GCLoop();
+    public:
+        static ContainerGCStrategy* CreateGC();
+
+        static void RegisterGC();
+
+        /**
+         * Constructor
+         */
+        CostBenefitContainerGCStrategy();
+
+        /**
+         * Destructor
+         */
+        virtual ~CostBenefitContainerGCStrategy();
+
+        /**
+         * Starts the container gc
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool Start(const dedupv1::StartContext& start_context, ContainerStorage* storage);
+
+        /**
+         * Starts the background thread
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool Run();
+
+        /**
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool Stop(const dedupv1::StopContext& stop_context);
+
+        /**
+         *
+         * Available options:
+         * - type: String
+         * - threshold: uint32_t
+         * - item-count-threshold: uint32_t
+         * - max-merge-count: uint32_t
+         * - io-budget: StorageUnit (bytes per second)
+         * - interval: uint32_t (seconds)
+         * - eviction-timeout: uint32_t
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool SetOption(const std::string& option_name, const std::string& option);
+
+        /**
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool OnCommit(const ContainerCommittedEventData& data);
+
+        /**
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool OnMove(const ContainerMoveEventData& data);
+
+        /**
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool OnRead(const Container& container, const void* key, size_t key_size);
+
+        /**
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool OnDeleteContainer(const Container& container);
+
+        /**
+         * @param data
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool OnMerge(const ContainerMergedEventData& data);
+
+        /**
+         * Executes compaction passes without considering the io budget
+         * until no more containers can be reclaimed.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool OnStoragePressure();
+
+        inline dedupv1::base::PersistentIndex* merge_candidates();
+
+        inline uint32_t merge_candidate_count();
+
+        /**
+         * Returns the cost-benefit score of a candidate.
+         * Higher is better.
+         */
+        double GetScore(const ContainerCostBenefitGCCandidateData& candidate, uint64_t now);
+
+        /**
+         * Packs the given candidates (first fit decreasing) into groups
+         * that fit into a single container.
+         * Groups with a single container are not returned.
+         */
+        std::list<std::vector<ContainerCostBenefitGCCandidateData> > PackCandidates(
+                std::vector<ContainerCostBenefitGCCandidateData> candidates);
+
+        virtual std::string PrintStatistics();
+
+        virtual std::string PrintProfile();
+
+#ifdef DEDUPV1_CORE_TEST
+        virtual void ClearData();
+#endif
+        DISALLOW_COPY_AND_ASSIGN(CostBenefitContainerGCStrategy);
+};
+
+dedupv1::base::PersistentIndex* CostBenefitContainerGCStrategy::merge_candidates() {
+    return this->merge_candidates_;
+}
+
+uint32_t CostBenefitContainerGCStrategy::merge_candidate_count() {
+    dedupv1::base::ScopedLock scoped_lock(&lock_);
+    scoped_lock.AcquireLock();
+    return candidates_.size();
+}
+
+}
+}
+
+#endif  // CONTAINER_STORAGE_GC_COST_BENEFIT_H__
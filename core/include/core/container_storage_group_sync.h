@@ -0,0 +1,137 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef CONTAINER_STORAGE_GROUP_SYNC_H__
+#define CONTAINER_STORAGE_GROUP_SYNC_H__
+
+#include <tbb/atomic.h>
+
+#include <core/dedup.h>
+#include <base/locks.h>
+#include <base/fileutil.h>
+#include <base/profile.h>
+
+#include <string>
+
+namespace dedupv1 {
+namespace chunkstore {
+
+/**
+ * Group commit of the container writes of a container file.
+ *
+ * If the container files are not opened with O_SYNC, a container write
+ * only reaches the page cache. Before the commit of a container is logged,
+ * the written container has to be made durable. Instead of syncing the file
+ * for every container, the writers wait for a shared fdatasync: The first waiting
+ * writer syncs the file on behalf of all writes that have been finished up to
+ * that point. Writers arriving during a running sync are covered by the next
+ * sync.
+ *
+ * With several background commit threads, a single fdatasync covers a batch of
+ * containers and the kernel can write adjacent containers as one large sequential I/O.
+ *
+ * The class is thread-safe.
+ */
+class ContainerStorageGroupSync {
+        DISALLOW_COPY_AND_ASSIGN(ContainerStorageGroupSync);
+    public:
+        /**
+         * Statistics about the group sync
+         */
+        class Statistics {
+            public:
+                Statistics();
+
+                /**
+                 * number of performed syncs
+                 */
+                tbb::atomic<uint64_t> syncs_;
+
+                /**
+                 * number of writes that have been made durable by the syncs
+                 */
+                tbb::atomic<uint64_t> synced_writes_;
+
+                /**
+                 * time spent in fdatasync
+                 */
+                dedupv1::base::Profile sync_time_;
+        };
+    private:
+        /**
+         * file to sync. Not owned.
+         */
+        dedupv1::base::File* file_;
+
+        /**
+         * lock protecting the counters
+         */
+        dedupv1::base::MutexLock lock_;
+
+        /**
+         * condition signaled after each finished sync
+         */
+        dedupv1::base::Condition sync_condition_;
+
+        /**
+         * number of finished writes
+         */
+        uint64_t write_count_;
+
+        /**
+         * number of finished writes that are known to be durable
+         */
+        uint64_t synced_count_;
+
+        /**
+         * true iff a thread currently syncs the file
+         */
+        bool sync_in_progress_;
+
+        Statistics stats_;
+    public:
+        /**
+         * Constructor
+         * @param file file to sync. The file is not owned by the group sync
+         */
+        explicit ContainerStorageGroupSync(dedupv1::base::File* file);
+
+        /**
+         * Registers a finished write to the file and blocks until the write
+         * is durable.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool SyncWrite();
+
+        /**
+         * returns the statistics of the group sync
+         */
+        inline const Statistics& stats() const;
+};
+
+const ContainerStorageGroupSync::Statistics& ContainerStorageGroupSync::stats() const {
+    return stats_;
+}
+
+}
+}
+
+#endif  // CONTAINER_STORAGE_GROUP_SYNC_H__
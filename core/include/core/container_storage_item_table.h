@@ -0,0 +1,214 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef CONTAINER_STORAGE_ITEM_TABLE_H__
+#define CONTAINER_STORAGE_ITEM_TABLE_H__
+
+#include <core/dedup.h>
+#include <core/container.h>
+#include <core/storage.h>
+#include <base/index.h>
+
+#include <tbb/spin_mutex.h>
+#include <tbb/atomic.h>
+
+#include <vector>
+#include <list>
+#include <map>
+#include <string>
+
+namespace dedupv1 {
+namespace chunkstore {
+
+/**
+ * Cache for the item tables (the container items without the data) of containers.
+ *
+ * The item table allows to read single items of a container without loading the
+ * meta data region of the container again. An item table is bound to the on-disk position
+ * the container has been loaded from. If the container has been moved in the meantime, the item
+ * table is stale and is not used.
+ *
+ * The cache is thread-safe. The least recently used item table is evicted if the cache is full.
+ */
+class ContainerStorageItemTableCache {
+        DISALLOW_COPY_AND_ASSIGN(ContainerStorageItemTableCache);
+    public:
+        /**
+         * Default number of cached item tables
+         */
+        static const uint32_t kDefaultSize = 64;
+
+        /**
+         * Statistics about the item table cache
+         */
+        class Statistics {
+            public:
+                Statistics();
+
+                tbb::atomic<uint64_t> hits_;
+                tbb::atomic<uint64_t> miss_;
+                tbb::atomic<uint64_t> stale_;
+                tbb::atomic<uint64_t> updates_;
+                tbb::atomic<uint64_t> evictions_;
+        };
+    private:
+        /**
+         * Cached item table of a single container
+         */
+        class ItemTable {
+            public:
+                ItemTable(uint32_t file_index, uint64_t file_offset);
+
+                /**
+                 * index of the container file the container has been loaded from
+                 */
+                uint32_t file_index_;
+
+                /**
+                 * offset in the container file the container has been loaded from
+                 */
+                uint64_t file_offset_;
+
+                /**
+                 * Number of lookups served by the item table
+                 */
+                uint32_t use_count_;
+
+                /**
+                 * non-deleted items of the container sorted by the key
+                 */
+                std::vector<ContainerItem> items_;
+
+                /**
+                 * position of the container id in the lru list
+                 */
+                std::list<uint64_t>::iterator lru_position_;
+
+                /**
+                 * Finds the item with the given key
+                 * @return pointer to the item or NULL if the item has not been found
+                 */
+                const ContainerItem* FindItem(const void* key, size_t key_size) const;
+        };
+
+        /**
+         * Maximal number of cached item tables
+         */
+        uint32_t size_;
+
+        /**
+         * Item tables by container id. Protected by lock_.
+         */
+        std::map<uint64_t, ItemTable*> tables_;
+
+        /**
+         * container ids ordered by the last usage. The most recently used container id is at the front.
+         * Protected by lock_.
+         */
+        std::list<uint64_t> lru_list_;
+
+        tbb::spin_mutex lock_;
+
+        Statistics stats_;
+
+        /**
+         * Removes the item table of the given container id.
+         * The caller has to hold lock_.
+         */
+        void RemoveUnlocked(uint64_t container_id);
+    public:
+        /**
+         * Constructor
+         */
+        ContainerStorageItemTableCache();
+
+        /**
+         * Destructor
+         */
+        ~ContainerStorageItemTableCache();
+
+        /**
+         * Configures the item table cache.
+         *
+         * Available options:
+         * - size: StorageUnit
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool SetOption(const std::string& option_name, const std::string& option);
+
+        /**
+         * Looks up the items of the given requests.
+         *
+         * @param container_id id of the container
+         * @param file_index file index of the current position of the container
+         * @param file_offset file offset of the current position of the container
+         * @param requests requests to lookup the items for
+         * @param items a copy of the item of every request is appended in the order of the requests
+         * @param use_count number of lookups served by the item table before this lookup
+         * @return LOOKUP_FOUND if the items of all requests have been found, LOOKUP_NOT_FOUND if no up-to-date
+         * item table exists or if an item has not been found, LOOKUP_ERROR if an error occurred.
+         */
+        dedupv1::base::lookup_result Lookup(uint64_t container_id,
+                uint32_t file_index,
+                uint64_t file_offset,
+                const std::vector<StorageReadRequest*>& requests,
+                std::vector<ContainerItem>* items,
+                uint32_t* use_count);
+
+        /**
+         * Stores the item table of the given container. The container may be a meta data only container.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Update(uint64_t container_id,
+                uint32_t file_index,
+                uint64_t file_offset,
+                const Container& container);
+
+        /**
+         * Removes the item table of the given container id if it is cached.
+         */
+        void Remove(uint64_t container_id);
+
+        /**
+         * Removes all item tables.
+         */
+        void Clear();
+
+        /**
+         * returns the number of cached item tables
+         */
+        size_t GetSize();
+
+        /**
+         * returns statistics about the item table cache
+         */
+        std::string PrintStatistics();
+
+        inline const Statistics& stats() const {
+            return stats_;
+        }
+};
+
+}
+}
+
+#endif  // CONTAINER_STORAGE_ITEM_TABLE_H__
@@ -0,0 +1,280 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef CONTAINER_STORAGE_TIERING_H__
+#define CONTAINER_STORAGE_TIERING_H__
+
+#include <core/dedup.h>
+#include <core/statistics.h>
+#include <base/profile.h>
+
+#include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+
+#include "dedupv1.pb.h"
+
+namespace dedupv1 {
+namespace chunkstore {
+
+class ContainerStorage;
+class Container;
+
+/**
+ * Hot/cold tiering of the container storage.
+ *
+ * The container files are either part of the fast tier (e.g. SSD) or the capacity tier (e.g. HDD).
+ * New containers are allocated on the fast tier by the allocator. The tiering keeps the
+ * containers of the fast tier in LRU order. When the fill ratio of the fast tier exceeds the high
+ * watermark, the least recently read containers are moved to the capacity tier until the fill ratio
+ * falls below the low watermark. A container on the capacity tier that is loaded at least promotion-threshold
+ * times is moved back to the fast tier if the fill ratio of the fast tier is below the low watermark.
+ *
+ * Only container loads (read cache misses) are counted. The loads are collected in striped maps and
+ * applied to the LRU order and the read counts in the idle time.
+ *
+ * Containers are moved in the idle time using the usual container move mechanism
+ * (ContainerMoveEventData). The recency information is not persisted. After a restart, all containers of the
+ * fast tier are considered equally cold.
+ */
+class ContainerStorageTiering : public dedupv1::StatisticProvider {
+        DISALLOW_COPY_AND_ASSIGN(ContainerStorageTiering);
+
+        static const uint32_t kDefaultPromotionThreshold = 4;
+        static const uint32_t kDefaultMaxMoveCount = 8;
+        static const uint32_t kDefaultMaxCandidateCount = 64 * 1024;
+
+        /**
+         * Number of stripes of the container loads
+         */
+        static const size_t kLoadStripeCount = 16;
+
+        /**
+         * Container loads since the last idle tick of a part of the containers
+         */
+        class LoadStripe {
+            public:
+                tbb::spin_mutex lock_;
+
+                /**
+                 * Number of loads per container
+                 */
+                std::map<uint64_t, uint32_t> load_count_map_;
+        };
+
+        class Statistics {
+            public:
+                Statistics();
+
+                tbb::atomic<uint64_t> demotion_count_;
+                tbb::atomic<uint64_t> promotion_count_;
+                tbb::atomic<uint64_t> aborted_move_count_;
+                tbb::atomic<uint64_t> failed_move_count_;
+
+                dedupv1::base::Profile move_time_;
+        };
+
+        Statistics stats_;
+
+        ContainerStorage* storage_;
+
+        /**
+         * Fill ratio of the fast tier above that containers are demoted.
+         */
+        double high_watermark_;
+
+        /**
+         * Fill ratio of the fast tier up to that containers are demoted once the
+         * high watermark has been exceeded.
+         */
+        double low_watermark_;
+
+        /**
+         * Number of reads after that a container of the capacity tier is promoted.
+         */
+        uint32_t promotion_threshold_;
+
+        /**
+         * Maximal number of containers moved per idle tick.
+         */
+        uint32_t max_move_count_;
+
+        /**
+         * Maximal number of capacity tier containers whose reads are counted. If the limit is
+         * reached, all counters are reset.
+         */
+        uint32_t max_candidate_count_;
+
+        bool started_;
+
+        /**
+         * Container loads that are not yet applied. A stripe is selected by the container id.
+         * Each stripe has its own lock.
+         */
+        LoadStripe load_stripes_[kLoadStripeCount];
+
+        /**
+         * Protects all members below
+         */
+        tbb::spin_mutex lock_;
+
+        /**
+         * true iff containers are demoted until the low watermark is reached
+         */
+        bool demoting_;
+
+        /**
+         * Primary ids of the containers on the fast tier. The most recently used
+         * container is at the front.
+         */
+        std::list<uint64_t> fast_list_;
+
+        /**
+         * Position of a container in the fast list.
+         */
+        std::map<uint64_t, std::list<uint64_t>::iterator> fast_map_;
+
+        /**
+         * Number of loads of containers on the capacity tier
+         */
+        std::map<uint64_t, uint32_t> read_count_map_;
+
+        /**
+         * Containers of the capacity tier that should be promoted
+         */
+        std::set<uint64_t> promotion_set_;
+
+        /**
+         * Marks the container as the most recently used container of the fast tier.
+         * The lock should be held.
+         */
+        void AddFastContainer(uint64_t container_id);
+
+        /**
+         * Removes all information about the container.
+         * The lock should be held.
+         */
+        void RemoveContainer(uint64_t container_id);
+
+        /**
+         * Applies the collected container loads to the LRU order of the fast tier
+         * and to the read counts of the capacity tier.
+         * The lock should not be held.
+         */
+        void ApplyLoads();
+
+        /**
+         * Moves the given containers to the given tier.
+         * The lock should not be held.
+         */
+        bool MoveContainers(const std::list<uint64_t>& container_list, bool fast_tier);
+    public:
+        /**
+         * Constructor
+         */
+        ContainerStorageTiering();
+
+        /**
+         * Destructor
+         */
+        virtual ~ContainerStorageTiering();
+
+        /**
+         * Available options:
+         * - high-watermark: double
+         * - low-watermark: double
+         * - promotion-threshold: uint32_t
+         * - max-move-count: uint32_t
+         * - max-candidate-count: uint32_t
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool SetOption(const std::string& option_name, const std::string& option);
+
+        /**
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Start(ContainerStorage* storage);
+
+        /**
+         * Loads the containers of the fast tier from the meta data index.
+         * Called after the log replay.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Run();
+
+        /**
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool OnCommit(const ContainerCommittedEventData& data);
+
+        /**
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool OnMove(const ContainerMoveEventData& data);
+
+        /**
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool OnMerge(const ContainerMergedEventData& data);
+
+        /**
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool OnDeleteContainer(const ContainerDeletedEventData& data);
+
+        /**
+         * Called when a container is loaded from disk, e.g. on a read cache miss.
+         * Only the lock of a load stripe is acquired.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool OnLoad(const Container& container);
+
+        /**
+         * Demotes or promotes containers.
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool OnIdle();
+
+        /**
+         * returns the number of containers known to be on the fast tier
+         */
+        uint64_t GetFastContainerCount();
+
+        /**
+         * returns the number of containers that wait for a promotion
+         */
+        uint64_t GetPromotionCandidateCount();
+
+        virtual std::string PrintStatistics();
+
+        virtual std::string PrintProfile();
+};
+
+}
+}
+
+#endif  // CONTAINER_STORAGE_TIERING_H__
@@ -28,6 +28,7 @@
 #include "tbb/concurrent_hash_map.h"
 #include "tbb/tick_count.h"
 #include "tbb/spin_rw_mutex.h"
+#include "tbb/spin_mutex.h"
 #include "tbb/atomic.h"
 
 #include <core/dedup.h>
@@ -157,6 +158,19 @@ class ContainerStorageWriteCache : public dedupv1::StatisticProvider {
     bool GetNextWriteCacheContainer(Container** write_container,
             dedupv1::base::ReadWriteLock** write_cache_lock);
 
+    /**
+     * Returns the write container for new data of the given stream.
+     * The write cache lock is acquired when the method returns successfully.
+     *
+     * @param stream_id stream of the data or Storage::NO_STREAM_ID
+     * @param write_container
+     * @param write_cache_lock
+     * @return
+     */
+    bool GetNextWriteCacheContainer(uint32_t stream_id,
+            Container** write_container,
+            dedupv1::base::ReadWriteLock** write_cache_lock);
+
     /**
      * Lock is NOT acquired
      *
@@ -195,11 +209,26 @@ class ContainerStorageWriteCacheStrategy {
         virtual bool GetNextWriteCacheContainer(Container** write_container,
                 dedupv1::base::ReadWriteLock** write_cache_lock) = 0;
 
+        /**
+         * Chooses the write container for new data of the given stream.
+         * The default implementation ignores the stream.
+         *
+         * @param stream_id stream of the data or Storage::NO_STREAM_ID
+         * @param write_container
+         * @param write_cache_lock
+         * @return true iff ok, otherwise an error has occurred
+         */
+        virtual bool GetNextWriteCacheContainerForStream(uint32_t stream_id,
+                Container** write_container,
+                dedupv1::base::ReadWriteLock** write_cache_lock);
+
         virtual bool Init();
 
         virtual bool SetOption(const std::string& option_name, const std::string& option);
 
         virtual bool Start(ContainerStorageWriteCache* write_cache);
+
+        virtual std::string PrintStatistics();
 };
 
 class RoundRobinContainerStorageWriteCacheStrategy : public ContainerStorageWriteCacheStrategy {
@@ -251,6 +280,150 @@ class EarliestFreeContainerStorageWriteCacheStrategy : public ContainerStorageWr
                 dedupv1::base::ReadWriteLock** write_cache_lock);
 };
 
+/**
+ * Write cache strategy that assigns each stream (e.g. a volume) a small set of write containers.
+ * The data of a stream is stored in its own containers, which improves the read locality when the
+ * stream is restored, and the threads of different streams do not contend for the same
+ * write container lock.
+ *
+ * A stream starts with a single write container. If all write containers of a stream are
+ * locked by other threads of the same stream, e.g. by the sessions of a volume, the stream is
+ * assigned an additional write container up to containers-per-stream. If there are more active
+ * streams than write containers, the least recently used write container is reassigned to the
+ * new stream. Data without a stream is placed using the earliest-free strategy.
+ */
+class StreamAffineContainerStorageWriteCacheStrategy : public ContainerStorageWriteCacheStrategy {
+    private:
+        DISALLOW_COPY_AND_ASSIGN(StreamAffineContainerStorageWriteCacheStrategy);
+
+        /**
+         * Default maximal number of write containers assigned to a stream
+         */
+        static const uint32_t kDefaultContainersPerStream = 2;
+
+        /**
+         * Statistics about the stream affine strategy
+         */
+        class Statistics {
+            public:
+                Statistics();
+
+                /**
+                 * number of requests that used a write container already assigned to the stream
+                 */
+                tbb::atomic<uint64_t> stream_hits_;
+
+                /**
+                 * number of assignments of a write container to a stream
+                 */
+                tbb::atomic<uint64_t> stream_assignments_;
+
+                /**
+                 * number of assignments that took the write container away from another stream
+                 */
+                tbb::atomic<uint64_t> stream_evictions_;
+
+                /**
+                 * number of requests that waited for a write container of the stream because all
+                 * containers of the stream were locked and no further container could be assigned
+                 */
+                tbb::atomic<uint64_t> stream_waits_;
+
+                /**
+                 * number of requests without a stream
+                 */
+                tbb::atomic<uint64_t> no_stream_requests_;
+        };
+
+        Statistics stats_;
+
+        ContainerStorageWriteCache* write_cache;
+
+        /**
+         * strategy used for data without a stream
+         */
+        ContainerStorageWriteCacheStrategy* fallback_strategy;
+
+        /**
+         * maximal number of write containers assigned to a stream
+         */
+        uint32_t containers_per_stream_;
+
+        /**
+         * Lock protecting the stream assignment
+         */
+        tbb::spin_mutex assignment_lock_;
+
+        /**
+         * stream id assigned to a write container index or Storage::NO_STREAM_ID
+         */
+        std::vector<uint32_t> container_stream_;
+
+        /**
+         * last time a write container index has been chosen
+         */
+        std::vector<tbb::tick_count> container_used_time_;
+
+        /**
+         * write container indexes assigned to a stream
+         */
+        std::map<uint32_t, std::vector<int> > stream_container_;
+
+        /**
+         * Number of requests per stream that had to wait for a write container. Used to
+         * spread the waiting requests over the containers of the stream.
+         */
+        std::map<uint32_t, uint32_t> stream_wait_count_;
+
+        /**
+         * Assigns an additional write container index to the stream. An unassigned write container
+         * is preferred, otherwise the least recently used container of another stream is taken.
+         * The caller has to hold the assignment lock.
+         *
+         * @return the assigned index or -1 if all write containers are assigned to the stream
+         */
+        int AssignContainerIndex(uint32_t stream_id);
+
+        /**
+         * Returns the write container indexes assigned to the stream. Assigns a write
+         * container index if the stream has no assigned index.
+         */
+        std::vector<int> GetStreamContainerIndexes(uint32_t stream_id);
+
+        /**
+         * Called if all write containers of the stream are locked. Assigns an additional
+         * write container if the stream has less than containers-per-stream containers, otherwise
+         * one of the containers of the stream is chosen.
+         */
+        int GetBusyStreamContainerIndex(uint32_t stream_id);
+    public:
+        static ContainerStorageWriteCacheStrategy* CreateWriteCacheStrategy();
+
+        static void RegisterWriteCacheStrategy();
+
+        StreamAffineContainerStorageWriteCacheStrategy();
+        virtual ~StreamAffineContainerStorageWriteCacheStrategy();
+
+        /**
+         * Configures the strategy.
+         *
+         * Available options:
+         * - containers-per-stream: uint32_t
+         */
+        virtual bool SetOption(const std::string& option_name, const std::string& option);
+
+        virtual bool Start(ContainerStorageWriteCache* write_cache);
+
+        virtual bool GetNextWriteCacheContainer(Container** write_container,
+                dedupv1::base::ReadWriteLock** write_cache_lock);
+
+        virtual bool GetNextWriteCacheContainerForStream(uint32_t stream_id,
+                Container** write_container,
+                dedupv1::base::ReadWriteLock** write_cache_lock);
+
+        virtual std::string PrintStatistics();
+};
+
 class ContainerStorageWriteCacheStrategyFactory {
         DISALLOW_COPY_AND_ASSIGN(ContainerStorageWriteCacheStrategyFactory);
     public:
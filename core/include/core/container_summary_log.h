@@ -0,0 +1,172 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef CONTAINER_SUMMARY_LOG_H__
+#define CONTAINER_SUMMARY_LOG_H__
+
+#include <core/dedup.h>
+#include <base/index.h>
+#include <base/locks.h>
+#include <base/fileutil.h>
+#include <base/callback.h>
+#include <base/option.h>
+
+#include <tbb/atomic.h>
+
+#include <string>
+
+#include "dedupv1.pb.h"
+
+namespace dedupv1 {
+namespace chunkstore {
+
+class Container;
+
+/**
+ * Append-only log with the item meta data of the containers written to a container file.
+ *
+ * After a container has been committed, moved or merged, a summary record with the container id,
+ * the address, the log id of the event and the item list is appended to the summary log
+ * of the container file. Components that only need the item meta data (e.g. the chunk index restorer)
+ * can stream the summary log instead of reading the containers.
+ *
+ * The summary log is never updated in place. A record is only current if the
+ * address of the container still carries the log id of the record (see
+ * ContainerStorage::IsCurrentContainerSummary). As the record is appended after the event
+ * commit, a crash might lose the record of a container. Consumers have to read containers without
+ * a current record as usual.
+ *
+ * Each record consists of a header (magic, data size, crc of the data) followed by a serialized
+ * ContainerSummaryData message. A torn record at the end of the log is truncated at startup.
+ *
+ * Every commit, move and merge appends a record, so the log grows with the number of container
+ * writes, not with the number of containers. The container storage compacts the log after a clean
+ * start so that only the current records are kept.
+ */
+class ContainerSummaryLog {
+        DISALLOW_COPY_AND_ASSIGN(ContainerSummaryLog);
+
+        static const uint32_t kRecordMagic = 0x53554D31;
+
+        static const size_t kRecordHeaderSize = 3 * sizeof(uint32_t);
+
+        /**
+         * Maximal size of a record. Large enough for a container full of items.
+         */
+        static const size_t kMaxRecordSize = 4 * 1024 * 1024;
+
+        class Statistics {
+            public:
+            Statistics();
+
+            tbb::atomic<uint64_t> appended_records_;
+            tbb::atomic<uint64_t> read_records_;
+            tbb::atomic<uint64_t> compacted_records_;
+        };
+
+        dedupv1::base::File* file_;
+
+        std::string filename_;
+
+        /**
+         * Offset the next record is appended at. Protected by the lock.
+         */
+        uint64_t end_offset_;
+
+        /**
+         * Serializes the appends.
+         */
+        dedupv1::base::MutexLock lock_;
+
+        Statistics stats_;
+    public:
+        /**
+         * Constructor
+         */
+        ContainerSummaryLog();
+
+        /**
+         * Destructor. Closes the log file.
+         */
+        ~ContainerSummaryLog();
+
+        /**
+         * Opens the summary log and searches the end of the log.
+         *
+         * @param filename
+         * @param truncate iff true, all existing records are removed, e.g. when the container file has been
+         * newly created.
+         * @param readonly iff true, the log is opened readonly and no records can be appended.
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Start(const std::string& filename, bool truncate, bool readonly);
+
+        /**
+         * Appends the summary record of the given container.
+         *
+         * @param container container that has been written
+         * @param address address the container has been written to
+         * @param log_id id of the log event that stored the container at the address
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Append(const Container& container, const ContainerStorageAddressData& address, int64_t log_id);
+
+        /**
+         * Reads the record at the given offset and sets the offset to the next record.
+         *
+         * @return LOOKUP_FOUND if a record has been read, LOOKUP_NOT_FOUND at the end of the log
+         * or if there is no valid record at the offset, LOOKUP_ERROR on an I/O error.
+         */
+        dedupv1::base::lookup_result ReadNext(uint64_t* offset, ContainerSummaryData* summary);
+
+        /**
+         * Rewrites the log so that it only contains the records for which the callback returns true.
+         * The records are written to a temporary file that replaces the log file.
+         *
+         * @param is_current callback that checks if a record is current. The callback is not deleted.
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Compact(dedupv1::base::Callback1<dedupv1::base::Option<bool>, const ContainerSummaryData&>* is_current);
+
+        /**
+         * Fills the summary data of the given container. The address is not set.
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        static bool FillSummary(const Container& container, ContainerSummaryData* summary);
+
+        /**
+         * Returns the offset the next record will be appended at.
+         */
+        uint64_t end_offset();
+
+        inline const std::string& filename() const;
+
+        std::string PrintStatistics();
+};
+
+const std::string& ContainerSummaryLog::filename() const {
+    return filename_;
+}
+
+}
+}
+
+#endif  // CONTAINER_SUMMARY_LOG_H__
@@ -486,23 +486,6 @@ class ContentStorage : public dedupv1::StatisticProvider {
     bool ComputeCRCChecksum(std::string* checksum, Session* session,
             dedupv1::blockindex::BlockMapping* block_mapping, dedupv1::base::ErrorContext* ec);
 
-    /**
-     * Reads data and computes the crc checksum for a block mapping item
-     *
-     * @param item The block mapping item to be read from
-     * @param session The current session
-     * @param data_buffer A buffer to store data in
-     * @param data_pos Current position in the data buffer
-     * @param count The number of bytes to read from this item. If 0 no bytes are read and only the crc is calculated.
-     * @param offset Offset of reading within this item.
-     * @param ec error context (Can be NULL)
-     */
-    bool ReadDataForItem(dedupv1::blockindex::BlockMappingItem* item,
-            Session* session,
-            byte* data_buffer,
-            unsigned int data_pos, int count,
-            int offset, dedupv1::base::ErrorContext* ec);
-
     /**
      * Fingerprint the given chunks.
      *
@@ -0,0 +1,349 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef READ_AHEAD_H__
+#define READ_AHEAD_H__
+
+#include <core/dedup.h>
+#include <base/error.h>
+
+#include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
+
+#include <set>
+#include <deque>
+#include <vector>
+#include <string>
+
+namespace dedupv1 {
+
+class DedupSystem;
+
+namespace blockindex {
+class BlockIndex;
+}
+
+namespace chunkstore {
+class Storage;
+}
+
+namespace base {
+class Threadpool;
+}
+
+class ReadAheadFillTask;
+
+/**
+ * Read-ahead for sequential restores.
+ *
+ * After a sequential read stream has been detected, the block mappings of the blocks
+ * following the reader are read from the block index. The containers referenced by these
+ * mappings are prefetched into the read cache of the storage before the reader needs them.
+ * The block mappings are read by a background task on the threadpool. The read path only
+ * updates the stream position and the window and at most one fill task per read-ahead is running.
+ *
+ * The read-ahead window (in blocks) adapts to the observed benefit. It is doubled after a
+ * window fill that caused container loads and it is halved when the sequential stream breaks
+ * while prefetched containers have not been used by the reader (waste).
+ *
+ * The read-ahead is disabled by default.
+ *
+ * A read-ahead instance is owned by a single command handler session and is not thread-safe.
+ * As a volume is served by several command handler threads, the reads of a single sequential stream may
+ * be observed out of order. A read is therefore also considered sequential, if it is within max-gap bytes
+ * of the expected offset.
+ */
+class ReadAhead {
+    public:
+        /**
+         * Default minimal window size in blocks
+         */
+        static const uint32_t kDefaultMinWindow = 4;
+
+        /**
+         * Default maximal window size in blocks
+         */
+        static const uint32_t kDefaultMaxWindow = 64;
+
+        /**
+         * Default number of sequential reads before the read-ahead starts
+         */
+        static const uint32_t kDefaultSequentialThreshold = 2;
+
+        /**
+         * Default distance in bytes between the expected and the actual offset that is still
+         * considered sequential.
+         */
+        static const uint64_t kDefaultMaxGap = 256 * 1024;
+
+        /**
+         * Statistics about the read-ahead. The statistics may be shared by the read-ahead instances
+         * of all sessions of a volume.
+         */
+        class Statistics {
+            public:
+                Statistics();
+
+                tbb::atomic<uint64_t> sequential_reads_;
+                tbb::atomic<uint64_t> random_reads_;
+
+                /**
+                 * Number of block mappings read ahead of the reader
+                 */
+                tbb::atomic<uint64_t> mapping_reads_;
+
+                /**
+                 * Number of issued container prefetches
+                 */
+                tbb::atomic<uint64_t> prefetches_;
+
+                /**
+                 * Number of containers that have not been prefetched because they were already in memory
+                 */
+                tbb::atomic<uint64_t> prefetch_ignored_;
+
+                /**
+                 * Number of prefetched containers used by the reader
+                 */
+                tbb::atomic<uint64_t> hits_;
+
+                /**
+                 * Number of prefetched containers not used by the reader
+                 */
+                tbb::atomic<uint64_t> waste_;
+
+                tbb::atomic<uint64_t> window_increases_;
+                tbb::atomic<uint64_t> window_decreases_;
+        };
+    private:
+        DISALLOW_COPY_AND_ASSIGN(ReadAhead);
+        friend class ReadAheadFillTask;
+
+        Statistics* stats_;
+
+        /**
+         * Threadpool to run the fill tasks on. Set after the start.
+         */
+        dedupv1::base::Threadpool* tp_;
+
+        /**
+         * Block index to read the block mappings from. Set after the start.
+         */
+        dedupv1::blockindex::BlockIndex* block_index_;
+
+        /**
+         * Storage to prefetch the containers in. Set after the start.
+         */
+        dedupv1::chunkstore::Storage* storage_;
+
+        uint32_t block_size_;
+
+        /**
+         * First block id of the volume
+         */
+        uint64_t start_block_id_;
+
+        /**
+         * Number of blocks of the volume
+         */
+        uint64_t block_count_;
+
+        bool enabled_;
+
+        uint32_t min_window_;
+
+        uint32_t max_window_;
+
+        /**
+         * current window size in blocks
+         */
+        uint32_t window_;
+
+        uint32_t sequential_threshold_;
+
+        uint64_t max_gap_;
+
+        /**
+         * true iff a previous read has been observed
+         */
+        bool has_position_;
+
+        /**
+         * Offset (in bytes) the next sequential read is expected at
+         */
+        uint64_t next_offset_;
+
+        /**
+         * Number of sequential reads in the current stream
+         */
+        uint32_t sequential_count_;
+
+        /**
+         * Volume block number up to which (exclusive) the block mappings have been read ahead.
+         */
+        uint64_t prefetched_until_;
+
+        /**
+         * Prefetched containers that have not been used by the reader yet with the block number
+         * of the first block that references them. Ordered by the block number.
+         */
+        std::deque<std::pair<uint64_t, uint64_t> > pending_;
+
+        /**
+         * Container ids in pending_
+         */
+        std::set<uint64_t> pending_containers_;
+
+        /**
+         * Number of the current sequential stream. Increased when a stream ends so that the
+         * results of a fill task of an old stream are not used.
+         */
+        uint64_t stream_id_;
+
+        /**
+         * true iff a fill task is submitted and not finished
+         */
+        tbb::atomic<bool> fill_running_;
+
+        /**
+         * Protects the fill results
+         */
+        tbb::spin_mutex fill_lock_;
+
+        /**
+         * Containers prefetched by the last fill task with the block number of the first block
+         * that references them. Protected by fill_lock_.
+         */
+        std::vector<std::pair<uint64_t, uint64_t> > fill_results_;
+
+        /**
+         * Stream id of the fill results. Protected by fill_lock_.
+         */
+        uint64_t fill_stream_id_;
+
+        /**
+         * true iff the fill results have not been collected yet. Protected by fill_lock_.
+         */
+        bool fill_done_;
+
+        /**
+         * Marks all pending containers referenced up to the given block as used.
+         */
+        void Consume(uint64_t block);
+
+        /**
+         * Moves the results of a finished fill task to the pending containers and
+         * adapts the window.
+         */
+        void CollectFill();
+
+        /**
+         * Ends the current sequential stream. All pending containers are waste.
+         */
+        void Reset();
+
+        /**
+         * Reads the block mappings of the blocks [begin_block, end_block) and issues prefetches for the
+         * referenced containers. Called by the fill task.
+         *
+         * @param known_containers containers that are already prefetched for the stream
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Fill(uint64_t stream_id, uint64_t begin_block, uint64_t end_block,
+                const std::set<uint64_t>& known_containers);
+    public:
+        /**
+         * Constructor
+         * @param stats statistics to update. Shall not be NULL and has to outlive the read-ahead.
+         */
+        explicit ReadAhead(Statistics* stats);
+
+        /**
+         * Destructor. Waits for a running fill task.
+         */
+        ~ReadAhead();
+
+        /**
+         * Configures the read-ahead.
+         *
+         * Available options:
+         * - enabled: Boolean
+         * - min-window: uint32_t (blocks)
+         * - max-window: uint32_t (blocks)
+         * - sequential-threshold: uint32_t
+         * - max-gap: StorageUnit
+         *
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool SetOption(const std::string& option_name, const std::string& option);
+
+        /**
+         * Starts the read-ahead for the volume with the given block interval.
+         *
+         * @param system dedup system. Shall not be NULL
+         * @param start_block_id first block id of the volume
+         * @param end_block_id first block id not belonging to the volume
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool Start(DedupSystem* system, uint64_t start_block_id, uint64_t end_block_id);
+
+        /**
+         * Notifies the read-ahead about a finished read of the given volume range (in bytes).
+         *
+         * @return true iff ok, otherwise an error has occurred. An error only affects the read-ahead,
+         * not the read itself.
+         */
+        bool Update(uint64_t offset, uint64_t size, dedupv1::base::ErrorContext* ec);
+
+        /**
+         * Waits until a running fill task is finished.
+         */
+        void WaitForFill();
+
+        /**
+         * returns true iff the read-ahead is started
+         */
+        inline bool is_started() const {
+            return block_index_ != NULL;
+        }
+
+        /**
+         * returns the current window size in blocks
+         */
+        inline uint32_t window() const {
+            return window_;
+        }
+
+        /**
+         * returns true iff the read-ahead is enabled
+         */
+        inline bool is_enabled() const {
+            return enabled_;
+        }
+
+        /**
+         * returns a developer-readable representation of the read-ahead state
+         */
+        std::string DebugString() const;
+};
+
+}
+
+#endif  // READ_AHEAD_H__
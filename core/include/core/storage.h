@@ -28,6 +28,7 @@
 #include <stdint.h>
 #include <map>
 #include <string>
+#include <vector>
 
 #include <core/idle_detector.h>
 #include <core/log.h>
@@ -53,6 +54,69 @@ enum storage_commit_state {
     STORAGE_ADDRESS_WILL_NEVER_COMMITTED = 3 // !< STORAGE_ADDRESS_WILL_NEVER_COMMITTED
 };
 
+/**
+ * A single chunk read of a batched read (see Storage::ReadBatch).
+ */
+class StorageReadRequest {
+    private:
+        uint64_t address_;
+
+        const void* key_;
+
+        size_t key_size_;
+
+        /**
+         * Target buffer. At least size bytes
+         */
+        void* data_;
+
+        uint32_t offset_;
+
+        uint32_t size_;
+
+        /**
+         * Number of bytes read. Set by the storage
+         */
+        uint32_t read_size_;
+    public:
+        StorageReadRequest(uint64_t address, const void* key, size_t key_size,
+                void* data, uint32_t offset, uint32_t size);
+
+        inline uint64_t address() const {
+            return address_;
+        }
+
+        inline const void* key() const {
+            return key_;
+        }
+
+        inline size_t key_size() const {
+            return key_size_;
+        }
+
+        inline void* data() const {
+            return data_;
+        }
+
+        inline uint32_t offset() const {
+            return offset_;
+        }
+
+        inline uint32_t size() const {
+            return size_;
+        }
+
+        inline uint32_t read_size() const {
+            return read_size_;
+        }
+
+        inline void set_read_size(uint32_t read_size) {
+            read_size_ = read_size;
+        }
+
+        std::string DebugString() const;
+};
+
 /**
  * The Storage system is used to store and read chunks of data.
  *
@@ -83,6 +147,11 @@ public:
      */
     static const uint64_t ILLEGAL_STORAGE_ADDRESS;
 
+    /**
+     * stream id used if a chunk does not belong to a stream (-1).
+     */
+    static const uint32_t NO_STREAM_ID;
+
     /**
      * Constructor
      * @return
@@ -145,6 +214,22 @@ public:
                 uint64_t* address,
                 dedupv1::base::ErrorContext* ec) = 0;
 
+    /**
+     * Writes a new chunk that belongs to a stream. A stream is a sequence of related chunks,
+     * e.g. the chunks written to a volume. A storage implementation may use the stream
+     * to decide how the chunk is stored.
+     *
+     * The default implementation ignores the stream.
+     *
+     * @return true iff ok, otherwise an error has occurred
+     */
+    virtual bool WriteNewInStream(uint32_t stream_id,
+            const void* key, size_t key_size, const void* data,
+            size_t data_size,
+            bool is_indexed,
+            uint64_t* address,
+            dedupv1::base::ErrorContext* ec);
+
     /**
      * Short reads are possible to the chunk is less offset+size.
      * In this case, read returns the number of read bytes.
@@ -158,6 +243,30 @@ public:
                                                  uint32_t size,
                                                  dedupv1::base::ErrorContext* ec) = 0;
 
+    /**
+     * Reads all given chunks. The read size of each request is set.
+     * In contrast to Read, the requests of a batch may be answered in any order and
+     * implementations are free to process requests of the same address together.
+     *
+     * The default implementation calls Read for each request.
+     *
+     * @return true iff ok, otherwise an error has occurred
+     */
+    virtual bool ReadBatch(const std::vector<StorageReadRequest*>& requests,
+                           dedupv1::base::ErrorContext* ec);
+
+    /**
+     * Hints the storage that the data stored at the given address will be read soon.
+     * Implementations may load the data asynchronously so that later reads are served from
+     * memory. The data is not returned.
+     *
+     * The default implementation ignores the hint.
+     *
+     * @return true if a load has been issued, false if the hint has been ignored, e.g. because
+     * the data is already in memory. An unset option is returned if an error occurred.
+     */
+    virtual dedupv1::base::Option<bool> Prefetch(uint64_t address, dedupv1::base::ErrorContext* ec);
+
     /**
      * Deletes the record from the storage system.
      *
@@ -34,7 +34,7 @@ class MockBlockIndex : public dedupv1::blockindex::BlockIndex {
     }
 
     MOCK_METHOD3(StoreBlock, bool(const dedupv1::blockindex::BlockMapping&, const dedupv1::blockindex::BlockMapping& updated_block_mapping, dedupv1::base::ErrorContext* ec));
-    MOCK_METHOD3(ReadBlockInfo, read_result(dedupv1::Session*, dedupv1::blockindex::BlockMapping* block_mapping, dedupv1::base::ErrorContext* ec));
+    MOCK_METHOD3(ReadBlockInfo, read_result(const dedupv1::Session*, dedupv1::blockindex::BlockMapping* block_mapping, dedupv1::base::ErrorContext* ec));
     MOCK_METHOD2(DeleteBlockInfo, dedupv1::base::delete_result(uint64_t, dedupv1::base::ErrorContext* ec));
 };
 
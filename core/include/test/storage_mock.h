@@ -50,6 +50,9 @@ class MockStorage : public dedupv1::chunkstore::Storage {
                 uint32_t size,
                 dedupv1::base::ErrorContext* ec));
 
+        MOCK_METHOD2(Prefetch, dedupv1::base::Option<bool>(uint64_t address,
+                dedupv1::base::ErrorContext* ec));
+
         MOCK_METHOD4(DeleteChunk, bool(uint64_t address,
               const void* key, size_t key_size,
               dedupv1::base::ErrorContext* ec));
@@ -74,6 +74,8 @@ using dedupv1::chunkstore::STORAGE_ADDRESS_COMMITED;
 using dedupv1::chunkstore::STORAGE_ADDRESS_NOT_COMMITED;
 using dedupv1::chunkstore::STORAGE_ADDRESS_WILL_NEVER_COMMITTED;
 using dedupv1::chunkstore::Storage;
+using dedupv1::chunkstore::READ_CACHE_HINT_NO_POLLUTE;
+using dedupv1::chunkstore::ScopedPoolContainer;
 using dedupv1::base::ScopedArray;
 using dedupv1::Fingerprinter;
 using dedupv1::base::lookup_result;
@@ -167,6 +169,11 @@ bool ChunkIndex::SetOption(const string& option_name, const string& option) {
         import_delay_ = To<uint32_t>(option).value();
         return true;
     }
+    if (StartsWith(option_name, "hot-tier.")) {
+        CHECK(this->hot_tier_.SetOption(option_name.substr(strlen("hot-tier.")),
+                option), "Configuration failed");
+        return true;
+    }
     if (StartsWith(option_name, "in-combats.")) {
         CHECK(this->in_combats_.SetOption(option_name.substr(strlen("in-combats.")),
                 option), "Configuration failed");
@@ -313,6 +320,7 @@ bool ChunkIndex::Start(const StartContext& start_context, DedupSystem* system) {
 
     CHECK(this->chunk_locks_.Start(start_context), "Failed to start chunk locks");
     CHECK(this->in_combats_.Start(start_context, this->log_), "Failed to start chunk in combat");
+    CHECK(this->hot_tier_.Start(), "Failed to start hot tier");
     CHECK(this->chunk_index_->Start(start_context), "Could not start index");
 
     if (dirty_chunk_count_threshold_ == 0) {
@@ -429,6 +437,7 @@ void ChunkIndex::ClearData() {
         delete chunk_index_;
         chunk_index_ = NULL;
     }
+    hot_tier_.Clear();
 }
 
 #endif
@@ -511,12 +520,25 @@ lookup_result ChunkIndex::Lookup(ChunkMapping* mapping,
     ProfileTimer total_timer(this->stats_.profiling_);
     ProfileTimer lookup_timer(this->stats_.lookup_time_);
 
-    enum lookup_result result = this->LookupPersistentIndex(mapping,
-        dedupv1::base::CACHE_LOOKUP_DEFAULT,
-        dedupv1::base::CACHE_ALLOW_DIRTY,
-        ec);
-    CHECK_RETURN(result != LOOKUP_ERROR, LOOKUP_ERROR, "Error while accessing main index: " <<
-        "mapping " << mapping->DebugString());
+    enum lookup_result result = LOOKUP_NOT_FOUND;
+    uint32_t hot_tier_epoch = 0;
+    if (hot_tier_.IsEnabled()) {
+        result = hot_tier_.Lookup(mapping, &hot_tier_epoch);
+        CHECK_RETURN(result != LOOKUP_ERROR, LOOKUP_ERROR, "Error while accessing hot tier: " <<
+            "mapping " << mapping->DebugString());
+    }
+    if (result == LOOKUP_NOT_FOUND) {
+        result = this->LookupPersistentIndex(mapping,
+            dedupv1::base::CACHE_LOOKUP_DEFAULT,
+            dedupv1::base::CACHE_ALLOW_DIRTY,
+            ec);
+        CHECK_RETURN(result != LOOKUP_ERROR, LOOKUP_ERROR, "Error while accessing main index: " <<
+            "mapping " << mapping->DebugString());
+        if (result == LOOKUP_FOUND && hot_tier_.IsEnabled()) {
+            CHECK_RETURN(hot_tier_.Admit(*mapping, hot_tier_epoch), LOOKUP_ERROR,
+                "Failed to admit mapping to hot tier: " << mapping->DebugString());
+        }
+    }
     if (result == LOOKUP_FOUND) {
         TRACE("Lookup chunk mapping " << mapping->DebugString() << ", result found");
     } else {
@@ -570,6 +592,9 @@ bool ChunkIndex::PutPersistentIndex(const ChunkMapping& mapping,
     }
     CHECK(result != PUT_ERROR,
         "Cannot put chunk mapping data: " << mapping.DebugString());
+    if (hot_tier_.IsEnabled()) {
+        CHECK(hot_tier_.Update(mapping), "Failed to update hot tier: " << mapping.DebugString());
+    }
     return true;
 }
 
@@ -582,6 +607,10 @@ bool ChunkIndex::Delete(const ChunkMapping& mapping) {
     TRACE("Delete from persistent chunk index: " << mapping.DebugString());
     enum delete_result result_persistent = this->chunk_index_->Delete(mapping.fingerprint(), mapping.fingerprint_size());
     CHECK(result_persistent != DELETE_ERROR, "Failed to delete mapping from persistent chunk index: " << mapping.DebugString());
+    if (hot_tier_.IsEnabled()) {
+        CHECK(hot_tier_.Remove(mapping.fingerprint(), mapping.fingerprint_size()),
+            "Failed to remove mapping from hot tier: " << mapping.DebugString());
+    }
     return true;
 }
 
@@ -669,6 +698,7 @@ string ChunkIndex::PrintTrace() {
     sstr << "\"index\": " << (chunk_index_ ? this->chunk_index_->PrintTrace() : "null") << "," << std::endl;
     sstr << "\"throttle count\": " << this->stats_.throttle_count_ << "," << std::endl;
     sstr << "\"in combats\": " << this->in_combats_.PrintTrace() << "," << std::endl;
+    sstr << "\"hot tier\": " << (hot_tier_.IsEnabled() ? hot_tier_.PrintTrace() : "null") << "," << std::endl;
     sstr << "\"replaying state\": " << ToString(static_cast<bool>(is_replaying_)) << "," << std::endl;
     sstr << "\"bg container import wait count\": " << this->stats_.bg_container_import_wait_count_ << std::endl;
     sstr << "}";
@@ -701,6 +731,7 @@ string ChunkIndex::PrintStatistics() {
         sstr << "\"dirty cache fill ratio\": null," << std::endl;
     }
 
+    sstr << "\"hot tier\": " << (hot_tier_.IsEnabled() ? hot_tier_.PrintStatistics() : "null") << "," << std::endl;
     sstr << "\"index full failure count\": " << this->stats_.index_full_failure_count_ << "," << std::endl;
     sstr << "\"index item count\": " << (chunk_index_ ? ToString(this->chunk_index_->GetItemCount()) : "null") << ","
          << std::endl;
@@ -718,6 +749,7 @@ string ChunkIndex::PrintProfile() {
     stringstream sstr;
     sstr << "{";
     sstr << "\"in combats\": " << this->in_combats_.PrintProfile() << "," << std::endl;
+    sstr << "\"hot tier\": " << (hot_tier_.IsEnabled() ? hot_tier_.PrintProfile() : "null") << "," << std::endl;
     sstr << "\"average lookup latency\": " << this->stats_.average_lookup_latency_.GetAverage() << "," << std::endl;
     sstr << "\"chunk index\": " << this->stats_.profiling_.GetSum() << "," << std::endl;
     sstr << "\"replay time\": " << this->stats_.replay_time_.GetSum() << "," << std::endl;
@@ -892,9 +924,11 @@ bool ChunkIndex::LoadContainerIntoCache(uint64_t container_id,
     // is committed
 
     TRACE("Load container " << container_id << " from log into cache (loading)");
-    Container container(container_id, container_storage->GetContainerSize(), true);
+    ScopedPoolContainer pool_container(container_storage->container_pool(), container_id, true);
+    CHECK(pool_container.Get(), "Failed to acquire container: container id " << container_id);
+    Container& container(*pool_container);
 
-    enum lookup_result read_result = container_storage->ReadContainerWithCache(&container);
+    enum lookup_result read_result = container_storage->ReadContainerWithCache(&container, READ_CACHE_HINT_NO_POLLUTE);
     CHECK(read_result != LOOKUP_ERROR,
         "Could not read container for import: " <<
         "container id " << container_id <<
@@ -1014,9 +1048,11 @@ bool ChunkIndex::ImportContainer(uint64_t container_id, dedupv1::base::ErrorCont
 
     if (chunk_index_->GetDirtyItemCount() > 0) {
     TRACE("Import container " << container_id << " from log (loading)");
-    Container container(container_id, container_storage->GetContainerSize(), true);
+    ScopedPoolContainer pool_container(container_storage->container_pool(), container_id, true);
+    CHECK(pool_container.Get(), "Failed to acquire container: container id " << container_id);
+    Container& container(*pool_container);
 
-        enum lookup_result read_result = container_storage->ReadContainerWithCache(&container);
+        enum lookup_result read_result = container_storage->ReadContainerWithCache(&container, READ_CACHE_HINT_NO_POLLUTE);
         CHECK(read_result != LOOKUP_ERROR,
             "Could not read container for import: " <<
             "container id " << container_id <<
@@ -1088,6 +1124,18 @@ bool ChunkIndex::HandleContainerCommitFailed(const ContainerCommitFailedEventDat
             WARNING("Cannot find item of failed container in cache: " <<
                 "container id " << event_data.container_id() <<
                 ", key " << Fingerprinter::DebugString(event_data.item_key(i)));
+        } else if (chunk_mapping.data_address() == event_data.container_id() &&
+                chunk_mapping.superseded_data_address() != Storage::ILLEGAL_STORAGE_ADDRESS) {
+            // the failed container stored a rewritten copy. The older copy is still valid and
+            // referenced by the block mappings written before the rewrite.
+            chunk_mapping.set_data_address(chunk_mapping.superseded_data_address());
+            chunk_mapping.set_superseded_data_address(Storage::ILLEGAL_STORAGE_ADDRESS);
+            TRACE("Restore superseded address: " << chunk_mapping.DebugString());
+            if (!PutPersistentIndex(chunk_mapping, false, false, NO_EC)) {
+                ERROR("Failed to restore item of failed container: " << "container id " << event_data.container_id()
+                                                                     << ", chunk " << chunk_mapping.DebugString());
+                failed = true;
+            }
         } else if (/*r == LOOKUP_FOUND && */ chunk_mapping.data_address() == event_data.container_id()) {
             TRACE("Delete from chunk index: " << chunk_mapping.DebugString());
             delete_result dr = this->chunk_index_->Delete(chunk_mapping.fingerprint(),
@@ -1097,6 +1145,10 @@ bool ChunkIndex::HandleContainerCommitFailed(const ContainerCommitFailedEventDat
                                                                     << ", key " << Fingerprinter::DebugString(event_data.item_key(i)));
                 failed = true;
             }
+            if (hot_tier_.IsEnabled() && !hot_tier_.Remove(chunk_mapping.fingerprint(), chunk_mapping.fingerprint_size())) {
+                ERROR("Failed to remove item of failed container from hot tier: " << chunk_mapping.DebugString());
+                failed = true;
+            }
         }
     }
     return !failed;
@@ -32,6 +32,7 @@
 #include <base/hashing_util.h>
 #include <core/fingerprinter.h>
 #include <core/storage.h>
+#include <core/dedup_volume.h>
 
 #include "dedupv1_stats.pb.h"
 
@@ -52,6 +53,7 @@ using dedupv1::chunkstore::Storage;
 using dedupv1::base::ErrorContext;
 using dedupv1::chunkindex::ChunkIndexSamplingStrategy;
 using dedupv1::base::Option;
+using dedupv1::base::strutil::StartsWith;
 
 LOGGER("ChunkIndexFilter");
 
@@ -66,11 +68,13 @@ ChunkIndexFilter::Statistics::Statistics() : average_latency_(256) {
     writes_ = 0;
     failures_ = 0;
     anchor_count_ = 0;
+    rewrites_ = 0;
 }
 
 ChunkIndexFilter::ChunkIndexFilter() :
     Filter("chunk-index-filter", FILTER_STRONG_MAYBE) {
     this->chunk_index_ = NULL;
+    this->rewrite_enabled_ = false;
 }
 
 ChunkIndexFilter::~ChunkIndexFilter() {
@@ -90,9 +94,27 @@ bool ChunkIndexFilter::Start(DedupSystem* system) {
     DCHECK(system->chunk_index(), "Chunk Index not set");
 
     this->chunk_index_ = system->chunk_index();
+    if (rewrite_enabled_) {
+        CHECK(rewrite_policy_.Start(), "Failed to start rewrite policy");
+    }
     return true;
 }
 
+bool ChunkIndexFilter::SetOption(const string& option_name, const string& option) {
+    if (option_name == "rewrite") {
+        Option<bool> b = To<bool>(option);
+        CHECK(b.valid(), "Illegal option value: " << option_name << "=" << option);
+        rewrite_enabled_ = b.value();
+        return true;
+    }
+    if (StartsWith(option_name, "rewrite.")) {
+        CHECK(rewrite_policy_.SetOption(option_name.substr(strlen("rewrite.")), option),
+            "Configuration failed");
+        return true;
+    }
+    return Filter::SetOption(option_name, option);
+}
+
 bool ChunkIndexFilter::ReleaseChunkLock(const dedupv1::chunkindex::ChunkMapping& mapping) {
     DCHECK(this->chunk_index_ != NULL, "Chunk index filter not started");
     return this->chunk_index_->chunk_locks().Unlock(mapping.fingerprint(), mapping.fingerprint_size());
@@ -123,6 +145,10 @@ Filter::filter_result ChunkIndexFilter::Check(Session* session,
     }
     stats_.anchor_count_++;
 
+    if (rewrite_enabled_ && session && session->volume() && mapping->chunk()) {
+        rewrite_policy_.OnWrite(session->volume()->GetId(), mapping->chunk()->size());
+    }
+
     TRACE("Chunk is anchor: " << mapping->DebugString());
 
     CHECK_RETURN(AcquireChunkLock(*mapping), FILTER_ERROR,
@@ -142,9 +168,20 @@ Filter::filter_result ChunkIndexFilter::Check(Session* session,
         }
         // with the normal chunk index filter, all chunks are indexed
     } else if (index_result == LOOKUP_FOUND) {
-        mapping->set_usage_count(0); // TODO (dmeister): Why???
-        this->stats_.strong_hits_++;
-        result = FILTER_STRONG_MAYBE;
+        if (rewrite_enabled_ && ShouldRewrite(session, *mapping)) {
+            // the usage count is kept so that the put in Update
+            // only changes the data address
+            TRACE("Rewrite chunk: " << mapping->DebugString());
+            // the old copy is freed by the gc together with the new copy
+            mapping->set_superseded_data_address(mapping->data_address());
+            mapping->set_data_address(Storage::ILLEGAL_STORAGE_ADDRESS);
+            this->stats_.rewrites_++;
+            result = FILTER_NOT_EXISTING;
+        } else {
+            mapping->set_usage_count(0); // TODO (dmeister): Why???
+            this->stats_.strong_hits_++;
+            result = FILTER_STRONG_MAYBE;
+        }
     } else if (index_result == LOOKUP_ERROR) {
         ERROR("Chunk index filter lookup failed: " <<
             "mapping " << mapping->DebugString());
@@ -160,6 +197,25 @@ Filter::filter_result ChunkIndexFilter::Check(Session* session,
     return result;
 }
 
+bool ChunkIndexFilter::ShouldRewrite(Session* session, const ChunkMapping& mapping) {
+    if (session == NULL || session->volume() == NULL) {
+        return false;
+    }
+    if (mapping.usage_count() <= 0) {
+        // the chunk might be in the process of being garbage collected
+        return false;
+    }
+    if (!Storage::IsValidAddress(mapping.data_address(), false)) {
+        return false;
+    }
+    if (mapping.superseded_data_address() != Storage::ILLEGAL_STORAGE_ADDRESS) {
+        // only a single older copy is tracked
+        return false;
+    }
+    return rewrite_policy_.ShouldRewrite(session->volume()->GetId(),
+        mapping.data_address(), mapping.chunk() ? mapping.chunk()->size() : 0);
+}
+
 bool ChunkIndexFilter::Update(Session* session,
                               const BlockMapping* block_mapping,
                               ChunkMapping* mapping,
@@ -240,7 +296,13 @@ string ChunkIndexFilter::PrintStatistics() {
     sstr << "\"weak\": " << this->stats_.weak_hits_ << "," << std::endl;
     sstr << "\"failures\": " << this->stats_.failures_ << "," << std::endl;
     sstr << "\"anchor count\": " << this->stats_.anchor_count_ << "," << std::endl;
-    sstr << "\"miss\": " << this->stats_.miss_ << std::endl;
+    sstr << "\"miss\": " << this->stats_.miss_ << "," << std::endl;
+    sstr << "\"rewrites\": " << this->stats_.rewrites_ << "," << std::endl;
+    if (rewrite_enabled_) {
+        sstr << "\"rewrite\": " << rewrite_policy_.PrintStatistics() << std::endl;
+    } else {
+        sstr << "\"rewrite\": null" << std::endl;
+    }
     sstr << "}";
     return sstr.str();
 }
@@ -0,0 +1,399 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <core/chunk_index_hot_tier.h>
+#include <core/fingerprinter.h>
+#include <base/logging.h>
+#include <base/strutil.h>
+#include <base/hashing_util.h>
+
+#include <string.h>
+#include <sstream>
+
+using std::string;
+using std::stringstream;
+using dedupv1::base::strutil::ToStorageUnit;
+using dedupv1::base::strutil::To;
+using dedupv1::base::lookup_result;
+using dedupv1::base::LOOKUP_FOUND;
+using dedupv1::base::LOOKUP_NOT_FOUND;
+using dedupv1::base::ProfileTimer;
+using dedupv1::base::murmur_hash3_x86_128;
+using tbb::spin_mutex;
+
+LOGGER("ChunkIndex");
+
+namespace dedupv1 {
+namespace chunkindex {
+
+ChunkIndexHotTier::Statistics::Statistics() {
+    hit_count_ = 0;
+    miss_count_ = 0;
+    admit_count_ = 0;
+    reject_count_ = 0;
+    evict_count_ = 0;
+    update_count_ = 0;
+    remove_count_ = 0;
+    aging_count_ = 0;
+}
+
+ChunkIndexHotTier::ChunkIndexHotTier() {
+    size_ = 0;
+    admission_ = true;
+    sets_ = NULL;
+    set_count_ = 0;
+    sketch_ = NULL;
+    sketch_width_ = 0;
+    sample_count_ = 0;
+    aging_threshold_ = 0;
+    access_clock_ = 0;
+    started_ = false;
+}
+
+ChunkIndexHotTier::~ChunkIndexHotTier() {
+    if (sets_) {
+        delete[] sets_;
+        sets_ = NULL;
+    }
+    if (sketch_) {
+        delete[] sketch_;
+        sketch_ = NULL;
+    }
+}
+
+bool ChunkIndexHotTier::SetOption(const string& option_name, const string& option) {
+    CHECK(!started_, "Hot tier already started");
+    if (option_name == "size") {
+        CHECK(ToStorageUnit(option).valid(), "Illegal option " << option);
+        CHECK(ToStorageUnit(option).value() >= 0, "Illegal size " << option);
+        size_ = ToStorageUnit(option).value();
+        return true;
+    }
+    if (option_name == "admission") {
+        CHECK(To<bool>(option).valid(), "Illegal option " << option);
+        admission_ = To<bool>(option).value();
+        return true;
+    }
+    ERROR("Illegal option: " << option_name);
+    return false;
+}
+
+bool ChunkIndexHotTier::Start() {
+    CHECK(!started_, "Hot tier already started");
+    started_ = true;
+    if (size_ == 0) {
+        DEBUG("Hot tier disabled");
+        return true;
+    }
+
+    set_count_ = (size_ + kWays - 1) / kWays;
+    sets_ = new Set[set_count_];
+    CHECK(sets_, "Failed to alloc hot tier");
+    for (uint64_t i = 0; i < set_count_; i++) {
+        sets_[i].epoch_ = 0;
+        memset(sets_[i].entries_, 0, sizeof(sets_[i].entries_));
+    }
+
+    sketch_width_ = kMinSketchWidth;
+    while (sketch_width_ < size_) {
+        sketch_width_ <<= 1;
+    }
+    sketch_ = new tbb::atomic<uint8_t>[kSketchDepth * sketch_width_];
+    CHECK(sketch_, "Failed to alloc hot tier sketch");
+    for (uint64_t i = 0; i < kSketchDepth * sketch_width_; i++) {
+        sketch_[i] = 0;
+    }
+    aging_threshold_ = kSampleFactor * size_;
+
+    INFO("Starting hot tier: " <<
+        "entries " << set_count_ * kWays <<
+        ", sets " << set_count_ <<
+        ", sketch width " << sketch_width_ <<
+        ", admission " << (admission_ ? "tinylfu" : "none") <<
+        ", memory " << (set_count_ * sizeof(Set) + kSketchDepth * sketch_width_));
+    return true;
+}
+
+void ChunkIndexHotTier::Hash(const void* fp, size_t fp_size, uint32_t* hash_values) {
+    murmur_hash3_x86_128(fp, fp_size, 0, hash_values);
+}
+
+ChunkIndexHotTier::Set* ChunkIndexHotTier::GetSet(const uint32_t* hash_values) {
+    uint64_t h = (static_cast<uint64_t>(hash_values[0]) << 32) | hash_values[1];
+    return &sets_[h % set_count_];
+}
+
+ChunkIndexHotTier::Entry* ChunkIndexHotTier::FindEntry(Set* set, const void* fp, size_t fp_size) {
+    for (uint32_t i = 0; i < kWays; i++) {
+        Entry* entry = &set->entries_[i];
+        if (entry->key_size_ == fp_size && memcmp(entry->key_, fp, fp_size) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void ChunkIndexHotTier::RecordAccess(const uint32_t* hash_values) {
+    for (uint32_t i = 0; i < kSketchDepth; i++) {
+        tbb::atomic<uint8_t>& counter = sketch_[i * sketch_width_ + (hash_values[i] & (sketch_width_ - 1))];
+        uint8_t value = counter;
+        while (value < kMaxFrequency) {
+            uint8_t old_value = counter.compare_and_swap(value + 1, value);
+            if (old_value == value) {
+                break;
+            }
+            value = old_value;
+        }
+    }
+    // exactly one thread observes the threshold
+    if (sample_count_.fetch_and_increment() + 1 == aging_threshold_) {
+        Age();
+    }
+}
+
+uint8_t ChunkIndexHotTier::EstimateFrequency(const uint32_t* hash_values) {
+    uint8_t frequency = kMaxFrequency;
+    for (uint32_t i = 0; i < kSketchDepth; i++) {
+        uint8_t value = sketch_[i * sketch_width_ + (hash_values[i] & (sketch_width_ - 1))];
+        if (value < frequency) {
+            frequency = value;
+        }
+    }
+    return frequency;
+}
+
+void ChunkIndexHotTier::Age() {
+    TRACE("Aging hot tier sketch");
+    for (uint64_t i = 0; i < kSketchDepth * sketch_width_; i++) {
+        uint8_t value = sketch_[i];
+        while (value > 0) {
+            uint8_t old_value = sketch_[i].compare_and_swap(value >> 1, value);
+            if (old_value == value) {
+                break;
+            }
+            value = old_value;
+        }
+    }
+    sample_count_ = 0;
+    stats_.aging_count_++;
+}
+
+void ChunkIndexHotTier::CopyToEntry(const ChunkMapping& mapping, Entry* entry) {
+    memcpy(entry->key_, mapping.fingerprint(), mapping.fingerprint_size());
+    entry->key_size_ = mapping.fingerprint_size();
+    entry->data_address_ = mapping.data_address();
+    entry->usage_count_ = mapping.usage_count();
+    entry->usage_count_change_log_id_ = mapping.usage_count_change_log_id();
+    entry->usage_count_failed_write_change_log_id_ = mapping.usage_count_failed_write_change_log_id();
+    entry->has_block_hint_ = mapping.has_block_hint();
+    entry->block_hint_ = mapping.has_block_hint() ? mapping.block_hint() : 0;
+}
+
+lookup_result ChunkIndexHotTier::Lookup(ChunkMapping* mapping, uint32_t* epoch) {
+    DCHECK_RETURN(mapping, dedupv1::base::LOOKUP_ERROR, "Mapping not set");
+    DCHECK_RETURN(epoch, dedupv1::base::LOOKUP_ERROR, "Epoch not set");
+    DCHECK_RETURN(IsEnabled(), dedupv1::base::LOOKUP_ERROR, "Hot tier not enabled");
+    ProfileTimer timer(stats_.lookup_time_);
+
+    if (mapping->fingerprint_size() == 0 || mapping->fingerprint_size() > kMaxKeySize) {
+        stats_.miss_count_++;
+        return LOOKUP_NOT_FOUND;
+    }
+
+    uint32_t hash_values[kSketchDepth];
+    Hash(mapping->fingerprint(), mapping->fingerprint_size(), hash_values);
+    RecordAccess(hash_values);
+
+    Set* set = GetSet(hash_values);
+    spin_mutex::scoped_lock scoped_lock(set->lock_);
+    *epoch = set->epoch_;
+    Entry* entry = FindEntry(set, mapping->fingerprint(), mapping->fingerprint_size());
+    if (entry == NULL) {
+        stats_.miss_count_++;
+        return LOOKUP_NOT_FOUND;
+    }
+    entry->last_access_ = access_clock_.fetch_and_increment();
+
+    mapping->set_data_address(entry->data_address_);
+    mapping->set_known_chunk(true);
+    mapping->set_usage_count(entry->usage_count_);
+    mapping->set_usage_count_change_log_id(entry->usage_count_change_log_id_);
+    mapping->set_usage_count_failed_write_change_log_id(entry->usage_count_failed_write_change_log_id_);
+    if (entry->has_block_hint_) {
+        mapping->set_block_hint(entry->block_hint_);
+    } else {
+        mapping->clear_block_hint();
+    }
+    stats_.hit_count_++;
+    return LOOKUP_FOUND;
+}
+
+bool ChunkIndexHotTier::Admit(const ChunkMapping& mapping, uint32_t epoch) {
+    DCHECK(IsEnabled(), "Hot tier not enabled");
+    if (mapping.fingerprint_size() == 0 || mapping.fingerprint_size() > kMaxKeySize) {
+        return true;
+    }
+
+    uint32_t hash_values[kSketchDepth];
+    Hash(mapping.fingerprint(), mapping.fingerprint_size(), hash_values);
+
+    Set* set = GetSet(hash_values);
+    spin_mutex::scoped_lock scoped_lock(set->lock_);
+    if (set->epoch_ != epoch) {
+        // the set has been changed since the lookup. The persistent
+        // data might be outdated
+        stats_.reject_count_++;
+        return true;
+    }
+    if (FindEntry(set, mapping.fingerprint(), mapping.fingerprint_size()) != NULL) {
+        // admitted by a concurrent lookup
+        return true;
+    }
+
+    Entry* victim = NULL;
+    for (uint32_t i = 0; i < kWays; i++) {
+        Entry* entry = &set->entries_[i];
+        if (entry->key_size_ == 0) {
+            victim = entry;
+            break;
+        }
+        if (victim == NULL || entry->last_access_ < victim->last_access_) {
+            victim = entry;
+        }
+    }
+    DCHECK(victim, "Victim not set");
+
+    if (victim->key_size_ > 0) {
+        if (admission_) {
+            uint32_t victim_hash_values[kSketchDepth];
+            Hash(victim->key_, victim->key_size_, victim_hash_values);
+            if (EstimateFrequency(hash_values) <= EstimateFrequency(victim_hash_values)) {
+                stats_.reject_count_++;
+                return true;
+            }
+        }
+        stats_.evict_count_++;
+    }
+    CopyToEntry(mapping, victim);
+    victim->last_access_ = access_clock_.fetch_and_increment();
+    stats_.admit_count_++;
+    return true;
+}
+
+bool ChunkIndexHotTier::Update(const ChunkMapping& mapping) {
+    DCHECK(IsEnabled(), "Hot tier not enabled");
+    if (mapping.fingerprint_size() == 0 || mapping.fingerprint_size() > kMaxKeySize) {
+        return true;
+    }
+    ProfileTimer timer(stats_.update_time_);
+
+    uint32_t hash_values[kSketchDepth];
+    Hash(mapping.fingerprint(), mapping.fingerprint_size(), hash_values);
+
+    Set* set = GetSet(hash_values);
+    spin_mutex::scoped_lock scoped_lock(set->lock_);
+    set->epoch_++;
+    Entry* entry = FindEntry(set, mapping.fingerprint(), mapping.fingerprint_size());
+    if (entry) {
+        CopyToEntry(mapping, entry);
+        stats_.update_count_++;
+    }
+    return true;
+}
+
+bool ChunkIndexHotTier::Remove(const void* fp, size_t fp_size) {
+    DCHECK(IsEnabled(), "Hot tier not enabled");
+    if (fp_size == 0 || fp_size > kMaxKeySize) {
+        return true;
+    }
+    ProfileTimer timer(stats_.update_time_);
+
+    uint32_t hash_values[kSketchDepth];
+    Hash(fp, fp_size, hash_values);
+
+    Set* set = GetSet(hash_values);
+    spin_mutex::scoped_lock scoped_lock(set->lock_);
+    set->epoch_++;
+    Entry* entry = FindEntry(set, fp, fp_size);
+    if (entry) {
+        memset(entry, 0, sizeof(Entry));
+        stats_.remove_count_++;
+    }
+    return true;
+}
+
+bool ChunkIndexHotTier::Clear() {
+    if (!IsEnabled()) {
+        return true;
+    }
+    DEBUG("Clear hot tier");
+    for (uint64_t i = 0; i < set_count_; i++) {
+        spin_mutex::scoped_lock scoped_lock(sets_[i].lock_);
+        sets_[i].epoch_++;
+        memset(sets_[i].entries_, 0, sizeof(sets_[i].entries_));
+    }
+    return true;
+}
+
+string ChunkIndexHotTier::PrintStatistics() {
+    stringstream sstr;
+    sstr.setf(std::ios::fixed, std::ios::floatfield);
+    sstr.setf(std::ios::showpoint);
+    sstr.precision(3);
+
+    uint64_t lookup_count = stats_.hit_count_ + stats_.miss_count_;
+    sstr << "{";
+    if (lookup_count > 0) {
+        sstr << "\"hit ratio\": " << (1.0 * stats_.hit_count_ / lookup_count) << "," << std::endl;
+    } else {
+        sstr << "\"hit ratio\": null," << std::endl;
+    }
+    sstr << "\"hits\": " << stats_.hit_count_ << "," << std::endl;
+    sstr << "\"misses\": " << stats_.miss_count_ << "," << std::endl;
+    sstr << "\"admitted\": " << stats_.admit_count_ << "," << std::endl;
+    sstr << "\"rejected\": " << stats_.reject_count_ << "," << std::endl;
+    sstr << "\"evicted\": " << stats_.evict_count_ << "," << std::endl;
+    sstr << "\"updated\": " << stats_.update_count_ << "," << std::endl;
+    sstr << "\"removed\": " << stats_.remove_count_ << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+string ChunkIndexHotTier::PrintTrace() {
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"size\": " << set_count_ * kWays << "," << std::endl;
+    sstr << "\"sketch samples\": " << sample_count_ << "," << std::endl;
+    sstr << "\"sketch agings\": " << stats_.aging_count_ << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+string ChunkIndexHotTier::PrintProfile() {
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"lookup time\": " << stats_.lookup_time_.GetSum() << "," << std::endl;
+    sstr << "\"update time\": " << stats_.update_time_.GetSum() << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+}
+}
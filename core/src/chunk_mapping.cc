@@ -46,6 +46,7 @@ ChunkMapping::ChunkMapping() {
     this->fp_size_ = 0;
     this->chunk_ = NULL;
     this->data_address_ = Storage::ILLEGAL_STORAGE_ADDRESS;
+    this->superseded_data_address_ = Storage::ILLEGAL_STORAGE_ADDRESS;
     this->known_chunk_ = false;
     this->usage_count_ = 0;
     this->usage_count_change_log_id_ = 0;
@@ -60,6 +61,7 @@ ChunkMapping::ChunkMapping(const byte* fp, size_t fp_size) {
     memcpy(this->fp_, fp, fp_size);
     this->chunk_ = NULL;
     this->data_address_ = Storage::ILLEGAL_STORAGE_ADDRESS;
+    this->superseded_data_address_ = Storage::ILLEGAL_STORAGE_ADDRESS;
     this->known_chunk_ = false;
     this->usage_count_ = 0;
     this->usage_count_change_log_id_ = 0;
@@ -74,6 +76,7 @@ ChunkMapping::ChunkMapping(const bytestring& fp) {
     memcpy(this->fp_, fp.data(), this->fp_size_);
     this->chunk_ = NULL;
     this->data_address_ = Storage::ILLEGAL_STORAGE_ADDRESS;
+    this->superseded_data_address_ = Storage::ILLEGAL_STORAGE_ADDRESS;
     this->known_chunk_ = false;
     this->usage_count_ = 0;
     this->usage_count_change_log_id_ = 0;
@@ -86,6 +89,7 @@ ChunkMapping::ChunkMapping(const bytestring& fp) {
 bool ChunkMapping::Init(const Chunk* chunk) {
     this->chunk_ = chunk;
     this->data_address_ = Storage::ILLEGAL_STORAGE_ADDRESS;
+    this->superseded_data_address_ = Storage::ILLEGAL_STORAGE_ADDRESS;
     this->known_chunk_ = false;
     this->usage_count_ = 0;
     this->usage_count_change_log_id_ = 0;
@@ -106,6 +110,9 @@ bool ChunkMapping::SerializeTo(ChunkMappingData* data) const {
     if (this->usage_count() != 0) {
         data->set_usage_count(this->usage_count());
     }
+    if (this->superseded_data_address() != Storage::ILLEGAL_STORAGE_ADDRESS) {
+        data->set_superseded_data_address(this->superseded_data_address());
+    }
     if (this->usage_count_change_log_id() > 0) {
         data->set_usage_count_change_log_id(this->usage_count_change_log_id());
     }
@@ -127,6 +134,12 @@ bool ChunkMapping::UnserializeFrom(const ChunkMappingData& data, bool preserve_c
         this->usage_count_ = 0;
     }
 
+    if (data.has_superseded_data_address()) {
+        this->superseded_data_address_ = data.superseded_data_address();
+    } else {
+        this->superseded_data_address_ = Storage::ILLEGAL_STORAGE_ADDRESS;
+    }
+
     if (data.has_last_block_hint()) {
         this->set_block_hint(data.last_block_hint());
     } else {
@@ -164,6 +177,9 @@ string ChunkMapping::DebugString() const {
     } else {
         s << ", address " << this->data_address();
     }
+    if (this->superseded_data_address() != Storage::ILLEGAL_STORAGE_ADDRESS) {
+        s << ", superseded address " << this->superseded_data_address();
+    }
     s << ", usage count " << this->usage_count();
     s << ", usage count change log id " << this->usage_count_change_log_id();
     s << ", usage count failed write change log id " << this->usage_count_failed_write_change_log_id();
@@ -0,0 +1,195 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <core/chunk_rewrite_policy.h>
+#include <base/logging.h>
+#include <base/strutil.h>
+
+#include <sstream>
+
+using std::string;
+using std::stringstream;
+using std::map;
+using dedupv1::base::strutil::To;
+using dedupv1::base::strutil::ToStorageUnit;
+using tbb::spin_mutex;
+
+LOGGER("ChunkRewritePolicy");
+
+namespace dedupv1 {
+namespace filter {
+
+ChunkRewritePolicy::VolumeState::VolumeState() {
+    written_bytes_ = 0;
+    duplicate_count_ = 0;
+    rewrite_count_ = 0;
+    rewrite_bytes_ = 0;
+    capped_count_ = 0;
+}
+
+ChunkRewritePolicy::ChunkRewritePolicy() {
+    window_size_ = kDefaultWindowSize;
+    container_threshold_ = kDefaultContainerThreshold;
+    min_references_ = kDefaultMinReferences;
+    max_ratio_ = 0.05;
+    started_ = false;
+}
+
+ChunkRewritePolicy::~ChunkRewritePolicy() {
+    map<uint32_t, VolumeState*>::iterator i;
+    for (i = volumes_.begin(); i != volumes_.end(); i++) {
+        delete i->second;
+    }
+    volumes_.clear();
+}
+
+bool ChunkRewritePolicy::SetOption(const string& option_name, const string& option) {
+    CHECK(!started_, "Rewrite policy already started");
+    if (option_name == "window-size") {
+        CHECK(ToStorageUnit(option).valid(), "Illegal option " << option);
+        CHECK(ToStorageUnit(option).value() > 0, "Illegal window size " << option);
+        window_size_ = ToStorageUnit(option).value();
+        return true;
+    }
+    if (option_name == "container-threshold") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        container_threshold_ = To<uint32_t>(option).value();
+        return true;
+    }
+    if (option_name == "min-references") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        min_references_ = To<uint32_t>(option).value();
+        return true;
+    }
+    if (option_name == "max-ratio") {
+        CHECK(To<double>(option).valid(), "Illegal option " << option);
+        CHECK(To<double>(option).value() >= 0.0 && To<double>(option).value() <= 1.0, "Illegal max ratio " << option);
+        max_ratio_ = To<double>(option).value();
+        return true;
+    }
+    ERROR("Illegal option: " << option_name);
+    return false;
+}
+
+bool ChunkRewritePolicy::Start() {
+    CHECK(!started_, "Rewrite policy already started");
+    CHECK(container_threshold_ < window_size_,
+        "Container threshold must be smaller than the window size: " <<
+        "container threshold " << container_threshold_ <<
+        ", window size " << window_size_);
+    started_ = true;
+    return true;
+}
+
+ChunkRewritePolicy::VolumeState* ChunkRewritePolicy::GetVolumeState(uint32_t volume_id) {
+    spin_mutex::scoped_lock l(volume_lock_);
+    map<uint32_t, VolumeState*>::iterator i = volumes_.find(volume_id);
+    if (i != volumes_.end()) {
+        return i->second;
+    }
+    VolumeState* state = new VolumeState();
+    volumes_[volume_id] = state;
+    return state;
+}
+
+void ChunkRewritePolicy::AddToWindow(VolumeState* state, uint64_t container_id) {
+    state->window_.push_back(container_id);
+    state->container_counts_[container_id]++;
+
+    if (state->window_.size() > window_size_) {
+        uint64_t old_container_id = state->window_.front();
+        state->window_.pop_front();
+        map<uint64_t, uint32_t>::iterator i = state->container_counts_.find(old_container_id);
+        if (i != state->container_counts_.end()) {
+            i->second--;
+            if (i->second == 0) {
+                state->container_counts_.erase(i);
+            }
+        }
+    }
+}
+
+void ChunkRewritePolicy::OnWrite(uint32_t volume_id, size_t chunk_size) {
+    VolumeState* state = GetVolumeState(volume_id);
+    spin_mutex::scoped_lock l(state->lock_);
+    state->written_bytes_ += chunk_size;
+}
+
+bool ChunkRewritePolicy::ShouldRewrite(uint32_t volume_id, uint64_t container_id, size_t chunk_size) {
+    DCHECK(started_, "Rewrite policy not started");
+    VolumeState* state = GetVolumeState(volume_id);
+    spin_mutex::scoped_lock l(state->lock_);
+    state->duplicate_count_++;
+
+    if (state->container_counts_.size() <= container_threshold_) {
+        AddToWindow(state, container_id);
+        return false;
+    }
+    map<uint64_t, uint32_t>::const_iterator i = state->container_counts_.find(container_id);
+    if (i != state->container_counts_.end() && i->second >= min_references_) {
+        // the container is read anyway during a restore
+        AddToWindow(state, container_id);
+        return false;
+    }
+    if (state->rewrite_bytes_ + chunk_size > max_ratio_ * state->written_bytes_) {
+        state->capped_count_++;
+        AddToWindow(state, container_id);
+        return false;
+    }
+    // the rewritten chunk is stored in the current container, it is not
+    // added to the window
+    state->rewrite_count_++;
+    state->rewrite_bytes_ += chunk_size;
+    return true;
+}
+
+uint32_t ChunkRewritePolicy::GetFragmentation(uint32_t volume_id) {
+    VolumeState* state = GetVolumeState(volume_id);
+    spin_mutex::scoped_lock l(state->lock_);
+    return state->container_counts_.size();
+}
+
+string ChunkRewritePolicy::PrintStatistics() {
+    stringstream sstr;
+    sstr << "{";
+    spin_mutex::scoped_lock l(volume_lock_);
+    map<uint32_t, VolumeState*>::iterator i;
+    for (i = volumes_.begin(); i != volumes_.end(); i++) {
+        if (i != volumes_.begin()) {
+            sstr << "," << std::endl;
+        }
+        VolumeState* state = i->second;
+        spin_mutex::scoped_lock sl(state->lock_);
+        sstr << "\"" << i->first << "\": {";
+        sstr << "\"fragmentation\": " << state->container_counts_.size() << "," << std::endl;
+        sstr << "\"window size\": " << state->window_.size() << "," << std::endl;
+        sstr << "\"written bytes\": " << state->written_bytes_ << "," << std::endl;
+        sstr << "\"duplicate count\": " << state->duplicate_count_ << "," << std::endl;
+        sstr << "\"rewrite count\": " << state->rewrite_count_ << "," << std::endl;
+        sstr << "\"rewrite bytes\": " << state->rewrite_bytes_ << "," << std::endl;
+        sstr << "\"capped count\": " << state->capped_count_ << std::endl;
+        sstr << "}";
+    }
+    sstr << "}";
+    return sstr.str();
+}
+
+}
+}
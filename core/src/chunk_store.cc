@@ -110,6 +110,7 @@ ChunkStore::~ChunkStore() {
 }
 
 bool ChunkStore::WriteBlock(ChunkMapping* chunk_mapping,
+                            uint32_t stream_id,
                             ErrorContext* ec) {
     ProfileTimer timer(this->stats_.time_);
 
@@ -121,7 +122,8 @@ bool ChunkStore::WriteBlock(ChunkMapping* chunk_mapping,
         chunk_mapping->data_address() == Storage::ILLEGAL_STORAGE_ADDRESS) {
         // write to storage if necessary
         uint64_t new_address = Storage::ILLEGAL_STORAGE_ADDRESS;
-        CHECK(chunk_storage_->WriteNew(chunk_mapping->fingerprint(),
+        CHECK(chunk_storage_->WriteNewInStream(stream_id,
+                chunk_mapping->fingerprint(),
                 chunk_mapping->fingerprint_size(),
                 chunk_mapping->chunk()->data(),
                 chunk_mapping->chunk()->size(),
@@ -176,6 +178,40 @@ bool ChunkStore::ReadBlock(BlockMappingItem* item,
     return true;
 }
 
+bool ChunkStore::ReadBlocks(const vector<StorageReadRequest*>& requests,
+                            ErrorContext* ec) {
+    ProfileTimer timer(this->stats_.time_);
+
+    vector<StorageReadRequest*> storage_requests;
+    vector<StorageReadRequest*>::const_iterator i;
+    for (i = requests.begin(); i != requests.end(); i++) {
+        StorageReadRequest* request = *i;
+        CHECK(request, "Request not set");
+        CHECK(request->data(), "Buffer not set");
+        CHECK(request->size() > 0, "Buffer size value not set");
+
+        if (request->address() == Storage::EMPTY_DATA_STORAGE_ADDRESS) { // Null Chunk
+            memset(request->data(), 0, request->size());
+            request->set_read_size(request->size());
+        } else {
+            storage_requests.push_back(request);
+        }
+    }
+    if (!storage_requests.empty()) {
+        CHECK(chunk_storage_->ReadBatch(storage_requests, ec),
+            "Reading of chunks failed: " << storage_requests.size() << " chunks");
+    }
+    for (i = requests.begin(); i != requests.end(); i++) {
+        StorageReadRequest* request = *i;
+        CHECK(request->read_size() == request->size(),
+            "Reading of chunk failed: " << request->DebugString() <<
+            ", read size " << request->read_size());
+        this->stats_.storage_reads_++;
+        this->stats_.storage_reads_bytes_ += request->size();
+    }
+    return true;
+}
+
 string ChunkStore::PrintLockStatistics() {
     return this->chunk_storage_->PrintLockStatistics();
 }
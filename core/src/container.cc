@@ -20,7 +20,11 @@
 #include <core/container.h>
 
 #include <ctime>
+#include <new>
+#include <algorithm>
 #include <sstream>
+#include <sys/mman.h>
+#include <errno.h>
 
 #include <dedupv1.pb.h>
 
@@ -29,6 +33,7 @@
 #include <base/hashing_util.h>
 #include <base/strutil.h>
 #include <base/crc32.h>
+#include <base/crc32c.h>
 #include <base/sha1.h>
 #include <core/fingerprinter.h>
 #include <base/fileutil.h>
@@ -36,13 +41,17 @@
 #include <base/compress.h>
 #include <core/storage.h>
 #include <base/adler32.h>
+#include <base/memory.h>
 
 using std::set;
 using std::vector;
+using std::pair;
+using std::make_pair;
 using std::string;
 using std::stringstream;
 using dedupv1::base::Compression;
 using dedupv1::base::File;
+using dedupv1::base::IOScheduler;
 using dedupv1::Fingerprinter;
 using dedupv1::base::strutil::ToString;
 using dedupv1::base::strutil::ToHexString;
@@ -50,8 +59,11 @@ using dedupv1::base::ParseSizedMessage;
 using dedupv1::base::SerializeSizedMessage;
 using dedupv1::base::raw_compare;
 using dedupv1::base::Option;
+using dedupv1::base::make_option;
+using dedupv1::base::ScopedArray;
 using dedupv1::base::crc;
 using dedupv1::base::AdlerChecksum;
+using dedupv1::base::crc32c_raw;
 using dedupv1::base::sha1;
 
 LOGGER("Container");
@@ -59,10 +71,34 @@ LOGGER("Container");
 namespace dedupv1 {
 namespace chunkstore {
 
+namespace {
+
+/**
+ * Orders (key prefix, item) pairs in the same way as raw_compare orders the keys.
+ * The full key is only compared if the prefixes are equal.
+ */
+bool ItemEntryLess(const pair<uint64_t, ContainerItem*>& a, const pair<uint64_t, ContainerItem*>& b) {
+    if (a.first != b.first) {
+        return a.first < b.first;
+    }
+    return raw_compare(a.second->key(), a.second->key_size(), b.second->key(), b.second->key_size()) < 0;
+}
+
+uint32_t CalculateChecksum(ContainerChecksumType checksum_type, const byte* data, size_t data_size) {
+    if (checksum_type == CONTAINER_CHECKSUM_CRC32C) {
+        return crc32c_raw(data, data_size);
+    }
+    AdlerChecksum adler;
+    adler.Update(data, data_size);
+    return adler.checksum();
+}
+
+}
+
 bool Container::UnserializeMetadata(bool verify_checksum) {
     DCHECK(this->data_, "Container not inited");
 
-    this->items_.clear();
+    ReleaseItems();
     this->item_count_ = 0;
     this->active_data_size_ = kMetaDataSize;
 
@@ -72,11 +108,11 @@ bool Container::UnserializeMetadata(bool verify_checksum) {
 
     if (verify_checksum && container_data.has_checksum() && !this->metaDataOnly_) {
         // we can only check the checksum if we have all data
-        AdlerChecksum adler;
-        adler.Update(this->data_ + kMetaDataSize, this->container_size_ - kMetaDataSize);
-        CHECK(container_data.checksum() == adler.checksum(),
+        uint32_t checksum = CalculateChecksum(container_data.checksum_type(),
+            this->data_ + kMetaDataSize, this->container_size_ - kMetaDataSize);
+        CHECK(container_data.checksum() == checksum,
             "Container checksum mismatch: " << container_data.ShortDebugString() <<
-            ", calculated checksum " << adler.checksum());
+            ", calculated checksum " << checksum);
     }
 
     // with this block and the block after the loop of the container items
@@ -92,7 +128,13 @@ bool Container::UnserializeMetadata(bool verify_checksum) {
         }
     }
 
+    // containers stored before the fixed item header have no format version and use the
+    // default CONTAINER_FORMAT_ITEM_MESSAGE
+    ContainerFormatVersion format_version = container_data.format_version();
+
     this->items_.reserve(container_data.items_size());
+    this->item_key_prefixes_.reserve(container_data.items_size());
+    ReserveItems(container_data.items_size());
     for (int i = 0; i < container_data.items_size(); i++) {
         const ContainerItemData& item_data = container_data.items(i);
         CHECK(item_data.has_fp() &&
@@ -110,13 +152,14 @@ bool Container::UnserializeMetadata(bool verify_checksum) {
             // backward mode
             original_id = container_data.primary_id();
         }
-        ContainerItem* item = new ContainerItem((byte *) item_data.fp().data(),
+        ContainerItem* item = NewItem((byte *) item_data.fp().data(),
             item_data.fp().size(),
             item_data.position_offset(),
             item_data.raw_size(),
             item_data.item_size(),
             original_id,
-            item_data.indexed());
+            item_data.indexed(),
+            format_version);
 
         CHECK(item, "Alloc item failed");
         if (item_data.has_deleted() && item_data.deleted()) {
@@ -135,7 +178,10 @@ bool Container::UnserializeMetadata(bool verify_checksum) {
             ", container size " << this->container_size());
 
         this->items_.push_back(item);
+        this->item_key_prefixes_.push_back(GetKeyPrefix(item->key(), item->key_size()));
     }
+    // the items are stored in sorted order, so this is usually only a check
+    SortItems();
 
     for (set<uint64_t>::iterator j = this->secondary_ids_.begin(); j != this->secondary_ids_.end(); j++) {
         if (*j == check_container_id) {
@@ -149,6 +195,7 @@ bool Container::UnserializeMetadata(bool verify_checksum) {
         this->commit_time_ = container_data.commit_time();
     }
     this->pos_ = container_data.container_size();
+    this->format_version_ = format_version;
     return true;
 }
 
@@ -156,9 +203,12 @@ size_t Container::SerializeMetadata(bool calculate_checksum) {
     DCHECK(this->data_, "Container not inited");
     DCHECK(!metaDataOnly_, "Cannot serialize metadata in metadata-only mode");
 
+    SortItems();
+
     ContainerData container_data;
     container_data.set_primary_id(this->primary_id_);
     container_data.set_container_size(this->pos_);
+    container_data.mutable_items()->Reserve(this->items_.size());
 
     for (vector<ContainerItem*>::iterator i = this->items_.begin(); i != this->items_.end(); i++) {
         ContainerItem* item = *i;
@@ -180,10 +230,15 @@ size_t Container::SerializeMetadata(bool calculate_checksum) {
     if (this->commit_time_ > 0) {
         container_data.set_commit_time(this->commit_time_);
     }
+    if (this->format_version_ != CONTAINER_FORMAT_ITEM_MESSAGE) {
+        container_data.set_format_version(this->format_version_);
+    }
     if (calculate_checksum) {
-        AdlerChecksum adler;
-        adler.Update(this->data_ + kMetaDataSize, this->container_size_ - kMetaDataSize);
-        container_data.set_checksum(adler.checksum());
+        container_data.set_checksum(CalculateChecksum(this->checksum_type_,
+                this->data_ + kMetaDataSize, this->container_size_ - kMetaDataSize));
+        if (this->checksum_type_ != CONTAINER_CHECKSUM_ADLER32) {
+            container_data.set_checksum_type(this->checksum_type_);
+        }
         TRACE("Container id " << this->primary_id_ << " has now checksum " << container_data.checksum());
     }
 
@@ -195,8 +250,64 @@ size_t Container::SerializeMetadata(bool calculate_checksum) {
     return meta_data_size.value();
 
 }
-Container::Container(uint64_t id, size_t container_size, bool metadata_only) {
+namespace {
+
+/**
+ * Size of a huge page on x86-64
+ */
+const size_t kHugePageSize = 2 * 1024 * 1024;
+
+/**
+ * Allocates a zeroed container data buffer.
+ *
+ * @param mapped_size set to the size of the mapping if the buffer has been mapped, 0 if
+ * the buffer has been allocated on the heap
+ */
+byte* AllocContainerData(size_t size, bool huge_pages, size_t* mapped_size) {
+    *mapped_size = 0;
+    if (huge_pages) {
+        size_t map_size = ((size + kHugePageSize - 1) / kHugePageSize) * kHugePageSize;
+        void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        // uses the reserved huge pages if there are any
+        p = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if (p == MAP_FAILED) {
+            p = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+            if (p != MAP_FAILED) {
+                // transparent huge pages are only a hint
+                madvise(p, map_size, MADV_HUGEPAGE);
+            }
+#endif
+        }
+        if (p != MAP_FAILED) {
+            // anonymous mappings are zeroed
+            *mapped_size = map_size;
+            return static_cast<byte*>(p);
+        }
+        DEBUG("Failed to map container data: size " << map_size << ", message " << strerror(errno));
+    }
+    byte* data = new byte[size];
+    memset(data, 0, size);
+    return data;
+}
+
+void FreeContainerData(byte* data, size_t mapped_size) {
+    if (mapped_size > 0) {
+        if (munmap(data, mapped_size) != 0) {
+            WARNING("Failed to unmap container data: " << strerror(errno));
+        }
+    } else {
+        delete[] data;
+    }
+}
+
+}
+
+Container::Container(uint64_t id, size_t container_size, bool metadata_only, bool huge_pages) {
     this->data_ = NULL;
+    this->data_mapped_size_ = 0;
     this->pos_ = 0;
     this->primary_id_ = Storage::ILLEGAL_STORAGE_ADDRESS;
     this->container_size_ = 0;
@@ -205,10 +316,12 @@ Container::Container(uint64_t id, size_t container_size, bool metadata_only) {
     this->metaDataOnly_ = false;
     this->item_count_ = 0;
     this->commit_time_ = 0;
+    this->checksum_type_ = CONTAINER_CHECKSUM_ADLER32;
+    this->format_version_ = kDefaultFormatVersion;
+    this->sorted_item_count_ = 0;
 
     if (!metadata_only) {
-        this->data_ = new byte[container_size];
-        memset(this->data_, 0, container_size);
+        this->data_ = AllocContainerData(container_size, huge_pages, &this->data_mapped_size_);
 
         this->pos_ = kMetaDataSize;
         this->active_data_size_ = kMetaDataSize;
@@ -236,21 +349,96 @@ Container::Container(uint64_t id, size_t container_size, bool metadata_only) {
     }
 }
 
-void Container::Reuse(uint64_t id) {
-    this->pos_ = kMetaDataSize;
-    this->active_data_size_ = kMetaDataSize;
-    this->primary_id_ = id;
+ContainerItem* Container::NewItem(const byte* key,
+                                  size_t key_size,
+                                  size_t offset,
+                                  size_t raw_size,
+                                  size_t item_size,
+                                  uint64_t original_id,
+                                  bool is_indexed,
+                                  ContainerFormatVersion format_version) {
+    if (this->free_items_.empty()) {
+        ReserveItems(kItemBlockSize);
+    }
+    ContainerItem* item = this->free_items_.back();
+    this->free_items_.pop_back();
+    return new (item) ContainerItem(key, key_size, offset, raw_size, item_size, original_id, is_indexed,
+        format_version);
+}
+
+void Container::ReserveItems(size_t count) {
+    if (this->free_items_.size() >= count) {
+        return;
+    }
+    size_t block_size = count - this->free_items_.size();
+    // the items are constructed when they are handed out by NewItem
+    ContainerItem* block = static_cast<ContainerItem*>(::operator new(sizeof(ContainerItem) * block_size));
+    this->item_blocks_.push_back(block);
+    for (size_t i = block_size; i > 0; i--) {
+        this->free_items_.push_back(block + (i - 1));
+    }
+}
+
+void Container::ReleaseItems() {
     for (vector<ContainerItem*>::iterator i = this->items_.begin(); i != this->items_.end(); i++) {
         ContainerItem* item = *i;
         if (item) {
-            delete item;
+            this->free_items_.push_back(item);
         }
     }
     this->items_.clear();
+    this->item_key_prefixes_.clear();
+    this->sorted_item_count_ = 0;
+}
+
+void Container::AppendItem(ContainerItem* item) {
+    this->items_.push_back(item);
+    this->item_key_prefixes_.push_back(GetKeyPrefix(item->key(), item->key_size()));
+    if (this->items_.size() - this->sorted_item_count_ > kMaxUnsortedItemCount) {
+        SortItems();
+    }
+}
+
+void Container::SortItems() {
+    if (this->sorted_item_count_ == this->items_.size()) {
+        return;
+    }
+    // fast path: the tail is already in order, e.g. after a container has been loaded
+    bool in_order = true;
+    for (size_t i = (this->sorted_item_count_ > 0 ? this->sorted_item_count_ : 1); i < this->items_.size(); i++) {
+        if (ItemEntryLess(make_pair(item_key_prefixes_[i], items_[i]), make_pair(item_key_prefixes_[i - 1], items_[i - 1]))) {
+            in_order = false;
+            break;
+        }
+    }
+    if (!in_order) {
+        vector<pair<uint64_t, ContainerItem*> > entries;
+        entries.reserve(this->items_.size());
+        for (size_t i = 0; i < this->items_.size(); i++) {
+            entries.push_back(make_pair(item_key_prefixes_[i], items_[i]));
+        }
+        vector<pair<uint64_t, ContainerItem*> >::iterator middle = entries.begin() + this->sorted_item_count_;
+        // stable so that items with the same key stay in insertion order
+        std::stable_sort(middle, entries.end(), ItemEntryLess);
+        std::inplace_merge(entries.begin(), middle, entries.end(), ItemEntryLess);
+        for (size_t i = 0; i < entries.size(); i++) {
+            item_key_prefixes_[i] = entries[i].first;
+            items_[i] = entries[i].second;
+        }
+    }
+    this->sorted_item_count_ = this->items_.size();
+}
+
+void Container::Reuse(uint64_t id) {
+    this->pos_ = kMetaDataSize;
+    this->active_data_size_ = kMetaDataSize;
+    this->primary_id_ = id;
+    ReleaseItems();
     this->item_count_ = 0;
     this->secondary_ids_.clear();
     this->stored_ = false;
     this->commit_time_ = 0;
+    this->format_version_ = kDefaultFormatVersion;
     // meta data mode stays the same
 }
 namespace {
@@ -264,24 +452,126 @@ Compression* GetCompression(CompressionMode mode) {
         return Compression::NewCompression(Compression::COMPRESSION_LZ4);
     } else if (mode == COMPRESSION_SNAPPY) {
         return Compression::NewCompression(Compression::COMPRESSION_SNAPPY);
+    } else if (mode == COMPRESSION_ZSTD) {
+        // the dictionary (if any) is found by the dictionary id in the compressed data
+        return Compression::NewCompression(Compression::COMPRESSION_ZSTD);
     }
     ERROR("Compression not supported yet");
     return NULL;
 }
 
+Option<CompressionMode> GetCompressionMode(Compression* comp) {
+    if (comp->GetCompressionType() == Compression::COMPRESSION_ZLIB_1 ||
+        comp->GetCompressionType() == Compression::COMPRESSION_ZLIB_3 ||
+        comp->GetCompressionType() == Compression::COMPRESSION_ZLIB_9) {
+        return make_option(COMPRESSION_DEFLATE);
+    } else if (comp->GetCompressionType() == Compression::COMPRESSION_BZ2) {
+        return make_option(COMPRESSION_BZ2);
+    } else if (comp->GetCompressionType() == Compression::COMPRESSION_LZ4) {
+        return make_option(COMPRESSION_LZ4);
+    } else if (comp->GetCompressionType() == Compression::COMPRESSION_SNAPPY) {
+        return make_option(COMPRESSION_SNAPPY);
+    } else if (comp->GetCompressionType() == Compression::COMPRESSION_ZSTD) {
+        return make_option(COMPRESSION_ZSTD);
+    }
+    return false;
+}
+
+bool ItemOffsetLess(const ContainerItem* a, const ContainerItem* b) {
+    return a->offset() < b->offset();
+}
+
+/**
+ * Offset of the compression mode in the fixed item header
+ */
+const size_t kItemHeaderCompressionOffset = 4;
+
+/**
+ * Offset of the flags in the fixed item header. No flags are defined yet.
+ */
+const size_t kItemHeaderFlagsOffset = 5;
+
+/**
+ * Decodes the header in front of the item data.
+ *
+ * @param format_version layout of the item header
+ * @param item_buffer on-disk data of the item
+ * @param item_size size of the on-disk data of the item
+ * @param on_disk_size set to the (possibly compressed) size of the item data
+ * @param compression set to the compression mode of the item data
+ * @param header_size set to the size of the item header
+ * @return true iff ok, otherwise an error has occurred
+ */
+bool ParseItemHeader(ContainerFormatVersion format_version,
+                     const byte* item_buffer,
+                     size_t item_size,
+                     uint32_t* on_disk_size,
+                     CompressionMode* compression,
+                     size_t* header_size) {
+    if (format_version == CONTAINER_FORMAT_FIXED_ITEM_HEADER) {
+        CHECK(item_size >= Container::kItemHeaderSize, "Illegal item size: " << item_size);
+        memcpy(on_disk_size, item_buffer, sizeof(uint32_t));
+        byte mode = item_buffer[kItemHeaderCompressionOffset];
+        CHECK(CompressionMode_IsValid(mode), "Illegal compression mode: " << static_cast<int>(mode));
+        CHECK(item_buffer[kItemHeaderFlagsOffset] == 0,
+            "Unknown item header flags: " << static_cast<int>(item_buffer[kItemHeaderFlagsOffset]));
+        *compression = static_cast<CompressionMode>(mode);
+        *header_size = Container::kItemHeaderSize;
+    } else {
+        ContainerItemValueData item_data;
+        Option<size_t> message_size = ParseSizedMessage(&item_data, item_buffer, item_size, false);
+        CHECK(message_size.valid(), "Cannot parse sized message");
+        *on_disk_size = item_data.on_disk_size();
+        *compression = item_data.compression();
+        *header_size = message_size.value();
+    }
+    CHECK(*header_size + *on_disk_size <= item_size, "Illegal item header: " <<
+        "header size " << *header_size <<
+        ", on disk size " << *on_disk_size <<
+        ", item size " << item_size);
+    return true;
+}
+
+/**
+ * Encodes the header in front of the item data.
+ *
+ * @param format_version layout of the item header
+ * @return size of the item header or an unset option if an error occurred
+ */
+Option<size_t> SerializeItemHeader(ContainerFormatVersion format_version,
+                                   uint32_t on_disk_size,
+                                   CompressionMode compression,
+                                   byte* buffer,
+                                   size_t buffer_size) {
+    if (format_version == CONTAINER_FORMAT_FIXED_ITEM_HEADER) {
+        CHECK(buffer_size >= Container::kItemHeaderSize, "Illegal buffer size: " << buffer_size);
+        memset(buffer, 0, Container::kItemHeaderSize);
+        memcpy(buffer, &on_disk_size, sizeof(uint32_t));
+        buffer[kItemHeaderCompressionOffset] = static_cast<byte>(compression);
+        return make_option(static_cast<size_t>(Container::kItemHeaderSize));
+    }
+    ContainerItemValueData value_data;
+    value_data.set_on_disk_size(on_disk_size);
+    if (compression != COMPRESSION_NO) {
+        value_data.set_compression(compression);
+    }
+    return SerializeSizedMessage(value_data, buffer, buffer_size, false);
+}
+
 bool DecompressItem(
     const ContainerItem* item,
-    const ContainerItemValueData& item_data,
+    uint32_t on_disk_size,
+    CompressionMode compression,
     const byte* data,
     void* dest,
     uint32_t offset,
     uint32_t size) {
-    Compression* comp = GetCompression(item_data.compression());
+    Compression* comp = GetCompression(compression);
     DCHECK(comp, "Cannot create compression");
 
     byte* buffer = new byte[item->raw_size()];
     bool failed = false;
-    if (comp->Decompress(buffer, item->raw_size(), data, item_data.on_disk_size()) < 0) {
+    if (comp->Decompress(buffer, item->raw_size(), data, on_disk_size) < 0) {
         ERROR("Failed to decompress container data");
         failed = true;
     } else {
@@ -297,6 +587,19 @@ bool Container::CopyRawData(const ContainerItem* item, void* dest, uint32_t chun
     DCHECK(item, "Item not set");
     DCHECK(this->data_, "Container not inited");
     CHECK(metaDataOnly_ == false, "Container has only loaded meta data");
+    DCHECK(item->offset() + item->item_size() <= container_size_,
+        "Illegal item: " << item->DebugString());
+
+    return CopyRawItemData(item, this->data_ + item->offset(), dest, chunk_offset, size);
+}
+
+bool Container::CopyRawItemData(const ContainerItem* item,
+                                const byte* item_buffer,
+                                void* dest,
+                                uint32_t chunk_offset,
+                                uint32_t size) {
+    DCHECK(item, "Item not set");
+    DCHECK(item_buffer, "Item buffer not set");
 
     TRACE("Read item " << item->key_string() << ":" <<
         "offset " << item->offset_ <<
@@ -304,42 +607,43 @@ bool Container::CopyRawData(const ContainerItem* item, void* dest, uint32_t chun
         ", raw size " << item->raw_size_ <<
         ", chunk offset " << chunk_offset <<
         ", dest size " << size);
-    DCHECK(item->offset() + item->item_size() <= container_size_,
-        "Illegal item: " << item->DebugString());
     DCHECK(chunk_offset + size <= item->raw_size(),
         "Illegal item request: " <<
         "offset " << chunk_offset <<
         ", size " << size <<
         ", item " << item->DebugString());
 
-    ContainerItemValueData item_data;
-    Option<size_t> message_size = ParseSizedMessage(&item_data, this->data_ + item->offset(), item->item_size(), false);
-    CHECK(message_size.valid(), "cannot parse sized message");
-
-    TRACE("Item data: " << item_data.ShortDebugString() <<
-        ", message size " << message_size.value() <<
-        ", data offset " << item->offset_ + message_size.value() <<
-        ", stored sha1 " << sha1(data_ + item->offset_ + message_size.value(), item_data.on_disk_size()));
-    size_t data_offset = item->offset_ + message_size.value();
-
-    if (!item_data.has_compression() || item_data.compression() == COMPRESSION_NO) {
-        DCHECK(item_data.on_disk_size() == item->raw_size(),
+    uint32_t on_disk_size = 0;
+    CompressionMode compression = COMPRESSION_NO;
+    size_t data_offset = 0;
+    CHECK(ParseItemHeader(item->format_version(), item_buffer, item->item_size(),
+            &on_disk_size, &compression, &data_offset),
+        "Cannot parse item header: " << item->DebugString());
+
+    TRACE("Item data: on disk size " << on_disk_size <<
+        ", compression " << CompressionMode_Name(compression) <<
+        ", header size " << data_offset <<
+        ", data offset " << item->offset_ + data_offset <<
+        ", stored sha1 " << sha1(item_buffer + data_offset, on_disk_size));
+
+    if (compression == COMPRESSION_NO) {
+        DCHECK(on_disk_size == item->raw_size(),
             "Illegal item size: " << item->DebugString() <<
-            ", item data " << item_data.ShortDebugString());
+            ", on disk size " << on_disk_size);
 
-        DCHECK(chunk_offset + size <= item_data.on_disk_size(), "Illegal destination size");
-        DCHECK(data_offset + item_data.on_disk_size() <= container_size_, "Illegal source offset");
-        memcpy(dest, this->data_ + data_offset + chunk_offset, size);
+        DCHECK(chunk_offset + size <= on_disk_size, "Illegal destination size");
+        memcpy(dest, item_buffer + data_offset + chunk_offset, size);
     } else {
         bool r = DecompressItem(
             item,
-            item_data,
-            this->data_ + data_offset,
+            on_disk_size,
+            compression,
+            item_buffer + data_offset,
             dest, chunk_offset,
             size);
         CHECK(r,
             "Failed to decompress item: " << item->DebugString() <<
-            ", item data " << item_data.ShortDebugString());
+            ", compression " << CompressionMode_Name(compression));
     }
     return true;
 }
@@ -361,22 +665,6 @@ bool Container::DeleteItem(const byte* key, size_t key_size) {
     return true;
 }
 
-void Container::InsertItemSorted(vector<ContainerItem*>* items, ContainerItem* new_item) {
-    int j = 0;
-    for (vector<ContainerItem*>::iterator i = items->begin(); i != items->end(); i++, j++) {
-        ContainerItem* item = *i;
-        int comp_result = raw_compare(new_item->key(), new_item->key_size(), item->key(), item->key_size());
-        if (comp_result >= 0) {
-            continue;
-        }
-        // insert here
-        items->insert(i, new_item);
-        return;
-    }
-    // not inserted before
-    items->push_back(new_item);
-}
-
 bool Container::CopyItem(const Container& parent_container, const ContainerItem& item) {
     CHECK(this->stored_ == false, "Cannot add items to a stored container: container " << this->primary_id());
     CHECK(this->metaDataOnly_ == false, "Container has only loaded meta data");
@@ -386,17 +674,36 @@ bool Container::CopyItem(const Container& parent_container, const ContainerItem&
         ", data size " << item.raw_size() <<
         ", items " << this->item_count() <<
         ", container size " << this->container_size());
-    DCHECK(pos_ + item.item_size() <= container_size_, "Illegal copy item: " << item.DebugString());
 
-    memcpy(this->data_ + this->pos_, parent_container.data_ + item.offset(), item.item_size());
+    const byte* item_buffer = parent_container.data_ + item.offset();
+    size_t item_size = item.item_size();
+    if (item.format_version() == this->format_version_) {
+        DCHECK(pos_ + item_size <= container_size_, "Illegal copy item: " << item.DebugString());
+        memcpy(this->data_ + this->pos_, item_buffer, item_size);
+    } else {
+        // the item header is converted to the format of this container. The item data is copied unchanged.
+        uint32_t on_disk_size = 0;
+        CompressionMode compression = COMPRESSION_NO;
+        size_t header_size = 0;
+        CHECK(ParseItemHeader(item.format_version(), item_buffer, item.item_size(),
+                &on_disk_size, &compression, &header_size),
+            "Cannot parse item header: " << item.DebugString());
+        Option<size_t> new_header_size = SerializeItemHeader(this->format_version_, on_disk_size, compression,
+            this->data_ + this->pos_, this->container_size_ - this->pos_);
+        CHECK(new_header_size.valid(), "Cannot serialize item header: " << item.DebugString());
+        item_size = new_header_size.value() + on_disk_size;
+        CHECK(pos_ + item_size <= container_size_, "Illegal copy item: " << item.DebugString());
+        memcpy(this->data_ + this->pos_ + new_header_size.value(), item_buffer + header_size, on_disk_size);
+    }
 
-    ContainerItem* new_item = new ContainerItem(item.key(),
+    ContainerItem* new_item = NewItem(item.key(),
         item.key_size(),
         this->pos_,
         item.raw_size(),
-        item.item_size(),
+        item_size,
         item.original_id(),
-        item.is_indexed());
+        item.is_indexed(),
+        this->format_version_);
     CHECK(new_item, "Alloc container item failed");
 
     if (item.is_deleted()) {
@@ -404,13 +711,13 @@ bool Container::CopyItem(const Container& parent_container, const ContainerItem&
         // do not increase item count and active data size of deleted items
     } else {
         this->item_count_++;
-        this->active_data_size_ += item.item_size();
+        this->active_data_size_ += item_size;
     }
 
-    this->pos_ += item.item_size();
+    this->pos_ += item_size;
 
     TRACE("Copy item " << new_item->key_string() << " to offset " << new_item->offset_ << " (item size " << new_item->item_size_ << ", raw size " << new_item->raw_size_ << ")");
-    Container::InsertItemSorted(&this->items_, new_item);
+    AppendItem(new_item);
     return true;
 }
 
@@ -432,30 +739,19 @@ bool Container::AddItem(const byte* key,
 
     size_t offset = this->pos_;
 
-    ContainerItemValueData value_data;
-    value_data.set_on_disk_size(data_size);
+    uint32_t on_disk_size = data_size;
+    CompressionMode compression = COMPRESSION_NO;
 
     byte data_buffer[data_size * 2];
     if (data_size >= kMinCompressedChunkSize && comp) {
         ssize_t compressed_size = comp->Compress(data_buffer, data_size * 2, data, data_size);
         CHECK(compressed_size >= 0, "Cannot compress data: size " << data_size);
         if (compressed_size < (ssize_t) data_size) {
-            value_data.set_on_disk_size(compressed_size);
-
-            if (comp->GetCompressionType() == Compression::COMPRESSION_ZLIB_1 ||
-                comp->GetCompressionType() == Compression::COMPRESSION_ZLIB_3 ||
-                comp->GetCompressionType() == Compression::COMPRESSION_ZLIB_9) {
-                value_data.set_compression(COMPRESSION_DEFLATE);
-            } else if (comp->GetCompressionType() == Compression::COMPRESSION_BZ2) {
-                value_data.set_compression(COMPRESSION_BZ2);
-            } else if (comp->GetCompressionType() == Compression::COMPRESSION_LZ4) {
-                value_data.set_compression(COMPRESSION_LZ4);
-            } else if (comp->GetCompressionType() == Compression::COMPRESSION_SNAPPY) {
-                value_data.set_compression(COMPRESSION_SNAPPY);
-            } else {
-                ERROR("Unsupported compression type: " << comp->GetCompressionType());
-                return false;
-            }
+            on_disk_size = compressed_size;
+
+            Option<CompressionMode> mode = GetCompressionMode(comp);
+            CHECK(mode.valid(), "Unsupported compression type: " << comp->GetCompressionType());
+            compression = mode.value();
         } else {
             // Compression not successful
             comp = NULL;
@@ -466,61 +762,142 @@ bool Container::AddItem(const byte* key,
 
     CHECK(this->container_size_ - offset >= (ssize_t) kMaxSerializedItemMetadataSize, "Illegal available message size: " <<
         this->container_size_ - offset);
-    Option<size_t> message_size = SerializeSizedMessage(value_data, this->data_ + offset, this->container_size_ - offset, false);
-    CHECK(message_size.valid(), "Cannot serialize sized message: max size " << (this->container_size_ - offset));
+    Option<size_t> header_size = SerializeItemHeader(this->format_version_, on_disk_size, compression,
+        this->data_ + offset, this->container_size_ - offset);
+    CHECK(header_size.valid(), "Cannot serialize item header: max size " << (this->container_size_ - offset));
 
-    // add the size of the item metadata size
-    this->pos_ += message_size.value();
-    this->active_data_size_ += message_size.value();
+    // add the size of the item header
+    this->pos_ += header_size.value();
+    this->active_data_size_ += header_size.value();
 
-    CHECK(pos_ + value_data.on_disk_size() <= container_size_,
+    CHECK(pos_ + on_disk_size <= container_size_,
         "Illegal item data: pos " << pos_ <<
-        ", data size " << value_data.on_disk_size() <<
+        ", data size " << on_disk_size <<
         ", container size " << container_size_);
 
     if (comp == NULL) {
         // Compression not active or not successful
-        memcpy(this->data_ + pos_, data, value_data.on_disk_size());
+        memcpy(this->data_ + pos_, data, on_disk_size);
     } else {
-        memcpy(this->data_ + pos_, data_buffer, value_data.on_disk_size());
+        memcpy(this->data_ + pos_, data_buffer, on_disk_size);
     }
 
     // adds the size of the (on disk) data
-    pos_ += value_data.on_disk_size();
-    this->active_data_size_ += value_data.on_disk_size();
+    pos_ += on_disk_size;
+    this->active_data_size_ += on_disk_size;
 
-    size_t item_size = message_size.value() + value_data.on_disk_size();
+    size_t item_size = header_size.value() + on_disk_size;
 
-    ContainerItem* item = new ContainerItem(key,
+    ContainerItem* item = NewItem(key,
         key_size,
         offset,
         data_size,
         item_size,
         this->primary_id(),
-        is_indexed);
+        is_indexed,
+        this->format_version_);
     CHECK(item, "Alloc container item failed");
 
     TRACE("Add item " << item->key_string() << ": container " << this->primary_id() <<
         ", offset " << item->offset() <<
         ", item size " << item->item_size() <<
         ", raw size " << item->raw_size() <<
-        ", item data: " << value_data.ShortDebugString() <<
-        ", message size " << message_size.value() <<
-        ", data offset " << pos_ - value_data.on_disk_size() <<
+        ", on disk size " << on_disk_size <<
+        ", compression " << CompressionMode_Name(compression) <<
+        ", header size " << header_size.value() <<
+        ", data offset " << pos_ - on_disk_size <<
         ", sha1 " << sha1(data, data_size) <<
-        ", stored sha1 " << sha1(data_ + pos_ - value_data.on_disk_size(), value_data.on_disk_size()));
-    Container::InsertItemSorted(&this->items_, item);
+        ", stored sha1 " << sha1(data_ + pos_ - on_disk_size, on_disk_size));
+    AppendItem(item);
     this->item_count_++;
 
     return true;
 }
 
+bool Container::CompressItems(Compression* comp) {
+    CHECK(this->stored_ == false, "Cannot compress a stored container: container " << this->primary_id());
+    CHECK(this->metaDataOnly_ == false, "Container has only loaded meta data");
+    CHECK(this->data_, "Container not inited");
+    CHECK(comp, "Compression not set");
+
+    Option<CompressionMode> mode = GetCompressionMode(comp);
+    CHECK(mode.valid(), "Unsupported compression type: " << comp->GetCompressionType());
+
+    // the item data is repacked in offset order. As an item never grows, the
+    // repacked item never overwrites the data of an item that is not processed yet.
+    vector<ContainerItem*> sorted_items(this->items_);
+    std::sort(sorted_items.begin(), sorted_items.end(), ItemOffsetLess);
+
+    size_t max_raw_size = 0;
+    for (vector<ContainerItem*>::iterator i = sorted_items.begin(); i != sorted_items.end(); i++) {
+        if ((*i)->raw_size() > max_raw_size) {
+            max_raw_size = (*i)->raw_size();
+        }
+    }
+    ScopedArray<byte> data_buffer(new byte[max_raw_size * 2 + 1]);
+    CHECK(data_buffer.Get(), "Alloc data buffer failed");
+
+    size_t pos = kMetaDataSize;
+    for (vector<ContainerItem*>::iterator i = sorted_items.begin(); i != sorted_items.end(); i++) {
+        ContainerItem* item = *i;
+        CHECK(pos <= item->offset(), "Illegal item offset: " << item->DebugString() << ", pos " << pos);
+
+        uint32_t on_disk_size = 0;
+        CompressionMode compression = COMPRESSION_NO;
+        size_t header_size = 0;
+        CHECK(ParseItemHeader(item->format_version(), this->data_ + item->offset(), item->item_size(),
+                &on_disk_size, &compression, &header_size),
+            "Cannot parse item header: item " << item->DebugString());
+        const byte* item_data = this->data_ + item->offset() + header_size;
+
+        size_t item_size = item->item_size();
+        bool compressed = false;
+        if (compression == COMPRESSION_NO && item->raw_size() >= kMinCompressedChunkSize) {
+            ssize_t compressed_size = comp->Compress(data_buffer.Get(), max_raw_size * 2 + 1,
+                item_data, on_disk_size);
+            CHECK(compressed_size >= 0, "Cannot compress data: item " << item->DebugString());
+
+            byte header_buffer[kMaxSerializedItemMetadataSize];
+            Option<size_t> compressed_header_size = SerializeItemHeader(item->format_version(),
+                compressed_size, mode.value(), header_buffer, kMaxSerializedItemMetadataSize);
+            CHECK(compressed_header_size.valid(), "Cannot serialize item header: item " << item->DebugString());
+            if (compressed_header_size.value() + compressed_size < item_size) {
+                memcpy(this->data_ + pos, header_buffer, compressed_header_size.value());
+                memcpy(this->data_ + pos + compressed_header_size.value(), data_buffer.Get(), compressed_size);
+                item_size = compressed_header_size.value() + compressed_size;
+                compressed = true;
+            }
+        }
+        if (!compressed && pos != item->offset()) {
+            memmove(this->data_ + pos, this->data_ + item->offset(), item_size);
+        }
+        if (!item->is_deleted()) {
+            this->active_data_size_ -= item->item_size();
+            this->active_data_size_ += item_size;
+        }
+        TRACE("Repack item " << item->key_string() << ": container " << this->primary_id() <<
+            ", old offset " << item->offset() <<
+            ", old item size " << item->item_size() <<
+            ", offset " << pos <<
+            ", item size " << item_size <<
+            ", compressed " << ToString(compressed));
+        item->offset_ = pos;
+        item->item_size_ = item_size;
+        pos += item_size;
+    }
+    CHECK(pos <= this->pos_, "Illegal container position: " << pos << ", old position " << this->pos_);
+    memset(this->data_ + pos, 0, this->pos_ - pos);
+    this->pos_ = pos;
+    return true;
+}
+
 ContainerItem::ContainerItem(const byte* key, size_t key_size,
                              size_t offset,
                              size_t raw_size,
                              size_t item_size,
                              uint64_t original_id,
-                             bool is_indexed) {
+                             bool is_indexed,
+                             ContainerFormatVersion format_version) {
     memcpy(this->key_, key, key_size);
     this->key_size_ = key_size;
     this->offset_ = offset;
@@ -529,6 +906,7 @@ ContainerItem::ContainerItem(const byte* key, size_t key_size,
     this->deleted_ = false;
     this->is_indexed_ = is_indexed;
     this->original_id_ = original_id;
+    this->format_version_ = format_version;
 }
 
 bool ContainerItem::Equals(const ContainerItem& item) const {
@@ -558,14 +936,15 @@ string ContainerItem::key_string() const {
 }
 
 Container::~Container() {
-    delete[] this->data_;
+    FreeContainerData(this->data_, this->data_mapped_size_);
     this->data_ = NULL;
     this->pos_ = 0;
-    for (vector<ContainerItem*>::iterator i = this->items_.begin(); i != this->items_.end(); i++) {
-        ContainerItem* item = *i;
-        delete item;
+    ReleaseItems();
+    this->free_items_.clear();
+    for (vector<ContainerItem*>::iterator i = this->item_blocks_.begin(); i != this->item_blocks_.end(); i++) {
+        ::operator delete(*i);
     }
-    this->items_.clear();
+    this->item_blocks_.clear();
     this->item_count_ = 0;
 }
 
@@ -580,6 +959,7 @@ bool Container::CopyFrom(const Container& container, bool copyId) {
         this->secondary_ids_ = container.secondary_ids_;
     }
     this->pos_ = container.pos_;
+    this->format_version_ = container.format_version_;
 
     if (this->is_metadata_only()) {
         memcpy(this->data_, container.data_, kMetaDataSize);
@@ -588,11 +968,12 @@ bool Container::CopyFrom(const Container& container, bool copyId) {
     }
 
     this->items_.reserve(container.items_.size());
+    ReserveItems(container.items_.size());
     for (vector<ContainerItem*>::const_iterator i = container.items_.begin(); i != container.items_.end(); i++) {
         const ContainerItem* item = *i;
-        ContainerItem* copy_item = new ContainerItem(item->key(), item->key_size(),
+        ContainerItem* copy_item = NewItem(item->key(), item->key_size(),
             item->offset(), item->raw_size(), item->item_size(), item->original_id(),
-            item->is_indexed());
+            item->is_indexed(), item->format_version());
         CHECK(copy_item, "Alloc container item failed");
         if (item->is_deleted()) {
             copy_item->deleted_ = true;
@@ -600,6 +981,9 @@ bool Container::CopyFrom(const Container& container, bool copyId) {
 
         this->items_.push_back(copy_item);
     }
+    // the item order is the same as in the source container
+    this->item_key_prefixes_ = container.item_key_prefixes_;
+    this->sorted_item_count_ = container.sorted_item_count_;
     this->active_data_size_ = container.active_data_size_;
     this->item_count_ = container.item_count_;
     return true;
@@ -642,12 +1026,14 @@ bool Container::Equals(const Container& container) const {
     return true;
 }
 
-bool Container::LoadFromFile(File* file, off_t offset, bool verify_checksum) {
+bool Container::LoadFromFile(File* file, off_t offset, bool verify_checksum, IOScheduler* io_scheduler) {
     CHECK(file, "File not set");
     DCHECK(this->data_, "Container not inited");
 
     if (this->metaDataOnly_ == false) {
-        ssize_t read_data_size = file->Read(offset, this->data_, this->container_size_);
+        ssize_t read_data_size = io_scheduler ?
+                                 io_scheduler->Read(file, offset, this->data_, this->container_size_) :
+                                 file->Read(offset, this->data_, this->container_size_);
         CHECK(read_data_size == (ssize_t) this->container_size_, "Cannot read container data: " <<
             "read data size "  << read_data_size <<
             ", container size " << this->container_size_);
@@ -658,7 +1044,9 @@ bool Container::LoadFromFile(File* file, off_t offset, bool verify_checksum) {
             ", offset " << offset <<
             ", container crc " << crc(this->data_, this->container_size_));
     } else {
-        ssize_t read_data_size = file->Read(offset, this->data_, Container::kMetaDataSize);
+        ssize_t read_data_size = io_scheduler ?
+                                 io_scheduler->Read(file, offset, this->data_, Container::kMetaDataSize) :
+                                 file->Read(offset, this->data_, Container::kMetaDataSize);
         CHECK(read_data_size == (ssize_t) Container::kMetaDataSize, "Cannot read container meta data: " <<
             "read data size "  << read_data_size <<
             ", container meta data size " << Container::kMetaDataSize);
@@ -679,7 +1067,7 @@ bool Container::LoadFromFile(File* file, off_t offset, bool verify_checksum) {
     return true;
 }
 
-bool Container::StoreToFile(File* file, off_t offset, bool calculate_checksum) {
+bool Container::StoreToFile(File* file, off_t offset, bool calculate_checksum, IOScheduler* io_scheduler) {
     DCHECK(file, "File not set");
     DCHECK(this->primary_id() != Storage::ILLEGAL_STORAGE_ADDRESS && this->primary_id() != Storage::EMPTY_DATA_STORAGE_ADDRESS && this->primary_id() != 0,
         "Illegal container id " << this->primary_id());
@@ -691,8 +1079,10 @@ bool Container::StoreToFile(File* file, off_t offset, bool calculate_checksum) {
     }
 
     CHECK(this->SerializeMetadata(calculate_checksum), "Cannot serialize container: " << this->DebugString());
-    CHECK(file->Write(offset, this->data_, this->container_size_)
-        == (ssize_t) this->container_size_, "Container write failed: " << this->DebugString());
+    ssize_t write_data_size = io_scheduler ?
+                              io_scheduler->Write(file, offset, this->data_, this->container_size_) :
+                              file->Write(offset, this->data_, this->container_size_);
+    CHECK(write_data_size == (ssize_t) this->container_size_, "Container write failed: " << this->DebugString());
     this->stored_ = true;
 
     DEBUG("Store container to file: " <<
@@ -703,84 +1093,112 @@ bool Container::StoreToFile(File* file, off_t offset, bool calculate_checksum) {
     return true;
 }
 
-const ContainerItem* Container::FindItem(const void* fp, size_t fp_size, bool find_deleted) const {
-    // Note: http://googleresearch.blogspot.com/2006/06/extra-extra-read-all-about-it-nearly.html NOLINT
-    // Note also that we cannot used std::binary_search here as it does not return the found value
-
-    int low = 0;
-    int high = this->items_.size() - 1;
+int Container::FindItemIndex(const void* fp, size_t fp_size, bool find_deleted) const {
+    uint64_t prefix = GetKeyPrefix(fp, fp_size);
 
-    while (low <= high) {
-        int mid = low + ((high - low) / 2);
-        const ContainerItem* item = this->items_[mid];
-        CHECK_RETURN(item != NULL, NULL, "Item not set");
-
-        int comp_result = raw_compare(item->key(), item->key_size(), fp, fp_size);
-        if (comp_result < 0) {
+    // binary search on the flat prefix array until the range is small enough for a linear scan
+    size_t low = 0;
+    size_t high = this->sorted_item_count_;
+    while (high - low > kLinearSearchThreshold) {
+        size_t mid = low + ((high - low) / 2);
+        if (this->item_key_prefixes_[mid] < prefix) {
             low = mid + 1;
-            TRACE("Check index " << mid <<
-                ", item " << item->key_string() <<
-                ", search fp " << Fingerprinter::DebugString(fp, fp_size) <<
-                ", result: lower");
-        } else if (comp_result > 0) {
-            high = mid - 1;
-            TRACE("Check index " << mid <<
-                ", item " << item->key_string() <<
-                ", search fp " << Fingerprinter::DebugString(fp, fp_size) <<
-                ", result: upper");
         } else {
-            TRACE("Check index " << mid <<
-                ", item " << item->key_string() <<
-                ", search fp " << Fingerprinter::DebugString(fp, fp_size) <<
-                ", result: found");
-            // key found
-            if (item->is_deleted() && !find_deleted) {
-                return NULL;
-            }
-            return item;
+            high = mid;
+        }
+    }
+    for (size_t i = low; i < this->sorted_item_count_; i++) {
+        if (this->item_key_prefixes_[i] < prefix) {
+            continue;
+        }
+        if (this->item_key_prefixes_[i] > prefix) {
+            break;
+        }
+        const ContainerItem* item = this->items_[i];
+        if (raw_compare(item->key(), item->key_size(), fp, fp_size) == 0 && (find_deleted || !item->is_deleted())) {
+            return i;
         }
     }
-    return NULL; // Key not found
+    // unsorted tail
+    for (size_t i = this->sorted_item_count_; i < this->items_.size(); i++) {
+        if (this->item_key_prefixes_[i] != prefix) {
+            continue;
+        }
+        const ContainerItem* item = this->items_[i];
+        if (raw_compare(item->key(), item->key_size(), fp, fp_size) == 0 && (find_deleted || !item->is_deleted())) {
+            return i;
+        }
+    }
+    return -1; // Key not found
+}
+
+const ContainerItem* Container::FindItem(const void* fp, size_t fp_size, bool find_deleted) const {
+    int index = FindItemIndex(fp, fp_size, find_deleted);
+    if (index < 0) {
+        TRACE("Search fp " << Fingerprinter::DebugString(fp, fp_size) << ", result: not found");
+        return NULL;
+    }
+    return this->items_[index];
 }
 
 ContainerItem* Container::FindItem(const void* fp, size_t fp_size, bool find_deleted) {
-    // Note: http://googleresearch.blogspot.com/2006/06/extra-extra-read-all-about-it-nearly.html NOLINT
-    // Note also that we cannot used std::binary_search here as it does not return the found value
+    int index = FindItemIndex(fp, fp_size, find_deleted);
+    if (index < 0) {
+        TRACE("Search fp " << Fingerprinter::DebugString(fp, fp_size) << ", result: not found");
+        return NULL;
+    }
+    return this->items_[index];
+}
 
-    int low = 0;
-    int high = this->items_.size() - 1;
+Option<size_t> Container::GetCopiedItemSize(const Container& parent_container, const ContainerItem& item) const {
+    if (item.format_version() == this->format_version_) {
+        return make_option(item.item_size());
+    }
+    const byte* item_buffer = parent_container.data_ + item.offset();
+    uint32_t on_disk_size = 0;
+    CompressionMode compression = COMPRESSION_NO;
+    size_t header_size = 0;
+    CHECK(ParseItemHeader(item.format_version(), item_buffer, item.item_size(),
+            &on_disk_size, &compression, &header_size),
+        "Cannot parse item header: " << item.DebugString());
+    byte header_buffer[kMaxSerializedItemMetadataSize];
+    Option<size_t> new_header_size = SerializeItemHeader(this->format_version_, on_disk_size, compression,
+        header_buffer, sizeof(header_buffer));
+    CHECK(new_header_size.valid(), "Cannot serialize item header: " << item.DebugString());
+    return make_option(new_header_size.value() + on_disk_size);
+}
 
-    while (low <= high) {
-        int mid = low + ((high - low) / 2);
-        ContainerItem* item = this->items_[mid];
-        CHECK_RETURN(item != NULL, NULL, "Item not set");
+Option<bool> Container::CanMergeContainer(const Container& container1, const Container& container2) const {
+    CHECK(container1.is_metadata_only() == false, "container has only meta data: " << container1.DebugString());
+    CHECK(container2.is_metadata_only() == false, "container has only meta data: " << container2.DebugString());
 
-        int comp_result = raw_compare(item->key(), item->key_size(), fp, fp_size);
-        if (comp_result < 0) {
-            low = mid + 1;
-            TRACE("Check index " << mid <<
-                ", item " << item->key_string() <<
-                ", search fp " << Fingerprinter::DebugString(fp, fp_size) <<
-                ", result: lower");
-        } else if (comp_result > 0) {
-            high = mid - 1;
-            TRACE("Check index " << mid <<
-                ", item " << item->key_string() <<
-                ", search fp " << Fingerprinter::DebugString(fp, fp_size) <<
-                ", result: upper");
-        } else {
-            TRACE("Check index " << mid <<
-                ", item " << item->key_string() <<
-                ", search fp " << Fingerprinter::DebugString(fp, fp_size) <<
-                ", result: found");
-            // key found
-            if (item->is_deleted() && !find_deleted) {
-                return NULL;
+    // the same checks as in CopyItem, but without copying the data
+    size_t pos = this->pos_;
+    size_t item_count = this->item_count_;
+    const Container* containers[] = {&container1, &container2};
+    for (int c = 0; c < 2; c++) {
+        vector<ContainerItem*>::const_iterator i;
+        for (i = containers[c]->items().begin(); i != containers[c]->items().end(); i++) {
+            const ContainerItem* item = *i;
+            if (item->is_deleted()) {
+                continue;
+            }
+            if (item->raw_size() + kMaxSerializedItemMetadataSize >= this->container_size_ - pos) {
+                return make_option(false);
+            }
+            if ((item_count + 1) * kMaxSerializedItemMetadataSize >= kMetaDataSize) {
+                return make_option(false);
+            }
+            Option<size_t> item_size = GetCopiedItemSize(*containers[c], *item);
+            CHECK(item_size.valid(), "Failed to get copied item size: " << item->DebugString());
+            if (pos + item_size.value() > this->container_size_) {
+                return make_option(false);
             }
-            return item;
+            pos += item_size.value();
+            item_count++;
         }
     }
-    return NULL; // Key not found
+    return make_option(true);
 }
 
 bool Container::MergeContainer(const Container& container1, const Container& container2) {
@@ -789,7 +1207,6 @@ bool Container::MergeContainer(const Container& container1, const Container& con
 
     // collect ids
     set<uint64_t> ids;
-    // Note that copy items takes care of the sorting
     vector<ContainerItem*>::const_iterator i;
     for (i = container1.items().begin(); i != container1.items().end(); i++) {
         const ContainerItem* item = *i;
@@ -814,6 +1231,7 @@ bool Container::MergeContainer(const Container& container1, const Container& con
     this->primary_id_ = *ids.begin();
     this->secondary_ids_ = ids;
     this->secondary_ids_.erase(this->primary_id_);
+    SortItems();
     return true;
 }
 
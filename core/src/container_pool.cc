@@ -0,0 +1,172 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <core/container_pool.h>
+
+#include <sstream>
+
+#include <core/storage.h>
+#include <base/logging.h>
+#include <base/strutil.h>
+
+using std::string;
+using std::stringstream;
+using std::vector;
+using dedupv1::base::strutil::To;
+using tbb::spin_mutex;
+
+LOGGER("ContainerPool");
+
+namespace dedupv1 {
+namespace chunkstore {
+
+ContainerPool::Statistics::Statistics() {
+    acquires_ = 0;
+    reuses_ = 0;
+    allocations_ = 0;
+    mapped_allocations_ = 0;
+    releases_ = 0;
+    discards_ = 0;
+}
+
+ContainerPool::ContainerPool() {
+    container_size_ = 0;
+    size_ = kDefaultSize;
+    huge_pages_ = false;
+    started_ = false;
+}
+
+ContainerPool::~ContainerPool() {
+    vector<Container*>::iterator i;
+    for (i = free_containers_.begin(); i != free_containers_.end(); i++) {
+        delete *i;
+    }
+    free_containers_.clear();
+    for (i = free_metadata_containers_.begin(); i != free_metadata_containers_.end(); i++) {
+        delete *i;
+    }
+    free_metadata_containers_.clear();
+}
+
+bool ContainerPool::SetOption(const string& option_name, const string& option) {
+    CHECK(!started_, "Container pool already started");
+    if (option_name == "size") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        size_ = To<uint32_t>(option).value();
+        return true;
+    }
+    if (option_name == "huge-pages") {
+        CHECK(To<bool>(option).valid(), "Illegal option " << option);
+        huge_pages_ = To<bool>(option).value();
+        return true;
+    }
+    ERROR("Illegal option: " << option_name);
+    return false;
+}
+
+bool ContainerPool::Start(size_t container_size) {
+    CHECK(!started_, "Container pool already started");
+    CHECK(container_size > Container::kMetaDataSize, "Illegal container size: " << container_size);
+    container_size_ = container_size;
+    free_containers_.reserve(size_);
+    free_metadata_containers_.reserve(size_);
+    started_ = true;
+    return true;
+}
+
+Container* ContainerPool::Acquire(uint64_t id, bool metadata_only) {
+    CHECK_RETURN(started_, NULL, "Container pool not started");
+    stats_.acquires_++;
+
+    Container* container = NULL;
+    spin_mutex::scoped_lock scoped_lock(lock_);
+    vector<Container*>& free_list(metadata_only ? free_metadata_containers_ : free_containers_);
+    if (!free_list.empty()) {
+        container = free_list.back();
+        free_list.pop_back();
+    }
+    scoped_lock.release();
+
+    if (container) {
+        stats_.reuses_++;
+        container->Reuse(id);
+        return container;
+    }
+    container = new Container(id, container_size_, metadata_only, huge_pages_);
+    CHECK_RETURN(container, NULL, "Failed to alloc container");
+    stats_.allocations_++;
+    if (container->has_mapped_data()) {
+        stats_.mapped_allocations_++;
+    }
+    return container;
+}
+
+void ContainerPool::Release(Container* container) {
+    if (container == NULL) {
+        return;
+    }
+    stats_.releases_++;
+    if (container->container_size() == container_size_) {
+        container->Reuse(Storage::ILLEGAL_STORAGE_ADDRESS);
+
+        spin_mutex::scoped_lock scoped_lock(lock_);
+        vector<Container*>& free_list(container->is_metadata_only() ? free_metadata_containers_ : free_containers_);
+        if (free_list.size() < size_) {
+            free_list.push_back(container);
+            return;
+        }
+    }
+    stats_.discards_++;
+    delete container;
+}
+
+size_t ContainerPool::GetFreeCount() {
+    spin_mutex::scoped_lock scoped_lock(lock_);
+    return free_containers_.size() + free_metadata_containers_.size();
+}
+
+string ContainerPool::PrintStatistics() {
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"free containers\": " << GetFreeCount() << "," << std::endl;
+    sstr << "\"acquires\": " << stats_.acquires_ << "," << std::endl;
+    sstr << "\"reuses\": " << stats_.reuses_ << "," << std::endl;
+    sstr << "\"allocations\": " << stats_.allocations_ << "," << std::endl;
+    sstr << "\"mapped allocations\": " << stats_.mapped_allocations_ << "," << std::endl;
+    sstr << "\"releases\": " << stats_.releases_ << "," << std::endl;
+    sstr << "\"discards\": " << stats_.discards_ << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+ScopedPoolContainer::ScopedPoolContainer(ContainerPool* pool, uint64_t id, bool metadata_only) {
+    pool_ = pool;
+    container_ = pool_ ? pool_->Acquire(id, metadata_only) : NULL;
+}
+
+ScopedPoolContainer::~ScopedPoolContainer() {
+    if (pool_ && container_) {
+        pool_->Release(container_);
+        container_ = NULL;
+    }
+}
+
+}
+}
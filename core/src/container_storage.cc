@@ -34,6 +34,8 @@
 
 #include <sstream>
 #include <list>
+#include <map>
+#include <algorithm>
 
 #include "dedupv1.pb.h"
 #include "dedupv1_stats.pb.h"
@@ -47,6 +49,7 @@
 #include <base/index.h>
 #include <base/hashing_util.h>
 #include <base/strutil.h>
+#include <base/callback.h>
 #include <base/crc32.h>
 #include <base/logging.h>
 #include <core/container.h>
@@ -71,6 +74,7 @@ using std::stringstream;
 using std::pair;
 using std::make_pair;
 using std::list;
+using std::map;
 using dedupv1::base::strutil::FormatLargeNumber;
 using dedupv1::base::strutil::ToString;
 using dedupv1::base::strutil::ToStorageUnit;
@@ -80,6 +84,7 @@ using dedupv1::base::strutil::To;
 using dedupv1::base::Index;
 using dedupv1::base::ProfileTimer;
 using dedupv1::base::File;
+using dedupv1::base::IOScheduler;
 using dedupv1::base::Compression;
 using dedupv1::base::bits;
 using dedupv1::base::Walltimer;
@@ -95,9 +100,14 @@ using dedupv1::base::lookup_result;
 using dedupv1::base::LOOKUP_ERROR;
 using dedupv1::base::LOOKUP_FOUND;
 using dedupv1::base::LOOKUP_NOT_FOUND;
+using dedupv1::base::PUT_ERROR;
+using dedupv1::base::DELETE_ERROR;
 using dedupv1::base::Thread;
 using dedupv1::base::ThreadUtil;
 using dedupv1::base::NewRunnable;
+using dedupv1::base::Runnable;
+using dedupv1::base::Future;
+using dedupv1::base::Threadpool;
 using dedupv1::log::EVENT_TYPE_CONTAINER_OPEN;
 using dedupv1::log::EVENT_TYPE_CONTAINER_COMMITED;
 using dedupv1::log::EVENT_TYPE_CONTAINER_COMMIT_FAILED;
@@ -115,6 +125,8 @@ using dedupv1::base::Option;
 using dedupv1::base::make_option;
 using dedupv1::base::IndexCursor;
 using dedupv1::base::ScopedPtr;
+using dedupv1::base::Callback1;
+using dedupv1::base::NewCallback;
 using dedupv1::base::ErrorContext;
 using dedupv1::base::UUID;
 
@@ -126,6 +138,21 @@ bool IsValidAddressData(const ContainerStorageAddressData& address) {
     return address.has_primary_id() || (address.has_file_index() && address.has_file_offset());
 }
 
+bool ItemOffsetLess(const ContainerItem* a, const ContainerItem* b) {
+    return a->offset() < b->offset();
+}
+
+/**
+ * Removes the item tables of all ids of the given container from the cache.
+ * Called when the container is written to a new address.
+ */
+void RemoveItemTables(ContainerStorageItemTableCache* item_table_cache, const Container& container) {
+    item_table_cache->Remove(container.primary_id());
+    for (set<uint64_t>::const_iterator i = container.secondary_ids().begin(); i != container.secondary_ids().end(); i++) {
+        item_table_cache->Remove(*i);
+    }
+}
+
 /**
  * Helper class to deal with the in_move_set of the container storage
  */
@@ -194,19 +221,73 @@ public:
 
 }
 
+/**
+ * State of a single container merge while it passes the stages of the merge.
+ * The request is created by the caller and handed from stage to stage, possibly
+ * to different threads.
+ */
+class ContainerMergeRequest {
+    DISALLOW_COPY_AND_ASSIGN(ContainerMergeRequest);
+public:
+    uint64_t container_id_1_;
+    uint64_t container_id_2_;
+
+    ScopedPoolContainer pool_container1_;
+    ScopedPoolContainer pool_container2_;
+
+    ContainerStorageAddressData container_address1_;
+    ContainerStorageAddressData container_address2_;
+
+    /**
+     * The in-move set membership is acquired in the read stage and released after
+     * the merge event is committed (or when the request is deleted).
+     */
+    ScopedInMoveSetMembership in_move_set_membership_;
+
+    Container new_container_;
+    ContainerStorageAddressData new_container_address_;
+
+    /**
+     * true iff an address has been allocated for the new container and the
+     * container has not been written yet.
+     */
+    bool allocated_;
+
+    ContainerMergedEventData event_data_;
+
+    bool aborted_;
+
+    ContainerMergeRequest(ContainerPool* pool,
+                          set<uint64_t>* in_move_set,
+                          tbb::spin_mutex* in_move_set_lock,
+                          uint64_t container_id_1,
+                          uint64_t container_id_2,
+                          uint32_t container_size)
+        : container_id_1_(container_id_1),
+        container_id_2_(container_id_2),
+        pool_container1_(pool, container_id_1, false),
+        pool_container2_(pool, container_id_2, false),
+        in_move_set_membership_(in_move_set, in_move_set_lock),
+        new_container_(0, container_size, false),
+        allocated_(false),
+        aborted_(false) {
+    }
+};
+
 lookup_result ContainerStorage::ReadContainerWithCache(
-    Container* container) {
+    Container* container,
+    read_cache_hint hint) {
     DCHECK_RETURN(container, LOOKUP_ERROR, "Container not set");
     DCHECK_RETURN(state_ == RUNNING || state_ == STARTED, LOOKUP_ERROR,
         "Illegal state to read container: " <<
         "state " << this->state_ << ", container " << container->primary_id());
 
-    bool use_cache = !container->is_metadata_only();
+    bool use_cache = !container->is_metadata_only() && hint != READ_CACHE_HINT_NO_POLLUTE;
     CacheEntry cache_entry;
 
     const Container* cache_container = NULL;
     // do not provide cache stuff the we only want meta data
-    lookup_result r = this->cache_.CheckCache(container->primary_id(), &cache_container, !use_cache, false, &cache_entry);
+    lookup_result r = this->cache_.CheckCache(container->primary_id(), &cache_container, !use_cache, false, &cache_entry, hint);
     CHECK_RETURN(r != LOOKUP_ERROR, LOOKUP_ERROR, "Failed to check cache: container " << container->DebugString());
 
     if (r == LOOKUP_FOUND) {
@@ -244,6 +325,70 @@ lookup_result ContainerStorage::ReadContainerWithCache(
     return b;
 }
 
+lookup_result ContainerStorage::LookupAddressData(uint64_t container_id, ContainerStorageAddressData* address_data) {
+    if (address_table_enabled_ && address_table_.is_started()) {
+        return address_table_.Lookup(container_id, address_data);
+    }
+    return this->meta_data_index_->Lookup(&container_id, sizeof(container_id), address_data);
+}
+
+void ContainerStorage::AppendContainerSummary(const Container& container, const ContainerStorageAddressData& address,
+                                              int64_t log_id) {
+    if (!summary_log_enabled_) {
+        return;
+    }
+    ContainerSummaryLog* summary_log = this->summary_log(address.file_index());
+    if (summary_log == NULL) {
+        WARNING("No summary log for address " << DebugString(address));
+        return;
+    }
+    if (!summary_log->Append(container, address, log_id)) {
+        WARNING("Failed to append container summary: container " << container.DebugString() <<
+            ", address " << DebugString(address));
+    }
+}
+
+ContainerSummaryLog* ContainerStorage::summary_log(uint32_t file_index) {
+    if (file_index >= summary_logs_.size()) {
+        return NULL;
+    }
+    return summary_logs_[file_index];
+}
+
+Option<bool> ContainerStorage::IsCurrentContainerSummary(const ContainerSummaryData& summary) {
+    CHECK(summary.has_address(), "Summary has no address: " << summary.ShortDebugString());
+
+    ContainerStorageAddressData address;
+    lookup_result r = LookupAddressData(summary.container_id(), &address);
+    CHECK(r != LOOKUP_ERROR, "Failed to lookup container address: container id " << summary.container_id());
+    if (r == LOOKUP_NOT_FOUND || address.has_primary_id()) {
+        return make_option(false);
+    }
+    return make_option(address.file_index() == summary.address().file_index() &&
+        address.file_offset() == summary.address().file_offset() &&
+        address.log_id() == summary.address().log_id());
+}
+
+bool ContainerStorage::PutAddressData(uint64_t container_id, const ContainerStorageAddressData& address_data) {
+    CHECK(this->meta_data_index_->Put(&container_id, sizeof(container_id), address_data) != PUT_ERROR,
+        "Failed to update meta data index: container id " << container_id);
+    if (address_table_enabled_ && address_table_.is_started()) {
+        CHECK(address_table_.Update(container_id, address_data),
+            "Failed to update address table: container id " << container_id);
+    }
+    return true;
+}
+
+bool ContainerStorage::DeleteAddressData(uint64_t container_id) {
+    CHECK(this->meta_data_index_->Delete(&container_id, sizeof(container_id)) != DELETE_ERROR,
+        "Failed to delete from meta data index: container id " << container_id);
+    if (address_table_enabled_ && address_table_.is_started()) {
+        CHECK(address_table_.Delete(container_id),
+            "Failed to delete from address table: container id " << container_id);
+    }
+    return true;
+}
+
 pair<lookup_result, ContainerStorageAddressData> ContainerStorage::LookupContainerAddress(
     uint64_t container_id,
     ReadWriteLock** primary_container_lock,
@@ -260,8 +405,7 @@ pair<lookup_result, ContainerStorageAddressData> ContainerStorage::LookupContain
 
     ContainerStorageAddressData container_address;
     ContainerStorageAddressData first_lookedup_container_address;
-    lookup_result lr = this->meta_data_index_->Lookup(&container_id, sizeof(uint64_t),
-        &container_address);
+    lookup_result lr = LookupAddressData(container_id, &container_address);
     if (lr == LOOKUP_ERROR || lr == LOOKUP_NOT_FOUND) {
         return make_pair(lr, container_address);
     }
@@ -275,8 +419,7 @@ pair<lookup_result, ContainerStorageAddressData> ContainerStorage::LookupContain
 
         TRACE("Lookup primary container address: container id " << container_id << ", primary container id " << primary_id);
 
-        lr = this->meta_data_index_->Lookup(&primary_id, sizeof(uint64_t),
-            &container_address);
+        lr = LookupAddressData(primary_id, &container_address);
         if (lr == LOOKUP_ERROR) {
             ERROR("Failed to lookup primary id: secondary id " << container_id <<
                 ", address " << container_address.ShortDebugString() <<
@@ -411,8 +554,10 @@ enum lookup_result ContainerStorage::ReadContainerLocked(Container* container,
     CHECK_RETURN(file, LOOKUP_ERROR, "File not open: file index: " << file_index << ", file count " << this->file_.size());
 
     // Access file
+    // With an io scheduler, the reads are not serialized by the file lock so that
+    // the scheduler is able to order and merge the requests of concurrent readers.
     ScopedLock file_lock(this->file_[file_index].lock());
-    {
+    if (this->io_scheduler_ == NULL) {
         ProfileTimer file_lock_timer(this->stats_.total_file_lock_time_);
         CHECK_RETURN(file_lock.AcquireLockWithStatistics(
                 &this->stats_.file_lock_free_,
@@ -424,7 +569,7 @@ enum lookup_result ContainerStorage::ReadContainerLocked(Container* container,
     {
         ProfileTimer load_file_timer(this->stats_.total_file_load_time_);
         tbb::tick_count load_start = tbb::tick_count::now();
-        load_file = container->LoadFromFile(file, file_offset, calculate_container_checksum_);
+        load_file = container->LoadFromFile(file, file_offset, calculate_container_checksum_, io_scheduler_);
         this->stats_.average_container_load_latency_.Add((tbb::tick_count::now() - load_start).seconds() * 1000);
     }
     if (!load_file) {
@@ -435,7 +580,9 @@ enum lookup_result ContainerStorage::ReadContainerLocked(Container* container,
             ", loaded address " << DebugString(container_address));
         return LOOKUP_ERROR;
     }
-    CHECK_RETURN(file_lock.ReleaseLock(), LOOKUP_ERROR, "Unlock failed");
+    if (file_lock.IsHeld()) {
+        CHECK_RETURN(file_lock.ReleaseLock(), LOOKUP_ERROR, "Unlock failed");
+    }
     this->stats_.readed_container_.fetch_and_increment();
 
     TRACE("Read container from disk: " <<
@@ -476,9 +623,9 @@ enum lookup_result ContainerStorage::ReadContainer(Container* container) {
     CHECK_RETURN(file, LOOKUP_ERROR, "File not open: file index: " << file_index << ", file count " << this->file_.size());
 
     // Access file
-
+    // See ReadContainerLocked for the io scheduler case
     ScopedLock file_lock(this->file_[file_index].lock());
-    {
+    if (this->io_scheduler_ == NULL) {
         ProfileTimer file_lock_timer(this->stats_.total_file_lock_time_);
         CHECK_RETURN(file_lock.AcquireLockWithStatistics(
                 &this->stats_.file_lock_free_,
@@ -490,7 +637,7 @@ enum lookup_result ContainerStorage::ReadContainer(Container* container) {
     {
         ProfileTimer load_file_timer(this->stats_.total_file_load_time_);
         tbb::tick_count load_start = tbb::tick_count::now();
-        load_file_result = container->LoadFromFile(file, file_offset, calculate_container_checksum_);
+        load_file_result = container->LoadFromFile(file, file_offset, calculate_container_checksum_, io_scheduler_);
 
         this->stats_.average_container_load_latency_.Add((tbb::tick_count::now() - load_start).seconds() * 1000);
     }
@@ -523,7 +670,9 @@ enum lookup_result ContainerStorage::ReadContainer(Container* container) {
             ", " << second_address);
         return LOOKUP_ERROR;
     }
-    CHECK_RETURN(file_lock.ReleaseLock(), LOOKUP_ERROR, "Unlock failed");
+    if (file_lock.IsHeld()) {
+        CHECK_RETURN(file_lock.ReleaseLock(), LOOKUP_ERROR, "Unlock failed");
+    }
     this->stats_.readed_container_.fetch_and_increment();
 
     TRACE("Read container from disk: " <<
@@ -555,14 +704,27 @@ bool ContainerStorage::WriteContainer(Container* container, const ContainerStora
     CHECK(file, "File not open: file index " << file_index);
 
     // TODO(fermat): Is this lock needed any more? It should be no problem to access the same file at different positions concurrently.
+    // With an io scheduler, the writes are not serialized by the file lock so that
+    // the scheduler is able to coalesce the writes of concurrent writers.
     ScopedLock file_lock(this->file_[file_index].lock());
-    CHECK(file_lock.AcquireLockWithStatistics(
-            &this->stats_.file_lock_free_,
-            &this->stats_.file_lock_busy_), "Failed to acquire file lock: file index " << file_index);
+    if (this->io_scheduler_ == NULL) {
+        CHECK(file_lock.AcquireLockWithStatistics(
+                &this->stats_.file_lock_free_,
+                &this->stats_.file_lock_busy_), "Failed to acquire file lock: file index " << file_index);
+    }
 
-    CHECK(container->StoreToFile(file, file_offset, calculate_container_checksum_),
+    container->set_checksum_type(this->file_[file_index].checksum_type());
+    CHECK(container->StoreToFile(file, file_offset, calculate_container_checksum_, io_scheduler_),
         "Cannot write container " << container_id << ": " << container->DebugString());
-    CHECK(file_lock.ReleaseLock(), "Container unlock failed");
+    if (this->io_scheduler_ == NULL) {
+        CHECK(file_lock.ReleaseLock(), "Container unlock failed");
+    }
+
+    if (this->file_[file_index].group_sync()) {
+        // the container is written to the page cache. Wait until it is durable before the commit is logged
+        CHECK(this->file_[file_index].group_sync()->SyncWrite(),
+            "Failed to sync container " << container_id << ": file index " << file_index);
+    }
     FAULT_POINT("container-storage.write.after-write");
     TRACE("Write container: " << container->DebugString() << ", address " << DebugString(container_address));
 
@@ -592,6 +754,33 @@ bool ContainerStorage::MarkContainerCommitAsFailed(Container* container) {
     return true;
 }
 
+Compression* ContainerStorage::GetCompression() {
+    if (compression_dictionary_enabled_) {
+        Compression* compression = compression_dictionary_.compression();
+        if (compression) {
+            return compression;
+        }
+    }
+    return compression_;
+}
+
+bool ContainerStorage::CompressContainer(Container* container) {
+    DCHECK(container, "Container not set");
+    Compression* compression = GetCompression();
+    DCHECK(compression, "Compression not set");
+
+    ProfileTimer compression_timer(this->stats_.background_compression_time_);
+    size_t data_position = container->data_position();
+    CHECK(container->CompressItems(compression), "Failed to compress items: " << container->DebugString());
+    DCHECK(container->data_position() <= data_position, "Illegal data position after compression: " << container->DebugString());
+
+    this->stats_.background_compressed_container_++;
+    this->stats_.background_compression_saved_bytes_ += (data_position - container->data_position());
+    TRACE("Compressed container " << container->DebugString() <<
+        ", saved bytes " << (data_position - container->data_position()));
+    return true;
+}
+
 bool ContainerStorage::CommitContainer(Container* container, const ContainerStorageAddressData& address) {
 #ifdef DEDUPV1_CORE_TEST
     if (clear_data_called_) {
@@ -626,6 +815,17 @@ bool ContainerStorage::CommitContainer(Container* container, const ContainerStor
         return false;
     }
 
+    if (background_compression_ && compression_) {
+        if (!CompressContainer(container)) {
+            ERROR("Failed to compress container: " << container->DebugString());
+            this->meta_data_cache_.Unstick(container_id);
+
+            CHECK(MarkContainerCommitAsFailed(container),
+                "Failed to mark container commit as failed: " << container->DebugString());
+            return false;
+        }
+    }
+
     INFO("Commit container: " << container->DebugString() << ", " << DebugString(address));
 
     if (!this->WriteContainer(container, address)) {
@@ -667,6 +867,7 @@ bool ContainerStorage::CommitContainer(Container* container, const ContainerStor
         }
         return false;
     }
+    AppendContainerSummary(*container, address, event_log_id);
 
     // In some sense, it would be better to unpin it in the LogAck method, but there
     // we don't have to container available. But you should be aware that the
@@ -730,7 +931,7 @@ bool ContainerStorage::LogAck(event_type event_type, const Message* log_message,
 
         // Update index
         DCHECK(IsValidAddressData(event_data.address()), "Invalid address data: " << event_data.ShortDebugString());
-        CHECK(this->meta_data_index_->Put(&container_id, sizeof(uint64_t), event_data.address()),
+        CHECK(PutAddressData(container_id, event_data.address()),
             "Meta data update failed: " << container_id <<
             ", address " << DebugString(event_data.address()));
         CHECK(this->meta_data_cache_.Update(container_id, STORAGE_ADDRESS_COMMITED), "Failed to update cache");
@@ -740,6 +941,11 @@ bool ContainerStorage::LogAck(event_type event_type, const Message* log_message,
         if (!gc_->OnCommit(event_data)) {
             WARNING("Error while updating storage gc: " << event_data.ShortDebugString());
         }
+        if (tiering_enabled_) {
+            if (!tiering_.OnCommit(event_data)) {
+                WARNING("Error while updating tiering: " << event_data.ShortDebugString());
+            }
+        }
 
         // Container Moved
     } else if (event_type == EVENT_TYPE_CONTAINER_MOVED) {
@@ -760,7 +966,7 @@ bool ContainerStorage::LogAck(event_type event_type, const Message* log_message,
         DCHECK(IsValidAddressData(event_data.new_address()), "Invalid address data: " << event_data.ShortDebugString());
         DCHECK(IsValidAddressData(event_data.old_address()), "Invalid address data: " << event_data.ShortDebugString());
 
-        CHECK(this->meta_data_index_->Put(&container_id, sizeof(uint64_t), event_data.new_address()),
+        CHECK(PutAddressData(container_id, event_data.new_address()),
             "Meta data update failed: " << container_id <<
             ", address " << DebugString(event_data.new_address()));
 
@@ -780,6 +986,11 @@ bool ContainerStorage::LogAck(event_type event_type, const Message* log_message,
                 WARNING("Error while updating storage gc: " << event_data.ShortDebugString());
             }
         }
+        if (tiering_enabled_) {
+            if (!tiering_.OnMove(event_data)) {
+                WARNING("Error while updating tiering: " << event_data.ShortDebugString());
+            }
+        }
         CHECK(scoped_container_lock.ReleaseLock(), "Failed to release container lock");
 
         // Container Merged
@@ -800,7 +1011,7 @@ bool ContainerStorage::LogAck(event_type event_type, const Message* log_message,
         ScopedReadWriteLock scoped_lock(&meta_data_lock_);
         CHECK(scoped_lock.AcquireWriteLock(), "Failed to acquire meta data lock");
         DCHECK(IsValidAddressData(event_data.new_address()), "Invalid address data: " << event_data.ShortDebugString());
-        CHECK(this->meta_data_index_->Put(&container_id, sizeof(uint64_t), event_data.new_address()),
+        CHECK(PutAddressData(container_id, event_data.new_address()),
             "Meta data update failed: " << container_id <<
             ", address " << DebugString(event_data.new_address()));
         FAULT_POINT("container-storage.ack.container-merge-after-put");
@@ -814,14 +1025,14 @@ bool ContainerStorage::LogAck(event_type event_type, const Message* log_message,
             uint64_t id = event_data.new_secondary_id(i);
             TRACE("Redirect merged container " << id << ": primary id " << secondary_data_address.primary_id());
             DCHECK(IsValidAddressData(secondary_data_address), "Invalid address data: " << secondary_data_address.ShortDebugString());
-            CHECK(this->meta_data_index_->Put(&id, sizeof(id), secondary_data_address),
+            CHECK(PutAddressData(id, secondary_data_address),
                 "Cannot write new container address: container id " << id);
             FAULT_POINT("container-storage.ack.container-merge-after-secondary-put");
         }
         for (int i = 0; i < event_data.unused_ids_size(); i++) {
             uint64_t id = event_data.unused_ids(i);
             TRACE("Delete unused container id: container " << id);
-            CHECK(this->meta_data_index_->Delete(&id, sizeof(id)), "Cannot delete unused container address: container id " << id);
+            CHECK(DeleteAddressData(id), "Cannot delete unused container address: container id " << id);
             CHECK(this->meta_data_cache_.Delete(id), "Failed to delete unused container address from meta data cache: container id " << id);
             FAULT_POINT("container-storage.ack.container-merge-middle");
         }
@@ -854,6 +1065,10 @@ bool ContainerStorage::LogAck(event_type event_type, const Message* log_message,
             CHECK(this->gc_->OnMerge(event_data),
                 "Failed to report merge to gc: " << event_data.ShortDebugString());
         }
+        if (tiering_enabled_) {
+            CHECK(tiering_.OnMerge(event_data),
+                "Failed to report merge to tiering: " << event_data.ShortDebugString());
+        }
 
         CHECK(container_lock1.ReleaseLock(), "Cannot release container write lock");
         if (container_lock2.Get() != container_lock1.Get()) {
@@ -885,7 +1100,7 @@ bool ContainerStorage::LogAck(event_type event_type, const Message* log_message,
         for (set<uint64_t>::const_iterator i = all_old_ids.begin(); i != all_old_ids.end(); i++) {
             uint64_t id = *i;
             TRACE("Delete unused container id: container " << id);
-            CHECK(this->meta_data_index_->Delete(&id, sizeof(id)), "Cannot delete unused container address: container id " << id);
+            CHECK(DeleteAddressData(id), "Cannot delete unused container address: container id " << id);
             CHECK(this->meta_data_cache_.Delete(id), "Failed to delete unused container address from meta data cache: container id " << id);
             FAULT_POINT("container-storage.ack.container-delete-middle");
         }
@@ -902,6 +1117,10 @@ bool ContainerStorage::LogAck(event_type event_type, const Message* log_message,
             CHECK(this->allocator_->OnDeleteContainer(event_data),
                 "Cannot get delete container address: " << event_data.ShortDebugString());
         }
+        if (tiering_enabled_) {
+            CHECK(tiering_.OnDeleteContainer(event_data),
+                "Failed to report delete to tiering: " << event_data.ShortDebugString());
+        }
 
         CHECK(container_lock.ReleaseLock(), "Failed to release container lock");
 
@@ -981,6 +1200,16 @@ ContainerStorage::ContainerStorage() : meta_data_cache_(this),
     this->last_given_container_id_ = 0;
     this->timeout_committer_ = NULL;
     this->compression_ = NULL;
+    this->background_compression_ = false;
+    this->compression_level_ = Compression::kDefaultZstdLevel;
+    this->compression_level_set_ = false;
+    this->compression_dictionary_enabled_ = false;
+    this->adaptive_compression_enabled_ = false;
+    this->group_commit_ = false;
+    this->address_table_enabled_ = true;
+    this->tiering_enabled_ = false;
+    this->merge_pipeline_enabled_ = true;
+    this->summary_log_enabled_ = false;
     this->state_ = CREATED;
     this->idle_detector_ = NULL;
     this->gc_ = NULL;
@@ -990,6 +1219,13 @@ ContainerStorage::ContainerStorage() : meta_data_cache_(this),
     this->size_ = 0;
     info_store_ = NULL;
     calculate_container_checksum_ = true;
+    checksum_type_ = CONTAINER_CHECKSUM_ADLER32;
+    io_scheduler_ = NULL;
+    tp_ = NULL;
+    max_prefetch_count_ = kDefaultMaxPrefetchCount;
+    partial_read_ = false;
+    partial_read_max_ratio_ = 0.25;
+    partial_read_full_load_count_ = kDefaultPartialReadFullLoadCount;
     timeout_committer_should_stop_ = false;
     had_been_started_ = false;
     chunk_index_ = NULL;
@@ -1013,6 +1249,17 @@ ContainerStorage::Statistics::Statistics() : average_container_load_latency_(16)
     this->write_cache_hit_ = 0;
     this->container_lock_free_ = 0;
     this->container_lock_busy_ = 0;
+    this->batch_reads_ = 0;
+    this->batch_read_containers_ = 0;
+    this->prefetch_requests_ = 0;
+    this->prefetch_loads_ = 0;
+    this->prefetch_ignored_ = 0;
+    this->partial_reads_ = 0;
+    this->partial_read_bytes_ = 0;
+    this->partial_read_metadata_loads_ = 0;
+    this->partial_read_full_loads_ = 0;
+    this->background_compressed_container_ = 0;
+    this->background_compression_saved_bytes_ = 0;
 
     this->committed_container_ = 0;
     this->container_timeouts_ = 0;
@@ -1020,6 +1267,7 @@ ContainerStorage::Statistics::Statistics() : average_container_load_latency_(16)
     this->committed_container_ = 0;
     this->moved_container_ = 0;
     this->merged_container_ = 0;
+    this->pipelined_merges_ = 0;
     this->failed_container_ = 0;
     this->deleted_container_ = 0;
 }
@@ -1042,11 +1290,61 @@ bool ContainerStorage::SetOption(const string& option_name, const string& option
         this->calculate_container_checksum_ = To<bool>(option).value();
         return true;
     }
+    if (option_name == "checksum-type") {
+        if (option == "adler32") {
+            this->checksum_type_ = CONTAINER_CHECKSUM_ADLER32;
+        } else if (option == "crc32c") {
+            this->checksum_type_ = CONTAINER_CHECKSUM_CRC32C;
+        } else {
+            ERROR("Illegal checksum type: " << option);
+            return false;
+        }
+        return true;
+    }
+    if (option_name == "io-scheduler") {
+        CHECK(this->io_scheduler_ == NULL, "IO scheduler already created");
+        CHECK(To<bool>(option).valid(), "Illegal option " << option);
+        if (To<bool>(option).value()) {
+            this->io_scheduler_ = new IOScheduler();
+        }
+        return true;
+    }
+    if (StartsWith(option_name, "io-scheduler.")) {
+        CHECK(this->io_scheduler_ != NULL, "IO scheduler not created");
+        CHECK(this->io_scheduler_->SetOption(option_name.substr(strlen("io-scheduler.")), option),
+            "IO scheduler configuration failed");
+        return true;
+    }
     if (option_name == "preallocate") {
         CHECK(To<bool>(option).valid(), "Illegal option");
         this->preallocate_ = To<bool>(option).value();
         return true;
     }
+    if (option_name == "max-prefetch-count") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        this->max_prefetch_count_ = To<uint32_t>(option).value();
+        return true;
+    }
+    if (option_name == "partial-read") {
+        CHECK(To<bool>(option).valid(), "Illegal option " << option);
+        this->partial_read_ = To<bool>(option).value();
+        return true;
+    }
+    if (option_name == "partial-read.max-ratio") {
+        CHECK(To<double>(option).valid(), "Illegal option " << option);
+        double ratio = To<double>(option).value();
+        CHECK(ratio > 0.0 && ratio <= 1.0, "Illegal partial read ratio " << option);
+        this->partial_read_max_ratio_ = ratio;
+        return true;
+    }
+    if (option_name == "partial-read.full-load-count") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        this->partial_read_full_load_count_ = To<uint32_t>(option).value();
+        return true;
+    }
+    if (option_name == "partial-read.item-table-size") {
+        return this->item_table_cache_.SetOption("size", option);
+    }
     if (option_name == "read-cache-size") {
         return this->cache_.SetOption("size", option);
     }
@@ -1063,6 +1361,22 @@ bool ContainerStorage::SetOption(const string& option_name, const string& option
         this->timeout_seconds_ = To<uint32_t>(option).value();
         return true;
     }
+    if (option_name == "compression.level") {
+        CHECK(To<int>(option).valid(), "Illegal option " << option);
+        this->compression_level_ = To<int>(option).value();
+        this->compression_level_set_ = true;
+        return true;
+    }
+    if (option_name == "compression.dictionary") {
+        CHECK(To<bool>(option).valid(), "Illegal option " << option);
+        this->compression_dictionary_enabled_ = To<bool>(option).value();
+        return true;
+    }
+    if (StartsWith(option_name, "compression.dictionary.")) {
+        CHECK(this->compression_dictionary_.SetOption(option_name.substr(strlen("compression.dictionary.")), option),
+            "Config failed");
+        return true;
+    }
     if (option_name == "compression") {
         CHECK(this->compression_ == NULL, "Compression already set");
         if (option == "deflate") {
@@ -1077,6 +1391,9 @@ bool ContainerStorage::SetOption(const string& option_name, const string& option
         } else if (option == "lz4") {
             this->compression_ = Compression::NewCompression(Compression::COMPRESSION_LZ4);
             return true;
+        } else if (option == "zstd") {
+            this->compression_ = Compression::NewCompression(Compression::COMPRESSION_ZSTD);
+            return true;
         } else if (option == "none") {
             this->compression_ = NULL;
             return true;
@@ -1085,6 +1402,50 @@ bool ContainerStorage::SetOption(const string& option_name, const string& option
             return false;
         }
     }
+    if (option_name == "background-compression") {
+        CHECK(To<bool>(option).valid(), "Illegal option " << option);
+        this->background_compression_ = To<bool>(option).value();
+        return true;
+    }
+    if (option_name == "adaptive-compression") {
+        CHECK(To<bool>(option).valid(), "Illegal option " << option);
+        this->adaptive_compression_enabled_ = To<bool>(option).value();
+        return true;
+    }
+    if (StartsWith(option_name, "adaptive-compression.")) {
+        CHECK(this->adaptive_compression_.SetOption(option_name.substr(strlen("adaptive-compression.")), option),
+            "Config failed");
+        return true;
+    }
+    if (option_name == "group-commit") {
+        CHECK(To<bool>(option).valid(), "Illegal option " << option);
+        this->group_commit_ = To<bool>(option).value();
+        return true;
+    }
+    if (option_name == "address-table") {
+        CHECK(To<bool>(option).valid(), "Illegal option " << option);
+        this->address_table_enabled_ = To<bool>(option).value();
+        return true;
+    }
+    if (option_name == "tiering") {
+        CHECK(To<bool>(option).valid(), "Illegal option " << option);
+        this->tiering_enabled_ = To<bool>(option).value();
+        return true;
+    }
+    if (StartsWith(option_name, "tiering.")) {
+        CHECK(this->tiering_.SetOption(option_name.substr(strlen("tiering.")), option), "Config failed");
+        return true;
+    }
+    if (option_name == "merge-pipeline") {
+        CHECK(To<bool>(option).valid(), "Illegal option " << option);
+        this->merge_pipeline_enabled_ = To<bool>(option).value();
+        return true;
+    }
+    if (option_name == "summary-log") {
+        CHECK(To<bool>(option).valid(), "Illegal option " << option);
+        this->summary_log_enabled_ = To<bool>(option).value();
+        return true;
+    }
     if (option_name == "filename") {
         CHECK(option.size() <= 255, "Filename too long");
         CHECK(option.size() > 0, "Filename too short");
@@ -1113,6 +1474,12 @@ bool ContainerStorage::SetOption(const string& option_name, const string& option
         file_.back().set_file_size(ToStorageUnit(option).value());
         return true;
     }
+    if (option_name == "filetier") {
+        CHECK(file_.size() > 0, "No file configured");
+        CHECK(option == "fast" || option == "capacity", "Illegal file tier " << option);
+        file_.back().set_fast_tier(option == "fast");
+        return true;
+    }
     if (option_name == "meta-data") {
         Index* index = Index::Factory().Create(option);
         CHECK(index, "Index creation failed");
@@ -1138,6 +1505,10 @@ bool ContainerStorage::SetOption(const string& option_name, const string& option
         CHECK(this->cache_.SetOption(option_name.substr(strlen("read-cache.")), option), "Config failed");
         return true;
     }
+    if (StartsWith(option_name, "container-pool.")) {
+        CHECK(this->container_pool_.SetOption(option_name.substr(strlen("container-pool.")), option), "Config failed");
+        return true;
+    }
     if (option_name == "gc") {
         this->gc_ = ContainerGCStrategyFactory::Create(option);
         CHECK(this->gc_, "Cannot create gc strategy: " << option);
@@ -1170,6 +1541,9 @@ bool ContainerStorage::Format(const ContainerFile& file, File* format_file) {
 
     ContainerSuperblockData superblock;
     superblock.set_uuid(file.uuid().ToString());
+    if (file.checksum_type() != CONTAINER_CHECKSUM_ADLER32) {
+        superblock.set_checksum_type(file.checksum_type());
+    }
 
     CHECK(format_file->WriteSizedMessage(0, superblock, kSuperBlockSize, true) > 0,
         "Failed to write superblock: " << superblock.DebugString());
@@ -1201,6 +1575,7 @@ bool ContainerStorage::Start(const StartContext& start_context, DedupSystem* sys
     idle_detector_ = system->idle_detector();
     chunk_index_ = system->chunk_index();
     DCHECK(chunk_index_, "Chunk index not set");
+    tp_ = system->threadpool();
 
     CHECK(this->file_.size() > 0, "Container files not configured");
     CHECK(this->meta_data_index_, "Metadata index not configured");
@@ -1208,6 +1583,23 @@ bool ContainerStorage::Start(const StartContext& start_context, DedupSystem* sys
     CHECK(this->allocator_, "Allocator not configured");
     CHECK(this->gc_, "Garbage collector not configured");
     CHECK(this->size_ > 0, "Container storage size not configured");
+    // the zstd options are applied here so that they do not depend on the order of the options
+    bool zstd_compression = this->compression_ && this->compression_->GetCompressionType() == Compression::COMPRESSION_ZSTD;
+    CHECK(!this->compression_level_set_ || zstd_compression,
+        "Compression level only supported for zstd compression");
+    CHECK(!this->compression_dictionary_enabled_ || zstd_compression,
+        "Compression dictionary only supported for zstd compression");
+    if (this->compression_level_set_) {
+        Compression* compression = Compression::NewZstdCompression(this->compression_level_, "");
+        CHECK(compression, "Failed to create compression: level " << this->compression_level_);
+        delete this->compression_;
+        this->compression_ = compression;
+    }
+    if (this->partial_read_ && this->calculate_container_checksum_) {
+        // the checksum covers the complete container, it cannot be verified when only some items are read
+        WARNING("Partial reads disabled: container checksums are enabled");
+        this->partial_read_ = false;
+    }
 
     this->container_lock_.Init(1024);
     this->state_ = STARTING;
@@ -1232,9 +1624,15 @@ bool ContainerStorage::Start(const StartContext& start_context, DedupSystem* sys
 
     int64_t size_to_assign = size_;
 
+    // with group commit, the container writes are synced explicitly
+    int open_flags = O_RDWR | O_LARGEFILE;
+    if (!group_commit_) {
+        open_flags |= O_SYNC;
+    }
+
     // open all existing files
     for (i = 0; i < this->file_.size(); i++) {
-        ScopedPtr<File> tmp_file(File::Open(this->file_[i].filename(), O_RDWR | O_LARGEFILE | O_SYNC, 0));
+        ScopedPtr<File> tmp_file(File::Open(this->file_[i].filename(), open_flags, 0));
         if (tmp_file.Get()) {
             // The file seems to be valid
             // special checks for old files
@@ -1272,6 +1670,8 @@ bool ContainerStorage::Start(const StartContext& start_context, DedupSystem* sys
                 Option<UUID> uuid = UUID::FromString(superblock.uuid());
                 CHECK(uuid.valid(), "Invalid uuid in super block: " << superblock.ShortDebugString());
                 file_[i].set_uuid(uuid.value());
+                // containers in an existing file are written with the checksum type of the file
+                file_[i].set_checksum_type(superblock.checksum_type());
             }
 
             if (preallocate_) {
@@ -1285,7 +1685,7 @@ bool ContainerStorage::Start(const StartContext& start_context, DedupSystem* sys
                     ", actual file size " << total_file_size);
             }
 
-            file_[i].Start(tmp_file.Get(), false);
+            file_[i].Start(tmp_file.Get(), false, group_commit_);
             tmp_file.Release();
         }
     }
@@ -1343,13 +1743,14 @@ bool ContainerStorage::Start(const StartContext& start_context, DedupSystem* sys
                 "Failed to check parent directories");
 
             file_[i].set_uuid(UUID::Generate());
+            file_[i].set_checksum_type(checksum_type_);
 
             // open file without O_SYNC to speed up formatting
             ScopedPtr<File> format_file(File::Open(this->file_[i].filename(), O_RDWR | O_LARGEFILE | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP));
             CHECK(format_file.Get(), "Failed to open file for formatting: " << this->file_[i].filename());
             CHECK(Format(this->file_[i], format_file.Get()), "Failed to format " << this->file_[i].filename());
 
-            ScopedPtr<File> tmp_file(File::Open(this->file_[i].filename(), O_RDWR | O_LARGEFILE | O_SYNC, 0));
+            ScopedPtr<File> tmp_file(File::Open(this->file_[i].filename(), open_flags, 0));
             CHECK(tmp_file.Get(), "Failed to open container file " << file_[i].filename());
             CHECK(chmod(this->file_[i].filename().c_str(), start_context.file_mode().mode()) == 0,
                 "Failed to change file permissions: " << this->file_[i].filename());
@@ -1358,13 +1759,41 @@ bool ContainerStorage::Start(const StartContext& start_context, DedupSystem* sys
                     "Failed to change file group: " << this->file_[i].filename());
             }
 
-            file_[i].Start(tmp_file.Release(), true);
+            file_[i].Start(tmp_file.Release(), true, group_commit_);
         }
     }
 
     CHECK(size_to_assign == 0, "Illegal container configuration: total size " << FormatStorageUnit(size_) <<
         ", not assigned size " << FormatStorageUnit(size_to_assign));
 
+    if (summary_log_enabled_) {
+        for (i = 0; i < file_.size(); i++) {
+            string summary_log_filename = file_[i].filename() + ".summary";
+            if (start_context.readonly()) {
+                Option<bool> exists = File::Exists(summary_log_filename);
+                CHECK(exists.valid(), "Failed to check summary log: " << summary_log_filename);
+                if (!exists.value()) {
+                    WARNING("Summary log missing: " << summary_log_filename);
+                    summary_logs_.push_back(NULL);
+                    continue;
+                }
+            }
+            ScopedPtr<ContainerSummaryLog> summary_log(new ContainerSummaryLog());
+            // the records of a newly created container file are meaningless
+            CHECK(summary_log->Start(summary_log_filename, file_[i].new_file(), start_context.readonly()),
+                "Failed to start summary log: " << summary_log_filename);
+            summary_logs_.push_back(summary_log.Release());
+        }
+    }
+
+    if (this->io_scheduler_) {
+        for (size_t i = 0; i < this->file_.size(); i++) {
+            CHECK(this->io_scheduler_->RegisterFile(this->file_[i].file()),
+                "Failed to register container file at io scheduler: " << this->file_[i].filename());
+        }
+        CHECK(this->io_scheduler_->Start(), "Failed to start io scheduler");
+    }
+
     // we wait to dump the meta data until the formatting is done
     if (info_lookup == LOOKUP_NOT_FOUND && start_context.create()) {
         CHECK(DumpMetaInfo(), "Failed to dump info");
@@ -1378,8 +1807,19 @@ bool ContainerStorage::Start(const StartContext& start_context, DedupSystem* sys
     this->highest_committed_container_id_ = this->last_given_container_id_;
 
     CHECK(this->meta_data_index_->Start(start_context), "Container index start failed");
+    if (address_table_enabled_) {
+        CHECK(this->address_table_.Start(this->meta_data_index_), "Failed to start address table");
+    }
     CHECK(this->write_cache_.Start(), "Failed to start write cache");
     CHECK(this->cache_.Start(), "Failed to start cache");
+    CHECK(this->container_pool_.Start(this->container_size_), "Failed to start container pool");
+    // a persisted dictionary is always restored. Otherwise, items compressed with the dictionary
+    // become unreadable if the dictionary is disabled later.
+    CHECK(this->compression_dictionary_.Start(info_store_, compression_level_),
+        "Failed to start compression dictionary");
+    if (adaptive_compression_enabled_) {
+        CHECK(this->adaptive_compression_.Start(), "Failed to start adaptive compression");
+    }
 
     if (this->idle_detector_) {
         CHECK(this->idle_detector_->RegisterIdleConsumer("container-storage", this),
@@ -1391,6 +1831,9 @@ bool ContainerStorage::Start(const StartContext& start_context, DedupSystem* sys
     CHECK(this->background_committer_.Start(this), "Cannot start committer");
     CHECK(this->gc_->Start(start_context, this), "Cannot start gc");
     CHECK(this->allocator_->Start(start_context, this), "Cannot start allocator");
+    if (tiering_enabled_) {
+        CHECK(this->tiering_.Start(this), "Cannot start tiering");
+    }
 
     this->state_ = STARTED;
 
@@ -1403,6 +1846,18 @@ bool ContainerStorage::Start(const StartContext& start_context, DedupSystem* sys
             ERROR("Last given container id " << id << " already stored: Illegal last given container id");
             return false;
         }
+
+        // after a clean shutdown, the container addresses are up to date and the stale
+        // summary records can be removed
+        Callback1<Option<bool>, const ContainerSummaryData&>* is_current =
+            NewCallback(this, &ContainerStorage::IsCurrentContainerSummary);
+        ScopedPtr<Callback1<Option<bool>, const ContainerSummaryData&> > scoped_is_current(is_current);
+        for (i = 0; i < this->summary_logs_.size(); i++) {
+            if (this->summary_logs_[i]) {
+                CHECK(this->summary_logs_[i]->Compact(is_current),
+                    "Failed to compact summary log: " << this->summary_logs_[i]->filename());
+            }
+        }
     } else {
         // it is not valid to check the validity of the container id here as it might be corrected by the log replay
         // or the system is readonly and we don't care because there is no way that the container is overwritten.
@@ -1442,8 +1897,10 @@ bool ContainerStorage::Run() {
             DEBUG("Check for ophran chunks: low container id " << id << ", high container id " << last_given_container_id_);
             for (; id <= last_given_container_id_; id++) {
                 TRACE("Check for ophrans in container: container id " << id);
-                Container container(id, container_size_, false);
-                lookup_result lr = ReadContainerWithCache(&container);
+                ScopedPoolContainer pool_container(&container_pool_, id, false);
+                CHECK(pool_container.Get(), "Failed to acquire container: container id " << id);
+                Container& container(*pool_container);
+                lookup_result lr = ReadContainerWithCache(&container, READ_CACHE_HINT_NO_POLLUTE);
                 CHECK(lr != LOOKUP_ERROR, "Failed to read container: " << container.DebugString());
                 if (lr == LOOKUP_FOUND) {
                     TRACE("Found container: " << container.DebugString());
@@ -1486,6 +1943,12 @@ bool ContainerStorage::Run() {
     if (allocator_) {
         CHECK(allocator_->Run(), "Failed to run allocator");
     }
+    if (gc_) {
+        CHECK(gc_->Run(), "Failed to run gc");
+    }
+    if (tiering_enabled_) {
+        CHECK(tiering_.Run(), "Failed to run tiering");
+    }
     state_ = RUNNING;
     return true;
 }
@@ -1535,12 +1998,21 @@ ContainerStorage::~ContainerStorage() {
         delete allocator_;
         this->allocator_ = NULL;
     }
+    if (this->io_scheduler_) {
+        // the scheduler must not access the files after they are closed
+        delete io_scheduler_;
+        this->io_scheduler_ = NULL;
+    }
     for (i = 0; i < this->file_.size(); i++) {
         if (this->file_[i].file()) {
             delete file_[i].file();
         }
     }
     file_.clear();
+    for (i = 0; i < this->summary_logs_.size(); i++) {
+        delete summary_logs_[i];
+    }
+    summary_logs_.clear();
     if (this->meta_data_index_) {
         delete meta_data_index_;
         this->meta_data_index_ = NULL;
@@ -1575,6 +2047,13 @@ bool ContainerStorage::Stop(const dedupv1::StopContext& stop_context) {
         INFO("Stopping container storage");
     }
 
+    // Wait for running prefetches. Prefetches that are still queued are dropped
+    // when the thread pool is stopped.
+    while (!prefetch_set_.empty() && tp_ && tp_->IsStarted()) {
+        TRACE("Wait for prefetches: count " << prefetch_set_.size());
+        ThreadUtil::Sleep(10, ThreadUtil::MILLISECONDS);
+    }
+
     // We stop the timeout committed to avoid a race condition when
     // the stop method and the timeout thread try to commit the same container at the
     // same time
@@ -1735,7 +2214,7 @@ alloc_result ContainerStorage::GetNewContainerId(Container* container) {
     CHECK_RETURN(container, ALLOC_ERROR, "Container not set");
 
     ContainerStorageAddressData address;
-    alloc_result ar = this->allocator_->OnNewContainer(*container, true, &address);
+    alloc_result ar = this->allocator_->OnNewContainer(*container, true, STORAGE_TIER_FAST, &address);
     CHECK_RETURN(ar != ALLOC_ERROR, ALLOC_ERROR, "Failed to get address");
     if (ar == ALLOC_FULL) {
         return ALLOC_FULL;
@@ -1842,18 +2321,35 @@ bool ContainerStorage::WriteNew(const void* key, size_t key_size,
                                        bool is_indexed,
                                        uint64_t* address,
                                        ErrorContext* ec) {
+    return WriteNewInStream(Storage::NO_STREAM_ID, key, key_size, data, data_size, is_indexed, address, ec);
+}
+
+bool ContainerStorage::WriteNewInStream(uint32_t stream_id,
+                                       const void* key, size_t key_size,
+                                       const void* data, size_t data_size,
+                                       bool is_indexed,
+                                       uint64_t* address,
+                                       ErrorContext* ec) {
     ProfileTimer timer(stats_.total_write_time_);
 
     CHECK(state_ == ContainerStorage::RUNNING, "Illegal state to write new data: " << state_);
     CHECK(!start_context_.readonly(), "Container storage is in readonly mode");
 
+    if (compression_dictionary_enabled_ && compression_dictionary_.AddSample(data, data_size)) {
+        Runnable<bool>* task = NewRunnable(&compression_dictionary_, &ContainerStorageCompressionDictionary::Train);
+        if (tp_ == NULL || !tp_->SubmitNoFuture(task, Threadpool::BACKGROUND_PRIORITY, Threadpool::ACCEPT)) {
+            WARNING("Failed to submit compression dictionary training");
+            delete task;
+        }
+    }
+
     // Select write container
     Container* write_container = NULL;
     ReadWriteLock* write_container_lock = NULL;
     // TODO(fermat): We could send the size of the chunk here to get an open container,
     // which can store the chunk, if there is one left.
     // This way we get a defragmentation.
-    CHECK(write_cache_.GetNextWriteCacheContainer(&write_container, &write_container_lock),
+    CHECK(write_cache_.GetNextWriteCacheContainer(stream_id, &write_container, &write_container_lock),
         "Failed to get write container: key " << Fingerprinter::DebugString((const byte *) key, key_size));
     CHECK(write_container, "Write container not set");
     CHECK(write_container_lock, "Write container lock not set");
@@ -1914,10 +2410,23 @@ bool ContainerStorage::WriteNew(const void* key, size_t key_size,
     // Scope for add timer
     {
         ProfileTimer add_timer(this->stats_.add_time_);
+        // with background compression, the container is compressed when it is committed
+        Compression* compression = background_compression_ ? NULL : GetCompression();
+        bool adaptive = compression && adaptive_compression_enabled_;
+        if (adaptive && !adaptive_compression_.ShouldCompress(stream_id, data, data_size)) {
+            compression = NULL;
+            adaptive = false;
+        }
         CHECK(write_container->AddItem((byte *) key, key_size, (byte *) data, data_size,
                 is_indexed,
-                compression_),
+                compression),
             "Cannot add item: fp " << Fingerprinter::DebugString((const byte *) key, key_size) << ", data size " << data_size << ", write container " << write_container->DebugString());
+        if (adaptive) {
+            const ContainerItem* item = write_container->FindItem(key, key_size);
+            CHECK(item, "Failed to find added item: fp " << Fingerprinter::DebugString((const byte *) key, key_size) <<
+                ", write container " << write_container->DebugString());
+            adaptive_compression_.ReportCompression(stream_id, item->raw_size(), item->item_size());
+        }
     }
     DCHECK(write_container->primary_id() == container_id, "Container id changed illegally");
     CHECK(scoped_write_container_lock.ReleaseLock(), "Failed to release write container lock: " << scoped_write_container_lock.DebugString());
@@ -2000,18 +2509,67 @@ string ContainerStorage::PrintStatistics() {
     sstr << "\"allocator\": " << (this->allocator_ ? this->allocator_->PrintStatistics() : "null") << "," << std::endl;
     sstr << "\"write cache\": " << this->write_cache_.PrintStatistics() << "," << std::endl;
     sstr << "\"read cache\": " << this->cache_.PrintStatistics() << "," << std::endl;
+    sstr << "\"item table cache\": " << this->item_table_cache_.PrintStatistics() << "," << std::endl;
+    if (address_table_enabled_) {
+        sstr << "\"address table\": " << this->address_table_.PrintStatistics() << "," << std::endl;
+    }
+    if (tiering_enabled_) {
+        sstr << "\"tiering\": " << this->tiering_.PrintStatistics() << "," << std::endl;
+    }
+    if (summary_log_enabled_) {
+        sstr << "\"summary log\": [";
+        for (size_t i = 0; i < summary_logs_.size(); i++) {
+            if (i > 0) {
+                sstr << ", ";
+            }
+            sstr << (summary_logs_[i] ? summary_logs_[i]->PrintStatistics() : "null");
+        }
+        sstr << "]," << std::endl;
+    }
+    sstr << "\"container pool\": " << this->container_pool_.PrintStatistics() << "," << std::endl;
+    if (compression_dictionary_enabled_) {
+        sstr << "\"compression dictionary\": " << this->compression_dictionary_.PrintStatistics() << "," << std::endl;
+    }
+    if (adaptive_compression_enabled_) {
+        sstr << "\"adaptive compression\": " << this->adaptive_compression_.PrintStatistics() << "," << std::endl;
+    }
+    sstr << "\"io scheduler\": " << (this->io_scheduler_ ? this->io_scheduler_->PrintStatistics() : "null") << "," << std::endl;
     sstr << "\"data size\": " << allocated_storage_size << "," << std::endl;
     sstr << "\"allocated storage size\": " << allocated_storage_size << "," << std::endl;
     sstr << "\"active storage size\": " << GetActiveStorageDataSize() << "," << std::endl;
 
     sstr << "\"reads\": " << this->stats_.reads_ << "," << std::endl;
     sstr << "\"write cache hits\": " << this->stats_.write_cache_hit_ << "," << std::endl;
+    sstr << "\"batch reads\": " << this->stats_.batch_reads_ << "," << std::endl;
+    sstr << "\"batch read container\": " << this->stats_.batch_read_containers_ << "," << std::endl;
+    sstr << "\"prefetch requests\": " << this->stats_.prefetch_requests_ << "," << std::endl;
+    sstr << "\"prefetch loads\": " << this->stats_.prefetch_loads_ << "," << std::endl;
+    sstr << "\"prefetch ignored\": " << this->stats_.prefetch_ignored_ << "," << std::endl;
+    sstr << "\"partial reads\": " << this->stats_.partial_reads_ << "," << std::endl;
+    sstr << "\"partial read bytes\": " << this->stats_.partial_read_bytes_ << "," << std::endl;
+    sstr << "\"partial read metadata loads\": " << this->stats_.partial_read_metadata_loads_ << "," << std::endl;
+    sstr << "\"partial read full loads\": " << this->stats_.partial_read_full_loads_ << "," << std::endl;
+    sstr << "\"background compressed container\": " << this->stats_.background_compressed_container_ << "," << std::endl;
+    sstr << "\"background compression saved bytes\": " << this->stats_.background_compression_saved_bytes_ << "," << std::endl;
     sstr << "\"committed container\": " << this->stats_.committed_container_ << "," << std::endl;
+    if (group_commit_) {
+        uint64_t group_syncs = 0;
+        uint64_t group_synced_writes = 0;
+        for (unsigned int i = 0; i < this->file_.size(); i++) {
+            if (this->file_[i].group_sync()) {
+                group_syncs += this->file_[i].group_sync()->stats().syncs_;
+                group_synced_writes += this->file_[i].group_sync()->stats().synced_writes_;
+            }
+        }
+        sstr << "\"group commit syncs\": " << group_syncs << "," << std::endl;
+        sstr << "\"group commit synced container\": " << group_synced_writes << "," << std::endl;
+    }
     sstr << "\"container timeouts\": " << this->stats_.container_timeouts_ << "," << std::endl;
     sstr << "\"readed container\": " << this->stats_.readed_container_ << "," << std::endl;
 
     sstr << "\"moved container\": " << this->stats_.moved_container_ << "," << std::endl;
     sstr << "\"merged container\": " << this->stats_.merged_container_ << "," << std::endl;
+    sstr << "\"pipelined merges\": " << this->stats_.pipelined_merges_ << "," << std::endl;
     sstr << "\"failed container\": " << this->stats_.failed_container_ << "," << std::endl;
     sstr << "\"deleted container\": " << this->stats_.deleted_container_ << "" << std::endl;
     sstr << "}";
@@ -2059,15 +2617,20 @@ string ContainerStorage::PrintProfile() {
     sstr << this->background_committer_.PrintEmbeddedProfile() << "," << std::endl;
     sstr << "\"gc\": " << (this->gc_ ? this->gc_->PrintProfile() : "null") << "," << std::endl;
     sstr << "\"allocator\": " << (this->allocator_ ? this->allocator_->PrintProfile() : "null") << "," << std::endl;
+    if (tiering_enabled_) {
+        sstr << "\"tiering\": " << this->tiering_.PrintProfile() << "," << std::endl;
+    }
     sstr << "\"meta data\": " << (this->meta_data_index_ ? this->meta_data_index_->PrintProfile() : "null") << "," << std::endl;
     sstr << "\"read container time\": " << this->stats_.total_read_container_time_.GetSum() << "," << std::endl;
     sstr << "\"read cache\": " << this->cache_.PrintProfile() << "," << std::endl;
     sstr << "\"write cache\": " << this->write_cache_.PrintProfile() << "," << std::endl;
+    sstr << "\"io scheduler\": " << (this->io_scheduler_ ? this->io_scheduler_->PrintProfile() : "null") << "," << std::endl;
     sstr << "\"read time\": " << this->stats_.total_read_time_.GetSum() << "," << std::endl;
     sstr << "\"write time\": " << this->stats_.total_write_time_.GetSum() << "," << std::endl;
     sstr << "\"add time\": " << this->stats_.add_time_.GetSum() << "," << std::endl;
     sstr << "\"pre commit time\": " << this->stats_.pre_commit_time_.GetSum() << "," << std::endl;
     sstr << "\"container write time\": " << this->stats_.container_write_time_.GetSum() << "," << std::endl;
+    sstr << "\"background compression time\": " << this->stats_.background_compression_time_.GetSum() << "," << std::endl;
     sstr << "\"commit state check time\": " << this->stats_.is_committed_time_.GetSum() << "," << std::endl;
     sstr << "\"file lock time\": " << this->stats_.total_file_lock_time_.GetSum() << "," << std::endl;
     sstr << "\"file load time\": " << this->stats_.total_file_load_time_.GetSum() << "," << std::endl;
@@ -2183,9 +2746,12 @@ bool ContainerStorage::DoDelete(
         }
     }
 
-    CHECK(allocator_->OnNewContainer(container, false, &new_container_address), "Failed to get new container address");
+    // the container stays on its tier. Only merges and tier moves change the tier of a container
+    enum storage_tier tier = IsFastTierAddress(old_container_address) ? STORAGE_TIER_FAST : STORAGE_TIER_CAPACITY;
+    CHECK(allocator_->OnNewContainer(container, false, tier, &new_container_address), "Failed to get new container address");
     CHECK(WriteContainer(&container, new_container_address),
         "Failed to write container " << container.DebugString());
+    RemoveItemTables(&item_table_cache_, container);
 
     ContainerMoveEventData event_data;
     event_data.set_container_id(container.primary_id());
@@ -2206,6 +2772,7 @@ bool ContainerStorage::DoDelete(
     int64_t event_log_id = 0;
     CHECK(log_->CommitEvent(EVENT_TYPE_CONTAINER_MOVED, &event_data, &event_log_id, this, NO_EC),
         "Failed to commit container move");
+    AppendContainerSummary(container, new_container_address, event_log_id);
 
     stats_.moved_container_++;
     return true;
@@ -2373,17 +2940,204 @@ Option<uint32_t> ContainerStorage::ReadInContainer(const Container& container,
     return make_option(size);
 }
 
-Option<uint32_t> ContainerStorage::Read(uint64_t address, const void* key,
-                                        size_t key_size,
-                                        void* data,
-                                        uint32_t offset,
-                                        uint32_t size,
-                                        ErrorContext* ec) {
-    ProfileTimer timer(stats_.total_read_time_);
+bool ContainerStorage::ReadRequestsInContainer(const Container& container,
+                                               const vector<StorageReadRequest*>& requests) {
+    vector<StorageReadRequest*>::const_iterator i;
+    for (i = requests.begin(); i != requests.end(); i++) {
+        StorageReadRequest* request = *i;
+        bool found = false;
+        Option<uint32_t> r = this->ReadInContainer(container,
+            request->key(),
+            request->key_size(),
+            request->data(),
+            request->offset(),
+            request->size(),
+            &found);
+        CHECK(r.valid(), "Failed to read in container: "
+            << "container " << container.DebugString()
+            << ", key " << Fingerprinter::DebugString(request->key(), request->key_size()));
+        if (!found) {
+            return false;
+        }
+        request->set_read_size(r.value());
+    }
+    return true;
+}
 
-    CHECK(state_ == ContainerStorage::RUNNING ||
-        state_ == ContainerStorage::STARTED, "Illegal state to read data: " << state_);
-    DCHECK(key, "Key NULL");
+Option<bool> ContainerStorage::ReadContainerRequestsPartial(uint64_t address,
+                                                           const vector<StorageReadRequest*>& requests) {
+    // Estimate the bytes before the meta data is known. The requested raw sizes are an
+    // upper bound for the on-disk size of all items that are not compressed.
+    uint64_t estimated_size = Container::kMetaDataSize;
+    vector<StorageReadRequest*>::const_iterator i;
+    for (i = requests.begin(); i != requests.end(); i++) {
+        estimated_size += (*i)->size();
+    }
+    uint64_t max_read_size = static_cast<uint64_t>(container_size_ * partial_read_max_ratio_);
+    if (estimated_size > max_read_size) {
+        stats_.partial_read_full_loads_++;
+        return make_option(false);
+    }
+
+    ReadWriteLock* lock = NULL;
+    pair<lookup_result, ContainerStorageAddressData> container_address =
+        LookupContainerAddressWait(address, &lock, false);
+    CHECK(container_address.first != LOOKUP_ERROR,
+        "Failed to lookup container address: container id " << address);
+    if (container_address.first == LOOKUP_NOT_FOUND) {
+        return make_option(false);
+    }
+    ScopedReadWriteLock scoped_lock(NULL);
+    scoped_lock.SetLocked(lock);
+
+    unsigned int file_index = container_address.second.file_index();
+    uint64_t file_offset = container_address.second.file_offset() + kSuperBlockSize;
+    CHECK(file_index < this->file_.size(),
+        "Illegal file index: " << file_index << ", file count " << this->file_.size());
+    File* file = this->file_[file_index].file();
+    CHECK(file, "File not open: file index: " << file_index << ", file count " << this->file_.size());
+
+    vector<ContainerItem> items;
+    uint32_t use_count = 0;
+    uint64_t read_size = 0;
+    lookup_result r = item_table_cache_.Lookup(address, file_index, file_offset, requests, &items, &use_count);
+    CHECK(r != LOOKUP_ERROR, "Failed to lookup item table: container id " << address);
+    if (r == LOOKUP_NOT_FOUND) {
+        Container metadata(address, container_size_, true);
+        {
+            ScopedLock file_lock(this->file_[file_index].lock());
+            if (this->io_scheduler_ == NULL) {
+                CHECK(file_lock.AcquireLockWithStatistics(
+                        &this->stats_.file_lock_free_,
+                        &this->stats_.file_lock_busy_), "Failed to acquire file lock: " <<
+                    "file index " << file_index <<
+                    ", container id " << address);
+            }
+            CHECK(metadata.LoadFromFile(file, file_offset, calculate_container_checksum_, io_scheduler_),
+                "Cannot load container meta data: " <<
+                "container id " << address <<
+                ", address " << DebugString(container_address.second));
+        }
+        stats_.partial_read_metadata_loads_++;
+        read_size += Container::kMetaDataSize;
+
+        CHECK(item_table_cache_.Update(address, file_index, file_offset, metadata),
+            "Failed to update item table: " << metadata.DebugString());
+        r = item_table_cache_.Lookup(address, file_index, file_offset, requests, &items, &use_count);
+        CHECK(r != LOOKUP_ERROR, "Failed to lookup item table: container id " << address);
+        if (r == LOOKUP_NOT_FOUND) {
+            // The full read reports the missing item
+            return make_option(false);
+        }
+    }
+    if (use_count >= partial_read_full_load_count_) {
+        // The container is accessed often. Loading it into the read cache is cheaper
+        // than reading its items one by one.
+        item_table_cache_.Remove(address);
+        stats_.partial_read_full_loads_++;
+        return make_option(false);
+    }
+
+    // Merge the items to extents so that nearby items are read with a single IO
+    vector<const ContainerItem*> sorted_items;
+    for (size_t j = 0; j < items.size(); j++) {
+        sorted_items.push_back(&items[j]);
+    }
+    std::sort(sorted_items.begin(), sorted_items.end(), ItemOffsetLess);
+
+    vector<pair<uint64_t, uint64_t> > extents; // offset, size
+    uint64_t extent_size_sum = 0;
+    vector<const ContainerItem*>::iterator j;
+    for (j = sorted_items.begin(); j != sorted_items.end(); j++) {
+        uint64_t item_start = (*j)->offset();
+        uint64_t item_end = item_start + (*j)->item_size();
+        CHECK(item_end <= container_size_, "Illegal item: " << (*j)->DebugString());
+        if (!extents.empty() && item_start <= extents.back().first + extents.back().second + kPartialReadMaxGap) {
+            uint64_t extent_end = extents.back().first + extents.back().second;
+            if (item_end > extent_end) {
+                extent_size_sum += item_end - extent_end;
+                extents.back().second = item_end - extents.back().first;
+            }
+        } else {
+            extents.push_back(make_pair(item_start, item_end - item_start));
+            extent_size_sum += item_end - item_start;
+        }
+    }
+    if (read_size + extent_size_sum > max_read_size) {
+        stats_.partial_read_full_loads_++;
+        return make_option(false);
+    }
+
+    dedupv1::base::ScopedArray<byte> buffer(new byte[extent_size_sum]);
+    CHECK(buffer.Get(), "Failed to alloc partial read buffer");
+    vector<uint64_t> buffer_offsets;
+    {
+        ScopedLock file_lock(this->file_[file_index].lock());
+        if (this->io_scheduler_ == NULL) {
+            CHECK(file_lock.AcquireLockWithStatistics(
+                    &this->stats_.file_lock_free_,
+                    &this->stats_.file_lock_busy_), "Failed to acquire file lock: " <<
+                "file index " << file_index <<
+                ", container id " << address);
+        }
+        uint64_t buffer_offset = 0;
+        vector<pair<uint64_t, uint64_t> >::iterator k;
+        for (k = extents.begin(); k != extents.end(); k++) {
+            byte* dest = buffer.Get() + buffer_offset;
+            ssize_t read_data_size = io_scheduler_ ?
+                                     io_scheduler_->Read(file, file_offset + k->first, dest, k->second) :
+                                     file->Read(file_offset + k->first, dest, k->second);
+            CHECK(read_data_size == static_cast<ssize_t>(k->second), "Cannot read container item data: " <<
+                "container id " << address <<
+                ", extent offset " << k->first <<
+                ", extent size " << k->second <<
+                ", read size " << read_data_size);
+            buffer_offsets.push_back(buffer_offset);
+            buffer_offset += k->second;
+        }
+    }
+    CHECK(scoped_lock.ReleaseLock(), "Failed to release container lock");
+
+    for (size_t l = 0; l < requests.size(); l++) {
+        StorageReadRequest* request = requests[l];
+        const ContainerItem* item = &items[l];
+        stats_.reads_++;
+
+        CHECK(!item->is_deleted(), "Found a deleted item: " << item->DebugString());
+        if (request->offset() >= item->raw_size()) {
+            // short read
+            request->set_read_size(0);
+            continue;
+        }
+        uint32_t size = request->size();
+        if (request->offset() + size >= item->raw_size()) {
+            size = item->raw_size() - request->offset();
+        }
+        const byte* item_buffer = NULL;
+        for (size_t k = 0; k < extents.size(); k++) {
+            if (item->offset() >= extents[k].first && item->offset() < extents[k].first + extents[k].second) {
+                item_buffer = buffer.Get() + buffer_offsets[k] + (item->offset() - extents[k].first);
+                break;
+            }
+        }
+        CHECK(item_buffer, "Failed to find extent of item " << item->DebugString());
+        CHECK(Container::CopyRawItemData(item, item_buffer, request->data(), request->offset(), size),
+            "Cannot copy data: " <<
+            "container id " << address <<
+            ", item " << item->DebugString());
+        request->set_read_size(size);
+    }
+    stats_.partial_reads_++;
+    stats_.partial_read_bytes_ += read_size + extent_size_sum;
+    TRACE("Read " << requests.size() << " items from container " << address << " (partial): " <<
+        "extents " << extents.size() <<
+        ", read size " << (read_size + extent_size_sum));
+    return make_option(true);
+}
+
+bool ContainerStorage::ReadContainerRequests(uint64_t address,
+                                             const vector<StorageReadRequest*>* requests) {
+    DCHECK(requests, "Requests not set");
 
     Container* write_container = NULL;
     ReadWriteLock* write_cache_lock = NULL;
@@ -2396,22 +3150,11 @@ Option<uint32_t> ContainerStorage::Read(uint64_t address, const void* key,
         scoped_write_cache_lock.SetLocked(write_cache_lock);
 
         stats_.write_cache_hit_++;
-        TRACE("Read item " << Fingerprinter::DebugString((byte *) key, key_size) << " from container " << address << " (write cache)");
+        TRACE("Read " << requests->size() << " items from container " << address << " (write cache)");
 
-        bool found = false;
-        Option<uint32_t> r = this->ReadInContainer(*write_container,
-            key,
-            key_size,
-            data,
-            offset,
-            size,
-            &found);
-        CHECK(r.valid(), "Failed to read in container: " << write_container->DebugString());
+        bool found = this->ReadRequestsInContainer(*write_container, *requests);
         scoped_write_cache_lock.ReleaseLock();
-        if (!found) {
-            return false;
-        }
-        return r;
+        return found;
     }
 
     // Not found in write cache => Try read cache
@@ -2430,25 +3173,43 @@ Option<uint32_t> ContainerStorage::Read(uint64_t address, const void* key,
 
         CHECK(cache_container->HasId(address), "Wrong active container: " << cache_container->DebugString() << ", address " << address);
 
-        TRACE("Read item " << Fingerprinter::DebugString((byte *) key, key_size) << " from container " << cache_container->DebugString() << " (read cache)");
+        TRACE("Read " << requests->size() << " items from container " << cache_container->DebugString() << " (read cache)");
 
         // We hold the cache entry lock, we can now also allocate the container lock
-        bool found = false;
-        Option<uint32_t> r = this->ReadInContainer(*cache_container, key, key_size, data, offset, size, &found);
-        CHECK(r.valid(), "Failed to read in container: "
-            << "container " << cache_container->DebugString()
-            << ", key " << Fingerprinter::DebugString(key, key_size));
+        bool found = this->ReadRequestsInContainer(*cache_container, *requests);
         CHECK(scoped_cache_lock.ReleaseLock(), "Failed to release cache lock");
-        if (!found) {
-            return false;
-        }
-        return r;
+        return found;
     }
     // read_resulkt == LOOKUP_NOT_FOUND => not found in read cache
     // cache lock might/should be set
-    TRACE("Read item " << Fingerprinter::DebugString((byte *) key, key_size) << " from container " << address << " (disk)");
+    if (partial_read_) {
+        Option<bool> partial_result = ReadContainerRequestsPartial(address, *requests);
+        if (!partial_result.valid() || partial_result.value()) {
+            if (!partial_result.valid()) {
+                ERROR("Partial read of container " << address << " failed");
+            }
+            if (cache_entry.is_set()) {
+                if (!cache_.ReleaseCacheline(address, &cache_entry)) {
+                    WARNING("Failed to release cache line: container id " << address << ", cache line " << cache_entry.DebugString());
+                }
+            }
+            return partial_result.valid();
+        }
+        // the heuristic decided to load the complete container
+    }
+    TRACE("Read " << requests->size() << " items from container " << address << " (disk)");
 
-    Container read_container(address, container_size_, false);
+    ScopedPoolContainer pool_container(&container_pool_, address, false);
+    if (pool_container.Get() == NULL) {
+        ERROR("Failed to acquire container: container id " << address);
+        if (cache_entry.is_set()) {
+            if (!cache_.ReleaseCacheline(address, &cache_entry)) {
+                WARNING("Failed to release cache line: container id " << address << ", cache line " << cache_entry.DebugString());
+            }
+        }
+        return false;
+    }
+    Container& read_container(*pool_container);
     // I have no container lock here, we will acquire and release it during ReadContainer
     read_result = ReadContainer(&read_container); // without cache
     if (read_result == LOOKUP_ERROR) {
@@ -2481,16 +3242,220 @@ Option<uint32_t> ContainerStorage::Read(uint64_t address, const void* key,
 
     // found
     CHECK(read_container.HasId(address), "Wrong active container: " << read_container.DebugString() << ", address " << address);
-    bool found = false;
-    Option<uint32_t> r2 = this->ReadInContainer(read_container,
-        key, key_size, data, offset, size, &found);
-    CHECK(r2.valid(), "Failed to read in container: "
-        << "container " << read_container.DebugString()
-        << ", key " << Fingerprinter::DebugString(key, key_size));
-    if (!found) {
+    if (tiering_enabled_) {
+        if (!tiering_.OnLoad(read_container)) {
+            WARNING("Error while updating tiering");
+        }
+    }
+    return this->ReadRequestsInContainer(read_container, *requests);
+}
+
+Option<uint32_t> ContainerStorage::Read(uint64_t address, const void* key,
+                                        size_t key_size,
+                                        void* data,
+                                        uint32_t offset,
+                                        uint32_t size,
+                                        ErrorContext* ec) {
+    ProfileTimer timer(stats_.total_read_time_);
+
+    CHECK(state_ == ContainerStorage::RUNNING ||
+        state_ == ContainerStorage::STARTED, "Illegal state to read data: " << state_);
+    DCHECK(key, "Key NULL");
+
+    StorageReadRequest request(address, key, key_size, data, offset, size);
+    vector<StorageReadRequest*> requests;
+    requests.push_back(&request);
+    if (!ReadContainerRequests(address, &requests)) {
+        return false;
+    }
+    return make_option(request.read_size());
+}
+
+bool ContainerStorage::ReadBatch(const vector<StorageReadRequest*>& requests,
+                                 ErrorContext* ec) {
+    ProfileTimer timer(stats_.total_read_time_);
+
+    CHECK(state_ == ContainerStorage::RUNNING ||
+        state_ == ContainerStorage::STARTED, "Illegal state to read data: " << state_);
+
+    // group the requests by container. The containers are processed in the order of their first request
+    vector<uint64_t> addresses;
+    map<uint64_t, vector<StorageReadRequest*> > groups;
+    vector<StorageReadRequest*>::const_iterator i;
+    for (i = requests.begin(); i != requests.end(); i++) {
+        StorageReadRequest* request = *i;
+        DCHECK(request, "Request not set");
+        DCHECK(request->key(), "Key NULL");
+
+        map<uint64_t, vector<StorageReadRequest*> >::iterator j = groups.find(request->address());
+        if (j == groups.end()) {
+            addresses.push_back(request->address());
+            j = groups.insert(make_pair(request->address(), vector<StorageReadRequest*>())).first;
+        }
+        j->second.push_back(request);
+    }
+    stats_.batch_reads_++;
+    stats_.batch_read_containers_ += addresses.size();
+
+    if (addresses.size() <= 1 || tp_ == NULL) {
+        vector<uint64_t>::iterator k;
+        for (k = addresses.begin(); k != addresses.end(); k++) {
+            CHECK(ReadContainerRequests(*k, &groups[*k]),
+                "Failed to read from container " << *k);
+        }
+        return true;
+    }
+
+    // all containers except the first one are read by the thread pool, the first one
+    // by the calling thread.
+    bool failed = false;
+    list<Future<bool>*> futures;
+    for (size_t k = 1; k < addresses.size(); k++) {
+        Runnable<bool>* task = NewRunnable(this, &ContainerStorage::ReadContainerRequests,
+            addresses[k], const_cast<const vector<StorageReadRequest*>*>(&groups[addresses[k]]));
+        Future<bool>* future = tp_->Submit(task, Threadpool::HIGH_PRIORITY, Threadpool::CALLER_RUNS);
+        if (!future) {
+            ERROR("Failed to submit container read: container " << addresses[k]);
+            delete task;
+            failed = true;
+            break;
+        }
+        futures.push_back(future);
+    }
+    if (!failed && !ReadContainerRequests(addresses[0], &groups[addresses[0]])) {
+        ERROR("Failed to read from container " << addresses[0]);
+        failed = true;
+    }
+
+    for (list<Future<bool>*>::iterator j = futures.begin(); j != futures.end(); ++j) {
+        Future<bool>* future = *j;
+        bool b = future->Wait();
+        if (!b) {
+            WARNING("Failed to wait for container read");
+            failed = true;
+        } else if (future->is_abort()) {
+            WARNING("Container read was aborted");
+            failed = true;
+        } else {
+            bool result = false;
+            future->Get(&result);
+            if (unlikely(!result)) {
+                failed = true;
+            }
+        }
+        delete future;
+    }
+    futures.clear();
+    CHECK(!failed, "Failed to read batch: " << requests.size() << " requests, " <<
+        addresses.size() << " containers");
+    return true;
+}
+
+bool ContainerStorage::PrefetchContainer(uint64_t address) {
+    Container* write_container = NULL;
+    ReadWriteLock* write_cache_lock = NULL;
+    lookup_result r = write_cache_.GetWriteCacheContainer(address, &write_container, &write_cache_lock, false);
+    if (r == LOOKUP_FOUND) {
+        CHECK(write_cache_lock, "Write cache lock not set");
+        CHECK(write_cache_lock->ReleaseLock(), "Failed to release write cache lock");
+        stats_.prefetch_ignored_++;
+        return true;
+    }
+    CHECK(r != LOOKUP_ERROR, "Failed to access write cache");
+
+    CacheEntry cache_entry;
+    r = cache_.GetCache(address, &cache_entry);
+    CHECK(r != LOOKUP_ERROR, "Prefetch of container " << address << " failed: Cache check failed");
+    if (r == LOOKUP_FOUND || !cache_entry.is_set()) {
+        // already cached or no cache line available
+        stats_.prefetch_ignored_++;
+        return true;
+    }
+
+    ScopedPoolContainer pool_container(&container_pool_, address, false);
+    if (pool_container.Get() == NULL) {
+        if (!cache_.ReleaseCacheline(address, &cache_entry)) {
+            WARNING("Failed to release cache line: container id " << address << ", cache line " << cache_entry.DebugString());
+        }
+        ERROR("Failed to acquire container: container id " << address);
+        return false;
+    }
+    Container& read_container(*pool_container);
+    r = ReadContainer(&read_container);
+    if (r != LOOKUP_FOUND) {
+        if (!cache_.ReleaseCacheline(address, &cache_entry)) {
+            WARNING("Failed to release cache line: container id " << address << ", cache line " << cache_entry.DebugString());
+        }
+        // a container that is not committed yet is not an error for a prefetch
+        CHECK(r != LOOKUP_ERROR, "Prefetch of container " << address << " failed: Lookup error");
+        stats_.prefetch_ignored_++;
+        return true;
+    }
+    CHECK(cache_.CopyToReadCache(read_container, &cache_entry),
+        "Failed to add container to read cache: " << read_container.DebugString());
+    stats_.prefetch_loads_++;
+    TRACE("Prefetched container " << read_container.DebugString());
+    return true;
+}
+
+/**
+ * Runnable that prefetches a container and removes the container from the
+ * prefetch set afterwards.
+ */
+class ContainerStoragePrefetchTask : public Runnable<bool> {
+    private:
+        ContainerStorage* storage_;
+        tbb::concurrent_hash_map<uint64_t, bool>* prefetch_set_;
+        uint64_t address_;
+    public:
+        ContainerStoragePrefetchTask(ContainerStorage* storage,
+                tbb::concurrent_hash_map<uint64_t, bool>* prefetch_set,
+                uint64_t address) :
+            storage_(storage), prefetch_set_(prefetch_set), address_(address) {
+        }
+
+        virtual bool Run() {
+            bool r = storage_->PrefetchContainer(address_);
+            if (!r) {
+                WARNING("Failed to prefetch container " << address_);
+            }
+            prefetch_set_->erase(address_);
+            delete this;
+            return r;
+        }
+};
+
+Option<bool> ContainerStorage::Prefetch(uint64_t address, ErrorContext* ec) {
+    CHECK(state_ == ContainerStorage::RUNNING ||
+        state_ == ContainerStorage::STARTED, "Illegal state to prefetch data: " << state_);
+
+    stats_.prefetch_requests_++;
+    if (tp_ == NULL || address == Storage::EMPTY_DATA_STORAGE_ADDRESS ||
+        prefetch_set_.size() >= max_prefetch_count_) {
+        stats_.prefetch_ignored_++;
+        return make_option(false);
+    }
+    if (cache_.IsCached(address)) {
+        stats_.prefetch_ignored_++;
+        return make_option(false);
+    }
+    {
+        tbb::concurrent_hash_map<uint64_t, bool>::accessor a;
+        if (!prefetch_set_.insert(a, address)) {
+            // already prefetched
+            stats_.prefetch_ignored_++;
+            return make_option(false);
+        }
+        a->second = true;
+    }
+    Runnable<bool>* task = new ContainerStoragePrefetchTask(this, &prefetch_set_, address);
+    if (!tp_->SubmitNoFuture(task, Threadpool::BACKGROUND_PRIORITY, Threadpool::ACCEPT)) {
+        ERROR("Failed to submit prefetch: container " << address);
+        delete task;
+        prefetch_set_.erase(address);
         return false;
     }
-    return r2;
+    return make_option(true);
 }
 
 storage_commit_state ContainerStorage::IsCommittedWait(uint64_t address) {
@@ -2548,7 +3513,7 @@ storage_commit_state ContainerStorage::IsCommittedWait(uint64_t address) {
     }
     // not found in cache
 
-    lookup_result r = this->meta_data_index_->Lookup(&address, sizeof(uint64_t), NULL);
+    lookup_result r = LookupAddressData(address, NULL);
     CHECK_RETURN(r != LOOKUP_ERROR, STORAGE_ADDRESS_ERROR, "Meta data index lookup error for container id " << address);
     if (r == LOOKUP_NOT_FOUND) {
         if (address <= this->initial_given_container_id_) {
@@ -2592,7 +3557,7 @@ storage_commit_state ContainerStorage::IsCommitted(uint64_t address) {
     } else {
         // not found in cache
 
-        lookup_result r = this->meta_data_index_->Lookup(&address, sizeof(uint64_t), NULL);
+        lookup_result r = LookupAddressData(address, NULL);
         CHECK_RETURN(r != LOOKUP_ERROR, STORAGE_ADDRESS_ERROR, "Meta data index lookup error for container id " << address);
         if (r == LOOKUP_NOT_FOUND) {
             if (address <= this->initial_given_container_id_) {
@@ -2673,7 +3638,7 @@ bool ContainerStorage::LogReplay(dedupv1::log::event_type event_type,
                 ", address " << updated_address.ShortDebugString());
 
             DCHECK(IsValidAddressData(event_data.address()), "Invalid address data: " << event_data.ShortDebugString());
-            CHECK(meta_data_index_->Put(&container_id, sizeof(container_id), updated_address),
+            CHECK(PutAddressData(container_id, updated_address),
                 "Failed to update meta data index data: container id " << container_id <<
                 ", address " << updated_address.ShortDebugString());
             CHECK(this->meta_data_cache_.Update(container_id, STORAGE_ADDRESS_COMMITED), "Failed to update cache");
@@ -2708,7 +3673,7 @@ bool ContainerStorage::LogReplay(dedupv1::log::event_type event_type,
             updated_address.set_log_id(context.log_id());
 
             DCHECK(IsValidAddressData(updated_address), "Invalid address data: " << updated_address.ShortDebugString());
-            CHECK(this->meta_data_index_->Put(&container_id, sizeof(container_id), updated_address),
+            CHECK(PutAddressData(container_id, updated_address),
                 "Meta data update failed: " << container_id <<
                 ", address " << DebugString(updated_address));
 
@@ -2743,7 +3708,7 @@ bool ContainerStorage::LogReplay(dedupv1::log::event_type event_type,
             TRACE("Redirect primary id " << container_id << ": " << updated_address.ShortDebugString());
 
             DCHECK(IsValidAddressData(updated_address), "Invalid address data: " << updated_address.ShortDebugString());
-            CHECK(this->meta_data_index_->Put(&container_id, sizeof(container_id), updated_address),
+            CHECK(PutAddressData(container_id, updated_address),
                 "Meta data update failed: " << container_id <<
                 ", address " << DebugString(updated_address));
         } else {
@@ -2768,7 +3733,7 @@ bool ContainerStorage::LogReplay(dedupv1::log::event_type event_type,
             if (update) {
                 TRACE("Redirect merged container " << id << ": primary id " << secondary_data_address.primary_id());
                 DCHECK(IsValidAddressData(secondary_data_address), "Invalid address data: " << secondary_data_address.ShortDebugString());
-                CHECK(this->meta_data_index_->Put(&id, sizeof(id), secondary_data_address),
+                CHECK(PutAddressData(id, secondary_data_address),
                     "Cannot write new container address: container id " << id);
             } else {
                 TRACE("Meta data already up-to-date: container id " << id <<
@@ -2784,7 +3749,7 @@ bool ContainerStorage::LogReplay(dedupv1::log::event_type event_type,
 
             if (lr == LOOKUP_FOUND) {
                 TRACE("Delete unused container id: container " << id);
-                CHECK(this->meta_data_index_->Delete(&id, sizeof(id)), "Cannot delete unused container address: container id " << id);
+                CHECK(DeleteAddressData(id), "Cannot delete unused container address: container id " << id);
             }
         }
     } else if (event_type == EVENT_TYPE_CONTAINER_DELETED && context.replay_mode() == EVENT_REPLAY_MODE_DIRTY_START) {
@@ -2814,7 +3779,7 @@ bool ContainerStorage::LogReplay(dedupv1::log::event_type event_type,
             CHECK(lr != LOOKUP_ERROR, "Failed to lookup meta data for container: container id " << id);
 
             if (lr == LOOKUP_FOUND) {
-                CHECK(this->meta_data_index_->Delete(&id, sizeof(id)), "Cannot delete unused container address: container id " << id);
+                CHECK(DeleteAddressData(id), "Cannot delete unused container address: container id " << id);
             }
         }
 
@@ -2823,7 +3788,7 @@ bool ContainerStorage::LogReplay(dedupv1::log::event_type event_type,
         for (set<uint64_t>::const_iterator i = all_old_ids.begin(); i != all_old_ids.end(); i++) {
             uint64_t id = *i;
             TRACE("Delete unused container id: container " << id);
-            CHECK(this->meta_data_index_->Delete(&id, sizeof(id)), "Cannot delete unused container address: container id " << id);
+            CHECK(DeleteAddressData(id), "Cannot delete unused container address: container id " << id);
             CHECK(this->meta_data_cache_.Delete(id), "Failed to delete unused container address from meta data cache: container id " << id);
             FAULT_POINT("container-storage.ack.container-delete-middle");
         }
@@ -2868,7 +3833,7 @@ bool ContainerStorage::FinishDirtyLogReplay() {
             // truncated
             WARNING("Remove container artifact from container meta data index: " << container_id <<
                 ", address data " << address_data.ShortDebugString());
-            CHECK(this->meta_data_index_->Delete(&container_id, sizeof(container_id)),
+            CHECK(DeleteAddressData(container_id),
                 "Cannot delete unused container address: container id " << container_id);
         }
     }
@@ -2918,6 +3883,11 @@ void ContainerStorage::IdleTick() {
             WARNING("gc idle thread processing failed");
         }
     }
+    if (tiering_enabled_ && state_ == RUNNING && !start_context_.readonly()) {
+        if (!this->tiering_.OnIdle()) {
+            WARNING("tiering idle processing failed");
+        }
+    }
 }
 
 bool ContainerStorage::TryMergeContainer(uint64_t container_id_1, uint64_t container_id_2, bool* aborted) {
@@ -2931,23 +3901,160 @@ bool ContainerStorage::TryMergeContainer(uint64_t container_id_1, uint64_t conta
     CHECK(container_id_1 != container_id_2,
         "Illegal to merge a container with itself: container " << container_id_1);
 
-    Container container1(container_id_1, container_size_, false);
-    Container container2(container_id_2, container_size_, false);
+    ContainerMergeRequest request(&container_pool_, &in_move_set_, &in_move_set_lock_,
+        container_id_1, container_id_2, container_size_);
+    CHECK(ReadMergeContainers(&request),
+        "Failed to read merge containers: container " << container_id_1 << ", container " << container_id_2);
+    if (!MergeContainers(&request) || !WriteMergedContainer(&request)) {
+        ERROR("Failed to merge containers: container " << container_id_1 << ", container " << container_id_2);
+        if (request.allocated_ && !allocator_->OnAbortContainer(request.new_container_, request.new_container_address_)) {
+            WARNING("Failed to abort merged container: " << request.new_container_.DebugString());
+        }
+        return false;
+    }
+    *aborted = request.aborted_;
+    return true;
+}
+
+bool ContainerStorage::TryMergeContainers(const vector<pair<uint64_t, uint64_t> >& merge_list,
+        vector<bool>* aborted_list) {
+    CHECK(aborted_list, "Aborted list not set");
+    aborted_list->assign(merge_list.size(), true);
+
+    if (!merge_pipeline_enabled_ || tp_ == NULL || merge_list.size() <= 1) {
+        for (size_t i = 0; i < merge_list.size(); i++) {
+            bool aborted = false;
+            CHECK(TryMergeContainer(merge_list[i].first, merge_list[i].second, &aborted),
+                "Failed to merge container " << merge_list[i].first << ", container " << merge_list[i].second);
+            (*aborted_list)[i] = aborted;
+        }
+        return true;
+    }
+
+    CHECK(state_ == RUNNING || state_ == STARTED, "Illegal state to merge container: " << state_);
+    CHECK(!start_context_.readonly(), "Container storage is in readonly mode");
+    for (size_t i = 0; i < merge_list.size(); i++) {
+        CHECK(merge_list[i].first != merge_list[i].second,
+            "Illegal to merge a container with itself: container " << merge_list[i].first);
+    }
+
+    // software pipeline: In step i, the containers of merge i are read, merge i - 1 is merged
+    // and merge i - 2 is written and committed. The stages of a step are executed in parallel,
+    // the stages of a single merge are executed in order.
+    vector<ContainerMergeRequest*> requests(merge_list.size(), static_cast<ContainerMergeRequest*>(NULL));
+    bool failed = false;
+    for (size_t step = 0; step < merge_list.size() + 2 && !failed; step++) {
+        list<Future<bool>*> futures;
+
+        if (step < merge_list.size()) {
+            FAULT_POINT("container-storage.merge.pre");
+            requests[step] = new ContainerMergeRequest(&container_pool_, &in_move_set_, &in_move_set_lock_,
+                merge_list[step].first, merge_list[step].second, container_size_);
+            Runnable<bool>* task = NewRunnable(this, &ContainerStorage::ReadMergeContainers, requests[step]);
+            Future<bool>* future = tp_->Submit(task, Threadpool::BACKGROUND_PRIORITY, Threadpool::CALLER_RUNS);
+            if (!future) {
+                ERROR("Failed to submit merge read: " <<
+                    "container " << merge_list[step].first << ", container " << merge_list[step].second);
+                delete task;
+                failed = true;
+            } else {
+                futures.push_back(future);
+            }
+        }
+        if (!failed && step >= 1 && step - 1 < merge_list.size()) {
+            Runnable<bool>* task = NewRunnable(this, &ContainerStorage::MergeContainers, requests[step - 1]);
+            Future<bool>* future = tp_->Submit(task, Threadpool::BACKGROUND_PRIORITY, Threadpool::CALLER_RUNS);
+            if (!future) {
+                ERROR("Failed to submit merge: " <<
+                    "container " << merge_list[step - 1].first << ", container " << merge_list[step - 1].second);
+                delete task;
+                failed = true;
+            } else {
+                futures.push_back(future);
+            }
+        }
+        if (!failed && step >= 2) {
+            Runnable<bool>* task = NewRunnable(this, &ContainerStorage::WriteMergedContainer, requests[step - 2]);
+            Future<bool>* future = tp_->Submit(task, Threadpool::BACKGROUND_PRIORITY, Threadpool::CALLER_RUNS);
+            if (!future) {
+                ERROR("Failed to submit merge write: " <<
+                    "container " << merge_list[step - 2].first << ", container " << merge_list[step - 2].second);
+                delete task;
+                failed = true;
+            } else {
+                futures.push_back(future);
+            }
+        }
+
+        for (list<Future<bool>*>::iterator j = futures.begin(); j != futures.end(); ++j) {
+            Future<bool>* future = *j;
+            bool b = future->Wait();
+            if (!b) {
+                WARNING("Failed to wait for merge stage");
+                failed = true;
+            } else if (future->is_abort()) {
+                WARNING("Merge stage was aborted");
+                failed = true;
+            } else {
+                bool result = false;
+                future->Get(&result);
+                if (unlikely(!result)) {
+                    failed = true;
+                }
+            }
+            delete future;
+        }
+        futures.clear();
+
+        if (!failed && step >= 2) {
+            (*aborted_list)[step - 2] = requests[step - 2]->aborted_;
+            if (!requests[step - 2]->aborted_) {
+                this->stats_.pipelined_merges_++;
+            }
+            delete requests[step - 2];
+            requests[step - 2] = NULL;
+        }
+    }
+
+    // clean up the requests that have not passed all stages
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (requests[i]) {
+            if (requests[i]->allocated_) {
+                if (!allocator_->OnAbortContainer(requests[i]->new_container_, requests[i]->new_container_address_)) {
+                    WARNING("Failed to abort merged container: " << requests[i]->new_container_.DebugString());
+                }
+            }
+            delete requests[i];
+            requests[i] = NULL;
+        }
+    }
+    CHECK(!failed, "Failed to merge containers: " << merge_list.size() << " merges");
+    return true;
+}
+
+bool ContainerStorage::ReadMergeContainers(ContainerMergeRequest* request) {
+    DCHECK(request, "Request not set");
+    uint64_t container_id_1 = request->container_id_1_;
+    uint64_t container_id_2 = request->container_id_2_;
+
+    CHECK(request->pool_container1_.Get() && request->pool_container2_.Get(), "Failed to acquire containers");
+    Container& container1(*request->pool_container1_);
+    Container& container2(*request->pool_container2_);
 
     // get both addresses
     // we cannot use the normal lookup address method here as that would lead to problems when
     // both containers use the same container lock
     uint64_t id = container1.primary_id();
-    ContainerStorageAddressData container_address1;
-    lookup_result r = this->meta_data_index_->Lookup(&id, sizeof(uint64_t), &container_address1);
+    ContainerStorageAddressData& container_address1(request->container_address1_);
+    lookup_result r = LookupAddressData(id, &container_address1);
     CHECK(r == LOOKUP_FOUND, "Cannot get container address for container " << id);
     CHECK(container_address1.has_primary_id() == false, "Illegal merge candidate: " <<
         "container " << container1.DebugString() <<
         ", address " << container_address1.ShortDebugString());
 
     id = container2.primary_id();
-    ContainerStorageAddressData container_address2;
-    r = this->meta_data_index_->Lookup(&id, sizeof(uint64_t), &container_address2);
+    ContainerStorageAddressData& container_address2(request->container_address2_);
+    r = LookupAddressData(id, &container_address2);
     CHECK(r == LOOKUP_FOUND, "Cannot get container address for container " << id);
     CHECK(container_address2.has_primary_id() == false, "Illegal merge candidate: " <<
         "container " << container2.DebugString() <<
@@ -2990,7 +4097,7 @@ bool ContainerStorage::TryMergeContainer(uint64_t container_id_1, uint64_t conta
         if (cache_entry2.is_set()) {
             CHECK(cache_entry2.lock()->ReleaseLock(), "Failed to release cache lock");
         }
-        *aborted = true;
+        request->aborted_ = true;
         return true;
     }
 
@@ -3006,7 +4113,7 @@ bool ContainerStorage::TryMergeContainer(uint64_t container_id_1, uint64_t conta
             if (cache_entry2.is_set()) {
                 CHECK(cache_entry2.lock()->ReleaseLock(), "Failed to release cache lock");
             }
-            *aborted = true;
+            request->aborted_ = true;
             return true;
         }
     }
@@ -3030,14 +4137,13 @@ bool ContainerStorage::TryMergeContainer(uint64_t container_id_1, uint64_t conta
     }
     // regardless of the cache results, the caches locks are released at this time
 
-    ScopedInMoveSetMembership scoped_set_membership(&in_move_set_, &in_move_set_lock_);
     list<uint64_t> container_id_list;
     container_id_list.push_back(container_id_1);
     container_id_list.push_back(container_id_2);
 
-    if (!scoped_set_membership.Insert(container_id_list)) {
+    if (!request->in_move_set_membership_.Insert(container_id_list)) {
         TRACE("Abort container merge: container in move set: container id " << container_id_1 << ", container id " << container_id_2);
-        *aborted = true;
+        request->aborted_ = true;
         return true;
     }
     TRACE("Adds containers to in move set: container id " << container_id_1 << ", container id " << container_id_2);
@@ -3063,32 +4169,64 @@ bool ContainerStorage::TryMergeContainer(uint64_t container_id_1, uint64_t conta
         ", container " << container2.DebugString() <<
         ", reason container id should be primary");
 
+    // From now on the in-move set membership protects both containers against deletes, moves and
+    // other merges until the merge is committed. The old containers stay readable at their old
+    // addresses, therefore the container locks are not needed for the later stages.
+    CHECK(container_lock1.ReleaseLock(), "Cannot release container write lock");
+    if (container_lock2.Get() != container_lock1.Get()) {
+        CHECK(container_lock2.ReleaseLock(), "Cannot release container write lock");
+    }
+    return true;
+}
+
+bool ContainerStorage::MergeContainers(ContainerMergeRequest* request) {
+    DCHECK(request, "Request not set");
+    if (request->aborted_) {
+        return true;
+    }
+    const Container& container1(*request->pool_container1_);
+    const Container& container2(*request->pool_container2_);
+    const ContainerStorageAddressData& container_address1(request->container_address1_);
+    const ContainerStorageAddressData& container_address2(request->container_address2_);
+
     // merge the two containers into the new container
-    Container new_container(0, container_size_, false);
+    Container& new_container(request->new_container_);
+
+    // The GC packs the merge candidates by their current item sizes, but items of older container formats
+    // grow when their item header is converted.
+    Option<bool> can_merge = new_container.CanMergeContainer(container1, container2);
+    CHECK(can_merge.valid(), "Failed to check container merge: " <<
+        container1.DebugString() << ", " << container2.DebugString());
+    if (!can_merge.value()) {
+        DEBUG("Abort container merge: merged items do not fit: " <<
+            container1.DebugString() << ", " << container2.DebugString());
+        request->aborted_ = true;
+        return true;
+    }
     CHECK(new_container.MergeContainer(container1, container2), "Failed to merge containers: " <<
         container1.DebugString() << ", " << container2.DebugString());
 
-    ContainerStorageAddressData new_container_address;
-    enum alloc_result alloc_result = this->allocator_->OnNewContainer(new_container, false, &new_container_address);
+    ContainerStorageAddressData& new_container_address(request->new_container_address_);
+    enum alloc_result alloc_result = this->allocator_->OnNewContainer(new_container, false, STORAGE_TIER_CAPACITY,
+        &new_container_address);
     CHECK(alloc_result != ALLOC_ERROR, "Failed to get new container address");
     if (alloc_result == ALLOC_FULL) {
         // this is one of the worst situations to be in. There is no single place left to merge data. So it is not possible to free
         // one container area. But we need COW.
-        *aborted = true;
+        request->aborted_ = true;
         return true;
     }
+    request->allocated_ = true;
 
     INFO("Merging container: " << container1.DebugString() << "(" << DebugString(container_address1) << ")" <<
         ", " << container2.DebugString() << "(" << DebugString(container_address2) << ")" <<
         ", new container " << new_container.DebugString() << "(" << DebugString(new_container_address) << ")");
 
     CHECK(IsValidAddressData(new_container_address), "Invalid address data: " << new_container_address.ShortDebugString());
-    CHECK(this->WriteContainer(&new_container, new_container_address),
-        "Failed to write container: " << new_container.DebugString());
 
     // the meta data index redirection is done after the log event commit
     // fill the data for the container merged log event
-    ContainerMergedEventData event_data;
+    ContainerMergedEventData& event_data(request->event_data_);
     event_data.set_new_item_count(new_container.item_count());
     event_data.set_new_active_data_size(new_container.active_data_size());
     if (container1.HasId(new_container.primary_id())) {
@@ -3132,11 +4270,25 @@ bool ContainerStorage::TryMergeContainer(uint64_t container_id_1, uint64_t conta
         // the actual deletion of the ids happens after the merge log event is committed
     }
 
-    // I release the lock here
-    CHECK(container_lock1.ReleaseLock(), "Cannot release container write lock");
-    if (container_lock2.Get() != container_lock1.Get()) {
-        CHECK(container_lock2.ReleaseLock(), "Cannot release container write lock");
+    return true;
+}
+
+bool ContainerStorage::WriteMergedContainer(ContainerMergeRequest* request) {
+    DCHECK(request, "Request not set");
+    if (request->aborted_) {
+        return true;
     }
+    const Container& container1(*request->pool_container1_);
+    const Container& container2(*request->pool_container2_);
+    Container& new_container(request->new_container_);
+    const ContainerStorageAddressData& new_container_address(request->new_container_address_);
+    ContainerMergedEventData& event_data(request->event_data_);
+
+    CHECK(this->WriteContainer(&new_container, new_container_address),
+        "Failed to write container: " << new_container.DebugString());
+    request->allocated_ = false;
+    RemoveItemTables(&item_table_cache_, container1);
+    RemoveItemTables(&item_table_cache_, container2);
 
     // a client now can read the container at the new or the old position. Both reads must be valid (and the
     // are at this point. During the commit call a lock on the meta data index ensures that a client
@@ -3145,21 +4297,22 @@ bool ContainerStorage::TryMergeContainer(uint64_t container_id_1, uint64_t conta
     int64_t commit_log_id = 0;
     CHECK(this->log_->CommitEvent(EVENT_TYPE_CONTAINER_MERGED, &event_data, &commit_log_id, this, NO_EC),
         "Cannot commit merge event data: " << event_data.ShortDebugString());
+    AppendContainerSummary(new_container, new_container_address, commit_log_id);
 
     FAULT_POINT("container-storage.merge.before-gc");
 
-    DEBUG("Merged container \n" << container1.DebugString() << " (" << DebugString(container_address1) << ")" <<
-        " and \n" << container2.DebugString() << " (" << DebugString(container_address2) << ")" <<
+    DEBUG("Merged container \n" << container1.DebugString() << " (" << DebugString(request->container_address1_) << ")" <<
+        " and \n" << container2.DebugString() << " (" << DebugString(request->container_address2_) << ")" <<
         ", into \n" << new_container.DebugString() <<
         ", new address " << DebugString(new_container_address) <<
         ", log id " << commit_log_id <<
         ", event data " << event_data.ShortDebugString());
     this->stats_.merged_container_++;
 
-    scoped_set_membership.RemoveAllFromSet();
+    request->in_move_set_membership_.RemoveAllFromSet();
 
     FAULT_POINT("container-storage.merge.post");
-    *aborted = false;
+    request->aborted_ = false;
     return true;
 }
 
@@ -3171,12 +4324,14 @@ bool ContainerStorage::TryDeleteContainer(uint64_t container_id, bool* aborted)
     FAULT_POINT("container-storage.delete.pre");
     // TODO (dmeister): We want an good state even if the delete fails
 
-    Container container(container_id, container_size_, false);
+    ScopedPoolContainer pool_container(&container_pool_, container_id, false);
+    CHECK(pool_container.Get(), "Failed to acquire container: container id " << container_id);
+    Container& container(*pool_container);
 
     // we cannot use the normal lookup address method here as that would lead to problems with the locking
     uint64_t id = container.primary_id();
     ContainerStorageAddressData container_address;
-    lookup_result r = this->meta_data_index_->Lookup(&id, sizeof(uint64_t), &container_address);
+    lookup_result r = LookupAddressData(id, &container_address);
     CHECK(r == LOOKUP_FOUND, "Cannot get container address for container " << id);
     CHECK(container_address.has_primary_id() == false, "Illegal delete candidate: " <<
         "container " << container.DebugString() <<
@@ -3227,6 +4382,7 @@ bool ContainerStorage::TryDeleteContainer(uint64_t container_id, bool* aborted)
     CHECK(container.item_count() == 0, "Container is contains items: << " << container.DebugString());
 
     INFO("Delete container " << container.DebugString() << ", old address " << DebugString(container_address));
+    RemoveItemTables(&item_table_cache_, container);
 
     // fill the data for the container merged log event
     ContainerDeletedEventData event_data;
@@ -3255,6 +4411,107 @@ bool ContainerStorage::TryDeleteContainer(uint64_t container_id, bool* aborted)
     return true;
 }
 
+bool ContainerStorage::IsFastTierAddress(const ContainerStorageAddressData& address) const {
+    if (!address.has_file_index() || address.file_index() >= file_.size()) {
+        return false;
+    }
+    return file_[address.file_index()].fast_tier();
+}
+
+bool ContainerStorage::TryMoveContainer(uint64_t container_id, bool fast_tier, bool* aborted) {
+    CHECK(state_ == STARTED || state_ == RUNNING, "Illegal state to move container: " << state_);
+    CHECK(aborted, "Aborted not set");
+    CHECK(!start_context_.readonly(), "Container storage is in readonly mode");
+    CHECK(allocator_, "Allocator not set");
+
+    // while the container is in the move set, no one else moves, merges, or deletes the container
+    ScopedInMoveSetMembership scoped_set_membership(&in_move_set_, &in_move_set_lock_);
+    if (!scoped_set_membership.Insert(container_id)) {
+        TRACE("Abort container move: container in move set: container id " << container_id);
+        *aborted = true;
+        return true;
+    }
+
+    ContainerStorageAddressData container_address;
+    lookup_result r = LookupAddressData(container_id, &container_address);
+    CHECK(r != LOOKUP_ERROR, "Failed to lookup container address: container id " << container_id);
+    if (r == LOOKUP_NOT_FOUND || container_address.has_primary_id()) {
+        // not committed, deleted, or merged into another container
+        TRACE("Abort container move: container not found: container id " << container_id);
+        *aborted = true;
+        return true;
+    }
+    if (IsFastTierAddress(container_address) == fast_tier) {
+        TRACE("Abort container move: container already on tier: container id " << container_id);
+        *aborted = true;
+        return true;
+    }
+
+    bool locked = false;
+    ScopedReadWriteLock container_lock(this->GetContainerLock(container_id));
+    CHECK(container_lock.TryAcquireWriteLock(&locked), "Cannot acquire container write lock");
+    if (!locked) {
+        DEBUG("Container currently locked: container id " << container_id);
+        *aborted = true;
+        return true;
+    }
+
+    ScopedPoolContainer pool_container(&container_pool_, container_id, false);
+    CHECK(pool_container.Get(), "Failed to acquire container: container id " << container_id);
+    Container& container(*pool_container);
+
+    lookup_result read_result = ReadContainerLocked(&container, container_address);
+    CHECK(read_result == LOOKUP_FOUND, "Failed to read container: container id " << container_id <<
+        ", address " << DebugString(container_address));
+    CHECK(container.primary_id() == container_id, "Container id mismatch: "
+        "container id " << container_id <<
+        ", container " << container.DebugString());
+
+    ContainerStorageAddressData new_container_address;
+    enum alloc_result ar = allocator_->OnMoveContainer(container,
+        fast_tier ? STORAGE_TIER_FAST : STORAGE_TIER_CAPACITY, &new_container_address);
+    CHECK(ar != ALLOC_ERROR, "Failed to get new container address: " << container.DebugString());
+    if (ar == ALLOC_FULL) {
+        DEBUG("Abort container move: tier full: container id " << container_id);
+        *aborted = true;
+        return true;
+    }
+    if (!WriteContainer(&container, new_container_address)) {
+        ERROR("Failed to write container " << container.DebugString());
+        if (!allocator_->OnAbortContainer(container, new_container_address)) {
+            WARNING("Failed to abort container address: " << DebugString(new_container_address));
+        }
+        return false;
+    }
+    RemoveItemTables(&item_table_cache_, container);
+
+    ContainerMoveEventData event_data;
+    event_data.set_container_id(container.primary_id());
+    event_data.mutable_new_address()->CopyFrom(new_container_address);
+    event_data.mutable_old_address()->CopyFrom(container_address);
+    event_data.set_active_data_size(container.active_data_size());
+    event_data.set_old_active_data_size(container.active_data_size());
+    event_data.set_item_count(container.item_count());
+    event_data.set_old_item_count(container.item_count());
+
+    DEBUG("Moved container " << container.DebugString() <<
+        ", old address " << DebugString(container_address) <<
+        ", new address " << DebugString(new_container_address) <<
+        ", tier " << (fast_tier ? "fast" : "capacity"));
+
+    CHECK(container_lock.ReleaseLock(), "Cannot release container write lock");
+
+    int64_t event_log_id = 0;
+    CHECK(log_->CommitEvent(EVENT_TYPE_CONTAINER_MOVED, &event_data, &event_log_id, this, NO_EC),
+        "Failed to commit container move");
+    AppendContainerSummary(container, new_container_address, event_log_id);
+    stats_.moved_container_++;
+
+    scoped_set_membership.RemoveAllFromSet();
+    *aborted = false;
+    return true;
+}
+
 enum lookup_result ContainerStorage::GetPrimaryId(uint64_t container_id,
                                                   uint64_t* primary_id,
                                                   dedupv1::base::ReadWriteLock** primary_container_lock,
@@ -3396,8 +4653,11 @@ bool ContainerStorageMetadataCache::Update(uint64_t address, storage_commit_stat
 ContainerStorage::ContainerFile::ContainerFile() {
     file_ = NULL;
     file_size_ = 0;
+    fast_tier_ = false;
+    checksum_type_ = CONTAINER_CHECKSUM_ADLER32;
     new_ = false;
     lock_ = NULL;
+    group_sync_ = NULL;
 }
 
 ContainerStorage::ContainerFile::~ContainerFile() {
@@ -3405,12 +4665,19 @@ ContainerStorage::ContainerFile::~ContainerFile() {
         delete lock_;
         lock_ = NULL;
     }
+    if (group_sync_) {
+        delete group_sync_;
+        group_sync_ = NULL;
+    }
 }
 
-bool ContainerStorage::ContainerFile::Start(File* file, bool is_new) {
+bool ContainerStorage::ContainerFile::Start(File* file, bool is_new, bool group_sync) {
     file_ = file;
     new_ = is_new;
     lock_ = new dedupv1::base::MutexLock();
+    if (group_sync) {
+        group_sync_ = new ContainerStorageGroupSync(file);
+    }
     return true;
 }
 
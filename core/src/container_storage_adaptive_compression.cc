@@ -0,0 +1,217 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <core/container_storage_adaptive_compression.h>
+
+#include <math.h>
+
+#include <sstream>
+
+#include <core/storage.h>
+#include <base/logging.h>
+#include <base/strutil.h>
+
+using std::string;
+using std::stringstream;
+using dedupv1::base::strutil::To;
+using dedupv1::base::strutil::ToStorageUnit;
+
+LOGGER("ContainerStorageAdaptiveCompression");
+
+namespace dedupv1 {
+namespace chunkstore {
+
+const double ContainerStorageAdaptiveCompression::kDefaultEntropyThreshold = 7.5;
+const double ContainerStorageAdaptiveCompression::kDefaultMinGainRatio = 0.1;
+const double ContainerStorageAdaptiveCompression::kGoodCompressionRatio = 0.9;
+
+ContainerStorageAdaptiveCompression::Statistics::Statistics() {
+    decisions_ = 0;
+    compress_decisions_ = 0;
+    entropy_skips_ = 0;
+    stream_skips_ = 0;
+    good_compressions_ = 0;
+    bad_compressions_ = 0;
+    stream_disables_ = 0;
+}
+
+ContainerStorageAdaptiveCompression::StreamState::StreamState() {
+    window_decisions_ = 0;
+    window_gains_ = 0;
+    skip_count_ = 0;
+}
+
+ContainerStorageAdaptiveCompression::ContainerStorageAdaptiveCompression() {
+    entropy_threshold_ = kDefaultEntropyThreshold;
+    sample_size_ = kDefaultSampleSize;
+    window_size_ = kDefaultWindowSize;
+    skip_count_ = kDefaultSkipCount;
+    min_gain_ratio_ = kDefaultMinGainRatio;
+    started_ = false;
+}
+
+bool ContainerStorageAdaptiveCompression::SetOption(const string& option_name, const string& option) {
+    CHECK(!started_, "Adaptive compression already started");
+    if (option_name == "entropy-threshold") {
+        CHECK(To<double>(option).valid(), "Illegal option " << option);
+        CHECK(To<double>(option).value() > 0.0 && To<double>(option).value() <= 8.0, "Illegal entropy threshold " << option);
+        entropy_threshold_ = To<double>(option).value();
+        return true;
+    }
+    if (option_name == "sample-size") {
+        CHECK(ToStorageUnit(option).valid(), "Illegal option " << option);
+        CHECK(ToStorageUnit(option).value() > 0, "Illegal sample size " << option);
+        sample_size_ = ToStorageUnit(option).value();
+        return true;
+    }
+    if (option_name == "window-size") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        CHECK(To<uint32_t>(option).value() > 0, "Illegal window size " << option);
+        window_size_ = To<uint32_t>(option).value();
+        return true;
+    }
+    if (option_name == "skip-count") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        skip_count_ = To<uint32_t>(option).value();
+        return true;
+    }
+    if (option_name == "min-gain-ratio") {
+        CHECK(To<double>(option).valid(), "Illegal option " << option);
+        CHECK(To<double>(option).value() >= 0.0 && To<double>(option).value() <= 1.0, "Illegal min gain ratio " << option);
+        min_gain_ratio_ = To<double>(option).value();
+        return true;
+    }
+    ERROR("Illegal option: " << option_name);
+    return false;
+}
+
+bool ContainerStorageAdaptiveCompression::Start() {
+    CHECK(!started_, "Adaptive compression already started");
+    started_ = true;
+    return true;
+}
+
+double ContainerStorageAdaptiveCompression::EstimateEntropy(const void* data, size_t data_size, size_t sample_size) {
+    if (data_size == 0 || sample_size == 0) {
+        return 0.0;
+    }
+    const byte* p = static_cast<const byte*>(data);
+    uint32_t histogram[256];
+    memset(histogram, 0, sizeof(histogram));
+
+    size_t count = 0;
+    if (data_size <= sample_size) {
+        for (size_t i = 0; i < data_size; i++) {
+            histogram[p[i]]++;
+        }
+        count = data_size;
+    } else {
+        size_t stride = data_size / sample_size;
+        for (size_t i = 0; i < sample_size; i++) {
+            histogram[p[i * stride]]++;
+        }
+        count = sample_size;
+    }
+
+    double entropy = 0.0;
+    for (int i = 0; i < 256; i++) {
+        if (histogram[i] > 0) {
+            double probability = static_cast<double>(histogram[i]) / count;
+            entropy -= probability * log2(probability);
+        }
+    }
+    return entropy;
+}
+
+void ContainerStorageAdaptiveCompression::RecordOutcome(uint32_t stream_id, bool gain) {
+    if (stream_id == Storage::NO_STREAM_ID) {
+        return;
+    }
+    tbb::concurrent_hash_map<uint32_t, StreamState>::accessor a;
+    streams_.insert(a, stream_id);
+    StreamState& state(a->second);
+    state.window_decisions_++;
+    if (gain) {
+        state.window_gains_++;
+    }
+    if (state.window_decisions_ < window_size_) {
+        return;
+    }
+    if (state.window_gains_ < min_gain_ratio_ * state.window_decisions_ && skip_count_ > 0) {
+        DEBUG("Switch off compression: stream " << stream_id <<
+            ", window gains " << state.window_gains_ <<
+            ", window decisions " << state.window_decisions_ <<
+            ", skip count " << skip_count_);
+        state.skip_count_ = skip_count_;
+        stats_.stream_disables_++;
+    }
+    state.window_decisions_ = 0;
+    state.window_gains_ = 0;
+}
+
+bool ContainerStorageAdaptiveCompression::ShouldCompress(uint32_t stream_id, const void* data, size_t data_size) {
+    stats_.decisions_++;
+    if (stream_id != Storage::NO_STREAM_ID) {
+        tbb::concurrent_hash_map<uint32_t, StreamState>::accessor a;
+        if (streams_.find(a, stream_id) && a->second.skip_count_ > 0) {
+            // after the last skipped chunk, the stream is probed again
+            a->second.skip_count_--;
+            stats_.stream_skips_++;
+            return false;
+        }
+    }
+    double entropy = EstimateEntropy(data, data_size, sample_size_);
+    if (entropy > entropy_threshold_) {
+        TRACE("Skip compression: stream " << stream_id << ", entropy " << entropy);
+        stats_.entropy_skips_++;
+        RecordOutcome(stream_id, false);
+        return false;
+    }
+    stats_.compress_decisions_++;
+    return true;
+}
+
+void ContainerStorageAdaptiveCompression::ReportCompression(uint32_t stream_id, size_t raw_size, size_t stored_size) {
+    bool gain = stored_size <= raw_size * kGoodCompressionRatio;
+    if (gain) {
+        stats_.good_compressions_++;
+    } else {
+        stats_.bad_compressions_++;
+    }
+    RecordOutcome(stream_id, gain);
+}
+
+string ContainerStorageAdaptiveCompression::PrintStatistics() {
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"decisions\": " << stats_.decisions_ << "," << std::endl;
+    sstr << "\"compress decisions\": " << stats_.compress_decisions_ << "," << std::endl;
+    sstr << "\"entropy skips\": " << stats_.entropy_skips_ << "," << std::endl;
+    sstr << "\"stream skips\": " << stats_.stream_skips_ << "," << std::endl;
+    sstr << "\"good compressions\": " << stats_.good_compressions_ << "," << std::endl;
+    sstr << "\"bad compressions\": " << stats_.bad_compressions_ << "," << std::endl;
+    sstr << "\"stream disables\": " << stats_.stream_disables_ << "," << std::endl;
+    sstr << "\"streams\": " << streams_.size() << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+}
+}
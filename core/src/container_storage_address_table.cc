@@ -0,0 +1,188 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <core/container_storage_address_table.h>
+
+#include <sstream>
+
+#include <base/logging.h>
+#include <base/memory.h>
+#include <base/timer.h>
+
+using std::string;
+using std::stringstream;
+using std::vector;
+using dedupv1::base::PersistentIndex;
+using dedupv1::base::IndexIterator;
+using dedupv1::base::ScopedPtr;
+using dedupv1::base::Walltimer;
+using dedupv1::base::LOOKUP_ERROR;
+using dedupv1::base::LOOKUP_NOT_FOUND;
+using dedupv1::base::LOOKUP_FOUND;
+using dedupv1::base::lookup_result;
+using tbb::spin_rw_mutex;
+
+LOGGER("ContainerStorageAddressTable");
+
+namespace dedupv1 {
+namespace chunkstore {
+
+ContainerStorageAddressTable::Statistics::Statistics() {
+    lookup_count_ = 0;
+    update_count_ = 0;
+    delete_count_ = 0;
+}
+
+ContainerStorageAddressTable::ContainerStorageAddressTable() {
+    entry_count_ = 0;
+    started_ = false;
+}
+
+bool ContainerStorageAddressTable::Start(PersistentIndex* meta_data_index) {
+    CHECK(!started_, "Address table already started");
+    CHECK(meta_data_index, "Meta data index not set");
+
+    Walltimer startup_timer;
+    IndexIterator* i = meta_data_index->CreateIterator();
+    CHECK(i, "Failed to create meta data iterator");
+    ScopedPtr<IndexIterator> scoped_iterator(i);
+
+    uint64_t container_id = 0;
+    size_t key_size = sizeof(container_id);
+    ContainerStorageAddressData address_data;
+    lookup_result lr = i->Next(&container_id, &key_size, &address_data);
+    for (; lr == LOOKUP_FOUND; lr = i->Next(&container_id, &key_size, &address_data)) {
+        CHECK(key_size == sizeof(container_id), "Illegal meta data key size: " << key_size);
+        CHECK(Update(container_id, address_data), "Failed to load container address: " <<
+            "container id " << container_id <<
+            ", address " << address_data.ShortDebugString());
+        key_size = sizeof(container_id);
+    }
+    CHECK(lr != LOOKUP_ERROR, "Failed to iterate meta data index");
+    stats_.update_count_ = 0;
+
+    DEBUG("Loaded container address table: " <<
+        "entry count " << entry_count_ <<
+        ", table size " << entries_.size() <<
+        ", load time " << startup_timer.GetTime() << "ms");
+    started_ = true;
+    return true;
+}
+
+lookup_result ContainerStorageAddressTable::Lookup(uint64_t container_id, ContainerStorageAddressData* address_data) {
+    stats_.lookup_count_++;
+
+    spin_rw_mutex::scoped_lock scoped_lock(lock_, false);
+    if (container_id >= entries_.size() || entries_[container_id].type_ == ENTRY_EMPTY) {
+        return LOOKUP_NOT_FOUND;
+    }
+    const Entry& entry(entries_[container_id]);
+    if (address_data) {
+        address_data->Clear();
+        if (entry.type_ == ENTRY_SECONDARY) {
+            address_data->set_primary_id(entry.value_);
+        } else {
+            address_data->set_file_index(entry.file_index_);
+            address_data->set_file_offset(entry.value_);
+        }
+        if (entry.log_id_ != 0) {
+            address_data->set_log_id(entry.log_id_);
+        }
+    }
+    return LOOKUP_FOUND;
+}
+
+bool ContainerStorageAddressTable::Update(uint64_t container_id, const ContainerStorageAddressData& address_data) {
+    Entry entry;
+    if (address_data.has_primary_id()) {
+        entry.value_ = address_data.primary_id();
+        entry.file_index_ = 0;
+        entry.type_ = ENTRY_SECONDARY;
+    } else {
+        CHECK(address_data.has_file_index() && address_data.has_file_offset(),
+            "Illegal container address: container id " << container_id <<
+            ", address " << address_data.ShortDebugString());
+        entry.value_ = address_data.file_offset();
+        entry.file_index_ = address_data.file_index();
+        entry.type_ = ENTRY_PRIMARY;
+    }
+    entry.log_id_ = address_data.log_id();
+    stats_.update_count_++;
+
+    spin_rw_mutex::scoped_lock scoped_lock(lock_, true);
+    if (container_id >= entries_.size()) {
+        // double the table to amortize the copying as container ids are given in increasing order
+        size_t new_size = entries_.size() * 2;
+        if (new_size <= container_id) {
+            new_size = container_id + 1;
+        }
+        Entry empty_entry;
+        empty_entry.value_ = 0;
+        empty_entry.log_id_ = 0;
+        empty_entry.file_index_ = 0;
+        empty_entry.type_ = ENTRY_EMPTY;
+        entries_.resize(new_size, empty_entry);
+    }
+    if (entries_[container_id].type_ == ENTRY_EMPTY) {
+        entry_count_++;
+    }
+    entries_[container_id] = entry;
+    return true;
+}
+
+bool ContainerStorageAddressTable::Delete(uint64_t container_id) {
+    stats_.delete_count_++;
+
+    spin_rw_mutex::scoped_lock scoped_lock(lock_, true);
+    if (container_id >= entries_.size() || entries_[container_id].type_ == ENTRY_EMPTY) {
+        return true;
+    }
+    entries_[container_id].value_ = 0;
+    entries_[container_id].log_id_ = 0;
+    entries_[container_id].file_index_ = 0;
+    entries_[container_id].type_ = ENTRY_EMPTY;
+    entry_count_--;
+    return true;
+}
+
+uint64_t ContainerStorageAddressTable::GetSize() {
+    spin_rw_mutex::scoped_lock scoped_lock(lock_, false);
+    return entry_count_;
+}
+
+uint64_t ContainerStorageAddressTable::GetMemorySize() {
+    spin_rw_mutex::scoped_lock scoped_lock(lock_, false);
+    return entries_.capacity() * sizeof(Entry);
+}
+
+string ContainerStorageAddressTable::PrintStatistics() {
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"entry count\": " << GetSize() << "," << std::endl;
+    sstr << "\"memory size\": " << GetMemorySize() << "," << std::endl;
+    sstr << "\"lookups\": " << this->stats_.lookup_count_ << "," << std::endl;
+    sstr << "\"updates\": " << this->stats_.update_count_ << "," << std::endl;
+    sstr << "\"deletes\": " << this->stats_.delete_count_ << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+}
+}
@@ -99,6 +99,17 @@ bool ContainerStorageAllocator::OnCommitContainer(const Container& container, co
     return true;
 }
 
+enum alloc_result ContainerStorageAllocator::OnMoveContainer(const Container& container,
+        enum storage_tier tier,
+        ContainerStorageAddressData* new_address) {
+    ERROR("Allocator doesn't support tiering");
+    return ALLOC_ERROR;
+}
+
+Option<double> ContainerStorageAllocator::GetTierFillRatio(enum storage_tier tier) {
+    return false;
+}
+
 bool ContainerStorageAllocator::OnMerge(const ContainerMergedEventData& data) {
     return true;
 }
@@ -169,6 +180,9 @@ MemoryBitmapContainerStorageAllocator::MemoryBitmapContainerStorageAllocator() {
     storage_ = NULL;
     persistent_bitmap_ = NULL;
     next_file_ = 0;
+    next_file_run_ = 0;
+    file_run_length_ = 1;
+    tiered_ = false;
     free_count_ = 0;
     total_count_ = 0;
     log_ = NULL;
@@ -192,6 +206,12 @@ bool MemoryBitmapContainerStorageAllocator::SetOption(const string& option_name,
         CHECK(this->persistent_bitmap_->SetOption("max-key-size", "8"), "Failed to set auto option");
         return true;
     }
+    if (option_name == "file-run-length") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        CHECK(To<uint32_t>(option).value() > 0, "Illegal file run length: " << option);
+        this->file_run_length_ = To<uint32_t>(option).value();
+        return true;
+    }
     CHECK(this->persistent_bitmap_, "Bitmap not set");
     CHECK(this->persistent_bitmap_->SetOption(option_name, option), "Configuration failed: " << option_name << " - " << option);
     return true;
@@ -260,7 +280,19 @@ bool MemoryBitmapContainerStorageAllocator::Start(const StartContext& start_cont
         free_count_ += bitmap->clean_bits();
         total_count_ += bitmap->size();
         file_[i].bitmap_ = bitmap;
+        file_[i].fast_tier_ = storage_->file(i).fast_tier();
+    }
+
+    bool has_fast_tier = false;
+    bool has_capacity_tier = false;
+    for (size_t i = 0; i < file_.size(); i++) {
+        if (file_[i].fast_tier_) {
+            has_fast_tier = true;
+        } else {
+            has_capacity_tier = true;
+        }
     }
+    tiered_ = has_fast_tier && has_capacity_tier;
 
     state_ = STARTED;
     return true;
@@ -407,7 +439,11 @@ uint64_t MemoryBitmapContainerStorageAllocator::GetActiveStorageDataSize() {
 int MemoryBitmapContainerStorageAllocator::GetNextFile() {
     tbb::spin_mutex::scoped_lock scoped_lock(this->next_file_lock_);
     int f = next_file_;
-    next_file_ = (next_file_ + 1) % this->file_.size();
+    next_file_run_++;
+    if (next_file_run_ >= file_run_length_) {
+        next_file_run_ = 0;
+        next_file_ = (next_file_ + 1) % this->file_.size();
+    }
     return f;
 }
 
@@ -491,6 +527,9 @@ string MemoryBitmapContainerStorageAllocator::PrintStatistics() {
             sstr << ",";
         }
         sstr << "{";
+        if (tiered_) {
+            sstr << "\"tier\": \"" << (file_[i].fast_tier_ ? "fast" : "capacity") << "\"," << std::endl;
+        }
         sstr << "\"total count\": " << file_[i].bitmap_->size() << "," << std::endl;
         sstr << "\"free count\": " << file_[i].bitmap_->clean_bits() << "," << std::endl;
         if (file_[i].bitmap_->size() > 0) {
@@ -623,20 +662,20 @@ bool MemoryBitmapContainerStorageAllocator::LogReplay(dedupv1::log::event_type e
     return true;
 }
 
-enum alloc_result MemoryBitmapContainerStorageAllocator::OnNewContainer(const Container& container,
-                                                                        bool is_new_container, ContainerStorageAddressData* new_address) {
-    ScopedReadWriteLock scoped_lock(&lock_);
-    scoped_lock.AcquireReadLock();
-    DCHECK_RETURN(new_address, ALLOC_ERROR, "new_adresss not set");
-
-    this->stats_.alloc_count_++;
-    ProfileTimer alloc_timer(this->stats_.alloc_time_);
-
-    DEBUG("Allocate a new address for container: " << container.DebugString());
-
+enum alloc_result MemoryBitmapContainerStorageAllocator::SearchFreeFile(bool is_new_container,
+        enum storage_tier tier,
+        ContainerStorageAddressData* new_address) {
     bool found_file = false;
+    int first_file_index = GetNextFile();
     for (int i = 0; i < file_.size(); i++) {
-        int file_index = GetNextFile();
+        // if the file of the current run is full, the following files are tested
+        int file_index = (first_file_index + i) % file_.size();
+        if (tier == STORAGE_TIER_FAST && !file_[file_index].fast_tier_) {
+            continue;
+        }
+        if (tier == STORAGE_TIER_CAPACITY && file_[file_index].fast_tier_) {
+            continue;
+        }
 
         ScopedLock file_lock(file_locks_.Get(file_index));
         CHECK_RETURN(file_lock.AcquireLock(), ALLOC_ERROR, "Failed to acquire file lock: file index " << file_index <<
@@ -662,6 +701,38 @@ enum alloc_result MemoryBitmapContainerStorageAllocator::OnNewContainer(const Co
     }
 
     if (!found_file) {
+        return ALLOC_FULL;
+    }
+    return ALLOC_OK;
+}
+
+enum alloc_result MemoryBitmapContainerStorageAllocator::OnNewContainer(const Container& container,
+                                                                        bool is_new_container,
+                                                                        enum storage_tier tier,
+                                                                        ContainerStorageAddressData* new_address) {
+    ScopedReadWriteLock scoped_lock(&lock_);
+    scoped_lock.AcquireReadLock();
+    DCHECK_RETURN(new_address, ALLOC_ERROR, "new_adresss not set");
+
+    this->stats_.alloc_count_++;
+    ProfileTimer alloc_timer(this->stats_.alloc_time_);
+
+    DEBUG("Allocate a new address for container: " << container.DebugString());
+
+    enum alloc_result result = ALLOC_FULL;
+    if (tiered_ && tier != STORAGE_TIER_ANY) {
+        enum storage_tier other_tier = tier == STORAGE_TIER_FAST ? STORAGE_TIER_CAPACITY : STORAGE_TIER_FAST;
+        result = SearchFreeFile(is_new_container, tier, new_address);
+        if (result == ALLOC_FULL) {
+            result = SearchFreeFile(is_new_container, other_tier, new_address);
+        }
+    } else {
+        result = SearchFreeFile(is_new_container, STORAGE_TIER_ANY, new_address);
+    }
+    if (result == ALLOC_ERROR) {
+        return ALLOC_ERROR;
+    }
+    if (result == ALLOC_FULL) {
         DEBUG("No container place available. Container storage is full");
         return ALLOC_FULL;
     }
@@ -671,6 +742,57 @@ enum alloc_result MemoryBitmapContainerStorageAllocator::OnNewContainer(const Co
     return ALLOC_OK;
 }
 
+enum alloc_result MemoryBitmapContainerStorageAllocator::OnMoveContainer(const Container& container,
+        enum storage_tier tier,
+        ContainerStorageAddressData* new_address) {
+    ScopedReadWriteLock scoped_lock(&lock_);
+    scoped_lock.AcquireReadLock();
+    DCHECK_RETURN(new_address, ALLOC_ERROR, "new_adresss not set");
+    CHECK_RETURN(tiered_, ALLOC_ERROR, "Container files are not tiered");
+
+    this->stats_.alloc_count_++;
+    ProfileTimer alloc_timer(this->stats_.alloc_time_);
+
+    DEBUG("Allocate a new address for container move: " << container.DebugString() <<
+        ", tier " << (tier == STORAGE_TIER_FAST ? "fast" : "capacity"));
+
+    // a tier move is optional. It should never take the last free place of a file
+    enum alloc_result result = SearchFreeFile(true, tier, new_address);
+    if (result == ALLOC_OK) {
+        DEBUG("Found free address: container " << container.DebugString() <<
+            ", address " << new_address->ShortDebugString());
+    }
+    return result;
+}
+
+Option<double> MemoryBitmapContainerStorageAllocator::GetTierFillRatio(enum storage_tier tier) {
+    ScopedReadWriteLock scoped_lock(&lock_);
+    scoped_lock.AcquireReadLock();
+
+    if (!tiered_) {
+        return false;
+    }
+    uint64_t total_count = 0;
+    uint64_t free_count = 0;
+    for (int i = 0; i < file_.size(); i++) {
+        if (tier == STORAGE_TIER_FAST && !file_[i].fast_tier_) {
+            continue;
+        }
+        if (tier == STORAGE_TIER_CAPACITY && file_[i].fast_tier_) {
+            continue;
+        }
+        ScopedLock file_lock(file_locks_.Get(i));
+        CHECK_RETURN(file_lock.AcquireLock(), false, "Failed to acquire file lock: file index " << i);
+        total_count += file_[i].bitmap_->size();
+        free_count += file_[i].bitmap_->clean_bits();
+        CHECK_RETURN(file_lock.ReleaseLock(), false, "Failed to release file lock");
+    }
+    if (total_count == 0) {
+        return false;
+    }
+    return make_option(1.0 - (1.0 * free_count / total_count));
+}
+
 bool MemoryBitmapContainerStorageAllocator::OnMerge(const ContainerMergedEventData& data) {
     ScopedReadWriteLock scoped_lock(&lock_);
     scoped_lock.AcquireReadLock();
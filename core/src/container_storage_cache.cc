@@ -43,9 +43,7 @@ using dedupv1::base::LOOKUP_NOT_FOUND;
 using dedupv1::base::LOOKUP_FOUND;
 using dedupv1::base::lookup_result;
 using dedupv1::base::strutil::ToString;
-using tbb::tick_count;
 using tbb::concurrent_hash_map;
-using tbb::spin_rw_mutex;
 using tbb::spin_mutex;
 
 LOGGER("ContainerStorageCache");
@@ -56,6 +54,8 @@ namespace chunkstore {
 ContainerStorageReadCache::ContainerStorageReadCache(ContainerStorage* storage) {
     this->storage_ = storage;
     this->read_cache_size_ = kDefaultReadCacheSize;
+    this->policy_ = NULL;
+    this->policy_name_ = "lru";
 }
 
 ContainerStorageReadCache::Statistics::Statistics() {
@@ -65,6 +65,7 @@ ContainerStorageReadCache::Statistics::Statistics() {
     this->cache_updates_ = 0;
     this->cache_hits_ = 0;
     this->cache_miss_ = 0;
+    this->cache_no_pollute_checks_ = 0;
 }
 
 bool ContainerStorageReadCache::SetOption(const string& option_name, const string& option) {
@@ -76,6 +77,13 @@ bool ContainerStorageReadCache::SetOption(const string& option_name, const strin
         CHECK(this->read_cache_size_ != 0, "Failed to set read cache size: size must be larger than 0");
         return true;
     }
+    if (option_name == "policy") {
+        ContainerStorageReadCachePolicy* policy = ContainerStorageReadCachePolicy::Create(option);
+        CHECK(policy, "Illegal read cache policy: " << option);
+        delete policy;
+        this->policy_name_ = option;
+        return true;
+    }
     ERROR("Illegal option: " << option_name);
     return false;
 }
@@ -90,13 +98,10 @@ bool ContainerStorageReadCache::Start() {
     }
     // read cache locks
     this->read_cache_lock_.Init(this->read_cache_size_);
-    this->read_cache_used_time_.resize(this->read_cache_size_);
-
-    // read cache replacement time data
-    for (int i = 0; i < this->read_cache_size_; i++) {
-        this->read_cache_used_time_[i] = tick_count::now();
-    }
 
+    this->policy_ = ContainerStorageReadCachePolicy::Create(this->policy_name_);
+    CHECK(this->policy_, "Failed to create read cache policy: " << this->policy_name_);
+    CHECK(this->policy_->Start(this->read_cache_size_), "Failed to start read cache policy: " << this->policy_name_);
     return true;
 }
 
@@ -111,19 +116,27 @@ ContainerStorageReadCache::~ContainerStorageReadCache() {
         }
         this->read_cache_.clear();
     }
-    this->read_cache_used_time_.clear();
+    if (this->policy_) {
+        delete this->policy_;
+        this->policy_ = NULL;
+    }
 }
 
 enum lookup_result ContainerStorageReadCache::CheckCache(uint64_t container_id,
                                                          const Container** container,
                                                          bool no_update,
                                                          bool write_lock,
-                                                         CacheEntry* entry) {
+                                                         CacheEntry* entry,
+                                                         read_cache_hint hint) {
     DCHECK_RETURN(container, LOOKUP_ERROR, "Container not set");
     DCHECK_RETURN(entry, LOOKUP_ERROR, "Cache entry not set");
 
     ProfileTimer cache_timer(this->stats_.cache_check_time_);
     this->stats_.cache_checks_.fetch_and_increment();
+    if (hint == READ_CACHE_HINT_NO_POLLUTE) {
+        this->stats_.cache_no_pollute_checks_.fetch_and_increment();
+        no_update = true;
+    }
 
     int read_cache_index = 0;
     if (no_update) {
@@ -198,12 +211,13 @@ enum lookup_result ContainerStorageReadCache::CheckCache(uint64_t container_id,
 
     DEBUG("Found container in read cache: container id " << container_id << ", update " << ToString(!no_update));
 
-    // update used time
-    spin_rw_mutex::scoped_lock scoped_lock(this->read_cache_used_time_lock_);
-    this->read_cache_used_time_[read_cache_index] = tick_count::now();
-    TRACE("Update used timestamp: " << read_cache_index <<
-        ", container " <<  this->read_cache_[read_cache_index]->DebugString());
-    scoped_lock.release();
+    if (hint != READ_CACHE_HINT_NO_POLLUTE) {
+        spin_mutex::scoped_lock scoped_lock(this->policy_lock_);
+        if (!this->policy_->Touch(read_cache_index)) {
+            WARNING("Failed to update read cache policy: cache line " << read_cache_index);
+        }
+        scoped_lock.release();
+    }
 
     this->stats_.cache_hits_.fetch_and_increment();
 
@@ -270,6 +284,11 @@ enum lookup_result ContainerStorageReadCache::GetCache(uint64_t container_id, Ca
     return LOOKUP_FOUND;
 }
 
+bool ContainerStorageReadCache::IsCached(uint64_t container_id) {
+    concurrent_hash_map<uint64_t, int>::const_accessor a;
+    return this->reverse_cache_map_.find(a, container_id);
+}
+
 bool ContainerStorageReadCache::AcquireCacheLineLock(uint64_t future_container_id, int cache_line, CacheEntry* cache_entry) {
     DCHECK(cache_entry, "Cache entry not set");
     Container* active_container = this->read_cache_[cache_line];
@@ -305,48 +324,17 @@ bool ContainerStorageReadCache::ReuseCacheLine(uint64_t future_container_id,
     DCHECK(cache_entry, "Cache entry not set");
     DCHECK(accessor, "Accessor not set");
 
-    spin_rw_mutex::scoped_lock scoped_cache_used_time_lock;
-    scoped_cache_used_time_lock.acquire(this->read_cache_used_time_lock_, false);
-
-    int least_recently_used_index = -1;
-    tick_count t = tick_count::now();
-    for (int read_cache_index = 0; read_cache_index < this->read_cache_size_; read_cache_index++) {
-        TRACE("cache index used time: " << read_cache_index <<
-            ", container " << this->read_cache_[read_cache_index]->DebugString());
-        tick_count::interval_t diff = t - this->read_cache_used_time_[read_cache_index];
-        if ((least_recently_used_index == -1) || diff.seconds() > 0) {
-            least_recently_used_index = read_cache_index;
-            t = this->read_cache_used_time_[read_cache_index];
-
-        }
-    }
-    if (least_recently_used_index >= 0) {
-        if (!scoped_cache_used_time_lock.upgrade_to_writer()) {
-            // rerun everything as we may be released the lock in the meantime
-            for (int read_cache_index = 0; read_cache_index < this->read_cache_size_; read_cache_index++) {
-                TRACE("cache index used time: " << read_cache_index <<
-                    ", container " << this->read_cache_[read_cache_index]->DebugString());
-                tick_count::interval_t diff = t - this->read_cache_used_time_[read_cache_index];
-                if ((least_recently_used_index == -1) || diff.seconds() > 0) {
-                    least_recently_used_index = read_cache_index;
-                    t = this->read_cache_used_time_[read_cache_index];
-                }
-            }
-        }
-        this->read_cache_used_time_[least_recently_used_index] = tick_count::now();
-        TRACE("Update used timestamp: " << least_recently_used_index);
-    } else {
-        ERROR("Failed to select cache entry to reuse");
-        return false;
-    }
-
-    scoped_cache_used_time_lock.release();
-    CHECK_RETURN(least_recently_used_index >= 0, LOOKUP_ERROR, "Failed to select cache entry to reuse");
+    spin_mutex::scoped_lock scoped_policy_lock(this->policy_lock_);
+    int cache_line = this->policy_->Replace(future_container_id);
+    scoped_policy_lock.release();
+    CHECK(cache_line >= 0 && cache_line < this->read_cache_size_,
+        "Failed to select cache entry to reuse: cache line " << cache_line);
+    TRACE("Reuse cache line: " << cache_line << ", container id " << future_container_id);
 
     // the id is set, we will in the data later
     // add entries into reverse lookup map
     concurrent_hash_map<uint64_t, int>::accessor& a(*accessor);
-    a->second = least_recently_used_index;
+    a->second = cache_line;
     a.release(); // release the lock
 
     // Here we have a race condition between the release of the reverse map and acquire of the cache line lock
@@ -354,7 +342,7 @@ bool ContainerStorageReadCache::ReuseCacheLine(uint64_t future_container_id,
     // if someone else infers with us and acquires the lock before us, we may override its cache line data
     // However, this only leads to cache misses. Before a cache is used, we check for the validity of the cache line
 
-    if (!AcquireCacheLineLock(future_container_id, least_recently_used_index, cache_entry)) {
+    if (!AcquireCacheLineLock(future_container_id, cache_line, cache_entry)) {
         WARNING("Failed to acquire cache line");
         cache_entry->clear();
     }
@@ -373,12 +361,6 @@ bool ContainerStorageReadCache::CopyToReadCache(const Container& container,
 
     TRACE("Insert container into cache: " << container.DebugString() << ", cache line " << cache_entry->DebugString());
 
-    spin_rw_mutex::scoped_lock scoped_lock(this->read_cache_used_time_lock_);
-    this->read_cache_used_time_[cache_entry->line()] = tick_count::now();
-    TRACE("Update used timestamp: " << cache_entry->DebugString() <<
-        ", container " <<  this->read_cache_[cache_entry->line()]->DebugString());
-    scoped_lock.release();
-
     ScopedReadWriteLock used_cache_lock(NULL);
     used_cache_lock.SetLocked(cache_entry->lock());
     int cache_line = cache_entry->line();
@@ -417,6 +399,9 @@ bool ContainerStorageReadCache::ClearCache() {
         CHECK(read_cache_lock.AcquireWriteLock(), "Failed to acquire read cache lock: index " << i);
 
         this->read_cache_[i]->Reuse(Storage::ILLEGAL_STORAGE_ADDRESS);
+        spin_mutex::scoped_lock scoped_policy_lock(this->policy_lock_);
+        CHECK(this->policy_->Remove(i), "Failed to update read cache policy: cache line " << i);
+        scoped_policy_lock.release();
 
         CHECK(read_cache_lock.ReleaseLock(), "Failed to release read cache lock");
         CHECK(read_cache_lock.Set(NULL), "Failed to unset read cache lock");
@@ -436,6 +421,11 @@ bool ContainerStorageReadCache::ReleaseCacheline(uint64_t container_id, CacheEnt
     // Release cache line lock after reverse cache map to avoid a cyclic lock with ReuseCacheLine
     this->reverse_cache_map_.erase(container_id);
     this->read_cache_[cache_entry->line()]->Reuse(Storage::ILLEGAL_STORAGE_ADDRESS);
+    spin_mutex::scoped_lock scoped_policy_lock(this->policy_lock_);
+    if (!this->policy_->Remove(cache_entry->line())) {
+        WARNING("Failed to update read cache policy: " << cache_entry->DebugString());
+    }
+    scoped_policy_lock.release();
 
     ReadWriteLock* lock = cache_entry->lock();
     cache_entry->clear();
@@ -461,6 +451,11 @@ bool ContainerStorageReadCache::RemoveFromReadCache(uint64_t container_id, Cache
         this->reverse_cache_map_.erase(*k);
     }
     this->read_cache_[cache_entry->line()]->Reuse(Storage::ILLEGAL_STORAGE_ADDRESS);
+    spin_mutex::scoped_lock scoped_policy_lock(this->policy_lock_);
+    if (!this->policy_->Remove(cache_entry->line())) {
+        WARNING("Failed to update read cache policy: " << cache_entry->DebugString());
+    }
+    scoped_policy_lock.release();
     DEBUG("Remove container " << container_id << " from read cache: index " << cache_entry->line());
 
     ReadWriteLock* lock = cache_entry->lock();
@@ -514,7 +509,14 @@ string ContainerStorageReadCache::PrintStatistics() {
     sstr << "\"cache checks\": " << this->stats_.cache_checks_ << "," << std::endl;
     sstr << "\"cache updates\": " << this->stats_.cache_updates_ << "," << std::endl;
     sstr << "\"cache hits\": " << this->stats_.cache_hits_ << "," << std::endl;
-    sstr << "\"cache miss\": " << this->stats_.cache_miss_ << std::endl;
+    sstr << "\"cache miss\": " << this->stats_.cache_miss_ << "," << std::endl;
+    sstr << "\"cache no pollute checks\": " << this->stats_.cache_no_pollute_checks_ << "," << std::endl;
+    if (this->policy_) {
+        spin_mutex::scoped_lock scoped_policy_lock(this->policy_lock_);
+        sstr << "\"policy\": " << this->policy_->PrintStatistics() << std::endl;
+    } else {
+        sstr << "\"policy\": null" << std::endl;
+    }
     sstr << "}";
     return sstr.str();
 }
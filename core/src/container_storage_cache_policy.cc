@@ -0,0 +1,276 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <core/container_storage_cache_policy.h>
+
+#include <sstream>
+
+#include <base/logging.h>
+
+using std::string;
+using std::stringstream;
+using std::vector;
+using std::list;
+using std::map;
+using std::pair;
+using std::make_pair;
+
+LOGGER("ContainerStorageCachePolicy");
+
+namespace dedupv1 {
+namespace chunkstore {
+
+ContainerStorageReadCachePolicy::ContainerStorageReadCachePolicy() {
+}
+
+ContainerStorageReadCachePolicy::~ContainerStorageReadCachePolicy() {
+}
+
+ContainerStorageReadCachePolicy* ContainerStorageReadCachePolicy::Create(const string& name) {
+    if (name == "lru") {
+        return new LruReadCachePolicy();
+    }
+    if (name == "arc") {
+        return new ArcReadCachePolicy();
+    }
+    ERROR("Cannot find read cache policy: " << name << ", available policies lru, arc");
+    return NULL;
+}
+
+LruReadCachePolicy::LruReadCachePolicy() {
+    evictions_ = 0;
+}
+
+bool LruReadCachePolicy::Start(uint32_t line_count) {
+    CHECK(line_count > 0, "Illegal line count: " << line_count);
+    lru_list_.clear();
+    lru_position_.resize(line_count);
+    used_.assign(line_count, false);
+    for (int i = 0; i < line_count; i++) {
+        lru_position_[i] = lru_list_.insert(lru_list_.end(), i);
+    }
+    return true;
+}
+
+bool LruReadCachePolicy::Touch(int line) {
+    DCHECK(line >= 0 && line < lru_position_.size(), "Illegal cache line: " << line);
+    lru_list_.splice(lru_list_.end(), lru_list_, lru_position_[line]);
+    return true;
+}
+
+int LruReadCachePolicy::Replace(uint64_t container_id) {
+    CHECK_RETURN(!lru_list_.empty(), -1, "Policy not started");
+    int line = lru_list_.front();
+    if (used_[line]) {
+        evictions_++;
+    }
+    used_[line] = true;
+    lru_list_.splice(lru_list_.end(), lru_list_, lru_position_[line]);
+    return line;
+}
+
+bool LruReadCachePolicy::Remove(int line) {
+    DCHECK(line >= 0 && line < lru_position_.size(), "Illegal cache line: " << line);
+    used_[line] = false;
+    // an empty line is reused first
+    lru_list_.splice(lru_list_.begin(), lru_list_, lru_position_[line]);
+    return true;
+}
+
+string LruReadCachePolicy::PrintStatistics() {
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"type\": \"lru\"," << std::endl;
+    sstr << "\"evictions\": " << evictions_ << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+ArcReadCachePolicy::ArcReadCachePolicy() {
+    line_count_ = 0;
+    target_ = 0;
+    b1_hits_ = 0;
+    b2_hits_ = 0;
+    evictions_ = 0;
+}
+
+bool ArcReadCachePolicy::Start(uint32_t line_count) {
+    CHECK(line_count > 0, "Illegal line count: " << line_count);
+    line_count_ = line_count;
+    target_ = 0;
+    free_list_.clear();
+    t1_.clear();
+    t2_.clear();
+    b1_.clear();
+    b2_.clear();
+    ghost_map_.clear();
+    line_state_.assign(line_count, LINE_FREE);
+    line_position_.resize(line_count);
+    line_container_id_.assign(line_count, 0);
+    for (int i = 0; i < line_count; i++) {
+        line_position_[i] = free_list_.insert(free_list_.end(), i);
+    }
+    return true;
+}
+
+void ArcReadCachePolicy::Insert(int line, line_state state, uint64_t container_id) {
+    list<int>* l = &free_list_;
+    if (state == LINE_T1) {
+        l = &t1_;
+    } else if (state == LINE_T2) {
+        l = &t2_;
+    }
+    line_position_[line] = l->insert(l->end(), line);
+    line_state_[line] = state;
+    line_container_id_[line] = container_id;
+}
+
+void ArcReadCachePolicy::Unlink(int line) {
+    if (line_state_[line] == LINE_T1) {
+        t1_.erase(line_position_[line]);
+    } else if (line_state_[line] == LINE_T2) {
+        t2_.erase(line_position_[line]);
+    } else {
+        free_list_.erase(line_position_[line]);
+    }
+}
+
+void ArcReadCachePolicy::AddGhost(uint64_t container_id, ghost_state state) {
+    map<uint64_t, pair<ghost_state, list<uint64_t>::iterator> >::iterator i = ghost_map_.find(container_id);
+    if (i != ghost_map_.end()) {
+        if (i->second.first == GHOST_B1) {
+            b1_.erase(i->second.second);
+        } else {
+            b2_.erase(i->second.second);
+        }
+        ghost_map_.erase(i);
+    }
+    list<uint64_t>& l(state == GHOST_B1 ? b1_ : b2_);
+    list<uint64_t>::iterator j = l.insert(l.end(), container_id);
+    ghost_map_.insert(make_pair(container_id, make_pair(state, j)));
+}
+
+void ArcReadCachePolicy::RemoveOldestGhost(ghost_state state) {
+    list<uint64_t>& l(state == GHOST_B1 ? b1_ : b2_);
+    if (l.empty()) {
+        return;
+    }
+    ghost_map_.erase(l.front());
+    l.pop_front();
+}
+
+int ArcReadCachePolicy::FreeLine(bool b2_hit) {
+    if (!free_list_.empty()) {
+        int line = free_list_.front();
+        free_list_.pop_front();
+        return line;
+    }
+    bool evict_t1 = !t1_.empty() &&
+                    (t2_.empty() || t1_.size() > target_ || (b2_hit && t1_.size() == target_));
+    list<int>& l(evict_t1 ? t1_ : t2_);
+    CHECK_RETURN(!l.empty(), -1, "No cache line to evict");
+
+    int line = l.front();
+    AddGhost(line_container_id_[line], evict_t1 ? GHOST_B1 : GHOST_B2);
+    l.pop_front();
+    evictions_++;
+    return line;
+}
+
+bool ArcReadCachePolicy::Touch(int line) {
+    DCHECK(line >= 0 && line < line_state_.size(), "Illegal cache line: " << line);
+    if (line_state_[line] == LINE_FREE) {
+        return true;
+    }
+    // the second access moves the line to the frequency list
+    Unlink(line);
+    Insert(line, LINE_T2, line_container_id_[line]);
+    return true;
+}
+
+int ArcReadCachePolicy::Replace(uint64_t container_id) {
+    CHECK_RETURN(line_count_ > 0, -1, "Policy not started");
+
+    int line = -1;
+    map<uint64_t, pair<ghost_state, list<uint64_t>::iterator> >::iterator i = ghost_map_.find(container_id);
+    if (i != ghost_map_.end() && i->second.first == GHOST_B1) {
+        // T1 was too small
+        b1_hits_++;
+        uint32_t delta = (b1_.size() >= b2_.size()) ? 1 : (b2_.size() / b1_.size());
+        target_ = (target_ + delta > line_count_) ? line_count_ : target_ + delta;
+        b1_.erase(i->second.second);
+        ghost_map_.erase(i);
+
+        line = FreeLine(false);
+        CHECK_RETURN(line >= 0, -1, "Failed to free cache line");
+        Insert(line, LINE_T2, container_id);
+    } else if (i != ghost_map_.end()) {
+        // T2 was too small
+        b2_hits_++;
+        uint32_t delta = (b2_.size() >= b1_.size()) ? 1 : (b1_.size() / b2_.size());
+        target_ = (target_ > delta) ? target_ - delta : 0;
+        b2_.erase(i->second.second);
+        ghost_map_.erase(i);
+
+        line = FreeLine(true);
+        CHECK_RETURN(line >= 0, -1, "Failed to free cache line");
+        Insert(line, LINE_T2, container_id);
+    } else {
+        line = FreeLine(false);
+        CHECK_RETURN(line >= 0, -1, "Failed to free cache line");
+        Insert(line, LINE_T1, container_id);
+    }
+
+    // bound the ghost lists: |T1| + |B1| <= c, |T1| + |T2| + |B1| + |B2| <= 2c
+    while (t1_.size() + b1_.size() > line_count_ && !b1_.empty()) {
+        RemoveOldestGhost(GHOST_B1);
+    }
+    while (t1_.size() + t2_.size() + b1_.size() + b2_.size() > 2 * line_count_ && !b2_.empty()) {
+        RemoveOldestGhost(GHOST_B2);
+    }
+    return line;
+}
+
+bool ArcReadCachePolicy::Remove(int line) {
+    DCHECK(line >= 0 && line < line_state_.size(), "Illegal cache line: " << line);
+    Unlink(line);
+    line_position_[line] = free_list_.insert(free_list_.begin(), line);
+    line_state_[line] = LINE_FREE;
+    return true;
+}
+
+string ArcReadCachePolicy::PrintStatistics() {
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"type\": \"arc\"," << std::endl;
+    sstr << "\"target t1 size\": " << target_ << "," << std::endl;
+    sstr << "\"t1 size\": " << t1_.size() << "," << std::endl;
+    sstr << "\"t2 size\": " << t2_.size() << "," << std::endl;
+    sstr << "\"b1 size\": " << b1_.size() << "," << std::endl;
+    sstr << "\"b2 size\": " << b2_.size() << "," << std::endl;
+    sstr << "\"b1 ghost hits\": " << b1_hits_ << "," << std::endl;
+    sstr << "\"b2 ghost hits\": " << b2_hits_ << "," << std::endl;
+    sstr << "\"evictions\": " << evictions_ << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+}
+}
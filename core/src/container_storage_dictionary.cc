@@ -0,0 +1,191 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <core/container_storage_dictionary.h>
+
+#include <sstream>
+
+#include <dedupv1.pb.h>
+
+#include <base/logging.h>
+#include <base/strutil.h>
+
+using std::string;
+using std::stringstream;
+using std::vector;
+using dedupv1::base::Compression;
+using dedupv1::base::lookup_result;
+using dedupv1::base::LOOKUP_ERROR;
+using dedupv1::base::LOOKUP_FOUND;
+using dedupv1::base::strutil::To;
+using dedupv1::base::strutil::ToStorageUnit;
+using tbb::spin_mutex;
+
+LOGGER("ContainerStorageCompressionDictionary");
+
+namespace dedupv1 {
+namespace chunkstore {
+
+ContainerStorageCompressionDictionary::Statistics::Statistics() {
+    samples_ = 0;
+    trainings_ = 0;
+    failed_trainings_ = 0;
+}
+
+ContainerStorageCompressionDictionary::ContainerStorageCompressionDictionary() {
+    info_store_ = NULL;
+    dictionary_size_ = kDefaultDictionarySize;
+    sample_count_ = kDefaultSampleCount;
+    level_ = Compression::kDefaultZstdLevel;
+    training_triggered_ = false;
+    compression_ = NULL;
+    dictionary_id_ = 0;
+    started_ = false;
+}
+
+ContainerStorageCompressionDictionary::~ContainerStorageCompressionDictionary() {
+    Compression* compression = compression_;
+    if (compression) {
+        delete compression;
+        compression_ = NULL;
+    }
+}
+
+bool ContainerStorageCompressionDictionary::SetOption(const string& option_name, const string& option) {
+    CHECK(!started_, "Compression dictionary already started");
+    if (option_name == "size") {
+        CHECK(ToStorageUnit(option).valid(), "Illegal option " << option);
+        CHECK(ToStorageUnit(option).value() > 0, "Illegal dictionary size " << option);
+        dictionary_size_ = ToStorageUnit(option).value();
+        return true;
+    }
+    if (option_name == "sample-count") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        CHECK(To<uint32_t>(option).value() > 0, "Illegal sample count " << option);
+        sample_count_ = To<uint32_t>(option).value();
+        return true;
+    }
+    ERROR("Illegal option: " << option_name);
+    return false;
+}
+
+bool ContainerStorageCompressionDictionary::SetDictionary(const string& dictionary) {
+    Compression* compression = Compression::NewZstdCompression(level_, dictionary);
+    CHECK(compression, "Failed to create dictionary compression");
+    dictionary_id_ = Compression::GetZstdDictionaryId(dictionary);
+    compression_ = compression;
+    return true;
+}
+
+bool ContainerStorageCompressionDictionary::Start(dedupv1::InfoStore* info_store, int level) {
+    CHECK(!started_, "Compression dictionary already started");
+    CHECK(info_store, "Info store not set");
+    info_store_ = info_store;
+    level_ = level;
+
+    CompressionDictionaryData dictionary_data;
+    lookup_result lr = info_store_->RestoreInfo("container-storage.compression-dictionary", &dictionary_data);
+    CHECK(lr != LOOKUP_ERROR, "Failed to restore compression dictionary");
+    if (lr == LOOKUP_FOUND) {
+        CHECK(SetDictionary(dictionary_data.dictionary()), "Failed to set restored dictionary");
+        CHECK(dictionary_id_ == dictionary_data.dictionary_id(), "Illegal dictionary id: " <<
+            "restored dictionary id " << dictionary_id_ <<
+            ", expected dictionary id " << dictionary_data.dictionary_id());
+        training_triggered_ = true;
+        DEBUG("Restored compression dictionary: dictionary id " << dictionary_id_ <<
+            ", size " << dictionary_data.dictionary().size());
+    }
+    started_ = true;
+    return true;
+}
+
+bool ContainerStorageCompressionDictionary::AddSample(const void* data, size_t data_size) {
+    if (training_triggered_ || data_size == 0) {
+        return false;
+    }
+    size_t sample_size = data_size > kMaxSampleSize ? kMaxSampleSize : data_size;
+
+    spin_mutex::scoped_lock scoped_lock(sample_lock_);
+    if (training_triggered_) {
+        return false;
+    }
+    if (sample_sizes_.empty()) {
+        // reserved with the first sample as the dictionary may be started without training
+        samples_.reserve(sample_count_ * kMaxSampleSize);
+        sample_sizes_.reserve(sample_count_);
+    }
+    samples_.append(static_cast<const char*>(data), sample_size);
+    sample_sizes_.push_back(sample_size);
+    stats_.samples_++;
+    if (sample_sizes_.size() < sample_count_) {
+        return false;
+    }
+    training_triggered_ = true;
+    return true;
+}
+
+bool ContainerStorageCompressionDictionary::Train() {
+    CHECK(started_, "Compression dictionary not started");
+    CHECK(compression_ == NULL, "Compression dictionary already trained");
+
+    string samples;
+    vector<size_t> sample_sizes;
+    spin_mutex::scoped_lock scoped_lock(sample_lock_);
+    samples.swap(samples_);
+    sample_sizes.swap(sample_sizes_);
+    scoped_lock.release();
+
+    stats_.trainings_++;
+    string dictionary;
+    if (!Compression::TrainZstdDictionary(samples, sample_sizes, dictionary_size_, &dictionary)) {
+        // e.g. if the samples are not diverse enough. The items are compressed without a dictionary.
+        WARNING("Failed to train compression dictionary: samples " << sample_sizes.size());
+        stats_.failed_trainings_++;
+        return false;
+    }
+
+    // the dictionary has to be persisted before it is used. Otherwise, the items
+    // would not be readable after a crash
+    CompressionDictionaryData dictionary_data;
+    dictionary_data.set_dictionary(dictionary);
+    dictionary_data.set_dictionary_id(Compression::GetZstdDictionaryId(dictionary));
+    CHECK(info_store_->PersistInfo("container-storage.compression-dictionary", dictionary_data),
+        "Failed to persist compression dictionary: dictionary id " << dictionary_data.dictionary_id());
+    CHECK(SetDictionary(dictionary), "Failed to set trained dictionary");
+
+    INFO("Trained compression dictionary: dictionary id " << dictionary_id_ <<
+        ", size " << dictionary.size() <<
+        ", samples " << sample_sizes.size());
+    return true;
+}
+
+string ContainerStorageCompressionDictionary::PrintStatistics() {
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"dictionary id\": " << dictionary_id_ << "," << std::endl;
+    sstr << "\"samples\": " << stats_.samples_ << "," << std::endl;
+    sstr << "\"trainings\": " << stats_.trainings_ << "," << std::endl;
+    sstr << "\"failed trainings\": " << stats_.failed_trainings_ << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+}
+}
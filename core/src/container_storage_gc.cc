@@ -70,6 +70,10 @@ bool ContainerGCStrategy::Start(const StartContext& start_context, ContainerStor
     return true;
 }
 
+bool ContainerGCStrategy::Run() {
+    return true;
+}
+
 bool ContainerGCStrategy::Stop(const dedupv1::StopContext& stop_context) {
     return true;
 }
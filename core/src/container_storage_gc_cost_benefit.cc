@@ -0,0 +1,692 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <core/container_storage_gc_cost_benefit.h>
+
+#include <time.h>
+
+#include <sstream>
+#include <algorithm>
+
+#include <core/dedup.h>
+#include <base/logging.h>
+#include <base/runnable.h>
+#include <base/strutil.h>
+#include <base/memory.h>
+#include <base/fault_injection.h>
+#include <core/container.h>
+#include <core/container_storage.h>
+
+#include "dedupv1.pb.h"
+
+using std::string;
+using std::pair;
+using std::list;
+using std::map;
+using std::vector;
+using std::make_pair;
+using std::stringstream;
+using dedupv1::base::strutil::To;
+using dedupv1::base::strutil::ToStorageUnit;
+using dedupv1::base::ScopedLock;
+using dedupv1::base::NewRunnable;
+using dedupv1::base::lookup_result;
+using dedupv1::base::LOOKUP_ERROR;
+using dedupv1::base::LOOKUP_FOUND;
+using dedupv1::base::LOOKUP_NOT_FOUND;
+using dedupv1::base::PUT_ERROR;
+using dedupv1::base::DELETE_ERROR;
+using dedupv1::base::Index;
+using dedupv1::base::IndexIterator;
+using dedupv1::base::ScopedPtr;
+using dedupv1::base::Option;
+using dedupv1::base::make_option;
+using dedupv1::base::ProfileTimer;
+using dedupv1::base::timed_bool;
+using dedupv1::base::TIMED_FALSE;
+
+LOGGER("ContainerGC");
+
+namespace dedupv1 {
+namespace chunkstore {
+
+namespace {
+
+bool CompareByActiveDataSizeDesc(const ContainerCostBenefitGCCandidateData& a,
+        const ContainerCostBenefitGCCandidateData& b) {
+    return a.active_data_size() > b.active_data_size();
+}
+
+bool CompareByAddress(const ContainerCostBenefitGCCandidateData& a,
+        const ContainerCostBenefitGCCandidateData& b) {
+    return a.address() < b.address();
+}
+
+}
+
+void CostBenefitContainerGCStrategy::RegisterGC() {
+    ContainerGCStrategyFactory::GetFactory()->Register("cost-benefit", &CostBenefitContainerGCStrategy::CreateGC);
+}
+
+ContainerGCStrategy* CostBenefitContainerGCStrategy::CreateGC() {
+    return new CostBenefitContainerGCStrategy();
+}
+
+CostBenefitContainerGCStrategy::Statistics::Statistics() {
+    pass_count_ = 0;
+    pressure_pass_count_ = 0;
+    merge_count_ = 0;
+    delete_count_ = 0;
+    aborted_count_ = 0;
+    reclaimed_count_ = 0;
+    copied_bytes_ = 0;
+}
+
+CostBenefitContainerGCStrategy::CostBenefitContainerGCStrategy() : touched_set_(0),
+    gc_thread_(NewRunnable(this, &CostBenefitContainerGCStrategy::GCLoop), "container gc") {
+    this->storage_ = NULL;
+    this->container_size_ = 0;
+    this->container_data_size_ = 0;
+    this->merge_candidates_ = NULL;
+    this->merge_candidate_data_size_threshold_ = 0;
+    this->merge_candidate_item_count_threshold_ = 0;
+    this->max_merge_count_ = kDefaultMaxMergeCount;
+    this->io_budget_ = 0;
+    this->interval_ = kDefaultInterval;
+    this->eviction_timeout_ = 5;
+    this->readonly_ = false;
+    this->state_ = CREATED;
+}
+
+CostBenefitContainerGCStrategy::~CostBenefitContainerGCStrategy() {
+    DEBUG("Closing cost-benefit container storage gc");
+    if (this->merge_candidates_) {
+        delete merge_candidates_;
+        this->merge_candidates_ = NULL;
+    }
+}
+
+bool CostBenefitContainerGCStrategy::SetOption(const string& option_name, const string& option) {
+    CHECK(this->state_ == CREATED, "GC already started");
+    if (option_name == "type") {
+        Index* index = Index::Factory().Create(option);
+        CHECK(index, "Index creation failed: " << option);
+        CHECK(index->IsPersistent(), "Index not persistent");
+        this->merge_candidates_ = index->AsPersistentIndex();
+        CHECK(this->merge_candidates_->SetOption("max-key-size", "8"), "Failed to set max key size");
+        return true;
+    }
+    if (option_name == "threshold") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        this->merge_candidate_data_size_threshold_ = To<uint32_t>(option).value();
+        return true;
+    }
+    if (option_name == "item-count-threshold") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        this->merge_candidate_item_count_threshold_ = To<uint32_t>(option).value();
+        return true;
+    }
+    if (option_name == "max-merge-count") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        CHECK(To<uint32_t>(option).value() >= 2, "Illegal max merge count: " << option);
+        this->max_merge_count_ = To<uint32_t>(option).value();
+        return true;
+    }
+    if (option_name == "io-budget") {
+        Option<int64_t> io_budget = ToStorageUnit(option);
+        CHECK(io_budget.valid(), "Illegal option " << option);
+        CHECK(io_budget.value() >= 0, "Illegal io budget: " << option);
+        this->io_budget_ = io_budget.value();
+        return true;
+    }
+    if (option_name == "interval") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        CHECK(To<uint32_t>(option).value() > 0, "Illegal interval: " << option);
+        this->interval_ = To<uint32_t>(option).value();
+        return true;
+    }
+    if (option_name == "eviction-timeout") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        this->eviction_timeout_ = To<uint32_t>(option).value();
+        return true;
+    }
+    CHECK(this->merge_candidates_, "Merge candidate index not set");
+    CHECK(this->merge_candidates_->SetOption(option_name, option), "Configuration failed: " << option_name << " - " << option);
+    return true;
+}
+
+bool CostBenefitContainerGCStrategy::Start(const StartContext& start_context, ContainerStorage* storage) {
+    CHECK(this->state_ == CREATED, "GC already started");
+    CHECK(this->merge_candidates_, "GC not configured");
+    CHECK(storage, "Storage not set");
+
+    DEBUG("Starting cost-benefit container storage gc");
+
+    touched_set_.SetSeconds(this->eviction_timeout_);
+
+    this->storage_ = storage;
+    this->readonly_ = start_context.readonly();
+    container_size_ = storage->GetContainerSize();
+    container_data_size_ = storage->GetContainerSize() - Container::kMetaDataSize;
+
+    if (merge_candidate_data_size_threshold_ == 0) {
+        this->merge_candidate_data_size_threshold_ = (0.40 * container_data_size_);
+    } else {
+        CHECK(merge_candidate_data_size_threshold_ < container_size_,
+            "Illegal threshold: threshold " << merge_candidate_data_size_threshold_ <<
+            ", container size " << container_size_);
+    }
+
+    if (this->merge_candidate_item_count_threshold_ == 0) {
+        this->merge_candidate_item_count_threshold_ = storage->GetMaxItemsPerContainer() * 0.4;
+    }
+
+    CHECK(this->merge_candidates_->Start(start_context), "Cannot start merge candidate index");
+    CHECK(this->merge_candidates_->HasCapability(dedupv1::base::HAS_ITERATOR),
+        "Merge candidate index has no iterator support");
+
+    // load the merge candidates into memory
+    IndexIterator* i = this->merge_candidates_->CreateIterator();
+    CHECK(i, "Failed to create merge candidate iterator");
+    ScopedPtr<IndexIterator> scoped_iterator(i);
+
+    ContainerCostBenefitGCCandidateData candidate_data;
+    lookup_result lr = i->Next(NULL, NULL, &candidate_data);
+    for (; lr == LOOKUP_FOUND; lr = i->Next(NULL, NULL, &candidate_data)) {
+        candidates_[candidate_data.address()] = candidate_data;
+    }
+    CHECK(lr != LOOKUP_ERROR, "Failed to iterate merge candidates");
+    DEBUG("Loaded merge candidates: count " << candidates_.size());
+
+    this->state_ = STARTED;
+    return true;
+}
+
+bool CostBenefitContainerGCStrategy::Run() {
+    CHECK(this->state_ == STARTED, "Illegal state: " << this->state_);
+
+    this->state_ = RUNNING;
+    if (!readonly_) {
+        CHECK(this->gc_thread_.Start(), "Cannot start gc thread");
+    }
+    return true;
+}
+
+bool CostBenefitContainerGCStrategy::Stop(const dedupv1::StopContext& stop_context) {
+    enum state old_state = this->state_.fetch_and_store(STOPPED);
+    if (old_state == RUNNING && !readonly_) {
+        DEBUG("Stopping cost-benefit container storage gc");
+        if (!this->thread_condition_.Broadcast()) {
+            WARNING("Failed to broadcast gc state change");
+        }
+        bool result = false;
+        CHECK(this->gc_thread_.Join(&result), "Cannot join gc thread");
+        if (!result) {
+            WARNING("gc thread finished with error");
+        }
+    }
+    return true;
+}
+
+bool CostBenefitContainerGCStrategy::GCLoop() {
+    DEBUG("Starting gc thread");
+
+    ScopedLock scoped_lock(&this->thread_lock_);
+    CHECK(scoped_lock.AcquireLock(), "Failed to acquire gc thread lock");
+
+    uint32_t waiting_time = interval_;
+    while (state_ == RUNNING) {
+        TRACE("GC waiting time: " << waiting_time << "s");
+        timed_bool tb = thread_condition_.ConditionWaitTimeout(&thread_lock_, waiting_time);
+        CHECK(tb != TIMED_FALSE, "Failed to wait for gc signal");
+        if (state_ != RUNNING) {
+            break;
+        }
+
+        uint64_t copied_bytes = 0;
+        uint32_t reclaimed_count = 0;
+        ScopedLock pass_scoped_lock(&this->pass_lock_);
+        CHECK(pass_scoped_lock.AcquireLock(), "Failed to acquire gc pass lock");
+        if (!ProcessMergeCandidates(&copied_bytes, &reclaimed_count)) {
+            WARNING("Failed to process merge candidates");
+        }
+        CHECK(pass_scoped_lock.ReleaseLock(), "Failed to release gc pass lock");
+
+        // throttle the gc so that the copied data is within the io budget
+        waiting_time = interval_;
+        if (io_budget_ > 0 && (copied_bytes / io_budget_) > waiting_time) {
+            waiting_time = copied_bytes / io_budget_;
+        }
+        if (waiting_time > kMaxWaitingTime) {
+            waiting_time = kMaxWaitingTime;
+        }
+    }
+    DEBUG("Exiting gc thread: state " << state_);
+    return true;
+}
+
+double CostBenefitContainerGCStrategy::GetScore(const ContainerCostBenefitGCCandidateData& candidate, uint64_t now) {
+    double utilization = 1.0;
+    if (container_data_size_ > 0) {
+        utilization = static_cast<double>(candidate.active_data_size()) / container_data_size_;
+    }
+    if (utilization > 1.0) {
+        utilization = 1.0;
+    }
+    uint64_t age = 0;
+    if (now > candidate.change_time()) {
+        age = now - candidate.change_time();
+    }
+    // free space * age / cost, where the cost is reading the container and
+    // writing the still used data. The age is shifted by one so that
+    // fresh containers are still ordered by their free space.
+    return ((1.0 - utilization) * (age + 1)) / (1.0 + utilization);
+}
+
+list<vector<ContainerCostBenefitGCCandidateData> > CostBenefitContainerGCStrategy::PackCandidates(
+        vector<ContainerCostBenefitGCCandidateData> candidates) {
+    std::sort(candidates.begin(), candidates.end(), CompareByActiveDataSizeDesc);
+
+    vector<vector<ContainerCostBenefitGCCandidateData> > groups;
+    vector<uint64_t> group_data_size;
+    vector<uint32_t> group_item_count;
+    uint32_t max_item_count = storage_->GetMaxItemsPerContainer();
+
+    // first fit decreasing
+    vector<ContainerCostBenefitGCCandidateData>::const_iterator i;
+    for (i = candidates.begin(); i != candidates.end(); i++) {
+        size_t j = 0;
+        for (; j < groups.size(); j++) {
+            if (group_data_size[j] + i->active_data_size() < container_data_size_ &&
+                group_item_count[j] + i->active_item_count() < max_item_count) {
+                break;
+            }
+        }
+        if (j == groups.size()) {
+            groups.push_back(vector<ContainerCostBenefitGCCandidateData>());
+            group_data_size.push_back(0);
+            group_item_count.push_back(0);
+        }
+        groups[j].push_back(*i);
+        group_data_size[j] += i->active_data_size();
+        group_item_count[j] += i->active_item_count();
+    }
+
+    list<vector<ContainerCostBenefitGCCandidateData> > result;
+    for (size_t j = 0; j < groups.size(); j++) {
+        if (groups[j].size() < 2) {
+            // nothing to gain
+            continue;
+        }
+        std::sort(groups[j].begin(), groups[j].end(), CompareByAddress);
+        result.push_back(groups[j]);
+    }
+    return result;
+}
+
+Option<bool> CostBenefitContainerGCStrategy::CheckIfPrimaryContainerId(uint64_t container_id) {
+    pair<lookup_result, uint64_t> r = GetPrimaryContainerId(container_id);
+    CHECK(r.first != LOOKUP_ERROR, "Lookup of container address failed: " << container_id);
+    if (r.first == LOOKUP_NOT_FOUND) {
+        return make_option(false);
+    }
+    return make_option(r.second == container_id);
+}
+
+pair<lookup_result, uint64_t> CostBenefitContainerGCStrategy::GetPrimaryContainerId(uint64_t container_id) {
+    CHECK_RETURN(storage_, make_pair(LOOKUP_ERROR, 0), "Storage not set");
+
+    pair<lookup_result, ContainerStorageAddressData> address_data =
+        storage_->LookupContainerAddress(container_id, NULL, false);
+    if (address_data.first != LOOKUP_FOUND) {
+        return make_pair(address_data.first, 0);
+    }
+    if (address_data.second.has_primary_id()) {
+        return make_pair(LOOKUP_FOUND, address_data.second.primary_id());
+    }
+    return make_pair(LOOKUP_FOUND, container_id);
+}
+
+bool CostBenefitContainerGCStrategy::PutCandidate(uint64_t container_id, uint32_t item_count, uint32_t active_data_size) {
+    ContainerCostBenefitGCCandidateData candidate_data;
+    candidate_data.set_address(container_id);
+    candidate_data.set_active_data_size(active_data_size);
+    candidate_data.set_active_item_count(item_count);
+    candidate_data.set_change_time(time(NULL));
+
+    CHECK(merge_candidates_->Put(&container_id, sizeof(container_id), candidate_data) != PUT_ERROR,
+        "Cannot store merge candidate data: " << candidate_data.ShortDebugString());
+    candidates_[container_id] = candidate_data;
+    return true;
+}
+
+bool CostBenefitContainerGCStrategy::DeleteCandidate(uint64_t container_id) {
+    map<uint64_t, ContainerCostBenefitGCCandidateData>::iterator i = candidates_.find(container_id);
+    if (i == candidates_.end()) {
+        return true;
+    }
+    candidates_.erase(i);
+    CHECK(merge_candidates_->Delete(&container_id, sizeof(container_id)) != DELETE_ERROR,
+        "Failed to delete merge candidate data: container id " << container_id);
+    return true;
+}
+
+bool CostBenefitContainerGCStrategy::ProcessCommit(uint64_t primary_container_id, uint32_t item_count, uint32_t active_data_size) {
+    ScopedLock scoped_lock(&this->lock_);
+    CHECK(scoped_lock.AcquireLock(), "Failed to acquire gc lock");
+
+    TRACE("Process commit: " <<
+        "container id " << primary_container_id <<
+        ", item count " << item_count <<
+        ", active data size " << active_data_size);
+
+    if (active_data_size > this->merge_candidate_data_size_threshold_ ||
+        item_count > this->merge_candidate_item_count_threshold_) {
+        TRACE("Container is no merge candidate: container id " << primary_container_id <<
+            ", threshold " << this->merge_candidate_data_size_threshold_ <<
+            ", item threshold " << this->merge_candidate_item_count_threshold_);
+        return DeleteCandidate(primary_container_id);
+    }
+
+    if (this->eviction_timeout_ > 0) {
+        touched_set_.Insert(primary_container_id);
+    }
+    return PutCandidate(primary_container_id, item_count, active_data_size);
+}
+
+bool CostBenefitContainerGCStrategy::OnCommit(const ContainerCommittedEventData& data) {
+    ProfileTimer gc_timer(this->stats_.gc_time_);
+
+    CHECK(this->state_ == STARTED || this->state_ == RUNNING, "GC not started");
+    return ProcessCommit(data.container_id(), data.item_count(), data.active_data_size());
+}
+
+bool CostBenefitContainerGCStrategy::OnMove(const ContainerMoveEventData& data) {
+    ProfileTimer gc_timer(this->stats_.gc_time_);
+
+    CHECK(this->state_ == STARTED || this->state_ == RUNNING, "GC not started");
+    if (this->storage_->IsCommitted(data.container_id()) != STORAGE_ADDRESS_COMMITED) {
+        return true; // the commit event will report the container
+    }
+    return ProcessCommit(data.container_id(), data.item_count(), data.active_data_size());
+}
+
+bool CostBenefitContainerGCStrategy::OnMerge(const ContainerMergedEventData& data) {
+    ProfileTimer gc_timer(this->stats_.gc_time_);
+
+    CHECK(this->state_ == STARTED || this->state_ == RUNNING, "GC not started");
+    {
+        ScopedLock scoped_lock(&this->lock_);
+        CHECK(scoped_lock.AcquireLock(), "Failed to acquire gc lock");
+
+        // the old containers are gone
+        if (data.first_id() != data.new_primary_id()) {
+            CHECK(DeleteCandidate(data.first_id()), "Failed to delete merge candidate: " << data.ShortDebugString());
+        }
+        if (data.second_id() != data.new_primary_id()) {
+            CHECK(DeleteCandidate(data.second_id()), "Failed to delete merge candidate: " << data.ShortDebugString());
+        }
+    }
+    return ProcessCommit(data.new_primary_id(), data.new_item_count(), data.new_active_data_size());
+}
+
+bool CostBenefitContainerGCStrategy::OnDeleteContainer(const Container& container) {
+    ScopedLock scoped_lock(&this->lock_);
+    CHECK(scoped_lock.AcquireLock(), "Failed to acquire gc lock");
+
+    return DeleteCandidate(container.primary_id());
+}
+
+bool CostBenefitContainerGCStrategy::OnRead(const Container& container, const void* key, size_t key_size) {
+    return true;
+}
+
+bool CostBenefitContainerGCStrategy::ProcessMergeCandidates(uint64_t* copied_bytes, uint32_t* reclaimed_count) {
+    DCHECK(copied_bytes, "Copied bytes not set");
+    DCHECK(reclaimed_count, "Reclaimed count not set");
+    FAULT_POINT("container-storage.gc.process.pre");
+
+    ProfileTimer gc_timer(this->stats_.gc_time_);
+    ScopedLock scoped_lock(&this->lock_);
+    CHECK(scoped_lock.AcquireLock(), "Failed to acquire gc lock");
+    CHECK(this->merge_candidates_, "Merge candidates not set");
+
+    this->stats_.pass_count_++;
+
+    // rank all candidates that have not been touched recently
+    uint64_t now = time(NULL);
+    vector<pair<double, uint64_t> > ranking;
+    map<uint64_t, ContainerCostBenefitGCCandidateData>::const_iterator c;
+    for (c = candidates_.begin(); c != candidates_.end(); c++) {
+        if (this->eviction_timeout_ > 0 && touched_set_.Contains(c->first)) {
+            continue;
+        }
+        ranking.push_back(make_pair(GetScore(c->second, now), c->first));
+    }
+    std::sort(ranking.rbegin(), ranking.rend());
+
+    vector<ContainerCostBenefitGCCandidateData> selected_items;
+    list<ContainerCostBenefitGCCandidateData> delete_items;
+    vector<pair<double, uint64_t> >::const_iterator r;
+    for (r = ranking.begin(); r != ranking.end() && selected_items.size() < max_merge_count_; r++) {
+        ContainerCostBenefitGCCandidateData item_data = candidates_[r->second];
+
+        Option<bool> check_result = CheckIfPrimaryContainerId(item_data.address());
+        CHECK(check_result.valid(),
+            "Failed to check of container id is primary: container id " << item_data.address());
+        if (!check_result.value()) {
+            TRACE("container id is either already deleted or not primary: " <<
+                "item " << item_data.ShortDebugString());
+            CHECK(DeleteCandidate(item_data.address()), "Failed to delete merge candidate: " << item_data.ShortDebugString());
+            continue;
+        }
+        if (item_data.active_data_size() == 0 && item_data.active_item_count() == 0) {
+            delete_items.push_back(item_data);
+        } else {
+            selected_items.push_back(item_data);
+        }
+    }
+
+    list<vector<ContainerCostBenefitGCCandidateData> > groups = PackCandidates(selected_items);
+
+    // remove the items from the candidates before the merge as the worst thing that can happen
+    // is to "lose" a merge candidate.
+    list<ContainerCostBenefitGCCandidateData>::const_iterator d;
+    for (d = delete_items.begin(); d != delete_items.end(); d++) {
+        CHECK(DeleteCandidate(d->address()), "Failed to delete merge candidate: " << d->ShortDebugString());
+    }
+    list<vector<ContainerCostBenefitGCCandidateData> >::const_iterator g;
+    for (g = groups.begin(); g != groups.end(); g++) {
+        vector<ContainerCostBenefitGCCandidateData>::const_iterator i;
+        for (i = g->begin(); i != g->end(); i++) {
+            CHECK(DeleteCandidate(i->address()), "Failed to delete merge candidate: " << i->ShortDebugString());
+        }
+    }
+
+    // release lock to avoid deadlock
+    CHECK(scoped_lock.ReleaseLock(), "Failed to release gc lock");
+
+    for (d = delete_items.begin(); d != delete_items.end(); d++) {
+        DEBUG("Found delete candidate " << d->ShortDebugString());
+
+        FAULT_POINT("container-storage.gc.process.before-container-delete");
+        bool aborted = false;
+        CHECK(storage_->TryDeleteContainer(d->address(), &aborted),
+            "Failed to delete container " << d->address() <<
+            ", data of container " << d->ShortDebugString());
+        if (aborted) {
+            DEBUG("Aborted to delete container " << d->address() <<
+                ", data of container " << d->ShortDebugString());
+            this->stats_.aborted_count_++;
+            CHECK(ProcessCommit(d->address(), d->active_item_count(), d->active_data_size()),
+                "Failed to re-add merge candidate: " << d->ShortDebugString());
+        } else {
+            this->stats_.delete_count_++;
+            this->stats_.reclaimed_count_++;
+            (*reclaimed_count)++;
+        }
+    }
+    CHECK(MergeGroups(groups, copied_bytes, reclaimed_count), "Failed to merge container groups");
+    FAULT_POINT("container-storage.gc.process.post");
+    return true;
+}
+
+bool CostBenefitContainerGCStrategy::MergeGroups(const list<vector<ContainerCostBenefitGCCandidateData> >& groups,
+        uint64_t* copied_bytes, uint32_t* reclaimed_count) {
+    // per group: the current (merged) container id and the index of the next container to merge into it.
+    // A group is finished when the next index reaches the group size.
+    vector<const vector<ContainerCostBenefitGCCandidateData>*> group_list;
+    vector<uint64_t> container_ids;
+    vector<size_t> next_index;
+    list<vector<ContainerCostBenefitGCCandidateData> >::const_iterator g;
+    for (g = groups.begin(); g != groups.end(); g++) {
+        DCHECK(g->size() >= 2, "Illegal group size: " << g->size());
+        group_list.push_back(&(*g));
+        container_ids.push_back((*g)[0].address());
+        next_index.push_back(1);
+    }
+
+    while (true) {
+        vector<pair<uint64_t, uint64_t> > merge_list;
+        vector<size_t> merge_groups;
+        for (size_t k = 0; k < group_list.size(); k++) {
+            if (next_index[k] < group_list[k]->size()) {
+                const ContainerCostBenefitGCCandidateData& item = (*group_list[k])[next_index[k]];
+                DEBUG("Merge container " << container_ids[k] << " with " << item.ShortDebugString());
+                merge_list.push_back(make_pair(container_ids[k], item.address()));
+                merge_groups.push_back(k);
+            }
+        }
+        if (merge_list.empty()) {
+            break;
+        }
+
+        FAULT_POINT("container-storage.gc.process.before-container-merge");
+        vector<bool> aborted_list;
+        CHECK(storage_->TryMergeContainers(merge_list, &aborted_list),
+            "Failed to merge containers: " << merge_list.size() << " merges");
+        CHECK(aborted_list.size() == merge_list.size(), "Illegal aborted list size: " << aborted_list.size());
+
+        for (size_t m = 0; m < merge_list.size(); m++) {
+            size_t k = merge_groups[m];
+            const vector<ContainerCostBenefitGCCandidateData>& group(*group_list[k]);
+            size_t i = next_index[k];
+            bool aborted = aborted_list[m];
+
+            pair<lookup_result, uint64_t> r(LOOKUP_NOT_FOUND, 0);
+            if (!aborted) {
+                this->stats_.merge_count_++;
+                this->stats_.reclaimed_count_++;
+                (*reclaimed_count)++;
+                // both containers are read and the merged container is written
+                (*copied_bytes) += 3 * container_size_;
+                this->stats_.copied_bytes_ += 3 * container_size_;
+
+                // the primary id of the merged container is the smallest id of the still used items, which is not
+                // necessarily one of the merged primary ids.
+                r = GetPrimaryContainerId(container_ids[k]);
+                if (r.first == LOOKUP_NOT_FOUND) {
+                    r = GetPrimaryContainerId(group[i].address());
+                }
+                CHECK(r.first != LOOKUP_ERROR, "Failed to lookup merged container: container id " << container_ids[k]);
+            } else {
+                DEBUG("Aborted to merge container " << container_ids[k] <<
+                    ", container " << group[i].address());
+                this->stats_.aborted_count_++;
+            }
+
+            if (r.first == LOOKUP_NOT_FOUND) {
+                // the chain is broken, put the remaining containers back as candidates. An already merged
+                // container has been reported by the merge event.
+                size_t first_index = i + 1;
+                if (aborted) {
+                    first_index = (i == 1) ? 0 : i;
+                }
+                for (size_t j = first_index; j < group.size(); j++) {
+                    CHECK(ProcessCommit(group[j].address(), group[j].active_item_count(), group[j].active_data_size()),
+                        "Failed to re-add merge candidate: " << group[j].ShortDebugString());
+                }
+                next_index[k] = group.size();
+                continue;
+            }
+            container_ids[k] = r.second;
+            next_index[k] = i + 1;
+        }
+    }
+    return true;
+}
+
+bool CostBenefitContainerGCStrategy::OnStoragePressure() {
+    CHECK(this->state_ == STARTED || this->state_ == RUNNING, "GC not started");
+
+    ScopedLock pass_scoped_lock(&this->pass_lock_);
+    CHECK(pass_scoped_lock.AcquireLock(), "Failed to acquire gc pass lock");
+
+    for (uint32_t i = 0; i < kMaxPressurePassCount; i++) {
+        uint64_t copied_bytes = 0;
+        uint32_t reclaimed_count = 0;
+        this->stats_.pressure_pass_count_++;
+        CHECK(ProcessMergeCandidates(&copied_bytes, &reclaimed_count),
+            "Failed to process merge candidates");
+        if (reclaimed_count == 0) {
+            break;
+        }
+    }
+    return true;
+}
+
+string CostBenefitContainerGCStrategy::PrintStatistics() {
+    stringstream sstr;
+    sstr << "{";
+    if (merge_candidates_) {
+        sstr << "\"merge candidate count\": " << merge_candidate_count() << "," << std::endl;
+    } else {
+        sstr << "\"merge candidate count\": null," << std::endl;
+    }
+    sstr << "\"pass count\": " << this->stats_.pass_count_ << "," << std::endl;
+    sstr << "\"pressure pass count\": " << this->stats_.pressure_pass_count_ << "," << std::endl;
+    sstr << "\"merge count\": " << this->stats_.merge_count_ << "," << std::endl;
+    sstr << "\"delete count\": " << this->stats_.delete_count_ << "," << std::endl;
+    sstr << "\"aborted count\": " << this->stats_.aborted_count_ << "," << std::endl;
+    sstr << "\"reclaimed container count\": " << this->stats_.reclaimed_count_ << "," << std::endl;
+    sstr << "\"copied bytes\": " << this->stats_.copied_bytes_ << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+string CostBenefitContainerGCStrategy::PrintProfile() {
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"gc time\": " << this->stats_.gc_time_.GetSum() << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+#ifdef DEDUPV1_CORE_TEST
+void CostBenefitContainerGCStrategy::ClearData() {
+    if (this->merge_candidates_) {
+        delete this->merge_candidates_;
+        this->merge_candidates_ = NULL;
+    }
+}
+#endif
+
+}
+}
@@ -0,0 +1,85 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <core/container_storage_group_sync.h>
+
+#include <base/logging.h>
+#include <base/timer.h>
+
+using dedupv1::base::File;
+using dedupv1::base::ScopedLock;
+using dedupv1::base::ProfileTimer;
+
+LOGGER("ContainerStorageGroupSync");
+
+namespace dedupv1 {
+namespace chunkstore {
+
+ContainerStorageGroupSync::Statistics::Statistics() {
+    syncs_ = 0;
+    synced_writes_ = 0;
+}
+
+ContainerStorageGroupSync::ContainerStorageGroupSync(File* file) {
+    file_ = file;
+    write_count_ = 0;
+    synced_count_ = 0;
+    sync_in_progress_ = false;
+}
+
+bool ContainerStorageGroupSync::SyncWrite() {
+    CHECK(file_, "File not set");
+
+    ScopedLock scoped_lock(&lock_);
+    CHECK(scoped_lock.AcquireLock(), "Failed to acquire group sync lock");
+
+    uint64_t ticket = ++write_count_;
+    while (synced_count_ < ticket) {
+        if (sync_in_progress_) {
+            // the running sync might not cover our write. We wait and check again
+            CHECK(sync_condition_.ConditionWait(&lock_), "Failed to wait for sync condition");
+            continue;
+        }
+        // we sync on behalf of all writes finished up to now
+        sync_in_progress_ = true;
+        uint64_t sync_target = write_count_;
+        CHECK(scoped_lock.ReleaseLock(), "Failed to release group sync lock");
+
+        bool sync_result = false;
+        {
+            ProfileTimer sync_timer(this->stats_.sync_time_);
+            sync_result = file_->DataSync();
+        }
+
+        CHECK(scoped_lock.AcquireLock(), "Failed to acquire group sync lock");
+        sync_in_progress_ = false;
+        if (sync_result) {
+            this->stats_.syncs_++;
+            this->stats_.synced_writes_ += (sync_target - synced_count_);
+            synced_count_ = sync_target;
+        }
+        CHECK(sync_condition_.Broadcast(), "Failed to broadcast sync condition");
+        CHECK(sync_result, "Failed to sync container file: " << file_->path());
+    }
+    return true;
+}
+
+}
+}
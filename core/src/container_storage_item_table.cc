@@ -0,0 +1,215 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <core/container_storage_item_table.h>
+
+#include <sstream>
+
+#include <base/logging.h>
+#include <base/strutil.h>
+#include <base/hashing_util.h>
+
+using std::string;
+using std::stringstream;
+using std::vector;
+using std::list;
+using std::map;
+using dedupv1::base::strutil::ToStorageUnit;
+using dedupv1::base::raw_compare;
+using dedupv1::base::LOOKUP_ERROR;
+using dedupv1::base::LOOKUP_NOT_FOUND;
+using dedupv1::base::LOOKUP_FOUND;
+using dedupv1::base::lookup_result;
+using tbb::spin_mutex;
+
+LOGGER("ContainerStorageItemTable");
+
+namespace dedupv1 {
+namespace chunkstore {
+
+ContainerStorageItemTableCache::Statistics::Statistics() {
+    hits_ = 0;
+    miss_ = 0;
+    stale_ = 0;
+    updates_ = 0;
+    evictions_ = 0;
+}
+
+ContainerStorageItemTableCache::ItemTable::ItemTable(uint32_t file_index, uint64_t file_offset) {
+    file_index_ = file_index;
+    file_offset_ = file_offset;
+    use_count_ = 0;
+}
+
+const ContainerItem* ContainerStorageItemTableCache::ItemTable::FindItem(const void* key, size_t key_size) const {
+    // binary search. The items are sorted by the key
+    size_t left = 0;
+    size_t right = items_.size();
+    while (left < right) {
+        size_t middle = left + ((right - left) / 2);
+        const ContainerItem& item = items_[middle];
+        int c = raw_compare(key, key_size, item.key(), item.key_size());
+        if (c == 0) {
+            return &item;
+        } else if (c < 0) {
+            right = middle;
+        } else {
+            left = middle + 1;
+        }
+    }
+    return NULL;
+}
+
+ContainerStorageItemTableCache::ContainerStorageItemTableCache() {
+    size_ = kDefaultSize;
+}
+
+ContainerStorageItemTableCache::~ContainerStorageItemTableCache() {
+    Clear();
+}
+
+bool ContainerStorageItemTableCache::SetOption(const string& option_name, const string& option) {
+    if (option_name == "size") {
+        CHECK(ToStorageUnit(option).valid(), "Illegal option " << option);
+        this->size_ = ToStorageUnit(option).value();
+        CHECK(this->size_ != 0, "Failed to set item table cache size: size must be larger than 0");
+        return true;
+    }
+    ERROR("Illegal option: " << option_name);
+    return false;
+}
+
+lookup_result ContainerStorageItemTableCache::Lookup(uint64_t container_id,
+                                                     uint32_t file_index,
+                                                     uint64_t file_offset,
+                                                     const vector<StorageReadRequest*>& requests,
+                                                     vector<ContainerItem>* items,
+                                                     uint32_t* use_count) {
+    DCHECK_RETURN(items, LOOKUP_ERROR, "Items not set");
+    DCHECK_RETURN(use_count, LOOKUP_ERROR, "Use count not set");
+
+    spin_mutex::scoped_lock scoped_lock(lock_);
+    map<uint64_t, ItemTable*>::iterator i = tables_.find(container_id);
+    if (i == tables_.end()) {
+        stats_.miss_++;
+        return LOOKUP_NOT_FOUND;
+    }
+    ItemTable* table = i->second;
+    if (table->file_index_ != file_index || table->file_offset_ != file_offset) {
+        // the container has been moved since the item table has been loaded
+        stats_.stale_++;
+        RemoveUnlocked(container_id);
+        return LOOKUP_NOT_FOUND;
+    }
+    size_t item_count = items->size();
+    vector<StorageReadRequest*>::const_iterator j;
+    for (j = requests.begin(); j != requests.end(); j++) {
+        const ContainerItem* item = table->FindItem((*j)->key(), (*j)->key_size());
+        if (item == NULL) {
+            // let the caller use the complete container
+            stats_.stale_++;
+            items->erase(items->begin() + item_count, items->end());
+            return LOOKUP_NOT_FOUND;
+        }
+        items->push_back(*item);
+    }
+    *use_count = table->use_count_;
+    table->use_count_++;
+
+    // move to the front of the lru list
+    lru_list_.splice(lru_list_.begin(), lru_list_, table->lru_position_);
+    stats_.hits_++;
+    return LOOKUP_FOUND;
+}
+
+bool ContainerStorageItemTableCache::Update(uint64_t container_id,
+                                            uint32_t file_index,
+                                            uint64_t file_offset,
+                                            const Container& container) {
+    ItemTable* table = new ItemTable(file_index, file_offset);
+    CHECK(table, "Failed to alloc item table");
+    table->items_.reserve(container.items().size());
+    vector<ContainerItem*>::const_iterator i;
+    for (i = container.items().begin(); i != container.items().end(); i++) {
+        const ContainerItem* item = *i;
+        if (item && !item->is_deleted()) {
+            table->items_.push_back(*item);
+        }
+    }
+
+    spin_mutex::scoped_lock scoped_lock(lock_);
+    RemoveUnlocked(container_id);
+    while (tables_.size() >= size_ && !lru_list_.empty()) {
+        RemoveUnlocked(lru_list_.back());
+        stats_.evictions_++;
+    }
+    lru_list_.push_front(container_id);
+    table->lru_position_ = lru_list_.begin();
+    tables_[container_id] = table;
+    stats_.updates_++;
+    return true;
+}
+
+void ContainerStorageItemTableCache::RemoveUnlocked(uint64_t container_id) {
+    map<uint64_t, ItemTable*>::iterator i = tables_.find(container_id);
+    if (i == tables_.end()) {
+        return;
+    }
+    ItemTable* table = i->second;
+    lru_list_.erase(table->lru_position_);
+    tables_.erase(i);
+    delete table;
+}
+
+void ContainerStorageItemTableCache::Remove(uint64_t container_id) {
+    spin_mutex::scoped_lock scoped_lock(lock_);
+    RemoveUnlocked(container_id);
+}
+
+void ContainerStorageItemTableCache::Clear() {
+    spin_mutex::scoped_lock scoped_lock(lock_);
+    map<uint64_t, ItemTable*>::iterator i;
+    for (i = tables_.begin(); i != tables_.end(); i++) {
+        delete i->second;
+    }
+    tables_.clear();
+    lru_list_.clear();
+}
+
+size_t ContainerStorageItemTableCache::GetSize() {
+    spin_mutex::scoped_lock scoped_lock(lock_);
+    return tables_.size();
+}
+
+string ContainerStorageItemTableCache::PrintStatistics() {
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"item table count\": " << GetSize() << "," << std::endl;
+    sstr << "\"hits\": " << this->stats_.hits_ << "," << std::endl;
+    sstr << "\"miss\": " << this->stats_.miss_ << "," << std::endl;
+    sstr << "\"stale\": " << this->stats_.stale_ << "," << std::endl;
+    sstr << "\"updates\": " << this->stats_.updates_ << "," << std::endl;
+    sstr << "\"evictions\": " << this->stats_.evictions_ << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+}
+}
@@ -0,0 +1,388 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <core/container_storage_tiering.h>
+#include <core/container_storage.h>
+#include <core/container.h>
+#include <base/index.h>
+#include <base/logging.h>
+#include <base/memory.h>
+#include <base/strutil.h>
+#include <base/timer.h>
+
+#include <sstream>
+
+using std::string;
+using std::stringstream;
+using std::list;
+using std::map;
+using std::set;
+using dedupv1::base::strutil::To;
+using dedupv1::base::lookup_result;
+using dedupv1::base::LOOKUP_FOUND;
+using dedupv1::base::LOOKUP_ERROR;
+using dedupv1::base::IndexIterator;
+using dedupv1::base::ScopedPtr;
+using dedupv1::base::Option;
+using dedupv1::base::ProfileTimer;
+using dedupv1::base::Walltimer;
+using tbb::spin_mutex;
+
+LOGGER("ContainerStorageTiering");
+
+namespace dedupv1 {
+namespace chunkstore {
+
+ContainerStorageTiering::Statistics::Statistics() {
+    demotion_count_ = 0;
+    promotion_count_ = 0;
+    aborted_move_count_ = 0;
+    failed_move_count_ = 0;
+}
+
+ContainerStorageTiering::ContainerStorageTiering() {
+    storage_ = NULL;
+    high_watermark_ = 0.9;
+    low_watermark_ = 0.75;
+    promotion_threshold_ = kDefaultPromotionThreshold;
+    max_move_count_ = kDefaultMaxMoveCount;
+    max_candidate_count_ = kDefaultMaxCandidateCount;
+    started_ = false;
+    demoting_ = false;
+}
+
+ContainerStorageTiering::~ContainerStorageTiering() {
+}
+
+bool ContainerStorageTiering::SetOption(const string& option_name, const string& option) {
+    CHECK(!started_, "Tiering already started");
+    if (option_name == "high-watermark") {
+        CHECK(To<double>(option).valid(), "Illegal option " << option);
+        CHECK(To<double>(option).value() > 0.0 && To<double>(option).value() <= 1.0, "Illegal high watermark " << option);
+        high_watermark_ = To<double>(option).value();
+        return true;
+    }
+    if (option_name == "low-watermark") {
+        CHECK(To<double>(option).valid(), "Illegal option " << option);
+        CHECK(To<double>(option).value() >= 0.0 && To<double>(option).value() <= 1.0, "Illegal low watermark " << option);
+        low_watermark_ = To<double>(option).value();
+        return true;
+    }
+    if (option_name == "promotion-threshold") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        CHECK(To<uint32_t>(option).value() > 0, "Illegal promotion threshold " << option);
+        promotion_threshold_ = To<uint32_t>(option).value();
+        return true;
+    }
+    if (option_name == "max-move-count") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        CHECK(To<uint32_t>(option).value() > 0, "Illegal max move count " << option);
+        max_move_count_ = To<uint32_t>(option).value();
+        return true;
+    }
+    if (option_name == "max-candidate-count") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        CHECK(To<uint32_t>(option).value() > 0, "Illegal max candidate count " << option);
+        max_candidate_count_ = To<uint32_t>(option).value();
+        return true;
+    }
+    ERROR("Illegal option: " << option_name);
+    return false;
+}
+
+bool ContainerStorageTiering::Start(ContainerStorage* storage) {
+    CHECK(!started_, "Tiering already started");
+    CHECK(storage, "Storage not set");
+    CHECK(low_watermark_ < high_watermark_, "Low watermark must be smaller than the high watermark: " <<
+        "low watermark " << low_watermark_ <<
+        ", high watermark " << high_watermark_);
+
+    uint32_t fast_file_count = 0;
+    for (uint32_t i = 0; i < storage->GetFileCount(); i++) {
+        if (storage->file(i).fast_tier()) {
+            fast_file_count++;
+        }
+    }
+    CHECK(fast_file_count > 0, "No container file of the fast tier configured");
+    CHECK(fast_file_count < storage->GetFileCount(), "No container file of the capacity tier configured");
+
+    storage_ = storage;
+    started_ = true;
+    return true;
+}
+
+bool ContainerStorageTiering::Run() {
+    CHECK(started_, "Tiering not started");
+    dedupv1::base::PersistentIndex* meta_data_index = storage_->meta_data_index();
+    CHECK(meta_data_index, "Meta data index not set");
+
+    Walltimer startup_timer;
+    IndexIterator* i = meta_data_index->CreateIterator();
+    CHECK(i, "Failed to create meta data iterator");
+    ScopedPtr<IndexIterator> scoped_iterator(i);
+
+    spin_mutex::scoped_lock l(lock_);
+    fast_list_.clear();
+    fast_map_.clear();
+
+    uint64_t container_id = 0;
+    size_t key_size = sizeof(container_id);
+    ContainerStorageAddressData address_data;
+    lookup_result lr = i->Next(&container_id, &key_size, &address_data);
+    for (; lr == LOOKUP_FOUND; lr = i->Next(&container_id, &key_size, &address_data)) {
+        CHECK(key_size == sizeof(container_id), "Illegal meta data key size: " << key_size);
+        if (!address_data.has_primary_id() && storage_->IsFastTierAddress(address_data)) {
+            // all containers are equally cold after a restart
+            fast_map_[container_id] = fast_list_.insert(fast_list_.end(), container_id);
+        }
+        key_size = sizeof(container_id);
+    }
+    CHECK(lr != LOOKUP_ERROR, "Failed to iterate meta data index");
+
+    DEBUG("Loaded fast tier containers: " <<
+        "container count " << fast_list_.size() <<
+        ", load time " << startup_timer.GetTime() << "ms");
+    return true;
+}
+
+void ContainerStorageTiering::AddFastContainer(uint64_t container_id) {
+    map<uint64_t, list<uint64_t>::iterator>::iterator i = fast_map_.find(container_id);
+    if (i != fast_map_.end()) {
+        fast_list_.splice(fast_list_.begin(), fast_list_, i->second);
+    } else {
+        fast_map_[container_id] = fast_list_.insert(fast_list_.begin(), container_id);
+    }
+    read_count_map_.erase(container_id);
+    promotion_set_.erase(container_id);
+}
+
+void ContainerStorageTiering::RemoveContainer(uint64_t container_id) {
+    map<uint64_t, list<uint64_t>::iterator>::iterator i = fast_map_.find(container_id);
+    if (i != fast_map_.end()) {
+        fast_list_.erase(i->second);
+        fast_map_.erase(i);
+    }
+    read_count_map_.erase(container_id);
+    promotion_set_.erase(container_id);
+
+    LoadStripe& stripe(load_stripes_[container_id % kLoadStripeCount]);
+    spin_mutex::scoped_lock l(stripe.lock_);
+    stripe.load_count_map_.erase(container_id);
+}
+
+bool ContainerStorageTiering::OnCommit(const ContainerCommittedEventData& data) {
+    if (!data.has_address() || !storage_->IsFastTierAddress(data.address())) {
+        return true;
+    }
+    spin_mutex::scoped_lock l(lock_);
+    AddFastContainer(data.container_id());
+    return true;
+}
+
+bool ContainerStorageTiering::OnMove(const ContainerMoveEventData& data) {
+    spin_mutex::scoped_lock l(lock_);
+    if (storage_->IsFastTierAddress(data.new_address())) {
+        AddFastContainer(data.container_id());
+    } else {
+        RemoveContainer(data.container_id());
+    }
+    return true;
+}
+
+bool ContainerStorageTiering::OnMerge(const ContainerMergedEventData& data) {
+    spin_mutex::scoped_lock l(lock_);
+    RemoveContainer(data.first_id());
+    RemoveContainer(data.second_id());
+    if (storage_->IsFastTierAddress(data.new_address())) {
+        AddFastContainer(data.new_primary_id());
+    }
+    return true;
+}
+
+bool ContainerStorageTiering::OnDeleteContainer(const ContainerDeletedEventData& data) {
+    spin_mutex::scoped_lock l(lock_);
+    RemoveContainer(data.container_id());
+    return true;
+}
+
+bool ContainerStorageTiering::OnLoad(const Container& container) {
+    uint64_t container_id = container.primary_id();
+
+    LoadStripe& stripe(load_stripes_[container_id % kLoadStripeCount]);
+    spin_mutex::scoped_lock l(stripe.lock_);
+    map<uint64_t, uint32_t>::iterator i = stripe.load_count_map_.find(container_id);
+    if (i != stripe.load_count_map_.end()) {
+        i->second++;
+    } else if (stripe.load_count_map_.size() < max_candidate_count_ / kLoadStripeCount + 1) {
+        stripe.load_count_map_[container_id] = 1;
+    }
+    // otherwise the load is not counted until the stripe is applied
+    return true;
+}
+
+void ContainerStorageTiering::ApplyLoads() {
+    for (size_t s = 0; s < kLoadStripeCount; s++) {
+        map<uint64_t, uint32_t> load_count_map;
+        spin_mutex::scoped_lock stripe_lock(load_stripes_[s].lock_);
+        load_count_map.swap(load_stripes_[s].load_count_map_);
+        stripe_lock.release();
+
+        spin_mutex::scoped_lock l(lock_);
+        map<uint64_t, uint32_t>::iterator j;
+        for (j = load_count_map.begin(); j != load_count_map.end(); j++) {
+            uint64_t container_id = j->first;
+            map<uint64_t, list<uint64_t>::iterator>::iterator i = fast_map_.find(container_id);
+            if (i != fast_map_.end()) {
+                fast_list_.splice(fast_list_.begin(), fast_list_, i->second);
+                continue;
+            }
+            if (promotion_set_.find(container_id) != promotion_set_.end()) {
+                continue;
+            }
+            uint32_t& read_count(read_count_map_[container_id]);
+            read_count += j->second;
+            if (read_count >= promotion_threshold_) {
+                TRACE("Container is promotion candidate: container id " << container_id);
+                read_count_map_.erase(container_id);
+                promotion_set_.insert(container_id);
+            } else if (read_count_map_.size() > max_candidate_count_) {
+                read_count_map_.clear();
+            }
+        }
+    }
+}
+
+bool ContainerStorageTiering::MoveContainers(const list<uint64_t>& container_list, bool fast_tier) {
+    list<uint64_t>::const_iterator i;
+    for (i = container_list.begin(); i != container_list.end(); i++) {
+        uint64_t container_id = *i;
+        ProfileTimer timer(stats_.move_time_);
+
+        bool aborted = false;
+        if (!storage_->TryMoveContainer(container_id, fast_tier, &aborted)) {
+            WARNING("Failed to move container: container id " << container_id <<
+                ", tier " << (fast_tier ? "fast" : "capacity"));
+            stats_.failed_move_count_++;
+            aborted = true;
+        } else if (!aborted) {
+            if (fast_tier) {
+                stats_.promotion_count_++;
+            } else {
+                stats_.demotion_count_++;
+            }
+        } else {
+            stats_.aborted_move_count_++;
+        }
+        if (aborted && !fast_tier) {
+            // otherwise the container stays the demotion candidate forever
+            spin_mutex::scoped_lock l(lock_);
+            RemoveContainer(container_id);
+        }
+    }
+    return true;
+}
+
+bool ContainerStorageTiering::OnIdle() {
+    CHECK(started_, "Tiering not started");
+    Option<double> fill_ratio = storage_->allocator()->GetTierFillRatio(STORAGE_TIER_FAST);
+    if (!fill_ratio.valid()) {
+        return true;
+    }
+
+    ApplyLoads();
+
+    list<uint64_t> demotion_list;
+    list<uint64_t> promotion_list;
+
+    spin_mutex::scoped_lock l(lock_);
+    if (fill_ratio.value() > high_watermark_) {
+        demoting_ = true;
+    } else if (fill_ratio.value() <= low_watermark_) {
+        demoting_ = false;
+    }
+    if (demoting_) {
+        list<uint64_t>::reverse_iterator i;
+        for (i = fast_list_.rbegin(); i != fast_list_.rend() && demotion_list.size() < max_move_count_; i++) {
+            demotion_list.push_back(*i);
+        }
+    } else if (fill_ratio.value() < low_watermark_) {
+        while (!promotion_set_.empty() && promotion_list.size() < max_move_count_) {
+            promotion_list.push_back(*promotion_set_.begin());
+            promotion_set_.erase(promotion_set_.begin());
+        }
+    }
+    l.release();
+
+    // the lock must not be held as the move calls OnMove
+    if (!demotion_list.empty()) {
+        DEBUG("Demote containers: fill ratio " << fill_ratio.value() <<
+            ", container count " << demotion_list.size());
+        CHECK(MoveContainers(demotion_list, false), "Failed to demote containers");
+    }
+    if (!promotion_list.empty()) {
+        DEBUG("Promote containers: fill ratio " << fill_ratio.value() <<
+            ", container count " << promotion_list.size());
+        CHECK(MoveContainers(promotion_list, true), "Failed to promote containers");
+    }
+    return true;
+}
+
+uint64_t ContainerStorageTiering::GetFastContainerCount() {
+    spin_mutex::scoped_lock l(lock_);
+    return fast_list_.size();
+}
+
+uint64_t ContainerStorageTiering::GetPromotionCandidateCount() {
+    spin_mutex::scoped_lock l(lock_);
+    return promotion_set_.size();
+}
+
+string ContainerStorageTiering::PrintStatistics() {
+    spin_mutex::scoped_lock l(lock_);
+    uint64_t fast_container_count = fast_list_.size();
+    uint64_t promotion_candidate_count = promotion_set_.size();
+    uint64_t read_candidate_count = read_count_map_.size();
+    bool demoting = demoting_;
+    l.release();
+
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"fast container count\": " << fast_container_count << "," << std::endl;
+    sstr << "\"promotion candidate count\": " << promotion_candidate_count << "," << std::endl;
+    sstr << "\"read candidate count\": " << read_candidate_count << "," << std::endl;
+    sstr << "\"demoting\": " << (demoting ? "true" : "false") << "," << std::endl;
+    sstr << "\"demotion count\": " << stats_.demotion_count_ << "," << std::endl;
+    sstr << "\"promotion count\": " << stats_.promotion_count_ << "," << std::endl;
+    sstr << "\"aborted move count\": " << stats_.aborted_move_count_ << "," << std::endl;
+    sstr << "\"failed move count\": " << stats_.failed_move_count_ << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+string ContainerStorageTiering::PrintProfile() {
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"move time\": " << stats_.move_time_.GetSum() << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+}
+}
@@ -20,6 +20,7 @@
 #include <core/container_storage_write_cache.h>
 
 #include <sstream>
+#include <algorithm>
 
 #include <core/container.h>
 #include <core/container_storage.h>
@@ -31,6 +32,10 @@
 
 using std::string;
 using std::stringstream;
+using std::map;
+using std::vector;
+using dedupv1::base::Option;
+using dedupv1::base::strutil::To;
 using dedupv1::base::strutil::ToStorageUnit;
 using dedupv1::base::strutil::StartsWith;
 using dedupv1::base::ProfileTimer;
@@ -222,6 +227,14 @@ bool ContainerStorageWriteCache::GetNextWriteCacheContainer(Container** write_co
     return write_cache_strategy_->GetNextWriteCacheContainer(write_container, write_cache_lock);
 }
 
+bool ContainerStorageWriteCache::GetNextWriteCacheContainer(uint32_t stream_id,
+                                                            Container** write_container,
+                                                            ReadWriteLock** write_cache_lock) {
+    CHECK(write_cache_strategy_, "Write cache strategy is not set");
+
+    return write_cache_strategy_->GetNextWriteCacheContainerForStream(stream_id, write_container, write_cache_lock);
+}
+
 string ContainerStorageWriteCache::PrintLockStatistics() {
     stringstream sstr;
     sstr << "{";
@@ -263,7 +276,8 @@ string ContainerStorageWriteCache::PrintStatistics() {
     sstr << "{";
     sstr << "\"write cache hits\": " << this->stats_.cache_hits_ << "," << std::endl;
     sstr << "\"write cache miss\": " << this->stats_.cache_miss_ << "," << std::endl;
-    sstr << "\"write cache checks\": " << this->stats_.cache_checks_ << std::endl;
+    sstr << "\"write cache checks\": " << this->stats_.cache_checks_ << "," << std::endl;
+    sstr << "\"strategy\": " << (this->write_cache_strategy_ ? this->write_cache_strategy_->PrintStatistics() : "null") << std::endl;
     sstr << "}";
     return sstr.str();
 }
@@ -287,6 +301,16 @@ bool ContainerStorageWriteCacheStrategy::Start(ContainerStorageWriteCache* write
     return true;
 }
 
+bool ContainerStorageWriteCacheStrategy::GetNextWriteCacheContainerForStream(uint32_t stream_id,
+                                                                             Container** write_container,
+                                                                             ReadWriteLock** write_cache_lock) {
+    return GetNextWriteCacheContainer(write_container, write_cache_lock);
+}
+
+string ContainerStorageWriteCacheStrategy::PrintStatistics() {
+    return "null";
+}
+
 ContainerStorageWriteCacheStrategy* RoundRobinContainerStorageWriteCacheStrategy::CreateWriteCacheStrategy() {
     return new RoundRobinContainerStorageWriteCacheStrategy();
 }
@@ -394,6 +418,211 @@ bool EarliestFreeContainerStorageWriteCacheStrategy::GetNextWriteCacheContainer(
     return this->fallback_strategy->GetNextWriteCacheContainer(write_container, write_cache_lock);
 }
 
+ContainerStorageWriteCacheStrategy* StreamAffineContainerStorageWriteCacheStrategy::CreateWriteCacheStrategy() {
+    return new StreamAffineContainerStorageWriteCacheStrategy();
+}
+
+void StreamAffineContainerStorageWriteCacheStrategy::RegisterWriteCacheStrategy() {
+    ContainerStorageWriteCacheStrategyFactory::GetFactory()->Register("stream-affine",
+        &StreamAffineContainerStorageWriteCacheStrategy::CreateWriteCacheStrategy);
+}
+
+StreamAffineContainerStorageWriteCacheStrategy::Statistics::Statistics() {
+    stream_hits_ = 0;
+    stream_assignments_ = 0;
+    stream_evictions_ = 0;
+    stream_waits_ = 0;
+    no_stream_requests_ = 0;
+}
+
+StreamAffineContainerStorageWriteCacheStrategy::StreamAffineContainerStorageWriteCacheStrategy() {
+    this->write_cache = NULL;
+    this->fallback_strategy = NULL;
+    this->containers_per_stream_ = kDefaultContainersPerStream;
+}
+
+StreamAffineContainerStorageWriteCacheStrategy::~StreamAffineContainerStorageWriteCacheStrategy() {
+    if (this->fallback_strategy) {
+        delete fallback_strategy;
+        this->fallback_strategy = NULL;
+    }
+}
+
+bool StreamAffineContainerStorageWriteCacheStrategy::SetOption(const string& option_name, const string& option) {
+    if (option_name == "containers-per-stream") {
+        Option<uint32_t> o = To<uint32_t>(option);
+        CHECK(o.valid(), "Illegal option " << option);
+        CHECK(o.value() > 0, "Illegal containers per stream " << option);
+        this->containers_per_stream_ = o.value();
+        return true;
+    }
+    return ContainerStorageWriteCacheStrategy::SetOption(option_name, option);
+}
+
+bool StreamAffineContainerStorageWriteCacheStrategy::Start(ContainerStorageWriteCache* write_cache) {
+    CHECK(write_cache, "Write cache not set");
+    this->write_cache = write_cache;
+    this->fallback_strategy = ContainerStorageWriteCacheStrategyFactory::Create("earliest-free");
+    CHECK(this->fallback_strategy, "Failed to create fallback strategy");
+    CHECK(this->fallback_strategy->Start(write_cache), "Failed to start fallback strategy");
+
+    this->container_stream_.resize(write_cache->GetSize(), Storage::NO_STREAM_ID);
+    this->container_used_time_.resize(write_cache->GetSize(), tick_count::now());
+
+    DEBUG("Starting stream-affine container write cache strategy: " <<
+        "containers per stream " << this->containers_per_stream_);
+    return true;
+}
+
+int StreamAffineContainerStorageWriteCacheStrategy::AssignContainerIndex(uint32_t stream_id) {
+    // prefer an unassigned write container, otherwise take the least recently used one
+    int index = -1;
+    for (int j = 0; j < this->container_stream_.size(); j++) {
+        if (this->container_stream_[j] == stream_id) {
+            continue;
+        }
+        if (this->container_stream_[j] == Storage::NO_STREAM_ID) {
+            index = j;
+            break;
+        }
+        if (index == -1 || (this->container_used_time_[j] - this->container_used_time_[index]).seconds() < 0.0) {
+            index = j;
+        }
+    }
+    if (index == -1) {
+        return -1;
+    }
+    uint32_t old_stream_id = this->container_stream_[index];
+    if (old_stream_id != Storage::NO_STREAM_ID) {
+        TRACE("Reassign write container " << index <<
+            ": old stream " << old_stream_id <<
+            ", new stream " << stream_id);
+        vector<int>& old_indexes(this->stream_container_[old_stream_id]);
+        old_indexes.erase(std::find(old_indexes.begin(), old_indexes.end(), index));
+        if (old_indexes.empty()) {
+            this->stream_container_.erase(old_stream_id);
+            this->stream_wait_count_.erase(old_stream_id);
+        }
+        this->stats_.stream_evictions_++;
+    }
+    this->container_stream_[index] = stream_id;
+    this->container_used_time_[index] = tick_count::now();
+    this->stream_container_[stream_id].push_back(index);
+    this->stats_.stream_assignments_++;
+    return index;
+}
+
+vector<int> StreamAffineContainerStorageWriteCacheStrategy::GetStreamContainerIndexes(uint32_t stream_id) {
+    tbb::spin_mutex::scoped_lock scoped_lock(this->assignment_lock_);
+
+    map<uint32_t, vector<int> >::iterator i = this->stream_container_.find(stream_id);
+    if (i != this->stream_container_.end()) {
+        this->stats_.stream_hits_++;
+        return i->second;
+    }
+    vector<int> indexes;
+    indexes.push_back(AssignContainerIndex(stream_id));
+    return indexes;
+}
+
+int StreamAffineContainerStorageWriteCacheStrategy::GetBusyStreamContainerIndex(uint32_t stream_id) {
+    tbb::spin_mutex::scoped_lock scoped_lock(this->assignment_lock_);
+
+    vector<int>& indexes(this->stream_container_[stream_id]);
+    if (indexes.size() < this->containers_per_stream_) {
+        int index = AssignContainerIndex(stream_id);
+        if (index >= 0) {
+            return index;
+        }
+    }
+    if (indexes.empty()) {
+        return -1;
+    }
+    this->stats_.stream_waits_++;
+    int index = indexes[this->stream_wait_count_[stream_id]++ % indexes.size()];
+    this->container_used_time_[index] = tick_count::now();
+    return index;
+}
+
+bool StreamAffineContainerStorageWriteCacheStrategy::GetNextWriteCacheContainer(Container** write_container,
+                                                                                ReadWriteLock** write_cache_lock) {
+    return GetNextWriteCacheContainerForStream(Storage::NO_STREAM_ID, write_container, write_cache_lock);
+}
+
+bool StreamAffineContainerStorageWriteCacheStrategy::GetNextWriteCacheContainerForStream(uint32_t stream_id,
+                                                                                         Container** write_container,
+                                                                                         ReadWriteLock** write_cache_lock) {
+    DCHECK(write_container, "Write container not set");
+    DCHECK(write_cache_lock, "Write cache lock not set");
+    DCHECK(this->write_cache, "Write cache not set");
+    DCHECK(this->fallback_strategy, "Fallback strategy not set");
+
+    if (stream_id == Storage::NO_STREAM_ID) {
+        this->stats_.no_stream_requests_++;
+        return this->fallback_strategy->GetNextWriteCacheContainer(write_container, write_cache_lock);
+    }
+
+    // use the first container of the stream that is not locked by another thread of the stream
+    vector<int> indexes = GetStreamContainerIndexes(stream_id);
+    for (size_t i = 0; i < indexes.size(); i++) {
+        ReadWriteLock* lock = this->write_cache->GetCacheLock().Get(indexes[i]);
+        DCHECK(lock, "Write cache lock not set");
+
+        bool locked = false;
+        CHECK(lock->TryAcquireWriteLock(&locked), "Lock failed");
+        if (locked) {
+            *write_container = this->write_cache->GetCache()[indexes[i]];
+            *write_cache_lock = lock;
+            CHECK(*write_container, "Write container not assigned");
+
+            this->write_cache->ResetTimeout(indexes[i]);
+
+            TRACE("Choose write container " << indexes[i] <<
+                ", stream " << stream_id <<
+                ", container " << (*write_container)->primary_id());
+            return true;
+        }
+    }
+
+    int write_container_index = GetBusyStreamContainerIndex(stream_id);
+    CHECK(write_container_index >= 0, "Failed to assign write container: stream " << stream_id);
+    *write_container = this->write_cache->GetCache()[write_container_index];
+    *write_cache_lock = this->write_cache->GetCacheLock().Get(write_container_index);
+    CHECK(*write_container, "Write container not assigned");
+    CHECK(*write_cache_lock, "Write cache lock not assigned");
+
+    this->write_cache->ResetTimeout(write_container_index);
+
+    TRACE("Choose write container " << write_container_index <<
+        ", stream " << stream_id <<
+        ", container " << (*write_container)->primary_id());
+
+    // the lock is only contended by other threads of the same stream or by a reassigned stream
+    ProfileTimer lock_timer(this->write_cache->GetStatistics()->write_lock_wait_time_);
+    CHECK((*write_cache_lock)->AcquireWriteLockWithStatistics(
+            &this->write_cache->GetStatistics()->write_container_lock_free_,
+            &this->write_cache->GetStatistics()->write_container_lock_busy_),
+        "Write cache lock failed: write container index " << write_container_index);
+    return true;
+}
+
+string StreamAffineContainerStorageWriteCacheStrategy::PrintStatistics() {
+    tbb::spin_mutex::scoped_lock scoped_lock(this->assignment_lock_);
+    size_t stream_count = this->stream_container_.size();
+    scoped_lock.release();
+
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"stream hits\": " << this->stats_.stream_hits_ << "," << std::endl;
+    sstr << "\"stream assignments\": " << this->stats_.stream_assignments_ << "," << std::endl;
+    sstr << "\"stream evictions\": " << this->stats_.stream_evictions_ << "," << std::endl;
+    sstr << "\"stream waits\": " << this->stats_.stream_waits_ << "," << std::endl;
+    sstr << "\"no stream requests\": " << this->stats_.no_stream_requests_ << "," << std::endl;
+    sstr << "\"assigned streams\": " << stream_count << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
 ContainerStorageWriteCacheStrategyFactory ContainerStorageWriteCacheStrategyFactory::factory;
 
 bool ContainerStorageWriteCacheStrategyFactory::Register(const string& name, ContainerStorageWriteCacheStrategy*(*factory)(void)) {
@@ -0,0 +1,277 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <core/container_summary_log.h>
+
+#include <core/container.h>
+#include <base/logging.h>
+#include <base/crc32.h>
+#include <base/strutil.h>
+#include <base/memory.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include <sstream>
+
+using std::string;
+using std::stringstream;
+using dedupv1::base::File;
+using dedupv1::base::Option;
+using dedupv1::base::ScopedLock;
+using dedupv1::base::lookup_result;
+using dedupv1::base::LOOKUP_ERROR;
+using dedupv1::base::LOOKUP_FOUND;
+using dedupv1::base::LOOKUP_NOT_FOUND;
+using dedupv1::base::crc_raw;
+using dedupv1::base::Callback1;
+using dedupv1::base::ScopedPtr;
+
+LOGGER("ContainerSummaryLog");
+
+namespace dedupv1 {
+namespace chunkstore {
+
+ContainerSummaryLog::Statistics::Statistics() {
+    appended_records_ = 0;
+    read_records_ = 0;
+    compacted_records_ = 0;
+}
+
+ContainerSummaryLog::ContainerSummaryLog() {
+    file_ = NULL;
+    end_offset_ = 0;
+}
+
+ContainerSummaryLog::~ContainerSummaryLog() {
+    if (file_) {
+        delete file_;
+        file_ = NULL;
+    }
+}
+
+bool ContainerSummaryLog::Start(const string& filename, bool truncate, bool readonly) {
+    CHECK(file_ == NULL, "Summary log already started");
+    filename_ = filename;
+
+    int flags = readonly ? (O_RDONLY | O_LARGEFILE) : (O_RDWR | O_LARGEFILE | O_CREAT);
+    file_ = File::Open(filename, flags, S_IRUSR | S_IWUSR | S_IRGRP);
+    CHECK(file_, "Failed to open summary log: " << filename);
+
+    if (truncate) {
+        CHECK(!readonly, "Cannot truncate summary log in readonly mode: " << filename);
+        CHECK(file_->Truncate(0), "Failed to truncate summary log: " << filename);
+        end_offset_ = 0;
+        return true;
+    }
+
+    // search the end of the log
+    uint64_t offset = 0;
+    ContainerSummaryData summary;
+    lookup_result r = LOOKUP_FOUND;
+    while (r == LOOKUP_FOUND) {
+        r = ReadNext(&offset, &summary);
+    }
+    CHECK(r != LOOKUP_ERROR, "Failed to read summary log: " << filename << ", offset " << offset);
+    end_offset_ = offset;
+
+    Option<off_t> file_size = file_->GetSize();
+    CHECK(file_size.valid(), "Failed to get size of summary log: " << filename);
+    if (static_cast<uint64_t>(file_size.value()) > end_offset_) {
+        WARNING("Summary log has invalid tail: " << filename <<
+            ", valid size " << end_offset_ <<
+            ", file size " << file_size.value());
+        if (!readonly) {
+            CHECK(file_->Truncate(end_offset_), "Failed to truncate summary log: " << filename);
+        }
+    }
+    stats_.read_records_ = 0;
+    DEBUG("Started summary log " << filename << ", size " << end_offset_);
+    return true;
+}
+
+bool ContainerSummaryLog::Compact(Callback1<Option<bool>, const ContainerSummaryData&>* is_current) {
+    CHECK(file_, "Summary log not started");
+    CHECK(is_current, "Callback not set");
+
+    ScopedLock scoped_lock(&lock_);
+    CHECK(scoped_lock.AcquireLock(), "Failed to acquire summary log lock");
+
+    string tmp_filename = filename_ + ".compact";
+    File* tmp_file = File::Open(tmp_filename, O_RDWR | O_LARGEFILE | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP);
+    CHECK(tmp_file, "Failed to open summary log: " << tmp_filename);
+    ScopedPtr<File> scoped_tmp_file(tmp_file);
+
+    uint64_t offset = 0;
+    uint64_t record_offset = 0;
+    uint64_t tmp_offset = 0;
+    uint64_t removed_count = 0;
+    ContainerSummaryData summary;
+    lookup_result r = ReadNext(&offset, &summary);
+    while (r == LOOKUP_FOUND) {
+        Option<bool> current = is_current->Call(summary);
+        CHECK(current.valid(), "Failed to check summary record: " << summary.ShortDebugString());
+        if (current.value()) {
+            // the record is copied unchanged including its header
+            string record(offset - record_offset, '\0');
+            CHECK(file_->Read(record_offset, const_cast<char*>(record.data()), record.size()) == static_cast<ssize_t>(record.size()),
+                "Failed to read summary record: " << filename_ << ", offset " << record_offset);
+            CHECK(tmp_file->Write(tmp_offset, record.data(), record.size()) == static_cast<ssize_t>(record.size()),
+                "Failed to write summary record: " << tmp_filename << ", offset " << tmp_offset);
+            tmp_offset += record.size();
+        } else {
+            removed_count++;
+        }
+        record_offset = offset;
+        r = ReadNext(&offset, &summary);
+    }
+    CHECK(r != LOOKUP_ERROR, "Failed to read summary log: " << filename_ << ", offset " << offset);
+
+    if (removed_count == 0) {
+        scoped_tmp_file.Release();
+        delete tmp_file;
+        CHECK(File::Remove(tmp_filename), "Failed to remove summary log: " << tmp_filename);
+        return true;
+    }
+    CHECK(tmp_file->Sync(), "Failed to sync summary log: " << tmp_filename);
+    CHECK(rename(tmp_filename.c_str(), filename_.c_str()) == 0,
+        "Failed to rename summary log: " << tmp_filename << ", message " << strerror(errno));
+
+    delete file_;
+    file_ = scoped_tmp_file.Release();
+    INFO("Compacted summary log " << filename_ <<
+        ": removed records " << removed_count <<
+        ", size " << end_offset_ << " -> " << tmp_offset);
+    end_offset_ = tmp_offset;
+    stats_.compacted_records_ += removed_count;
+    return true;
+}
+
+bool ContainerSummaryLog::FillSummary(const Container& container, ContainerSummaryData* summary) {
+    DCHECK(summary, "Summary not set");
+
+    summary->Clear();
+    summary->set_container_id(container.primary_id());
+    std::set<uint64_t>::const_iterator j;
+    for (j = container.secondary_ids().begin(); j != container.secondary_ids().end(); j++) {
+        summary->add_secondary_id(*j);
+    }
+    std::vector<ContainerItem*>::const_iterator i;
+    for (i = container.items().begin(); i != container.items().end(); i++) {
+        const ContainerItem* item = *i;
+        CHECK(item, "Item not set");
+        if (item->is_deleted()) {
+            continue;
+        }
+        ContainerItemData* item_data = summary->add_item();
+        item_data->set_fp(item->key(), item->key_size());
+        item_data->set_item_size(item->item_size());
+        item_data->set_raw_size(item->raw_size());
+        item_data->set_indexed(item->is_indexed());
+        item_data->set_original_id(item->original_id());
+    }
+    return true;
+}
+
+bool ContainerSummaryLog::Append(const Container& container, const ContainerStorageAddressData& address,
+                                 int64_t log_id) {
+    CHECK(file_, "Summary log not started");
+
+    ContainerSummaryData summary;
+    CHECK(FillSummary(container, &summary), "Failed to fill summary: " << container.DebugString());
+    summary.mutable_address()->CopyFrom(address);
+    summary.mutable_address()->set_log_id(log_id);
+
+    string data;
+    CHECK(summary.SerializeToString(&data), "Failed to serialize summary: " << summary.ShortDebugString());
+    CHECK(data.size() + kRecordHeaderSize <= kMaxRecordSize, "Summary record too large: " <<
+        "container " << container.primary_id() <<
+        ", size " << data.size());
+
+    uint32_t header[3];
+    header[0] = kRecordMagic;
+    header[1] = data.size();
+    header[2] = crc_raw(data.data(), data.size());
+
+    string record(reinterpret_cast<const char*>(header), kRecordHeaderSize);
+    record.append(data);
+
+    ScopedLock scoped_lock(&lock_);
+    CHECK(scoped_lock.AcquireLock(), "Failed to acquire summary log lock");
+
+    CHECK(file_->Write(end_offset_, record.data(), record.size()) == static_cast<ssize_t>(record.size()),
+        "Failed to write summary record: " << filename_ << ", offset " << end_offset_);
+    end_offset_ += record.size();
+    stats_.appended_records_++;
+    return true;
+}
+
+lookup_result ContainerSummaryLog::ReadNext(uint64_t* offset, ContainerSummaryData* summary) {
+    DCHECK_RETURN(offset, LOOKUP_ERROR, "Offset not set");
+    DCHECK_RETURN(summary, LOOKUP_ERROR, "Summary not set");
+    CHECK_RETURN(file_, LOOKUP_ERROR, "Summary log not started");
+
+    uint32_t header[3];
+    ssize_t r = file_->Read(*offset, header, kRecordHeaderSize);
+    CHECK_RETURN(r >= 0, LOOKUP_ERROR, "Failed to read summary record header: " << filename_ << ", offset " << *offset);
+    if (static_cast<size_t>(r) < kRecordHeaderSize) {
+        return LOOKUP_NOT_FOUND;
+    }
+    if (header[0] != kRecordMagic || header[1] > kMaxRecordSize - kRecordHeaderSize) {
+        return LOOKUP_NOT_FOUND;
+    }
+    string data(header[1], '\0');
+    r = file_->Read(*offset + kRecordHeaderSize, const_cast<char*>(data.data()), data.size());
+    CHECK_RETURN(r >= 0, LOOKUP_ERROR, "Failed to read summary record: " << filename_ << ", offset " << *offset);
+    if (static_cast<size_t>(r) < data.size()) {
+        return LOOKUP_NOT_FOUND;
+    }
+    if (crc_raw(data.data(), data.size()) != header[2]) {
+        return LOOKUP_NOT_FOUND;
+    }
+    if (!summary->ParseFromString(data)) {
+        return LOOKUP_NOT_FOUND;
+    }
+    *offset += kRecordHeaderSize + data.size();
+    stats_.read_records_++;
+    return LOOKUP_FOUND;
+}
+
+uint64_t ContainerSummaryLog::end_offset() {
+    ScopedLock scoped_lock(&lock_);
+    CHECK_RETURN(scoped_lock.AcquireLock(), 0, "Failed to acquire summary log lock");
+    return end_offset_;
+}
+
+string ContainerSummaryLog::PrintStatistics() {
+    stringstream sstr;
+    sstr << "{";
+    sstr << "\"appended records\": " << stats_.appended_records_ << "," << std::endl;
+    sstr << "\"read records\": " << stats_.read_records_ << "," << std::endl;
+    sstr << "\"compacted records\": " << stats_.compacted_records_ << "," << std::endl;
+    sstr << "\"size\": " << end_offset() << std::endl;
+    sstr << "}";
+    return sstr.str();
+}
+
+}
+}
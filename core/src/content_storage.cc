@@ -82,6 +82,7 @@ using dedupv1::blockindex::BlockMappingItem;
 using dedupv1::blockindex::BlockMapping;
 using dedupv1::chunkstore::ChunkStore;
 using dedupv1::chunkstore::Storage;
+using dedupv1::chunkstore::StorageReadRequest;
 using dedupv1::base::ScopedArray;
 using dedupv1::filter::FilterChain;
 using dedupv1::base::CRC;
@@ -271,34 +272,48 @@ bool ContentStorage::ReadBlock(Session* session,
 
     // Append the chunks/mapping items to each other.
     // data_pos denotes the current position
-    int num = 0;
+    // All chunks are read with a single batched read so that the items of the same
+    // container are served together
+    vector<StorageReadRequest> read_requests;
+    read_requests.reserve(mapping.item_count());
     uint32_t todo_size = request->size();
     uint64_t offset = request->offset();
     for (list<BlockMappingItem>::iterator i = mapping.items().begin(); i != mapping.items().end() && todo_size > 0; i++) {
-        num++;
         BlockMappingItem* item = &(*i);
         if (i->size() <= offset) {
             offset -= i->size();
             continue;
         }
+        CHECK(item->fingerprint_size() > 0, "Illegal block mapping item: " << item->DebugString());
 
         count = todo_size;
         if (offset + count > i->size()) {
             count = i->size() - offset;
         }
 
-        CHECK(ContentStorage::ReadDataForItem(
-                item, session, data_buffer,
-                data_pos, count, offset, ec),
-            "Read chunk failed: chunk " << item->DebugString() <<
-            ", block " << mapping.DebugString() <<
-            ", request " << request->DebugString());
+        if (count > 0) {
+            read_requests.push_back(StorageReadRequest(item->data_address(),
+                    item->fingerprint(),
+                    item->fingerprint_size(),
+                    data_buffer + data_pos,
+                    item->chunk_offset() + offset,
+                    count));
+        }
 
         todo_size -= count;
         offset = 0;
         data_pos += count;
     }
 
+    vector<StorageReadRequest*> read_request_pointers;
+    read_request_pointers.reserve(read_requests.size());
+    for (vector<StorageReadRequest>::iterator j = read_requests.begin(); j != read_requests.end(); j++) {
+        read_request_pointers.push_back(&(*j));
+    }
+    CHECK(this->chunk_store_->ReadBlocks(read_request_pointers, ec),
+        "Read chunks failed: block " << mapping.DebugString() <<
+        ", request " << request->DebugString());
+
     IF_TRACE() {
         TRACE("Read block: request " << request->DebugString() <<
             ", crc " << crc(request->buffer(), request->size()));
@@ -674,7 +689,9 @@ bool ContentStorage::ProcessChunkFilterChain(std::tr1::tuple<Session*, const Blo
     if (likely(!failed)) {
         SlidingAverageProfileTimer method_timer2(
             this->stats_.average_process_chunk_filter_chain_write_block_latency_);
-        if (!this->chunk_store_->WriteBlock(chunk_mapping, ec)) {
+        // all chunks of a volume form a stream
+        uint32_t stream_id = (session && session->volume()) ? session->volume()->GetId() : Storage::NO_STREAM_ID;
+        if (!this->chunk_store_->WriteBlock(chunk_mapping, stream_id, ec)) {
             ERROR("Storing of chunk data failed: " <<
                 "block mapping " << (block_mapping ? block_mapping->DebugString() : "<no block mapping>") <<
                 ", chunk mapping " << chunk_mapping->DebugString());
@@ -1134,18 +1151,4 @@ dedupv1::Chunker* ContentStorage::default_chunker() {
   return default_chunker_;
 }
 
-bool ContentStorage::ReadDataForItem(BlockMappingItem* item, Session* session, byte* data_buffer,
-                                     unsigned int data_pos, int count, int offset, dedupv1::base::ErrorContext* ec) {
-    DCHECK(item, "Block mapping item not set");
-    CHECK(item->fingerprint_size() > 0, "Illegal block mapping item: " << item->DebugString());
-
-    if (count == 0) {
-        return true;
-    }
-    uint32_t final_chunk_offset = item->chunk_offset() + offset;
-    CHECK(this->chunk_store_->ReadBlock(item, data_buffer + data_pos, final_chunk_offset, count, ec),
-        "Chunk reading failed " << item->DebugString() << ", offset = " << offset);
-    return true;
-}
-
 }
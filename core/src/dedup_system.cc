@@ -65,6 +65,7 @@
 #include <base/fileutil.h>
 #include <core/dedup_volume_info.h>
 #include <core/container_storage_gc.h>
+#include <core/container_storage_gc_cost_benefit.h>
 #include <core/container_storage_alloc.h>
 #include <core/idle_detector.h>
 #include <core/garbage_collector.h>
@@ -1248,11 +1249,13 @@ void DedupSystem::RegisterDefaults() {
     dedupv1::chunkindex::SuffixMaskChunkIndexSamplingStrategy::RegisterStrategy();
 
     dedupv1::chunkstore::GreedyContainerGCStrategy::RegisterGC();
+    dedupv1::chunkstore::CostBenefitContainerGCStrategy::RegisterGC();
 
     dedupv1::chunkstore::MemoryBitmapContainerStorageAllocator::RegisterAllocator();
 
     dedupv1::chunkstore::RoundRobinContainerStorageWriteCacheStrategy::RegisterWriteCacheStrategy();
     dedupv1::chunkstore::EarliestFreeContainerStorageWriteCacheStrategy::RegisterWriteCacheStrategy();
+    dedupv1::chunkstore::StreamAffineContainerStorageWriteCacheStrategy::RegisterWriteCacheStrategy();
 
     dedupv1::chunkindex::ChunkIndex::RegisterChunkIndex();
 }
@@ -0,0 +1,371 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <core/read_ahead.h>
+#include <core/dedup_system.h>
+#include <core/block_index.h>
+#include <core/block_mapping.h>
+#include <core/storage.h>
+#include <base/strutil.h>
+#include <base/logging.h>
+#include <base/runnable.h>
+#include <base/thread.h>
+#include <base/threadpool.h>
+
+#include <sstream>
+
+using std::string;
+using std::stringstream;
+using std::list;
+using std::pair;
+using std::make_pair;
+using std::set;
+using std::vector;
+using dedupv1::base::strutil::To;
+using dedupv1::base::strutil::ToStorageUnit;
+using dedupv1::base::strutil::ToString;
+using dedupv1::base::Option;
+using dedupv1::base::ErrorContext;
+using dedupv1::base::Runnable;
+using dedupv1::base::Threadpool;
+using dedupv1::base::ThreadUtil;
+using dedupv1::blockindex::BlockIndex;
+using dedupv1::blockindex::BlockMapping;
+using dedupv1::blockindex::BlockMappingItem;
+using dedupv1::chunkstore::Storage;
+
+LOGGER("ReadAhead");
+
+namespace dedupv1 {
+
+ReadAhead::Statistics::Statistics() {
+    sequential_reads_ = 0;
+    random_reads_ = 0;
+    mapping_reads_ = 0;
+    prefetches_ = 0;
+    prefetch_ignored_ = 0;
+    hits_ = 0;
+    waste_ = 0;
+    window_increases_ = 0;
+    window_decreases_ = 0;
+}
+
+/**
+ * Runnable that reads the block mappings of a block range and prefetches the referenced containers.
+ */
+class ReadAheadFillTask : public Runnable<bool> {
+    private:
+        ReadAhead* read_ahead_;
+        uint64_t stream_id_;
+        uint64_t begin_block_;
+        uint64_t end_block_;
+        set<uint64_t> known_containers_;
+    public:
+        ReadAheadFillTask(ReadAhead* read_ahead,
+                uint64_t stream_id,
+                uint64_t begin_block,
+                uint64_t end_block,
+                const set<uint64_t>& known_containers) :
+            read_ahead_(read_ahead), stream_id_(stream_id), begin_block_(begin_block), end_block_(end_block),
+            known_containers_(known_containers) {
+        }
+
+        virtual bool Run() {
+            bool r = read_ahead_->Fill(stream_id_, begin_block_, end_block_, known_containers_);
+            if (!r) {
+                WARNING("Failed to read ahead: blocks " << begin_block_ << " - " << end_block_);
+            }
+            // the read-ahead must not be accessed after this point
+            read_ahead_->fill_running_ = false;
+            delete this;
+            return r;
+        }
+};
+
+ReadAhead::ReadAhead(Statistics* stats) {
+    stats_ = stats;
+    tp_ = NULL;
+    block_index_ = NULL;
+    storage_ = NULL;
+    block_size_ = 0;
+    start_block_id_ = 0;
+    block_count_ = 0;
+    enabled_ = false;
+    min_window_ = kDefaultMinWindow;
+    max_window_ = kDefaultMaxWindow;
+    window_ = kDefaultMinWindow;
+    sequential_threshold_ = kDefaultSequentialThreshold;
+    max_gap_ = kDefaultMaxGap;
+    has_position_ = false;
+    next_offset_ = 0;
+    sequential_count_ = 0;
+    prefetched_until_ = 0;
+    stream_id_ = 0;
+    fill_running_ = false;
+    fill_stream_id_ = 0;
+    fill_done_ = false;
+}
+
+ReadAhead::~ReadAhead() {
+    WaitForFill();
+}
+
+void ReadAhead::WaitForFill() {
+    while (fill_running_) {
+        ThreadUtil::Sleep(1, ThreadUtil::MILLISECONDS);
+    }
+}
+
+bool ReadAhead::SetOption(const string& option_name, const string& option) {
+    if (option_name == "enabled") {
+        CHECK(To<bool>(option).valid(), "Illegal option " << option);
+        this->enabled_ = To<bool>(option).value();
+        return true;
+    }
+    if (option_name == "min-window") {
+        Option<uint32_t> o = To<uint32_t>(option);
+        CHECK(o.valid() && o.value() > 0, "Illegal option " << option);
+        this->min_window_ = o.value();
+        this->window_ = o.value();
+        return true;
+    }
+    if (option_name == "max-window") {
+        Option<uint32_t> o = To<uint32_t>(option);
+        CHECK(o.valid() && o.value() > 0, "Illegal option " << option);
+        this->max_window_ = o.value();
+        return true;
+    }
+    if (option_name == "sequential-threshold") {
+        CHECK(To<uint32_t>(option).valid(), "Illegal option " << option);
+        this->sequential_threshold_ = To<uint32_t>(option).value();
+        return true;
+    }
+    if (option_name == "max-gap") {
+        CHECK(ToStorageUnit(option).valid(), "Illegal option " << option);
+        this->max_gap_ = ToStorageUnit(option).value();
+        return true;
+    }
+    ERROR("Illegal option: " << option_name);
+    return false;
+}
+
+bool ReadAhead::Start(DedupSystem* system, uint64_t start_block_id, uint64_t end_block_id) {
+    CHECK(system, "System not set");
+    CHECK(stats_, "Statistics not set");
+    CHECK(!is_started(), "Read-ahead already started");
+    CHECK(start_block_id <= end_block_id, "Illegal block interval: " << start_block_id << " - " << end_block_id);
+    CHECK(min_window_ <= max_window_, "Illegal window: min window " << min_window_ << ", max window " << max_window_);
+
+    storage_ = system->storage();
+    CHECK(storage_, "Storage not set");
+    tp_ = system->threadpool();
+    CHECK(tp_, "Threadpool not set");
+    block_size_ = system->block_size();
+    CHECK(block_size_ > 0, "Block size not set");
+    start_block_id_ = start_block_id;
+    block_count_ = end_block_id - start_block_id;
+
+    // set last as it marks the read-ahead as started
+    block_index_ = system->block_index();
+    CHECK(block_index_, "Block index not set");
+    return true;
+}
+
+void ReadAhead::Consume(uint64_t block) {
+    while (!pending_.empty() && pending_.front().first <= block) {
+        pending_containers_.erase(pending_.front().second);
+        pending_.pop_front();
+        stats_->hits_++;
+    }
+}
+
+void ReadAhead::Reset() {
+    if (!pending_.empty()) {
+        stats_->waste_ += pending_.size();
+        pending_.clear();
+        pending_containers_.clear();
+
+        if (window_ > min_window_) {
+            window_ = window_ / 2 < min_window_ ? min_window_ : window_ / 2;
+            stats_->window_decreases_++;
+        }
+    }
+    sequential_count_ = 0;
+    prefetched_until_ = 0;
+    stream_id_++;
+}
+
+bool ReadAhead::Fill(uint64_t stream_id, uint64_t begin_block, uint64_t end_block,
+                     const set<uint64_t>& known_containers) {
+    set<uint64_t> containers(known_containers);
+    vector<pair<uint64_t, uint64_t> > results;
+    bool failed = false;
+    for (uint64_t block = begin_block; block < end_block && !failed; block++) {
+        BlockMapping mapping(start_block_id_ + block, block_size_);
+        BlockIndex::read_result r = block_index_->ReadBlockInfo(NULL, &mapping, NULL);
+        if (r == BlockIndex::READ_RESULT_ERROR) {
+            ERROR("Failed to read block mapping: block id " << mapping.block_id());
+            failed = true;
+            break;
+        }
+        stats_->mapping_reads_++;
+        if (r == BlockIndex::READ_RESULT_NOT_FOUND) {
+            continue;
+        }
+
+        list<BlockMappingItem>::const_iterator i;
+        for (i = mapping.items().begin(); i != mapping.items().end(); i++) {
+            uint64_t address = i->data_address();
+            if (!Storage::IsValidAddress(address)) {
+                continue;
+            }
+            if (!containers.insert(address).second) {
+                continue;
+            }
+            Option<bool> p = storage_->Prefetch(address, NULL);
+            if (!p.valid()) {
+                ERROR("Failed to prefetch container " << address);
+                failed = true;
+                break;
+            }
+            if (p.value()) {
+                results.push_back(make_pair(block, address));
+                stats_->prefetches_++;
+            } else {
+                stats_->prefetch_ignored_++;
+            }
+        }
+    }
+    TRACE("Read ahead: blocks " << begin_block << " - " << end_block <<
+        ", issued prefetches " << results.size());
+
+    tbb::spin_mutex::scoped_lock scoped_lock(fill_lock_);
+    fill_results_.swap(results);
+    fill_stream_id_ = stream_id;
+    fill_done_ = true;
+    return !failed;
+}
+
+void ReadAhead::CollectFill() {
+    vector<pair<uint64_t, uint64_t> > results;
+    uint64_t stream_id = 0;
+    {
+        tbb::spin_mutex::scoped_lock scoped_lock(fill_lock_);
+        if (!fill_done_) {
+            return;
+        }
+        fill_done_ = false;
+        results.swap(fill_results_);
+        stream_id = fill_stream_id_;
+    }
+    if (stream_id != stream_id_) {
+        // the stream has ended while the fill task was running
+        stats_->waste_ += results.size();
+        return;
+    }
+    vector<pair<uint64_t, uint64_t> >::iterator i;
+    for (i = results.begin(); i != results.end(); i++) {
+        if (pending_containers_.insert(i->second).second) {
+            pending_.push_back(*i);
+        }
+    }
+
+    // Only grow the window if the read-ahead actually had to load containers. If all containers are already
+    // in memory, a larger window does not help.
+    if (!results.empty() && window_ < max_window_) {
+        window_ = window_ * 2 > max_window_ ? max_window_ : window_ * 2;
+        stats_->window_increases_++;
+    }
+}
+
+bool ReadAhead::Update(uint64_t offset, uint64_t size, ErrorContext* ec) {
+    if (!enabled_ || !is_started() || size == 0) {
+        return true;
+    }
+    CollectFill();
+
+    bool sequential = has_position_ &&
+                      offset <= next_offset_ + max_gap_ &&
+                      offset + max_gap_ >= next_offset_;
+    if (!sequential || offset + size > next_offset_) {
+        next_offset_ = offset + size;
+    }
+    has_position_ = true;
+
+    if (!sequential) {
+        stats_->random_reads_++;
+        Reset();
+        return true;
+    }
+    stats_->sequential_reads_++;
+    sequential_count_++;
+
+    uint64_t last_block = (offset + size - 1) / block_size_;
+    Consume(last_block);
+
+    if (sequential_count_ < sequential_threshold_) {
+        return true;
+    }
+
+    // refill when less than half of the window is read ahead of the reader
+    uint64_t next_block = last_block + 1;
+    if (prefetched_until_ < next_block) {
+        prefetched_until_ = next_block;
+    }
+    if (prefetched_until_ - next_block > window_ / 2) {
+        return true;
+    }
+    uint64_t end_block = next_block + window_;
+    if (end_block > block_count_) {
+        end_block = block_count_;
+    }
+    if (prefetched_until_ >= end_block) {
+        return true;
+    }
+    if (fill_running_) {
+        // the next read tries again
+        return true;
+    }
+    uint64_t begin_block = prefetched_until_;
+    prefetched_until_ = end_block;
+
+    fill_running_ = true;
+    ReadAheadFillTask* task = new ReadAheadFillTask(this, stream_id_, begin_block, end_block, pending_containers_);
+    if (!tp_->SubmitNoFuture(task, Threadpool::BACKGROUND_PRIORITY, Threadpool::ACCEPT)) {
+        delete task;
+        fill_running_ = false;
+        ERROR("Failed to submit read-ahead: " << DebugString());
+        return false;
+    }
+    return true;
+}
+
+string ReadAhead::DebugString() const {
+    stringstream sstr;
+    sstr << "[read ahead: window " << window_ <<
+    ", sequential count " << sequential_count_ <<
+    ", next offset " << next_offset_ <<
+    ", prefetched until " << prefetched_until_ <<
+    ", pending " << pending_.size() <<
+    ", fill running " << ToString(static_cast<bool>(fill_running_)) << "]";
+    return sstr.str();
+}
+
+}
@@ -24,11 +24,20 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <sstream>
+
 #include <base/bitutil.h>
 #include <base/logging.h>
+#include <base/strutil.h>
 
 using std::map;
 using std::string;
+using std::stringstream;
+using std::vector;
+using dedupv1::base::Option;
+using dedupv1::base::make_option;
+using dedupv1::base::ErrorContext;
+using dedupv1::base::strutil::ToHexString;
 using dedupv1::log::Log;
 using dedupv1::IdleDetector;
 
@@ -45,6 +54,7 @@ MetaFactory<Storage>& Storage::Factory() {
 
 const uint64_t Storage::EMPTY_DATA_STORAGE_ADDRESS = (uint64_t) -2;
 const uint64_t Storage::ILLEGAL_STORAGE_ADDRESS = (uint64_t) -1;
+const uint32_t Storage::NO_STREAM_ID = (uint32_t) -1;
 
 Storage::Storage() {
 }
@@ -77,6 +87,15 @@ bool Storage::CheckIfFull() {
     return false;
 }
 
+bool Storage::WriteNewInStream(uint32_t stream_id,
+                               const void* key, size_t key_size,
+                               const void* data, size_t data_size,
+                               bool is_indexed,
+                               uint64_t* address,
+                               dedupv1::base::ErrorContext* ec) {
+    return WriteNew(key, key_size, data, data_size, is_indexed, address, ec);
+}
+
 bool Storage::DeleteChunk(uint64_t address, const byte* key, size_t key_size, dedupv1::base::ErrorContext* ec) {
     std::list<bytestring> key_list;
     bytestring s;
@@ -86,6 +105,48 @@ bool Storage::DeleteChunk(uint64_t address, const byte* key, size_t key_size, de
 }
 
 
+StorageReadRequest::StorageReadRequest(uint64_t address, const void* key, size_t key_size,
+                                       void* data, uint32_t offset, uint32_t size) {
+    address_ = address;
+    key_ = key;
+    key_size_ = key_size;
+    data_ = data;
+    offset_ = offset;
+    size_ = size;
+    read_size_ = 0;
+}
+
+string StorageReadRequest::DebugString() const {
+    stringstream sstr;
+    sstr << "[address " << address_ <<
+        ", key " << ToHexString(key_, key_size_) <<
+        ", offset " << offset_ <<
+        ", size " << size_ << "]";
+    return sstr.str();
+}
+
+bool Storage::ReadBatch(const vector<StorageReadRequest*>& requests, ErrorContext* ec) {
+    vector<StorageReadRequest*>::const_iterator i;
+    for (i = requests.begin(); i != requests.end(); i++) {
+        StorageReadRequest* request = *i;
+        DCHECK(request, "Request not set");
+        Option<uint32_t> r = Read(request->address(),
+            request->key(),
+            request->key_size(),
+            request->data(),
+            request->offset(),
+            request->size(),
+            ec);
+        CHECK(r.valid(), "Failed to read chunk: " << request->DebugString());
+        request->set_read_size(r.value());
+    }
+    return true;
+}
+
+Option<bool> Storage::Prefetch(uint64_t address, ErrorContext* ec) {
+    return make_option(false);
+}
+
 bool Storage::IsValidAddress(uint64_t address, bool allow_empty) {
     return (address != 0) &&
            (address != Storage::ILLEGAL_STORAGE_ADDRESS) &&
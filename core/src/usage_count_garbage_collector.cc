@@ -104,6 +104,7 @@ using dedupv1::chunkstore::STORAGE_ADDRESS_NOT_COMMITED;
 using dedupv1::chunkstore::STORAGE_ADDRESS_WILL_NEVER_COMMITTED;
 using tbb::tick_count;
 using dedupv1::chunkstore::Storage;
+using dedupv1::chunkstore::READ_CACHE_HINT_NO_POLLUTE;
 using dedupv1::base::ScopedPtr;
 using dedupv1::base::PUT_ERROR;
 using dedupv1::base::PUT_KEEP;
@@ -577,7 +578,7 @@ bool UsageCountGarbageCollector::ProcessGCCandidateItem(const GarbageCollectionC
                 // Read container for reporting
                 enum lookup_result r = LOOKUP_ERROR;
                 Container c(chunk_mapping.data_address(), storage_->GetContainerSize(), false);
-                r = this->storage_->ReadContainerWithCache(&c);
+                r = this->storage_->ReadContainerWithCache(&c, READ_CACHE_HINT_NO_POLLUTE);
                 string container_debug_string;
                 if (r == LOOKUP_ERROR) {
                     container_debug_string += "<read error>";
@@ -625,13 +626,33 @@ bool UsageCountGarbageCollector::ProcessGCCandidateItem(const GarbageCollectionC
             } else {
                 FAULT_POINT("gc.process.before-chunk-index-delete");
                 // now we have a chunk that should be deleted
-                if (this->chunk_index_->Delete(chunk_mapping) == DELETE_ERROR) {
-                    ERROR("Cannot delete from chunk mapping: " << chunk_mapping.DebugString());
-                    failed = true;
+                bool superseded_deleted = true;
+                if (chunk_mapping.superseded_data_address() != Storage::ILLEGAL_STORAGE_ADDRESS) {
+                    // the older copy of a rewritten chunk is deleted before the chunk index entry
+                    // so that a crash in between does not lose its address
+                    TRACE("Delete superseded copy: " << chunk_mapping.DebugString());
+                    if (!storage_->DeleteChunk(chunk_mapping.superseded_data_address(),
+                            chunk_mapping.fingerprint(), chunk_mapping.fingerprint_size(), NO_EC)) {
+                        if (candidate_data.processing()) {
+                            // the copy might have been deleted before a crash
+                            WARNING("Failed to delete superseded copy from storage: " << chunk_mapping.DebugString());
+                        } else {
+                            // the candidate item is kept and processed again later
+                            ERROR("Failed to delete superseded copy from storage: " << chunk_mapping.DebugString());
+                            superseded_deleted = false;
+                            failed = true;
+                        }
+                    }
+                }
+                if (superseded_deleted) {
+                    if (this->chunk_index_->Delete(chunk_mapping) == DELETE_ERROR) {
+                        ERROR("Cannot delete from chunk mapping: " << chunk_mapping.DebugString());
+                        failed = true;
+                    }
+                    *del = make_pair(true, true);
+                    del_set = true;
+                    FAULT_POINT("gc.process.after-chunk-index-delete");
                 }
-                *del = make_pair(true, true);
-                del_set = true;
-                FAULT_POINT("gc.process.after-chunk-index-delete");
             }
             this->stats_.processed_gc_candidates_++;
         }
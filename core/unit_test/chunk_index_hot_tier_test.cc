@@ -0,0 +1,178 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <gtest/gtest.h>
+
+#include <core/chunk_index_hot_tier.h>
+#include <core/chunk_mapping.h>
+#include <test_util/log_assert.h>
+
+using dedupv1::base::LOOKUP_FOUND;
+using dedupv1::base::LOOKUP_NOT_FOUND;
+
+namespace dedupv1 {
+namespace chunkindex {
+
+class ChunkIndexHotTierTest : public testing::Test {
+protected:
+    USE_LOGGING_EXPECTATION();
+
+    ChunkIndexHotTier* tier_;
+
+    virtual void SetUp() {
+        tier_ = new ChunkIndexHotTier();
+    }
+
+    virtual void TearDown() {
+        if (tier_) {
+            delete tier_;
+        }
+    }
+
+    ChunkMapping CreateMapping(uint64_t i) {
+        byte fp[20];
+        memset(fp, 0, sizeof(fp));
+        memcpy(fp, &i, sizeof(i));
+        ChunkMapping mapping(fp, sizeof(fp));
+        mapping.set_data_address(i + 1);
+        return mapping;
+    }
+};
+
+TEST_F(ChunkIndexHotTierTest, Init) {
+}
+
+TEST_F(ChunkIndexHotTierTest, DisabledByDefault) {
+    ASSERT_TRUE(tier_->Start());
+    ASSERT_FALSE(tier_->IsEnabled());
+}
+
+TEST_F(ChunkIndexHotTierTest, IllegalOption) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Repeatedly();
+
+    ASSERT_FALSE(tier_->SetOption("size", "abc"));
+    ASSERT_FALSE(tier_->SetOption("admission", "abc"));
+    ASSERT_FALSE(tier_->SetOption("no-option", "1"));
+}
+
+TEST_F(ChunkIndexHotTierTest, AdmitAndLookup) {
+    ASSERT_TRUE(tier_->SetOption("size", "1K"));
+    ASSERT_TRUE(tier_->Start());
+    ASSERT_TRUE(tier_->IsEnabled());
+
+    ChunkMapping mapping = CreateMapping(1);
+    mapping.set_usage_count(7);
+    mapping.set_block_hint(42);
+
+    ChunkMapping lookup_mapping = CreateMapping(1);
+    uint32_t epoch = 0;
+    ASSERT_EQ(tier_->Lookup(&lookup_mapping, &epoch), LOOKUP_NOT_FOUND);
+    ASSERT_TRUE(tier_->Admit(mapping, epoch));
+
+    ChunkMapping lookup_mapping2 = CreateMapping(1);
+    lookup_mapping2.set_data_address(0);
+    ASSERT_EQ(tier_->Lookup(&lookup_mapping2, &epoch), LOOKUP_FOUND);
+    ASSERT_EQ(lookup_mapping2.data_address(), 2U);
+    ASSERT_EQ(lookup_mapping2.usage_count(), 7);
+    ASSERT_TRUE(lookup_mapping2.has_block_hint());
+    ASSERT_EQ(lookup_mapping2.block_hint(), 42U);
+}
+
+TEST_F(ChunkIndexHotTierTest, UpdateAndRemove) {
+    ASSERT_TRUE(tier_->SetOption("size", "1K"));
+    ASSERT_TRUE(tier_->Start());
+
+    ChunkMapping mapping = CreateMapping(1);
+    uint32_t epoch = 0;
+    ASSERT_EQ(tier_->Lookup(&mapping, &epoch), LOOKUP_NOT_FOUND);
+    mapping.set_data_address(2);
+    ASSERT_TRUE(tier_->Admit(mapping, epoch));
+
+    mapping.set_data_address(10);
+    ASSERT_TRUE(tier_->Update(mapping));
+
+    ChunkMapping lookup_mapping = CreateMapping(1);
+    ASSERT_EQ(tier_->Lookup(&lookup_mapping, &epoch), LOOKUP_FOUND);
+    ASSERT_EQ(lookup_mapping.data_address(), 10U);
+
+    ASSERT_TRUE(tier_->Remove(mapping.fingerprint(), mapping.fingerprint_size()));
+    ASSERT_EQ(tier_->Lookup(&lookup_mapping, &epoch), LOOKUP_NOT_FOUND);
+}
+
+TEST_F(ChunkIndexHotTierTest, RejectOutdatedAdmission) {
+    ASSERT_TRUE(tier_->SetOption("size", "1K"));
+    ASSERT_TRUE(tier_->Start());
+
+    ChunkMapping mapping = CreateMapping(1);
+    uint32_t epoch = 0;
+    ASSERT_EQ(tier_->Lookup(&mapping, &epoch), LOOKUP_NOT_FOUND);
+
+    // concurrent update between the persistent lookup and the admission
+    ASSERT_TRUE(tier_->Update(mapping));
+    ASSERT_TRUE(tier_->Admit(mapping, epoch));
+
+    ASSERT_EQ(tier_->Lookup(&mapping, &epoch), LOOKUP_NOT_FOUND);
+}
+
+TEST_F(ChunkIndexHotTierTest, FrequencyAdmission) {
+    // a single set
+    ASSERT_TRUE(tier_->SetOption("size", "8"));
+    ASSERT_TRUE(tier_->Start());
+
+    uint32_t epoch = 0;
+    for (uint64_t i = 0; i < 8; i++) {
+        ChunkMapping mapping = CreateMapping(i);
+        for (int j = 0; j < 4; j++) {
+            if (tier_->Lookup(&mapping, &epoch) == LOOKUP_NOT_FOUND) {
+                ASSERT_TRUE(tier_->Admit(mapping, epoch));
+            }
+        }
+    }
+
+    // a chunk that is only seen once should not replace a popular chunk
+    ChunkMapping rare_mapping = CreateMapping(100);
+    ASSERT_EQ(tier_->Lookup(&rare_mapping, &epoch), LOOKUP_NOT_FOUND);
+    ASSERT_TRUE(tier_->Admit(rare_mapping, epoch));
+    ASSERT_EQ(tier_->Lookup(&rare_mapping, &epoch), LOOKUP_NOT_FOUND);
+
+    // but a chunk that is seen often should
+    ChunkMapping popular_mapping = CreateMapping(200);
+    for (int j = 0; j < 10; j++) {
+        if (tier_->Lookup(&popular_mapping, &epoch) == LOOKUP_NOT_FOUND) {
+            ASSERT_TRUE(tier_->Admit(popular_mapping, epoch));
+        }
+    }
+    ASSERT_EQ(tier_->Lookup(&popular_mapping, &epoch), LOOKUP_FOUND);
+}
+
+TEST_F(ChunkIndexHotTierTest, Clear) {
+    ASSERT_TRUE(tier_->SetOption("size", "1K"));
+    ASSERT_TRUE(tier_->Start());
+
+    uint32_t epoch = 0;
+    ChunkMapping mapping = CreateMapping(1);
+    ASSERT_EQ(tier_->Lookup(&mapping, &epoch), LOOKUP_NOT_FOUND);
+    ASSERT_TRUE(tier_->Admit(mapping, epoch));
+    ASSERT_TRUE(tier_->Clear());
+    ASSERT_EQ(tier_->Lookup(&mapping, &epoch), LOOKUP_NOT_FOUND);
+}
+
+}
+}
@@ -167,6 +167,42 @@ TEST_P(ChunkIndexTest, ContainerFailed) {
     ASSERT_TRUE(storage->FailWriteCacheContainer(test_address[kTestDataCount - 1]));
 }
 
+TEST_P(ChunkIndexTest, ContainerFailedAfterRewrite) {
+    EXPECT_LOGGING(dedupv1::test::WARN).Matches("Failed to commit container").Times(0, 1);
+
+    string config = GetParam();
+    config += ";storage.container-size=4M";
+    system =  DedupSystemTest::CreateDefaultSystem(config, &info_store, &tp, true, false, false);
+    ASSERT_TRUE(system);
+    ChunkIndex* chunk_index = system->chunk_index();
+    ContainerStorage* storage = dynamic_cast<ContainerStorage*>(system->storage());
+    ASSERT_TRUE(storage);
+
+    WriteTestData(chunk_index, storage);
+    ASSERT_TRUE(storage->Flush(NO_EC));
+
+    // rewrite the first chunk into a new container
+    uint64_t rewrite_address = Storage::ILLEGAL_STORAGE_ADDRESS;
+    ASSERT_TRUE(storage->WriteNew(&test_fp[0],
+            sizeof(test_fp[0]), test_data[0], kTestDataSize, true,
+            &rewrite_address, NO_EC));
+    ASSERT_NE(rewrite_address, test_address[0]);
+
+    ChunkMapping mapping((byte *) &test_fp[0], sizeof(test_fp[0]));
+    ASSERT_EQ(chunk_index->Lookup(&mapping, false, NO_EC), LOOKUP_FOUND);
+    mapping.set_superseded_data_address(mapping.data_address());
+    mapping.set_data_address(rewrite_address);
+    ASSERT_TRUE(chunk_index->Put(mapping, NO_EC));
+
+    ASSERT_TRUE(storage->FailWriteCacheContainer(rewrite_address));
+
+    // the old copy is used again
+    ChunkMapping mapping2((byte *) &test_fp[0], sizeof(test_fp[0]));
+    ASSERT_EQ(chunk_index->Lookup(&mapping2, false, NO_EC), LOOKUP_FOUND);
+    ASSERT_EQ(mapping2.data_address(), test_address[0]);
+    ASSERT_EQ(mapping2.superseded_data_address(), Storage::ILLEGAL_STORAGE_ADDRESS);
+}
+
 TEST_P(ChunkIndexTest, UsageCountUpdate) {
     system =  DedupSystemTest::CreateDefaultSystem(GetParam(), &info_store, &tp, true, false, false);
     ASSERT_TRUE(system);
@@ -73,6 +73,29 @@ TEST_F(ChunkMappingTest, SerializeWithUsageCount) {
     ASSERT_EQ(m2.usage_count(), (unsigned int) 10);
 }
 
+TEST_F(ChunkMappingTest, SerializeWithSupersededAddress) {
+    uint64_t fp = 1;
+    ChunkMapping m1((byte *) &fp, sizeof(fp));
+    m1.set_data_address(10);
+    m1.set_superseded_data_address(5);
+
+    ChunkMappingData value;
+    ASSERT_TRUE(m1.SerializeTo(&value));
+
+    ChunkMapping m2;
+    ASSERT_TRUE(m2.UnserializeFrom(value, false));
+    ASSERT_EQ(m2.data_address(), 10U);
+    ASSERT_EQ(m2.superseded_data_address(), 5U);
+
+    // a mapping without an older copy clears the address
+    ChunkMapping m3((byte *) &fp, sizeof(fp));
+    m3.set_data_address(10);
+    ASSERT_TRUE(m3.SerializeTo(&value));
+    ASSERT_FALSE(value.has_superseded_data_address());
+    ASSERT_TRUE(m2.UnserializeFrom(value, false));
+    ASSERT_EQ(m2.superseded_data_address(), Storage::ILLEGAL_STORAGE_ADDRESS);
+}
+
 TEST_F(ChunkMappingTest, InitWithFP) {
     uint64_t fp = 1;
     ChunkMapping m((byte *) &fp, sizeof(fp));
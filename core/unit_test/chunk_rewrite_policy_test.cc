@@ -0,0 +1,141 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <gtest/gtest.h>
+
+#include <core/chunk_rewrite_policy.h>
+#include <test_util/log_assert.h>
+
+namespace dedupv1 {
+namespace filter {
+
+class ChunkRewritePolicyTest : public testing::Test {
+protected:
+    USE_LOGGING_EXPECTATION();
+
+    ChunkRewritePolicy* policy_;
+
+    virtual void SetUp() {
+        policy_ = new ChunkRewritePolicy();
+    }
+
+    virtual void TearDown() {
+        if (policy_) {
+            delete policy_;
+        }
+    }
+};
+
+TEST_F(ChunkRewritePolicyTest, Init) {
+    ASSERT_TRUE(policy_->Start());
+}
+
+TEST_F(ChunkRewritePolicyTest, IllegalOption) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Repeatedly();
+
+    ASSERT_FALSE(policy_->SetOption("window-size", "abc"));
+    ASSERT_FALSE(policy_->SetOption("max-ratio", "2.0"));
+    ASSERT_FALSE(policy_->SetOption("no-option", "1"));
+}
+
+TEST_F(ChunkRewritePolicyTest, IllegalThreshold) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Once();
+
+    ASSERT_TRUE(policy_->SetOption("window-size", "16"));
+    ASSERT_TRUE(policy_->SetOption("container-threshold", "16"));
+    ASSERT_FALSE(policy_->Start());
+}
+
+TEST_F(ChunkRewritePolicyTest, NoRewriteWithLowFragmentation) {
+    ASSERT_TRUE(policy_->SetOption("window-size", "16"));
+    ASSERT_TRUE(policy_->SetOption("container-threshold", "4"));
+    ASSERT_TRUE(policy_->SetOption("max-ratio", "1.0"));
+    ASSERT_TRUE(policy_->Start());
+
+    for (int i = 0; i < 64; i++) {
+        policy_->OnWrite(1, 1024);
+        ASSERT_FALSE(policy_->ShouldRewrite(1, i % 4, 1024));
+    }
+    ASSERT_EQ(4U, policy_->GetFragmentation(1));
+}
+
+TEST_F(ChunkRewritePolicyTest, RewriteWithHighFragmentation) {
+    ASSERT_TRUE(policy_->SetOption("window-size", "16"));
+    ASSERT_TRUE(policy_->SetOption("container-threshold", "4"));
+    ASSERT_TRUE(policy_->SetOption("min-references", "2"));
+    ASSERT_TRUE(policy_->SetOption("max-ratio", "1.0"));
+    ASSERT_TRUE(policy_->Start());
+
+    int rewrite_count = 0;
+    for (int i = 0; i < 64; i++) {
+        policy_->OnWrite(1, 1024);
+        if (policy_->ShouldRewrite(1, i, 1024)) {
+            rewrite_count++;
+        }
+    }
+    // the first 5 chunks fill the window up to the threshold
+    ASSERT_EQ(64 - 5, rewrite_count);
+    ASSERT_EQ(5U, policy_->GetFragmentation(1));
+
+    // other volumes are not affected
+    ASSERT_EQ(0U, policy_->GetFragmentation(2));
+    policy_->OnWrite(2, 1024);
+    ASSERT_FALSE(policy_->ShouldRewrite(2, 100, 1024));
+}
+
+TEST_F(ChunkRewritePolicyTest, NoRewriteOfDenseContainer) {
+    ASSERT_TRUE(policy_->SetOption("window-size", "16"));
+    ASSERT_TRUE(policy_->SetOption("container-threshold", "4"));
+    ASSERT_TRUE(policy_->SetOption("min-references", "2"));
+    ASSERT_TRUE(policy_->SetOption("max-ratio", "1.0"));
+    ASSERT_TRUE(policy_->Start());
+
+    uint64_t containers[] = {0, 0, 1, 2, 3, 4};
+    for (int i = 0; i < 6; i++) {
+        policy_->OnWrite(1, 1024);
+        ASSERT_FALSE(policy_->ShouldRewrite(1, containers[i], 1024));
+    }
+    policy_->OnWrite(1, 1024);
+    ASSERT_FALSE(policy_->ShouldRewrite(1, 0, 1024)) << "Container 0 has two references";
+
+    policy_->OnWrite(1, 1024);
+    ASSERT_TRUE(policy_->ShouldRewrite(1, 1, 1024)) << "Container 1 has only a single reference";
+}
+
+TEST_F(ChunkRewritePolicyTest, RewriteCapped) {
+    ASSERT_TRUE(policy_->SetOption("window-size", "16"));
+    ASSERT_TRUE(policy_->SetOption("container-threshold", "4"));
+    ASSERT_TRUE(policy_->SetOption("min-references", "2"));
+    ASSERT_TRUE(policy_->SetOption("max-ratio", "0.1"));
+    ASSERT_TRUE(policy_->Start());
+
+    int rewrite_count = 0;
+    for (int i = 0; i < 1000; i++) {
+        policy_->OnWrite(1, 1024);
+        if (policy_->ShouldRewrite(1, i, 1024)) {
+            rewrite_count++;
+        }
+    }
+    ASSERT_LE(rewrite_count, 100);
+    ASSERT_GE(rewrite_count, 90);
+}
+
+}
+}
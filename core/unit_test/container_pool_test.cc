@@ -0,0 +1,196 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <gtest/gtest.h>
+
+#include <core/dedup.h>
+#include <core/container_pool.h>
+#include <core/container.h>
+#include <core/storage.h>
+#include <base/logging.h>
+
+#include <test_util/log_assert.h>
+
+#include <string.h>
+
+LOGGER("ContainerPoolTest");
+
+namespace dedupv1 {
+namespace chunkstore {
+
+class ContainerPoolTest : public testing::Test {
+protected:
+    USE_LOGGING_EXPECTATION();
+
+    static const size_t kContainerSize = Container::kDefaultContainerSize;
+
+    ContainerPool* pool;
+
+    virtual void SetUp() {
+        pool = new ContainerPool();
+        ASSERT_TRUE(pool);
+    }
+
+    virtual void TearDown() {
+        if (pool) {
+            delete pool;
+            pool = NULL;
+        }
+    }
+};
+
+TEST_F(ContainerPoolTest, Create) {
+    ASSERT_FALSE(pool->is_started());
+    ASSERT_EQ(0U, pool->GetFreeCount());
+}
+
+TEST_F(ContainerPoolTest, AcquireBeforeStart) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Once();
+
+    ASSERT_TRUE(pool->Acquire(1, false) == NULL);
+}
+
+TEST_F(ContainerPoolTest, IllegalOption) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Times(2);
+
+    ASSERT_FALSE(pool->SetOption("size", "abc"));
+    ASSERT_FALSE(pool->SetOption("unknown", "1"));
+}
+
+TEST_F(ContainerPoolTest, Reuse) {
+    ASSERT_TRUE(pool->Start(kContainerSize));
+
+    Container* container = pool->Acquire(1, false);
+    ASSERT_TRUE(container);
+    ASSERT_EQ(1U, container->primary_id());
+    ASSERT_FALSE(container->is_metadata_only());
+    pool->Release(container);
+    ASSERT_EQ(1U, pool->GetFreeCount());
+
+    Container* container2 = pool->Acquire(2, false);
+    ASSERT_TRUE(container2 == container);
+    ASSERT_EQ(2U, container2->primary_id());
+    ASSERT_EQ(0U, container2->item_count());
+    ASSERT_EQ(0U, pool->GetFreeCount());
+    pool->Release(container2);
+}
+
+TEST_F(ContainerPoolTest, MetadataOnlySeparation) {
+    ASSERT_TRUE(pool->Start(kContainerSize));
+
+    Container* container = pool->Acquire(1, true);
+    ASSERT_TRUE(container);
+    ASSERT_TRUE(container->is_metadata_only());
+    pool->Release(container);
+
+    Container* container2 = pool->Acquire(2, false);
+    ASSERT_TRUE(container2);
+    ASSERT_TRUE(container2 != container);
+    ASSERT_FALSE(container2->is_metadata_only());
+
+    Container* container3 = pool->Acquire(3, true);
+    ASSERT_TRUE(container3 == container);
+    ASSERT_TRUE(container3->is_metadata_only());
+
+    pool->Release(container2);
+    pool->Release(container3);
+    ASSERT_EQ(2U, pool->GetFreeCount());
+}
+
+TEST_F(ContainerPoolTest, Bounded) {
+    ASSERT_TRUE(pool->SetOption("size", "2"));
+    ASSERT_TRUE(pool->Start(kContainerSize));
+
+    Container* containers[4];
+    for (int i = 0; i < 4; i++) {
+        containers[i] = pool->Acquire(i + 1, false);
+        ASSERT_TRUE(containers[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        pool->Release(containers[i]);
+    }
+    ASSERT_EQ(2U, pool->GetFreeCount());
+}
+
+TEST_F(ContainerPoolTest, DisabledPooling) {
+    ASSERT_TRUE(pool->SetOption("size", "0"));
+    ASSERT_TRUE(pool->Start(kContainerSize));
+
+    Container* container = pool->Acquire(1, false);
+    ASSERT_TRUE(container);
+    pool->Release(container);
+    ASSERT_EQ(0U, pool->GetFreeCount());
+}
+
+TEST_F(ContainerPoolTest, ReleaseForeignContainer) {
+    ASSERT_TRUE(pool->Start(kContainerSize));
+
+    // a container with a different size is not pooled
+    Container* container = new Container(1, kContainerSize * 2, false);
+    ASSERT_TRUE(container);
+    pool->Release(container);
+    ASSERT_EQ(0U, pool->GetFreeCount());
+
+    container = new Container(1, kContainerSize, false);
+    ASSERT_TRUE(container);
+    pool->Release(container);
+    ASSERT_EQ(1U, pool->GetFreeCount());
+}
+
+/**
+ * Huge pages might not be available in the test environment. The container
+ * data buffer has to be usable in both cases.
+ */
+TEST_F(ContainerPoolTest, HugePages) {
+    ASSERT_TRUE(pool->SetOption("huge-pages", "true"));
+    ASSERT_TRUE(pool->Start(kContainerSize));
+
+    Container* container = pool->Acquire(1, false);
+    ASSERT_TRUE(container);
+
+    uint64_t fp = 17;
+    byte data[16 * 1024];
+    memset(data, 7, sizeof(data));
+    ASSERT_TRUE(container->AddItem(reinterpret_cast<byte*>(&fp), sizeof(fp), data, sizeof(data), true, NULL));
+
+    const ContainerItem* item = container->FindItem(&fp, sizeof(fp));
+    ASSERT_TRUE(item);
+    byte result[16 * 1024];
+    ASSERT_TRUE(container->CopyRawData(item, result, 0, sizeof(result)));
+    ASSERT_EQ(0, memcmp(data, result, sizeof(data)));
+    pool->Release(container);
+}
+
+TEST_F(ContainerPoolTest, ScopedPoolContainer) {
+    ASSERT_TRUE(pool->Start(kContainerSize));
+    {
+        ScopedPoolContainer pool_container(pool, 1, false);
+        ASSERT_TRUE(pool_container.Get());
+        ASSERT_EQ(1U, pool_container->primary_id());
+        ASSERT_EQ(0U, pool->GetFreeCount());
+    }
+    ASSERT_EQ(1U, pool->GetFreeCount());
+
+    ScopedPoolContainer no_pool(NULL, 1, false);
+    ASSERT_TRUE(no_pool.Get() == NULL);
+}
+
+}
+}
@@ -0,0 +1,131 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <core/dedup.h>
+#include <core/container_storage_adaptive_compression.h>
+#include <core/storage.h>
+#include <base/logging.h>
+
+#include <test_util/log_assert.h>
+
+LOGGER("ContainerStorageAdaptiveCompressionTest");
+
+namespace dedupv1 {
+namespace chunkstore {
+
+class ContainerStorageAdaptiveCompressionTest : public testing::Test {
+protected:
+    USE_LOGGING_EXPECTATION();
+
+    ContainerStorageAdaptiveCompression* adaptive;
+
+    byte zero_data[8192];
+    byte random_data[8192];
+
+    virtual void SetUp() {
+        adaptive = new ContainerStorageAdaptiveCompression();
+        ASSERT_TRUE(adaptive);
+
+        memset(zero_data, 0, sizeof(zero_data));
+        unsigned int seed = 0;
+        for (size_t i = 0; i < sizeof(random_data); i++) {
+            random_data[i] = rand_r(&seed) % 256;
+        }
+    }
+
+    virtual void TearDown() {
+        if (adaptive) {
+            delete adaptive;
+            adaptive = NULL;
+        }
+    }
+};
+
+TEST_F(ContainerStorageAdaptiveCompressionTest, Create) {
+}
+
+TEST_F(ContainerStorageAdaptiveCompressionTest, EstimateEntropy) {
+    double zero_entropy = ContainerStorageAdaptiveCompression::EstimateEntropy(zero_data, sizeof(zero_data), 2048);
+    ASSERT_EQ(0.0, zero_entropy);
+
+    double random_entropy = ContainerStorageAdaptiveCompression::EstimateEntropy(random_data, sizeof(random_data), 2048);
+    ASSERT_GT(random_entropy, 7.5);
+    ASSERT_LE(random_entropy, 8.0);
+
+    ASSERT_EQ(0.0, ContainerStorageAdaptiveCompression::EstimateEntropy(random_data, 0, 2048));
+}
+
+TEST_F(ContainerStorageAdaptiveCompressionTest, SkipIncompressibleChunk) {
+    ASSERT_TRUE(adaptive->Start());
+
+    ASSERT_TRUE(adaptive->ShouldCompress(Storage::NO_STREAM_ID, zero_data, sizeof(zero_data)));
+    ASSERT_FALSE(adaptive->ShouldCompress(Storage::NO_STREAM_ID, random_data, sizeof(random_data)));
+}
+
+TEST_F(ContainerStorageAdaptiveCompressionTest, DisableStream) {
+    ASSERT_TRUE(adaptive->SetOption("window-size", "4"));
+    ASSERT_TRUE(adaptive->SetOption("skip-count", "8"));
+    ASSERT_TRUE(adaptive->Start());
+
+    // the chunks pass the entropy check, but do not compress well
+    for (int i = 0; i < 4; i++) {
+        ASSERT_TRUE(adaptive->ShouldCompress(1, zero_data, sizeof(zero_data)));
+        adaptive->ReportCompression(1, 8192, 8192);
+    }
+
+    // the compression is switched off for stream 1
+    for (int i = 0; i < 8; i++) {
+        ASSERT_FALSE(adaptive->ShouldCompress(1, zero_data, sizeof(zero_data)));
+    }
+    // other streams are not affected
+    ASSERT_TRUE(adaptive->ShouldCompress(2, zero_data, sizeof(zero_data)));
+
+    // after the skip count, the stream is probed again
+    ASSERT_TRUE(adaptive->ShouldCompress(1, zero_data, sizeof(zero_data)));
+}
+
+TEST_F(ContainerStorageAdaptiveCompressionTest, KeepStreamEnabled) {
+    ASSERT_TRUE(adaptive->SetOption("window-size", "4"));
+    ASSERT_TRUE(adaptive->Start());
+
+    for (int i = 0; i < 16; i++) {
+        ASSERT_TRUE(adaptive->ShouldCompress(1, zero_data, sizeof(zero_data)));
+        adaptive->ReportCompression(1, 8192, 1024);
+    }
+    ASSERT_TRUE(adaptive->ShouldCompress(1, zero_data, sizeof(zero_data)));
+}
+
+TEST_F(ContainerStorageAdaptiveCompressionTest, IllegalOptions) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Times(4);
+
+    ASSERT_FALSE(adaptive->SetOption("entropy-threshold", "9.0"));
+    ASSERT_FALSE(adaptive->SetOption("window-size", "0"));
+    ASSERT_FALSE(adaptive->SetOption("min-gain-ratio", "2.0"));
+    ASSERT_FALSE(adaptive->SetOption("unknown", "1"));
+}
+
+}
+}
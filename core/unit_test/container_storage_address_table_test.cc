@@ -0,0 +1,183 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <gtest/gtest.h>
+
+#include <core/dedup.h>
+#include <base/index.h>
+#include <base/logging.h>
+#include <core/container_storage_address_table.h>
+
+#include "dedupv1.pb.h"
+
+#include <test_util/log_assert.h>
+
+LOGGER("ContainerStorageAddressTableTest");
+
+using dedupv1::chunkstore::ContainerStorageAddressTable;
+using dedupv1::base::Index;
+using dedupv1::base::PersistentIndex;
+using dedupv1::base::LOOKUP_NOT_FOUND;
+using dedupv1::base::LOOKUP_FOUND;
+using dedupv1::base::PUT_OK;
+using dedupv1::StartContext;
+
+class ContainerStorageAddressTableTest : public testing::Test {
+protected:
+    USE_LOGGING_EXPECTATION();
+
+    ContainerStorageAddressTable* table;
+    PersistentIndex* index;
+
+    virtual void SetUp() {
+        table = new ContainerStorageAddressTable();
+
+        Index* i = Index::Factory().Create("sqlite-disk-btree");
+        ASSERT_TRUE(i);
+        index = i->AsPersistentIndex();
+        ASSERT_TRUE(index);
+        ASSERT_TRUE(index->SetOption("filename", "work/container-meta-data"));
+        ASSERT_TRUE(index->SetOption("max-item-count", "1M"));
+        ASSERT_TRUE(index->SetOption("max-key-size", "8"));
+        ASSERT_TRUE(index->SetOption("max-value-size", "16"));
+        ASSERT_TRUE(index->Start(StartContext()));
+    }
+
+    virtual void TearDown() {
+        if (table) {
+            delete table;
+            table = NULL;
+        }
+        if (index) {
+            delete index;
+            index = NULL;
+        }
+    }
+
+    ContainerStorageAddressData MakePrimaryAddress(uint32_t file_index, uint64_t file_offset) {
+        ContainerStorageAddressData address;
+        address.set_file_index(file_index);
+        address.set_file_offset(file_offset);
+        address.set_log_id(7);
+        return address;
+    }
+
+    ContainerStorageAddressData MakeSecondaryAddress(uint64_t primary_id) {
+        ContainerStorageAddressData address;
+        address.set_primary_id(primary_id);
+        return address;
+    }
+};
+
+TEST_F(ContainerStorageAddressTableTest, StartEmpty) {
+    ASSERT_TRUE(table->Start(index));
+    ASSERT_TRUE(table->is_started());
+    ASSERT_EQ(table->GetSize(), 0U);
+
+    ContainerStorageAddressData address;
+    ASSERT_EQ(table->Lookup(1, &address), LOOKUP_NOT_FOUND);
+    ASSERT_EQ(table->Lookup(1000, NULL), LOOKUP_NOT_FOUND);
+}
+
+TEST_F(ContainerStorageAddressTableTest, Update) {
+    ASSERT_TRUE(table->Start(index));
+
+    ASSERT_TRUE(table->Update(1, MakePrimaryAddress(2, 4 * 1024 * 1024)));
+    ASSERT_TRUE(table->Update(5, MakeSecondaryAddress(1)));
+    ASSERT_EQ(table->GetSize(), 2U);
+
+    ContainerStorageAddressData address;
+    ASSERT_EQ(table->Lookup(1, &address), LOOKUP_FOUND);
+    ASSERT_FALSE(address.has_primary_id());
+    ASSERT_EQ(address.file_index(), 2U);
+    ASSERT_EQ(address.file_offset(), 4U * 1024 * 1024);
+    ASSERT_EQ(address.log_id(), 7U);
+
+    ASSERT_EQ(table->Lookup(5, &address), LOOKUP_FOUND);
+    ASSERT_TRUE(address.has_primary_id());
+    ASSERT_EQ(address.primary_id(), 1U);
+    ASSERT_FALSE(address.has_file_index());
+    ASSERT_FALSE(address.has_log_id());
+
+    ASSERT_EQ(table->Lookup(3, &address), LOOKUP_NOT_FOUND);
+
+    // overwrite
+    ASSERT_TRUE(table->Update(1, MakePrimaryAddress(0, 8 * 1024 * 1024)));
+    ASSERT_EQ(table->GetSize(), 2U);
+    ASSERT_EQ(table->Lookup(1, &address), LOOKUP_FOUND);
+    ASSERT_EQ(address.file_index(), 0U);
+    ASSERT_EQ(address.file_offset(), 8U * 1024 * 1024);
+}
+
+TEST_F(ContainerStorageAddressTableTest, Delete) {
+    ASSERT_TRUE(table->Start(index));
+
+    ASSERT_TRUE(table->Update(1, MakePrimaryAddress(0, 0)));
+    ASSERT_TRUE(table->Update(2, MakeSecondaryAddress(1)));
+    ASSERT_TRUE(table->Delete(2));
+    ASSERT_EQ(table->GetSize(), 1U);
+    ASSERT_EQ(table->Lookup(2, NULL), LOOKUP_NOT_FOUND);
+    ASSERT_EQ(table->Lookup(1, NULL), LOOKUP_FOUND);
+
+    // deleting a not existing address is not an error
+    ASSERT_TRUE(table->Delete(2));
+    ASSERT_TRUE(table->Delete(1000));
+    ASSERT_EQ(table->GetSize(), 1U);
+}
+
+TEST_F(ContainerStorageAddressTableTest, StartFromIndex) {
+    for (uint64_t container_id = 1; container_id <= 128; container_id++) {
+        ContainerStorageAddressData address;
+        if (container_id % 4 == 0) {
+            address = MakeSecondaryAddress(container_id - 1);
+        } else {
+            address = MakePrimaryAddress(container_id % 3, container_id * 4 * 1024 * 1024);
+        }
+        ASSERT_EQ(index->Put(&container_id, sizeof(container_id), address), PUT_OK);
+    }
+
+    ASSERT_TRUE(table->Start(index));
+    ASSERT_EQ(table->GetSize(), 128U);
+
+    for (uint64_t container_id = 1; container_id <= 128; container_id++) {
+        ContainerStorageAddressData address;
+        ASSERT_EQ(table->Lookup(container_id, &address), LOOKUP_FOUND);
+        if (container_id % 4 == 0) {
+            ASSERT_EQ(address.primary_id(), container_id - 1);
+        } else {
+            ASSERT_FALSE(address.has_primary_id());
+            ASSERT_EQ(address.file_index(), container_id % 3);
+            ASSERT_EQ(address.file_offset(), container_id * 4 * 1024 * 1024);
+            ASSERT_EQ(address.log_id(), 7U);
+        }
+    }
+    ASSERT_EQ(table->Lookup(129, NULL), LOOKUP_NOT_FOUND);
+}
+
+TEST_F(ContainerStorageAddressTableTest, IllegalAddress) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Once();
+
+    ASSERT_TRUE(table->Start(index));
+
+    ContainerStorageAddressData address;
+    address.set_file_index(1);
+    ASSERT_FALSE(table->Update(1, address));
+    ASSERT_EQ(table->Lookup(1, NULL), LOOKUP_NOT_FOUND);
+}
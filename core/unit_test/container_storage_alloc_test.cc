@@ -117,7 +117,7 @@ protected:
     }
 
     void CreateSystem(const std::string& configuration) {
-        system = dedupv1::DedupSystemTest::CreateDefaultSystem(GetParam(), &info_store, &tp);
+        system = dedupv1::DedupSystemTest::CreateDefaultSystem(configuration, &info_store, &tp);
         ASSERT_TRUE(system);
 
         storage = dynamic_cast<ContainerStorage*>(system->storage());
@@ -183,6 +183,30 @@ TEST_P(MemoryBitmapAllocatorTest, GetNextFile) {
     }
 }
 
+/**
+ * This test case tests that consecutive containers of a file run are allocated
+ * on the same file at adjacent addresses.
+ */
+TEST_P(MemoryBitmapAllocatorTest, FileRunLength) {
+    CreateSystem(std::string(GetParam()) + ";storage.alloc.file-run-length=4");
+
+    Container c(0, CONTAINER_SIZE, false);
+    FillDefaultContainer(&c, 0, 12 );
+
+    ContainerStorageAddressData last_address_data;
+    for (int i = 0; i < (4 * storage->GetFileCount()); i++) {
+        ContainerStorageAddressData address_data;
+        ASSERT_EQ(ALLOC_OK, alloc->OnNewContainer(c, true, STORAGE_TIER_ANY, &address_data));
+
+        ASSERT_EQ((i / 4) % storage->GetFileCount(), address_data.file_index());
+        if (i % 4 != 0) {
+            ASSERT_EQ(last_address_data.file_index(), address_data.file_index());
+            ASSERT_EQ(last_address_data.file_offset() + storage->GetContainerSize(), address_data.file_offset());
+        }
+        last_address_data = address_data;
+    }
+}
+
 /**
  * This test case tests that the allocator assigned an address at the
  * end of a file when there are no free container places.
@@ -199,7 +223,7 @@ TEST_P(MemoryBitmapAllocatorTest, OnCommit) {
         ContainerStorageAddressData address_data;
         address_data.set_file_index(-2); // set illegal values
         address_data.set_file_offset(-2); // set illegal values
-        ASSERT_EQ(ALLOC_OK, alloc->OnNewContainer(c, true, &address_data));
+        ASSERT_EQ(ALLOC_OK, alloc->OnNewContainer(c, true, STORAGE_TIER_ANY, &address_data));
 
         Option<bool> b = alloc->IsAddressFree(address_data);
         ASSERT_TRUE(b.valid());
@@ -227,18 +251,18 @@ TEST_P(MemoryBitmapAllocatorTest, OnContainerForMerge) {
     ContainerStorageAddressData address_data;
     address_data.set_file_index(-2); // set illegal values
     address_data.set_file_offset(-2); // set illegal values
-    enum alloc_result ar = alloc->OnNewContainer(c, true, &address_data);
+    enum alloc_result ar = alloc->OnNewContainer(c, true, STORAGE_TIER_ANY, &address_data);
     while (ar == ALLOC_OK) {
         address_data.set_file_index(-2); // set illegal values
         address_data.set_file_offset(-2); // set illegal values
-        ar = alloc->OnNewContainer(c, true, &address_data);
+        ar = alloc->OnNewContainer(c, true, STORAGE_TIER_ANY, &address_data);
     }
     ASSERT_EQ(ALLOC_FULL, ar);
     ASSERT_GE(alloc->free_count(), 0);
 
     address_data.set_file_index(-2); // set illegal values
     address_data.set_file_offset(-2); // set illegal values
-    ar = alloc->OnNewContainer(c, false, &address_data);
+    ar = alloc->OnNewContainer(c, false, STORAGE_TIER_ANY, &address_data);
     ASSERT_EQ(ALLOC_OK, ar);
 }
 
@@ -254,7 +278,7 @@ TEST_P(MemoryBitmapAllocatorTest, Overflow) {
         ContainerStorageAddressData address_data;
         address_data.set_file_index(-2); // set illegal values
         address_data.set_file_offset(-2); // set illegal values
-        ASSERT_EQ(ALLOC_OK, alloc->OnNewContainer(c, true, &address_data));
+        ASSERT_EQ(ALLOC_OK, alloc->OnNewContainer(c, true, STORAGE_TIER_ANY, &address_data));
 
         address_map[i] = address_data;
 
@@ -275,7 +299,7 @@ TEST_P(MemoryBitmapAllocatorTest, Overflow) {
         ContainerStorageAddressData address_data;
         address_data.set_file_index(-2); // set illegal values
         address_data.set_file_offset(-2); // set illegal values
-        ASSERT_EQ(ALLOC_OK, alloc->OnNewContainer(c, true, &address_data));
+        ASSERT_EQ(ALLOC_OK, alloc->OnNewContainer(c, true, STORAGE_TIER_ANY, &address_data));
 
         address_map[i] = address_data;
 
@@ -302,7 +326,7 @@ TEST_P(MemoryBitmapAllocatorTest, OnCommitAndFree) {
         ContainerStorageAddressData address_data;
         address_data.set_file_index(-2); // set illegal values
         address_data.set_file_offset(-2); // set illegal values
-        ASSERT_EQ(ALLOC_OK, alloc->OnNewContainer(c, true, &address_data));
+        ASSERT_EQ(ALLOC_OK, alloc->OnNewContainer(c, true, STORAGE_TIER_ANY, &address_data));
 
         address_map[i] = address_data;
 
@@ -329,5 +353,44 @@ TEST_P(MemoryBitmapAllocatorTest, OnCommitAndFree) {
     ASSERT_EQ(free_areas, alloc->free_count());
 }
 
+/**
+ * This test case tests that new containers are placed on the fast tier and
+ * that containers can be explicitly moved between the tiers.
+ */
+TEST_P(MemoryBitmapAllocatorTest, TieredAllocation) {
+    CreateSystem(std::string(GetParam()) + ";storage.filename=work/container-fast;storage.filetier=fast");
+    ASSERT_EQ(2U, storage->GetFileCount());
+    ASSERT_FALSE(storage->file(0).fast_tier());
+    ASSERT_TRUE(storage->file(1).fast_tier());
+
+    Container c(0, CONTAINER_SIZE, false);
+    FillDefaultContainer(&c, 0, 12 );
+
+    for (int i = 0; i < 8; i++) {
+        ContainerStorageAddressData address_data;
+        ASSERT_EQ(ALLOC_OK, alloc->OnNewContainer(c, true, STORAGE_TIER_FAST, &address_data));
+        ASSERT_EQ(1U, address_data.file_index()) << "New container not placed on the fast tier";
+
+        ASSERT_EQ(ALLOC_OK, alloc->OnNewContainer(c, false, STORAGE_TIER_CAPACITY, &address_data));
+        ASSERT_EQ(0U, address_data.file_index()) << "Merged container not placed on the capacity tier";
+
+        ASSERT_EQ(ALLOC_OK, alloc->OnNewContainer(c, false, STORAGE_TIER_FAST, &address_data));
+        ASSERT_EQ(1U, address_data.file_index()) << "Rewritten container not kept on the fast tier";
+
+        ASSERT_EQ(ALLOC_OK, alloc->OnMoveContainer(c, STORAGE_TIER_FAST, &address_data));
+        ASSERT_EQ(1U, address_data.file_index());
+    }
+
+    Option<double> fill_ratio = alloc->GetTierFillRatio(STORAGE_TIER_FAST);
+    ASSERT_TRUE(fill_ratio.valid());
+    ASSERT_GT(fill_ratio.value(), 0.0);
+}
+
+TEST_P(MemoryBitmapAllocatorTest, TierFillRatioWithoutTiers) {
+    CreateSystem(GetParam());
+
+    ASSERT_FALSE(alloc->GetTierFillRatio(STORAGE_TIER_FAST).valid());
+}
+
 }
 }
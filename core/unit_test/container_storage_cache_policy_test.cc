@@ -0,0 +1,222 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <gtest/gtest.h>
+
+#include <map>
+
+#include <core/dedup.h>
+#include <core/container_storage_cache_policy.h>
+#include <base/logging.h>
+
+#include <test_util/log_assert.h>
+
+using std::map;
+
+LOGGER("ContainerStorageCachePolicyTest");
+
+namespace dedupv1 {
+namespace chunkstore {
+
+/**
+ * Simulates the read cache on top of a replacement policy
+ */
+class CacheSimulation {
+    ContainerStorageReadCachePolicy* policy_;
+    map<uint64_t, int> cached_;
+    map<int, uint64_t> lines_;
+public:
+    explicit CacheSimulation(ContainerStorageReadCachePolicy* policy) : policy_(policy) {
+    }
+
+    /**
+     * returns true iff the container was a cache hit
+     */
+    bool Access(uint64_t container_id) {
+        map<uint64_t, int>::iterator i = cached_.find(container_id);
+        if (i != cached_.end()) {
+            EXPECT_TRUE(policy_->Touch(i->second));
+            return true;
+        }
+        int line = policy_->Replace(container_id);
+        EXPECT_GE(line, 0);
+        map<int, uint64_t>::iterator j = lines_.find(line);
+        if (j != lines_.end()) {
+            cached_.erase(j->second);
+        }
+        lines_[line] = container_id;
+        cached_[container_id] = line;
+        return false;
+    }
+
+    bool IsCached(uint64_t container_id) {
+        return cached_.find(container_id) != cached_.end();
+    }
+
+    /**
+     * returns the cache line of the container or -1
+     */
+    int line(uint64_t container_id) {
+        map<uint64_t, int>::iterator i = cached_.find(container_id);
+        if (i == cached_.end()) {
+            return -1;
+        }
+        return i->second;
+    }
+
+    void Remove(uint64_t container_id) {
+        int l = line(container_id);
+        ASSERT_GE(l, 0);
+        ASSERT_TRUE(policy_->Remove(l));
+        cached_.erase(container_id);
+        lines_.erase(l);
+    }
+};
+
+class ContainerStorageCachePolicyTest : public testing::TestWithParam<const char*> {
+protected:
+    USE_LOGGING_EXPECTATION();
+
+    ContainerStorageReadCachePolicy* policy;
+
+    virtual void SetUp() {
+        policy = ContainerStorageReadCachePolicy::Create(GetParam());
+        ASSERT_TRUE(policy);
+        ASSERT_TRUE(policy->Start(4));
+    }
+
+    virtual void TearDown() {
+        if (policy) {
+            delete policy;
+            policy = NULL;
+        }
+    }
+};
+
+TEST_P(ContainerStorageCachePolicyTest, FillAndHit) {
+    CacheSimulation cache(policy);
+    for (uint64_t i = 1; i <= 4; i++) {
+        ASSERT_FALSE(cache.Access(i));
+    }
+    for (uint64_t i = 1; i <= 4; i++) {
+        ASSERT_TRUE(cache.Access(i)) << "Container " << i << " should be cached";
+    }
+    ASSERT_FALSE(policy->PrintStatistics().empty());
+}
+
+TEST_P(ContainerStorageCachePolicyTest, RemovedLineIsReusedFirst) {
+    CacheSimulation cache(policy);
+    for (uint64_t i = 1; i <= 4; i++) {
+        ASSERT_FALSE(cache.Access(i));
+    }
+    int line = cache.line(3);
+    cache.Remove(3);
+
+    ASSERT_FALSE(cache.Access(5));
+    ASSERT_EQ(cache.line(5), line);
+    ASSERT_TRUE(cache.IsCached(1));
+    ASSERT_TRUE(cache.IsCached(2));
+    ASSERT_TRUE(cache.IsCached(4));
+}
+
+INSTANTIATE_TEST_CASE_P(ContainerStorageCachePolicy,
+    ContainerStorageCachePolicyTest,
+    ::testing::Values("lru", "arc"));
+
+class ContainerStorageCachePolicyTypeTest : public testing::Test {
+protected:
+    USE_LOGGING_EXPECTATION();
+};
+
+TEST_F(ContainerStorageCachePolicyTypeTest, IllegalPolicy) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Once();
+
+    ASSERT_FALSE(ContainerStorageReadCachePolicy::Create("fifo"));
+}
+
+TEST_F(ContainerStorageCachePolicyTypeTest, LruEvictsLeastRecentlyUsed) {
+    LruReadCachePolicy policy;
+    ASSERT_TRUE(policy.Start(4));
+    CacheSimulation cache(&policy);
+    for (uint64_t i = 1; i <= 4; i++) {
+        ASSERT_FALSE(cache.Access(i));
+    }
+    ASSERT_TRUE(cache.Access(1));
+    ASSERT_FALSE(cache.Access(5));
+
+    ASSERT_TRUE(cache.IsCached(1));
+    ASSERT_FALSE(cache.IsCached(2));
+}
+
+TEST_F(ContainerStorageCachePolicyTypeTest, ArcIsScanResistant) {
+    ArcReadCachePolicy policy;
+    ASSERT_TRUE(policy.Start(4));
+    CacheSimulation cache(&policy);
+
+    // working set accessed twice
+    ASSERT_FALSE(cache.Access(1));
+    ASSERT_FALSE(cache.Access(2));
+    ASSERT_TRUE(cache.Access(1));
+    ASSERT_TRUE(cache.Access(2));
+
+    // scan
+    for (uint64_t i = 100; i < 200; i++) {
+        ASSERT_FALSE(cache.Access(i));
+    }
+    ASSERT_TRUE(cache.Access(1));
+    ASSERT_TRUE(cache.Access(2));
+}
+
+TEST_F(ContainerStorageCachePolicyTypeTest, LruIsNotScanResistant) {
+    LruReadCachePolicy policy;
+    ASSERT_TRUE(policy.Start(4));
+    CacheSimulation cache(&policy);
+
+    ASSERT_FALSE(cache.Access(1));
+    ASSERT_FALSE(cache.Access(2));
+    ASSERT_TRUE(cache.Access(1));
+    ASSERT_TRUE(cache.Access(2));
+
+    for (uint64_t i = 100; i < 200; i++) {
+        ASSERT_FALSE(cache.Access(i));
+    }
+    ASSERT_FALSE(cache.IsCached(1));
+    ASSERT_FALSE(cache.IsCached(2));
+}
+
+TEST_F(ContainerStorageCachePolicyTypeTest, ArcGhostHit) {
+    ArcReadCachePolicy policy;
+    ASSERT_TRUE(policy.Start(2));
+    CacheSimulation cache(&policy);
+
+    ASSERT_FALSE(cache.Access(1));
+    ASSERT_TRUE(cache.Access(1));
+    ASSERT_FALSE(cache.Access(2));
+    ASSERT_FALSE(cache.Access(3)); // evicts 2 into the ghost list b1
+    ASSERT_FALSE(cache.IsCached(2));
+
+    ASSERT_FALSE(cache.Access(2)); // ghost hit
+    ASSERT_TRUE(cache.IsCached(2));
+    ASSERT_TRUE(policy.PrintStatistics().find("\"b1 ghost hits\": 1") != std::string::npos) << policy.PrintStatistics();
+    ASSERT_TRUE(policy.PrintStatistics().find("\"target t1 size\": 1") != std::string::npos) << policy.PrintStatistics();
+}
+
+}
+}
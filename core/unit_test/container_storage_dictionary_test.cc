@@ -0,0 +1,137 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <core/dedup.h>
+#include <core/container_storage_dictionary.h>
+#include <core/info_store.h>
+#include <base/compress.h>
+#include <base/logging.h>
+
+#include <test_util/log_assert.h>
+
+using std::string;
+using dedupv1::base::Compression;
+
+LOGGER("ContainerStorageCompressionDictionaryTest");
+
+namespace dedupv1 {
+namespace chunkstore {
+
+class ContainerStorageCompressionDictionaryTest : public testing::Test {
+protected:
+    USE_LOGGING_EXPECTATION();
+
+    dedupv1::MemoryInfoStore info_store;
+
+    ContainerStorageCompressionDictionary* dictionary;
+
+    virtual void SetUp() {
+        dictionary = new ContainerStorageCompressionDictionary();
+        ASSERT_TRUE(dictionary);
+    }
+
+    virtual void TearDown() {
+        if (dictionary) {
+            delete dictionary;
+            dictionary = NULL;
+        }
+    }
+
+    /**
+     * Returns a text-like chunk. The chunks share a vocabulary, but are different
+     */
+    string CreateChunk(int i) {
+        const char* words[] = {"volume ", "block ", "chunk ", "container ", "id=", "size=", "name=\"", "\", "};
+        string chunk;
+        unsigned int seed = i;
+        while (chunk.size() < 8192) {
+            char number[16];
+            snprintf(number, sizeof(number), "%d;", rand_r(&seed) % 1000);
+            chunk += words[rand_r(&seed) % 8];
+            chunk += number;
+        }
+        chunk.resize(8192);
+        return chunk;
+    }
+
+    /**
+     * Adds samples until the training should be triggered
+     */
+    void Sample(uint32_t sample_count) {
+        for (uint32_t i = 0; i < sample_count - 1; i++) {
+            string chunk = CreateChunk(i);
+            ASSERT_FALSE(dictionary->AddSample(chunk.data(), chunk.size()));
+        }
+        string chunk = CreateChunk(sample_count);
+        ASSERT_TRUE(dictionary->AddSample(chunk.data(), chunk.size()));
+    }
+};
+
+TEST_F(ContainerStorageCompressionDictionaryTest, Create) {
+    ASSERT_FALSE(dictionary->is_started());
+    ASSERT_TRUE(dictionary->compression() == NULL);
+}
+
+TEST_F(ContainerStorageCompressionDictionaryTest, IllegalOption) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Times(2);
+
+    ASSERT_FALSE(dictionary->SetOption("sample-count", "0"));
+    ASSERT_FALSE(dictionary->SetOption("unknown", "1"));
+}
+
+TEST_F(ContainerStorageCompressionDictionaryTest, TrainAndRestore) {
+    ASSERT_TRUE(dictionary->SetOption("size", "16K"));
+    ASSERT_TRUE(dictionary->SetOption("sample-count", "512"));
+    ASSERT_TRUE(dictionary->Start(&info_store, Compression::kDefaultZstdLevel));
+    ASSERT_TRUE(dictionary->compression() == NULL);
+
+    ASSERT_NO_FATAL_FAILURE(Sample(512));
+
+    // no more samples after the training has been triggered
+    string chunk = CreateChunk(1024);
+    ASSERT_FALSE(dictionary->AddSample(chunk.data(), chunk.size()));
+
+    ASSERT_TRUE(dictionary->Train());
+    ASSERT_TRUE(dictionary->compression());
+    ASSERT_NE(0U, dictionary->dictionary_id());
+    uint32_t dictionary_id = dictionary->dictionary_id();
+
+    byte compressed[16 * 1024];
+    ssize_t compressed_size = dictionary->compression()->Compress(compressed, sizeof(compressed), chunk.data(), chunk.size());
+    ASSERT_GT(compressed_size, 0);
+
+    delete dictionary;
+    dictionary = new ContainerStorageCompressionDictionary();
+    ASSERT_TRUE(dictionary->Start(&info_store, Compression::kDefaultZstdLevel));
+    ASSERT_TRUE(dictionary->compression());
+    ASSERT_EQ(dictionary_id, dictionary->dictionary_id());
+    ASSERT_FALSE(dictionary->AddSample(chunk.data(), chunk.size())) << "A restored dictionary should not be trained again";
+
+    byte decompressed[8192];
+    ASSERT_EQ(8192, dictionary->compression()->Decompress(decompressed, sizeof(decompressed), compressed, compressed_size));
+    ASSERT_TRUE(memcmp(decompressed, chunk.data(), chunk.size()) == 0);
+}
+
+}
+}
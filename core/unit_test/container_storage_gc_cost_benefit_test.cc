@@ -0,0 +1,365 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+#include <string>
+#include <list>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <core/dedup.h>
+#include <base/strutil.h>
+#include <core/log_consumer.h>
+#include <base/index.h>
+#include <core/container.h>
+#include <core/storage.h>
+#include <base/logging.h>
+#include <core/container_storage.h>
+#include <core/container_storage_gc.h>
+#include <core/container_storage_gc_cost_benefit.h>
+
+#include "dedupv1.pb.h"
+
+#include <test_util/log_assert.h>
+
+#include <test/container_storage_mock.h>
+
+LOGGER("CostBenefitContainerGCStrategyTest");
+
+using std::list;
+using std::vector;
+using std::make_pair;
+using testing::Return;
+using testing::DoAll;
+using testing::SetArgumentPointee;
+using testing::InSequence;
+using testing::_;
+
+using dedupv1::chunkstore::CostBenefitContainerGCStrategy;
+using dedupv1::chunkstore::Container;
+using dedupv1::base::strutil::ToString;
+using dedupv1::base::PersistentIndex;
+using dedupv1::base::LOOKUP_NOT_FOUND;
+using dedupv1::base::LOOKUP_FOUND;
+using dedupv1::chunkstore::STORAGE_ADDRESS_COMMITED;
+using dedupv1::StartContext;
+using dedupv1::StopContext;
+
+class CostBenefitContainerGCStrategyTest : public testing::Test {
+protected:
+    static size_t const CONTAINER_SIZE = 512 * 1024;
+    static size_t const TEST_DATA_SIZE = 16 * 1024;
+
+    USE_LOGGING_EXPECTATION();
+
+    CostBenefitContainerGCStrategy* gc;
+    MockContainerStorage storage;
+
+    byte test_data[16][TEST_DATA_SIZE];
+    uint64_t test_fp[16];
+
+    virtual void SetUp() {
+        storage.SetOption("container-size", ToString(CONTAINER_SIZE));
+
+        gc = new CostBenefitContainerGCStrategy();
+
+        int fd = open("/dev/urandom", O_RDONLY);
+        for (size_t i = 0; i < 16; i++) {
+            size_t j = 0;
+            while (j < TEST_DATA_SIZE) {
+                size_t r = read(fd, test_data[i] + j, TEST_DATA_SIZE - j);
+                j += r;
+            }
+            test_fp[i] = i + 1;
+        }
+        close(fd);
+    }
+
+    virtual void TearDown() {
+        if (gc) {
+            ASSERT_TRUE(gc->Stop(StopContext()));
+            delete gc;
+        }
+    }
+
+    void SetDefaultConfig(CostBenefitContainerGCStrategy* gc) {
+        ASSERT_TRUE(gc->SetOption("type", "sqlite-disk-btree"));
+        ASSERT_TRUE(gc->SetOption("filename", "work/merge-candidates"));
+        ASSERT_TRUE(gc->SetOption("max-item-count", "4M"));
+        ASSERT_TRUE(gc->SetOption("eviction-timeout", "0")); // we deactivate the eviction system
+    }
+
+    void CommitContainer(uint64_t container_id, int count) {
+        Container c(container_id, CONTAINER_SIZE, false);
+        for (int i = 0; i < count; i++) {
+            ASSERT_TRUE(c.AddItem((byte *) &test_fp[i], sizeof(test_fp[i]), test_data[i], TEST_DATA_SIZE, true, NULL));
+        }
+        ContainerCommittedEventData data;
+        data.set_container_id(c.primary_id());
+        data.set_active_data_size(c.active_data_size());
+        data.set_item_count(c.item_count());
+        ASSERT_TRUE(gc->OnCommit(data));
+    }
+};
+
+TEST_F(CostBenefitContainerGCStrategyTest, Init) {
+    // do nothing
+}
+
+TEST_F(CostBenefitContainerGCStrategyTest, StartWithoutConfig) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Once();
+
+    ASSERT_FALSE(gc->Start(StartContext(), &storage)) << "A start without a config should fail";
+}
+
+TEST_F(CostBenefitContainerGCStrategyTest, IllegalOptions) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Times(3);
+
+    ASSERT_FALSE(gc->SetOption("max-merge-count", "1"));
+    ASSERT_FALSE(gc->SetOption("interval", "0"));
+    ASSERT_FALSE(gc->SetOption("io-budget", "abc"));
+    ASSERT_TRUE(gc->SetOption("io-budget", "4M"));
+}
+
+TEST_F(CostBenefitContainerGCStrategyTest, OnCommitFullContainer) {
+    SetDefaultConfig(gc);
+    ASSERT_TRUE(gc->Start(StartContext(), &storage));
+
+    CommitContainer(0, 16);
+
+    ASSERT_EQ(0, gc->merge_candidate_count());
+    ASSERT_EQ(0, gc->merge_candidates()->GetItemCount());
+}
+
+TEST_F(CostBenefitContainerGCStrategyTest, OnCommitEmptyContainer) {
+    SetDefaultConfig(gc);
+    ASSERT_TRUE(gc->Start(StartContext(), &storage));
+
+    CommitContainer(0, 1);
+
+    ASSERT_EQ(1, gc->merge_candidate_count());
+
+    uint64_t container_id = 0;
+    ContainerCostBenefitGCCandidateData candidate_data;
+    ASSERT_EQ(LOOKUP_FOUND, gc->merge_candidates()->Lookup(&container_id, sizeof(container_id), &candidate_data));
+    ASSERT_EQ(0U, candidate_data.address());
+    ASSERT_EQ(1U, candidate_data.active_item_count());
+    ASSERT_TRUE(candidate_data.has_change_time());
+}
+
+TEST_F(CostBenefitContainerGCStrategyTest, Restart) {
+    SetDefaultConfig(gc);
+    ASSERT_TRUE(gc->Start(StartContext(), &storage));
+
+    CommitContainer(0, 1);
+    CommitContainer(1, 2);
+    ASSERT_TRUE(gc->Stop(StopContext()));
+    delete gc;
+
+    gc = new CostBenefitContainerGCStrategy();
+    SetDefaultConfig(gc);
+    ASSERT_TRUE(gc->Start(StartContext(), &storage));
+    ASSERT_EQ(2, gc->merge_candidate_count());
+}
+
+TEST_F(CostBenefitContainerGCStrategyTest, Score) {
+    SetDefaultConfig(gc);
+    ASSERT_TRUE(gc->Start(StartContext(), &storage));
+
+    ContainerCostBenefitGCCandidateData sparse;
+    sparse.set_address(1);
+    sparse.set_active_data_size(16 * 1024);
+    sparse.set_change_time(100);
+
+    ContainerCostBenefitGCCandidateData dense;
+    dense.set_address(2);
+    dense.set_active_data_size(128 * 1024);
+    dense.set_change_time(100);
+
+    ContainerCostBenefitGCCandidateData old_dense(dense);
+    old_dense.set_change_time(0);
+
+    ASSERT_GT(gc->GetScore(sparse, 200), gc->GetScore(dense, 200));
+    ASSERT_GT(gc->GetScore(old_dense, 200), gc->GetScore(dense, 200));
+}
+
+TEST_F(CostBenefitContainerGCStrategyTest, PackCandidates) {
+    SetDefaultConfig(gc);
+    ASSERT_TRUE(gc->Start(StartContext(), &storage));
+
+    vector<ContainerCostBenefitGCCandidateData> candidates;
+    for (int i = 0; i < 5; i++) {
+        ContainerCostBenefitGCCandidateData c;
+        c.set_address(10 - i);
+        c.set_active_data_size(CONTAINER_SIZE / 4);
+        c.set_active_item_count(1);
+        candidates.push_back(c);
+    }
+    // three of the containers fit into a single container, the remaining two into another one
+    list<vector<ContainerCostBenefitGCCandidateData> > groups = gc->PackCandidates(candidates);
+    ASSERT_EQ(2U, groups.size());
+    ASSERT_EQ(3U, groups.front().size());
+    ASSERT_EQ(2U, groups.back().size());
+    ASSERT_LT(groups.front()[0].address(), groups.front()[1].address());
+
+    // a single container is not worth a merge
+    candidates.resize(1);
+    ASSERT_EQ(0U, gc->PackCandidates(candidates).size());
+}
+
+TEST_F(CostBenefitContainerGCStrategyTest, OnStoragePressureNoCandidates) {
+    EXPECT_CALL(storage, TryMergeContainer(_,_,_)).Times(0);
+
+    SetDefaultConfig(gc);
+    ASSERT_TRUE(gc->Start(StartContext(), &storage));
+
+    ASSERT_TRUE(gc->OnStoragePressure());
+}
+
+TEST_F(CostBenefitContainerGCStrategyTest, OnStoragePressureThreeCandidates) {
+    ContainerStorageAddressData address;
+    address.set_file_index(1);
+    address.set_file_offset(0);
+    EXPECT_CALL(storage, LookupContainerAddress(_, _, _)).WillRepeatedly(Return(make_pair(LOOKUP_FOUND, address)));
+    {
+        InSequence seq;
+        // all three containers are compacted into a single container in one pass
+        EXPECT_CALL(storage, TryMergeContainer(0, 1, _)).WillOnce(Return(true));
+        EXPECT_CALL(storage, TryMergeContainer(0, 2, _)).WillOnce(Return(true));
+    }
+
+    SetDefaultConfig(gc);
+    ASSERT_TRUE(gc->Start(StartContext(), &storage));
+
+    CommitContainer(0, 2);
+    CommitContainer(1, 2);
+    CommitContainer(2, 2);
+
+    ASSERT_TRUE(gc->OnStoragePressure());
+    ASSERT_EQ(0, gc->merge_candidate_count());
+    ASSERT_EQ(0, gc->merge_candidates()->GetItemCount());
+}
+
+TEST_F(CostBenefitContainerGCStrategyTest, OnStoragePressureEmptyContainer) {
+    ContainerStorageAddressData address;
+    address.set_file_index(1);
+    address.set_file_offset(0);
+    EXPECT_CALL(storage, LookupContainerAddress(0, _, _)).WillRepeatedly(Return(make_pair(LOOKUP_FOUND, address)));
+    EXPECT_CALL(storage, TryDeleteContainer(0, _)).WillOnce(Return(true));
+    EXPECT_CALL(storage, TryMergeContainer(_,_,_)).Times(0);
+
+    SetDefaultConfig(gc);
+    ASSERT_TRUE(gc->Start(StartContext(), &storage));
+
+    CommitContainer(0, 0);
+
+    ASSERT_TRUE(gc->OnStoragePressure());
+    ASSERT_EQ(0, gc->merge_candidate_count());
+}
+
+TEST_F(CostBenefitContainerGCStrategyTest, OnStoragePressureSecondaryCandidate) {
+    ContainerStorageAddressData address0;
+    address0.set_file_index(1);
+    address0.set_file_offset(0);
+    ContainerStorageAddressData address1;
+    address1.set_file_index(1);
+    address1.set_file_offset(0);
+    address1.set_primary_id(0);
+    EXPECT_CALL(storage, LookupContainerAddress(0, _, _)).WillRepeatedly(Return(make_pair(LOOKUP_FOUND, address0)));
+    EXPECT_CALL(storage, LookupContainerAddress(1, _, _)).WillRepeatedly(Return(make_pair(LOOKUP_FOUND, address1)));
+    EXPECT_CALL(storage, TryMergeContainer(_,_,_)).Times(0);
+
+    SetDefaultConfig(gc);
+    ASSERT_TRUE(gc->Start(StartContext(), &storage));
+
+    CommitContainer(0, 2);
+    CommitContainer(1, 2);
+
+    ASSERT_TRUE(gc->OnStoragePressure());
+
+    // container 1 is not a primary container anymore
+    ASSERT_EQ(1, gc->merge_candidate_count());
+}
+
+TEST_F(CostBenefitContainerGCStrategyTest, OnStoragePressureAborted) {
+    ContainerStorageAddressData address;
+    address.set_file_index(1);
+    address.set_file_offset(0);
+    EXPECT_CALL(storage, LookupContainerAddress(_, _, _)).WillRepeatedly(Return(make_pair(LOOKUP_FOUND, address)));
+    EXPECT_CALL(storage, TryMergeContainer(0, 1, _)).WillOnce(DoAll(SetArgumentPointee<2>(true), Return(true)));
+
+    SetDefaultConfig(gc);
+    ASSERT_TRUE(gc->Start(StartContext(), &storage));
+
+    CommitContainer(0, 2);
+    CommitContainer(1, 2);
+
+    ASSERT_TRUE(gc->OnStoragePressure());
+
+    // both containers are put back into the candidate set
+    ASSERT_EQ(2, gc->merge_candidate_count());
+}
+
+TEST_F(CostBenefitContainerGCStrategyTest, OnMerge) {
+    SetDefaultConfig(gc);
+    ASSERT_TRUE(gc->Start(StartContext(), &storage));
+
+    CommitContainer(0, 2);
+    CommitContainer(1, 2);
+
+    ContainerMergedEventData event_data;
+    event_data.set_first_id(0);
+    event_data.set_second_id(1);
+    event_data.set_new_primary_id(0);
+    event_data.set_new_item_count(4);
+    event_data.set_new_active_data_size(4 * TEST_DATA_SIZE);
+    ASSERT_TRUE(gc->OnMerge(event_data));
+
+    ASSERT_EQ(1, gc->merge_candidate_count());
+
+    uint64_t container_id = 0;
+    ContainerCostBenefitGCCandidateData candidate_data;
+    ASSERT_EQ(LOOKUP_FOUND, gc->merge_candidates()->Lookup(&container_id, sizeof(container_id), &candidate_data));
+    ASSERT_EQ(4U, candidate_data.active_item_count());
+}
+
+TEST_F(CostBenefitContainerGCStrategyTest, OnMoveToFull) {
+    EXPECT_CALL(storage, IsCommitted(_)).WillRepeatedly(Return(STORAGE_ADDRESS_COMMITED));
+
+    SetDefaultConfig(gc);
+    ASSERT_TRUE(gc->Start(StartContext(), &storage));
+
+    CommitContainer(0, 2);
+    ASSERT_EQ(1, gc->merge_candidate_count());
+
+    ContainerMoveEventData event_data;
+    event_data.set_container_id(0);
+    event_data.set_old_active_data_size(2 * TEST_DATA_SIZE);
+    event_data.set_active_data_size(CONTAINER_SIZE / 2);
+    event_data.set_item_count(2);
+    event_data.set_old_item_count(2);
+    ASSERT_TRUE(gc->OnMove(event_data));
+
+    ASSERT_EQ(0, gc->merge_candidate_count());
+}
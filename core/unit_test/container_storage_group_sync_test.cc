@@ -0,0 +1,117 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <core/dedup.h>
+#include <core/container_storage_group_sync.h>
+#include <base/fileutil.h>
+#include <base/thread.h>
+#include <base/runnable.h>
+#include <base/logging.h>
+
+#include <test_util/log_assert.h>
+
+using dedupv1::base::File;
+using dedupv1::base::Thread;
+using dedupv1::base::NewRunnable;
+
+LOGGER("ContainerStorageGroupSyncTest");
+
+namespace dedupv1 {
+namespace chunkstore {
+
+class ContainerStorageGroupSyncTest : public testing::Test {
+protected:
+    USE_LOGGING_EXPECTATION();
+
+    File* file;
+    ContainerStorageGroupSync* group_sync;
+
+    virtual void SetUp() {
+        file = File::Open("work/group-sync", O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+        ASSERT_TRUE(file);
+        group_sync = new ContainerStorageGroupSync(file);
+        ASSERT_TRUE(group_sync);
+    }
+
+    virtual void TearDown() {
+        if (group_sync) {
+            delete group_sync;
+            group_sync = NULL;
+        }
+        if (file) {
+            delete file;
+            file = NULL;
+        }
+    }
+};
+
+namespace {
+bool WriteAndSync(File* file, ContainerStorageGroupSync* group_sync, int thread_id) {
+    byte buffer[4096];
+    memset(buffer, thread_id, sizeof(buffer));
+    for (int i = 0; i < 16; i++) {
+        off_t offset = ((thread_id * 16) + i) * sizeof(buffer);
+        CHECK(file->Write(offset, buffer, sizeof(buffer)) == sizeof(buffer), "Failed to write");
+        CHECK(group_sync->SyncWrite(), "Failed to sync");
+    }
+    return true;
+}
+}
+
+TEST_F(ContainerStorageGroupSyncTest, Create) {
+}
+
+TEST_F(ContainerStorageGroupSyncTest, SingleWrite) {
+    byte buffer[4096];
+    memset(buffer, 1, sizeof(buffer));
+    ASSERT_EQ(sizeof(buffer), file->Write(0, buffer, sizeof(buffer)));
+    ASSERT_TRUE(group_sync->SyncWrite());
+
+    ASSERT_EQ(1, group_sync->stats().syncs_);
+    ASSERT_EQ(1, group_sync->stats().synced_writes_);
+}
+
+TEST_F(ContainerStorageGroupSyncTest, ConcurrentWrites) {
+    Thread<bool>* threads[8];
+    for (int i = 0; i < 8; i++) {
+        threads[i] = new Thread<bool>(NewRunnable(&WriteAndSync, file, group_sync, i), "sync");
+        ASSERT_TRUE(threads[i]->Start());
+    }
+    for (int i = 0; i < 8; i++) {
+        bool result = false;
+        ASSERT_TRUE(threads[i]->Join(&result));
+        ASSERT_TRUE(result);
+        delete threads[i];
+    }
+
+    // every write is covered by a sync, but a sync might cover multiple writes
+    ASSERT_EQ(8 * 16, group_sync->stats().synced_writes_);
+    ASSERT_LE(group_sync->stats().syncs_, 8 * 16);
+    INFO("Syncs: " << group_sync->stats().syncs_ << ", synced writes " << group_sync->stats().synced_writes_);
+}
+
+}
+}
@@ -20,6 +20,7 @@
 
 #include <string>
 #include <list>
+#include <algorithm>
 
 #include <gtest/gtest.h>
 #include <tbb/atomic.h>
@@ -39,6 +40,7 @@
 #include <core/fingerprinter.h>
 #include <base/thread.h>
 #include <base/runnable.h>
+#include <base/threadpool.h>
 
 #include "storage_test.h"
 #include "container_test_helper.h"
@@ -48,6 +50,7 @@
 
 using std::string;
 using std::pair;
+using std::make_pair;
 using dedupv1::base::crc;
 using dedupv1::base::strutil::ToString;
 using dedupv1::Fingerprinter;
@@ -64,6 +67,7 @@ using testing::Return;
 using testing::_;
 using ::std::tr1::tuple;
 using dedupv1::base::Option;
+using std::vector;
 
 LOGGER("ContainerStorageTest");
 
@@ -186,6 +190,58 @@ protected:
         delete[] result;
     }
 
+    /**
+     * Writes and deletes test data and checks that only the summary records of the
+     * current container addresses are reported as current.
+     */
+    void CheckSummaryLog() {
+        WriteTestData(storage);
+        ASSERT_TRUE(storage->Flush(NO_EC));
+
+        // delete all but the first item of the first container. Each delete moves the container
+        // and the previous summary record of the container becomes stale.
+        uint64_t first_container_id = container_helper->data_address(0);
+        size_t deleted_count = 0;
+        for (size_t i = 1; i < TEST_DATA_COUNT; i++) {
+            if (container_helper->data_address(i) == first_container_id) {
+                ASSERT_TRUE(storage->DeleteChunk(first_container_id,
+                        container_helper->fingerprint(i).data(),
+                        container_helper->fingerprint(i).size(), NO_EC));
+                deleted_count++;
+            }
+        }
+        ASSERT_GT(deleted_count, 0U);
+        ASSERT_TRUE(storage->Flush(NO_EC));
+
+        size_t record_count = 0;
+        size_t current_record_count = 0;
+        size_t current_item_count = 0;
+        for (uint32_t f = 0; f < storage->GetFileCount(); f++) {
+            ContainerSummaryLog* summary_log = storage->summary_log(f);
+            ASSERT_TRUE(summary_log);
+
+            uint64_t offset = 0;
+            ContainerSummaryData summary;
+            while (summary_log->ReadNext(&offset, &summary) == LOOKUP_FOUND) {
+                record_count++;
+                ASSERT_EQ(summary.address().file_index(), f);
+                Option<bool> current = storage->IsCurrentContainerSummary(summary);
+                ASSERT_TRUE(current.valid());
+                if (!current.value()) {
+                    ASSERT_EQ(summary.container_id(), first_container_id);
+                    continue;
+                }
+                current_record_count++;
+                for (int i = 0; i < summary.item_size(); i++) {
+                    current_item_count++;
+                    ASSERT_EQ(summary.item(i).original_id(), summary.container_id());
+                }
+            }
+        }
+        ASSERT_EQ(current_item_count, TEST_DATA_COUNT - deleted_count);
+        ASSERT_EQ(record_count, current_record_count + deleted_count);
+    }
+
     void CrashAndRestart() {
         storage->ClearData();
         crashed_storage = storage;
@@ -307,6 +363,106 @@ TEST_P(ContainerStorageTest, SimpleReadWrite) {
  * Additionally we also check if the cache was hit. In particular, we want to test if a read
  * using a sessin adds the container to the read cache.
  */
+/**
+ * Reads all test data with a single batched read. The requests are ordered so that
+ * requests of the same container are not adjacent.
+ */
+TEST_P(ContainerStorageTest, ReadBatch) {
+    dedupv1::base::Threadpool tp;
+    ASSERT_TRUE(tp.SetOption("size", "4"));
+    ASSERT_TRUE(tp.Start());
+    system.set_threadpool(&tp);
+
+    ASSERT_TRUE(storage->Start(StartContext(), &system));
+    ASSERT_TRUE(storage->Run());
+
+    WriteTestData(storage);
+
+    vector<bytestring> fingerprints;
+    for (size_t i = 0; i < TEST_DATA_COUNT; i++) {
+        fingerprints.push_back(container_helper->fingerprint(i));
+    }
+
+    byte* result = new byte[TEST_DATA_SIZE * TEST_DATA_COUNT];
+    for (int round = 0; round < 2; round++) {
+        // the first round reads from the write cache, the second from disk or the read cache
+        memset(result, 0, TEST_DATA_SIZE * TEST_DATA_COUNT);
+        vector<StorageReadRequest> requests;
+        for (size_t i = 0; i < TEST_DATA_COUNT; i += 2) {
+            requests.push_back(StorageReadRequest(container_helper->data_address(i),
+                    fingerprints[i].data(),
+                    fingerprints[i].size(),
+                    result + (i * TEST_DATA_SIZE), 0, TEST_DATA_SIZE));
+        }
+        for (size_t i = 1; i < TEST_DATA_COUNT; i += 2) {
+            requests.push_back(StorageReadRequest(container_helper->data_address(i),
+                    fingerprints[i].data(),
+                    fingerprints[i].size(),
+                    result + (i * TEST_DATA_SIZE), 0, TEST_DATA_SIZE));
+        }
+        vector<StorageReadRequest*> request_pointers;
+        for (size_t i = 0; i < requests.size(); i++) {
+            request_pointers.push_back(&requests[i]);
+        }
+        ASSERT_TRUE(storage->ReadBatch(request_pointers, NO_EC));
+
+        for (size_t i = 0; i < requests.size(); i++) {
+            ASSERT_EQ(requests[i].read_size(), TEST_DATA_SIZE) << "Read " << requests[i].DebugString() << " failed";
+        }
+        for (size_t i = 0; i < TEST_DATA_COUNT; i++) {
+            ASSERT_TRUE(memcmp(container_helper->data(i), result + (i * TEST_DATA_SIZE), TEST_DATA_SIZE) == 0) <<
+            "Compare " << i << " error";
+        }
+        ASSERT_TRUE(storage->Flush(NO_EC));
+    }
+    delete[] result;
+
+    delete storage;
+    storage = NULL;
+    system.set_threadpool(NULL);
+    ASSERT_TRUE(tp.Stop());
+}
+
+TEST_P(ContainerStorageTest, PartialRead) {
+    ASSERT_TRUE(storage->SetOption("checksum", "false"));
+    ASSERT_TRUE(storage->SetOption("partial-read", "true"));
+    ASSERT_TRUE(storage->SetOption("partial-read.max-ratio", "1.0"));
+    ASSERT_TRUE(storage->SetOption("partial-read.full-load-count", "1024"));
+    ASSERT_TRUE(storage->Start(StartContext(), &system));
+    ASSERT_TRUE(storage->Run());
+
+    WriteTestData(storage);
+    ASSERT_TRUE(storage->Flush(NO_EC));
+
+    // the first round loads the meta data, the second round uses the cached item tables
+    ReadTestData(storage);
+    uint64_t partial_reads = storage->stats_.partial_reads_;
+    uint64_t metadata_loads = storage->stats_.partial_read_metadata_loads_;
+    ASSERT_EQ(partial_reads, TEST_DATA_COUNT);
+    ASSERT_GT(metadata_loads, 0U);
+
+    ReadTestData(storage);
+    partial_reads = storage->stats_.partial_reads_;
+    ASSERT_EQ(partial_reads, 2 * TEST_DATA_COUNT);
+    ASSERT_EQ(static_cast<uint64_t>(storage->stats_.partial_read_metadata_loads_), metadata_loads);
+}
+
+TEST_P(ContainerStorageTest, PartialReadWithChecksum) {
+    EXPECT_LOGGING(dedupv1::test::WARN).Matches("Partial reads disabled").Once();
+
+    ASSERT_TRUE(storage->SetOption("checksum", "true"));
+    ASSERT_TRUE(storage->SetOption("partial-read", "true"));
+    ASSERT_TRUE(storage->SetOption("partial-read.max-ratio", "1.0"));
+    ASSERT_TRUE(storage->Start(StartContext(), &system));
+    ASSERT_TRUE(storage->Run());
+
+    WriteTestData(storage);
+    ASSERT_TRUE(storage->Flush(NO_EC));
+
+    ReadTestData(storage);
+    ASSERT_EQ(static_cast<uint64_t>(storage->stats_.partial_reads_), 0U);
+}
+
 TEST_P(ContainerStorageTest, SimpleReread) {
     ASSERT_TRUE(storage->Start(StartContext(), &system));
     ASSERT_TRUE(storage->Run());
@@ -450,6 +606,45 @@ TEST_P(ContainerStorageTest, Delete) {
     << "Container hasn't changed position after deletion";
 }
 
+TEST_P(ContainerStorageTest, MoveBetweenTiers) {
+    ASSERT_TRUE(storage->SetOption("filetier", "fast")); // work/container-data-2
+    ASSERT_TRUE(storage->SetOption("tiering", "true"));
+    ASSERT_TRUE(storage->Start(StartContext(), &system));
+    ASSERT_TRUE(storage->Run());
+    ASSERT_TRUE(storage->tiering());
+
+    WriteTestData(storage);
+    ASSERT_TRUE(storage->Flush(NO_EC));
+
+    uint64_t container_id = container_helper->data_address(0);
+    pair<lookup_result, ContainerStorageAddressData> address_result =
+        storage->LookupContainerAddress(container_id, NULL, false);
+    ASSERT_EQ(address_result.first, LOOKUP_FOUND);
+    ASSERT_TRUE(storage->IsFastTierAddress(address_result.second)) << "New container not placed on the fast tier";
+    ASSERT_GT(storage->tiering()->GetFastContainerCount(), 0U);
+
+    bool aborted = false;
+    ASSERT_TRUE(storage->TryMoveContainer(container_id, false, &aborted));
+    ASSERT_FALSE(aborted);
+
+    address_result = storage->LookupContainerAddress(container_id, NULL, false);
+    ASSERT_EQ(address_result.first, LOOKUP_FOUND);
+    ASSERT_FALSE(storage->IsFastTierAddress(address_result.second)) << "Container hasn't been moved to the capacity tier";
+    ReadTestData(storage);
+
+    // the container is already on the capacity tier
+    ASSERT_TRUE(storage->TryMoveContainer(container_id, false, &aborted));
+    ASSERT_TRUE(aborted);
+
+    ASSERT_TRUE(storage->TryMoveContainer(container_id, true, &aborted));
+    ASSERT_FALSE(aborted);
+
+    address_result = storage->LookupContainerAddress(container_id, NULL, false);
+    ASSERT_EQ(address_result.first, LOOKUP_FOUND);
+    ASSERT_TRUE(storage->IsFastTierAddress(address_result.second)) << "Container hasn't been moved to the fast tier";
+    ReadTestData(storage);
+}
+
 TEST_P(ContainerStorageTest, DeleteBeforeRun) {
     EXPECT_LOGGING(dedupv1::test::WARN).Matches("Key not found").Repeatedly();
 
@@ -905,6 +1100,29 @@ TEST_P(ContainerStorageTest, IllegalSize) {
     ASSERT_FALSE(storage->Start(StartContext(), &system));
 }
 
+TEST_P(ContainerStorageTest, CompressionLevelBeforeCompression) {
+    string use_compression(std::tr1::get<0>(GetParam()));
+    if (use_compression != "zstd") {
+        EXPECT_LOGGING(dedupv1::test::ERROR).Once();
+    }
+
+    // the level is set before the compression type
+    delete storage;
+    storage = dynamic_cast<ContainerStorage*>(Storage::Factory().Create("container-storage"));
+    ASSERT_TRUE(storage);
+    ASSERT_TRUE(storage->SetOption("compression.level", "3"));
+    SetDefaultStorageOptions(storage);
+
+    if (use_compression == "zstd") {
+        ASSERT_TRUE(storage->Start(StartContext(), &system));
+        ASSERT_TRUE(storage->Run());
+        WriteTestData(storage);
+        ReadTestData(storage);
+    } else {
+        ASSERT_FALSE(storage->Start(StartContext(), &system));
+    }
+}
+
 TEST_P(ContainerStorageTest, ChangeExplcitSizeOfExistingFile) {
     EXPECT_LOGGING(dedupv1::test::ERROR).Once();
 
@@ -1341,6 +1559,97 @@ TEST_P(ContainerStorageTest, Merge) {
     }
 }
 
+/**
+ * Merges two independent container pairs with the merge pipeline.
+ */
+TEST_P(ContainerStorageTest, MergePipeline) {
+    dedupv1::base::Threadpool tp;
+    ASSERT_TRUE(tp.SetOption("size", "4"));
+    ASSERT_TRUE(tp.Start());
+    system.set_threadpool(&tp);
+
+    ASSERT_TRUE(storage->Start(StartContext(), &system));
+    ASSERT_TRUE(storage->Run());
+
+    WriteTestData(storage);
+
+    // keep only the first item of the first four containers
+    vector<uint64_t> container_ids;
+    vector<size_t> kept_items;
+    for (size_t i = 0; i < TEST_DATA_COUNT; i++) {
+        uint64_t container_id = container_helper->data_address(i);
+        if (std::find(container_ids.begin(), container_ids.end(), container_id) == container_ids.end()) {
+            if (container_ids.size() == 4) {
+                break;
+            }
+            container_ids.push_back(container_id);
+            kept_items.push_back(i);
+        } else {
+            ASSERT_TRUE(storage->DeleteChunk(container_id,
+                    container_helper->fingerprint(i).data(),
+                    container_helper->fingerprint(i).size(), NO_EC));
+        }
+    }
+    ASSERT_EQ(4U, container_ids.size());
+    ASSERT_TRUE(storage->Flush(NO_EC));
+
+    vector<pair<uint64_t, uint64_t> > merge_list;
+    merge_list.push_back(make_pair(container_ids[0], container_ids[1]));
+    merge_list.push_back(make_pair(container_ids[2], container_ids[3]));
+    vector<bool> aborted_list;
+    ASSERT_TRUE(storage->TryMergeContainers(merge_list, &aborted_list));
+    ASSERT_EQ(2U, aborted_list.size());
+    ASSERT_FALSE(aborted_list[0]);
+    ASSERT_FALSE(aborted_list[1]);
+
+    for (size_t i = 0; i < 4; i += 2) {
+        pair<lookup_result, ContainerStorageAddressData> address1 =
+            storage->LookupContainerAddress(container_ids[i], NULL, false);
+        ASSERT_EQ(address1.first, LOOKUP_FOUND);
+        pair<lookup_result, ContainerStorageAddressData> address2 =
+            storage->LookupContainerAddress(container_ids[i + 1], NULL, false);
+        ASSERT_EQ(address2.first, LOOKUP_FOUND);
+        ASSERT_TRUE(address1.second.file_index() == address2.second.file_index() &&
+            address1.second.file_offset() == address2.second.file_offset()) <<
+        "container " << container_ids[i] << " and container " << container_ids[i + 1] << " should be merged";
+    }
+
+    byte result[TEST_DATA_SIZE];
+    for (size_t i = 0; i < kept_items.size(); i++) {
+        size_t item = kept_items[i];
+        memset(result, 0, TEST_DATA_SIZE);
+        Option<uint32_t> r = storage->Read(container_helper->data_address(item),
+            container_helper->fingerprint(item).data(),
+            container_helper->fingerprint(item).size(), result,
+            0, TEST_DATA_SIZE, NO_EC);
+        ASSERT_TRUE(r.valid()) << "Read " << item << " failed";
+        ASSERT_TRUE(r.value() == TEST_DATA_SIZE) << "Read " << item << " error";
+        ASSERT_TRUE(memcmp(container_helper->data(item), result, r.value()) == 0) << "Compare " << item << " error";
+    }
+
+    delete storage;
+    storage = NULL;
+    system.set_threadpool(NULL);
+    ASSERT_TRUE(tp.Stop());
+}
+
+TEST_P(ContainerStorageTest, SummaryLog) {
+    ASSERT_TRUE(storage->SetOption("summary-log", "true"));
+    ASSERT_TRUE(storage->Start(StartContext(), &system));
+    ASSERT_TRUE(storage->Run());
+
+    ASSERT_NO_FATAL_FAILURE(CheckSummaryLog());
+}
+
+TEST_P(ContainerStorageTest, SummaryLogWithoutAddressTable) {
+    ASSERT_TRUE(storage->SetOption("summary-log", "true"));
+    ASSERT_TRUE(storage->SetOption("address-table", "false"));
+    ASSERT_TRUE(storage->Start(StartContext(), &system));
+    ASSERT_TRUE(storage->Run());
+
+    ASSERT_NO_FATAL_FAILURE(CheckSummaryLog());
+}
+
 /**
  * This unit tests verify the behavior of the merge operations during a crash.
  */
@@ -1467,8 +1776,8 @@ TEST_P(ContainerStorageTest, MergeWithSameContainerLock) {
 
     ContainerStorageAddressData address1;
     ContainerStorageAddressData address2;
-    ASSERT_TRUE(storage->allocator()->OnNewContainer(container1, true, &address1));
-    ASSERT_TRUE(storage->allocator()->OnNewContainer(container2, true, &address2));
+    ASSERT_TRUE(storage->allocator()->OnNewContainer(container1, true, STORAGE_TIER_FAST, &address1));
+    ASSERT_TRUE(storage->allocator()->OnNewContainer(container2, true, STORAGE_TIER_FAST, &address2));
 
     DEBUG("Write container");
     ASSERT_TRUE(storage->CommitContainer(&container1, address1));
@@ -1567,7 +1876,7 @@ INSTANTIATE_TEST_CASE_P(ContainerStorage,
 INSTANTIATE_TEST_CASE_P(ContainerStorage,
     ContainerStorageTest,
     ::testing::Combine(
-        ::testing::Values("", "deflate", "bz2", "lz4", "snappy"),
+        ::testing::Values("", "deflate", "bz2", "lz4", "snappy", "zstd"),
         ::testing::Values(0, 1, 2)));
 
 }
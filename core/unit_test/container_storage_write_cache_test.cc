@@ -49,6 +49,7 @@ using dedupv1::log::Log;
 using testing::Return;
 using testing::_;
 using dedupv1::base::LOOKUP_FOUND;
+using dedupv1::base::Option;
 
 LOGGER("ContainerStorageWriteCacheTest");
 
@@ -141,6 +142,19 @@ protected:
         ASSERT_TRUE(this->write_cache);
     }
 
+    void CreateContainerStorageWithStrategy(int write_container_count, const std::string& strategy) {
+        this->storage = dynamic_cast<ContainerStorage*>(Storage::Factory().Create("container-storage"));
+        ASSERT_TRUE(this->storage);
+        ASSERT_NO_FATAL_FAILURE(SetDefaultStorageOptions(storage));
+        ASSERT_TRUE(this->storage->SetOption("write-container-count", ToString(write_container_count)));
+        ASSERT_TRUE(this->storage->SetOption("write-cache.strategy", strategy));
+        ASSERT_TRUE(this->storage->Start(StartContext(), &system));
+        ASSERT_TRUE(this->storage->Run());
+
+        this->write_cache = this->storage->GetWriteCache();
+        ASSERT_TRUE(this->write_cache);
+    }
+
     virtual void TearDown() {
         if (storage) {
             delete storage;
@@ -233,5 +247,113 @@ TEST_F(ContainerStorageWriteCacheTest, EarliestFreeWithLocking) {
     }
 }
 
+TEST_F(ContainerStorageWriteCacheTest, StreamAffine) {
+    CreateContainerStorageWithStrategy(4, "stream-affine");
+    ASSERT_TRUE(storage);
+    ASSERT_TRUE(write_cache);
+
+    // three interleaved streams
+    for (int i = 0; i < 12; i++) {
+        uint32_t stream_id = 10 + (i % 3);
+        byte* d = container_helper->data(i);
+        ASSERT_TRUE(d);
+        ASSERT_TRUE(storage->WriteNewInStream(stream_id,
+                container_helper->fingerprint(i).data(),
+                container_helper->fingerprint(i).size(),
+                d,
+                TEST_DATA_SIZE,
+                true,
+                container_helper->mutable_data_address(i),
+                NO_EC))
+        << "Write " << i << " failed";
+        // each stream has its own container
+        ASSERT_EQ((i % 3) + 1, container_helper->data_address(i));
+        DEBUG("Wrote index " << i << ", stream " << stream_id << ", container id " << container_helper->data_address(i));
+    }
+}
+
+TEST_F(ContainerStorageWriteCacheTest, StreamAffineMoreStreamsThanContainers) {
+    CreateContainerStorageWithStrategy(2, "stream-affine");
+    ASSERT_TRUE(storage);
+    ASSERT_TRUE(write_cache);
+
+    for (int i = 0; i < 16; i++) {
+        uint32_t stream_id = i % 5;
+        byte* d = container_helper->data(i);
+        ASSERT_TRUE(d);
+        ASSERT_TRUE(storage->WriteNewInStream(stream_id,
+                container_helper->fingerprint(i).data(),
+                container_helper->fingerprint(i).size(),
+                d,
+                TEST_DATA_SIZE,
+                true,
+                container_helper->mutable_data_address(i),
+                NO_EC))
+        << "Write " << i << " failed";
+    }
+    for (int i = 0; i < 16; i++) {
+        byte buffer[TEST_DATA_SIZE];
+        Option<uint32_t> r = storage->Read(container_helper->data_address(i),
+            container_helper->fingerprint(i).data(),
+            container_helper->fingerprint(i).size(),
+            buffer, 0, TEST_DATA_SIZE, NO_EC);
+        ASSERT_TRUE(r.valid()) << "Read " << i << " failed";
+        ASSERT_EQ(TEST_DATA_SIZE, r.value());
+        ASSERT_EQ(0, memcmp(buffer, container_helper->data(i), TEST_DATA_SIZE));
+    }
+}
+
+TEST_F(ContainerStorageWriteCacheTest, StreamAffineBusyStream) {
+    CreateContainerStorageWithStrategy(4, "stream-affine");
+    ASSERT_TRUE(storage);
+    ASSERT_TRUE(write_cache);
+
+    for (int i = 0; i < 3; i++) {
+        if (i == 1) {
+            // another thread of the stream holds the first container of the stream
+            ASSERT_TRUE(write_cache->GetCacheLock().Get(0)->AcquireWriteLock());
+        }
+        byte* d = container_helper->data(i);
+        ASSERT_TRUE(d);
+        ASSERT_TRUE(storage->WriteNewInStream(10,
+                container_helper->fingerprint(i).data(),
+                container_helper->fingerprint(i).size(),
+                d,
+                TEST_DATA_SIZE,
+                true,
+                container_helper->mutable_data_address(i),
+                NO_EC))
+        << "Write " << i << " failed";
+        if (i == 1) {
+            ASSERT_TRUE(write_cache->GetCacheLock().Get(0)->ReleaseLock());
+        }
+    }
+    // the stream got a second container while the first was busy and uses the first again afterwards
+    ASSERT_EQ(1, container_helper->data_address(0));
+    ASSERT_EQ(2, container_helper->data_address(1));
+    ASSERT_EQ(1, container_helper->data_address(2));
+}
+
+TEST_F(ContainerStorageWriteCacheTest, StreamAffineWithoutStream) {
+    CreateContainerStorageWithStrategy(4, "stream-affine");
+    ASSERT_TRUE(storage);
+    ASSERT_TRUE(write_cache);
+
+    // without a stream, the earliest-free strategy is used
+    for (int i = 0; i < 8; i++) {
+        byte* d = container_helper->data(i);
+        ASSERT_TRUE(d);
+        ASSERT_TRUE(storage->WriteNew(container_helper->fingerprint(i).data(),
+                container_helper->fingerprint(i).size(),
+                d,
+                TEST_DATA_SIZE,
+                true,
+                container_helper->mutable_data_address(i),
+                NO_EC))
+        << "Write " << i << " failed";
+        ASSERT_EQ(1, container_helper->data_address(i));
+    }
+}
+
 }
 }
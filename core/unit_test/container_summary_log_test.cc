@@ -0,0 +1,226 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <gtest/gtest.h>
+
+#include <core/dedup.h>
+#include <base/logging.h>
+#include <base/fileutil.h>
+#include <base/callback.h>
+#include <base/memory.h>
+#include <core/container.h>
+#include <core/container_summary_log.h>
+
+#include "dedupv1.pb.h"
+
+#include <test_util/log_assert.h>
+
+LOGGER("ContainerSummaryLogTest");
+
+using dedupv1::chunkstore::ContainerSummaryLog;
+using dedupv1::chunkstore::Container;
+using dedupv1::base::File;
+using dedupv1::base::Option;
+using dedupv1::base::lookup_result;
+using dedupv1::base::LOOKUP_NOT_FOUND;
+using dedupv1::base::LOOKUP_FOUND;
+using dedupv1::base::Callback1;
+using dedupv1::base::NewCallback;
+using dedupv1::base::ScopedPtr;
+
+namespace {
+class EvenContainerFilter {
+    public:
+        Option<bool> IsCurrent(const ContainerSummaryData& summary) {
+            return dedupv1::base::make_option(summary.container_id() % 2 == 0);
+        }
+};
+}
+
+class ContainerSummaryLogTest : public testing::Test {
+protected:
+    USE_LOGGING_EXPECTATION();
+
+    static const size_t kContainerSize = 512 * 1024;
+
+    ContainerSummaryLog* log;
+    byte data[4096];
+
+    virtual void SetUp() {
+        log = new ContainerSummaryLog();
+        memset(data, 1, sizeof(data));
+    }
+
+    virtual void TearDown() {
+        if (log) {
+            delete log;
+            log = NULL;
+        }
+    }
+
+    void FillContainer(Container* container, uint64_t fp_base, int item_count) {
+        for (int i = 0; i < item_count; i++) {
+            uint64_t fp = fp_base + i;
+            ASSERT_TRUE(container->AddItem(reinterpret_cast<const byte*>(&fp), sizeof(fp),
+                    data, sizeof(data), true, NULL));
+        }
+    }
+
+    ContainerStorageAddressData MakeAddress(uint32_t file_index, uint64_t file_offset) {
+        ContainerStorageAddressData address;
+        address.set_file_index(file_index);
+        address.set_file_offset(file_offset);
+        return address;
+    }
+};
+
+TEST_F(ContainerSummaryLogTest, AppendAndRead) {
+    ASSERT_TRUE(log->Start("work/container-summary", true, false));
+
+    Container container1(1, kContainerSize, false);
+    FillContainer(&container1, 100, 4);
+    uint64_t fp = 101;
+    ASSERT_TRUE(container1.DeleteItem(reinterpret_cast<const byte*>(&fp), sizeof(fp)));
+    Container container2(2, kContainerSize, false);
+    FillContainer(&container2, 200, 8);
+
+    ASSERT_TRUE(log->Append(container1, MakeAddress(0, 0), 10));
+    ASSERT_TRUE(log->Append(container2, MakeAddress(0, kContainerSize), 11));
+
+    uint64_t offset = 0;
+    ContainerSummaryData summary;
+    ASSERT_EQ(log->ReadNext(&offset, &summary), LOOKUP_FOUND);
+    ASSERT_EQ(summary.container_id(), 1U);
+    ASSERT_EQ(summary.address().file_offset(), 0U);
+    ASSERT_EQ(summary.address().log_id(), 10U);
+    // the deleted item is not part of the summary
+    ASSERT_EQ(summary.item_size(), 3);
+    fp = 100;
+    ASSERT_EQ(summary.item(0).fp(), std::string(reinterpret_cast<const char*>(&fp), sizeof(fp)));
+    ASSERT_TRUE(summary.item(0).indexed());
+
+    ASSERT_EQ(log->ReadNext(&offset, &summary), LOOKUP_FOUND);
+    ASSERT_EQ(summary.container_id(), 2U);
+    ASSERT_EQ(summary.address().log_id(), 11U);
+    ASSERT_EQ(summary.item_size(), 8);
+
+    ASSERT_EQ(log->ReadNext(&offset, &summary), LOOKUP_NOT_FOUND);
+    ASSERT_EQ(offset, log->end_offset());
+}
+
+TEST_F(ContainerSummaryLogTest, Restart) {
+    ASSERT_TRUE(log->Start("work/container-summary", true, false));
+
+    Container container1(1, kContainerSize, false);
+    FillContainer(&container1, 100, 4);
+    ASSERT_TRUE(log->Append(container1, MakeAddress(0, 0), 10));
+    uint64_t end_offset = log->end_offset();
+    delete log;
+
+    log = new ContainerSummaryLog();
+    ASSERT_TRUE(log->Start("work/container-summary", false, false));
+    ASSERT_EQ(log->end_offset(), end_offset);
+
+    Container container2(2, kContainerSize, false);
+    FillContainer(&container2, 200, 2);
+    ASSERT_TRUE(log->Append(container2, MakeAddress(1, 0), 12));
+
+    uint64_t offset = 0;
+    ContainerSummaryData summary;
+    ASSERT_EQ(log->ReadNext(&offset, &summary), LOOKUP_FOUND);
+    ASSERT_EQ(summary.container_id(), 1U);
+    ASSERT_EQ(log->ReadNext(&offset, &summary), LOOKUP_FOUND);
+    ASSERT_EQ(summary.container_id(), 2U);
+    ASSERT_EQ(summary.address().file_index(), 1U);
+    ASSERT_EQ(log->ReadNext(&offset, &summary), LOOKUP_NOT_FOUND);
+}
+
+TEST_F(ContainerSummaryLogTest, TruncateTornTail) {
+    EXPECT_LOGGING(dedupv1::test::WARN).Once();
+
+    ASSERT_TRUE(log->Start("work/container-summary", true, false));
+
+    Container container1(1, kContainerSize, false);
+    FillContainer(&container1, 100, 4);
+    ASSERT_TRUE(log->Append(container1, MakeAddress(0, 0), 10));
+    uint64_t valid_end_offset = log->end_offset();
+    Container container2(2, kContainerSize, false);
+    FillContainer(&container2, 200, 4);
+    ASSERT_TRUE(log->Append(container2, MakeAddress(0, kContainerSize), 11));
+    uint64_t end_offset = log->end_offset();
+    delete log;
+    log = NULL;
+
+    // simulate a crash during the second append
+    ASSERT_TRUE(File::Truncate("work/container-summary", end_offset - 5));
+
+    log = new ContainerSummaryLog();
+    ASSERT_TRUE(log->Start("work/container-summary", false, false));
+    ASSERT_EQ(log->end_offset(), valid_end_offset);
+    Option<off_t> file_size = File::GetFileSize("work/container-summary");
+    ASSERT_TRUE(file_size.valid());
+    ASSERT_EQ(static_cast<uint64_t>(file_size.value()), valid_end_offset);
+
+    uint64_t offset = 0;
+    ContainerSummaryData summary;
+    ASSERT_EQ(log->ReadNext(&offset, &summary), LOOKUP_FOUND);
+    ASSERT_EQ(summary.container_id(), 1U);
+    ASSERT_EQ(log->ReadNext(&offset, &summary), LOOKUP_NOT_FOUND);
+}
+
+TEST_F(ContainerSummaryLogTest, Compact) {
+    ASSERT_TRUE(log->Start("work/container-summary", true, false));
+
+    for (uint64_t i = 1; i <= 4; i++) {
+        Container container(i, kContainerSize, false);
+        FillContainer(&container, i * 100, 4);
+        ASSERT_TRUE(log->Append(container, MakeAddress(0, i * kContainerSize), i));
+    }
+    uint64_t end_offset = log->end_offset();
+
+    EvenContainerFilter filter;
+    ScopedPtr<Callback1<Option<bool>, const ContainerSummaryData&> > is_current(
+        NewCallback(&filter, &EvenContainerFilter::IsCurrent));
+    ASSERT_TRUE(log->Compact(is_current.Get()));
+    ASSERT_LT(log->end_offset(), end_offset);
+
+    // appends continue after the compacted records
+    Container container6(6, kContainerSize, false);
+    FillContainer(&container6, 600, 2);
+    ASSERT_TRUE(log->Append(container6, MakeAddress(0, 6 * kContainerSize), 6));
+    end_offset = log->end_offset();
+    delete log;
+
+    log = new ContainerSummaryLog();
+    ASSERT_TRUE(log->Start("work/container-summary", false, false));
+    ASSERT_EQ(log->end_offset(), end_offset);
+
+    uint64_t offset = 0;
+    ContainerSummaryData summary;
+    ASSERT_EQ(log->ReadNext(&offset, &summary), LOOKUP_FOUND);
+    ASSERT_EQ(summary.container_id(), 2U);
+    ASSERT_EQ(log->ReadNext(&offset, &summary), LOOKUP_FOUND);
+    ASSERT_EQ(summary.container_id(), 4U);
+    ASSERT_EQ(summary.item_size(), 4);
+    ASSERT_EQ(log->ReadNext(&offset, &summary), LOOKUP_FOUND);
+    ASSERT_EQ(summary.container_id(), 6U);
+    ASSERT_EQ(log->ReadNext(&offset, &summary), LOOKUP_NOT_FOUND);
+    ASSERT_EQ(offset, end_offset);
+}
@@ -37,6 +37,7 @@
 #include <base/compress.h>
 
 #include <base/index.h>
+#include <base/hashing_util.h>
 #include <core/chunk_mapping.h>
 #include <core/container.h>
 #include <core/chunk.h>
@@ -47,6 +48,7 @@ LOGGER("ContainerTest");
 
 using dedupv1::Fingerprinter;
 using dedupv1::base::crc;
+using dedupv1::base::raw_compare;
 
 namespace dedupv1 {
 namespace chunkstore {
@@ -188,6 +190,63 @@ TEST_F(ContainerTest, AddItemRandomFingerprints) {
     }
 }
 
+TEST_F(ContainerTest, AddManyItemsUnsorted) {
+    Container container(Container::kLeastValidContainerId, CONTAINER_SIZE, false);
+
+    // more items than fit into the unsorted tail of the item list
+    int item_count = 200;
+    byte fp[200][20];
+    for (int i = 0; i < item_count; i++) {
+        memset(fp[i], 0, 20);
+        // the first bytes are equal for some items so that the full fingerprint has to be compared
+        fp[i][0] = (i * 37) % 7;
+        fp[i][19] = i;
+        ASSERT_TRUE(container.AddItem(fp[i], 20, test_data[0] + (i * 1024), 1024, true, NULL))
+        << "Add item " << i << " failed";
+    }
+    for (int i = 0; i < item_count; i++) {
+        ASSERT_TRUE(container.FindItem(fp[i], 20)) << "Find item " << i << " failed";
+    }
+    byte unknown_fp[20];
+    memset(unknown_fp, 0, 20);
+    unknown_fp[19] = 255;
+    ASSERT_FALSE(container.FindItem(unknown_fp, 20));
+    ASSERT_FALSE(container.FindItem(fp[0], 8));
+
+    ASSERT_TRUE(container.DeleteItem(fp[10], 20));
+    ASSERT_FALSE(container.FindItem(fp[10], 20));
+    ASSERT_TRUE(container.FindItem(fp[10], 20, true));
+
+    dedupv1::base::File* f = dedupv1::base::File::Open("work/container", O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    ASSERT_TRUE(f);
+    ASSERT_TRUE(container.StoreToFile(f, 0, true));
+
+    // the items are sorted when the container is stored
+    for (size_t i = 1; i < container.items().size(); i++) {
+        const ContainerItem* item1 = container.items()[i - 1];
+        const ContainerItem* item2 = container.items()[i];
+        ASSERT_LE(raw_compare(item1->key(), item1->key_size(), item2->key(), item2->key_size()), 0);
+    }
+
+    Container container2(Container::kLeastValidContainerId, CONTAINER_SIZE, false);
+    ASSERT_TRUE(container2.LoadFromFile(f, 0, true));
+    delete f;
+    f = NULL;
+
+    ASSERT_TRUE(container.Equals(container2));
+    for (int i = 0; i < item_count; i++) {
+        if (i == 10) {
+            continue;
+        }
+        const ContainerItem* item = container2.FindItem(fp[i], 20);
+        ASSERT_TRUE(item) << "Find item " << i << " failed";
+
+        byte buffer[1024];
+        ASSERT_TRUE(container2.CopyRawData(item, buffer, 0, 1024));
+        ASSERT_EQ(0, memcmp(buffer, test_data[0] + (i * 1024), 1024));
+    }
+}
+
 TEST_F(ContainerTest, NoLineFeedInDebugString) {
     Container container(Container::kLeastValidContainerId, CONTAINER_SIZE, false);
     for (int i = 0; i < 4; i++) {
@@ -226,6 +285,32 @@ TEST_F(ContainerTest, SerializeContainer) {
     ASSERT_TRUE(container2.Equals(container)) << "Containers should be equal";
 }
 
+TEST_F(ContainerTest, SerializeContainerWithCRC32C) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Once();
+
+    Container container(0, CONTAINER_SIZE, false);
+    container.set_checksum_type(CONTAINER_CHECKSUM_CRC32C);
+    for (int i = 0; i < 4; i++) {
+        // Use small items to avoid an overflow
+        ASSERT_TRUE(container.AddItem((byte *) &test_fp[i], sizeof(test_fp[i]), (byte *) test_data[i], (size_t) 16 * 1024, true, NULL))
+        << "Add item " << i << " failed";
+    }
+
+    ASSERT_TRUE(container.SerializeMetadata(true));
+
+    // the stored checksum type is used for the verification
+    Container container2(0, CONTAINER_SIZE, false);
+    memcpy(container2.mutable_data(), container.mutable_data(), CONTAINER_SIZE);
+    ASSERT_TRUE(container2.UnserializeMetadata(true));
+    ASSERT_TRUE(container2.Equals(container)) << "Containers should be equal";
+
+    // corrupt the item data
+    Container container3(0, CONTAINER_SIZE, false);
+    memcpy(container3.mutable_data(), container.mutable_data(), CONTAINER_SIZE);
+    container3.mutable_data()[Container::kMetaDataSize + 1] ^= 0xFF;
+    ASSERT_FALSE(container3.UnserializeMetadata(true));
+}
+
 TEST_F(ContainerTest, CopyFrom) {
     Container container(0, CONTAINER_SIZE, false);
     for (int i = 0; i < 4; i++) {
@@ -304,6 +389,55 @@ TEST_F(ContainerTest, StoreAndLoad) {
     ASSERT_TRUE(container.Equals(container2));
 }
 
+TEST_F(ContainerTest, CompressItems) {
+    Container container(Container::kLeastValidContainerId, CONTAINER_SIZE, false);
+    for (int i = 0; i < 8; i++) {
+        // Use small items to avoid an overflow
+        ASSERT_TRUE(container.AddItem((byte *) &test_fp[i], sizeof(test_fp[i]), (byte *) test_data[i], (size_t) 16 * 1024, true, NULL))
+        << "Add item " << i << " failed";
+    }
+    ASSERT_TRUE(container.DeleteItem((byte *) &test_fp[5], sizeof(test_fp[5])));
+    size_t old_pos = container.data_position();
+    size_t old_active_data_size = container.active_data_size();
+
+    dedupv1::base::Compression* comp = dedupv1::base::Compression::NewCompression(dedupv1::base::Compression::COMPRESSION_ZLIB_1);
+    ASSERT_TRUE(comp);
+    ASSERT_TRUE(container.CompressItems(comp));
+    delete comp;
+
+    // only the zero-filled items are compressible
+    ASSERT_LT(container.data_position(), old_pos);
+    ASSERT_LT(container.active_data_size(), old_active_data_size);
+    ASSERT_EQ(7U, container.item_count());
+
+    dedupv1::base::File* f = dedupv1::base::File::Open("work/container", O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    ASSERT_TRUE(f);
+    ASSERT_TRUE(container.StoreToFile(f, 0, true));
+    delete f;
+    f = NULL;
+
+    f = dedupv1::base::File::Open("work/container", O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    ASSERT_TRUE(f);
+    Container container2(Container::kLeastValidContainerId, CONTAINER_SIZE, false);
+    ASSERT_TRUE(container2.LoadFromFile(f, 0, true));
+    delete f;
+    f = NULL;
+
+    for (int i = 0; i < 8; i++) {
+        const ContainerItem* item = container2.FindItem(&test_fp[i], sizeof(test_fp[i]));
+        if (i == 5) {
+            ASSERT_FALSE(item);
+            continue;
+        }
+        ASSERT_TRUE(item);
+        ASSERT_EQ(item->raw_size(), (size_t) 16 * 1024);
+
+        byte buffer[item->raw_size()];
+        ASSERT_TRUE(container2.CopyRawData(item, buffer, 0, item->raw_size()));
+        ASSERT_TRUE(memcmp(buffer, test_data[i], item->raw_size()) == 0) << "Item " << i << " differs";
+    }
+}
+
 TEST_F(ContainerTest, AddAfterLoad) {
     EXPECT_LOGGING(dedupv1::test::ERROR).Once();
 
@@ -527,6 +661,95 @@ TEST_F(ContainerTest, MergeContainer) {
     }
 }
 
+TEST_F(ContainerTest, MergeContainerWithItemMessageFormat) {
+    dedupv1::base::Compression* comp = dedupv1::base::Compression::NewCompression(dedupv1::base::Compression::COMPRESSION_ZLIB_1);
+    ASSERT_TRUE(comp);
+
+    // container in the format used before the fixed item header
+    Container container(Container::kLeastValidContainerId, CONTAINER_SIZE, false);
+    container.format_version_ = CONTAINER_FORMAT_ITEM_MESSAGE;
+    for (int i = 0; i < 4; i++) {
+        // Use small items to avoid an overflow
+        ASSERT_TRUE(container.AddItem((byte *) &test_fp[i], sizeof(test_fp[i]), (byte *) test_data[i], (size_t) 16 * 1024, true, comp))
+        << "Add item " << i << " failed";
+    }
+    delete comp;
+    ASSERT_TRUE(container.SerializeMetadata(true));
+
+    Container container1(Container::kLeastValidContainerId, CONTAINER_SIZE, false);
+    memcpy(container1.mutable_data(), container.mutable_data(), CONTAINER_SIZE);
+    ASSERT_TRUE(container1.UnserializeMetadata(true));
+    ASSERT_EQ(container1.format_version(), CONTAINER_FORMAT_ITEM_MESSAGE);
+
+    Container container2(Container::kLeastValidContainerId + 1, CONTAINER_SIZE, false);
+    ASSERT_EQ(container2.format_version(), CONTAINER_FORMAT_FIXED_ITEM_HEADER);
+    for (int i = 4; i < 8; i++) {
+        // Use small items to avoid an overflow
+        ASSERT_TRUE(container2.AddItem((byte *) &test_fp[i], sizeof(test_fp[i]), (byte *) test_data[i], (size_t) 16 * 1024, true, NULL))
+        << "Add item " << i << " failed";
+        const ContainerItem* item = container2.FindItem((byte *) &test_fp[i], sizeof(test_fp[i]));
+        ASSERT_TRUE(item);
+        ASSERT_EQ(item->item_size(), 16 * 1024 + Container::kItemHeaderSize);
+    }
+
+    Container new_container(Storage::ILLEGAL_STORAGE_ADDRESS, CONTAINER_SIZE, false);
+    dedupv1::base::Option<bool> can_merge = new_container.CanMergeContainer(container1, container2);
+    ASSERT_TRUE(can_merge.valid());
+    ASSERT_TRUE(can_merge.value());
+    ASSERT_TRUE(new_container.MergeContainer(container1, container2));
+    ASSERT_EQ(new_container.format_version(), CONTAINER_FORMAT_FIXED_ITEM_HEADER);
+
+    for (int i = 0; i < 8; i++) {
+        byte result[16 * 1024];
+
+        const ContainerItem* item = container1.FindItem((byte *) &test_fp[i], sizeof(test_fp[i]));
+        if (i < 4) {
+            ASSERT_TRUE(item);
+            memset(result, 0, 16 * 1024);
+            ASSERT_TRUE(container1.CopyRawData(item, result, 0, 16 * 1024));
+            ASSERT_TRUE(memcmp(result, (byte *) test_data[i], 16 * 1024) == 0) << "Item " << i << " differs";
+        }
+
+        ContainerItem* new_item = new_container.FindItem((byte *) &test_fp[i], sizeof(test_fp[i]));
+        ASSERT_TRUE(new_item);
+        ASSERT_EQ(new_item->format_version(), CONTAINER_FORMAT_FIXED_ITEM_HEADER);
+        ASSERT_EQ(new_item->raw_size(), 16 * 1024U);
+        if (i < 4) {
+            dedupv1::base::Option<size_t> copied_item_size = new_container.GetCopiedItemSize(container1, *item);
+            ASSERT_TRUE(copied_item_size.valid());
+            ASSERT_EQ(copied_item_size.value(), new_item->item_size());
+        }
+
+        memset(result, 0, 16 * 1024);
+        ASSERT_TRUE(new_container.CopyRawData(new_item, result, 0, 16 * 1024));
+        ASSERT_TRUE(memcmp(result, (byte *) test_data[i], 16 * 1024) == 0) << "Item " << i << " differs";
+    }
+}
+
+TEST_F(ContainerTest, CanMergeContainer) {
+    Container container1(Container::kLeastValidContainerId, CONTAINER_SIZE, false);
+    Container container2(Container::kLeastValidContainerId + 1, CONTAINER_SIZE, false);
+    for (int i = 0; i < 4; i++) {
+        ASSERT_TRUE(container1.AddItem((byte *) &test_fp[i], sizeof(test_fp[i]), (byte *) test_data[i], (size_t) 64 * 1024, true, NULL))
+        << "Add item " << i << " failed";
+        ASSERT_TRUE(container2.AddItem((byte *) &test_fp[4 + i], sizeof(test_fp[4 + i]), (byte *) test_data[4 + i], (size_t) 64 * 1024, true, NULL))
+        << "Add item " << (4 + i) << " failed";
+    }
+
+    // both containers together have more data than fits into a container
+    Container new_container(Storage::ILLEGAL_STORAGE_ADDRESS, CONTAINER_SIZE, false);
+    dedupv1::base::Option<bool> can_merge = new_container.CanMergeContainer(container1, container2);
+    ASSERT_TRUE(can_merge.valid());
+    ASSERT_FALSE(can_merge.value());
+
+    ASSERT_TRUE(container2.DeleteItem((byte *) &test_fp[6], sizeof(test_fp[6])));
+    ASSERT_TRUE(container2.DeleteItem((byte *) &test_fp[7], sizeof(test_fp[7])));
+    can_merge = new_container.CanMergeContainer(container1, container2);
+    ASSERT_TRUE(can_merge.valid());
+    ASSERT_TRUE(can_merge.value());
+    ASSERT_TRUE(new_container.MergeContainer(container1, container2));
+}
+
 TEST_F(ContainerTest, MergeContainerSwitched) {
     Container container1(Container::kLeastValidContainerId, CONTAINER_SIZE, false);
     for (int i = 0; i < 2; i++) {
@@ -28,6 +28,9 @@ INSTANTIATE_TEST_CASE_P(DedupSystemDefault,
         "data/dedupv1_test.conf",
         "data/dedupv1_test.conf;storage.compression=lz4",
         "data/dedupv1_test.conf;storage.compression=snappy",
+        "data/dedupv1_test.conf;storage.compression=zstd",
+        "data/dedupv1_test.conf;storage.compression=lz4;storage.adaptive-compression=true",
+        "data/dedupv1_test.conf;storage.group-commit=true;storage.alloc.file-run-length=4",
         "data/dedupv1_test.conf;chunking.avg-chunk-size=16K;chunking.min-chunk-size=4K;chunking.max-chunk-size=64K",
         // sqlite
         "data/dedupv1_sqlite_test.conf",
@@ -0,0 +1,238 @@
+/*
+ * dedupv1 - iSCSI based Deduplication System for Linux
+ *
+ * (C) 2008 Dirk Meister
+ * (C) 2009 - 2011, Dirk Meister, Paderborn Center for Parallel Computing
+ * (C) 2012 Dirk Meister, Johannes Gutenberg University Mainz
+ *
+ * This file is part of dedupv1.
+ *
+ * dedupv1 is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * dedupv1 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with dedupv1. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include <gtest/gtest.h>
+
+#include <core/dedup.h>
+#include <core/read_ahead.h>
+#include <core/block_mapping.h>
+#include <base/logging.h>
+#include <base/option.h>
+#include <base/threadpool.h>
+
+#include <test_util/log_assert.h>
+#include <test/dedup_system_mock.h>
+#include <test/block_index_mock.h>
+#include <test/storage_mock.h>
+
+using testing::Return;
+using testing::Invoke;
+using testing::_;
+using dedupv1::base::make_option;
+using dedupv1::blockindex::BlockIndex;
+using dedupv1::blockindex::BlockMapping;
+using dedupv1::blockindex::BlockMappingItem;
+
+LOGGER("ReadAheadTest");
+
+namespace dedupv1 {
+
+namespace {
+/**
+ * Fills the block mapping so that always two consecutive blocks share a container
+ */
+BlockIndex::read_result ReadBlockInfoTwoBlocksPerContainer(const Session* session,
+                                                           BlockMapping* mapping,
+                                                           dedupv1::base::ErrorContext* ec) {
+    mapping->items().clear();
+    BlockMappingItem item(0, mapping->block_size());
+    item.set_data_address(1 + (mapping->block_id() / 2));
+    mapping->items().push_back(item);
+    return BlockIndex::READ_RESULT_MAIN;
+}
+}
+
+class ReadAheadTest : public testing::Test {
+protected:
+    static const uint32_t kBlockSize = 64 * 1024;
+    static const uint64_t kBlockCount = 1024;
+
+    USE_LOGGING_EXPECTATION();
+
+    MockDedupSystem system;
+    MockBlockIndex block_index;
+    MockStorage storage;
+    dedupv1::base::Threadpool tp;
+    ReadAhead::Statistics stats;
+    ReadAhead* read_ahead;
+
+    virtual void SetUp() {
+        ASSERT_TRUE(tp.SetOption("size", "4"));
+        ASSERT_TRUE(tp.Start());
+        system.set_threadpool(&tp);
+
+        EXPECT_CALL(system, block_index()).WillRepeatedly(Return(&block_index));
+        EXPECT_CALL(system, storage()).WillRepeatedly(Return(&storage));
+        EXPECT_CALL(system, block_size()).WillRepeatedly(Return(kBlockSize));
+        EXPECT_CALL(block_index, ReadBlockInfo(_, _, _)).WillRepeatedly(Invoke(ReadBlockInfoTwoBlocksPerContainer));
+
+        read_ahead = new ReadAhead(&stats);
+        ASSERT_TRUE(read_ahead);
+        ASSERT_TRUE(read_ahead->SetOption("enabled", "true"));
+        ASSERT_TRUE(read_ahead->SetOption("min-window", "4"));
+        ASSERT_TRUE(read_ahead->SetOption("max-window", "16"));
+    }
+
+    virtual void TearDown() {
+        if (read_ahead) {
+            delete read_ahead;
+            read_ahead = NULL;
+        }
+    }
+
+    /**
+     * Notifies the read-ahead about a read and waits for the fill task so that the
+     * results are deterministic.
+     */
+    void Read(uint64_t block) {
+        ASSERT_TRUE(read_ahead->Update(block * kBlockSize, kBlockSize, NO_EC));
+        read_ahead->WaitForFill();
+    }
+
+    void ReadSequential(uint64_t first_block, uint64_t block_count) {
+        for (uint64_t i = first_block; i < first_block + block_count; i++) {
+            ASSERT_NO_FATAL_FAILURE(Read(i));
+        }
+    }
+};
+
+TEST_F(ReadAheadTest, Init) {
+    // do nothing
+}
+
+TEST_F(ReadAheadTest, IllegalOptions) {
+    EXPECT_LOGGING(dedupv1::test::ERROR).Times(3);
+
+    EXPECT_FALSE(read_ahead->SetOption("min-window", "0"));
+    EXPECT_FALSE(read_ahead->SetOption("max-window", "abc"));
+    EXPECT_FALSE(read_ahead->SetOption("window-size", "4"));
+}
+
+TEST_F(ReadAheadTest, NoReadAheadForRandomReads) {
+    EXPECT_CALL(storage, Prefetch(_, _)).Times(0);
+    ASSERT_TRUE(read_ahead->Start(&system, 0, kBlockCount));
+
+    uint64_t blocks[] = {17, 400, 3, 900, 120, 64, 800};
+    for (int i = 0; i < 7; i++) {
+        ASSERT_NO_FATAL_FAILURE(Read(blocks[i]));
+    }
+    EXPECT_EQ(stats.mapping_reads_, 0U);
+    EXPECT_EQ(stats.sequential_reads_, 0U);
+    EXPECT_EQ(stats.random_reads_, 7U);
+}
+
+TEST_F(ReadAheadTest, SequentialRead) {
+    EXPECT_CALL(storage, Prefetch(_, _)).WillRepeatedly(Return(make_option(true)));
+    ASSERT_TRUE(read_ahead->Start(&system, 0, kBlockCount));
+
+    ReadSequential(0, 128);
+
+    EXPECT_GT(stats.prefetches_, 0U);
+    EXPECT_GT(stats.hits_, 0U);
+    EXPECT_EQ(stats.waste_, 0U);
+    // the window grows up to the maximum as all prefetches have been issued
+    EXPECT_EQ(read_ahead->window(), 16U);
+}
+
+TEST_F(ReadAheadTest, ContainersPrefetchedOnce) {
+    // every container is referenced by two blocks
+    EXPECT_CALL(storage, Prefetch(_, _)).WillRepeatedly(Return(make_option(true)));
+    ASSERT_TRUE(read_ahead->Start(&system, 0, kBlockCount));
+
+    ReadSequential(0, 256);
+    // the read-ahead reaches at most one maximal window beyond the reader
+    EXPECT_LE(stats.prefetches_, (256U + 16U) / 2U);
+    EXPECT_EQ(stats.prefetch_ignored_, 0U);
+}
+
+TEST_F(ReadAheadTest, WindowShrinksOnWaste) {
+    EXPECT_CALL(storage, Prefetch(_, _)).WillRepeatedly(Return(make_option(true)));
+    ASSERT_TRUE(read_ahead->Start(&system, 0, kBlockCount));
+
+    ReadSequential(0, 64);
+    uint32_t window = read_ahead->window();
+
+    // jump far away
+    ASSERT_NO_FATAL_FAILURE(Read(700));
+    EXPECT_GT(stats.waste_, 0U);
+    EXPECT_LT(read_ahead->window(), window);
+    EXPECT_GT(stats.window_decreases_, 0U);
+}
+
+TEST_F(ReadAheadTest, NoWindowGrowthIfCached) {
+    EXPECT_CALL(storage, Prefetch(_, _)).WillRepeatedly(Return(make_option(false)));
+    ASSERT_TRUE(read_ahead->Start(&system, 0, kBlockCount));
+
+    ReadSequential(0, 128);
+    EXPECT_EQ(stats.prefetches_, 0U);
+    EXPECT_GT(stats.prefetch_ignored_, 0U);
+    EXPECT_EQ(read_ahead->window(), 4U);
+}
+
+TEST_F(ReadAheadTest, StopAtVolumeEnd) {
+    EXPECT_CALL(storage, Prefetch(_, _)).WillRepeatedly(Return(make_option(true)));
+    ASSERT_TRUE(read_ahead->Start(&system, 0, 32));
+
+    ReadSequential(0, 32);
+    // no block mapping after the end of the volume is read
+    EXPECT_LE(stats.mapping_reads_, 32U);
+}
+
+TEST_F(ReadAheadTest, OutOfOrderSequentialRead) {
+    EXPECT_CALL(storage, Prefetch(_, _)).WillRepeatedly(Return(make_option(true)));
+    ASSERT_TRUE(read_ahead->Start(&system, 0, kBlockCount));
+
+    // a sequential stream served by two threads might be observed slightly out of order
+    for (uint64_t i = 0; i < 64; i += 2) {
+        ASSERT_NO_FATAL_FAILURE(Read(i + 1));
+        ASSERT_NO_FATAL_FAILURE(Read(i));
+    }
+    EXPECT_EQ(stats.random_reads_, 1U); // only the first read
+    EXPECT_GT(stats.prefetches_, 0U);
+}
+
+TEST_F(ReadAheadTest, DisabledByDefault) {
+    ReadAhead default_read_ahead(&stats);
+    ASSERT_FALSE(default_read_ahead.is_enabled());
+}
+
+TEST_F(ReadAheadTest, ReadWithoutWaitingForFill) {
+    EXPECT_CALL(storage, Prefetch(_, _)).WillRepeatedly(Return(make_option(true)));
+    ASSERT_TRUE(read_ahead->Start(&system, 0, kBlockCount));
+
+    // the fill task is submitted, but a single fill is running at a time
+    for (uint64_t i = 0; i < 64; i++) {
+        ASSERT_TRUE(read_ahead->Update(i * kBlockSize, kBlockSize, NO_EC));
+    }
+    read_ahead->WaitForFill();
+    EXPECT_GT(stats.mapping_reads_, 0U);
+    EXPECT_LE(stats.mapping_reads_, 64U + 16U);
+}
+
+TEST_F(ReadAheadTest, Disabled) {
+    EXPECT_CALL(storage, Prefetch(_, _)).Times(0);
+    ASSERT_TRUE(read_ahead->SetOption("enabled", "false"));
+    ASSERT_TRUE(read_ahead->Start(&system, 0, kBlockCount));
+
+    ReadSequential(0, 64);
+    EXPECT_EQ(stats.mapping_reads_, 0U);
+}
+
+}
@@ -34,6 +34,7 @@
 #include <core/dedupv1_scsi.h>
 #include <core/statistics.h>
 #include <core/info_store.h>
+#include <core/read_ahead.h>
 #include "dedupv1d.pb.h"
 
 #include "scst_handle.h"
@@ -439,6 +440,11 @@ class CommandHandler: public dedupv1::StatisticProvider {
          */
         Statistics stats_;
 
+        /**
+         * Statistics of the read-ahead of all sessions
+         */
+        dedupv1::ReadAhead::Statistics read_ahead_stats_;
+
         /**
          * Flag that denotes if the command handler is already started.
          */
@@ -533,6 +539,23 @@ class CommandHandlerSession: public ScstCommandHandler {
          */
         int thread_id_;
 
+        /**
+         * Read-ahead for sequential reads of this session.
+         * Started with the first read.
+         */
+        dedupv1::ReadAhead read_ahead_;
+
+        /**
+         * true iff the start of the read-ahead failed. The start is not retried.
+         */
+        bool read_ahead_start_failed_;
+
+        /**
+         * Configures the read-ahead with the read-ahead options of the volume and starts it.
+         * @return true iff ok, otherwise an error has occurred
+         */
+        bool StartReadAhead();
+
 #ifndef NO_SCST
         /**
          * Buffer for a SCST error message.
@@ -215,6 +215,12 @@ class Dedupv1dVolume: public dedupv1::StatisticProvider {
          */
         std::list<std::pair<std::string, std::string> > chunking_options_;
 
+        /**
+         * List of per-volume read-ahead options (with the "read-ahead." prefix).
+         * The options are applied to the read-ahead of every command handler session.
+         */
+        std::list<std::pair<std::string, std::string> > read_ahead_options_;
+
         /**
          * Info store
          */
@@ -263,6 +269,8 @@ class Dedupv1dVolume: public dedupv1::StatisticProvider {
          * - maintenance: Boolean
          * - filter: String
          * - chunking: String
+         * - read-ahead.*: Options of the read-ahead of the command handler sessions (see ReadAhead::SetOption).
+         *   The read-ahead is disabled by default and enabled with read-ahead.enabled=true.
          *
          * @param option_name
          * @param option
@@ -462,6 +470,11 @@ class Dedupv1dVolume: public dedupv1::StatisticProvider {
          */
         inline bool maintenance_mode() const;
 
+        /**
+         * returns the read-ahead options of the volume
+         */
+        inline const std::list<std::pair<std::string, std::string> >& read_ahead_options() const;
+
         /**
          * @return true iff ok, otherwise an error has occurred
          */
@@ -612,6 +625,10 @@ inline bool Dedupv1dVolume::maintenance_mode() const {
     return this->maintenance_mode_;
 }
 
+inline const std::list<std::pair<std::string, std::string> >& Dedupv1dVolume::read_ahead_options() const {
+    return this->read_ahead_options_;
+}
+
 }
 
 #endif  // DEDUPV1D_VOLUME_H__
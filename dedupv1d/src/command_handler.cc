@@ -55,6 +55,8 @@
 using std::string;
 using std::stringstream;
 using std::endl;
+using std::list;
+using std::pair;
 using dedupv1::base::strutil::ToString;
 using dedupv1::base::strutil::ToHexString;
 using dedupv1::scsi::SCSI_OK;
@@ -226,6 +228,17 @@ string CommandHandler::PrintStatistics() {
     sstr << "\"average write response time\": " << this->response_time_write_average_.GetAverage() << "," << std::endl;
     sstr << "\"average write throughput\": " << this->stats_.average_write_throughput() << "," << std::endl;
     sstr << "\"average read throughput\": " << this->stats_.average_read_throughput() << "," << std::endl;
+    sstr << "\"read ahead\": {" << std::endl;
+    sstr << "\"sequential reads\": " << this->read_ahead_stats_.sequential_reads_ << "," << std::endl;
+    sstr << "\"random reads\": " << this->read_ahead_stats_.random_reads_ << "," << std::endl;
+    sstr << "\"mapping reads\": " << this->read_ahead_stats_.mapping_reads_ << "," << std::endl;
+    sstr << "\"prefetches\": " << this->read_ahead_stats_.prefetches_ << "," << std::endl;
+    sstr << "\"prefetch ignored\": " << this->read_ahead_stats_.prefetch_ignored_ << "," << std::endl;
+    sstr << "\"hits\": " << this->read_ahead_stats_.hits_ << "," << std::endl;
+    sstr << "\"waste\": " << this->read_ahead_stats_.waste_ << "," << std::endl;
+    sstr << "\"window increases\": " << this->read_ahead_stats_.window_increases_ << "," << std::endl;
+    sstr << "\"window decreases\": " << this->read_ahead_stats_.window_decreases_ << std::endl;
+    sstr << "}," << std::endl;
     sstr << "\"scsi commands\": " << std::endl;
     sstr << "{" << endl;
     tbb::concurrent_unordered_map<byte, tbb::atomic<uint64_t> >::iterator i;
@@ -650,6 +663,17 @@ dedupv1::scsi::ScsiResult CommandHandlerSession::ExecuteRead(struct scst_user_sc
 
     this->ch->stats_.sector_read_count_ += (size / this->ch->GetVolume()->block_size());
 
+    // the read-ahead is only an optimization, a failure does not affect the read
+    if (read_ahead_start_failed_) {
+        // the read-ahead is not used by this session
+    } else if (!read_ahead_.is_started() && !StartReadAhead()) {
+        WARNING("Failed to start read-ahead: volume " << this->ch->volume_->DebugString());
+        read_ahead_start_failed_ = true;
+    } else if (!read_ahead_.Update(offset, size, &ec)) {
+        WARNING("Read-ahead failed: offset " << offset <<
+            ", size " << size <<
+            ", volume " << this->ch->volume_->DebugString());
+    }
     return ScsiResult::kOk;
 }
 
@@ -1413,9 +1437,32 @@ bool CommandHandlerSession::OnFreeCachedMemory(uint32_t cmd_h, uint64_t sess_h,
 }
 #endif
 
-CommandHandlerSession::CommandHandlerSession(CommandHandler* ch, int thread_id) {
+CommandHandlerSession::CommandHandlerSession(CommandHandler* ch, int thread_id) :
+    read_ahead_(&ch->read_ahead_stats_) {
     this->ch = ch;
     this->thread_id_ = thread_id;
+    this->read_ahead_start_failed_ = false;
+}
+
+bool CommandHandlerSession::StartReadAhead() {
+    DCHECK(ch, "Command handler not set");
+    DCHECK(ch->GetVolume(), "Volume not set");
+    dedupv1::DedupVolume* volume = ch->GetVolume()->volume();
+    CHECK(volume, "Volume not set");
+    CHECK(volume->dedup_system(), "Volume not started");
+
+    list<pair<string, string> >::const_iterator i;
+    for (i = ch->GetVolume()->read_ahead_options().begin(); i != ch->GetVolume()->read_ahead_options().end(); i++) {
+        CHECK(read_ahead_.SetOption(i->first.substr(strlen("read-ahead.")), i->second),
+            "Failed to configure read-ahead: " << i->first << "=" << i->second);
+    }
+
+    uint64_t start_block_id = 0;
+    uint64_t end_block_id = 0;
+    CHECK(volume->GetBlockInterval(&start_block_id, &end_block_id), "Failed to get block interval");
+    CHECK(read_ahead_.Start(volume->dedup_system(), start_block_id, end_block_id),
+        "Failed to start read-ahead");
+    return true;
 }
 
 CommandHandlerSession::~CommandHandlerSession() {
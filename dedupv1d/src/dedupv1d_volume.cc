@@ -38,6 +38,7 @@
 #include <core/fingerprinter.h>
 #include <base/threadpool.h>
 #include <core/dedup_volume.h>
+#include <core/read_ahead.h>
 #include <base/logging.h>
 #include <base/bitutil.h>
 #include <base/hashing_util.h>
@@ -200,6 +201,11 @@ bool Dedupv1dVolume::ParseFrom(const VolumeInfoData& volume_info) {
                 volume_info.chunking_options(i).option()),
             "Failed to set chunking option");
     }
+    for (int i = 0; i < volume_info.read_ahead_options_size(); i++) {
+        CHECK(this->SetOption(volume_info.read_ahead_options(i).option_name(),
+                volume_info.read_ahead_options(i).option()),
+            "Failed to set read-ahead option");
+    }
     return true;
 }
 
@@ -266,6 +272,15 @@ bool Dedupv1dVolume::SetOption(const string& option_name, const string& option)
         this->maintenance_mode_ = To<bool>(option).value();
         return true;
     }
+    if (StartsWith(option_name, "read-ahead.")) {
+        // check the option with a temporary read-ahead. The options are applied when a session starts its read-ahead.
+        dedupv1::ReadAhead::Statistics read_ahead_stats;
+        dedupv1::ReadAhead read_ahead(&read_ahead_stats);
+        CHECK(read_ahead.SetOption(option_name.substr(strlen("read-ahead.")), option),
+            "Illegal read-ahead option: " << option_name << "=" << option);
+        this->read_ahead_options_.push_back(make_pair(option_name, option));
+        return true;
+    }
     if (StartsWith(option_name, "filter")) {
         this->filter_options_.push_back(make_pair(option_name, option));
         // fall through
@@ -747,6 +762,11 @@ bool Dedupv1dVolume::SerializeTo(VolumeInfoData* data) const {
         op->set_option_name(j->first);
         op->set_option(j->second);
     }
+    for (j = read_ahead_options_.begin(); j != read_ahead_options_.end(); j++) {
+        OptionPair* op =  data->add_read_ahead_options();
+        op->set_option_name(j->first);
+        op->set_option(j->second);
+    }
 
     if (this->maintenance_mode()) {
         data->set_state(VOLUME_STATE_MAINTENANCE);